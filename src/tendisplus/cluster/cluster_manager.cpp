@@ -835,6 +835,17 @@ void ClusterState::clusterSendFail(CNodePtr node, uint64_t offset) {
   clusterBroadcastMessage(msg);
 }
 
+void ClusterState::clusterPropagatePublish(const std::string& channel,
+                                           const std::string& message) {
+  std::lock_guard<myMutex> lk(_mutex);
+  ClusterMsg msg(ClusterMsg::Type::PUBLISH,
+                 shared_from_this(),
+                 _server,
+                 _server->getReplManager()->replicationGetOffset());
+  msg.setData(std::make_shared<ClusterMsgDataPublish>(channel, message));
+  clusterBroadcastMessage(msg);
+}
+
 void ClusterState::clusterBroadcastMessage(ClusterMsg& msg) {
   for (const auto& nodep : _nodes) {
     const auto& node = nodep.second;
@@ -2847,6 +2858,9 @@ ClusterMsg::ClusterMsg(const ClusterMsg::Type type,
       _msgData = std::move(std::make_shared<ClusterMsgDataUpdate>(
         node->getConfigEpoch(), node->getNodeName(), node->getSlots()));
       break;
+    case Type::PUBLISH:
+      // the payload is set by the caller through setData()
+      break;
     case Type::FAILOVER_AUTH_ACK:
     case Type::MFSTART:
       if (cstate->getMyselfNode()->nodeIsMaster() && cstate->getMfEnd()) {
@@ -3027,6 +3041,13 @@ Expected<ClusterMsg> ClusterMsg::msgDecode(const std::string& key) {
     }
     msgDataPtr =
       std::make_shared<ClusterMsgDataFail>(std::move(msgFdata.value()));
+  } else if (type == Type::PUBLISH) {
+    auto msgPdata = ClusterMsgDataPublish::dataDecode(msgStr);
+    if (!msgPdata.ok()) {
+      return msgPdata.status();
+    }
+    msgDataPtr =
+      std::make_shared<ClusterMsgDataPublish>(std::move(msgPdata.value()));
   } else if (type == Type::FAILOVER_AUTH_ACK ||
              type == Type::FAILOVER_AUTH_REQUEST || type == Type::MFSTART) {
     msgDataPtr = nullptr;
@@ -3382,6 +3403,44 @@ Expected<ClusterMsgDataFail> ClusterMsgDataFail::dataDecode(
   return ClusterMsgDataFail(msg);
 }
 
+size_t ClusterMsgDataPublish::fixedSize() {
+  return sizeof(uint32_t) + sizeof(uint32_t);
+}
+
+std::string ClusterMsgDataPublish::dataEncode() const {
+  std::vector<uint8_t> key;
+  key.reserve(fixedSize() + _channel.size() + _message.size());
+  CopyUint(&key, static_cast<uint32_t>(_channel.size()));
+  CopyUint(&key, static_cast<uint32_t>(_message.size()));
+  key.insert(key.end(), _channel.begin(), _channel.end());
+  key.insert(key.end(), _message.begin(), _message.end());
+
+  return std::string(reinterpret_cast<const char*>(key.data()), key.size());
+}
+
+Expected<ClusterMsgDataPublish> ClusterMsgDataPublish::dataDecode(
+  const std::string& msg) {
+  if (msg.size() < fixedSize()) {
+    return {ErrorCodes::ERR_DECODE, "decode publish length less than minsize"};
+  }
+  size_t offset = 0;
+  auto decode = [&](auto func) {
+    auto n = func(msg.c_str() + offset);
+    offset += sizeof(n);
+    return n;
+  };
+  uint32_t channelLen = decode(int32Decode);
+  uint32_t messageLen = decode(int32Decode);
+  if (msg.size() - offset != (uint64_t)channelLen + messageLen) {
+    return {ErrorCodes::ERR_DECODE, "invalid publish data length"};
+  }
+  std::string channel(msg.c_str() + offset, channelLen);
+  offset += channelLen;
+  std::string message(msg.c_str() + offset, messageLen);
+
+  return ClusterMsgDataPublish(channel, message);
+}
+
 ClusterGossip::ClusterGossip(const std::shared_ptr<ClusterNode> node)
   : _gossipName(node->getNodeName()),
     _pingSent(node->_pingSent / 1000),
@@ -5223,7 +5282,13 @@ Status ClusterState::clusterProcessPacket(std::shared_ptr<ClusterSession> sess,
     }
 
   } else if (type == ClusterMsg::Type::PUBLISH) {
-    INVARIANT_D(0);
+    if (!sender)
+      return {ErrorCodes::ERR_OK, ""}; /* We don't know that node. */
+    auto pubMsg =
+      std::dynamic_pointer_cast<ClusterMsgDataPublish>(msg.getData());
+    INVARIANT_D(pubMsg != nullptr);
+    _server->getPubSubMgr()->publish(pubMsg->getChannel(),
+                                     pubMsg->getMessage());
   } else if (type == ClusterMsg::Type::FAILOVER_AUTH_REQUEST) {
     if (!sender)
       return {ErrorCodes::ERR_OK, ""}; /* We don't know that node. */
@@ -337,6 +337,9 @@ class ClusterMsg {
   std::shared_ptr<ClusterMsgData> getData() const {
     return _msgData;
   }
+  void setData(const std::shared_ptr<ClusterMsgData>& data) {
+    _msgData = data;
+  }
 
   uint32_t getTotlen() const {
     return _totlen;
@@ -482,6 +485,29 @@ class ClusterMsgDataFail : public ClusterMsgData {
   std::string _nodeName;
 };
 
+class ClusterMsgDataPublish : public ClusterMsgData {
+ public:
+  ClusterMsgDataPublish(const std::string& channel, const std::string& message)
+    : ClusterMsgData(ClusterMsgData::Type::PUBLIC),
+      _channel(channel),
+      _message(message) {}
+  ClusterMsgDataPublish(const ClusterMsgDataPublish&) = delete;
+  ClusterMsgDataPublish(ClusterMsgDataPublish&&) = default;
+  const std::string& getChannel() const {
+    return _channel;
+  }
+  const std::string& getMessage() const {
+    return _message;
+  }
+  static size_t fixedSize();
+  std::string dataEncode() const override;
+  static Expected<ClusterMsgDataPublish> dataDecode(const std::string& msg);
+
+ private:
+  std::string _channel;
+  std::string _message;
+};
+
 class NetSession;
 class NetworkMatrix;
 class RequestMatrix;
@@ -627,6 +653,9 @@ class ClusterState : public std::enable_shared_from_this<ClusterState> {
 
   void clusterBroadcastPong(int target, uint64_t offset);
   void clusterSendFail(CNodePtr node, uint64_t offset);
+  // forward PUBLISH to all the other nodes through the cluster bus
+  void clusterPropagatePublish(const std::string& channel,
+                               const std::string& message);
   // TODO(vinchen): make it const reference
   void clusterBroadcastMessage(ClusterMsg& msg);  // NOLINT
 
@@ -1757,10 +1757,54 @@ void testDeleteChunks(std::shared_ptr<ServerEntry> svr,
   }
 }
 
+// a gc_* field of CLUSTER GCINFO
+uint64_t getGcInfo(std::shared_ptr<ServerEntry> svr,
+                   const std::string& field) {
+  auto ctx = std::make_shared<asio::io_context>();
+  auto sess = makeSession(svr, ctx);
+  sess->setArgs({"cluster", "gcinfo"});
+  auto expect = Command::runSessionCmd(sess.get());
+  EXPECT_TRUE(expect.ok());
+  const std::string& info = expect.value();
+  auto pos = info.find(field + ":");
+  EXPECT_NE(pos, std::string::npos) << field;
+  if (pos == std::string::npos) {
+    return 0;
+  }
+  pos += field.size() + 1;
+  auto value =
+    ::tendisplus::stoul(info.substr(pos, info.find('\r', pos) - pos));
+  EXPECT_TRUE(value.ok());
+  return value.value();
+}
+
 void testDeleteRange(std::shared_ptr<ServerEntry> svr,
                      uint32_t storeid,
                      uint32_t start,
                      uint32_t end) {
+  // the keys are in the sst files, so the bytes reclaimed are known
+  auto expdb = svr->getSegmentMgr()->getDb(
+    nullptr, storeid, mgl::LockMode::LOCK_IS, false, 0);
+  EXPECT_TRUE(expdb.ok());
+  EXPECT_TRUE(expdb.value().store->fullCompact().ok());
+  auto deleted = getGcInfo(svr, "gc_tasks_deleted");
+  auto compacted = getGcInfo(svr, "gc_tasks_compacted");
+  auto slots = getGcInfo(svr, "gc_slots_deleted");
+  auto reclaimed = getGcInfo(svr, "gc_reclaimed_bytes");
+  auto failed = getGcInfo(svr, "gc_tasks_failed");
+  auto begin =
+    RecordKey(start, 0, RecordType::RT_INVALID, "", "").prefixChunkid();
+  auto stop =
+    RecordKey(end + 1, 0, RecordType::RT_INVALID, "", "").prefixChunkid();
+  auto sizeBefore = expdb.value().store->getApproximateSize(begin, stop);
+  EXPECT_GT(sizeBefore, 0u);
+  uint64_t slotsInStore = 0;
+  for (size_t i = start; i <= end; ++i) {
+    if (svr->getSegmentMgr()->getStoreid(i) == storeid) {
+      slotsInStore++;
+    }
+  }
+
   svr->getGcMgr()->deleteChunks(storeid, start, end);
   std::this_thread::sleep_for(std::chrono::seconds(8));
   for (size_t i = start; i <= end; ++i) {
@@ -1769,6 +1813,24 @@ void testDeleteRange(std::shared_ptr<ServerEntry> svr,
       EXPECT_EQ(c, 0);
     }
   }
+
+  // garbage-compact-idle-ops is 0, the range is compacted at once
+  EXPECT_GT(getGcInfo(svr, "gc_tasks_deleted"), deleted);
+  EXPECT_GT(getGcInfo(svr, "gc_tasks_compacted"), compacted);
+  EXPECT_EQ(getGcInfo(svr, "gc_slots_deleted"), slots + slotsInStore);
+  EXPECT_GT(getGcInfo(svr, "gc_reclaimed_bytes"), reclaimed);
+  EXPECT_EQ(getGcInfo(svr, "gc_tasks_pending_delete"), 0);
+  EXPECT_EQ(getGcInfo(svr, "gc_tasks_pending_compact"), 0);
+  EXPECT_EQ(getGcInfo(svr, "gc_tasks_failed"), failed);
+  EXPECT_LT(expdb.value().store->getApproximateSize(begin, stop), sizeBefore);
+
+  // INFO gc shows the same fields
+  auto ctx = std::make_shared<asio::io_context>();
+  auto sess = makeSession(svr, ctx);
+  sess->setArgs({"info", "gc"});
+  auto expect = Command::runSessionCmd(sess.get());
+  EXPECT_TRUE(expect.ok());
+  EXPECT_NE(expect.value().find("gc_reclaimed_bytes:"), std::string::npos);
 }
 
 TEST(Cluster, deleteChunks) {
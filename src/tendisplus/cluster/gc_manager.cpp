@@ -13,7 +13,12 @@ GCManager::GCManager(std::shared_ptr<ServerEntry> svr)
   : _svr(svr),
     _cstate(svr->getClusterMgr()->getClusterState()),
     _isRunning(false),
-    _gcDeleterMatrix(std::make_shared<PoolMatrix>()) {
+    _gcDeleterMatrix(std::make_shared<PoolMatrix>()),
+    _deletedTasks(0),
+    _compactedTasks(0),
+    _failedTasks(0),
+    _deletedSlots(0),
+    _reclaimedBytes(0) {
   _svr->getParams()
     ->serverParamsVar("garbageDeleteThreadnum")
     ->setUpdate([this]() {
@@ -142,10 +147,36 @@ Status GCManager::startDeleteTask(uint32_t storeid,
   return {ErrorCodes::ERR_OK, ""};
 }
 
+void GCManager::releaseSlots(DeleteRangeTask* task) {
+  if (task->_slotsReleased) {
+    return;
+  }
+  for (uint32_t i = task->_slotStart; i <= task->_slotEnd; i++) {
+    if (_svr->getSegmentMgr()->getStoreid(i) == task->_storeid) {
+      _deletingSlots.reset(i);
+    }
+  }
+  task->_slotsReleased = true;
+}
+
+bool GCManager::canCompact(const DeleteRangeTask* task,
+                           const SCLOCK::time_point& now) const {
+  const auto& params = _svr->getParams();
+  if (params->garbageCompactIdleOps == 0 ||
+      now >= task->_deletedTime +
+          chrono::seconds(params->garbageCompactMaxDelay)) {
+    return true;
+  }
+  auto ops =
+    _svr->getServerStat().getInstantaneousMetric(STATS_METRIC_COMMAND);
+  return ops < params->garbageCompactIdleOps;
+}
+
 // garbage dat delete schedule job
 bool GCManager::gcSchedule(const SCLOCK::time_point& now) {
   bool doSth = false;
   std::list<std::shared_ptr<DeleteRangeTask>> startDeletingTask;
+  std::list<std::shared_ptr<DeleteRangeTask>> startCompactingTask;
   {
     std::lock_guard<myMutex> lk(_mutex);
     for (auto it = _deleteChunkTask.begin(); it != _deleteChunkTask.end();) {
@@ -153,40 +184,53 @@ bool GCManager::gcSchedule(const SCLOCK::time_point& now) {
         ++it;
         continue;
       }
-      doSth = true;
       auto startPos = (*it)->_slotStart;
       auto endPos = (*it)->_slotEnd;
-      auto storeid = (*it)->_storeid;
       if ((*it)->_state == DeleteRangeState::START) {
+        doSth = true;
         LOG(INFO) << "deletetask start,"
                   << " from:" << startPos << " to:" << endPos;
         (*it)->_isRunning = true;
         startDeletingTask.push_back(*it);
         ++it;
+      } else if ((*it)->_state == DeleteRangeState::COMPACT) {
+        if (!canCompact(it->get(), now)) {
+          // check it again later
+          (*it)->_nextSchedTime = now + chrono::seconds(1);
+          ++it;
+          continue;
+        }
+        doSth = true;
+        LOG(INFO) << "garbage compact start,"
+                  << " from:" << startPos << " to:" << endPos;
+        (*it)->_isRunning = true;
+        startCompactingTask.push_back(*it);
+        ++it;
       } else if ((*it)->_state == DeleteRangeState::SUCC) {
+        doSth = true;
         LOG(INFO) << "garbage delete success,"
                   << " from:" << startPos << " to:" << endPos;
-        for (uint32_t i = startPos; i <= endPos; i++) {
-          if (_svr->getSegmentMgr()->getStoreid(i) == storeid)
-            _deletingSlots.reset(i);
-        }
+        releaseSlots(it->get());
         it = _deleteChunkTask.erase(it);
         continue;
       } else if ((*it)->_state == DeleteRangeState::ERR) {
+        doSth = true;
         LOG(ERROR) << "garbage delete failed,"
                    << " from:" << startPos << " to:" << endPos;
-        for (uint32_t i = startPos; i <= endPos; i++) {
-          if (_svr->getSegmentMgr()->getStoreid(i) == storeid) {
-            _deletingSlots.reset(i);
-          }
-        }
+        releaseSlots(it->get());
         /*NOTE (wayenchen) no need rerty again,
         beacause croncheck job will do the fail job */
         it = _deleteChunkTask.erase(it);
         continue;
+      } else {
+        ++it;
       }
     }
   }
+  for (auto& task : startCompactingTask) {
+    _gcDeleter->schedule(
+      [this, iter = task.get()]() { garbageCompact(iter); });
+  }
   /* NOTE(wayenchen) delete task is running in Db lock, so it can not be
    * running in mutex */
   for (auto it = startDeletingTask.begin(); it != startDeletingTask.end();) {
@@ -342,9 +386,20 @@ void GCManager::garbageDelete(DeleteRangeTask* task) {
   if (!s.ok()) {
     LOG(ERROR) << "fail delete slots range" << s.toString();
     task->_state = DeleteRangeState::ERR;
+    _failedTasks++;
   } else {
     auto end = msSinceEpoch();
-    task->_state = DeleteRangeState::SUCC;
+    // the keys are gone, the slots can be used again before the
+    // compaction
+    task->_state = DeleteRangeState::COMPACT;
+    task->_deletedTime = SCLOCK::now();
+    releaseSlots(task);
+    _deletedTasks++;
+    for (uint32_t i = task->_slotStart; i <= task->_slotEnd; i++) {
+      if (_svr->getSegmentMgr()->getStoreid(i) == task->_storeid) {
+        _deletedSlots++;
+      }
+    }
     serverLog(LL_NOTICE,
               "GCManager::garbageDelete success"
               "from: [%u] to [%u] [total used time:%lu]",
@@ -356,6 +411,58 @@ void GCManager::garbageDelete(DeleteRangeTask* task) {
   task->_isRunning = false;
 }
 
+void GCManager::garbageCompact(DeleteRangeTask* task) {
+  uint64_t start = msSinceEpoch();
+  auto reclaimed = task->compactSlotRange();
+  std::lock_guard<myMutex> lk(_mutex);
+  if (!reclaimed.ok()) {
+    LOG(ERROR) << "fail compact slots range" << reclaimed.status().toString();
+    task->_state = DeleteRangeState::ERR;
+    _failedTasks++;
+  } else {
+    task->_state = DeleteRangeState::SUCC;
+    _compactedTasks++;
+    _reclaimedBytes += reclaimed.value();
+    serverLog(LL_NOTICE,
+              "GCManager::garbageCompact success"
+              "from: [%u] to [%u] [reclaimed bytes:%lu] [used time:%lu]",
+              task->_slotStart,
+              task->_slotEnd,
+              reclaimed.value(),
+              msSinceEpoch() - start);
+  }
+  task->_nextSchedTime = SCLOCK::now();
+  task->_isRunning = false;
+}
+
+void GCManager::getGcInfo(std::stringstream& ss) {
+  uint64_t pendingDelete = 0;
+  uint64_t pendingCompact = 0;
+  {
+    std::lock_guard<myMutex> lk(_mutex);
+    for (const auto& task : _deleteChunkTask) {
+      if (task->_state == DeleteRangeState::START) {
+        pendingDelete++;
+      } else if (task->_state == DeleteRangeState::COMPACT) {
+        pendingCompact++;
+      }
+    }
+  }
+  ss << "gc_tasks_pending_delete:" << pendingDelete << "\r\n";
+  ss << "gc_tasks_pending_compact:" << pendingCompact << "\r\n";
+  ss << "gc_tasks_deleted:" << _deletedTasks.load() << "\r\n";
+  ss << "gc_tasks_compacted:" << _compactedTasks.load() << "\r\n";
+  ss << "gc_tasks_failed:" << _failedTasks.load() << "\r\n";
+  ss << "gc_slots_deleted:" << _deletedSlots.load() << "\r\n";
+  ss << "gc_reclaimed_bytes:" << _reclaimedBytes.load() << "\r\n";
+}
+
+std::pair<std::string, std::string> DeleteRangeTask::getRange() const {
+  RecordKey rkStart(_slotStart, 0, RecordType::RT_INVALID, "", "");
+  RecordKey rkEnd(_slotEnd + 1, 0, RecordType::RT_INVALID, "", "");
+  return {rkStart.prefixChunkid(), rkEnd.prefixChunkid()};
+}
+
 Status DeleteRangeTask::deleteSlotRange() {
   auto expdb =
     _svr->getSegmentMgr()->getDb(NULL, _storeid, mgl::LockMode::LOCK_IS);
@@ -364,10 +471,26 @@ Status DeleteRangeTask::deleteSlotRange() {
     return expdb.status();
   }
   PStore kvstore = expdb.value().store;
-  RecordKey rkStart(_slotStart, 0, RecordType::RT_INVALID, "", "");
-  RecordKey rkEnd(_slotEnd + 1, 0, RecordType::RT_INVALID, "", "");
-  string start = rkStart.prefixChunkid();
-  string end = rkEnd.prefixChunkid();
+  auto range = getRange();
+  const string& start = range.first;
+  const string& end = range.second;
+  _sizeBefore = kvstore->getApproximateSize(start, end);
+
+  // NOTE: the files fully in the range are dropped at once, no range
+  // tombstones or compaction needed for them
+  if (_svr->getParams()->garbageDeleteFiles) {
+    auto s = kvstore->deleteFilesInRange(start, end);
+    if (!s.ok()) {
+      serverLog(LL_NOTICE,
+                "DeleteRangeTask::deleteFilesInRange failed,"
+                "from [startSlot:%u] to [endSlot:%u] [bad response:%s]",
+                _slotStart,
+                _slotEnd,
+                s.toString().c_str());
+      return s;
+    }
+  }
+
   auto s = kvstore->deleteRange(start, end);
 
   if (!s.ok()) {
@@ -379,11 +502,30 @@ Status DeleteRangeTask::deleteSlotRange() {
               s.toString().c_str());
     return s;
   }
+
+  serverLog(LL_VERBOSE,
+            "DeleteRangeTask::deleteRange finished,"
+            "from [startSlot: %u] to [endSlot: %u]",
+            _slotStart,
+            _slotEnd);
+
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<uint64_t> DeleteRangeTask::compactSlotRange() {
+  auto expdb =
+    _svr->getSegmentMgr()->getDb(NULL, _storeid, mgl::LockMode::LOCK_IS);
+  if (!expdb.ok()) {
+    LOG(ERROR) << "getDb failed:" << _storeid;
+    return expdb.status();
+  }
+  PStore kvstore = expdb.value().store;
+  auto range = getRange();
   // NOTE(takenliu) after deleteRange, cursor seek will scan all the keys in
   // delete range,
   //     so we call compactRange to real delete the keys.
-  s = kvstore->compactRange(
-    ColumnFamilyNumber::ColumnFamily_Default, &start, &end);
+  auto s = kvstore->compactRange(
+    ColumnFamilyNumber::ColumnFamily_Default, &range.first, &range.second);
 
   if (!s.ok()) {
     serverLog(LL_NOTICE,
@@ -395,13 +537,14 @@ Status DeleteRangeTask::deleteSlotRange() {
     return s;
   }
 
+  uint64_t sizeAfter = kvstore->getApproximateSize(range.first, range.second);
   serverLog(LL_VERBOSE,
-            "DeleteRangeTask::deleteRange finished,"
+            "DeleteRangeTask::compactRange finished,"
             "from [startSlot: %u] to [endSlot: %u]",
             _slotStart,
             _slotEnd);
 
-  return {ErrorCodes::ERR_OK, ""};
+  return _sizeBefore > sizeAfter ? _sizeBefore - sizeAfter : 0;
 }
 
 void GCManager::garbageDeleterResize(size_t size) {
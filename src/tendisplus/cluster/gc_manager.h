@@ -7,6 +7,7 @@
 
 #include <list>
 #include <memory>
+#include <sstream>
 #include <string>
 #include <utility>
 
@@ -24,7 +25,9 @@ using mstime_t = uint64_t;
 using SlotsBitmap = std::bitset<CLUSTER_SLOTS>;
 using myMutex = std::recursive_mutex;
 
-enum class DeleteRangeState { NONE = 0, START, SUCC, ERR };
+// START -> COMPACT -> SUCC, the slots are released after the delete,
+// the compaction waits for a quiet moment.
+enum class DeleteRangeState { NONE = 0, START, SUCC, ERR, COMPACT };
 
 class DeleteRangeTask {
  public:
@@ -37,7 +40,9 @@ class DeleteRangeTask {
       _slotEnd(slotIdEnd),
       _svr(svr),
       _isRunning(false),
-      _state(DeleteRangeState::START) {}
+      _state(DeleteRangeState::START),
+      _slotsReleased(false),
+      _sizeBefore(0) {}
 
   uint32_t _storeid;
   uint32_t _slotStart;
@@ -47,7 +52,20 @@ class DeleteRangeTask {
   SCLOCK::time_point _nextSchedTime;
   mutable myMutex _mutex;
   DeleteRangeState _state;
+  // _deletingSlots are reset for the task
+  bool _slotsReleased;
+  // when the range was deleted, the compaction waits no longer than
+  // garbageCompactMaxDelay after it
+  SCLOCK::time_point _deletedTime;
+  // the approximate size of the range before deleting
+  uint64_t _sizeBefore;
+  // drop the sst files in the range, then deleteRange() the rest
   Status deleteSlotRange();
+  // compact the range tombstones away, returns the bytes reclaimed
+  Expected<uint64_t> compactSlotRange();
+
+ private:
+  std::pair<std::string, std::string> getRange() const;
 };
 
 using SlotsBitmap = std::bitset<CLUSTER_SLOTS>;
@@ -73,10 +91,19 @@ class GCManager {
   void garbageDeleterResize(size_t size);
   size_t garbageDeleterSize();
   Status delGarbage();
+  // the gc_* fields of INFO gc and CLUSTER GCINFO
+  void getGcInfo(std::stringstream& ss);
 
  private:
   void controlRoutine();
   bool gcSchedule(const SCLOCK::time_point& now);
+  // should be called with _mutex held
+  void releaseSlots(DeleteRangeTask* task);
+  // true if the server is quiet enough to compact, or the task has
+  // waited too long
+  bool canCompact(const DeleteRangeTask* task,
+                  const SCLOCK::time_point& now) const;
+  void garbageCompact(DeleteRangeTask* task);
   SlotsBitmap getCheckList();
   Status startDeleteTask(uint32_t storeid,
                          uint32_t slotStart,
@@ -102,6 +129,12 @@ class GCManager {
 
   // slots in deleting task
   std::bitset<CLUSTER_SLOTS> _deletingSlots;
+
+  std::atomic<uint64_t> _deletedTasks;
+  std::atomic<uint64_t> _compactedTasks;
+  std::atomic<uint64_t> _failedTasks;
+  std::atomic<uint64_t> _deletedSlots;
+  std::atomic<uint64_t> _reclaimedBytes;
 };
 
 }  // namespace tendisplus
@@ -612,6 +612,8 @@ void MigrateSendTask::deleteSenderChunks() {
       _sender->setSenderStatus(MigrateSenderStatus::DEL_DONE);
       _state = MigrateSendState::SUCC;
     }
+    // slots belong to dst now, blocked clients get MOVED when running again
+    _svr->getBlockMgr()->wakeupBySlots(_slots);
   }
   _nextSchedTime = SCLOCK::now();
   _isRunning = false;
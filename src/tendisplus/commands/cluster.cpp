@@ -637,6 +637,10 @@ class ClusterCommand : public Command {
         return s;
       }
       return Command::fmtOK();
+    } else if (arg1 == "gcinfo" && argSize == 2) {
+      std::stringstream ss;
+      gcMgr->getGcInfo(ss);
+      return Command::fmtBulk(ss.str());
     }
     return {ErrorCodes::ERR_CLUSTER, "Invalid cluster command " + args[1]};
   }
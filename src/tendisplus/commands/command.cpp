@@ -7,6 +7,7 @@
 #include <map>
 #include <utility>
 #include <list>
+#include <algorithm>
 #include <limits>
 #include <vector>
 #include <unordered_set>
@@ -253,6 +254,16 @@ Expected<Command*> Command::precheck(Session* sess) {
     return {ErrorCodes::ERR_AUTH, "-NOAUTH Authentication required.\r\n"};
   }
 
+  if ((pCtx->getFlags() & CLIENT_PUBSUB)) {
+    const auto& name = it->second->getName();
+    if (name != "subscribe" && name != "psubscribe" && name != "unsubscribe" &&
+        name != "punsubscribe" && name != "ping" && name != "quit") {
+      return {ErrorCodes::ERR_PARSEPKT,
+              "only (P)SUBSCRIBE / (P)UNSUBSCRIBE / PING / QUIT allowed in "
+              "this context"};
+    }
+  }
+
   return it->second;
 }
 
@@ -266,6 +277,14 @@ Expected<std::string> Command::runSessionCmd(Session* sess) {
     LOG(FATAL) << "BUG: command:" << args[0] << " not found!";
   }
 
+  // the commands between MULTI and EXEC are run by EXEC, see execCommand
+  auto pCtx = sess->getCtx();
+  if (pCtx->isInMulti() && !pCtx->isEp() && commandName != "exec" &&
+      commandName != "discard" && commandName != "multi") {
+    pCtx->queueMultiCmd(args);
+    return std::string("+QUEUED\r\n");
+  }
+
   // TODO(vinchen): here there is a copy, it is a waste.
   sess->getCtx()->setArgsBrief(sess->getArgs());
   it->second->incrCallTimes();
@@ -277,7 +296,30 @@ Expected<std::string> Command::runSessionCmd(Session* sess) {
     sess->getServerEntry()->slowlogPushEntryIfNeeded(
       now / 1000, duration / 1000, sess);
   });
+
+  // client side caching, the keys are collected by the key lock path
+  auto trackingMgr = sess->getServerEntry()->getTrackingMgr();
+  auto tracking = SessionCtx::KeyTracking::NONE;
+  if (trackingMgr->isActive()) {
+    if (it->second->getFlags() & CMD_WRITE) {
+      tracking = SessionCtx::KeyTracking::WRITE;
+    } else if ((it->second->getFlags() & CMD_READONLY) &&
+               (pCtx->getFlags() & CLIENT_TRACKING)) {
+      tracking = SessionCtx::KeyTracking::READ;
+    }
+  }
+  // EXEC runs the queued commands through here again
+  auto prevTracking = pCtx->getKeyTracking();
+  pCtx->setKeyTracking(tracking);
   auto v = it->second->run(sess);
+  pCtx->setKeyTracking(prevTracking);
+  if (tracking == SessionCtx::KeyTracking::WRITE) {
+    // a failed write may have changed some keys, invalidate them anyway
+    auto keys = pCtx->popWrittenKeys();
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    trackingMgr->invalidateKeys(keys, sess->id());
+  }
   if (v.ok()) {
     if (sess->getCtx()->isEp()) {
       sess->getServerEntry()->setTsEp(sess->getCtx()->getTsEP());
@@ -376,10 +418,8 @@ Expected<std::pair<std::string, std::list<Record>>> Command::scan(
   const std::string& from,
   uint64_t cnt,
   Transaction* txn) {
-  auto cursor = txn->createDataCursor();
-  if (from == "0") {
-    cursor->seek(pk);
-  } else {
+  auto cursor = txn->createPrefixCursor(pk);
+  if (from != "0") {
     auto unhex = unhexlify(from);
     if (!unhex.ok()) {
       return unhex.status();
@@ -387,30 +427,31 @@ Expected<std::pair<std::string, std::list<Record>>> Command::scan(
     cursor->seek(unhex.value());
   }
   std::list<Record> result;
+  std::string nextCursor = "0";
+  RecordKeyView rk;
+  RecordValueView rv;
   while (true) {
-    if (result.size() >= cnt + 1) {
+    auto s = cursor->next(&rk, &rv);
+    if (s.code() == ErrorCodes::ERR_EXHAUST) {
       break;
     }
-    Expected<Record> exptRcd = cursor->next();
-    if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+    if (!s.ok()) {
+      return s;
+    }
+    if (result.size() == cnt) {
+      auto next = rk.encode();
+      nextCursor = hexlify(std::string(next.data(), next.size()));
       break;
     }
-    if (!exptRcd.ok()) {
-      return exptRcd.status();
+    auto erk = rk.toRecordKey();
+    if (!erk.ok()) {
+      return erk.status();
     }
-    Record& rcd = exptRcd.value();
-    const RecordKey& rcdKey = rcd.getRecordKey();
-    if (rcdKey.prefixPk() != pk) {
-      break;
+    auto erv = rv.toRecordValue();
+    if (!erv.ok()) {
+      return erv.status();
     }
-    result.emplace_back(std::move(exptRcd.value()));
-  }
-  std::string nextCursor;
-  if (result.size() == cnt + 1) {
-    nextCursor = hexlify(result.back().getRecordKey().encode());
-    result.pop_back();
-  } else {
-    nextCursor = "0";
+    result.emplace_back(std::move(erk.value()), std::move(erv.value()));
   }
   return std::move(
     std::pair<std::string, std::list<Record>>(nextCursor, std::move(result)));
@@ -458,15 +499,31 @@ Expected<uint32_t> Command::partialDelSubKeys(Session* sess,
     server->getSegmentMgr()->getDb(nullptr, storeId, mgl::LockMode::LOCK_NONE);
   RET_IF_ERR_EXPECTED(expdb);
 
-  PStore kvstore = expdb.value().store;
+  auto cnt = delSubKeysInTxn(
+    expdb.value().store, subCount, mk, valueType, deleteMeta, txn, ictx);
+  if (!cnt.ok()) {
+    s = cnt.status();
+    return s;
+  }
+
+  Expected<uint64_t> commitStatus = txn->commit();
+  RET_IF_ERR_EXPECTED(commitStatus);
+
+  return cnt.value();
+}
+
+Expected<uint32_t> Command::delSubKeysInTxn(PStore kvstore,
+                                            uint32_t subCount,
+                                            const RecordKey& mk,
+                                            RecordType valueType,
+                                            bool deleteMeta,
+                                            Transaction* txn,
+                                            const TTLIndex* ictx) {
+  Status s(ErrorCodes::ERR_OK, "");
   INVARIANT_D(mk.getRecordType() == RecordType::RT_DATA_META);
   if (valueType == RecordType::RT_KV) {
     s = kvstore->delKV(mk, txn);
     RET_IF_ERR(s);
-
-    auto commitStatus = txn->commit();
-    RET_IF_ERR_EXPECTED(commitStatus);
-
     return 1;
   }
   std::vector<std::string> prefixes;
@@ -504,31 +561,50 @@ Expected<uint32_t> Command::partialDelSubKeys(Session* sess,
                        mk.getPrimaryKey(),
                        "");
     prefixes.push_back(fakeEle1.prefixPk());
+    RecordKey fakeEle2(mk.getChunkId(),
+                       mk.getDbId(),
+                       RecordType::RT_ZSET_I_ELE,
+                       mk.getPrimaryKey(),
+                       "");
+    prefixes.push_back(fakeEle2.prefixPk());
+  } else if (valueType == RecordType::RT_STREAM_META) {
+    RecordKey fakeEle(mk.getChunkId(),
+                      mk.getDbId(),
+                      RecordType::RT_STREAM_ELE,
+                      mk.getPrimaryKey(),
+                      "");
+    prefixes.push_back(fakeEle.prefixPk());
+    RecordKey fakeEle1(mk.getChunkId(),
+                       mk.getDbId(),
+                       RecordType::RT_STREAM_CG,
+                       mk.getPrimaryKey(),
+                       "");
+    prefixes.push_back(fakeEle1.prefixPk());
   } else {
     INVARIANT_D(0);
   }
 
   std::list<RecordKey> pendingDelete;
   for (const auto& prefix : prefixes) {
-    auto cursor = txn->createDataCursor();
-    cursor->seek(prefix);
-
+    auto cursor = txn->createPrefixCursor(prefix);
+    RecordKeyView rk;
+    RecordValueView rv;
     while (true) {
       if (pendingDelete.size() >= subCount) {
         break;
       }
-      Expected<Record> exptRcd = cursor->next();
-      if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+      auto es = cursor->next(&rk, &rv);
+      if (es.code() == ErrorCodes::ERR_EXHAUST) {
         break;
       }
-      RET_IF_ERR_EXPECTED(exptRcd);
-
-      Record& rcd = exptRcd.value();
-      const RecordKey& rcdKey = rcd.getRecordKey();
-      if (rcdKey.prefixPk() != prefix) {
-        break;
+      if (!es.ok()) {
+        return es;
+      }
+      auto erk = rk.toRecordKey();
+      if (!erk.ok()) {
+        return erk.status();
       }
-      pendingDelete.push_back(rcdKey);
+      pendingDelete.push_back(std::move(erk.value()));
     }
   }
 
@@ -545,12 +621,106 @@ Expected<uint32_t> Command::partialDelSubKeys(Session* sess,
     RET_IF_ERR(s);
   }
 
-  Expected<uint64_t> commitStatus = txn->commit();
-  RET_IF_ERR_EXPECTED(commitStatus);
-
   return pendingDelete.size();
 }
 
+Expected<uint32_t> Command::expireChunkKeys(Session* sess,
+                                            uint32_t chunkId,
+                                            const std::vector<TTLIndex>& idxs,
+                                            std::vector<TTLIndex>* rest) {
+  // the sub keys a transaction deletes at most, like delKey()
+  const uint64_t maxSubKeys = 2048;
+  if (_noexpire || idxs.empty()) {
+    return 0;
+  }
+  auto server = sess->getServerEntry();
+  INVARIANT(server != nullptr);
+  auto segMgr = server->getSegmentMgr();
+
+  std::vector<std::string> keys;
+  std::vector<int> index;
+  for (const auto& idx : idxs) {
+    index.push_back(keys.size());
+    keys.push_back(idx.getPriKey());
+  }
+  // the keys are all in chunkId, it works in cluster mode
+  auto locklist =
+    segMgr->getAllKeysLocked(sess, keys, index, mgl::LockMode::LOCK_X);
+  RET_IF_ERR_EXPECTED(locklist);
+  auto expdb =
+    segMgr->getDb(sess, segMgr->getStoreid(chunkId), mgl::LockMode::LOCK_NONE);
+  RET_IF_ERR_EXPECTED(expdb);
+  PStore kvstore = expdb.value().store;
+
+  for (uint32_t i = 0; i < RETRY_CNT; ++i) {
+    auto ptxn = kvstore->createTransaction(sess);
+    RET_IF_ERR_EXPECTED(ptxn);
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    if (txn->isReplOnly()) {
+      return 0;
+    }
+
+    rest->clear();
+    std::vector<std::string> deleted;
+    uint64_t subKeys = 0;
+    uint64_t currentTs = msSinceEpoch();
+    for (const auto& idx : idxs) {
+      RecordKey mk(chunkId,
+                   idx.getDbId(),
+                   RecordType::RT_DATA_META,
+                   idx.getPriKey(),
+                   "");
+      Expected<RecordValue> eValue = kvstore->getKV(mk, txn.get());
+      if (eValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
+        continue;
+      }
+      RET_IF_ERR_EXPECTED(eValue);
+      uint64_t targetTtl = eValue.value().getTtl();
+      if (targetTtl == 0 || currentTs < targetTtl) {
+        continue;
+      }
+      RecordType valueType = eValue.value().getRecordType();
+      auto cnt = rcd_util::getSubKeyCount(mk, eValue.value());
+      RET_IF_ERR_EXPECTED(cnt);
+      if (subKeys + cnt.value() >= maxSubKeys) {
+        rest->push_back(idx);
+        continue;
+      }
+      subKeys += cnt.value();
+
+      TTLIndex ictx(idx.getPriKey(), valueType, idx.getDbId(), targetTtl);
+      auto s = delSubKeysInTxn(kvstore,
+                               std::numeric_limits<uint32_t>::max(),
+                               mk,
+                               valueType,
+                               true,
+                               txn.get(),
+                               &ictx);
+      RET_IF_ERR_EXPECTED(s);
+      deleted.push_back(idx.getPriKey());
+    }
+    if (deleted.empty()) {
+      return 0;
+    }
+
+    Expected<uint64_t> commitStatus = txn->commit();
+    if (commitStatus.status().code() == ErrorCodes::ERR_COMMIT_RETRY &&
+        i != RETRY_CNT - 1) {
+      continue;
+    }
+    RET_IF_ERR_EXPECTED(commitStatus);
+
+    for (size_t j = 0; j < deleted.size(); ++j) {
+      ++server->getServerStat().expiredkeys;
+    }
+    server->getTrackingMgr()->invalidateKeys(deleted, sess->id());
+    return deleted.size();
+  }
+  // should never reach here
+  INVARIANT_D(0);
+  return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+}
+
 Expected<bool> Command::delKeyChkExpire(Session* sess,
                                         const std::string& key,
                                         RecordType tp) {
@@ -720,6 +890,7 @@ Expected<RecordValue> Command::expireKeyIfNeeded(Session* sess,
       Status s =
         Command::delKeyPessimisticInLock(sess, storeId, mk, valueType, &ictx);
       if (s.ok()) {
+        ++server->getServerStat().expiredkeys;
         return {ErrorCodes::ERR_EXPIRED, ""};
       } else {
         return s;
@@ -731,6 +902,7 @@ Expected<RecordValue> Command::expireKeyIfNeeded(Session* sess,
         continue;
       }
       if (s.ok()) {
+        ++server->getServerStat().expiredkeys;
         return {ErrorCodes::ERR_EXPIRED, ""};
       } else {
         return s;
@@ -755,6 +927,10 @@ std::string Command::fmtNull() {
   return "$-1\r\n";
 }
 
+std::string Command::fmtNullArray() {
+  return "*-1\r\n";
+}
+
 std::string Command::fmtOK() {
   return "+OK\r\n";
 }
@@ -809,6 +985,15 @@ std::stringstream& Command::fmtBulk(std::stringstream& ss,
   return ss;
 }
 
+std::stringstream& Command::fmtBulk(std::stringstream& ss,
+                                    const char* data,
+                                    size_t size) {
+  ss << "$" << size << "\r\n";
+  ss.write(data, size);
+  ss << "\r\n";
+  return ss;
+}
+
 std::stringstream& Command::fmtNull(std::stringstream& ss) {
   ss << "$-1\r\n";
   return ss;
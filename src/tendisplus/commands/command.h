@@ -77,6 +77,15 @@ class Command {
                                                  RecordType tp,
                                                  bool hasVersion = true);
 
+  // delete the expired keys of one chunk in one transaction, for the
+  // background expiration. keys renewed since their ttl index was
+  // scanned are kept, big keys are put in *rest to be deleted by
+  // expireKeyIfNeeded(). returns the number of keys deleted.
+  static Expected<uint32_t> expireChunkKeys(Session* sess,
+                                            uint32_t chunkId,
+                                            const std::vector<TTLIndex>& idxs,
+                                            std::vector<TTLIndex>* rest);
+
   static Expected<std::pair<std::string, std::list<Record>>> scan(
     const std::string& pk,
     const std::string& from,
@@ -98,6 +107,7 @@ class Command {
 
   static std::string fmtErr(const std::string& s);
   static std::string fmtNull();
+  static std::string fmtNullArray();
   static std::string fmtOK();
   static std::string fmtOne();
   static std::string fmtZero();
@@ -111,6 +121,9 @@ class Command {
   static std::string fmtZeroBulkLen();
   static std::stringstream& fmtMultiBulkLen(std::stringstream&, uint64_t);
   static std::stringstream& fmtBulk(std::stringstream&, const std::string&);
+  static std::stringstream& fmtBulk(std::stringstream&,
+                                    const char* data,
+                                    size_t size);
   static std::stringstream& fmtStatus(std::stringstream&, const std::string&);
   static std::stringstream& fmtNull(std::stringstream&);
   static std::stringstream& fmtLongLong(std::stringstream&, int64_t);
@@ -148,6 +161,14 @@ class Command {
                                               bool deleteMeta,
                                               Transaction* txn,
                                               const TTLIndex* ictx = nullptr);
+  // partialDelSubKeys() without the commit
+  static Expected<uint32_t> delSubKeysInTxn(PStore kvstore,
+                                            uint32_t subCount,
+                                            const RecordKey& mk,
+                                            RecordType valueType,
+                                            bool deleteMeta,
+                                            Transaction* txn,
+                                            const TTLIndex* ictx);
 
   const std::string _name;
   /* Flags as string representation, one char per flag. */
@@ -163,6 +184,12 @@ class Command {
 
 std::map<std::string, Command*>& commandMap();
 
+// park the session on keys until they are signaled or the deadline(ms),
+// see BlockManager. returns the null array, which is not sent if blocked.
+std::string blockForKeys(Session* sess,
+                         const std::vector<std::string>& keys,
+                         uint64_t deadline);
+
 }  // namespace tendisplus
 
 #endif  // SRC_TENDISPLUS_COMMANDS_COMMAND_H_
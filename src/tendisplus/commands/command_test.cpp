@@ -17,10 +17,12 @@
 #include "tendisplus/utils/sync_point.h"
 #include "tendisplus/utils/test_util.h"
 #include "tendisplus/storage/rocks/rocks_kvstore.h"
+#include "tendisplus/storage/quicklist.h"
 #include "tendisplus/commands/command.h"
 #include "tendisplus/server/server_params.h"
 #include "tendisplus/server/server_entry.h"
 #include "tendisplus/utils/string.h"
+#include "tendisplus/utils/sha1.h"
 #include "tendisplus/utils/invariant.h"
 
 namespace tendisplus {
@@ -638,6 +640,134 @@ void testMulti(std::shared_ptr<ServerEntry> svr) {
   EXPECT_TRUE(!expect.ok());
 }
 
+void testMultiExec(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioCtx;
+  asio::ip::tcp::socket socket(ioCtx);
+  NetSession sess(svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  sess.setArgs({"multi"});
+  auto expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  std::vector<std::vector<std::string>> cmds = {
+    {"set", "execkey", "1"},
+    {"incr", "execkey"},
+    {"lpush", "execkey", "a"},
+    {"hset", "{execkey}h", "f", "v"},
+    {"get", "execkey"}};
+  for (const auto& args : cmds) {
+    sess.setArgs(args);
+    expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok());
+    EXPECT_EQ(expect.value(), "+QUEUED\r\n");
+  }
+  // nothing is written before EXEC
+  {
+    asio::ip::tcp::socket socket1(ioCtx);
+    NetSession sess1(svr, std::move(socket1), 2, false, nullptr, nullptr);
+    sess1.setArgs({"get", "execkey"});
+    expect = Command::runSessionCmd(&sess1);
+    EXPECT_TRUE(expect.ok());
+    EXPECT_EQ(expect.value(), Command::fmtNull());
+  }
+  // a failed command doesn't abort the others
+  sess.setArgs({"exec"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value().find("*5\r\n+OK\r\n:2\r\n-"), 0U);
+  auto tail = Command::fmtOne() + Command::fmtBulk("2");
+  EXPECT_EQ(expect.value().substr(expect.value().size() - tail.size()), tail);
+  EXPECT_FALSE(sess.getCtx()->isInMulti());
+
+  sess.setArgs({"multi"});
+  EXPECT_TRUE(Command::runSessionCmd(&sess).ok());
+  sess.setArgs({"set", "discardkey", "1"});
+  EXPECT_TRUE(Command::runSessionCmd(&sess).ok());
+  sess.setArgs({"discard"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), Command::fmtOK());
+  sess.setArgs({"get", "discardkey"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), Command::fmtNull());
+  sess.setArgs({"discard"});
+  EXPECT_FALSE(Command::runSessionCmd(&sess).ok());
+
+  // a command failed to be queued aborts EXEC
+  {
+    // the wrong arity is refused by ServerEntry::processRequest(), which
+    // marks the transaction dirty
+    asio::ip::tcp::socket socket1(ioCtx);
+    auto sess1 = std::make_shared<NetSession>(
+      svr, std::move(socket1), 2, false, nullptr, nullptr);
+    sess1->setArgs({"multi"});
+    EXPECT_TRUE(Command::runSessionCmd(sess1.get()).ok());
+    sess1->setArgs({"set", "discardkey", "1"});
+    EXPECT_TRUE(Command::runSessionCmd(sess1.get()).ok());
+    sess1->setArgs({"get"});
+    EXPECT_TRUE(svr->processRequest(sess1.get()));
+    EXPECT_TRUE(sess1->getCtx()->getFlags() & CLIENT_DIRTY_EXEC);
+    sess1->setArgs({"exec"});
+    expect = Command::runSessionCmd(sess1.get());
+    EXPECT_FALSE(expect.ok());
+    EXPECT_NE(expect.status().toString().find("EXECABORT"),
+              std::string::npos);
+    EXPECT_FALSE(sess1->getCtx()->isInMulti());
+  }
+  sess.setArgs({"get", "discardkey"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), Command::fmtNull());
+
+  // the keys of two kvstores are not coalesced, each command is run and
+  // committed by itself
+  std::string otherkey;
+  auto segMgr = svr->getSegmentMgr();
+  auto storeOf = [&segMgr](const std::string& key) {
+    return segMgr->getStoreid(
+      redis_port::keyHashSlot(key.c_str(), key.size()));
+  };
+  for (int i = 0; otherkey.empty(); i++) {
+    auto key = "execkey" + std::to_string(i);
+    if (storeOf(key) != storeOf("execkey")) {
+      otherkey = key;
+    }
+  }
+  sess.setArgs({"multi"});
+  EXPECT_TRUE(Command::runSessionCmd(&sess).ok());
+  sess.setArgs({"set", otherkey, "1"});
+  EXPECT_TRUE(Command::runSessionCmd(&sess).ok());
+  sess.setArgs({"incr", "execkey"});
+  EXPECT_TRUE(Command::runSessionCmd(&sess).ok());
+  sess.setArgs({"incr", otherkey});
+  EXPECT_TRUE(Command::runSessionCmd(&sess).ok());
+  sess.setArgs({"exec"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), "*3\r\n+OK\r\n:3\r\n:2\r\n");
+  sess.setArgs({"get", otherkey});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), Command::fmtBulk("2"));
+
+  // SELECT is not coalesced, the commands are run one by one
+  sess.setArgs({"multi"});
+  EXPECT_TRUE(Command::runSessionCmd(&sess).ok());
+  sess.setArgs({"select", "1"});
+  EXPECT_TRUE(Command::runSessionCmd(&sess).ok());
+  sess.setArgs({"set", "execkey", "db1"});
+  EXPECT_TRUE(Command::runSessionCmd(&sess).ok());
+  sess.setArgs({"exec"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), "*2\r\n+OK\r\n+OK\r\n");
+  EXPECT_EQ(sess.getCtx()->getDbId(), 1U);
+  sess.setArgs({"get", "execkey"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), Command::fmtBulk("db1"));
+}
+
 void testMaxClients(std::shared_ptr<ServerEntry> svr) {
   asio::io_context ioContext;
   asio::ip::tcp::socket socket(ioContext), socket1(ioContext);
@@ -970,6 +1100,7 @@ TEST(Command, tendisex) {
   testExtendProtocol(server);
   testSync(server);
   testMulti(server);
+  testMultiExec(server);
 
 #ifndef _WIN32
   server->stop();
@@ -1965,6 +2096,1445 @@ TEST(Command, resizeCommand) {
 #endif
 }
 
+void testBlockingList(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext), socket1(ioContext);
+  // BlockManager keeps weak_ptr of the blocked session
+  auto sess = std::make_shared<NetSession>(
+    svr, std::move(socket), 1, false, nullptr, nullptr);
+  auto sess1 = std::make_shared<NetSession>(
+    svr, std::move(socket1), 2, false, nullptr, nullptr);
+  auto blockMgr = svr->getBlockMgr();
+
+  sess->setArgs({"blpop", "bl1", "bl2", "-1"});
+  auto expect = Command::runSessionCmd(sess.get());
+  EXPECT_FALSE(expect.ok());
+  sess->setArgs({"blpop", "bl1", "bl2", "abc"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_FALSE(expect.ok());
+
+  // data already there
+  sess1->setArgs({"rpush", "bl2", "a", "b"});
+  expect = Command::runSessionCmd(sess1.get());
+  EXPECT_EQ(Command::fmtLongLong(2), expect.value());
+  sess->setArgs({"brpop", "bl1", "bl2", "0"});
+  expect = Command::runSessionCmd(sess.get());
+  std::stringstream ss;
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "bl2");
+  Command::fmtBulk(ss, "b");
+  EXPECT_EQ(ss.str(), expect.value());
+  EXPECT_FALSE(sess->getCtx()->isBlocked());
+
+  // block on empty lists, a push on any of them wakes the session up
+  sess->setArgs({"blpop", "bl1", "bl3", "0"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_TRUE(expect.ok());
+  EXPECT_TRUE(sess->getCtx()->isBlocked());
+  EXPECT_EQ(blockMgr->getBlockedCount(), 1);
+
+  sess1->setArgs({"lpush", "bl3", "c"});
+  expect = Command::runSessionCmd(sess1.get());
+  EXPECT_EQ(Command::fmtLongLong(1), expect.value());
+  EXPECT_EQ(blockMgr->getBlockedCount(), 0);
+
+  // NetSession::processReq() runs the command again after unblock()
+  sess->getCtx()->resetBlocked();
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "bl3");
+  Command::fmtBulk(ss, "c");
+  EXPECT_EQ(ss.str(), expect.value());
+  EXPECT_FALSE(sess->getCtx()->isBlocked());
+  sess->getCtx()->clearBlockDeadline();
+
+  // timeout, the command replies nil when it runs again
+  sess->setArgs({"brpoplpush", "bl1", "bl4", "0.1"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_TRUE(sess->getCtx()->isBlocked());
+  EXPECT_EQ(blockMgr->getBlockedCount(), 1);
+  blockMgr->handleTimeout(msSinceEpoch() + 1000);
+  EXPECT_EQ(blockMgr->getBlockedCount(), 0);
+  sess->getCtx()->resetBlocked();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtNullArray(), expect.value());
+  EXPECT_FALSE(sess->getCtx()->isBlocked());
+  sess->getCtx()->clearBlockDeadline();
+
+  // a closed session leaves no waiter behind
+  sess->setArgs({"brpoplpush", "bl1", "bl4", "0"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_TRUE(sess->getCtx()->isBlocked());
+  EXPECT_TRUE(blockMgr->removeWaiter(sess->id()));
+  EXPECT_EQ(blockMgr->getBlockedCount(), 0);
+
+  // never block in MULTI or from a LocalSession
+  LocalSessionGuard sg(svr.get());
+  sg.getSession()->setArgs({"blpop", "bl1", "0"});
+  expect = Command::runSessionCmd(sg.getSession());
+  EXPECT_EQ(Command::fmtNullArray(), expect.value());
+  EXPECT_FALSE(sg.getSession()->getCtx()->isBlocked());
+  EXPECT_EQ(blockMgr->getBlockedCount(), 0);
+}
+
+TEST(Command, blockingList) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  auto server = makeServerEntry(cfg);
+
+  testBlockingList(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testPubSub(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext), socket1(ioContext);
+  auto sess = std::make_shared<NetSession>(
+    svr, std::move(socket), 1, false, nullptr, nullptr);
+  auto sess1 = std::make_shared<NetSession>(
+    svr, std::move(socket1), 2, false, nullptr, nullptr);
+  auto mgr = svr->getPubSubMgr();
+
+  sess->setArgs({"subscribe", "ch1", "ch2"});
+  auto expect = Command::runSessionCmd(sess.get());
+  std::stringstream ss;
+  Command::fmtMultiBulkLen(ss, 3);
+  Command::fmtBulk(ss, "subscribe");
+  Command::fmtBulk(ss, "ch1");
+  Command::fmtLongLong(ss, 1);
+  Command::fmtMultiBulkLen(ss, 3);
+  Command::fmtBulk(ss, "subscribe");
+  Command::fmtBulk(ss, "ch2");
+  Command::fmtLongLong(ss, 2);
+  EXPECT_EQ(ss.str(), expect.value());
+  EXPECT_TRUE(sess->getCtx()->getFlags() & CLIENT_PUBSUB);
+
+  // only (P)SUBSCRIBE / (P)UNSUBSCRIBE / PING / QUIT in subscribed mode
+  sess->setArgs({"set", "a", "b"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_FALSE(expect.ok());
+
+  // PING replies an array in subscribed mode
+  sess->setArgs({"ping"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "pong");
+  Command::fmtBulk(ss, "");
+  EXPECT_EQ(ss.str(), expect.value());
+  sess->setArgs({"ping", "hi"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "pong");
+  Command::fmtBulk(ss, "hi");
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess1->setArgs({"psubscribe", "ch*", "h?llo"});
+  expect = Command::runSessionCmd(sess1.get());
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(mgr->numPat(), 2);
+
+  // ch1 is received by sess and sess1(ch*)
+  sess1->setArgs({"publish", "ch1", "msg"});
+  EXPECT_FALSE(Command::runSessionCmd(sess1.get()).ok());
+  LocalSessionGuard sg(svr.get());
+  sg.getSession()->setArgs({"publish", "ch1", "msg"});
+  expect = Command::runSessionCmd(sg.getSession());
+  EXPECT_EQ(Command::fmtLongLong(2), expect.value());
+  sg.getSession()->setArgs({"publish", "hello", "msg"});
+  expect = Command::runSessionCmd(sg.getSession());
+  EXPECT_EQ(Command::fmtLongLong(1), expect.value());
+  sg.getSession()->setArgs({"publish", "other", "msg"});
+  expect = Command::runSessionCmd(sg.getSession());
+  EXPECT_EQ(Command::fmtLongLong(0), expect.value());
+
+  sg.getSession()->setArgs({"pubsub", "numsub", "ch1", "ch3"});
+  expect = Command::runSessionCmd(sg.getSession());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 4);
+  Command::fmtBulk(ss, "ch1");
+  Command::fmtLongLong(ss, 1);
+  Command::fmtBulk(ss, "ch3");
+  Command::fmtLongLong(ss, 0);
+  EXPECT_EQ(ss.str(), expect.value());
+  sg.getSession()->setArgs({"pubsub", "channels", "*2"});
+  expect = Command::runSessionCmd(sg.getSession());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 1);
+  Command::fmtBulk(ss, "ch2");
+  EXPECT_EQ(ss.str(), expect.value());
+
+  // a LocalSession can't receive messages
+  sg.getSession()->setArgs(std::vector<std::string>{"subscribe", "ch1"});
+  EXPECT_FALSE(Command::runSessionCmd(sg.getSession()).ok());
+
+  // unsubscribe from all the channels
+  sess->setArgs({"unsubscribe"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_TRUE(expect.ok());
+  EXPECT_FALSE(sess->getCtx()->getFlags() & CLIENT_PUBSUB);
+  EXPECT_EQ(mgr->numSub("ch1"), 0);
+  sess->setArgs({"ping"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(std::string("+PONG\r\n"), expect.value());
+  sess->setArgs({"unsubscribe"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 3);
+  Command::fmtBulk(ss, "unsubscribe");
+  Command::fmtNull(ss);
+  Command::fmtLongLong(ss, 0);
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess1->setArgs({"punsubscribe", "h?llo"});
+  expect = Command::runSessionCmd(sess1.get());
+  EXPECT_EQ(mgr->numPat(), 1);
+  EXPECT_TRUE(sess1->getCtx()->getFlags() & CLIENT_PUBSUB);
+
+  // a closed session leaves no subscription behind
+  mgr->unsubscribeAll(sess1->id());
+  EXPECT_EQ(mgr->numPat(), 0);
+  sg.getSession()->setArgs({"publish", "ch1", "msg"});
+  expect = Command::runSessionCmd(sg.getSession());
+  EXPECT_EQ(Command::fmtLongLong(0), expect.value());
+}
+
+TEST(Command, pubsub) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  auto server = makeServerEntry(cfg);
+
+  testPubSub(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testClientTracking(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext), socket1(ioContext);
+  auto sess = std::make_shared<NetSession>(
+    svr, std::move(socket), 1, false, nullptr, nullptr);
+  // the redirect session should be known by the server
+  auto redir = std::make_shared<NetSession>(
+    svr, std::move(socket1), 2, false, nullptr, nullptr);
+  EXPECT_TRUE(svr->addSession(redir));
+  auto trackingMgr = svr->getTrackingMgr();
+  LocalSessionGuard sg(svr.get());
+  auto writer = sg.getSession();
+
+  sess->setArgs({"client", "tracking", "on"});
+  EXPECT_FALSE(Command::runSessionCmd(sess.get()).ok());
+  sess->setArgs({"client", "tracking", "on", "redirect", "123456"});
+  EXPECT_FALSE(Command::runSessionCmd(sess.get()).ok());
+  sess->setArgs({"client", "tracking", "on", "prefix", "a"});
+  EXPECT_FALSE(Command::runSessionCmd(sess.get()).ok());
+
+  auto redirId = std::to_string(redir->id());
+  sess->setArgs({"client", "tracking", "on", "redirect", redirId});
+  auto expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOK(), expect.value());
+  EXPECT_EQ(trackingMgr->getTrackingCount(), 1);
+  sess->setArgs({"client", "getredir"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtLongLong(redir->id()), expect.value());
+
+  // reads are remembered, a write invalidates and forgets the key
+  writer->setArgs({"set", "tk1", "v1"});
+  EXPECT_TRUE(Command::runSessionCmd(writer).ok());
+  sess->setArgs({"get", "tk1"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtBulk("v1"), expect.value());
+  sess->setArgs({"mget", "tk2", "tk3"});
+  EXPECT_TRUE(Command::runSessionCmd(sess.get()).ok());
+  EXPECT_EQ(trackingMgr->getTrackedKeyCount(), 3);
+  writer->setArgs({"set", "tk1", "v2"});
+  EXPECT_TRUE(Command::runSessionCmd(writer).ok());
+  EXPECT_EQ(trackingMgr->getTrackedKeyCount(), 2);
+  writer->setArgs({"del", "tk2", "tk3"});
+  EXPECT_TRUE(Command::runSessionCmd(writer).ok());
+  EXPECT_EQ(trackingMgr->getTrackedKeyCount(), 0);
+
+  // the table is bounded, old keys are evicted
+  svr->getParams()->trackingTableMaxKeys = TrackingManager::TABLE_SHARDS;
+  for (int i = 0; i < 100; i++) {
+    sess->setArgs({"get", "tk" + std::to_string(i)});
+    EXPECT_TRUE(Command::runSessionCmd(sess.get()).ok());
+  }
+  EXPECT_LE(trackingMgr->getTrackedKeyCount(), TrackingManager::TABLE_SHARDS);
+  writer->setArgs(std::vector<std::string>{"flushall"});
+  EXPECT_TRUE(Command::runSessionCmd(writer).ok());
+  EXPECT_EQ(trackingMgr->getTrackedKeyCount(), 0);
+
+  // the least recently read key of a shard is evicted
+  svr->getParams()->trackingTableMaxKeys = 2 * TrackingManager::TABLE_SHARDS;
+  auto shardOf = [](const std::string& key) {
+    return std::hash<std::string>()(key) % TrackingManager::TABLE_SHARDS;
+  };
+  std::vector<std::string> lruKeys;
+  for (int i = 0; lruKeys.size() < 3; i++) {
+    std::string key = "lru" + std::to_string(i);
+    if (shardOf(key) == shardOf("lru0")) {
+      lruKeys.push_back(key);
+    }
+  }
+  for (auto idx : {0, 1, 0, 2}) {
+    sess->setArgs({"get", lruKeys[idx]});
+    EXPECT_TRUE(Command::runSessionCmd(sess.get()).ok());
+  }
+  EXPECT_EQ(trackingMgr->getTrackedKeyCount(), 2);
+  writer->setArgs({"set", lruKeys[1], "v"});
+  EXPECT_TRUE(Command::runSessionCmd(writer).ok());
+  EXPECT_EQ(trackingMgr->getTrackedKeyCount(), 2);
+  writer->setArgs({"set", lruKeys[0], "v"});
+  EXPECT_TRUE(Command::runSessionCmd(writer).ok());
+  EXPECT_EQ(trackingMgr->getTrackedKeyCount(), 1);
+  writer->setArgs(std::vector<std::string>{"flushall"});
+  EXPECT_TRUE(Command::runSessionCmd(writer).ok());
+
+  // can't switch to BCAST without OFF, BCAST remembers nothing
+  sess->setArgs({"client", "tracking", "on", "redirect", redirId, "bcast"});
+  EXPECT_FALSE(Command::runSessionCmd(sess.get()).ok());
+  sess->setArgs({"client", "tracking", "off"});
+  EXPECT_TRUE(Command::runSessionCmd(sess.get()).ok());
+  EXPECT_EQ(trackingMgr->getTrackingCount(), 0);
+  sess->setArgs({"client", "tracking", "on", "redirect", redirId, "bcast",
+                 "prefix", "user:"});
+  EXPECT_TRUE(Command::runSessionCmd(sess.get()).ok());
+  sess->setArgs({"get", "user:1"});
+  EXPECT_TRUE(Command::runSessionCmd(sess.get()).ok());
+  EXPECT_EQ(trackingMgr->getTrackedKeyCount(), 0);
+  writer->setArgs({"set", "user:1", "v"});
+  EXPECT_TRUE(Command::runSessionCmd(writer).ok());
+
+  // ServerEntry::endSession() stops tracking
+  trackingMgr->disableTracking(sess->id());
+  EXPECT_EQ(trackingMgr->getTrackingCount(), 0);
+  svr->endSession(redir->id());
+}
+
+TEST(Command, clientTracking) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  auto server = makeServerEntry(cfg);
+
+  testClientTracking(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testTrafficCapture(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  auto sess = std::make_shared<NetSession>(
+    svr, std::move(socket), 1, false, nullptr, nullptr);
+  auto monitorMgr = svr->getMonitorMgr();
+  LocalSessionGuard sg(svr.get());
+  auto admin = sg.getSession();
+  const std::string path = "./traffic_capture_test.bin";
+  const auto guard = MakeGuard([&path] { remove(path.c_str()); });
+
+  EXPECT_FALSE(CaptureFilter::parse({"monitor", "sample", "0"}, 1).ok());
+  EXPECT_FALSE(CaptureFilter::parse({"monitor", "keyprefix"}, 1).ok());
+  auto filter =
+    CaptureFilter::parse({"monitor", "SAMPLE", "2", "command", "GET"}, 1);
+  EXPECT_TRUE(filter.ok());
+  EXPECT_EQ(filter.value().sampleRate, 2U);
+  EXPECT_EQ(filter.value().commands.count("get"), 1U);
+
+  // nothing is captured without consumers
+  auto setCmd = commandMap()["set"];
+  auto getCmd = commandMap()["get"];
+  sess->setArgs({"set", "ck0", "v"});
+  monitorMgr->capture(sess.get(), setCmd);
+  EXPECT_EQ(monitorMgr->getStats().captured, 0);
+
+  admin->setArgs({"trafficcapture", "start", path, "command", "set"});
+  auto expect = Command::runSessionCmd(admin);
+  EXPECT_EQ(Command::fmtOK(), expect.value());
+  EXPECT_FALSE(Command::runSessionCmd(admin).ok());
+  for (int i = 0; i < 3; i++) {
+    sess->setArgs({"set", "ck" + std::to_string(i), "v"});
+    monitorMgr->capture(sess.get(), setCmd);
+    sess->setArgs({"get", "ck" + std::to_string(i)});
+    monitorMgr->capture(sess.get(), getCmd);
+  }
+  admin->setArgs(std::vector<std::string>{"trafficcapture", "stop"});
+  expect = Command::runSessionCmd(admin);
+  EXPECT_EQ(Command::fmtOK(), expect.value());
+  EXPECT_FALSE(Command::runSessionCmd(admin).ok());
+
+  auto stats = monitorMgr->getStats();
+  EXPECT_EQ(stats.captured, 6);
+  EXPECT_EQ(stats.dropped, 0);
+  EXPECT_EQ(stats.dumped, 3);
+  EXPECT_FALSE(stats.dumping);
+
+  // the magic and then the records of SET only
+  std::ifstream in(path, std::ios::binary);
+  std::string content((std::istreambuf_iterator<char>(in)),
+                      std::istreambuf_iterator<char>());
+  std::string magic(MonitorManager::CAPTURE_FILE_MAGIC);
+  EXPECT_EQ(content.compare(0, magic.size(), magic), 0);
+  size_t pos = magic.size();
+  uint32_t records = 0;
+  while (pos + sizeof(uint32_t) <= content.size()) {
+    uint32_t len = int32Decode(content.data() + pos);
+    pos += sizeof(uint32_t);
+    // timestamp, dbid, session id, then argc
+    size_t argcPos = pos + sizeof(uint64_t) + sizeof(uint32_t) +
+      sizeof(uint64_t);
+    EXPECT_EQ(int32Decode(content.data() + argcPos), 3);
+    uint32_t arg0Len = int32Decode(content.data() + argcPos + 4);
+    EXPECT_EQ(content.substr(argcPos + 8, arg0Len), "set");
+    pos += len;
+    records++;
+  }
+  EXPECT_EQ(pos, content.size());
+  EXPECT_EQ(records, 3);
+
+  // monitor with filters
+  sess->setArgs(std::vector<std::string>{"monitor", "sample"});
+  EXPECT_FALSE(Command::runSessionCmd(sess.get()).ok());
+  sess->setArgs({"monitor", "keyprefix", "ck"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOK(), expect.value());
+  EXPECT_TRUE(sess->getCtx()->getIsMonitor());
+  EXPECT_EQ(monitorMgr->getStats().monitors, 1);
+
+  // the ring of a thread is removed after the thread exits
+  auto before = monitorMgr->getStats();
+  std::thread thd([&]() {
+    sess->setArgs({"set", "ck0", "v"});
+    monitorMgr->capture(sess.get(), setCmd);
+  });
+  thd.join();
+  for (int i = 0; i < 100; i++) {
+    if (monitorMgr->getStats().rings == before.rings) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  auto after = monitorMgr->getStats();
+  EXPECT_EQ(after.rings, before.rings);
+  EXPECT_EQ(after.captured, before.captured + 1);
+  monitorMgr->removeMonitor(sess->id());
+  EXPECT_EQ(monitorMgr->getStats().monitors, 0);
+}
+
+TEST(Command, trafficCapture) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  auto server = makeServerEntry(cfg);
+
+  testTrafficCapture(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testScript(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  NetSession sess(svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  std::string body = "return redis.call('set', KEYS[1], ARGV[1])";
+  std::string sha = sha1hex(body);
+  sess.setArgs({"script", "exists", sha, "nosuchsha"});
+  auto expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), "*2\r\n:0\r\n:0\r\n");
+
+  sess.setArgs({"evalsha", sha, "1", "scriptkey", "v"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_FALSE(expect.ok());
+
+#ifdef WITH_LUA
+  sess.setArgs({"eval", body, "1", "scriptkey", "v1"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), Command::fmtOK());
+
+  // EVAL caches the script for EVALSHA
+  sess.setArgs({"script", "exists", sha});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), "*1\r\n:1\r\n");
+
+  std::string getBody = "return redis.call('get', KEYS[1])";
+  sess.setArgs({"script", "load", getBody});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), Command::fmtBulk(sha1hex(getBody)));
+
+  sess.setArgs({"evalsha", sha1hex(getBody), "1", "scriptkey"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), Command::fmtBulk("v1"));
+
+  // the keys should be declared
+  sess.setArgs({"eval", "return redis.call('get', 'otherkey')", "0"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_FALSE(expect.ok());
+
+  // a failed script writes nothing
+  sess.setArgs({"eval",
+                "redis.call('set', KEYS[1], 'v2') "
+                "return redis.call('lpush', KEYS[1], 'a')",
+                "1",
+                "scriptkey"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_FALSE(expect.ok());
+
+  // redis.pcall returns the error as a table
+  sess.setArgs({"eval",
+                "local r = redis.pcall('lpush', KEYS[1], 'a') "
+                "return r['err'] ~= nil",
+                "1",
+                "scriptkey"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), Command::fmtOne());
+
+  sess.setArgs({"get", "scriptkey"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), Command::fmtBulk("v1"));
+
+  // commands not allowed in scripts
+  sess.setArgs({"eval", "return redis.call('script', 'flush')", "0"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_FALSE(expect.ok());
+
+  // a failed script leaves no sum in the counter cache
+  sess.setArgs({"incr", "scriptcounter"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_EQ(expect.value(), Command::fmtOne());
+  sess.setArgs({"hincrby", "scripthash", "f", "1"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_EQ(expect.value(), Command::fmtOne());
+  sess.setArgs({"eval",
+                "redis.call('incr', KEYS[1]) "
+                "redis.call('hincrby', KEYS[2], 'f', 1) "
+                "error('fail')",
+                "2",
+                "scriptcounter",
+                "scripthash"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_FALSE(expect.ok());
+  sess.setArgs({"incr", "scriptcounter"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_EQ(expect.value(), Command::fmtLongLong(2));
+  sess.setArgs({"hincrby", "scripthash", "f", "1"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_EQ(expect.value(), Command::fmtLongLong(2));
+  sess.setArgs({"get", "scriptcounter"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_EQ(expect.value(), Command::fmtBulk("2"));
+#else
+  sess.setArgs({"eval", body, "1", "scriptkey", "v1"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_FALSE(expect.ok());
+#endif
+
+  sess.setArgs({"script", "flush"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(svr->getScriptMgr()->getScriptCount(), 0U);
+  sess.setArgs({"script", "exists", sha});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), "*1\r\n:0\r\n");
+}
+
+TEST(Command, script) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  cfg->incrMergeMode = true;
+  auto server = makeServerEntry(cfg);
+
+  testScript(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testStream(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext), socket1(ioContext);
+  auto sess = std::make_shared<NetSession>(
+    svr, std::move(socket), 1, false, nullptr, nullptr);
+  auto sess1 = std::make_shared<NetSession>(
+    svr, std::move(socket1), 2, false, nullptr, nullptr);
+  auto blockMgr = svr->getBlockMgr();
+
+  sess->setArgs({"xadd", "st", "1-1", "f1", "v1"});
+  auto expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtBulk("1-1"), expect.value());
+  sess->setArgs({"xadd", "st", "1-*", "f2", "v2"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtBulk("1-2"), expect.value());
+  sess->setArgs({"xadd", "st", "3", "f3", "v3", "f4", "v4"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtBulk("3-0"), expect.value());
+  // the ids only grow
+  sess->setArgs({"xadd", "st", "2-0", "f", "v"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_FALSE(expect.ok());
+  sess->setArgs({"xadd", "st", "3-0", "f"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_FALSE(expect.ok());
+  sess->setArgs({"xadd", "nost", "nomkstream", "*", "f", "v"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtNull(), expect.value());
+
+  sess->setArgs({"xlen", "st"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtLongLong(3), expect.value());
+  sess->setArgs({"type", "st"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtStatus("stream"), expect.value());
+
+  std::stringstream ss;
+  auto fmtEntry = [](std::stringstream& ss,
+                     const std::string& id,
+                     const std::vector<std::string>& fields) {
+    Command::fmtMultiBulkLen(ss, 2);
+    Command::fmtBulk(ss, id);
+    Command::fmtMultiBulkLen(ss, fields.size());
+    for (const auto& v : fields) {
+      Command::fmtBulk(ss, v);
+    }
+  };
+  sess->setArgs({"xrange", "st", "-", "+", "count", "2"});
+  expect = Command::runSessionCmd(sess.get());
+  Command::fmtMultiBulkLen(ss, 2);
+  fmtEntry(ss, "1-1", {"f1", "v1"});
+  fmtEntry(ss, "1-2", {"f2", "v2"});
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"xrevrange", "st", "+", "(1-1"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 2);
+  fmtEntry(ss, "3-0", {"f3", "v3", "f4", "v4"});
+  fmtEntry(ss, "1-2", {"f2", "v2"});
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"xrevrange", "st", "1", "1"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 2);
+  fmtEntry(ss, "1-2", {"f2", "v2"});
+  fmtEntry(ss, "1-1", {"f1", "v1"});
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"xdel", "st", "1-2", "1-2", "9-9"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOne(), expect.value());
+
+  // XREAD after an id, "$" blocks until the next XADD
+  sess->setArgs({"xread", "count", "1", "streams", "st", "nost", "0", "0"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 1);
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "st");
+  Command::fmtMultiBulkLen(ss, 1);
+  fmtEntry(ss, "1-1", {"f1", "v1"});
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"xread", "streams", "st", "$"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtNullArray(), expect.value());
+  EXPECT_FALSE(sess->getCtx()->isBlocked());
+
+  sess->setArgs({"xread", "block", "0", "streams", "st", "$"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_TRUE(sess->getCtx()->isBlocked());
+  EXPECT_EQ(blockMgr->getBlockedCount(), 1);
+  sess1->setArgs({"xadd", "st", "4-0", "f5", "v5"});
+  expect = Command::runSessionCmd(sess1.get());
+  EXPECT_EQ(Command::fmtBulk("4-0"), expect.value());
+  EXPECT_EQ(blockMgr->getBlockedCount(), 0);
+  sess->getCtx()->resetBlocked();
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 1);
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "st");
+  Command::fmtMultiBulkLen(ss, 1);
+  fmtEntry(ss, "4-0", {"f5", "v5"});
+  EXPECT_EQ(ss.str(), expect.value());
+  EXPECT_FALSE(sess->getCtx()->isBlocked());
+  sess->getCtx()->clearBlockDeadline();
+
+  // consumer groups
+  sess->setArgs({"xgroup", "create", "nost", "g1", "$"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_FALSE(expect.ok());
+  sess->setArgs({"xgroup", "create", "st", "g1", "0"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOK(), expect.value());
+  sess->setArgs({"xgroup", "create", "st", "g1", "0"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_FALSE(expect.ok());
+
+  sess->setArgs({"xreadgroup", "group", "g1", "c1", "count", "2",
+                 "streams", "st", ">"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 1);
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "st");
+  Command::fmtMultiBulkLen(ss, 2);
+  fmtEntry(ss, "1-1", {"f1", "v1"});
+  fmtEntry(ss, "3-0", {"f3", "v3", "f4", "v4"});
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"xreadgroup", "group", "g1", "c2", "streams", "st", ">"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 1);
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "st");
+  Command::fmtMultiBulkLen(ss, 1);
+  fmtEntry(ss, "4-0", {"f5", "v5"});
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"xpending", "st", "g1"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 4);
+  Command::fmtLongLong(ss, 3);
+  Command::fmtBulk(ss, "1-1");
+  Command::fmtBulk(ss, "4-0");
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "c1");
+  Command::fmtBulk(ss, "2");
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "c2");
+  Command::fmtBulk(ss, "1");
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"xack", "st", "g1", "1-1", "4-0", "5-0"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtLongLong(2), expect.value());
+
+  // the history of c1, and the pending entries left
+  sess->setArgs({"xreadgroup", "group", "g1", "c1", "streams", "st", "0"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 1);
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "st");
+  Command::fmtMultiBulkLen(ss, 1);
+  fmtEntry(ss, "3-0", {"f3", "v3", "f4", "v4"});
+  EXPECT_EQ(ss.str(), expect.value());
+
+  // a pending entry deleted from the stream has a nil body
+  sess->setArgs({"xdel", "st", "3-0"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOne(), expect.value());
+  sess->setArgs({"xreadgroup", "group", "g1", "c1", "streams", "st", "0"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 1);
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "st");
+  Command::fmtMultiBulkLen(ss, 1);
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "3-0");
+  Command::fmtNull(ss);
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"xpending", "st", "g1", "-", "+", "10", "c1"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value().substr(0, 17), "*1\r\n*4\r\n$3\r\n3-0\r\n");
+
+  sess->setArgs({"xgroup", "delconsumer", "st", "g1", "c1"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOne(), expect.value());
+  sess->setArgs({"xgroup", "destroy", "st", "g1"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOne(), expect.value());
+  sess->setArgs({"xreadgroup", "group", "g1", "c1", "streams", "st", ">"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_FALSE(expect.ok());
+
+  sess->setArgs({"xtrim", "st", "maxlen", "1"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOne(), expect.value());
+  sess->setArgs({"xadd", "st", "maxlen", "=", "1", "*", "f6", "v6"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_TRUE(expect.ok());
+  sess->setArgs({"xlen", "st"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOne(), expect.value());
+
+  sess->setArgs({"del", "st"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOne(), expect.value());
+  sess->setArgs({"xrange", "st", "-", "+"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtZeroBulkLen(), expect.value());
+}
+
+TEST(Command, stream) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  auto server = makeServerEntry(cfg);
+
+  testStream(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testGeo(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  auto sess = std::make_shared<NetSession>(
+    svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  sess->setArgs({"geoadd",
+                 "Sicily",
+                 "13.361389",
+                 "38.115556",
+                 "Palermo",
+                 "15.087269",
+                 "37.502669",
+                 "Catania"});
+  auto expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtLongLong(2), expect.value());
+  sess->setArgs({"geoadd", "Sicily", "200", "100", "Nowhere"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_FALSE(expect.ok());
+  sess->setArgs({"geoadd", "Sicily", "nx", "13.5", "38", "Palermo"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtZero(), expect.value());
+
+  sess->setArgs({"geodist", "Sicily", "Palermo", "Catania"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtBulk("166274.1516"), expect.value());
+  sess->setArgs({"geodist", "Sicily", "Palermo", "Catania", "km"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtBulk("166.2742"), expect.value());
+  sess->setArgs({"geodist", "Sicily", "Palermo", "Foo"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtNull(), expect.value());
+
+  std::stringstream ss;
+  sess->setArgs({"geohash", "Sicily", "Palermo", "Catania", "Foo"});
+  expect = Command::runSessionCmd(sess.get());
+  Command::fmtMultiBulkLen(ss, 3);
+  Command::fmtBulk(ss, "sqc8b49rny0");
+  Command::fmtBulk(ss, "sqdtr74hyu0");
+  Command::fmtNull(ss);
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"geopos", "Sicily", "Foo"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 1);
+  ss << Command::fmtNullArray();
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"georadius",
+                 "Sicily",
+                 "15",
+                 "37",
+                 "200",
+                 "km",
+                 "withdist",
+                 "asc"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "Catania");
+  Command::fmtBulk(ss, "56.4413");
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "Palermo");
+  Command::fmtBulk(ss, "190.4424");
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"georadius", "Sicily", "15", "37", "100", "km"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 1);
+  Command::fmtBulk(ss, "Catania");
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"georadiusbymember_ro",
+                 "Sicily",
+                 "Palermo",
+                 "200",
+                 "km",
+                 "count",
+                 "1"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 1);
+  Command::fmtBulk(ss, "Palermo");
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"geosearch",
+                 "Sicily",
+                 "fromlonlat",
+                 "15",
+                 "37",
+                 "bybox",
+                 "400",
+                 "400",
+                 "km",
+                 "desc"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "Palermo");
+  Command::fmtBulk(ss, "Catania");
+  EXPECT_EQ(ss.str(), expect.value());
+  sess->setArgs({"geosearch", "Sicily", "bybox", "400", "400", "km"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_FALSE(expect.ok());
+  sess->setArgs({"geosearch",
+                 "Sicily",
+                 "frommember",
+                 "Palermo",
+                 "byradius",
+                 "10",
+                 "km",
+                 "any"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_FALSE(expect.ok());
+
+  sess->setArgs({"georadius",
+                 "Sicily",
+                 "15",
+                 "37",
+                 "200",
+                 "km",
+                 "storedist",
+                 "dst"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtLongLong(2), expect.value());
+  sess->setArgs({"zcard", "dst"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtLongLong(2), expect.value());
+  sess->setArgs({"geosearchstore",
+                 "dst",
+                 "Sicily",
+                 "frommember",
+                 "Palermo",
+                 "byradius",
+                 "10",
+                 "km"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOne(), expect.value());
+  sess->setArgs({"zrange", "dst", "0", "-1"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 1);
+  Command::fmtBulk(ss, "Palermo");
+  EXPECT_EQ(ss.str(), expect.value());
+}
+
+TEST(Command, geo) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  auto server = makeServerEntry(cfg);
+
+  testGeo(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testListKeyFormat(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  auto sess = std::make_shared<NetSession>(
+    svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  // a list written by the older versions, "10" is before "8"
+  const std::string key = "oldlist";
+  const uint64_t head = 8;
+  const uint64_t len = 12;
+  auto writeOldList = [&](uint64_t n) {
+    auto expdb = svr->getSegmentMgr()->getDbWithKeyLock(
+      sess.get(), key, mgl::LockMode::LOCK_X);
+    EXPECT_TRUE(expdb.ok());
+    PStore kvstore = expdb.value().store;
+    auto etxn = kvstore->createTransaction(sess.get());
+    EXPECT_TRUE(etxn.ok());
+    RecordKey metaRk(
+      expdb.value().chunkId, 0, RecordType::RT_LIST_META, key, "");
+    ListMetaValue lm(head, head + n, ListKeyFormat::LKF_DECIMAL);
+    for (uint64_t i = 0; i < n; i++) {
+      RecordKey subRk(expdb.value().chunkId,
+                      0,
+                      RecordType::RT_LIST_ELE,
+                      key,
+                      std::to_string(head + i));
+      RecordValue subRv("v" + std::to_string(i), RecordType::RT_LIST_ELE, -1);
+      EXPECT_TRUE(kvstore->setKV(subRk, subRv, etxn.value().get()).ok());
+    }
+    RecordValue metaRv(lm.encode(), RecordType::RT_LIST_META, -1);
+    EXPECT_TRUE(kvstore->setKV(metaRk, metaRv, etxn.value().get()).ok());
+    EXPECT_TRUE(etxn.value()->commit().ok());
+  };
+  auto listMeta = [&]() {
+    auto expdb = svr->getSegmentMgr()->getDbWithKeyLock(
+      sess.get(), key, mgl::LockMode::LOCK_S);
+    EXPECT_TRUE(expdb.ok());
+    PStore kvstore = expdb.value().store;
+    auto etxn = kvstore->createTransaction(sess.get());
+    EXPECT_TRUE(etxn.ok());
+    RecordKey metaRk(
+      expdb.value().chunkId, 0, RecordType::RT_LIST_META, key, "");
+    auto rv = kvstore->getKV(metaRk, etxn.value().get());
+    EXPECT_TRUE(rv.ok());
+    auto lm = ListMetaValue::decode(rv.value().getValue());
+    EXPECT_TRUE(lm.ok());
+    return std::move(lm.value());
+  };
+  auto keyFormat = [&]() { return listMeta().getKeyFormat(); };
+  auto expectRange = [&](uint64_t n) {
+    sess->setArgs({"lrange", key, "0", "-1"});
+    auto expect = Command::runSessionCmd(sess.get());
+    std::stringstream ss;
+    Command::fmtMultiBulkLen(ss, n);
+    for (uint64_t i = 0; i < n; i++) {
+      Command::fmtBulk(ss, "v" + std::to_string(i));
+    }
+    EXPECT_EQ(ss.str(), expect.value());
+  };
+
+  writeOldList(len);
+  EXPECT_EQ(keyFormat(), ListKeyFormat::LKF_DECIMAL);
+  // read as it is
+  expectRange(len);
+  sess->setArgs({"lindex", key, "5"});
+  auto expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtBulk("v5"), expect.value());
+  EXPECT_EQ(keyFormat(), ListKeyFormat::LKF_DECIMAL);
+
+  // converted by the first write
+  sess->setArgs({"rpush", key, "v" + std::to_string(len)});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtLongLong(len + 1), expect.value());
+  EXPECT_EQ(keyFormat(), ListKeyFormat::LKF_CHUNKED);
+  expectRange(len + 1);
+  sess->setArgs({"lrange", key, "2", "3"});
+  expect = Command::runSessionCmd(sess.get());
+  std::stringstream ss;
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "v2");
+  Command::fmtBulk(ss, "v3");
+  EXPECT_EQ(ss.str(), expect.value());
+
+  sess->setArgs({"ltrim", key, "1", "-1"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOK(), expect.value());
+  sess->setArgs({"lindex", key, "0"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtBulk("v1"), expect.value());
+  EXPECT_EQ(keyFormat(), ListKeyFormat::LKF_CHUNKED);
+
+  // a new list is chunked at once
+  sess->setArgs({"del", key});
+  expect = Command::runSessionCmd(sess.get());
+  sess->setArgs({"lpush", key, "v1", "v0"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(keyFormat(), ListKeyFormat::LKF_CHUNKED);
+  expectRange(2);
+  sess->setArgs({"del", key});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOne(), expect.value());
+
+  // converted by LSET too
+  writeOldList(len);
+  sess->setArgs({"lset", key, "-1", "v11"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOK(), expect.value());
+  EXPECT_EQ(keyFormat(), ListKeyFormat::LKF_CHUNKED);
+  expectRange(len);
+
+  // a long one is converted a batch per write, and read in between
+  sess->setArgs({"del", key});
+  expect = Command::runSessionCmd(sess.get());
+  const uint64_t longLen = LIST_CONVERT_MAX_ELES + 2 * LIST_CONVERT_BATCH;
+  writeOldList(longLen);
+  for (uint64_t i = 1; i <= 2; i++) {
+    sess->setArgs({"lset", key, "0", "v0"});
+    expect = Command::runSessionCmd(sess.get());
+    EXPECT_EQ(Command::fmtOK(), expect.value());
+    auto lm = listMeta();
+    EXPECT_EQ(lm.getKeyFormat(), ListKeyFormat::LKF_CHUNKED);
+    EXPECT_EQ(lm.getLegacyTail() - lm.getLegacyHead(),
+              longLen - i * LIST_CONVERT_BATCH);
+    uint64_t chunked = i * LIST_CONVERT_BATCH;
+    sess->setArgs({"lindex", key, std::to_string(chunked)});
+    expect = Command::runSessionCmd(sess.get());
+    EXPECT_EQ(Command::fmtBulk("v" + std::to_string(chunked)),
+              expect.value());
+    expectRange(longLen);
+  }
+  // the rest at once
+  sess->setArgs({"lset", key, "0", "v0"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOK(), expect.value());
+  auto lm = listMeta();
+  EXPECT_EQ(lm.getLegacyHead(), lm.getLegacyTail());
+  expectRange(longLen);
+
+  // a list of several chunks
+  sess->setArgs({"del", key});
+  expect = Command::runSessionCmd(sess.get());
+  std::vector<std::string> args = {"rpush", key};
+  for (uint64_t i = 0; i < 1000; i++) {
+    args.emplace_back("v" + std::to_string(i));
+  }
+  sess->setArgs(args);
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtLongLong(1000), expect.value());
+  expectRange(1000);
+  sess->setArgs({"linsert", key, "after", "v499", "new"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtLongLong(1001), expect.value());
+  sess->setArgs({"lindex", key, "500"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtBulk("new"), expect.value());
+  sess->setArgs({"lrem", key, "0", "new"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOne(), expect.value());
+  expectRange(1000);
+  sess->setArgs({"lset", key, "700", "v700"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOK(), expect.value());
+  sess->setArgs({"lrange", key, "699", "701"});
+  expect = Command::runSessionCmd(sess.get());
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 3);
+  Command::fmtBulk(ss, "v699");
+  Command::fmtBulk(ss, "v700");
+  Command::fmtBulk(ss, "v701");
+  EXPECT_EQ(ss.str(), expect.value());
+  sess->setArgs({"ltrim", key, "0", "9"});
+  expect = Command::runSessionCmd(sess.get());
+  EXPECT_EQ(Command::fmtOK(), expect.value());
+  expectRange(10);
+}
+
+TEST(Command, listKeyFormat) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  auto server = makeServerEntry(cfg);
+
+  testListKeyFormat(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testSessionRegistry(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  std::vector<std::shared_ptr<NetSession>> sesses;
+  size_t base = svr->getSessionCount();
+  for (int i = 0; i < 40; i++) {
+    asio::ip::tcp::socket socket(ioContext);
+    sesses.emplace_back(std::make_shared<NetSession>(
+      svr, std::move(socket), i, false, nullptr, nullptr));
+    EXPECT_TRUE(svr->addSession(sesses.back()));
+  }
+  EXPECT_EQ(svr->getSessionCount(), base + 40);
+  EXPECT_EQ(svr->getSession(sesses[7]->id()), sesses[7]);
+  auto all = svr->getAllSessions();
+  EXPECT_TRUE(std::is_sorted(
+    all.begin(),
+    all.end(),
+    [](const std::shared_ptr<Session>& a, const std::shared_ptr<Session>& b) {
+      return a->id() < b->id();
+    }));
+  for (const auto& sess : sesses) {
+    svr->endSession(sess->id());
+  }
+  EXPECT_EQ(svr->getSessionCount(), base);
+  EXPECT_EQ(svr->getSession(sesses[7]->id()), nullptr);
+
+  // the LocalSessions of the guards are reused and reset
+  uint64_t id = 0;
+  {
+    LocalSessionGuard sg(svr.get());
+    auto sess = sg.getSession();
+    id = sess->id();
+    EXPECT_EQ(svr->getSession(id).get(), sess);
+    sess->setArgs(std::vector<std::string>{"select", "1"});
+    EXPECT_TRUE(Command::runSessionCmd(sess).ok());
+    EXPECT_EQ(sess->getCtx()->getDbId(), 1U);
+  }
+  EXPECT_EQ(svr->getSession(id), nullptr);
+  EXPECT_EQ(svr->getSessionCount(), base);
+  {
+    LocalSessionGuard sg(svr.get());
+    auto sess = sg.getSession();
+    EXPECT_EQ(sess->id(), id);
+    EXPECT_EQ(sess->getCtx()->getDbId(), 0U);
+    EXPECT_TRUE(sess->getArgs().empty());
+    // the pool is bounded
+    svr->getParams()->localSessionPoolSize = 0;
+  }
+  LocalSessionGuard sg(svr.get());
+  EXPECT_NE(sg.getSession()->id(), id);
+}
+
+TEST(Command, sessionRegistry) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  auto server = makeServerEntry(cfg);
+
+  testSessionRegistry(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testSort(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  auto sess = std::make_shared<NetSession>(
+    svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  auto run = [&](const std::vector<std::string>& args) {
+    sess->setArgs(args);
+    auto expect = Command::runSessionCmd(sess.get());
+    EXPECT_TRUE(expect.ok());
+    return expect.value();
+  };
+  auto multiBulk = [](const std::vector<std::string>& vals) {
+    std::stringstream ss;
+    Command::fmtMultiBulkLen(ss, vals.size());
+    for (const auto& v : vals) {
+      Command::fmtBulk(ss, v);
+    }
+    return ss.str();
+  };
+
+  // the pattern keys are spread over the stores
+  const uint32_t n = 20;
+  std::vector<std::string> push = {"rpush", "sortlist"};
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t v = (i * 7) % n;
+    push.emplace_back(std::to_string(v));
+    run({"set", "weight_" + std::to_string(v), std::to_string(n - v)});
+    run({"hset", "obj_" + std::to_string(v), "name", "o" + std::to_string(v)});
+  }
+  EXPECT_EQ(Command::fmtLongLong(n), run(push));
+
+  std::vector<std::string> asc, desc, byWeight;
+  for (uint32_t i = 0; i < n; i++) {
+    asc.emplace_back(std::to_string(i));
+    desc.emplace_back(std::to_string(n - 1 - i));
+  }
+  EXPECT_EQ(multiBulk(asc), run({"sort", "sortlist"}));
+  EXPECT_EQ(multiBulk(desc), run({"sort", "sortlist", "desc"}));
+  EXPECT_EQ(multiBulk({"2", "3", "4"}),
+            run({"sort", "sortlist", "limit", "2", "3"}));
+  EXPECT_EQ(multiBulk({"17", "16"}),
+            run({"sort", "sortlist", "desc", "limit", "2", "2"}));
+  EXPECT_EQ(multiBulk({}), run({"sort", "sortlist", "limit", "30", "2"}));
+
+  // the lexicographical order
+  EXPECT_EQ(multiBulk({"0", "1", "10", "11"}),
+            run({"sort", "sortlist", "alpha", "limit", "0", "4"}));
+  EXPECT_EQ(Command::fmtLongLong(2), run({"sadd", "sortset", "b", "a"}));
+  EXPECT_EQ(multiBulk({"a", "b"}), run({"sort", "sortset", "alpha"}));
+  sess->setArgs({"sort", "sortset"});
+  auto expect = Command::runSessionCmd(sess.get());
+  EXPECT_FALSE(expect.ok());
+
+  // BY the weight keys, the heaviest first
+  EXPECT_EQ(multiBulk(desc), run({"sort", "sortlist", "by", "weight_*"}));
+  EXPECT_EQ(multiBulk({"19", "18"}),
+            run({"sort", "sortlist", "by", "weight_*", "limit", "0", "2"}));
+  // BY without a * keeps the order of the list
+  EXPECT_EQ(multiBulk({"7", "14"}),
+            run({"sort", "sortlist", "by", "nosort", "limit", "1", "2"}));
+  EXPECT_EQ(
+    multiBulk({"13", "6"}),
+    run({"sort", "sortlist", "by", "nosort", "desc", "limit", "0", "2"}));
+  EXPECT_EQ(Command::fmtLongLong(3),
+            run({"zadd", "sortzset", "1", "a", "2", "b", "3", "c"}));
+  EXPECT_EQ(multiBulk({"b", "c"}),
+            run({"sort", "sortzset", "by", "nosort", "limit", "1", "2"}));
+
+  // GET # is the element itself
+  EXPECT_EQ(multiBulk({"0", "20", "o0", "1", "19", "o1"}),
+            run({"sort",
+                 "sortlist",
+                 "limit",
+                 "0",
+                 "2",
+                 "get",
+                 "#",
+                 "get",
+                 "weight_*",
+                 "get",
+                 "obj_*->name"}));
+  EXPECT_EQ(multiBulk({"o19", "o18"}),
+            run({"sort",
+                 "sortlist",
+                 "by",
+                 "weight_*",
+                 "get",
+                 "obj_*->name",
+                 "limit",
+                 "0",
+                 "2"}));
+  // the expired pattern keys are missing, which weigh 0
+  run({"set", "weight_5", "1", "px", "1"});
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(multiBulk({"5", "19"}),
+            run({"sort", "sortlist", "by", "weight_*", "limit", "0", "2"}));
+
+  // STORE overwrites a key of another type
+  EXPECT_EQ(Command::fmtOne(), run({"hset", "sortdst", "f", "v"}));
+  EXPECT_EQ(Command::fmtLongLong(n),
+            run({"sort", "sortlist", "desc", "store", "sortdst"}));
+  EXPECT_EQ(Command::fmtStatus("list"), run({"type", "sortdst"}));
+  EXPECT_EQ(multiBulk(desc), run({"lrange", "sortdst", "0", "-1"}));
+  EXPECT_EQ(Command::fmtLongLong(4),
+            run({"sort",
+                 "sortlist",
+                 "limit",
+                 "0",
+                 "2",
+                 "get",
+                 "#",
+                 "get",
+                 "obj_*->name",
+                 "store",
+                 "sortdst"}));
+  EXPECT_EQ(multiBulk({"0", "o0", "1", "o1"}),
+            run({"lrange", "sortdst", "0", "-1"}));
+  // an empty result deletes the destination
+  EXPECT_EQ(Command::fmtZero(),
+            run({"sort", "nosuchlist", "store", "sortdst"}));
+  EXPECT_EQ(Command::fmtZero(), run({"exists", "sortdst"}));
+
+  // the field (h1, f->g) and the field (h1->f, g) are different lookups
+  EXPECT_EQ(Command::fmtLongLong(2), run({"rpush", "arrows", "h1", "h1->f"}));
+  EXPECT_EQ(Command::fmtOne(), run({"hset", "h1", "f->g", "A"}));
+  EXPECT_EQ(Command::fmtOne(), run({"hset", "h1->f", "g", "B"}));
+  EXPECT_EQ(
+    multiBulk({"A", "", "", "B"}),
+    run({"sort", "arrows", "by", "nosort", "get", "*->f->g", "get", "*->g"}));
+}
+
+TEST(Command, sort) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  auto server = makeServerEntry(cfg);
+
+  testSort(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testIncrMeta(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  auto sess = std::make_shared<NetSession>(
+    svr, std::move(socket), 1, false, nullptr, nullptr);
+  auto run = [&sess](const std::vector<std::string>& args) {
+    sess->setArgs(args);
+    auto expect = Command::runSessionCmd(sess.get());
+    EXPECT_TRUE(expect.ok());
+    return expect.ok() ? expect.value() : expect.status().toString();
+  };
+
+  run({"set", "incrmeta_kv", "v"});
+  run({"set", "incrmeta_counter", "1"});
+  // a merge entry in the binlog
+  EXPECT_EQ(Command::fmtLongLong(2), run({"incr", "incrmeta_counter"}));
+  run({"xadd", "incrmeta_stream", "1-1", "f", "v"});
+  run({"hset", "incrmeta_hash", "f", "v"});
+
+  // the stream is skipped, as it is by the full meta dump
+  auto payload = run({"incrmeta", "0", "100000"});
+  EXPECT_NE(payload.find("INCRMETAEND"), std::string::npos);
+  EXPECT_NE(payload.find("incrmeta_kv"), std::string::npos);
+  EXPECT_NE(payload.find("incrmeta_counter"), std::string::npos);
+  EXPECT_NE(payload.find("incrmeta_hash"), std::string::npos);
+  EXPECT_EQ(payload.find("incrmeta_stream"), std::string::npos);
+}
+
+TEST(Command, incrmeta) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  cfg->incrMergeMode = true;
+  auto server = makeServerEntry(cfg);
+
+  testIncrMeta(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
 // NOTE(takenliu): renameCommand may change command's name or behavior, so put
 // it in the end
 extern string gRenameCmdList;
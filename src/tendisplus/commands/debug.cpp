@@ -27,13 +27,17 @@
 #include "rapidjson/stringbuffer.h"
 #include "rocksdb/perf_context.h"
 #include "rocksdb/iostats_context.h"
+#include "rocksdb/cache.h"
+#include "rocksdb/write_buffer_manager.h"
 #include "tendisplus/utils/sync_point.h"
 #include "tendisplus/utils/string.h"
+#include "tendisplus/utils/redis_port.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/commands/command.h"
 #include "tendisplus/commands/release.h"
 #include "tendisplus/commands/version.h"
 #include "tendisplus/storage/varint.h"
+#include "tendisplus/storage/quicklist.h"
 #include "tendisplus/utils/scopeguard.h"
 
 namespace tendisplus {
@@ -285,14 +289,23 @@ class PingCommand : public Command {
   }
 
   Expected<std::string> run(Session* sess) final {
-    if (sess->getArgs().size() == 1) {
-      return std::string("+PONG\r\n");
-    }
-    if (sess->getArgs().size() != 2) {
+    const auto& args = sess->getArgs();
+    if (args.size() > 2) {
       return {ErrorCodes::ERR_WRONG_ARGS_SIZE,
               "wrong number of arguments for 'ping' command"};
     }
-    return Command::fmtBulk(sess->getArgs()[1]);
+    // in subscribed mode, the reply is an array like a pubsub message
+    if (sess->getCtx()->getFlags() & CLIENT_PUBSUB) {
+      std::stringstream ss;
+      Command::fmtMultiBulkLen(ss, 2);
+      Command::fmtBulk(ss, "pong");
+      Command::fmtBulk(ss, args.size() == 1 ? "" : args[1]);
+      return ss.str();
+    }
+    if (args.size() == 1) {
+      return std::string("+PONG\r\n");
+    }
+    return Command::fmtBulk(args[1]);
   }
 } pingCmd;
 
@@ -570,7 +583,10 @@ class IterAllCommand : public Command {
       cursor->seek(unhex.value());
     }
 
-    std::unordered_map<std::string, uint64_t> lIdx;
+    std::unordered_map<std::string, ListMetaValue> lIdx;
+    // the index of the first element of each chunk, by the chunk id
+    std::unordered_map<std::string, std::unordered_map<uint64_t, uint64_t>>
+      lChunkIdx;
     std::list<Record> result;
     uint64_t currentTs = msSinceEpoch();
     while (true) {
@@ -632,14 +648,100 @@ class IterAllCommand : public Command {
     } else {
       nextCursor = "0";
     }
+    auto getListMeta =
+      [&](const RecordKey& rk) -> Expected<const ListMetaValue*> {
+      auto it = lIdx.find(rk.prefixPk());
+      if (it == lIdx.end()) {
+        RecordKey metakey(rk.getChunkId(),
+                          rk.getDbId(),
+                          RecordType::RT_DATA_META,
+                          rk.getPrimaryKey(),
+                          "");
+        auto expRv = kvstore->getKV(metakey, txn.get());
+        if (!expRv.ok()) {
+          return expRv.status();
+        }
+        auto expLm = ListMetaValue::decode(expRv.value().getValue());
+        if (!expLm.ok()) {
+          return expLm.status();
+        }
+        it = lIdx.emplace(rk.prefixPk(), std::move(expLm.value())).first;
+      }
+      return &it->second;
+    };
+    auto getChunkIdx = [&](const RecordKey& rk, const ListMetaValue& lm)
+      -> Expected<const std::unordered_map<uint64_t, uint64_t>*> {
+      auto it = lChunkIdx.find(rk.prefixPk());
+      if (it == lChunkIdx.end()) {
+        QuickList ql(rk.getChunkId(),
+                     rk.getDbId(),
+                     rk.getPrimaryKey(),
+                     lm,
+                     kvstore);
+        auto expChunks = ql.getChunks(txn.get());
+        if (!expChunks.ok()) {
+          return expChunks.status();
+        }
+        std::unordered_map<uint64_t, uint64_t> idxs;
+        uint64_t idx = 0;
+        for (const auto& c : expChunks.value()) {
+          idxs[c.id] = idx;
+          idx += c.count;
+        }
+        it = lChunkIdx.emplace(rk.prefixPk(), std::move(idxs)).first;
+      }
+      return &it->second;
+    };
+
+    // a chunk of a list is replied as its elements
     std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, 2);
-    Command::fmtBulk(ss, nextCursor);
-    Command::fmtMultiBulkLen(ss, result.size());
+    uint64_t cnt = 0;
     for (const auto& o : result) {
-      Command::fmtMultiBulkLen(ss, 5);
       const auto& t = o.getRecordKey().getRecordType();
       const auto& vt = o.getRecordValue().getRecordType();
+      if (t == RecordType::RT_LIST_ELE) {
+        auto expLm = getListMeta(o.getRecordKey());
+        if (!expLm.ok()) {
+          return expLm.status();
+        }
+        const ListMetaValue* lm = expLm.value();
+        const std::string& sk = o.getRecordKey().getSecondaryKey();
+        if (QuickList::isGroupKey(sk)) {
+          // the counts of the chunks
+          continue;
+        }
+        if (QuickList::isChunkKey(sk)) {
+          auto expId = QuickList::decodeChunkId(sk);
+          if (!expId.ok()) {
+            return expId.status();
+          }
+          auto expIdx = getChunkIdx(o.getRecordKey(), *lm);
+          if (!expIdx.ok()) {
+            return expIdx.status();
+          }
+          auto itIdx = expIdx.value()->find(expId.value());
+          if (itIdx == expIdx.value()->end()) {
+            return {ErrorCodes::ERR_INTERNAL, "list chunk not found"};
+          }
+          uint64_t idx = itIdx->second;
+          auto eles = QuickList::decodeChunk(o.getRecordValue().getValue());
+          if (!eles.ok()) {
+            return eles.status();
+          }
+          for (const auto& e : eles.value()) {
+            Command::fmtMultiBulkLen(ss, 5);
+            Command::fmtBulk(ss, std::to_string(static_cast<uint32_t>(vt)));
+            Command::fmtBulk(ss, std::to_string(o.getRecordKey().getDbId()));
+            Command::fmtBulk(ss, o.getRecordKey().getPrimaryKey());
+            Command::fmtBulk(ss, std::to_string(idx++));
+            Command::fmtBulk(ss, e);
+            cnt++;
+          }
+          continue;
+        }
+      }
+      cnt++;
+      Command::fmtMultiBulkLen(ss, 5);
       Command::fmtBulk(ss, std::to_string(static_cast<uint32_t>(vt)));
       switch (t) {
         case RecordType::RT_DATA_META:
@@ -661,31 +763,23 @@ class IterAllCommand : public Command {
 
         case RecordType::RT_LIST_ELE: {
           INVARIANT_D(vt == t);
-          if (lIdx.count(o.getRecordKey().prefixPk()) < 1) {
-            RecordKey metakey(o.getRecordKey().getChunkId(),
-                              o.getRecordKey().getDbId(),
-                              RecordType::RT_DATA_META,
-                              o.getRecordKey().getPrimaryKey(),
-                              "");
-            auto expRv = kvstore->getKV(metakey, txn.get());
-            if (!expRv.ok()) {
-              return expRv.status();
-            }
-            auto expLm = ListMetaValue::decode(expRv.value().getValue());
-            if (!expLm.ok()) {
-              return expLm.status();
-            }
-            lIdx.emplace(std::make_pair(o.getRecordKey().prefixPk(),
-                                        expLm.value().getHead()));
+          auto expLm = getListMeta(o.getRecordKey());
+          if (!expLm.ok()) {
+            return expLm.status();
           }
-          auto& head = lIdx[o.getRecordKey().prefixPk()];
-          auto expIdx = tendisplus::stoul(o.getRecordKey().getSecondaryKey());
+          const auto& lm = *expLm.value();
+          auto expIdx =
+            tendisplus::stoul(o.getRecordKey().getSecondaryKey());
           if (!expIdx.ok()) {
             return expIdx.status();
           }
           Command::fmtBulk(ss, std::to_string(o.getRecordKey().getDbId()));
           Command::fmtBulk(ss, o.getRecordKey().getPrimaryKey());
-          Command::fmtBulk(ss, std::to_string(expIdx.value() - head));
+          // the older elements of a list follow its chunks
+          uint64_t idx = lm.getTail() - lm.getHead() -
+            (lm.getLegacyTail() - lm.getLegacyHead()) +
+            (expIdx.value() - lm.getLegacyHead());
+          Command::fmtBulk(ss, std::to_string(idx));
           Command::fmtBulk(ss, o.getRecordValue().getValue());
           break;
         }
@@ -705,7 +799,12 @@ class IterAllCommand : public Command {
           INVARIANT_D(0);
       }
     }
-    return ss.str();
+    std::stringstream reply;
+    Command::fmtMultiBulkLen(reply, 2);
+    Command::fmtBulk(reply, nextCursor);
+    Command::fmtMultiBulkLen(reply, cnt);
+    reply << ss.rdbuf();
+    return reply.str();
   }
 } iterAllCmd;
 
@@ -1719,6 +1818,59 @@ class ClientCommand : public Command {
     return {ErrorCodes::ERR_NOTFOUND, "No such client"};
   }
 
+  // CLIENT TRACKING ON|OFF [REDIRECT id] [PREFIX prefix ...] [BCAST]
+  // [NOLOOP], there is no RESP3 in tendis, REDIRECT is required.
+  Expected<std::string> trackingClient(Session* sess) {
+    const std::vector<std::string>& args = sess->getArgs();
+    auto trackingMgr = sess->getServerEntry()->getTrackingMgr();
+    auto onoff = toLower(args[2]);
+    uint64_t redirectId = 0;
+    bool bcast = false;
+    bool noloop = false;
+    std::vector<std::string> prefixes;
+
+    for (size_t i = 3; i < args.size(); i++) {
+      auto opt = toLower(args[i]);
+      bool moreargs = args.size() > i + 1;
+      if (opt == "redirect" && moreargs) {
+        Expected<uint64_t> eid = ::tendisplus::stoul(args[++i]);
+        if (!eid.ok()) {
+          return eid.status();
+        }
+        redirectId = eid.value();
+      } else if (opt == "prefix" && moreargs) {
+        prefixes.push_back(args[++i]);
+      } else if (opt == "bcast") {
+        bcast = true;
+      } else if (opt == "noloop") {
+        noloop = true;
+      } else {
+        return {ErrorCodes::ERR_PARSEOPT, ""};
+      }
+    }
+
+    if (onoff == "off") {
+      trackingMgr->disableTracking(sess);
+      return Command::fmtOK();
+    } else if (onoff != "on") {
+      return {ErrorCodes::ERR_PARSEOPT, ""};
+    }
+    if (!bcast && !prefixes.empty()) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "PREFIX option requires BCAST mode to be enabled"};
+    }
+    if (redirectId == 0) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "REDIRECT is required, RESP3 is not supported"};
+    }
+    auto s =
+      trackingMgr->enableTracking(sess, redirectId, bcast, noloop, prefixes);
+    if (!s.ok()) {
+      return s;
+    }
+    return Command::fmtOK();
+  }
+
   Expected<std::string> run(Session* sess) final {
     const std::vector<std::string>& args = sess->getArgs();
 
@@ -1748,10 +1900,16 @@ class ClientCommand : public Command {
       return Command::fmtOK();
     } else if (arg1 == "kill") {
       return killClients(sess);
+    } else if (arg1 == "tracking" && args.size() >= 3) {
+      return trackingClient(sess);
+    } else if (arg1 == "getredir" && args.size() == 2) {
+      auto trackingMgr = sess->getServerEntry()->getTrackingMgr();
+      uint64_t redirectId = trackingMgr->getRedirectId(sess->id());
+      return Command::fmtLongLong(redirectId ? redirectId : -1);
     } else {
       return {ErrorCodes::ERR_PARSEOPT,
               "Syntax error, try CLIENT (LIST | KILL ip:port | GETNAME | "
-              "SETNAME connection-name)"};  // NOLINT
+              "SETNAME connection-name | TRACKING on|off)"};  // NOLINT
     }
   }
 } clientCmd;
@@ -1810,7 +1968,9 @@ class InfoCommand : public Command {
     infoBackup(allsections, defsections, section, sess, result);
     infoDataset(allsections, defsections, section, sess, result);
     infoCompaction(allsections, defsections, section, sess, result);
+    infoGC(allsections, defsections, section, sess, result);
     infoLevelStats(allsections, defsections, section, sess, result);
+    infoRocksdbMemory(allsections, defsections, section, sess, result);
     infoRocksdbStats(allsections, defsections, section, sess, result);
     infoRocksdbPerfStats(allsections, defsections, section, sess, result);
     infoRocksdbBgError(allsections, defsections, section, sess, result);
@@ -1881,7 +2041,13 @@ class InfoCommand : public Command {
       auto server = sess->getServerEntry();
       std::stringstream ss;
       ss << "# Clients\r\n"
-         << "connected_clients:" << server->getSessionCount() << "\r\n";
+         << "connected_clients:" << server->getSessionCount() << "\r\n"
+         << "blocked_clients:" << server->getBlockMgr()->getBlockedCount()
+         << "\r\n"
+         << "tracking_clients:"
+         << server->getTrackingMgr()->getTrackingCount() << "\r\n"
+         << "tracking_total_keys:"
+         << server->getTrackingMgr()->getTrackedKeyCount() << "\r\n";
       ss << "\r\n";
       result << ss.str();
     }
@@ -2193,10 +2359,18 @@ class InfoCommand : public Command {
       ss << "rocksdb.live-sst-files-size:" << live << "\r\n";
       ss << "rocksdb.estimate-live-data-size:" << estimate << "\r\n";
       ss << "rocksdb.estimate-num-keys:" << numkeys << "\r\n";
-      ss << "rocksdb.total-memory:"
-         << memtables + tablereaderMem +
-          (uint64_t)server->getParams()->rocksBlockcacheMB * 1024 * 1024
-         << "\r\n";
+      // the memtables or the index and filter blocks may be charged to
+      // the block cache, count them once
+      const auto& params = server->getParams();
+      uint64_t totalMem =
+        (uint64_t)params->rocksBlockcacheMB * 1024 * 1024;
+      if (!server->getWriteBufferManager()) {
+        totalMem += memtables;
+      }
+      if (!params->rocksCacheIndexAndFilterBlocks) {
+        totalMem += tablereaderMem;
+      }
+      ss << "rocksdb.total-memory:" << totalMem << "\r\n";
       ss << "rocksdb.cur-size-all-mem-tables:" << memtables << "\r\n";
       ss << "rocksdb.estimate-table-readers-mem:" << tablereaderMem << "\r\n";
       ss << "rocksdb.blockcache:"
@@ -2227,6 +2401,29 @@ class InfoCommand : public Command {
              << (running ? "running" : "stopped") << "\r\n";
       result << "time-since-lastest-compaction:" << duration << "\r\n";
       result << "current-compaction-dbid:" << dbid << "\r\n";
+      auto scheduler = sess->getServerEntry()->getCompactionScheduler();
+      if (scheduler) {
+        std::stringstream ss;
+        scheduler->getInfo(ss);
+        result << ss.str();
+      }
+      result << "\r\n";
+    }
+  }
+
+  static void infoGC(bool allsections,
+                     bool defsections,
+                     const std::string& section,
+                     Session* sess,
+                     std::stringstream& result) {
+    if (allsections || defsections || section == "gc") {
+      auto gcMgr = sess->getServerEntry()->getGcMgr();
+      // only in cluster mode
+      if (!gcMgr) {
+        return;
+      }
+      result << "# GC\r\n";
+      gcMgr->getGcInfo(result);
       result << "\r\n";
     }
   }
@@ -2264,6 +2461,71 @@ class InfoCommand : public Command {
     }
   }
 
+  static void infoRocksdbMemory(bool allsections,
+                                bool defsections,
+                                const std::string& section,
+                                Session* sess,
+                                std::stringstream& result) {
+    if (allsections || section == "rocksdbmemory") {
+      auto server = sess->getServerEntry();
+
+      result << "# RocksdbMemory\r\n";
+      const auto& blockCache = server->getBlockCache();
+      if (blockCache) {
+        result << "rocksdb.blockcache-capacity:" << blockCache->GetCapacity()
+               << "\r\n";
+        result << "rocksdb.blockcache-usage:" << blockCache->GetUsage()
+               << "\r\n";
+        result << "rocksdb.blockcache-pinned-usage:"
+               << blockCache->GetPinnedUsage() << "\r\n";
+      }
+      const auto& wbm = server->getWriteBufferManager();
+      if (wbm) {
+        result << "rocksdb.write-buffer-manager-size:" << wbm->buffer_size()
+               << "\r\n";
+        result << "rocksdb.write-buffer-manager-usage:" << wbm->memory_usage()
+               << "\r\n";
+        result << "rocksdb.write-buffer-manager-mutable-usage:"
+               << wbm->mutable_memtable_memory_usage() << "\r\n";
+      }
+
+      const std::vector<std::pair<std::string, ColumnFamilyNumber>> cfs = {
+        {"default", ColumnFamilyNumber::ColumnFamily_Default},
+        {"binlog", ColumnFamilyNumber::ColumnFamily_Binlog}};
+      const std::vector<std::string> properties = {
+        "cur-size-all-mem-tables",
+        "size-all-mem-tables",
+        "estimate-table-readers-mem"};
+      for (uint64_t i = 0; i < server->getKVStoreCount(); ++i) {
+        auto expdb = server->getSegmentMgr()->getDb(
+          sess, i, mgl::LockMode::LOCK_IS, false, 0);
+        if (!expdb.ok()) {
+          continue;
+        }
+
+        auto store = expdb.value().store;
+        for (const auto& cf : cfs) {
+          if (cf.second == ColumnFamilyNumber::ColumnFamily_Binlog &&
+              server->getParams()->binlogUsingDefaultCF) {
+            continue;
+          }
+          for (const auto& property : properties) {
+            uint64_t value = 0;
+            if (!store->getIntProperty(
+                  "rocksdb." + property, &value, cf.second)) {
+              continue;
+            }
+            // e.g. rocksdb0.default.cur-size-all-mem-tables
+            result << "rocksdb" << store->dbId() << "." << cf.first << "."
+                   << property << ":" << value << "\r\n";
+          }
+        }
+      }
+
+      result << "\r\n";
+    }
+  }
+
   static void infoRocksdbStats(bool allsections,
                                bool defsections,
                                const std::string& section,
@@ -2477,6 +2739,7 @@ class ObjectCommand : public Command {
         {RecordType::RT_HASH_META, "hashtable"},
         {RecordType::RT_SET_META, "ziplist"},
         {RecordType::RT_ZSET_META, "skiplist"},
+        {RecordType::RT_STREAM_META, "stream"},
       };
 
       Expected<RecordValue> rv =
@@ -2688,6 +2951,10 @@ class FlushGeneric : public Command {
     auto server = sess->getServerEntry();
     auto replMgr = server->getReplManager();
     INVARIANT(replMgr != nullptr);
+    // tracking sessions drop their caches, even if only some of the
+    // kvstores are flushed
+    const auto guard =
+      MakeGuard([server] { server->getTrackingMgr()->invalidateAll(); });
 
     for (ssize_t i = 0; i < server->getKVStoreCount(); i++) {
       auto expdb =
@@ -2831,12 +3098,13 @@ class FlushAllDiskCommand : public FlushGeneric {
   }
 } flushalldiskCmd;
 
+// monitor [SAMPLE n] [COMMAND name] ... [KEYPREFIX prefix]
 class MonitorCommand : public Command {
  public:
   MonitorCommand() : Command("monitor", "as") {}
 
   ssize_t arity() const {
-    return 1;
+    return -1;
   }
 
   int32_t firstkey() const {
@@ -2852,16 +3120,94 @@ class MonitorCommand : public Command {
   }
 
   Expected<std::string> run(Session* sess) final {
+    auto filter = CaptureFilter::parse(sess->getArgs(), 1);
+    if (!filter.ok()) {
+      return filter.status();
+    }
     SessionCtx* pCtx = sess->getCtx();
     INVARIANT(pCtx != nullptr);
-    pCtx->setIsMonitor(true);
 
-    sess->getServerEntry()->AddMonitor(sess->id());
+    auto monitorMgr = sess->getServerEntry()->getMonitorMgr();
+    auto s = monitorMgr->addMonitor(sess, filter.value());
+    if (!s.ok()) {
+      return s;
+    }
+    pCtx->setIsMonitor(true);
 
     return Command::fmtOK();
   }
 } monitorCmd;
 
+// trafficcapture start path [SAMPLE n] [COMMAND name] ... [KEYPREFIX prefix]
+// trafficcapture stop
+// trafficcapture status
+// the file is in the format described in monitor_manager.h, and can be
+// replayed by tendisplus_bench.
+class TrafficCaptureCommand : public Command {
+ public:
+  TrafficCaptureCommand() : Command("trafficcapture", "as") {}
+
+  ssize_t arity() const {
+    return -2;
+  }
+
+  int32_t firstkey() const {
+    return 0;
+  }
+
+  int32_t lastkey() const {
+    return 0;
+  }
+
+  int32_t keystep() const {
+    return 0;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const auto& args = sess->getArgs();
+    auto monitorMgr = sess->getServerEntry()->getMonitorMgr();
+    auto subCmd = toLower(args[1]);
+
+    if (subCmd == "start" && args.size() >= 3) {
+      auto filter = CaptureFilter::parse(args, 3);
+      if (!filter.ok()) {
+        return filter.status();
+      }
+      auto s = monitorMgr->startDump(args[2], filter.value());
+      if (!s.ok()) {
+        return s;
+      }
+      return Command::fmtOK();
+    } else if (subCmd == "stop" && args.size() == 2) {
+      auto s = monitorMgr->stopDump();
+      if (!s.ok()) {
+        return s;
+      }
+      return Command::fmtOK();
+    } else if (subCmd == "status" && args.size() == 2) {
+      auto stats = monitorMgr->getStats();
+      std::stringstream ss;
+      Command::fmtMultiBulkLen(ss, 14);
+      Command::fmtBulk(ss, "captured");
+      Command::fmtLongLong(ss, stats.captured);
+      Command::fmtBulk(ss, "dropped");
+      Command::fmtLongLong(ss, stats.dropped);
+      Command::fmtBulk(ss, "dumped");
+      Command::fmtLongLong(ss, stats.dumped);
+      Command::fmtBulk(ss, "monitors");
+      Command::fmtLongLong(ss, stats.monitors);
+      Command::fmtBulk(ss, "rings");
+      Command::fmtLongLong(ss, stats.rings);
+      Command::fmtBulk(ss, "dumping");
+      Command::fmtLongLong(ss, stats.dumping ? 1 : 0);
+      Command::fmtBulk(ss, "path");
+      Command::fmtBulk(ss, stats.dumpPath);
+      return ss.str();
+    }
+    return {ErrorCodes::ERR_PARSEOPT, ""};
+  }
+} trafficCaptureCmd;
+
 // destroystore storeId [force]
 // force is optional, it means whether check the store is empty.
 // if force, no check
@@ -3252,10 +3598,269 @@ class PublishCommand : public Command {
   }
 
   Expected<std::string> run(Session* sess) final {
-    return Command::fmtOK();
+    const auto& args = sess->getArgs();
+    auto svr = sess->getServerEntry();
+    auto receivers = svr->getPubSubMgr()->publish(args[1], args[2]);
+    // like redis, the receivers on the other nodes are not counted
+    if (svr->isClusterEnabled()) {
+      svr->getClusterMgr()->getClusterState()->clusterPropagatePublish(
+        args[1], args[2]);
+    }
+    return Command::fmtLongLong(receivers);
   }
 } publishCmd;
 
+// reply of (P)SUBSCRIBE and (P)UNSUBSCRIBE for one channel or pattern
+void fmtSubscribeReply(std::stringstream& ss,
+                       const std::string& kind,
+                       const std::string* name,
+                       size_t count) {
+  Command::fmtMultiBulkLen(ss, 3);
+  Command::fmtBulk(ss, kind);
+  if (name) {
+    Command::fmtBulk(ss, *name);
+  } else {
+    Command::fmtNull(ss);
+  }
+  Command::fmtLongLong(ss, count);
+}
+
+void updatePubSubFlag(Session* sess, size_t count) {
+  if (count > 0) {
+    sess->getCtx()->setFlags(CLIENT_PUBSUB);
+  } else {
+    sess->getCtx()->resetFlags(CLIENT_PUBSUB);
+  }
+}
+
+// only a network session can receive messages
+Expected<NetSession*> getSubscriber(Session* sess) {
+  auto netSess = dynamic_cast<NetSession*>(sess);
+  if (sess->getType() != Session::Type::NET || netSess == nullptr) {
+    return {ErrorCodes::ERR_INTERNAL,
+            "subscribe not supported in this session"};
+  }
+  if (sess->getCtx()->isInMulti() ||
+      (sess->getCtx()->getFlags() & CLIENT_EXEC)) {
+    return {ErrorCodes::ERR_PARSEOPT, "subscribe not allowed in MULTI"};
+  }
+  return netSess;
+}
+
+class SubscribeCommand : public Command {
+ public:
+  SubscribeCommand() : Command("subscribe", "pslt") {}
+
+  ssize_t arity() const {
+    return -2;
+  }
+
+  int32_t firstkey() const {
+    return 0;
+  }
+
+  int32_t lastkey() const {
+    return 0;
+  }
+
+  int32_t keystep() const {
+    return 0;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    auto esess = getSubscriber(sess);
+    if (!esess.ok()) {
+      return esess.status();
+    }
+    const auto& args = sess->getArgs();
+    auto mgr = sess->getServerEntry()->getPubSubMgr();
+    std::stringstream ss;
+    size_t count = 0;
+    for (size_t i = 1; i < args.size(); ++i) {
+      count = mgr->subscribe(esess.value(), args[i]);
+      fmtSubscribeReply(ss, "subscribe", &args[i], count);
+    }
+    updatePubSubFlag(sess, count);
+    return ss.str();
+  }
+} subscribeCmd;
+
+class PSubscribeCommand : public Command {
+ public:
+  PSubscribeCommand() : Command("psubscribe", "pslt") {}
+
+  ssize_t arity() const {
+    return -2;
+  }
+
+  int32_t firstkey() const {
+    return 0;
+  }
+
+  int32_t lastkey() const {
+    return 0;
+  }
+
+  int32_t keystep() const {
+    return 0;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    auto esess = getSubscriber(sess);
+    if (!esess.ok()) {
+      return esess.status();
+    }
+    const auto& args = sess->getArgs();
+    auto mgr = sess->getServerEntry()->getPubSubMgr();
+    std::stringstream ss;
+    size_t count = 0;
+    for (size_t i = 1; i < args.size(); ++i) {
+      count = mgr->psubscribe(esess.value(), args[i]);
+      fmtSubscribeReply(ss, "psubscribe", &args[i], count);
+    }
+    updatePubSubFlag(sess, count);
+    return ss.str();
+  }
+} psubscribeCmd;
+
+class UnsubscribeCommand : public Command {
+ public:
+  UnsubscribeCommand() : Command("unsubscribe", "pslt") {}
+
+  ssize_t arity() const {
+    return -1;
+  }
+
+  int32_t firstkey() const {
+    return 0;
+  }
+
+  int32_t lastkey() const {
+    return 0;
+  }
+
+  int32_t keystep() const {
+    return 0;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const auto& args = sess->getArgs();
+    auto mgr = sess->getServerEntry()->getPubSubMgr();
+    // without arguments, unsubscribe from all the channels
+    std::vector<std::string> channels(args.begin() + 1, args.end());
+    if (channels.empty()) {
+      channels = mgr->getChannels(sess->id());
+    }
+    std::stringstream ss;
+    if (channels.empty()) {
+      auto count = mgr->getPatterns(sess->id()).size();
+      fmtSubscribeReply(ss, "unsubscribe", nullptr, count);
+      updatePubSubFlag(sess, count);
+      return ss.str();
+    }
+    size_t count = 0;
+    for (const auto& channel : channels) {
+      count = mgr->unsubscribe(sess, channel);
+      fmtSubscribeReply(ss, "unsubscribe", &channel, count);
+    }
+    updatePubSubFlag(sess, count);
+    return ss.str();
+  }
+} unsubscribeCmd;
+
+class PUnsubscribeCommand : public Command {
+ public:
+  PUnsubscribeCommand() : Command("punsubscribe", "pslt") {}
+
+  ssize_t arity() const {
+    return -1;
+  }
+
+  int32_t firstkey() const {
+    return 0;
+  }
+
+  int32_t lastkey() const {
+    return 0;
+  }
+
+  int32_t keystep() const {
+    return 0;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const auto& args = sess->getArgs();
+    auto mgr = sess->getServerEntry()->getPubSubMgr();
+    // without arguments, unsubscribe from all the patterns
+    std::vector<std::string> patterns(args.begin() + 1, args.end());
+    if (patterns.empty()) {
+      patterns = mgr->getPatterns(sess->id());
+    }
+    std::stringstream ss;
+    if (patterns.empty()) {
+      auto count = mgr->getChannels(sess->id()).size();
+      fmtSubscribeReply(ss, "punsubscribe", nullptr, count);
+      updatePubSubFlag(sess, count);
+      return ss.str();
+    }
+    size_t count = 0;
+    for (const auto& pattern : patterns) {
+      count = mgr->punsubscribe(sess, pattern);
+      fmtSubscribeReply(ss, "punsubscribe", &pattern, count);
+    }
+    updatePubSubFlag(sess, count);
+    return ss.str();
+  }
+} punsubscribeCmd;
+
+class PubSubCommand : public Command {
+ public:
+  PubSubCommand() : Command("pubsub", "pltR") {}
+
+  ssize_t arity() const {
+    return -2;
+  }
+
+  int32_t firstkey() const {
+    return 0;
+  }
+
+  int32_t lastkey() const {
+    return 0;
+  }
+
+  int32_t keystep() const {
+    return 0;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const auto& args = sess->getArgs();
+    auto mgr = sess->getServerEntry()->getPubSubMgr();
+    auto subcmd = toLower(args[1]);
+    std::stringstream ss;
+    if (subcmd == "channels" && (args.size() == 2 || args.size() == 3)) {
+      auto channels = mgr->activeChannels(args.size() == 3 ? args[2] : "");
+      Command::fmtMultiBulkLen(ss, channels.size());
+      for (const auto& channel : channels) {
+        Command::fmtBulk(ss, channel);
+      }
+    } else if (subcmd == "numsub") {
+      Command::fmtMultiBulkLen(ss, (args.size() - 2) * 2);
+      for (size_t i = 2; i < args.size(); ++i) {
+        Command::fmtBulk(ss, args[i]);
+        Command::fmtLongLong(ss, mgr->numSub(args[i]));
+      }
+    } else if (subcmd == "numpat" && args.size() == 2) {
+      Command::fmtLongLong(ss, mgr->numPat());
+    } else {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "Unknown PUBSUB subcommand or wrong number of arguments for '" +
+                args[1] + "'"};
+    }
+    return ss.str();
+  }
+} pubsubCmd;
+
 class multiCommand : public Command {
  public:
   multiCommand() : Command("multi", "sF") {}
@@ -3312,6 +3917,18 @@ class execCommand : public Command {
     if (!pCtx->isInMulti()) {
       return {ErrorCodes::ERR_PARSEPKT, "EXEC without MULTI"};
     }
+    if (!pCtx->isEp()) {
+      bool dirty = pCtx->getFlags() & CLIENT_DIRTY_EXEC;
+      auto cmds = pCtx->popMultiCmds();
+      pCtx->resetMulti();
+      if (dirty) {
+        return {ErrorCodes::ERR_PARSEPKT,
+                "-EXECABORT Transaction discarded because of previous "
+                "errors.\r\n"};
+      }
+      return execQueued(sess, &cmds);
+    }
+    // with the extended protocol, the commands were run at once
     // check version ?
     if (!pCtx->verifyVersion(pCtx->getVersionEP())) {
       return {ErrorCodes::ERR_WRONG_VERSION_EP, ""};
@@ -3321,8 +3938,168 @@ class execCommand : public Command {
     // command results
     return Command::fmtOK();
   }
+
+ private:
+  // the keys of all the commands are locked in the order of
+  // SegmentMgr::getAllKeysLocked() before the first command, and the
+  // commands write to one transaction of their kvstore, which is committed
+  // once after the last command. So EXEC costs one commit and one binlog,
+  // instead of one per command.
+  // The commands are run one by one with their own transactions if some
+  // of them can't be coalesced: a keyless command which is not readonly
+  // (SELECT, FLUSHALL...) may change the db or need the kvstore lock.
+  // Neither are the keys of more than one kvstore coalesced: the stores
+  // can't commit atomically, a failed commit of a later store would leave
+  // the earlier ones applied behind an error reply. Run one by one, each
+  // command reports its own result, like redis which never rolls back.
+  Expected<std::string> execQueued(
+    Session* sess, std::vector<std::vector<std::string>>* cmds) {
+    auto server = sess->getServerEntry();
+    auto pCtx = sess->getCtx();
+
+    std::vector<std::string> keys;
+    bool coalesce = true;
+    bool hasWrite = false;
+    for (auto& args : *cmds) {
+      sess->swapArgs(&args);
+      auto cmd = Command::getCommand(sess);
+      std::vector<int> index;
+      if (cmd) {
+        index = cmd->getKeysFromCommand(sess->getArgs());
+      }
+      sess->swapArgs(&args);
+      if (!cmd) {
+        coalesce = false;
+        break;
+      }
+      if (index.empty() && !(cmd->getFlags() & CMD_READONLY)) {
+        coalesce = false;
+        break;
+      }
+      hasWrite |= static_cast<bool>(cmd->getFlags() & CMD_WRITE);
+      for (auto i : index) {
+        keys.push_back(args[i]);
+      }
+    }
+
+    if (coalesce) {
+      std::set<uint32_t> stores;
+      for (const auto& key : keys) {
+        stores.insert(server->getSegmentMgr()->getStoreid(
+          redis_port::keyHashSlot(key.c_str(), key.size())));
+      }
+      coalesce = stores.size() <= 1;
+    }
+
+    std::list<std::unique_ptr<KeyLock>> locks;
+    std::map<std::string, std::unique_ptr<Transaction>> txns;
+    if (coalesce && !keys.empty()) {
+      std::sort(keys.begin(), keys.end());
+      keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+      std::vector<int> index(keys.size());
+      for (size_t i = 0; i < keys.size(); i++) {
+        index[i] = i;
+      }
+      auto elocks = server->getSegmentMgr()->getAllKeysLocked(
+        sess,
+        keys,
+        index,
+        hasWrite ? mgl::LockMode::LOCK_X : mgl::LockMode::LOCK_S);
+      RET_IF_ERR_EXPECTED(elocks);
+      locks = std::move(elocks.value());
+
+      for (const auto& key : keys) {
+        auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, key);
+        RET_IF_ERR_EXPECTED(expdb);
+        auto store = expdb.value().store;
+        if (txns.count(store->dbId())) {
+          continue;
+        }
+        auto ptxn = store->createTransaction(sess);
+        RET_IF_ERR_EXPECTED(ptxn);
+        txns[store->dbId()] = std::move(ptxn.value());
+      }
+    }
+    for (const auto& txn : txns) {
+      pCtx->setNestedTxn(txn.first, txn.second.get());
+    }
+
+    pCtx->setFlags(CLIENT_EXEC);
+    std::stringstream ss;
+    Command::fmtMultiBulkLen(ss, cmds->size());
+    for (auto& args : *cmds) {
+      sess->swapArgs(&args);
+      auto cmd = Command::getCommand(sess);
+      bool isWrite = cmd && (cmd->getFlags() & CMD_WRITE);
+      // a failed command leaves nothing in the transactions, like it
+      // does in its own transaction
+      if (isWrite) {
+        for (const auto& txn : txns) {
+          txn.second->setSavePoint();
+        }
+      }
+      auto expCmd = Command::precheck(sess);
+      Expected<std::string> v = expCmd.ok() ? Command::runSessionCmd(sess)
+                                            : expCmd.status();
+      if (isWrite) {
+        for (const auto& txn : txns) {
+          auto s = v.ok() ? txn.second->popSavePoint()
+                          : txn.second->rollbackToSavePoint();
+          if (!s.ok()) {
+            LOG(ERROR) << "release save point failed:" << s.toString();
+          }
+        }
+      }
+      if (v.ok()) {
+        ss << v.value();
+      } else {
+        ss << Command::fmtErr(v.status().toString());
+      }
+      sess->swapArgs(&args);
+    }
+    pCtx->resetFlags(CLIENT_EXEC);
+    for (const auto& txn : txns) {
+      pCtx->setNestedTxn(txn.first, nullptr);
+    }
+
+    for (const auto& txn : txns) {
+      auto eCommit = txn.second->commit();
+      RET_IF_ERR_EXPECTED(eCommit);
+    }
+    return ss.str();
+  }
 } execCmd;
 
+class discardCommand : public Command {
+ public:
+  discardCommand() : Command("discard", "sF") {}
+
+  ssize_t arity() const {
+    return 1;
+  }
+
+  int32_t firstkey() const {
+    return 0;
+  }
+
+  int32_t lastkey() const {
+    return 0;
+  }
+
+  int32_t keystep() const {
+    return 0;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    auto pCtx = sess->getCtx();
+    if (!pCtx->isInMulti()) {
+      return {ErrorCodes::ERR_PARSEPKT, "DISCARD without MULTI"};
+    }
+    pCtx->resetMulti();
+    return Command::fmtOK();
+  }
+} discardCmd;
+
 class slowlogCommand : public Command {
  public:
   slowlogCommand() : Command("slowlog", "sM") {}
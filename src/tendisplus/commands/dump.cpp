@@ -11,6 +11,7 @@
 #include "tendisplus/commands/dump.h"
 #include "tendisplus/commands/command.h"
 #include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/quicklist.h"
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/redis_port.h"
 #include "tendisplus/storage/record.h"
@@ -466,29 +467,35 @@ class ListSerializer : public Serializer {
     uint32_t lenSz(0);
     std::vector<std::string> ziplist;
     size_t zlCnt(0);
-    for (size_t i = head; i != tail; i++) {
-      RecordKey nodeKey(expdb.value().chunkId,
-                        _sess->getCtx()->getDbId(),
-                        RecordType::RT_LIST_ELE,
-                        _key,
-                        std::to_string(i));
-      auto expNodeVal = kvstore->getKV(nodeKey, txn.get());
-      if (!expNodeVal.ok()) {
-        return expNodeVal.status();
+    QuickList ql(expdb.value().chunkId,
+                 _sess->getCtx()->getDbId(),
+                 _key,
+                 expListMeta.value(),
+                 kvstore);
+    uint64_t idx(0);
+    while (idx < len) {
+      // a batch of the elements is read with one scan
+      auto values =
+        ql.range(idx, std::min(idx + LIST_DUMP_BATCH, len), txn.get());
+      if (!values.ok()) {
+        return values.status();
       }
-      byteSz += expNodeVal.value().getValue().size();
-      lenSz++;
-      ziplist.emplace_back(std::move(expNodeVal.value().getValue()));
-      if ((byteSz > ZLBYTE_LIMIT || lenSz > ZLLEN_LIMIT) || i == tail - 1) {
-        ++zlCnt;
-        auto ezlBytes = formatZiplist(payload, &_pos, ziplist, byteSz);
-        if (!ezlBytes.ok()) {
-          return ezlBytes.status();
+      for (auto& v : values.value()) {
+        byteSz += v.size();
+        lenSz++;
+        ziplist.emplace_back(std::move(v));
+        ++idx;
+        if ((byteSz > ZLBYTE_LIMIT || lenSz > ZLLEN_LIMIT) || idx == len) {
+          ++zlCnt;
+          auto ezlBytes = formatZiplist(payload, &_pos, ziplist, byteSz);
+          if (!ezlBytes.ok()) {
+            return ezlBytes.status();
+          }
+          qlbytes += ezlBytes.value();
+          ziplist.clear();
+          byteSz = 0;
+          lenSz = 0;
         }
-        qlbytes += ezlBytes.value();
-        ziplist.clear();
-        byteSz = 0;
-        lenSz = 0;
       }
     }
 
@@ -1155,6 +1162,7 @@ class ZsetDeserializer : public Deserializer {
     }
     INVARIANT_D(eMeta.status().code() == ErrorCodes::ERR_NOTFOUND);
     ZSlMetaValue meta(1, 1, 0);
+    meta.setScoreIndex(true);
     RecordValue rv(meta.encode(),
                    RecordType::RT_ZSET_META,
                    _sess->getCtx()->getVersionEP(),
@@ -1380,9 +1388,11 @@ class ListDeserializer : public Deserializer {
     }
     std::unique_ptr<Transaction> txn = std::move(ptxn.value());
     ListMetaValue lm(INITSEQ, INITSEQ);
-
-    uint64_t head = lm.getHead();
-    uint64_t tail = lm.getTail();
+    QuickList ql(metaRk.getChunkId(),
+                 metaRk.getDbId(),
+                 metaRk.getPrimaryKey(),
+                 lm,
+                 kvstore);
     while (qlLen--) {
       auto zlist = loadString(_payload, &_pos);
       size_t pos = 0;
@@ -1391,25 +1401,13 @@ class ListDeserializer : public Deserializer {
         LOG(ERROR) << "Restore list failed, " << expZl.status().toString();
         return expZl.status();
       }
-      const auto& zl = expZl.value();
-      uint64_t idx;
-      for (auto iter = zl.begin(); iter != zl.end(); iter++) {
-        idx = tail++;
-        RecordKey rk(metaRk.getChunkId(),
-                     metaRk.getDbId(),
-                     RecordType::RT_LIST_ELE,
-                     metaRk.getPrimaryKey(),
-                     std::to_string(idx));
-        RecordValue rv(std::move(*iter), RecordType::RT_LIST_ELE, -1);
-        Status s = kvstore->setKV(rk, rv, txn.get());
-        if (!s.ok()) {
-          return s;
-        }
+      Status s = ql.push(expZl.value(), false, txn.get());
+      if (!s.ok()) {
+        return s;
       }
     }
-    lm.setHead(head);
-    lm.setTail(tail);
-    RecordValue metaRv(lm.encode(),
+    ListMetaValue newLm = ql.getMeta();
+    RecordValue metaRv(newLm.encode(),
                        RecordType::RT_LIST_META,
                        _sess->getCtx()->getVersionEP(),
                        _ttl);
@@ -1566,6 +1564,9 @@ class RestoreMetaCommand : public Command {
         case RecordType::RT_KV:
           typeMask = 0 << 4;
           break;
+        case RecordType::RT_STREAM_META:
+          // no type mask for streams, they can't be dumped
+          continue;
         default:
           LOG(ERROR) << "get invalid record type"
                      << rt2Char(value.getRecordType()) << "in iteration";
@@ -1682,6 +1683,8 @@ class IncrMetaCommand : public Command {
   Expected<IncrMeta> parseReplLogValueEntryV2(const ReplLogValueEntryV2& entry,
                                               uint64_t startRevision) {
     switch (entry.getOp()) {
+      // the operand of a counter is a value with the header of the sum
+      case ReplOp::REPL_OP_MERGE:
       case ReplOp::REPL_OP_SET: {
         Expected<RecordKey> opkey = RecordKey::decode(entry.getOpKey());
         if (!opkey.ok()) {
@@ -1696,6 +1699,10 @@ class IncrMetaCommand : public Command {
             return opvalue.status();
           }
           const auto& value = opvalue.value();
+          if (value.getRecordType() == RecordType::RT_STREAM_META) {
+            // no type mask for streams, they can't be dumped
+            break;
+          }
           uint64_t version = value.getVersionEP();
           uint64_t ttl = value.getTtl();
           uint8_t type = decodeType(value.getRecordType());
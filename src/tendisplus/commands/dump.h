@@ -55,6 +55,8 @@ enum class DumpType : uint8_t {
 // utility
 constexpr uint32_t ZLBYTE_LIMIT = 8192;
 constexpr uint32_t ZLLEN_LIMIT = 256;
+// the list elements are read in batches of this size
+constexpr uint64_t LIST_DUMP_BATCH = 1024;
 
 // this `extern` is a little weird here i think..
 constexpr uint64_t MAXSEQ = 9223372036854775807ULL;
@@ -372,6 +372,7 @@ class TypeCommand : public Command {
       {RecordType::RT_HASH_META, "hash"},
       {RecordType::RT_SET_META, "set"},
       {RecordType::RT_ZSET_META, "zset"},
+      {RecordType::RT_STREAM_META, "stream"},
     };
 
     auto server = sess->getServerEntry();
@@ -0,0 +1,961 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tendisplus/commands/command.h"
+#include "tendisplus/storage/skiplist.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/string.h"
+
+namespace tendisplus {
+
+// geo.c of redis. The points are members of a zset, the score of a member
+// is the 52 bits geohash of its position, so a geohash box is a range of
+// scores in the skiplist.
+
+using redis_port::GeoHashBits;
+using redis_port::GeoHashFix52Bits;
+using redis_port::GeoHashRadius;
+using redis_port::GeoShape;
+
+Expected<bool> delGeneric(Session* sess, const std::string& key);
+Expected<std::string> genericZadd(Session* sess,
+                                  PStore kvstore,
+                                  const RecordKey& mk,
+                                  const Expected<RecordValue>& eMeta,
+                                  const std::map<std::string, double>& subKeys,
+                                  int flags);
+
+struct GeoPoint {
+  double longitude;
+  double latitude;
+  double dist;
+  double score;
+  std::string member;
+};
+
+Status extractLongLat(const std::string& lon,
+                      const std::string& lat,
+                      double* xy) {
+  auto x = tendisplus::stod(lon);
+  auto y = tendisplus::stod(lat);
+  if (!x.ok() || !y.ok()) {
+    return {ErrorCodes::ERR_PARSEOPT, "value is not a valid float"};
+  }
+  xy[0] = x.value();
+  xy[1] = y.value();
+  if (xy[0] < GEO_LONG_MIN || xy[0] > GEO_LONG_MAX || xy[1] < GEO_LAT_MIN ||
+      xy[1] > GEO_LAT_MAX) {
+    char buf[128];
+    snprintf(buf,
+             sizeof(buf),
+             "invalid longitude,latitude pair %f,%f",
+             xy[0],
+             xy[1]);
+    return {ErrorCodes::ERR_PARSEOPT, buf};
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// the meters of one unit
+Expected<double> extractUnit(const std::string& unit) {
+  auto u = toLower(unit);
+  if (u == "m") {
+    return 1.0;
+  } else if (u == "km") {
+    return 1000.0;
+  } else if (u == "ft") {
+    return 0.3048;
+  } else if (u == "mi") {
+    return 1609.34;
+  }
+  return {ErrorCodes::ERR_PARSEOPT,
+          "unsupported unit provided. please use M, KM, FT, MI"};
+}
+
+Expected<double> extractDistance(const std::string& s,
+                                 const std::string& errmsg) {
+  auto d = tendisplus::stod(s);
+  if (!d.ok()) {
+    return {ErrorCodes::ERR_PARSEOPT, "need numeric radius"};
+  }
+  if (d.value() < 0) {
+    return {ErrorCodes::ERR_PARSEOPT, errmsg};
+  }
+  return d;
+}
+
+bool decodeGeohash(double bits, double* xy) {
+  GeoHashBits hash = {static_cast<uint64_t>(bits), GEO_STEP_MAX};
+  return redis_port::geohashDecodeToLongLatWGS84(hash, xy);
+}
+
+// the distance(meters) to the center if the point of score is in shape
+bool geoWithinShape(const GeoShape& shape,
+                    double score,
+                    double* xy,
+                    double* distance) {
+  if (!decodeGeohash(score, xy)) {
+    return false;
+  }
+  if (shape.type == CIRCULAR_TYPE) {
+    return redis_port::geohashGetDistanceIfInRadiusWGS84(
+      shape.xy[0],
+      shape.xy[1],
+      xy[0],
+      xy[1],
+      shape.t.radius * shape.conversion,
+      distance);
+  }
+  return redis_port::geohashGetDistanceIfInRectangle(
+    shape.t.r.width * shape.conversion,
+    shape.t.r.height * shape.conversion,
+    shape.xy[0],
+    shape.xy[1],
+    xy[0],
+    xy[1],
+    distance);
+}
+
+std::string fmtGeoDistance(double d) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%.4f", d);
+  return buf;
+}
+
+Expected<double> getGeoMemberScore(PStore kvstore,
+                                   Transaction* txn,
+                                   const RecordKey& metaRk,
+                                   const std::string& member) {
+  RecordKey hk(metaRk.getChunkId(),
+               metaRk.getDbId(),
+               RecordType::RT_ZSET_H_ELE,
+               metaRk.getPrimaryKey(),
+               member);
+  Expected<RecordValue> eValue = kvstore->getKV(hk, txn);
+  if (!eValue.ok()) {
+    return eValue.status();
+  }
+  return tendisplus::doubleDecode(eValue.value().getValue());
+}
+
+// The points of the zset in shape. The center geohash box and its 8
+// neighbors cover the shape, each of them is a range of scores. The ranges
+// are sorted and the adjacent ones merged, so a small area close to the
+// boxes' borders takes less skiplist searches, and all of them are scanned
+// in txn. any > 0 stops at the first any points found.
+Expected<std::vector<GeoPoint>> geoMembersOfShape(SkipList* sl,
+                                                  Transaction* txn,
+                                                  GeoShape* shape,
+                                                  uint64_t any) {
+  GeoHashRadius n = redis_port::geohashCalculateAreasByShapeWGS84(shape);
+  GeoHashBits boxes[9] = {n.hash,
+                          n.neighbors.north,
+                          n.neighbors.south,
+                          n.neighbors.east,
+                          n.neighbors.west,
+                          n.neighbors.north_east,
+                          n.neighbors.north_west,
+                          n.neighbors.south_east,
+                          n.neighbors.south_west};
+  std::vector<std::pair<GeoHashFix52Bits, GeoHashFix52Bits>> ranges;
+  for (auto box : boxes) {
+    if (HASHISZERO(box)) {
+      continue;
+    }
+    GeoHashFix52Bits min = redis_port::geohashAlign52Bits(box);
+    box.bits++;
+    GeoHashFix52Bits max = redis_port::geohashAlign52Bits(box);
+    ranges.emplace_back(min, max);
+  }
+  std::sort(ranges.begin(), ranges.end());
+  std::vector<std::pair<GeoHashFix52Bits, GeoHashFix52Bits>> merged;
+  for (const auto& r : ranges) {
+    if (!merged.empty() && r.first <= merged.back().second) {
+      merged.back().second = std::max(merged.back().second, r.second);
+    } else {
+      merged.push_back(r);
+    }
+  }
+
+  std::vector<GeoPoint> points;
+  for (const auto& r : merged) {
+    // [min, max)
+    redis_port::Zrangespec spec = {static_cast<double>(r.first),
+                                   static_cast<double>(r.second),
+                                   0,
+                                   1};
+    auto arr = sl->scanByScore(spec, 0, UINT64_MAX, false, txn);
+    if (!arr.ok()) {
+      return arr.status();
+    }
+    double xy[2];
+    double distance = 0;
+    for (auto& v : arr.value()) {
+      if (!geoWithinShape(*shape, v.first, xy, &distance)) {
+        continue;
+      }
+      points.push_back(GeoPoint{xy[0],
+                                xy[1],
+                                distance / shape->conversion,
+                                v.first,
+                                std::move(v.second)});
+      if (any && points.size() >= any) {
+        return points;
+      }
+    }
+  }
+  return points;
+}
+
+// GEOADD key [NX|XX] [CH] longitude latitude member
+//   [longitude latitude member ...]
+class GeoAddCommand : public Command {
+ public:
+  GeoAddCommand() : Command("geoadd", "wm") {}
+
+  ssize_t arity() const {
+    return -5;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return 1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    const std::string& key = args[1];
+
+    int flag = ZADD_NONE;
+    size_t i = 2;
+    for (; i < args.size(); i++) {
+      auto opt = toLower(args[i]);
+      if (opt == "nx") {
+        flag |= ZADD_NX;
+      } else if (opt == "xx") {
+        flag |= ZADD_XX;
+      } else if (opt == "ch") {
+        flag |= ZADD_CH;
+      } else {
+        break;
+      }
+    }
+    if ((args.size() - i) % 3 != 0 || args.size() == i) {
+      return {ErrorCodes::ERR_PARSEOPT, ""};
+    }
+
+    std::map<std::string, double> scoreMap;
+    for (; i < args.size(); i += 3) {
+      double xy[2];
+      auto s = extractLongLat(args[i], args[i + 1], xy);
+      if (!s.ok()) {
+        return s;
+      }
+      GeoHashBits hash;
+      redis_port::geohashEncodeWGS84(xy[0], xy[1], GEO_STEP_MAX, &hash);
+      scoreMap[args[i + 2]] =
+        static_cast<double>(redis_port::geohashAlign52Bits(hash));
+    }
+
+    auto server = sess->getServerEntry();
+    auto expdb = server->getSegmentMgr()->getDbWithKeyLock(
+      sess, key, mgl::LockMode::LOCK_X);
+    if (!expdb.ok()) {
+      return expdb.status();
+    }
+
+    Expected<RecordValue> rv =
+      Command::expireKeyIfNeeded(sess, key, RecordType::RT_ZSET_META);
+    if (rv.status().code() != ErrorCodes::ERR_OK &&
+        rv.status().code() != ErrorCodes::ERR_EXPIRED &&
+        rv.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return rv.status();
+    }
+
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+    RecordKey metaRk(expdb.value().chunkId,
+                     pCtx->getDbId(),
+                     RecordType::RT_ZSET_META,
+                     key,
+                     "");
+    PStore kvstore = expdb.value().store;
+    for (int32_t i = 0; i < RETRY_CNT; ++i) {
+      Expected<std::string> s =
+        genericZadd(sess, kvstore, metaRk, rv, scoreMap, flag);
+      if (s.ok()) {
+        return s.value();
+      }
+      if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
+        return s.status();
+      }
+      if (i == RETRY_CNT - 1) {
+        return s.status();
+      } else {
+        continue;
+      }
+    }
+
+    INVARIANT_D(0);
+    return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+  }
+} geoaddCmd;
+
+// the read only commands on the members of a zset
+class GeoMembersGenericCommand : public Command {
+ public:
+  GeoMembersGenericCommand(const std::string& name, const char* sflags)
+    : Command(name, sflags) {}
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return 1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    const std::string& key = args[1];
+
+    auto server = sess->getServerEntry();
+    auto expdb =
+      server->getSegmentMgr()->getDbWithKeyLock(sess, key, Command::RdLock());
+    if (!expdb.ok()) {
+      return expdb.status();
+    }
+
+    Expected<RecordValue> rv =
+      Command::expireKeyIfNeeded(sess, key, RecordType::RT_ZSET_META);
+    if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
+        rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return reply(nullptr, nullptr, RecordKey(), args);
+    } else if (!rv.ok()) {
+      return rv.status();
+    }
+
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+    RecordKey metaRk(expdb.value().chunkId,
+                     pCtx->getDbId(),
+                     RecordType::RT_ZSET_META,
+                     key,
+                     "");
+    PStore kvstore = expdb.value().store;
+    auto ptxn = kvstore->createTransaction(sess);
+    if (!ptxn.ok()) {
+      return ptxn.status();
+    }
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    return reply(kvstore, txn.get(), metaRk, args);
+  }
+
+ protected:
+  // the score of member, ERR_NOTFOUND if no such member or key
+  Expected<double> getScore(PStore kvstore,
+                            Transaction* txn,
+                            const RecordKey& metaRk,
+                            const std::string& member) {
+    if (!txn) {
+      return {ErrorCodes::ERR_NOTFOUND, ""};
+    }
+    return getGeoMemberScore(kvstore, txn, metaRk, member);
+  }
+
+  // txn is nullptr if the key doesn't exist
+  virtual Expected<std::string> reply(PStore kvstore,
+                                      Transaction* txn,
+                                      const RecordKey& metaRk,
+                                      const std::vector<std::string>& args) = 0;
+};
+
+// GEOHASH key [member ...]
+class GeoHashCommand : public GeoMembersGenericCommand {
+ public:
+  GeoHashCommand() : GeoMembersGenericCommand("geohash", "r") {}
+
+  ssize_t arity() const {
+    return -2;
+  }
+
+  Expected<std::string> reply(PStore kvstore,
+                              Transaction* txn,
+                              const RecordKey& metaRk,
+                              const std::vector<std::string>& args) final {
+    static const char* geoalphabet = "0123456789bcdefghjkmnpqrstuvwxyz";
+    std::stringstream ss;
+    Command::fmtMultiBulkLen(ss, args.size() - 2);
+    for (size_t j = 2; j < args.size(); j++) {
+      auto score = getScore(kvstore, txn, metaRk, args[j]);
+      if (score.status().code() == ErrorCodes::ERR_NOTFOUND) {
+        Command::fmtNull(ss);
+        continue;
+      } else if (!score.ok()) {
+        return score.status();
+      }
+      double xy[2];
+      if (!decodeGeohash(score.value(), xy)) {
+        Command::fmtNull(ss);
+        continue;
+      }
+      // the standard geohash is on [-90, 90] of latitude, not the one
+      // of the scores
+      redis_port::GeoHashRange r[2];
+      r[0].min = -180;
+      r[0].max = 180;
+      r[1].min = -90;
+      r[1].max = 90;
+      GeoHashBits hash;
+      redis_port::geohashEncode(&r[0], &r[1], xy[0], xy[1], 26, &hash);
+
+      char buf[12];
+      for (int i = 0; i < 11; i++) {
+        int idx;
+        if (i == 10) {
+          // 52 bits only, the 11th char is always 0 like redis
+          idx = 0;
+        } else {
+          idx = (hash.bits >> (52 - ((i + 1) * 5))) & 0x1f;
+        }
+        buf[i] = geoalphabet[idx];
+      }
+      buf[11] = '\0';
+      Command::fmtBulk(ss, buf);
+    }
+    return ss.str();
+  }
+} geohashCmd;
+
+// GEOPOS key [member ...]
+class GeoPosCommand : public GeoMembersGenericCommand {
+ public:
+  GeoPosCommand() : GeoMembersGenericCommand("geopos", "r") {}
+
+  ssize_t arity() const {
+    return -2;
+  }
+
+  Expected<std::string> reply(PStore kvstore,
+                              Transaction* txn,
+                              const RecordKey& metaRk,
+                              const std::vector<std::string>& args) final {
+    std::stringstream ss;
+    Command::fmtMultiBulkLen(ss, args.size() - 2);
+    for (size_t j = 2; j < args.size(); j++) {
+      auto score = getScore(kvstore, txn, metaRk, args[j]);
+      if (score.status().code() == ErrorCodes::ERR_NOTFOUND) {
+        ss << Command::fmtNullArray();
+        continue;
+      } else if (!score.ok()) {
+        return score.status();
+      }
+      double xy[2];
+      if (!decodeGeohash(score.value(), xy)) {
+        ss << Command::fmtNullArray();
+        continue;
+      }
+      Command::fmtMultiBulkLen(ss, 2);
+      Command::fmtBulk(ss, tendisplus::ldtos(xy[0], true));
+      Command::fmtBulk(ss, tendisplus::ldtos(xy[1], true));
+    }
+    return ss.str();
+  }
+} geoposCmd;
+
+// GEODIST key member1 member2 [m|km|ft|mi]
+class GeoDistCommand : public GeoMembersGenericCommand {
+ public:
+  GeoDistCommand() : GeoMembersGenericCommand("geodist", "r") {}
+
+  ssize_t arity() const {
+    return -4;
+  }
+
+  Expected<std::string> reply(PStore kvstore,
+                              Transaction* txn,
+                              const RecordKey& metaRk,
+                              const std::vector<std::string>& args) final {
+    double toMeters = 1;
+    if (args.size() == 5) {
+      auto unit = extractUnit(args[4]);
+      if (!unit.ok()) {
+        return unit.status();
+      }
+      toMeters = unit.value();
+    } else if (args.size() > 5) {
+      return {ErrorCodes::ERR_PARSEOPT, ""};
+    }
+
+    double xyxy[4];
+    for (size_t j = 0; j < 2; j++) {
+      auto score = getScore(kvstore, txn, metaRk, args[j + 2]);
+      if (score.status().code() == ErrorCodes::ERR_NOTFOUND) {
+        return Command::fmtNull();
+      } else if (!score.ok()) {
+        return score.status();
+      }
+      if (!decodeGeohash(score.value(), xyxy + j * 2)) {
+        return Command::fmtNull();
+      }
+    }
+    double distance =
+      redis_port::geohashGetDistance(xyxy[0], xyxy[1], xyxy[2], xyxy[3]);
+    return Command::fmtBulk(fmtGeoDistance(distance / toMeters));
+  }
+} geodistCmd;
+
+enum class GeoSearchType {
+  RADIUS_COORDS,  // GEORADIUS
+  RADIUS_MEMBER,  // GEORADIUSBYMEMBER
+  SEARCH,         // GEOSEARCH
+  SEARCH_STORE,   // GEOSEARCHSTORE
+};
+
+// GEORADIUS key longitude latitude radius m|km|ft|mi [WITHCOORD]
+//   [WITHDIST] [WITHHASH] [COUNT count [ANY]] [ASC|DESC]
+//   [STORE key] [STOREDIST key]
+// GEORADIUSBYMEMBER key member radius m|km|ft|mi ...
+// GEOSEARCH key FROMMEMBER member|FROMLONLAT longitude latitude
+//   BYRADIUS radius m|km|ft|mi|BYBOX width height m|km|ft|mi
+//   [ASC|DESC] [COUNT count [ANY]] [WITHCOORD] [WITHDIST] [WITHHASH]
+// GEOSEARCHSTORE destination source ... [STOREDIST]
+// The _RO variants of GEORADIUS have no STORE.
+class GeoSearchGenericCommand : public Command {
+ public:
+  GeoSearchGenericCommand(const std::string& name,
+                          const char* sflags,
+                          GeoSearchType type,
+                          ssize_t arity,
+                          bool readOnly)
+    : Command(name, sflags),
+      _type(type),
+      _arity(arity),
+      _readOnly(readOnly) {}
+
+  ssize_t arity() const {
+    return _arity;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return _type == GeoSearchType::SEARCH_STORE ? 2 : 1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  std::vector<int> getKeysFromCommand(
+    const std::vector<std::string>& argv) final {
+    if (_type == GeoSearchType::SEARCH_STORE) {
+      return {1, 2};
+    }
+    std::vector<int> keyindex = {1};
+    if (_type == GeoSearchType::SEARCH || _readOnly) {
+      return keyindex;
+    }
+    // the last STORE/STOREDIST of GEORADIUS
+    int storeKey = 0;
+    for (size_t i = baseArgs(); i + 1 < argv.size(); i++) {
+      auto opt = toLower(argv[i]);
+      if (opt == "store" || opt == "storedist") {
+        storeKey = i + 1;
+        i++;
+      }
+    }
+    if (storeKey) {
+      keyindex.push_back(storeKey);
+    }
+    return keyindex;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+
+    size_t srcIdx = _type == GeoSearchType::SEARCH_STORE ? 2 : 1;
+    const std::string& key = args[srcIdx];
+    SearchArgs sa;
+    GeoShape& shape = sa.shape;
+    memset(&shape, 0, sizeof(shape));
+    auto s = parseArgs(args, &sa);
+    if (!s.ok()) {
+      return s;
+    }
+
+    auto server = sess->getServerEntry();
+    auto index = getKeysFromCommand(args);
+    auto locklist = server->getSegmentMgr()->getAllKeysLocked(
+      sess,
+      args,
+      index,
+      sa.storeKey.empty() ? Command::RdLock() : mgl::LockMode::LOCK_X);
+    if (!locklist.ok()) {
+      return locklist.status();
+    }
+
+    std::vector<GeoPoint> points;
+    Expected<RecordValue> rv =
+      Command::expireKeyIfNeeded(sess, key, RecordType::RT_ZSET_META);
+    if (rv.ok()) {
+      auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, key);
+      if (!expdb.ok()) {
+        return expdb.status();
+      }
+      RecordKey metaRk(expdb.value().chunkId,
+                       pCtx->getDbId(),
+                       RecordType::RT_ZSET_META,
+                       key,
+                       "");
+      PStore kvstore = expdb.value().store;
+      auto ptxn = kvstore->createTransaction(sess);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+
+      if (!sa.fromMember.empty()) {
+        auto score = getGeoMemberScore(kvstore, txn.get(), metaRk,
+                                       sa.fromMember);
+        if (!score.ok() || !decodeGeohash(score.value(), shape.xy)) {
+          if (!score.ok() &&
+              score.status().code() != ErrorCodes::ERR_NOTFOUND) {
+            return score.status();
+          }
+          return {ErrorCodes::ERR_PARSEOPT,
+                  "could not decode requested zset member"};
+        }
+      }
+
+      auto eMeta = ZSlMetaValue::decode(rv.value().getValue());
+      if (!eMeta.ok()) {
+        return eMeta.status();
+      }
+      SkipList sl(
+        expdb.value().chunkId, pCtx->getDbId(), key, eMeta.value(), kvstore);
+      auto found =
+        geoMembersOfShape(&sl, txn.get(), &shape, sa.any ? sa.count : 0);
+      if (!found.ok()) {
+        return found.status();
+      }
+      points = std::move(found.value());
+    } else if (rv.status().code() != ErrorCodes::ERR_EXPIRED &&
+               rv.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return rv.status();
+    }
+
+    // COUNT without ANY takes the nearest ones
+    if (sa.sort == 0 && sa.count && !sa.any) {
+      sa.sort = 1;
+    }
+    if (sa.sort) {
+      bool asc = sa.sort > 0;
+      std::sort(points.begin(),
+                points.end(),
+                [asc](const GeoPoint& a, const GeoPoint& b) {
+                  return asc ? a.dist < b.dist : a.dist > b.dist;
+                });
+    }
+    if (sa.count && points.size() > sa.count) {
+      points.resize(sa.count);
+    }
+
+    if (!sa.storeKey.empty()) {
+      return storePoints(sess, sa, points);
+    }
+
+    size_t optionLength = sa.withDist + sa.withHash + sa.withCoords;
+    std::stringstream ss;
+    Command::fmtMultiBulkLen(ss, points.size());
+    for (const auto& gp : points) {
+      if (optionLength) {
+        Command::fmtMultiBulkLen(ss, optionLength + 1);
+      }
+      Command::fmtBulk(ss, gp.member);
+      if (sa.withDist) {
+        Command::fmtBulk(ss, fmtGeoDistance(gp.dist));
+      }
+      if (sa.withHash) {
+        Command::fmtLongLong(ss, static_cast<int64_t>(gp.score));
+      }
+      if (sa.withCoords) {
+        Command::fmtMultiBulkLen(ss, 2);
+        Command::fmtBulk(ss, tendisplus::ldtos(gp.longitude, true));
+        Command::fmtBulk(ss, tendisplus::ldtos(gp.latitude, true));
+      }
+    }
+    return ss.str();
+  }
+
+ private:
+  struct SearchArgs {
+    GeoShape shape;
+    std::string fromMember;
+    bool withDist = false;
+    bool withHash = false;
+    bool withCoords = false;
+    // 1 for ASC, -1 for DESC
+    int sort = 0;
+    uint64_t count = 0;
+    bool any = false;
+    std::string storeKey;
+    bool storeDist = false;
+  };
+
+  size_t baseArgs() const {
+    switch (_type) {
+      case GeoSearchType::RADIUS_COORDS:
+        return 6;
+      case GeoSearchType::RADIUS_MEMBER:
+        return 5;
+      case GeoSearchType::SEARCH:
+        return 2;
+      case GeoSearchType::SEARCH_STORE:
+        return 3;
+    }
+    return 2;
+  }
+
+  Status parseArgs(const std::vector<std::string>& args, SearchArgs* sa) {
+    GeoShape& shape = sa->shape;
+    bool byRadius = false, byBox = false, fromLonLat = false;
+    if (_type == GeoSearchType::RADIUS_COORDS ||
+        _type == GeoSearchType::RADIUS_MEMBER) {
+      size_t i = 2;
+      if (_type == GeoSearchType::RADIUS_COORDS) {
+        auto s = extractLongLat(args[2], args[3], shape.xy);
+        if (!s.ok()) {
+          return s;
+        }
+        i = 4;
+      } else {
+        sa->fromMember = args[2];
+        i = 3;
+      }
+      auto radius = extractDistance(args[i], "radius cannot be negative");
+      if (!radius.ok()) {
+        return radius.status();
+      }
+      auto unit = extractUnit(args[i + 1]);
+      if (!unit.ok()) {
+        return unit.status();
+      }
+      shape.type = CIRCULAR_TYPE;
+      shape.t.radius = radius.value();
+      shape.conversion = unit.value();
+      byRadius = true;
+    }
+
+    bool isSearch = _type == GeoSearchType::SEARCH ||
+      _type == GeoSearchType::SEARCH_STORE;
+    for (size_t i = baseArgs(); i < args.size(); i++) {
+      auto opt = toLower(args[i]);
+      size_t remaining = args.size() - i - 1;
+      if (opt == "withdist" && _type != GeoSearchType::SEARCH_STORE) {
+        sa->withDist = true;
+      } else if (opt == "withhash" && _type != GeoSearchType::SEARCH_STORE) {
+        sa->withHash = true;
+      } else if (opt == "withcoord" && _type != GeoSearchType::SEARCH_STORE) {
+        sa->withCoords = true;
+      } else if (opt == "any") {
+        sa->any = true;
+      } else if (opt == "asc") {
+        sa->sort = 1;
+      } else if (opt == "desc") {
+        sa->sort = -1;
+      } else if (opt == "count" && remaining >= 1) {
+        auto count = tendisplus::stoll(args[++i]);
+        if (!count.ok()) {
+          return count.status();
+        }
+        if (count.value() <= 0) {
+          return {ErrorCodes::ERR_PARSEOPT, "COUNT must be > 0"};
+        }
+        sa->count = count.value();
+      } else if ((opt == "store" || opt == "storedist") && remaining >= 1 &&
+                 !isSearch && !_readOnly) {
+        sa->storeKey = args[++i];
+        sa->storeDist = opt == "storedist";
+      } else if (opt == "storedist" &&
+                 _type == GeoSearchType::SEARCH_STORE) {
+        sa->storeDist = true;
+      } else if (opt == "frommember" && remaining >= 1 && isSearch &&
+                 !fromLonLat && sa->fromMember.empty()) {
+        sa->fromMember = args[++i];
+      } else if (opt == "fromlonlat" && remaining >= 2 && isSearch &&
+                 !fromLonLat && sa->fromMember.empty()) {
+        auto s = extractLongLat(args[i + 1], args[i + 2], shape.xy);
+        if (!s.ok()) {
+          return s;
+        }
+        fromLonLat = true;
+        i += 2;
+      } else if (opt == "byradius" && remaining >= 2 && isSearch &&
+                 !byRadius && !byBox) {
+        auto radius =
+          extractDistance(args[i + 1], "radius cannot be negative");
+        if (!radius.ok()) {
+          return radius.status();
+        }
+        auto unit = extractUnit(args[i + 2]);
+        if (!unit.ok()) {
+          return unit.status();
+        }
+        shape.type = CIRCULAR_TYPE;
+        shape.t.radius = radius.value();
+        shape.conversion = unit.value();
+        byRadius = true;
+        i += 2;
+      } else if (opt == "bybox" && remaining >= 3 && isSearch && !byRadius &&
+                 !byBox) {
+        auto width =
+          extractDistance(args[i + 1], "height or width cannot be negative");
+        if (!width.ok()) {
+          return width.status();
+        }
+        auto height =
+          extractDistance(args[i + 2], "height or width cannot be negative");
+        if (!height.ok()) {
+          return height.status();
+        }
+        auto unit = extractUnit(args[i + 3]);
+        if (!unit.ok()) {
+          return unit.status();
+        }
+        shape.type = RECTANGLE_TYPE;
+        shape.t.r.width = width.value();
+        shape.t.r.height = height.value();
+        shape.conversion = unit.value();
+        byBox = true;
+        i += 3;
+      } else {
+        return {ErrorCodes::ERR_PARSEOPT, ""};
+      }
+    }
+
+    if (isSearch) {
+      if (sa->fromMember.empty() == !fromLonLat) {
+        return {ErrorCodes::ERR_PARSEOPT,
+                "exactly one of FROMMEMBER or FROMLONLAT can be specified "
+                "for " +
+                  getName()};
+      }
+      if (byRadius == byBox) {
+        return {ErrorCodes::ERR_PARSEOPT,
+                "exactly one of BYRADIUS and BYBOX can be specified for " +
+                  getName()};
+      }
+    }
+    if (sa->any && !sa->count) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "the ANY argument requires COUNT argument"};
+    }
+    if (_type == GeoSearchType::SEARCH_STORE) {
+      sa->storeKey = args[1];
+    }
+    if (!sa->storeKey.empty() &&
+        (sa->withDist || sa->withHash || sa->withCoords)) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "STORE option in GEORADIUS is not compatible with WITHDIST, "
+              "WITHHASH and WITHCOORDS options"};
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  // the points are stored into a new zset, with the geohash or the
+  // distance as the score
+  Expected<std::string> storePoints(Session* sess,
+                                    const SearchArgs& sa,
+                                    const std::vector<GeoPoint>& points) {
+    const std::string& storeKey = sa.storeKey;
+    Expected<bool> deleted = delGeneric(sess, storeKey);
+    if (!deleted.ok()) {
+      return deleted.status();
+    }
+    if (points.empty()) {
+      return Command::fmtZero();
+    }
+
+    std::map<std::string, double> scoreMap;
+    for (const auto& gp : points) {
+      scoreMap[gp.member] = sa.storeDist ? gp.dist : gp.score;
+    }
+    SessionCtx* pCtx = sess->getCtx();
+    auto expdb =
+      sess->getServerEntry()->getSegmentMgr()->getDbHasLocked(sess, storeKey);
+    if (!expdb.ok()) {
+      return expdb.status();
+    }
+    PStore kvstore = expdb.value().store;
+    RecordKey storeRk(expdb.value().chunkId,
+                      pCtx->getDbId(),
+                      RecordType::RT_ZSET_META,
+                      storeKey,
+                      "");
+    for (int32_t i = 0; i < RETRY_CNT; ++i) {
+      Expected<std::string> s =
+        genericZadd(sess,
+                    kvstore,
+                    storeRk,
+                    {ErrorCodes::ERR_NOTFOUND, ""},
+                    scoreMap,
+                    ZADD_NONE);
+      if (s.ok()) {
+        return Command::fmtLongLong(points.size());
+      }
+      if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY ||
+          i == RETRY_CNT - 1) {
+        return s.status();
+      }
+    }
+
+    INVARIANT_D(0);
+    return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+  }
+
+  GeoSearchType _type;
+  ssize_t _arity;
+  bool _readOnly;
+};
+
+GeoSearchGenericCommand georadiusCmd(
+  "georadius", "w", GeoSearchType::RADIUS_COORDS, -6, false);
+GeoSearchGenericCommand georadiusroCmd(
+  "georadius_ro", "r", GeoSearchType::RADIUS_COORDS, -6, true);
+GeoSearchGenericCommand georadiusbymemberCmd(
+  "georadiusbymember", "w", GeoSearchType::RADIUS_MEMBER, -5, false);
+GeoSearchGenericCommand georadiusbymemberroCmd(
+  "georadiusbymember_ro", "r", GeoSearchType::RADIUS_MEMBER, -5, true);
+GeoSearchGenericCommand geosearchCmd(
+  "geosearch", "r", GeoSearchType::SEARCH, -7, true);
+GeoSearchGenericCommand geosearchstoreCmd(
+  "geosearchstore", "wm", GeoSearchType::SEARCH_STORE, -8, false);
+
+}  // namespace tendisplus
@@ -16,6 +16,7 @@
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/redis_port.h"
 #include "tendisplus/commands/command.h"
+#include "tendisplus/storage/counter_cache.h"
 
 namespace tendisplus {
 
@@ -115,20 +116,33 @@ Expected<std::string> hincrGeneric(Session* sess,
     hashMeta = std::move(exptHashMeta.value());
   }  // no else, else not found , so subkeyCount = 0, ttl = 0
 
-  auto getSubkeyExpt = kvstore->getKV(subRk, txn.get());
+  // the field is added by a merge operand, and is not read if cached,
+  // the cached field always exists since its deletion drops it. In EVAL
+  // or EXEC the transaction is committed later or rolled back, which the
+  // cache can't follow, so the field is written as before there.
+  auto counters = sess->getCtx()->getNestedTxn(kvstore->dbId())
+    ? nullptr
+    : kvstore->getCounterCache();
   int64_t nowVal = 0;
-  if (getSubkeyExpt.ok()) {
-    Expected<int64_t> val =
-      ::tendisplus::stoll(getSubkeyExpt.value().getValue());
-    if (!val.ok()) {
-      return {ErrorCodes::ERR_DECODE, "hash value is not an integer "};
+  bool newField = false;
+  bool cached =
+    counters && eValue.ok() && counters->get(subRk.encode(), &nowVal);
+  if (!cached) {
+    auto getSubkeyExpt = kvstore->getKV(subRk, txn.get());
+    if (getSubkeyExpt.ok()) {
+      Expected<int64_t> val =
+        ::tendisplus::stoll(getSubkeyExpt.value().getValue());
+      if (!val.ok()) {
+        return {ErrorCodes::ERR_DECODE, "hash value is not an integer "};
+      }
+      nowVal = val.value();
+    } else if (getSubkeyExpt.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      nowVal = 0;
+      newField = true;
+      hashMeta.setCount(hashMeta.getCount() + 1);
+    } else {
+      return getSubkeyExpt.status();
     }
-    nowVal = val.value();
-  } else if (getSubkeyExpt.status().code() == ErrorCodes::ERR_NOTFOUND) {
-    nowVal = 0;
-    hashMeta.setCount(hashMeta.getCount() + 1);
-  } else {
-    return getSubkeyExpt.status();
   }
 
   if ((inc < 0 && nowVal < 0 && inc < (LLONG_MIN - nowVal)) ||
@@ -137,25 +151,36 @@ Expected<std::string> hincrGeneric(Session* sess,
   }
   nowVal += inc;
   RecordValue newVal(std::to_string(nowVal), RecordType::RT_HASH_ELE, -1);
-  RecordValue metaValue(hashMeta.encode(),
-                        RecordType::RT_HASH_META,
-                        sess->getCtx()->getVersionEP(),
-                        ttl,
-                        eValue);
-  Status setStatus = kvstore->setKV(metaRk, metaValue, txn.get());
-  if (!setStatus.ok()) {
-    return setStatus;
+  Status setStatus = {ErrorCodes::ERR_OK, ""};
+  // a merged field leaves the meta as it is, unless it adds the field
+  if (!counters || newField) {
+    RecordValue metaValue(hashMeta.encode(),
+                          RecordType::RT_HASH_META,
+                          sess->getCtx()->getVersionEP(),
+                          ttl,
+                          eValue);
+    setStatus = kvstore->setKV(metaRk, metaValue, txn.get());
+    if (!setStatus.ok()) {
+      return setStatus;
+    }
+  }
+  if (counters) {
+    RecordValue operand(std::to_string(inc), RecordType::RT_HASH_ELE, -1);
+    setStatus = kvstore->mergeKV(subRk, operand, txn.get());
+  } else {
+    setStatus = kvstore->setKV(subRk, newVal, txn.get());
   }
-  setStatus = kvstore->setKV(subRk, newVal, txn.get());
   if (!setStatus.ok()) {
     return setStatus;
   }
   Expected<uint64_t> exptCommit = txn->commit();
   if (!exptCommit.ok()) {
     return exptCommit.status();
-  } else {
-    return Command::fmtLongLong(nowVal);
   }
+  if (counters) {
+    counters->put(subRk.encode(), nowVal);
+  }
+  return Command::fmtLongLong(nowVal);
 }
 
 class HLenCommand : public Command {
@@ -292,7 +317,8 @@ class HAllCommand : public Command {
     return 1;
   }
 
-  Expected<std::list<Record>> getRecords(Session* sess) {
+  // the fields and/or the values of the hash
+  Expected<std::string> fmtFields(Session* sess, bool field, bool value) {
     const std::vector<std::string>& args = sess->getArgs();
     const std::string& key = args[1];
 
@@ -309,9 +335,9 @@ class HAllCommand : public Command {
     Expected<RecordValue> rv =
       Command::expireKeyIfNeeded(sess, key, RecordType::RT_HASH_META);
     if (rv.status().code() == ErrorCodes::ERR_EXPIRED) {
-      return std::list<Record>();
+      return Command::fmtZeroBulkLen();
     } else if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-      return std::list<Record>();
+      return Command::fmtZeroBulkLen();
     } else if (!rv.status().ok()) {
       return rv.status();
     }
@@ -334,27 +360,38 @@ class HAllCommand : public Command {
                       RecordType::RT_HASH_ELE,
                       metaRk.getPrimaryKey(),
                       "");
-    std::string prefix = fakeEle.prefixPk();
-    auto cursor = txn->createDataCursor();
-    cursor->seek(prefix);
+    auto cursor = txn->createPrefixCursor(fakeEle.prefixPk());
 
-    std::list<Record> result;
+    std::stringstream body;
+    uint64_t cnt = 0;
+    RecordKeyView rk;
+    RecordValueView rvv;
     while (true) {
-      Expected<Record> exptRcd = cursor->next();
-      if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+      auto s = cursor->next(&rk, &rvv);
+      if (s.code() == ErrorCodes::ERR_EXHAUST) {
         break;
       }
-      if (!exptRcd.ok()) {
-        return exptRcd.status();
+      if (!s.ok()) {
+        return s;
       }
-      Record& rcd = exptRcd.value();
-      const RecordKey& rcdKey = rcd.getRecordKey();
-      if (rcdKey.prefixPk() != prefix) {
-        break;
+      if (field) {
+        auto sk = rk.getSecondaryKey();
+        Command::fmtBulk(body, sk.data(), sk.size());
+        cnt++;
+      }
+      if (value) {
+        auto v = rvv.getValue();
+        if (!v.ok()) {
+          return v.status();
+        }
+        Command::fmtBulk(body, v.value().data(), v.value().size());
+        cnt++;
       }
-      result.emplace_back(std::move(rcd));
     }
-    return std::move(result);
+    std::stringstream ss;
+    Command::fmtMultiBulkLen(ss, cnt);
+    ss << body.rdbuf();
+    return ss.str();
   }
 };
 
@@ -363,17 +400,7 @@ class HGetAllCommand : public HAllCommand {
   HGetAllCommand() : HAllCommand("hgetall", "r") {}
 
   Expected<std::string> run(Session* sess) final {
-    Expected<std::list<Record>> rcds = getRecords(sess);
-    if (!rcds.ok()) {
-      return rcds.status();
-    }
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, rcds.value().size() * 2);
-    for (const auto& v : rcds.value()) {
-      Command::fmtBulk(ss, v.getRecordKey().getSecondaryKey());
-      Command::fmtBulk(ss, v.getRecordValue().getValue());
-    }
-    return ss.str();
+    return fmtFields(sess, true, true);
   }
 } hgetAllCmd;
 
@@ -382,16 +409,7 @@ class HKeysCommand : public HAllCommand {
   HKeysCommand() : HAllCommand("hkeys", "rS") {}
 
   Expected<std::string> run(Session* sess) final {
-    Expected<std::list<Record>> rcds = getRecords(sess);
-    if (!rcds.ok()) {
-      return rcds.status();
-    }
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, rcds.value().size());
-    for (const auto& v : rcds.value()) {
-      Command::fmtBulk(ss, v.getRecordKey().getSecondaryKey());
-    }
-    return ss.str();
+    return fmtFields(sess, true, false);
   }
 } hkeysCmd;
 
@@ -400,16 +418,7 @@ class HValsCommand : public HAllCommand {
   HValsCommand() : HAllCommand("hvals", "rS") {}
 
   Expected<std::string> run(Session* sess) final {
-    Expected<std::list<Record>> rcds = getRecords(sess);
-    if (!rcds.ok()) {
-      return rcds.status();
-    }
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, rcds.value().size());
-    for (const auto& v : rcds.value()) {
-      Command::fmtBulk(ss, v.getRecordValue().getValue());
-    }
-    return ss.str();
+    return fmtFields(sess, false, true);
   }
 } hvalsCmd;
 
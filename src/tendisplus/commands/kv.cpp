@@ -17,6 +17,7 @@
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/redis_port.h"
 #include "tendisplus/commands/command.h"
+#include "tendisplus/storage/counter_cache.h"
 #include "tendisplus/utils/scopeguard.h"
 
 namespace tendisplus {
@@ -927,6 +928,49 @@ class GetSetGeneral : public Command {
   virtual Expected<RecordValue> newValueFromOld(
     Session* sess, const Expected<RecordValue>& oldValue) const = 0;
 
+  // the delta added to an integer without a ttl, if the command can be
+  // written as a merge operand, see KVIncrMergeOperator
+  virtual Expected<int64_t> mergeDelta(Session* sess) const {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+
+  Expected<RecordValue> mergeGeneral(Session* sess,
+                                     PStore kvstore,
+                                     const RecordKey& rk,
+                                     int64_t sum,
+                                     int64_t delta) {
+    if ((delta < 0 && sum < 0 && delta < (LLONG_MIN - sum)) ||
+        (delta > 0 && sum > 0 && delta > (LLONG_MAX - sum))) {
+      return {ErrorCodes::ERR_OVERFLOW,
+              "increment or decrement would overflow"};
+    }
+    sum += delta;
+
+    auto ptxn = kvstore->createTransaction(sess);
+    if (!ptxn.ok()) {
+      return ptxn.status();
+    }
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    RecordValue operand(std::to_string(delta),
+                        RecordType::RT_KV,
+                        sess->getCtx()->getVersionEP(),
+                        0);
+    auto s = kvstore->mergeKV(rk, operand, txn.get());
+    if (!s.ok()) {
+      return s;
+    }
+    // a blind write never conflicts, no retry is needed
+    auto eCommit = txn->commit();
+    if (!eCommit.ok()) {
+      return eCommit.status();
+    }
+    kvstore->getCounterCache()->put(rk.encode(), sum);
+    return RecordValue(std::to_string(sum),
+                       RecordType::RT_KV,
+                       sess->getCtx()->getVersionEP(),
+                       0);
+  }
+
   Expected<RecordValue> runGeneral(Session* sess) {
     const std::string& key = sess->getArgs()[firstkey()];
     SessionCtx* pCtx = sess->getCtx();
@@ -940,6 +984,23 @@ class GetSetGeneral : public Command {
       return expdb.status();
     }
 
+    PStore kvstore = expdb.value().store;
+    RecordKey rk(
+      expdb.value().chunkId, pCtx->getDbId(), RecordType::RT_KV, key, "");
+
+    // a cached counter is summed without reading the key, it has no ttl.
+    // In EVAL or EXEC the transaction is committed later or rolled back,
+    // which the cache can't follow, so the key is written as before there.
+    auto counters = kvstore->getCounterCache();
+    Expected<int64_t> delta = {ErrorCodes::ERR_NOTFOUND, ""};
+    if (counters && !pCtx->getNestedTxn(kvstore->dbId())) {
+      delta = mergeDelta(sess);
+      int64_t sum = 0;
+      if (delta.ok() && counters->get(rk.encode(), &sum)) {
+        return mergeGeneral(sess, kvstore, rk, sum, delta.value());
+      }
+    }
+
     // expire if possible
     Expected<RecordValue> rv =
       Command::expireKeyIfNeeded(sess, key, RecordType::RT_KV);
@@ -949,9 +1010,19 @@ class GetSetGeneral : public Command {
       return rv.status();
     }
 
-    PStore kvstore = expdb.value().store;
-    RecordKey rk(
-      expdb.value().chunkId, pCtx->getDbId(), RecordType::RT_KV, key, "");
+    if (delta.ok()) {
+      if (!rv.ok()) {
+        return mergeGeneral(sess, kvstore, rk, 0, delta.value());
+      }
+      // the keys with a ttl are written as before, for the ttl
+      // compaction filter drops a value rather than its operands
+      if (rv.value().getTtl() == 0) {
+        auto sum = ::tendisplus::stoll(rv.value().getValue());
+        if (sum.ok()) {
+          return mergeGeneral(sess, kvstore, rk, sum.value(), delta.value());
+        }
+      }
+    }
 
     for (int32_t i = 0; i < RETRY_CNT; ++i) {
       auto ptxn = kvstore->createTransaction(sess);
@@ -1487,6 +1558,10 @@ class IncrbyCommand : public IncrDecrGeneral {
                        ttl,
                        oldValue);
   }
+
+  Expected<int64_t> mergeDelta(Session* sess) const {
+    return ::tendisplus::stoll(sess->getArgs()[2]);
+  }
 } incrbyCmd;
 
 class IncrexCommand : public IncrDecrGeneral {
@@ -1577,6 +1652,10 @@ class IncrCommand : public IncrDecrGeneral {
                        ttl,
                        oldValue);
   }
+
+  Expected<int64_t> mergeDelta(Session* sess) const {
+    return 1;
+  }
 } incrCmd;
 
 class DecrbyCommand : public IncrDecrGeneral {
@@ -1625,6 +1704,14 @@ class DecrbyCommand : public IncrDecrGeneral {
                        ttl,
                        oldValue);
   }
+
+  Expected<int64_t> mergeDelta(Session* sess) const {
+    Expected<int64_t> eInc = ::tendisplus::stoll(sess->getArgs()[2]);
+    if (!eInc.ok()) {
+      return eInc.status();
+    }
+    return -eInc.value();
+  }
 } decrbyCmd;
 
 class DecrCommand : public IncrDecrGeneral {
@@ -1667,6 +1754,10 @@ class DecrCommand : public IncrDecrGeneral {
                        ttl,
                        oldValue);
   }
+
+  Expected<int64_t> mergeDelta(Session* sess) const {
+    return -1;
+  }
 } decrCmd;
 
 class MGetCommand : public Command {
@@ -1727,13 +1818,6 @@ class BitopCommand : public Command {
  public:
   BitopCommand() : Command("bitop", "wm") {}
 
-  enum class Op {
-    BITOP_AND,
-    BITOP_OR,
-    BITOP_XOR,
-    BITOP_NOT,
-  };
-
   ssize_t arity() const {
     return -4;
   }
@@ -1754,19 +1838,19 @@ class BitopCommand : public Command {
     const auto& args = sess->getArgs();
     const std::string& opName = toLower(args[1]);
     const std::string& targetKey = args[2];
-    Op op;
+    redis_port::BitOp op;
     if (opName == "and") {
-      op = Op::BITOP_AND;
+      op = redis_port::BitOp::BITOP_AND;
     } else if (opName == "or") {
-      op = Op::BITOP_OR;
+      op = redis_port::BitOp::BITOP_OR;
     } else if (opName == "xor") {
-      op = Op::BITOP_XOR;
+      op = redis_port::BitOp::BITOP_XOR;
     } else if (opName == "not") {
-      op = Op::BITOP_NOT;
+      op = redis_port::BitOp::BITOP_NOT;
     } else {
       return {ErrorCodes::ERR_PARSEPKT, "syntax error"};
     }
-    if (op == Op::BITOP_NOT && args.size() != 4) {
+    if (op == redis_port::BitOp::BITOP_NOT && args.size() != 4) {
       return {
         ErrorCodes::ERR_PARSEPKT,
         "BITOP NOT must be called with a single source key."};  // NOLINT(whitespace/line_length)
@@ -1807,29 +1891,14 @@ class BitopCommand : public Command {
       Command::delKeyChkExpire(sess, targetKey, RecordType::RT_KV);
       return Command::fmtZero();
     }
-    std::string result(maxLen, 0);
-    for (size_t i = 0; i < maxLen; ++i) {
-      unsigned char output = (vals[0].size() <= i) ? 0 : vals[0][i];
-      if (op == Op::BITOP_NOT)
-        output = ~output;
-      for (size_t j = 1; j < numKeys; ++j) {
-        unsigned char byte = (vals[j].size() <= i) ? 0 : vals[j][i];
-        switch (op) {
-          case Op::BITOP_AND:
-            output &= byte;
-            break;
-          case Op::BITOP_OR:
-            output |= byte;
-            break;
-          case Op::BITOP_XOR:
-            output ^= byte;
-            break;
-          default:
-            INVARIANT_D(0);
-        }
-      }
-      result[i] = output;
+    std::vector<const std::string*> srcs;
+    srcs.reserve(numKeys);
+    for (const auto& v : vals) {
+      srcs.push_back(&v);
     }
+    std::string result(maxLen, 0);
+    redis_port::bitOp(
+      op, reinterpret_cast<unsigned char*>(&result[0]), maxLen, srcs);
 
 
     auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, targetKey);
@@ -2221,6 +2290,9 @@ class RenameGenericCommand : public Command {
     pCtx->commitAll("rename");
     rollback = false;
 
+    if (rv.value().getRecordType() == RecordType::RT_LIST_META) {
+      server->getBlockMgr()->signalKeyReady(pCtx->getDbId(), dst, cnt.value());
+    }
     return _flagnx ? Command::fmtOne() : Command::fmtOK();
   }
 
@@ -2263,6 +2335,25 @@ class RenameGenericCommand : public Command {
                         rk.getPrimaryKey(),
                         "");
       ret.push_back(fakeRk2.prefixPk());
+      RecordKey fakeRk3(rk.getChunkId(),
+                        rk.getDbId(),
+                        RecordType::RT_ZSET_I_ELE,
+                        rk.getPrimaryKey(),
+                        "");
+      ret.push_back(fakeRk3.prefixPk());
+    } else if (type == RecordType::RT_STREAM_META) {
+      RecordKey fakeRk(rk.getChunkId(),
+                       rk.getDbId(),
+                       RecordType::RT_STREAM_ELE,
+                       rk.getPrimaryKey(),
+                       "");
+      ret.push_back(fakeRk.prefixPk());
+      RecordKey fakeRk2(rk.getChunkId(),
+                        rk.getDbId(),
+                        RecordType::RT_STREAM_CG,
+                        rk.getPrimaryKey(),
+                        "");
+      ret.push_back(fakeRk2.prefixPk());
     }
     return ret;
   }
@@ -8,13 +8,16 @@
 #include <algorithm>
 #include <cctype>
 #include <clocale>
+#include <sstream>
 #include <vector>
 #include "glog/logging.h"
 #include "tendisplus/utils/sync_point.h"
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/scopeguard.h"
+#include "tendisplus/utils/time.h"
 #include "tendisplus/commands/command.h"
+#include "tendisplus/storage/quicklist.h"
 
 namespace tendisplus {
 
@@ -33,62 +36,38 @@ Expected<std::string> genericPop(Session* sess,
                                  const RecordKey& metaRk,
                                  const Expected<RecordValue>& rv,
                                  ListPos pos) {
-  ListMetaValue lm(INITSEQ, INITSEQ);
   if (!rv.ok()) {
     return rv.status();
   }
 
-  uint64_t ttl = 0;
-  ttl = rv.value().getTtl();
   Expected<ListMetaValue> exptLm = ListMetaValue::decode(rv.value().getValue());
   INVARIANT_D(exptLm.ok());
   if (!exptLm.ok()) {
     return exptLm.status();
   }
-  lm = std::move(exptLm.value());
-
-  uint64_t head = lm.getHead();
-  uint64_t tail = lm.getTail();
-  INVARIANT_D(head != tail);
-  if (head == tail) {
+  QuickList ql(metaRk.getChunkId(),
+               metaRk.getDbId(),
+               metaRk.getPrimaryKey(),
+               exptLm.value(),
+               kvstore);
+  INVARIANT_D(ql.size() != 0);
+  if (ql.size() == 0) {
     return {ErrorCodes::ERR_INTERNAL, "invalid head or tail of list"};
   }
-  uint64_t idx;
-  if (pos == ListPos::LP_HEAD) {
-    idx = head++;
-  } else {
-    idx = --tail;
-  }
-  RecordKey subRk(metaRk.getChunkId(),
-                  metaRk.getDbId(),
-                  RecordType::RT_LIST_ELE,
-                  metaRk.getPrimaryKey(),
-                  std::to_string(idx));
-  Expected<RecordValue> subRv = kvstore->getKV(subRk, txn);
-  if (!subRv.ok()) {
-    return subRv.status();
-  }
-  Status s = kvstore->delKV(subRk, txn);
-  if (!s.ok()) {
-    return s;
+  auto val = ql.pop(pos == ListPos::LP_HEAD, txn);
+  if (!val.ok()) {
+    return val.status();
   }
-  if (head == tail) {
+  Status s;
+  if (ql.size() == 0) {
     s = Command::delKeyAndTTL(sess, metaRk, rv.value(), txn);
   } else {
-    lm.setHead(head);
-    lm.setTail(tail);
-    s = kvstore->setKV(metaRk,
-                       RecordValue(lm.encode(),
-                                   RecordType::RT_LIST_META,
-                                   sess->getCtx()->getVersionEP(),
-                                   ttl,
-                                   rv),
-                       txn);
+    s = ql.save(txn, rv, sess->getCtx()->getVersionEP());
   }
   if (!s.ok()) {
     return s;
   }
-  return subRv.value().getValue();
+  return val.value();
 }
 
 Expected<std::string> genericPush(Session* sess,
@@ -100,10 +79,8 @@ Expected<std::string> genericPush(Session* sess,
                                   ListPos pos,
                                   bool needExist) {
   ListMetaValue lm(INITSEQ, INITSEQ);
-  uint64_t ttl = 0;
 
   if (rv.ok()) {
-    ttl = rv.value().getTtl();
     Expected<ListMetaValue> exptLm =
       ListMetaValue::decode(rv.value().getValue());
     INVARIANT_D(exptLm.ok());
@@ -118,39 +95,99 @@ Expected<std::string> genericPush(Session* sess,
     return Command::fmtZero();
   }
 
-  uint64_t head = lm.getHead();
-  uint64_t tail = lm.getTail();
-  for (size_t i = 0; i < args.size(); ++i) {
-    uint64_t idx;
-    if (pos == ListPos::LP_HEAD) {
-      idx = --head;
-    } else {
-      idx = tail++;
-    }
-    RecordKey subRk(metaRk.getChunkId(),
-                    metaRk.getDbId(),
-                    RecordType::RT_LIST_ELE,
-                    metaRk.getPrimaryKey(),
-                    std::to_string(idx));
-    RecordValue subRv(args[i], RecordType::RT_LIST_ELE, -1);
-    Status s = kvstore->setKV(subRk, subRv, txn);
-    if (!s.ok()) {
-      return s;
-    }
+  QuickList ql(metaRk.getChunkId(),
+               metaRk.getDbId(),
+               metaRk.getPrimaryKey(),
+               lm,
+               kvstore);
+  Status s = ql.push(args, pos == ListPos::LP_HEAD, txn);
+  if (!s.ok()) {
+    return s;
   }
-  lm.setHead(head);
-  lm.setTail(tail);
-  Status s = kvstore->setKV(metaRk,
-                            RecordValue(lm.encode(),
-                                        RecordType::RT_LIST_META,
-                                        sess->getCtx()->getVersionEP(),
-                                        ttl,
-                                        rv),
-                            txn);
+  s = ql.save(txn, rv, sess->getCtx()->getVersionEP());
   if (!s.ok()) {
     return s;
   }
-  return Command::fmtLongLong(lm.getTail() - lm.getHead());
+  return Command::fmtLongLong(ql.size());
+}
+
+// pop one element in its own transaction, ERR_NOTFOUND if the list is empty
+Expected<std::string> genericPopWithRetry(Session* sess,
+                                          PStore kvstore,
+                                          const RecordKey& metaRk,
+                                          const Expected<RecordValue>& rv,
+                                          ListPos pos) {
+  for (uint32_t i = 0; i < Command::RETRY_CNT; ++i) {
+    auto ptxn = kvstore->createTransaction(sess);
+    if (!ptxn.ok()) {
+      return ptxn.status();
+    }
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    Expected<std::string> s1 =
+      genericPop(sess, kvstore, txn.get(), metaRk, rv, pos);
+    if (!s1.ok()) {
+      return s1.status();
+    }
+    auto s = txn->commit();
+    if (s.ok()) {
+      return s1.value();
+    } else if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
+      return s.status();
+    }
+    if (i == Command::RETRY_CNT - 1) {
+      return s.status();
+    } else {
+      continue;
+    }
+  }
+
+  INVARIANT_D(0);
+  return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+}
+
+// the deadline(ms) of a blocking command, the timeout is in seconds.
+// when the command runs again after wakeup, the deadline of the first run
+// is kept in SessionCtx.
+Expected<uint64_t> getBlockDeadline(Session* sess, const std::string& arg) {
+  uint64_t deadline = sess->getCtx()->getBlockDeadline();
+  if (deadline) {
+    return deadline;
+  }
+  auto etimeout = tendisplus::stod(arg);
+  if (!etimeout.ok()) {
+    return {ErrorCodes::ERR_PARSEOPT, "timeout is not a float or out of range"};
+  }
+  if (etimeout.value() < 0) {
+    return {ErrorCodes::ERR_PARSEOPT, "timeout is negative"};
+  }
+  // more than ten years is as good as forever
+  if (etimeout.value() == 0 || etimeout.value() > 315360000) {
+    return BlockManager::NO_DEADLINE;
+  }
+  return msSinceEpoch() + static_cast<uint64_t>(etimeout.value() * 1000);
+}
+
+// all the lists are empty, park the session on keys until one of them is
+// pushed. it should be called with keys locked. like redis, a blocking
+// command in MULTI, in a script or from a non-network session replies nil
+// at once.
+std::string blockForKeys(Session* sess,
+                         const std::vector<std::string>& keys,
+                         uint64_t deadline) {
+  SessionCtx* pCtx = sess->getCtx();
+  if (sess->getType() != Session::Type::NET || pCtx->isInMulti() ||
+      (pCtx->getFlags() & (CLIENT_SCRIPT | CLIENT_EXEC)) ||
+      deadline <= msSinceEpoch()) {
+    return Command::fmtNullArray();
+  }
+  // a non-zero deadline means we were woken up, but other clients
+  // took the elements first
+  bool retry = pCtx->getBlockDeadline() != 0;
+  sess->getServerEntry()->getBlockMgr()->addWaiter(
+    sess, pCtx->getDbId(), keys, deadline, retry);
+  pCtx->setBlocked(deadline);
+  // not sent, see ServerEntry::processRequest()
+  return Command::fmtNullArray();
 }
 
 class LLenCommand : public Command {
@@ -252,49 +289,125 @@ class ListPopWrapper : public Command {
                      "");
     PStore kvstore = expdb.value().store;
 
-    for (uint32_t i = 0; i < RETRY_CNT; ++i) {
-      auto ptxn = kvstore->createTransaction(sess);
-      if (!ptxn.ok()) {
-        return ptxn.status();
+    Expected<std::string> s1 =
+      genericPopWithRetry(sess, kvstore, metaRk, rv, _pos);
+    if (s1.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return Command::fmtNull();
+    } else if (!s1.ok()) {
+      return s1.status();
+    }
+    return Command::fmtBulk(s1.value());
+  }
+
+ private:
+  ListPos _pos;
+};
+
+class LPopCommand : public ListPopWrapper {
+ public:
+  LPopCommand() : ListPopWrapper(ListPos::LP_HEAD, "wF") {}
+} LPopCommand;
+
+class RPopCommand : public ListPopWrapper {
+ public:
+  RPopCommand() : ListPopWrapper(ListPos::LP_TAIL, "wF") {}
+} rpopCommand;
+
+class BListPopWrapper : public Command {
+ public:
+  explicit BListPopWrapper(ListPos pos, const char* sflags)
+    : Command(pos == ListPos::LP_HEAD ? "blpop" : "brpop", sflags),
+      _pos(pos) {}
+
+  ssize_t arity() const {
+    return -3;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return -2;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+
+    auto deadline = getBlockDeadline(sess, args.back());
+    if (!deadline.ok()) {
+      return deadline.status();
+    }
+
+    auto server = sess->getServerEntry();
+    auto index = getKeysFromCommand(args);
+    auto locklist = server->getSegmentMgr()->getAllKeysLocked(
+      sess, args, index, mgl::LockMode::LOCK_X);
+    if (!locklist.ok()) {
+      return locklist.status();
+    }
+
+    std::vector<std::string> keys;
+    for (auto i : index) {
+      const std::string& key = args[i];
+      Expected<RecordValue> rv =
+        Command::expireKeyIfNeeded(sess, key, RecordType::RT_LIST_META);
+      if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
+          rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+        keys.push_back(key);
+        continue;
+      } else if (!rv.ok()) {
+        return rv.status();
       }
-      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+
+      auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, key);
+      if (!expdb.ok()) {
+        return expdb.status();
+      }
+      RecordKey metaRk(expdb.value().chunkId,
+                       pCtx->getDbId(),
+                       RecordType::RT_LIST_META,
+                       key,
+                       "");
       Expected<std::string> s1 =
-        genericPop(sess, kvstore, txn.get(), metaRk, rv, _pos);
+        genericPopWithRetry(sess, expdb.value().store, metaRk, rv, _pos);
       if (s1.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        return Command::fmtNull();
+        keys.push_back(key);
+        continue;
       } else if (!s1.ok()) {
         return s1.status();
       }
-      auto s = txn->commit();
-      if (s.ok()) {
-        return Command::fmtBulk(s1.value());
-      } else if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
-        return s.status();
-      }
-      if (i == RETRY_CNT - 1) {
-        return s.status();
-      } else {
-        continue;
-      }
+
+      std::stringstream ss;
+      Command::fmtMultiBulkLen(ss, 2);
+      Command::fmtBulk(ss, key);
+      Command::fmtBulk(ss, s1.value());
+      return ss.str();
     }
 
-    INVARIANT_D(0);
-    return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+    return blockForKeys(sess, keys, deadline.value());
   }
 
  private:
   ListPos _pos;
 };
 
-class LPopCommand : public ListPopWrapper {
+class BLPopCommand : public BListPopWrapper {
  public:
-  LPopCommand() : ListPopWrapper(ListPos::LP_HEAD, "wF") {}
-} LPopCommand;
+  BLPopCommand() : BListPopWrapper(ListPos::LP_HEAD, "ws") {}
+} blpopCommand;
 
-class RPopCommand : public ListPopWrapper {
+class BRPopCommand : public BListPopWrapper {
  public:
-  RPopCommand() : ListPopWrapper(ListPos::LP_TAIL, "wF") {}
-} rpopCommand;
+  BRPopCommand() : BListPopWrapper(ListPos::LP_TAIL, "ws") {}
+} brpopCommand;
 
 class ListPushWrapper : public Command {
  public:
@@ -370,6 +483,8 @@ class ListPushWrapper : public Command {
       }
       auto s = txn->commit();
       if (s.ok()) {
+        server->getBlockMgr()->signalKeyReady(
+          pCtx->getDbId(), key, valargs.size());
         return s1.value();
       } else if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
         return s.status();
@@ -413,10 +528,12 @@ class RPushXCommand : public ListPushWrapper {
 // NOTE(deyukong): atomic is not guaranteed
 class RPopLPushCommand : public Command {
  public:
-  RPopLPushCommand() : Command("rpoplpush", "wm") {}
+  RPopLPushCommand() : RPopLPushCommand("rpoplpush", "wm", false) {}
+  RPopLPushCommand(const std::string& name, const char* sflags, bool blocking)
+    : Command(name, sflags), _blocking(blocking) {}
 
   ssize_t arity() const {
-    return 3;
+    return _blocking ? 4 : 3;
   }
 
   int32_t firstkey() const {
@@ -440,6 +557,15 @@ class RPopLPushCommand : public Command {
     auto server = sess->getServerEntry();
     INVARIANT(pCtx != nullptr);
 
+    uint64_t deadline = 0;
+    if (_blocking) {
+      auto edeadline = getBlockDeadline(sess, args[3]);
+      if (!edeadline.ok()) {
+        return edeadline.status();
+      }
+      deadline = edeadline.value();
+    }
+
     auto index = getKeysFromCommand(args);
     auto locklist = server->getSegmentMgr()->getAllKeysLocked(
       sess, args, index, mgl::LockMode::LOCK_X);
@@ -451,7 +577,7 @@ class RPopLPushCommand : public Command {
       Command::expireKeyIfNeeded(sess, key1, RecordType::RT_LIST_META);
     if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
         rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-      return Command::fmtNull();
+      return emptySource(sess, key1, deadline);
     } else if (!rv.ok()) {
       return rv.status();
     }
@@ -486,7 +612,7 @@ class RPopLPushCommand : public Command {
         break;
       }
       if (s.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        return Command::fmtNull();
+        return emptySource(sess, key1, deadline);
       }
 
       if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
@@ -520,8 +646,9 @@ class RPopLPushCommand : public Command {
                              ListPos::LP_HEAD,
                              false /*need_exist*/);
         if (s.ok()) {
-          pCtx->commitAll("rpoplpush");
+          pCtx->commitAll(getName());
           rollback = false;
+          server->getBlockMgr()->signalKeyReady(pCtx->getDbId(), key2, 1);
           return Command::fmtBulk(val);
         }
         if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
@@ -568,8 +695,9 @@ class RPopLPushCommand : public Command {
                              ListPos::LP_HEAD,
                              false /*need_exist*/);
         if (s.ok()) {
-          pCtx->commitAll("rpoplpush");
+          pCtx->commitAll(getName());
           rollback = false;
+          server->getBlockMgr()->signalKeyReady(pCtx->getDbId(), key2, 1);
           return Command::fmtBulk(val);
         }
         if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
@@ -585,8 +713,25 @@ class RPopLPushCommand : public Command {
     INVARIANT_D(0);
     return {ErrorCodes::ERR_INTERNAL, "not reachable"};
   }
+
+ private:
+  std::string emptySource(Session* sess,
+                          const std::string& key,
+                          uint64_t deadline) {
+    if (!_blocking) {
+      return Command::fmtNull();
+    }
+    return blockForKeys(sess, {key}, deadline);
+  }
+
+  bool _blocking;
 } rpoplpushCmd;
 
+class BRPopLPushCommand : public RPopLPushCommand {
+ public:
+  BRPopLPushCommand() : RPopLPushCommand("brpoplpush", "wms", true) {}
+} brpoplpushCmd;
+
 class LtrimCommand : public Command {
  public:
   LtrimCommand() : Command("ltrim", "w") {}
@@ -607,13 +752,14 @@ class LtrimCommand : public Command {
     return 1;
   }
 
-  Status trimListPessimistic(Session* sess,
-                             PStore kvstore,
-                             const RecordKey& mk,
-                             const ListMetaValue& lm,
-                             int64_t start,
-                             int64_t end,
-                             const Expected<RecordValue>& rv) {
+  // the chunks out of [start, end] are deleted in one transaction
+  Status trimList(Session* sess,
+                  PStore kvstore,
+                  const RecordKey& mk,
+                  const ListMetaValue& lm,
+                  int64_t start,
+                  int64_t end,
+                  const Expected<RecordValue>& rv) {
     auto ptxn = kvstore->createTransaction(sess);
     if (!ptxn.ok()) {
       return ptxn.status();
@@ -621,61 +767,20 @@ class LtrimCommand : public Command {
     if (!rv.ok()) {
       return rv.status();
     }
-    uint64_t head = lm.getHead();
     std::unique_ptr<Transaction> txn = std::move(ptxn.value());
-    uint64_t cnt = 0;
-    auto functor = [kvstore, sess, &cnt, &txn, &mk](int64_t start,
-                                                    int64_t end) -> Status {
-      SessionCtx* pCtx = sess->getCtx();
-      for (int64_t i = start; i < end; ++i) {
-        RecordKey subRk(mk.getChunkId(),
-                        pCtx->getDbId(),
-                        RecordType::RT_LIST_ELE,
-                        mk.getPrimaryKey(),
-                        std::to_string(i));
-        Status s = kvstore->delKV(subRk, txn.get());
-        if (!s.ok()) {
-          return s;
-        }
-        cnt += 1;
-        if (cnt % 1000 == 0) {
-          auto v = txn->commit();
-          if (!v.ok()) {
-            return v.status();
-          }
-          auto ptxn = kvstore->createTransaction(sess);
-          if (!ptxn.ok()) {
-            return ptxn.status();
-          }
-          txn = std::move(ptxn.value());
-        }
-      }
-      return {ErrorCodes::ERR_OK, ""};
-    };
-    auto st = functor(head, start + head);
-    if (!st.ok()) {
-      return st;
-    }
-    st = functor(head + end + 1, lm.getTail());
+    QuickList ql(
+      mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey(), lm, kvstore);
+    Status st = ql.trim(start, end + 1, txn.get());
     if (!st.ok()) {
       return st;
     }
-    if (cnt >= lm.getTail() - lm.getHead()) {
+    if (ql.size() == 0) {
       st = Command::delKeyAndTTL(sess, mk, rv.value(), txn.get());
-      if (!st.ok()) {
-        return st;
-      }
     } else {
-      ListMetaValue newLm(start + head, end + 1 + head);
-      RecordValue metarcd(newLm.encode(),
-                          RecordType::RT_LIST_META,
-                          sess->getCtx()->getVersionEP(),
-                          rv.value().getTtl(),
-                          rv);
-      st = kvstore->setKV(mk, metarcd, txn.get());
-      if (!st.ok()) {
-        return st;
-      }
+      st = ql.save(txn.get(), rv, sess->getCtx()->getVersionEP());
+    }
+    if (!st.ok()) {
+      return st;
     }
     auto commitstatus = txn->commit();
     return commitstatus.status();
@@ -749,7 +854,7 @@ class LtrimCommand : public Command {
     if (end >= len) {
       end = len - 1;
     }
-    Status st = trimListPessimistic(sess, kvstore, metaRk, lm, start, end, rv);
+    Status st = trimList(sess, kvstore, metaRk, lm, start, end, rv);
     if (!st.ok()) {
       return st;
     }
@@ -807,6 +912,11 @@ class LRangeCommand : public Command {
     }
 
     SessionCtx* pCtx = sess->getCtx();
+    RecordKey metaRk(expdb.value().chunkId,
+                     pCtx->getDbId(),
+                     RecordType::RT_LIST_META,
+                     key,
+                     "");
 
     PStore kvstore = expdb.value().store;
     auto ptxn = kvstore->createTransaction(sess);
@@ -848,23 +958,19 @@ class LRangeCommand : public Command {
     if (end >= len) {
       end = len - 1;
     }
-    int64_t rangelen = (end - start) + 1;
-    start += head;
+    QuickList ql(metaRk.getChunkId(),
+                 metaRk.getDbId(),
+                 metaRk.getPrimaryKey(),
+                 lm,
+                 kvstore);
+    auto values = ql.range(start, end + 1, txn.get());
+    if (!values.ok()) {
+      return values.status();
+    }
     std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, rangelen);
-    while (rangelen--) {
-      RecordKey subRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_LIST_ELE,
-                      key,
-                      std::to_string(start));
-      Expected<RecordValue> eSubVal = kvstore->getKV(subRk, txn.get());
-      if (eSubVal.ok()) {
-        Command::fmtBulk(ss, eSubVal.value().getValue());
-      } else {
-        return eSubVal.status();
-      }
-      start++;
+    Command::fmtMultiBulkLen(ss, values.value().size());
+    for (const auto& v : values.value()) {
+      Command::fmtBulk(ss, v);
     }
     return ss.str();
   }
@@ -951,14 +1057,14 @@ class LIndexCommand : public Command {
     if (mappingIdx < head || mappingIdx >= tail) {
       return fmtNull();
     }
-    RecordKey subRk(expdb.value().chunkId,
-                    pCtx->getDbId(),
-                    RecordType::RT_LIST_ELE,
-                    key,
-                    std::to_string(mappingIdx));
-    Expected<RecordValue> eSubVal = kvstore->getKV(subRk, txn.get());
+    QuickList ql(metaRk.getChunkId(),
+                 metaRk.getDbId(),
+                 metaRk.getPrimaryKey(),
+                 lm,
+                 kvstore);
+    auto eSubVal = ql.index(mappingIdx - head, txn.get());
     if (eSubVal.ok()) {
-      return fmtBulk(eSubVal.value().getValue());
+      return fmtBulk(eSubVal.value());
     } else {
       return eSubVal.status();
     }
@@ -1035,29 +1141,23 @@ class LSetCommand : public Command {
       }
       std::unique_ptr<Transaction> txn = std::move(ptxn.value());
 
-      RecordKey subRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_LIST_ELE,
-                      key,
-                      std::to_string(realIndex));
-      RecordValue subRv(value, RecordType::RT_LIST_ELE, -1);
-      Status s = kvstore->setKV(subRk, subRv, txn.get());
-      if (!s.ok()) {
-        return s;
-      }
-      // update meta key's revision
       RecordKey metaRk(expdb.value().chunkId,
                        pCtx->getDbId(),
                        RecordType::RT_LIST_META,
                        key,
                        "");
-      s = kvstore->setKV(metaRk,
-                         RecordValue(lm.encode(),
-                                     RecordType::RT_LIST_META,
-                                     sess->getCtx()->getVersionEP(),
-                                     rv.value().getTtl(),
-                                     rv),
-                         txn.get());
+      // a new QuickList on each retry, as it's changed by the last one
+      QuickList ql(metaRk.getChunkId(),
+                   metaRk.getDbId(),
+                   metaRk.getPrimaryKey(),
+                   lm,
+                   kvstore);
+      Status s = ql.set(realIndex - head, value, txn.get());
+      if (!s.ok()) {
+        return s;
+      }
+      // update meta key's revision
+      s = ql.save(txn.get(), rv, sess->getCtx()->getVersionEP());
       if (!s.ok()) {
         return s;
       }
@@ -1139,168 +1239,36 @@ class LRemCommand : public Command {
     if (!expLm.ok()) {
       return expLm.status();
     }
-    ListMetaValue lm = std::move(expLm.value());
-    uint64_t head = lm.getHead();
-    uint64_t tail = lm.getTail();
-
-    size_t len = tail - head;
-    uint64_t index = pos == ListPos::LP_HEAD ? head : tail - 1;
-    std::vector<uint64_t> hole;
-    hole.push_back(head - 1);
-
     PStore kvstore = expdb.value().store;
     auto ptxn = kvstore->createTransaction(sess);
     if (!ptxn.ok()) {
       return ptxn.status();
     }
     std::unique_ptr<Transaction> txn = std::move(ptxn.value());
-
-    for (size_t i = 0; i < len; i++) {
-      RecordKey subRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_LIST_ELE,
-                      key,
-                      std::to_string(index));
-      Expected<RecordValue> expRv = kvstore->getKV(subRk, txn.get());
-      if (!expRv.ok()) {
-        return expRv.status();
-      }
-      if (expRv.value().getValue() == value) {
-        hole.push_back(index);
-        Status s = kvstore->delKV(subRk, txn.get());
-        if (!s.ok()) {
-          return s;
-        }
-        if (count >= 0 && hole.size() - 1 == static_cast<uint32_t>(count)) {
-          break;
-        }
-      }
-      if (pos == ListPos::LP_HEAD)
-        index++;
-      else
-        index--;
-    }
-    hole.push_back(tail);
-    if (hole.size() == 2) {
-      return Command::fmtZero();
-    }
-
-    size_t lasthole(0);
-    uint64_t largest(0);
-    std::pair<uint64_t, uint64_t> seg;
-    if (pos == ListPos::LP_TAIL) {
-      std::sort(hole.begin(), hole.end());
-    }
-    for (size_t i = 1; i < hole.size(); i++) {
-      if (hole[i] - hole[lasthole] > largest) {
-        largest = hole[i] - hole[lasthole];
-        seg = std::make_pair(lasthole, i);
-      }
-      lasthole = i;
-    }
-
-    uint64_t oldHead(head), oldTail(tail);
-    uint64_t lBorder, rBorder;
-    lBorder = seg.first;
-    rBorder = seg.second;
-    INVARIANT(hole[rBorder] > hole[lBorder]);
-
-    uint64_t destPos(hole[lBorder]);
-    for (ssize_t i = lBorder - 1; i >= 0; i--) {
-      uint64_t pos = hole[i + 1] - 1;
-      uint64_t nextHole = hole[i];
-      for (; pos > nextHole; pos--) {
-        RecordKey subRk(expdb.value().chunkId,
-                        pCtx->getDbId(),
-                        RecordType::RT_LIST_ELE,
-                        key,
-                        std::to_string(pos));
-        Expected<RecordValue> eSubVal = kvstore->getKV(subRk, txn.get());
-        if (!eSubVal.ok()) {
-          return eSubVal.status();
-        }
-        RecordKey newRk(expdb.value().chunkId,
-                        pCtx->getDbId(),
-                        RecordType::RT_LIST_ELE,
-                        key,
-                        std::to_string(destPos));
-        Status s = kvstore->setKV(newRk, eSubVal.value(), txn.get());
-        if (!s.ok()) {
-          return s;
-        }
-        destPos--;
-      }
-    }
-    head = destPos + 1;
-
-    destPos = hole[rBorder];
-    for (size_t i = rBorder + 1; i < hole.size(); i++) {
-      uint64_t pos = hole[i - 1] + 1;
-      uint64_t nextHole = hole[i];
-      for (; pos < nextHole; pos++) {
-        RecordKey subRk(expdb.value().chunkId,
-                        pCtx->getDbId(),
-                        RecordType::RT_LIST_ELE,
-                        key,
-                        std::to_string(pos));
-        Expected<RecordValue> eSubVal = kvstore->getKV(subRk, txn.get());
-        if (!eSubVal.ok()) {
-          return eSubVal.status();
-        }
-        RecordKey newRk(expdb.value().chunkId,
-                        pCtx->getDbId(),
-                        RecordType::RT_LIST_ELE,
-                        key,
-                        std::to_string(destPos));
-        Status s = kvstore->setKV(newRk, eSubVal.value(), txn.get());
-        if (!s.ok()) {
-          return s;
-        }
-        destPos++;
-      }
-    }
-    tail = destPos;
-
-    // explicit delete useless records between old end and new end.
-    while (true) {
-      uint64_t delPos;
-      if (oldHead != head) {
-        delPos = oldHead++;
-      } else if (oldTail != tail) {
-        delPos = --oldTail;
-      } else {
-        break;
-      }
-
-      RecordKey subRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_LIST_ELE,
-                      key,
-                      std::to_string(delPos));
-      Status s = kvstore->delKV(subRk, txn.get());
-      if (!s.ok()) {
-        return s;
-      }
-    }
-
-    lm.setHead(head);
-    lm.setTail(tail);
     RecordKey metaRk(expdb.value().chunkId,
                      pCtx->getDbId(),
                      RecordType::RT_LIST_META,
                      key,
                      "");
+    QuickList ql(metaRk.getChunkId(),
+                 metaRk.getDbId(),
+                 metaRk.getPrimaryKey(),
+                 expLm.value(),
+                 kvstore);
+    auto removed =
+      ql.remove(value, count, pos == ListPos::LP_HEAD, txn.get());
+    if (!removed.ok()) {
+      return removed.status();
+    }
+    if (removed.value() == 0) {
+      return Command::fmtZero();
+    }
+
     Status s;
-    if (head == tail) {
+    if (ql.size() == 0) {
       s = Command::delKeyAndTTL(sess, metaRk, rv.value(), txn.get());
     } else {
-      s = kvstore->setKV(metaRk,
-                         RecordValue(lm.encode(),
-                                     RecordType::RT_LIST_META,
-                                     sess->getCtx()->getVersionEP(),
-                                     rv.value().getTtl(),
-                                     rv),
-                         txn.get());
+      s = ql.save(txn.get(), rv, sess->getCtx()->getVersionEP());
     }
     if (!s.ok()) {
       return s;
@@ -1311,7 +1279,7 @@ class LRemCommand : public Command {
       return expCmt.status();
     }
 
-    return Command::fmtLongLong(static_cast<int64_t>(hole.size() - 2));
+    return Command::fmtLongLong(static_cast<int64_t>(removed.value()));
   }
 } lremCmd;
 
@@ -1338,13 +1306,13 @@ class LInsertCommand : public Command {
   Expected<std::string> run(Session* sess) final {
     const std::vector<std::string>& args = sess->getArgs();
     const std::string& key = args[1];
-    int32_t step;
+    bool after;
     const std::string& pivot = args[3];
     const std::string& value = args[4];
     if (!::strcasecmp(args[2].c_str(), "before")) {
-      step = 1;
+      after = false;
     } else if (!::strcasecmp(args[2].c_str(), "after")) {
-      step = -1;
+      after = true;
     } else {
       return {ErrorCodes::ERR_PARSEOPT, "syntax error"};
     }
@@ -1372,110 +1340,31 @@ class LInsertCommand : public Command {
       return expLm.status();
     }
 
-    ListMetaValue lm = std::move(expLm.value());
-    uint64_t head = lm.getHead();
-    uint64_t tail = lm.getTail();
-    uint64_t len = tail - head;
-    uint64_t index = head;
-
     PStore kvstore = expdb.value().store;
     auto ptxn = kvstore->createTransaction(sess);
     if (!ptxn.ok()) {
       return ptxn.status();
     }
     std::unique_ptr<Transaction> txn = std::move(ptxn.value());
-    while (len > 0) {
-      RecordKey subRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_LIST_ELE,
-                      key,
-                      std::to_string(index));
-      Expected<RecordValue> eSubRv = kvstore->getKV(subRk, txn.get());
-      if (!eSubRv.ok()) {
-        return eSubRv.status();
-      }
-      RecordValue& subRv = eSubRv.value();
-      if (subRv.getValue() == pivot) {
-        break;
-      }
-      len--;
-      index++;
-    }
-    if (len <= 0) {
-      return Command::fmtLongLong(-1);
-    }
-    // we traverse the list in reverse order,
-    // so here need to subtract the step.
-    int32_t leftEle = index - head;
-    int32_t rightEle = tail - index - 1;
-
-    int32_t moveLen(0);
-    if (step < 0) {
-      leftEle += 1;
-    } else if (step > 0) {
-      rightEle += 1;
-    }
-
-    if (leftEle < rightEle) {
-      step = 1;
-      head = head - 1;
-      index = head;
-      moveLen = leftEle;
-    } else {
-      step = -1;
-      tail = tail + 1;
-      index = tail - 1;
-      moveLen = rightEle;
-    }
-
-    while (moveLen > 0) {
-      RecordKey subRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_LIST_ELE,
-                      key,
-                      std::to_string(index + step));
-      Expected<RecordValue> eSubVal = kvstore->getKV(subRk, txn.get());
-      if (!eSubVal.ok()) {
-        return eSubVal.status();
-      }
-
-      RecordKey newRk(subRk.getChunkId(),
-                      subRk.getDbId(),
-                      RecordType::RT_LIST_ELE,
-                      key,
-                      std::to_string(index));
-      Status s = kvstore->setKV(newRk, eSubVal.value(), txn.get());
-      if (!s.ok()) {
-        return s;
-      }
-      index += step;
-      moveLen--;
-    }
-    RecordKey targRk(expdb.value().chunkId,
-                     pCtx->getDbId(),
-                     RecordType::RT_LIST_ELE,
-                     key,
-                     std::to_string(index));
-    RecordValue targRv(value, RecordType::RT_LIST_ELE, -1);
-    Status s = kvstore->setKV(targRk, targRv, txn.get());
-    if (!s.ok()) {
-      return s;
-    }
-
-    lm.setHead(head);
-    lm.setTail(tail);
     RecordKey metaRk(expdb.value().chunkId,
                      pCtx->getDbId(),
                      RecordType::RT_LIST_META,
                      key,
                      "");
-    s = kvstore->setKV(metaRk,
-                       RecordValue(lm.encode(),
-                                   RecordType::RT_LIST_META,
-                                   pCtx->getVersionEP(),
-                                   rv.value().getTtl(),
-                                   rv),
-                       txn.get());
+    QuickList ql(metaRk.getChunkId(),
+                 metaRk.getDbId(),
+                 metaRk.getPrimaryKey(),
+                 expLm.value(),
+                 kvstore);
+    auto found = ql.insert(pivot, value, after, txn.get());
+    if (!found.ok()) {
+      return found.status();
+    }
+    if (!found.value()) {
+      return Command::fmtLongLong(-1);
+    }
+
+    Status s = ql.save(txn.get(), rv, pCtx->getVersionEP());
     if (!s.ok()) {
       return s;
     }
@@ -1485,7 +1374,7 @@ class LInsertCommand : public Command {
       return expCmt.status();
     }
 
-    return Command::fmtLongLong(lm.getTail() - lm.getHead());
+    return Command::fmtLongLong(ql.size());
   }
 } linsertCmd;
 
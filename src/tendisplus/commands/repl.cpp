@@ -46,14 +46,20 @@ class BackupCommand : public Command {
   Expected<std::string> run(Session* sess) final {
     const std::string& dir = sess->getArgs()[1];
     auto mode = KVStore::BackupMode::BACKUP_COPY;
+    // backup dir incr baseDir, baseDir is a ckpt or incr backup before
+    std::string baseDir;
     if (sess->getArgs().size() >= 3) {
       const std::string& str_mode = toLower(sess->getArgs()[2]);
       if (str_mode == "ckpt") {
         mode = KVStore::BackupMode::BACKUP_CKPT;
       } else if (str_mode == "copy") {
         mode = KVStore::BackupMode::BACKUP_COPY;
+      } else if (str_mode == "incr" && sess->getArgs().size() == 4) {
+        mode = KVStore::BackupMode::BACKUP_INCR;
+        baseDir = sess->getArgs()[3];
       } else {
-        return {ErrorCodes::ERR_MANUAL, "mode error, should be ckpt or copy"};
+        return {ErrorCodes::ERR_MANUAL,
+                "mode error, should be ckpt, copy or incr baseDir"};
       }
     }
     auto svr = sess->getServerEntry();
@@ -75,6 +81,15 @@ class BackupCommand : public Command {
       return {ErrorCodes::ERR_MANUAL, "dir cant be dbPath:" + dir};
     }
 
+    if (mode == KVStore::BackupMode::BACKUP_INCR) {
+      if (!filesystem::exists(baseDir)) {
+        return {ErrorCodes::ERR_MANUAL, "base dir not exist:" + baseDir};
+      }
+      if (filesystem::equivalent(dir, baseDir)) {
+        return {ErrorCodes::ERR_MANUAL, "dir cant be base dir:" + dir};
+      }
+    }
+
     if (svr->isClusterEnabled()) {
       auto state = svr->getClusterMgr()->getClusterState();
       Expected<std::string> eptNodeInfo = state->getBackupInfo();
@@ -118,8 +133,11 @@ class BackupCommand : public Command {
         continue;
       }
       std::string dbdir = dir + "/" + std::to_string(i) + "/";
-      Expected<BackupInfo> bkInfo =
-        store->backup(dbdir, mode, svr->getCatalog()->getBinlogVersion());
+      auto binlogVersion = svr->getCatalog()->getBinlogVersion();
+      Expected<BackupInfo> bkInfo = mode == KVStore::BackupMode::BACKUP_INCR
+        ? store->backupIncr(
+            dbdir, baseDir + "/" + std::to_string(i) + "/", binlogVersion)
+        : store->backup(dbdir, mode, binlogVersion);
       if (!bkInfo.ok()) {
         svr->onBackupEndFailed(i, bkInfo.status().toString());
         return bkInfo.status();
@@ -552,6 +570,7 @@ class ApplyBinlogsGeneric : public Command {
     INVARIANT_D(eflush.value() == eLog.value().getReplLogKey().getBinlogId());
 
     replMgr->onFlush(storeId, eflush.value());
+    svr->getTrackingMgr()->invalidateAll();
     return {ErrorCodes::ERR_OK, ""};
   }
 
@@ -831,6 +850,7 @@ class RestoreBinlogCommandV2 : public Command {
     INVARIANT_D(eflush.value() == logKey.value().getBinlogId());
 
     replMgr->onFlush(storeId, eflush.value());
+    svr->getTrackingMgr()->invalidateAll();
     return {ErrorCodes::ERR_OK, ""};
   }
 
@@ -0,0 +1,196 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include "tendisplus/commands/command.h"
+#include "tendisplus/utils/sha1.h"
+#include "tendisplus/utils/string.h"
+
+namespace tendisplus {
+
+// EVAL script numkeys [key ...] [arg ...]
+// EVALSHA sha1 numkeys [key ...] [arg ...]
+// The keys are locked before the script runs, and all the writes of the
+// script are done in one transaction of their kvstore, so the script is
+// committed as one binlog and applied atomically by the slaves. If the
+// script fails, nothing is written.
+class EvalGenericCommand : public Command {
+ public:
+  explicit EvalGenericCommand(const std::string& name)
+    : Command(name, "wms"), _isSha(name == "evalsha") {}
+
+  ssize_t arity() const {
+    return -3;
+  }
+
+  int32_t firstkey() const {
+    return 0;
+  }
+
+  int32_t lastkey() const {
+    return 0;
+  }
+
+  int32_t keystep() const {
+    return 0;
+  }
+
+  std::vector<int> getKeysFromCommand(
+    const std::vector<std::string>& argv) final {
+    auto expNum = tendisplus::stol(argv[2]);
+    if (!expNum.ok() || expNum.value() < 0 ||
+        expNum.value() > static_cast<int32_t>(argv.size()) - 3) {
+      return std::vector<int>();
+    }
+    std::vector<int> keyindex;
+    keyindex.reserve(expNum.value());
+    for (int32_t i = 0; i < expNum.value(); i++) {
+      keyindex.push_back(3 + i);
+    }
+    return keyindex;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const auto& args = sess->getArgs();
+    auto server = sess->getServerEntry();
+    auto scriptMgr = server->getScriptMgr();
+
+    auto expNum = tendisplus::stol(args[2]);
+    if (!expNum.ok()) {
+      return expNum.status();
+    }
+    if (expNum.value() < 0) {
+      return {ErrorCodes::ERR_PARSEOPT, "Number of keys can't be negative"};
+    }
+    if (expNum.value() > static_cast<int32_t>(args.size()) - 3) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "Number of keys can't be greater than number of args"};
+    }
+
+    std::string sha;
+    std::string body;
+    if (_isSha) {
+      sha = toLower(args[1]);
+      auto expBody = scriptMgr->getScript(sha);
+      RET_IF_ERR_EXPECTED(expBody);
+      body = std::move(expBody.value());
+    } else {
+      body = args[1];
+      sha = sha1hex(body);
+    }
+
+    auto index = getKeysFromCommand(args);
+    std::vector<std::string> keys;
+    for (auto i : index) {
+      keys.push_back(args[i]);
+    }
+    std::vector<std::string> argv(args.begin() + 3 + index.size(),
+                                  args.end());
+
+    auto locks = server->getSegmentMgr()->getAllKeysLocked(
+      sess, args, index, mgl::LockMode::LOCK_X);
+    RET_IF_ERR_EXPECTED(locks);
+
+    // one transaction for the whole script, so the keys should be in one
+    // kvstore, hash tags can put them together
+    PStore kvstore;
+    for (const auto& key : keys) {
+      auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, key);
+      RET_IF_ERR_EXPECTED(expdb);
+      if (kvstore && kvstore->dbId() != expdb.value().store->dbId()) {
+        return {ErrorCodes::ERR_PARSEOPT,
+                "Keys of a script should be in the same kvstore"};
+      }
+      kvstore = expdb.value().store;
+    }
+
+    std::unique_ptr<Transaction> txn;
+    if (kvstore) {
+      auto ptxn = kvstore->createTransaction(sess);
+      RET_IF_ERR_EXPECTED(ptxn);
+      txn = std::move(ptxn.value());
+    }
+
+    auto pCtx = sess->getCtx();
+    Transaction* prevTxn = nullptr;
+    if (txn) {
+      // EXEC may have set one, txn is nested in it
+      prevTxn = pCtx->getNestedTxn(kvstore->dbId());
+      pCtx->setNestedTxn(kvstore->dbId(), txn.get());
+    }
+    auto reply = scriptMgr->runScript(sess, sha, body, keys, argv, txn.get());
+    if (txn) {
+      pCtx->setNestedTxn(kvstore->dbId(), prevTxn);
+    }
+    if (!txn) {
+      return reply;
+    }
+    if (!reply.ok()) {
+      txn->rollback();
+      return reply;
+    }
+    auto eCommit = txn->commit();
+    RET_IF_ERR_EXPECTED(eCommit);
+    return reply;
+  }
+
+ private:
+  bool _isSha;
+};
+
+EvalGenericCommand evalCmd("eval");
+EvalGenericCommand evalshaCmd("evalsha");
+
+// SCRIPT LOAD script | EXISTS sha1 [sha1 ...] | FLUSH
+class ScriptCommand : public Command {
+ public:
+  ScriptCommand() : Command("script", "s") {}
+
+  ssize_t arity() const {
+    return -2;
+  }
+
+  int32_t firstkey() const {
+    return 0;
+  }
+
+  int32_t lastkey() const {
+    return 0;
+  }
+
+  int32_t keystep() const {
+    return 0;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const auto& args = sess->getArgs();
+    auto scriptMgr = sess->getServerEntry()->getScriptMgr();
+    auto subCmd = toLower(args[1]);
+
+    if (subCmd == "load" && args.size() == 3) {
+      auto sha = scriptMgr->loadScript(args[2]);
+      RET_IF_ERR_EXPECTED(sha);
+      return Command::fmtBulk(sha.value());
+    } else if (subCmd == "exists" && args.size() > 2) {
+      std::stringstream ss;
+      Command::fmtMultiBulkLen(ss, args.size() - 2);
+      for (size_t i = 2; i < args.size(); i++) {
+        Command::fmtLongLong(ss,
+                             scriptMgr->existsScript(toLower(args[i])) ? 1 : 0);
+      }
+      return ss.str();
+    } else if (subCmd == "flush" && args.size() == 2) {
+      scriptMgr->flushScripts();
+      return Command::fmtOK();
+    }
+    return {ErrorCodes::ERR_PARSEOPT,
+            "Unknown SCRIPT subcommand or wrong number of arguments for '" +
+              args[1] + "'"};
+  }
+} scriptCmd;
+
+}  // namespace tendisplus
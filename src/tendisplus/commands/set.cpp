@@ -218,25 +218,22 @@ class SMembersCommand : public Command {
 
     std::stringstream ss;
     Command::fmtMultiBulkLen(ss, ssize);
-    auto cursor = txn->createDataCursor();
     RecordKey fake = {
       expdb.value().chunkId, pCtx->getDbId(), RecordType::RT_SET_ELE, key, ""};
-    cursor->seek(fake.prefixPk());
+    auto cursor = txn->createPrefixCursor(fake.prefixPk());
+    RecordKeyView rk;
+    RecordValueView rvv;
     while (true) {
-      Expected<Record> exptRcd = cursor->next();
-      if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+      auto s = cursor->next(&rk, &rvv);
+      if (s.code() == ErrorCodes::ERR_EXHAUST) {
         break;
       }
-      if (!exptRcd.ok()) {
-        return exptRcd.status();
-      }
-      Record& rcd = exptRcd.value();
-      const RecordKey& rcdkey = rcd.getRecordKey();
-      if (rcdkey.prefixPk() != fake.prefixPk()) {
-        break;
+      if (!s.ok()) {
+        return s;
       }
       cnt += 1;
-      Command::fmtBulk(ss, rcdkey.getSecondaryKey());
+      auto sk = rk.getSecondaryKey();
+      Command::fmtBulk(ss, sk.data(), sk.size());
     }
     INVARIANT_D(cnt == ssize);
     if (cnt != ssize) {
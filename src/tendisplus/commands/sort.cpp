@@ -5,6 +5,8 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <map>
+#include <utility>
 #ifndef _WIN32
 #include <experimental/optional>
 #endif
@@ -12,7 +14,9 @@
 #include "tendisplus/commands/command.h"
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/time.h"
 #include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/quicklist.h"
 
 namespace tendisplus {
 constexpr uint64_t MAXSEQ = 9223372036854775807ULL;
@@ -70,49 +74,129 @@ class SortCommand : public Command {
     return std::make_pair(std::move(combine), std::move(field));
   }
 
-  Expected<std::string> getPatternResult(Session* sess,
-                                         const std::string& metaKey,
-                                         const std::string& fieldKey) {
+  struct PatternKey {
+    std::string priKey;
+    std::string field;
+  };
+
+  // Fetch the values of pattern keys (a string key, or a hash field if
+  // field is set) in batch. Lookups are deduplicated and grouped by
+  // store, then each store serves all its meta keys and all its hash
+  // fields with one multiget per round, inside one transaction.
+  // Missing, expired or wrong typed keys are left as ERR_NOTFOUND.
+  Status batchGetPatternResult(Session* sess,
+                               const std::vector<PatternKey>& keys,
+                               std::vector<Expected<std::string>>* result) {
     const auto& server = sess->getServerEntry();
     const auto& pCtx = sess->getCtx();
-    auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, metaKey);
-    if (!expdb.ok()) {
-      return expdb.status();
+    result->assign(keys.size(),
+                   Expected<std::string>(ErrorCodes::ERR_NOTFOUND, ""));
+
+    struct Lookup {
+      uint32_t chunkId;
+      const PatternKey* key;
+      std::vector<size_t> resultIdx;
+    };
+    struct StoreBatch {
+      PStore store;
+      std::vector<Lookup> lookups;
+    };
+    std::map<uint32_t, StoreBatch> batches;
+    std::map<std::pair<std::string, std::string>, std::pair<uint32_t, size_t>>
+      uniq;
+    for (size_t i = 0; i < keys.size(); i++) {
+      auto uk = std::make_pair(keys[i].priKey, keys[i].field);
+      auto it = uniq.find(uk);
+      if (it != uniq.end()) {
+        auto& lookup = batches[it->second.first].lookups[it->second.second];
+        lookup.resultIdx.push_back(i);
+        continue;
+      }
+      auto expdb =
+        server->getSegmentMgr()->getDbHasLocked(sess, keys[i].priKey);
+      if (!expdb.ok()) {
+        return expdb.status();
+      }
+      auto& batch = batches[expdb.value().dbId];
+      batch.store = expdb.value().store;
+      uniq.emplace(std::move(uk),
+                   std::make_pair(expdb.value().dbId, batch.lookups.size()));
+      batch.lookups.emplace_back(
+        Lookup{expdb.value().chunkId, &keys[i], std::vector<size_t>{i}});
     }
 
-    auto byRv =
-      Command::expireKeyIfNeeded(sess, metaKey, RecordType::RT_DATA_META);
-    // should handle NOT_FOUND and EXPIRED outsie
-    if (!byRv.ok()) {
-      return byRv.status();
-    }
-    auto byStore = expdb.value().store;
-    auto byExptxn = byStore->createTransaction(sess);
-    if (!byExptxn.ok()) {
-      return byExptxn.status();
-    }
-    std::unique_ptr<Transaction> ROTxn = std::move(byExptxn.value());
+    uint64_t currentTs = msSinceEpoch();
+    for (auto& kv : batches) {
+      auto& batch = kv.second;
+      auto ptxn = batch.store->createTransaction(sess);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+
+      std::vector<RecordKey> metaRks;
+      metaRks.reserve(batch.lookups.size());
+      for (const auto& l : batch.lookups) {
+        metaRks.emplace_back(l.chunkId,
+                             pCtx->getDbId(),
+                             RecordType::RT_DATA_META,
+                             l.key->priKey,
+                             "");
+      }
+      auto metas = batch.store->multiGetKV(metaRks, txn.get());
+
+      std::vector<RecordKey> eleRks;
+      std::vector<const Lookup*> eleLookups;
+      for (size_t i = 0; i < metas.size(); i++) {
+        const auto& l = batch.lookups[i];
+        if (metas[i].status().code() == ErrorCodes::ERR_NOTFOUND) {
+          ++server->getServerStat().keyspaceMisses;
+          continue;
+        }
+        if (!metas[i].ok()) {
+          return metas[i].status();
+        }
+        const RecordValue& rv = metas[i].value();
+        // expired keys are treated as missing, they are deleted later
+        // by the index manager or the next write.
+        uint64_t ttl = rv.getTtl();
+        if (!Command::noExpire() && ttl != 0 && currentTs >= ttl) {
+          continue;
+        }
+        ++server->getServerStat().keyspaceHits;
+        if (l.key->field.size() == 0) {
+          if (rv.getRecordType() == RecordType::RT_KV) {
+            for (auto idx : l.resultIdx) {
+              (*result)[idx] = rv.getValue();
+            }
+          }
+        } else if (rv.getRecordType() == RecordType::RT_HASH_META) {
+          eleRks.emplace_back(l.chunkId,
+                              pCtx->getDbId(),
+                              RecordType::RT_HASH_ELE,
+                              l.key->priKey,
+                              l.key->field);
+          eleLookups.push_back(&l);
+        }
+      }
+      if (eleRks.size() == 0) {
+        continue;
+      }
 
-    if (fieldKey.size() != 0) {
-      RecordKey hashRk(expdb.value().chunkId,
-                       pCtx->getDbId(),
-                       RecordType::RT_HASH_ELE,
-                       metaKey,
-                       fieldKey);
-      auto hashVal = byStore->getKV(hashRk, ROTxn.get());
-      if (!hashVal.ok()) {
-        return hashVal.status();
-      }
-      return std::move(hashVal.value().getValue());
-    } else {
-      RecordKey kvRk(
-        expdb.value().chunkId, pCtx->getDbId(), RecordType::RT_KV, metaKey, "");
-      auto kvVal = byStore->getKV(kvRk, ROTxn.get());
-      if (!kvVal.ok()) {
-        return kvVal.status();
+      auto eles = batch.store->multiGetKV(eleRks, txn.get());
+      for (size_t i = 0; i < eles.size(); i++) {
+        if (eles[i].status().code() == ErrorCodes::ERR_NOTFOUND) {
+          continue;
+        }
+        if (!eles[i].ok()) {
+          return eles[i].status();
+        }
+        for (auto idx : eleLookups[i]->resultIdx) {
+          (*result)[idx] = eles[i].value().getValue();
+        }
       }
-      return std::move(kvVal.value().getValue());
     }
+    return {ErrorCodes::ERR_OK, ""};
   }
 
 
@@ -263,7 +347,7 @@ class SortCommand : public Command {
 
     // get the length of the object
     ssize_t veclen(0);
-    uint64_t lHead(0), lTail(0);
+    std::unique_ptr<QuickList> ql(nullptr);
     std::unique_ptr<SkipList> sl(nullptr);
     switch (keyType) {
       case RecordType::RT_LIST_META: {
@@ -271,9 +355,12 @@ class SortCommand : public Command {
         if (!lm.ok()) {
           return lm.status();
         }
-        lHead = lm.value().getHead();
-        lTail = lm.value().getTail();
-        veclen = lTail - lHead;
+        ql = std::make_unique<QuickList>(metaRk.getChunkId(),
+                                         metaRk.getDbId(),
+                                         metaRk.getPrimaryKey(),
+                                         lm.value(),
+                                         kvstore);
+        veclen = ql->size();
         break;
       }
       case RecordType::RT_SET_META: {
@@ -333,39 +420,26 @@ class SortCommand : public Command {
     std::unique_ptr<Transaction> txn = std::move(ptxn.value());
 
     if (keyType == RecordType::RT_LIST_META) {
-      uint64_t pos(0), stop(0);
-      int32_t sign = 1;
-
+      // the elements in [lo, hi) are read with one scan, the ones with
+      // desc are from the tail
+      uint64_t len = ql->size();
+      uint64_t lo(0), hi(len);
       if (nosort) {
-        pos = lHead + start;
-        stop = lHead + end;
-        if (desc) {
-          pos = lTail - start;
-          stop = lTail - end;
-          sign = -1;
-        }
-      } else {
-        pos = lHead;
-        stop = lTail - 1;
-        if (desc) {
-          pos = lTail - 1;
-          stop = lHead;
-          sign = -1;
+        lo = hi = 0;
+        if (end >= start) {
+          lo = desc ? len - 1 - end : start;
+          hi = desc ? len - start : end + 1;
         }
       }
-
-      while (sign * static_cast<int64_t>(stop - pos) >= 0) {
-        RecordKey subRk(expdb.value().chunkId,
-                        pCtx->getDbId(),
-                        RecordType::RT_LIST_ELE,
-                        key,
-                        std::to_string(pos));
-        Expected<RecordValue> expRv = kvstore->getKV(subRk, txn.get());
-        if (!expRv.ok()) {
-          return expRv.status();
-        }
-        records.emplace_back(Element{expRv.value().getValue(), 0});
-        pos += sign;
+      auto values = ql->range(lo, hi, txn.get());
+      if (!values.ok()) {
+        return values.status();
+      }
+      if (desc) {
+        std::reverse(values.value().begin(), values.value().end());
+      }
+      for (auto& v : values.value()) {
+        records.emplace_back(Element{std::move(v), 0});
       }
     } else if (keyType == RecordType::RT_SET_META) {
       auto cursor = txn->createDataCursor();
@@ -406,6 +480,13 @@ class SortCommand : public Command {
     } else {
       INVARIANT_D(0);
     }
+    if ((keyType == RecordType::RT_ZSET_META ||
+         keyType == RecordType::RT_LIST_META) &&
+        nosort) {
+      // only the range is read, the output starts from its first one
+      end -= start;
+      start = 0;
+    }
 
     // release key lock.
     // older expdb, pstore, txn should not been used till then.
@@ -445,6 +526,26 @@ class SortCommand : public Command {
       if (!nosort) {
         const auto& op = ops[0];
         const auto& priKeylist = op.priKey;
+
+        // gather all BY lookups first, and fetch them in batch
+        std::vector<PatternKey> byKeys;
+        std::vector<size_t> byIdx(records.size());
+        if (sortby) {
+          for (size_t i = 0; i < records.size(); i++) {
+            // skip * not found and "BY #"
+            if (priKeylist[i].size() == 0 || priKeylist[i] == records[i].key) {
+              continue;
+            }
+            byIdx[i] = byKeys.size();
+            byKeys.emplace_back(PatternKey{priKeylist[i], op.field});
+          }
+        }
+        std::vector<Expected<std::string>> byVals;
+        auto s = batchGetPatternResult(sess, byKeys, &byVals);
+        if (!s.ok()) {
+          return s;
+        }
+
         std::string nval;
         for (size_t i = 0; i < records.size(); i++) {
           auto& ele = records[i];
@@ -460,14 +561,9 @@ class SortCommand : public Command {
               // set subkey itself as value.
               nval = ele.key;
             } else {
-              const auto& field = op.field;
-              auto expVal = getPatternResult(sess, priKeylist[i], field);
-              if (expVal.status().code() == ErrorCodes::ERR_NOTFOUND ||
-                  expVal.status().code() == ErrorCodes::ERR_EXPIRED) {
-                continue;
-              }
+              auto& expVal = byVals[byIdx[i]];
               if (!expVal.ok()) {
-                return expVal.status();
+                continue;
               }
               nval = std::move(expVal.value());
             }
@@ -488,26 +584,35 @@ class SortCommand : public Command {
         }
       }
 
+      ssize_t sortStart(0), sortEnd(records.size());
+      if (start != 0 || end != 0) {
+        sortStart = start;
+        sortEnd = end + 1;
+      }
+
       if (!nosort) {
-        std::sort(records.begin(),
-                  records.end(),
-                  [&sortby, &desc, &alpha](const Element& a, const Element& b) {
-                    bool ret(true);
-                    if (alpha) {
-                      if (sortby) {
-                        ret = a.sortBy < b.sortBy;
-                      } else {
-                        ret = a.key < b.key;
-                      }
-                    } else {
-                      if (a.score == b.score) {
-                        ret = a.key < b.key;
-                      } else {
-                        ret = a.score < b.score;
-                      }
-                    }
-                    return desc ? !ret : ret;
-                  });
+        auto less = [&sortby, &alpha](const Element& a, const Element& b) {
+          if (alpha) {
+            if (sortby) {
+              return a.sortBy < b.sortBy;
+            }
+            return a.key < b.key;
+          }
+          if (a.score == b.score) {
+            return a.key < b.key;
+          }
+          return a.score < b.score;
+        };
+        auto cmp = [&less, &desc](const Element& a, const Element& b) {
+          return desc ? less(b, a) : less(a, b);
+        };
+        // with LIMIT only the first sortEnd elements need to be ordered
+        if (sortEnd >= 0 && static_cast<size_t>(sortEnd) < records.size()) {
+          std::partial_sort(
+            records.begin(), records.begin() + sortEnd, records.end(), cmp);
+        } else {
+          std::sort(records.begin(), records.end(), cmp);
+        }
       }
 
       // ops has a minimum size 1.
@@ -516,11 +621,28 @@ class SortCommand : public Command {
       if (ops.size() == 1) {
         ops.emplace_back(SortOp{"", ""});
       }
-      ssize_t sortStart(0), sortEnd(records.size());
-      if (start != 0 || end != 0) {
-        sortStart = start;
-        sortEnd = end + 1;
+      // gather the GET lookups of the returned range, fetch them in batch
+      std::vector<PatternKey> getKeys;
+      for (ssize_t i = sortStart; i < sortEnd; i++) {
+        for (size_t j = 1; j < ops.size(); j++) {
+          const auto& op = ops[j];
+          if (op.cmd == "") {
+            continue;
+          }
+          const auto& pri = op.priKey[records[i].uniqueId];
+          if (pri.size() == 0 || pri == records[i].key) {
+            continue;
+          }
+          getKeys.emplace_back(PatternKey{pri, op.field});
+        }
+      }
+      std::vector<Expected<std::string>> getVals;
+      auto s = batchGetPatternResult(sess, getKeys, &getVals);
+      if (!s.ok()) {
+        return s;
       }
+
+      size_t getIdx = 0;
       for (ssize_t i = sortStart; i < sortEnd; i++) {
         for (size_t j = 1; j < ops.size(); j++) {
           const auto& op = ops[j];
@@ -536,16 +658,12 @@ class SortCommand : public Command {
           } else if (priKeylist[uniqueId] == records[i].key) {
             result.emplace_back(records[i].key);
           } else {
-            const auto& field = op.field;
-            auto expVal = getPatternResult(sess, priKeylist[uniqueId], field);
-            if (expVal.status().code() == ErrorCodes::ERR_NOTFOUND ||
-                expVal.status().code() == ErrorCodes::ERR_EXPIRED) {
-              result.emplace_back("");
-            }
+            auto& expVal = getVals[getIdx++];
             if (!expVal.ok()) {
-              return expVal.status();
+              result.emplace_back("");
+            } else {
+              result.emplace_back(std::move(expVal.value()));
             }
-            result.emplace_back(expVal.value());
           }
         }
       }
@@ -577,26 +695,18 @@ class SortCommand : public Command {
                        args[storeKeyIndex],
                        "");
       ListMetaValue lm(INITSEQ, INITSEQ);
-      uint64_t head = lm.getHead();
-      uint64_t idx = head++;
-      for (const auto& x : result) {
-        RecordKey subRk(metaRk.getChunkId(),
+      QuickList storeQl(metaRk.getChunkId(),
                         metaRk.getDbId(),
-                        RecordType::RT_LIST_ELE,
                         metaRk.getPrimaryKey(),
-                        std::to_string(idx++));
-        RecordValue subRv(x, RecordType::RT_LIST_ELE, -1);
-        Status s = addStore->setKV(subRk, subRv, addTxn.get());
-        if (!s.ok()) {
-          return s;
-        }
+                        lm,
+                        addStore);
+      Status s = storeQl.push(result, false, addTxn.get());
+      if (!s.ok()) {
+        return s;
       }
-      lm.setTail(idx);
-      Status s = addStore->setKV(metaRk,
-                                 RecordValue(lm.encode(),
-                                             RecordType::RT_LIST_META,
-                                             pCtx->getVersionEP()),
-                                 addTxn.get());
+      s = storeQl.save(addTxn.get(),
+                       {ErrorCodes::ERR_NOTFOUND, ""},
+                       pCtx->getVersionEP());
       if (!s.ok()) {
         return s;
       }
@@ -605,6 +715,8 @@ class SortCommand : public Command {
       if (!expCmt.ok()) {
         return expCmt.status();
       }
+      server->getBlockMgr()->signalKeyReady(
+        pCtx->getDbId(), args[storeKeyIndex], result.size());
       return Command::fmtLongLong(result.size());
     }
 
@@ -0,0 +1,1775 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tendisplus/commands/command.h"
+#include "tendisplus/storage/varint.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/string.h"
+#include "tendisplus/utils/time.h"
+
+namespace tendisplus {
+
+/*
+A stream is a RT_STREAM_META record, its entries are RT_STREAM_ELE records
+keyed by the encoded StreamId, so the entries are iterated in id order.
+The consumer groups are RT_STREAM_CG records, the secondary key starts with
+a tag:
+'G'|LENSTR(GROUP)            -> LAST_DELIVERED_ID|PENDING_COUNT
+'C'|LENSTR(GROUP)|CONSUMER   -> SEEN_TIME
+'P'|LENSTR(GROUP)|ID         -> LENSTR(CONSUMER)|DELIVERY_TIME|DELIVERY_COUNT
+The group name is length prefixed, so the pending entries of a group are
+in id order and never mixed with the ones of another group.
+*/
+
+const StreamId kStreamMinId{0, 0};
+const StreamId kStreamMaxId{std::numeric_limits<uint64_t>::max(),
+                            std::numeric_limits<uint64_t>::max()};
+const char* kInvalidStreamIdErr =
+  "Invalid stream ID specified as stream command argument";
+
+Expected<uint64_t> parseStreamIdPart(const std::string& s) {
+  if (s.empty() || s.size() > 20 ||
+      !std::all_of(s.begin(), s.end(), ::isdigit)) {
+    return {ErrorCodes::ERR_PARSEOPT, kInvalidStreamIdErr};
+  }
+  auto v = tendisplus::stoull(s);
+  if (!v.ok()) {
+    return {ErrorCodes::ERR_PARSEOPT, kInvalidStreamIdErr};
+  }
+  return v;
+}
+
+// <ms>-<seq>, or <ms> alone which takes missingSeq as seq. "-" and "+"
+// are the smallest and the largest ids.
+Expected<StreamId> parseStreamId(const std::string& s, uint64_t missingSeq) {
+  if (s == "-") {
+    return kStreamMinId;
+  } else if (s == "+") {
+    return kStreamMaxId;
+  }
+  auto pos = s.find('-');
+  auto ms = parseStreamIdPart(s.substr(0, pos));
+  RET_IF_ERR_EXPECTED(ms);
+  if (pos == std::string::npos) {
+    return StreamId{ms.value(), missingSeq};
+  }
+  auto seq = parseStreamIdPart(s.substr(pos + 1));
+  RET_IF_ERR_EXPECTED(seq);
+  return StreamId{ms.value(), seq.value()};
+}
+
+// the smallest id after id, false if id is the largest one
+bool streamIncrId(StreamId* id) {
+  if (id->seq != std::numeric_limits<uint64_t>::max()) {
+    id->seq++;
+  } else if (id->ms != std::numeric_limits<uint64_t>::max()) {
+    id->ms++;
+    id->seq = 0;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool streamDecrId(StreamId* id) {
+  if (id->seq != 0) {
+    id->seq--;
+  } else if (id->ms != 0) {
+    id->ms--;
+    id->seq = std::numeric_limits<uint64_t>::max();
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// the bound of XRANGE/XREVRANGE/XPENDING, a "(" prefix excludes the id
+Expected<StreamId> parseStreamRangeId(const std::string& s, bool isStart) {
+  bool exclusive = s.size() > 1 && s[0] == '(';
+  auto id = parseStreamId(exclusive ? s.substr(1) : s,
+                          isStart ? 0 : std::numeric_limits<uint64_t>::max());
+  RET_IF_ERR_EXPECTED(id);
+  if (exclusive) {
+    StreamId v = id.value();
+    if (!(isStart ? streamIncrId(&v) : streamDecrId(&v))) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              isStart ? "invalid start ID for the interval"
+                      : "invalid end ID for the interval"};
+    }
+    return v;
+  }
+  return id;
+}
+
+std::string encodeStreamFields(const std::vector<std::string>& args,
+                               size_t begin) {
+  std::string value = varintEncodeStr(args.size() - begin);
+  for (size_t i = begin; i < args.size(); i++) {
+    value.append(lenStrEncode(args[i]));
+  }
+  return value;
+}
+
+Expected<std::vector<std::string>> decodeStreamFields(const std::string& v) {
+  auto num = varintDecodeFwd(reinterpret_cast<const uint8_t*>(v.c_str()),
+                             v.size());
+  RET_IF_ERR_EXPECTED(num);
+  size_t offset = num.value().second;
+  std::vector<std::string> fields;
+  fields.reserve(num.value().first);
+  for (uint64_t i = 0; i < num.value().first; i++) {
+    auto field = lenStrDecode(v.c_str() + offset, v.size() - offset);
+    RET_IF_ERR_EXPECTED(field);
+    offset += field.value().second;
+    fields.emplace_back(std::move(field.value().first));
+  }
+  return fields;
+}
+
+// an entry in the reply, [id, [field, value, ...]], or [id, nil] for an
+// entry deleted which has an empty value
+Status fmtStreamEntry(std::stringstream& ss, const Record& rcd) {
+  auto id = StreamId::decode(rcd.getRecordKey().getSecondaryKey());
+  RET_IF_ERR_EXPECTED(id);
+  if (rcd.getRecordValue().getValue().empty()) {
+    Command::fmtMultiBulkLen(ss, 2);
+    Command::fmtBulk(ss, id.value().toString());
+    Command::fmtNull(ss);
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  auto fields = decodeStreamFields(rcd.getRecordValue().getValue());
+  RET_IF_ERR_EXPECTED(fields);
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, id.value().toString());
+  Command::fmtMultiBulkLen(ss, fields.value().size());
+  for (const auto& v : fields.value()) {
+    Command::fmtBulk(ss, v);
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status fmtStreamEntries(std::stringstream& ss,
+                        const std::vector<Record>& entries) {
+  Command::fmtMultiBulkLen(ss, entries.size());
+  for (const auto& rcd : entries) {
+    auto s = fmtStreamEntry(ss, rcd);
+    RET_IF_ERR(s);
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<StreamMetaValue> getStreamMeta(const Expected<RecordValue>& rv) {
+  if (!rv.ok()) {
+    // an empty stream for the missing key
+    return StreamMetaValue();
+  }
+  return StreamMetaValue::decode(rv.value().getValue());
+}
+
+Status setStreamMeta(Session* sess,
+                     PStore kvstore,
+                     Transaction* txn,
+                     const RecordKey& metaRk,
+                     const Expected<RecordValue>& rv,
+                     const StreamMetaValue& meta) {
+  RecordValue metaValue(meta.encode(),
+                        RecordType::RT_STREAM_META,
+                        sess->getCtx()->getVersionEP(),
+                        rv.ok() ? rv.value().getTtl() : 0,
+                        rv);
+  return kvstore->setKV(metaRk, metaValue, txn);
+}
+
+RecordKey streamEleKey(const RecordKey& metaRk, const StreamId& id) {
+  return RecordKey(metaRk.getChunkId(),
+                   metaRk.getDbId(),
+                   RecordType::RT_STREAM_ELE,
+                   metaRk.getPrimaryKey(),
+                   id.encode());
+}
+
+std::string streamElePrefix(const RecordKey& metaRk) {
+  return streamEleKey(metaRk, kStreamMinId).prefixPk();
+}
+
+// the entries in [start, end] in id order, at most count of them
+Expected<std::vector<Record>> streamRange(Transaction* txn,
+                                          const RecordKey& metaRk,
+                                          const StreamId& start,
+                                          const StreamId& end,
+                                          uint64_t count) {
+  std::vector<Record> result;
+  std::string prefix = streamElePrefix(metaRk);
+  auto cursor = txn->createDataCursor();
+  cursor->seek(prefix + start.encode());
+  while (result.size() < count) {
+    Expected<Record> exptRcd = cursor->next();
+    if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    RET_IF_ERR_EXPECTED(exptRcd);
+    const RecordKey& rcdKey = exptRcd.value().getRecordKey();
+    if (rcdKey.prefixPk() != prefix) {
+      break;
+    }
+    auto id = StreamId::decode(rcdKey.getSecondaryKey());
+    RET_IF_ERR_EXPECTED(id);
+    if (end < id.value()) {
+      break;
+    }
+    result.emplace_back(std::move(exptRcd.value()));
+  }
+  return result;
+}
+
+// the entries in [start, end] in reversed id order, at most count of them
+Expected<std::vector<Record>> streamRevRange(Transaction* txn,
+                                             const RecordKey& metaRk,
+                                             const StreamId& start,
+                                             const StreamId& end,
+                                             uint64_t count) {
+  std::vector<Record> result;
+  std::string prefix = streamElePrefix(metaRk);
+  auto cursor = txn->createDataCursor();
+  cursor->seekForPrev(streamEleKey(metaRk, end).encode());
+  while (result.size() < count) {
+    Expected<Record> exptRcd = cursor->next();
+    if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    RET_IF_ERR_EXPECTED(exptRcd);
+    const RecordKey& rcdKey = exptRcd.value().getRecordKey();
+    if (rcdKey.prefixPk() != prefix) {
+      break;
+    }
+    auto id = StreamId::decode(rcdKey.getSecondaryKey());
+    RET_IF_ERR_EXPECTED(id);
+    if (id.value() < start) {
+      break;
+    }
+    result.emplace_back(std::move(exptRcd.value()));
+    // back to the record, then the one before it
+    auto s = cursor->prev();
+    RET_IF_ERR(s);
+    s = cursor->prev();
+    RET_IF_ERR(s);
+  }
+  return result;
+}
+
+struct StreamTrimArgs {
+  enum class Strategy { NONE, MAXLEN, MINID };
+  Strategy strategy = Strategy::NONE;
+  uint64_t maxLen = 0;
+  StreamId minId{0, 0};
+  // 0 for no limit
+  uint64_t limit = 0;
+};
+
+// MAXLEN|MINID [=|~] threshold [LIMIT count], starting at args[*pos].
+// "~" trims the stream exactly, it is allowed to.
+Status parseStreamTrimArgs(const std::vector<std::string>& args,
+                           size_t* pos,
+                           StreamTrimArgs* trim) {
+  size_t i = *pos;
+  auto opt = toLower(args[i]);
+  if (trim->strategy != StreamTrimArgs::Strategy::NONE) {
+    return {ErrorCodes::ERR_PARSEOPT, ""};
+  }
+  i++;
+  bool approx = false;
+  if (i < args.size() && (args[i] == "~" || args[i] == "=")) {
+    approx = args[i] == "~";
+    i++;
+  }
+  if (i >= args.size()) {
+    return {ErrorCodes::ERR_PARSEOPT, ""};
+  }
+  if (opt == "maxlen") {
+    auto maxLen = tendisplus::stoll(args[i]);
+    if (!maxLen.ok()) {
+      return {ErrorCodes::ERR_INTERGER, ""};
+    }
+    if (maxLen.value() < 0) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "The MAXLEN argument must be >= 0."};
+    }
+    trim->strategy = StreamTrimArgs::Strategy::MAXLEN;
+    trim->maxLen = maxLen.value();
+  } else {
+    auto minId = parseStreamId(args[i], 0);
+    RET_IF_ERR_EXPECTED(minId);
+    trim->strategy = StreamTrimArgs::Strategy::MINID;
+    trim->minId = minId.value();
+  }
+  i++;
+  if (i + 1 < args.size() && toLower(args[i]) == "limit") {
+    if (!approx) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "syntax error, LIMIT cannot be used without the special ~ "
+              "option"};
+    }
+    auto limit = tendisplus::stoll(args[i + 1]);
+    if (!limit.ok() || limit.value() < 0) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "The LIMIT argument must be >= 0."};
+    }
+    trim->limit = limit.value();
+    i += 2;
+  }
+  *pos = i;
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// delete the oldest entries as trim says, returns the deleted count
+Expected<uint64_t> streamTrim(PStore kvstore,
+                              Transaction* txn,
+                              const RecordKey& metaRk,
+                              const StreamTrimArgs& trim,
+                              StreamMetaValue* meta) {
+  uint64_t toDel = 0;
+  StreamId end = kStreamMaxId;
+  if (trim.strategy == StreamTrimArgs::Strategy::MAXLEN) {
+    if (meta->getCount() <= trim.maxLen) {
+      return 0;
+    }
+    toDel = meta->getCount() - trim.maxLen;
+  } else if (trim.strategy == StreamTrimArgs::Strategy::MINID) {
+    toDel = meta->getCount();
+    end = trim.minId;
+    if (!streamDecrId(&end)) {
+      return 0;
+    }
+  } else {
+    return 0;
+  }
+  if (trim.limit && toDel > trim.limit) {
+    toDel = trim.limit;
+  }
+
+  auto entries = streamRange(txn, metaRk, kStreamMinId, end, toDel);
+  RET_IF_ERR_EXPECTED(entries);
+  for (const auto& rcd : entries.value()) {
+    auto s = kvstore->delKV(rcd.getRecordKey(), txn);
+    RET_IF_ERR(s);
+  }
+  meta->setCount(meta->getCount() - entries.value().size());
+  return entries.value().size();
+}
+
+RecordKey streamCgKey(const RecordKey& metaRk, const std::string& sk) {
+  return RecordKey(metaRk.getChunkId(),
+                   metaRk.getDbId(),
+                   RecordType::RT_STREAM_CG,
+                   metaRk.getPrimaryKey(),
+                   sk);
+}
+
+std::string streamGroupSk(const std::string& group) {
+  return "G" + lenStrEncode(group);
+}
+
+std::string streamConsumerSk(const std::string& group,
+                             const std::string& consumer) {
+  return "C" + lenStrEncode(group) + consumer;
+}
+
+std::string streamPendingSk(const std::string& group, const StreamId& id) {
+  return "P" + lenStrEncode(group) + id.encode();
+}
+
+struct StreamGroup {
+  StreamId lastId;
+  uint64_t pending;
+
+  std::string encode() const {
+    return lastId.encode() + varintEncodeStr(pending);
+  }
+
+  static Expected<StreamGroup> decode(const std::string& v) {
+    if (v.size() < StreamId::ENCODED_SIZE) {
+      return {ErrorCodes::ERR_DECODE, "invalid stream group"};
+    }
+    auto id = StreamId::decode(v.substr(0, StreamId::ENCODED_SIZE));
+    RET_IF_ERR_EXPECTED(id);
+    auto pending = varintDecodeFwd(
+      reinterpret_cast<const uint8_t*>(v.c_str()) + StreamId::ENCODED_SIZE,
+      v.size() - StreamId::ENCODED_SIZE);
+    RET_IF_ERR_EXPECTED(pending);
+    return StreamGroup{id.value(), pending.value().first};
+  }
+};
+
+struct StreamPending {
+  std::string consumer;
+  uint64_t deliveryTime;
+  uint64_t deliveryCount;
+
+  std::string encode() const {
+    return lenStrEncode(consumer) + varintEncodeStr(deliveryTime) +
+      varintEncodeStr(deliveryCount);
+  }
+
+  static Expected<StreamPending> decode(const std::string& v) {
+    auto consumer = lenStrDecode(v);
+    RET_IF_ERR_EXPECTED(consumer);
+    size_t offset = consumer.value().second;
+    auto p = reinterpret_cast<const uint8_t*>(v.c_str());
+    auto time = varintDecodeFwd(p + offset, v.size() - offset);
+    RET_IF_ERR_EXPECTED(time);
+    offset += time.value().second;
+    auto count = varintDecodeFwd(p + offset, v.size() - offset);
+    RET_IF_ERR_EXPECTED(count);
+    return StreamPending{std::move(consumer.value().first),
+                         time.value().first,
+                         count.value().first};
+  }
+};
+
+Expected<StreamGroup> getStreamGroup(PStore kvstore,
+                                     Transaction* txn,
+                                     const RecordKey& metaRk,
+                                     const std::string& group) {
+  auto rv =
+    kvstore->getKV(streamCgKey(metaRk, streamGroupSk(group)), txn);
+  RET_IF_ERR_EXPECTED(rv);
+  return StreamGroup::decode(rv.value().getValue());
+}
+
+Status setStreamGroup(PStore kvstore,
+                      Transaction* txn,
+                      const RecordKey& metaRk,
+                      const std::string& group,
+                      const StreamGroup& cg) {
+  return kvstore->setKV(streamCgKey(metaRk, streamGroupSk(group)),
+                        RecordValue(cg.encode(), RecordType::RT_STREAM_CG, -1),
+                        txn);
+}
+
+// create the consumer if not exists, or refresh its seen time.
+// returns true if it is created.
+Expected<bool> touchStreamConsumer(PStore kvstore,
+                                   Transaction* txn,
+                                   const RecordKey& metaRk,
+                                   const std::string& group,
+                                   const std::string& consumer) {
+  RecordKey rk = streamCgKey(metaRk, streamConsumerSk(group, consumer));
+  auto rv = kvstore->getKV(rk, txn);
+  if (!rv.ok() && rv.status().code() != ErrorCodes::ERR_NOTFOUND) {
+    return rv.status();
+  }
+  auto s = kvstore->setKV(
+    rk,
+    RecordValue(
+      varintEncodeStr(msSinceEpoch()), RecordType::RT_STREAM_CG, -1),
+    txn);
+  RET_IF_ERR(s);
+  return !rv.ok();
+}
+
+// the RT_STREAM_CG records of the group with the secondary key prefix
+// tag|LENSTR(group)|from, passed to fn(record, rest of the secondary
+// key) until it returns false
+template <typename Fn>
+Status scanStreamGroup(Transaction* txn,
+                       const RecordKey& metaRk,
+                       char tag,
+                       const std::string& group,
+                       const std::string& from,
+                       Fn fn) {
+  std::string tagPrefix = std::string(1, tag) + lenStrEncode(group);
+  std::string prefix = streamCgKey(metaRk, "").prefixPk();
+  auto cursor = txn->createDataCursor();
+  cursor->seek(prefix + tagPrefix + from);
+  while (true) {
+    Expected<Record> exptRcd = cursor->next();
+    if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    RET_IF_ERR_EXPECTED(exptRcd);
+    const RecordKey& rcdKey = exptRcd.value().getRecordKey();
+    const std::string& sk = rcdKey.getSecondaryKey();
+    if (rcdKey.prefixPk() != prefix ||
+        sk.compare(0, tagPrefix.size(), tagPrefix) != 0) {
+      break;
+    }
+    if (!fn(exptRcd.value(), sk.substr(tagPrefix.size()))) {
+      break;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status noGroupErr(const std::string& key, const std::string& group) {
+  return {ErrorCodes::ERR_PARSEOPT,
+          "-NOGROUP No such key '" + key + "' or consumer group '" + group +
+            "'\r\n"};
+}
+
+Expected<RecordValue> getStreamKey(Session* sess, const std::string& key) {
+  Expected<RecordValue> rv =
+    Command::expireKeyIfNeeded(sess, key, RecordType::RT_STREAM_META);
+  if (rv.status().code() == ErrorCodes::ERR_EXPIRED) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+  return rv;
+}
+
+// XADD key [NOMKSTREAM] [MAXLEN|MINID [=|~] threshold [LIMIT count]]
+//   *|id field value [field value ...]
+class XAddCommand : public Command {
+ public:
+  XAddCommand() : Command("xadd", "wmFR") {}
+
+  ssize_t arity() const {
+    return -5;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return 1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    const std::string& key = args[1];
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+
+    bool noMkStream = false;
+    StreamTrimArgs trim;
+    size_t i = 2;
+    for (; i < args.size(); i++) {
+      auto opt = toLower(args[i]);
+      if (opt == "nomkstream") {
+        noMkStream = true;
+      } else if (opt == "maxlen" || opt == "minid") {
+        auto s = parseStreamTrimArgs(args, &i, &trim);
+        RET_IF_ERR(s);
+        i--;
+      } else {
+        break;
+      }
+    }
+    if (i + 3 > args.size() || (args.size() - i - 1) % 2 != 0) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "wrong number of arguments for 'xadd' command"};
+    }
+    const std::string& idArg = args[i];
+
+    auto server = sess->getServerEntry();
+    auto expdb = server->getSegmentMgr()->getDbWithKeyLock(
+      sess, key, mgl::LockMode::LOCK_X);
+    RET_IF_ERR_EXPECTED(expdb);
+    auto rv = getStreamKey(sess, key);
+    if (!rv.ok() && rv.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return rv.status();
+    }
+    if (!rv.ok() && noMkStream) {
+      return Command::fmtNull();
+    }
+    auto emeta = getStreamMeta(rv);
+    RET_IF_ERR_EXPECTED(emeta);
+    StreamMetaValue meta = std::move(emeta.value());
+    const StreamId& last = meta.getLastId();
+
+    StreamId id;
+    if (idArg == "*" ||
+        (idArg.size() > 2 && idArg.compare(idArg.size() - 2, 2, "-*") == 0)) {
+      if (idArg == "*") {
+        id = StreamId{msSinceEpoch(), 0};
+      } else {
+        auto ms = parseStreamIdPart(idArg.substr(0, idArg.size() - 2));
+        RET_IF_ERR_EXPECTED(ms);
+        id = StreamId{ms.value(), 0};
+      }
+      // the seq is generated, and for "*", the clock may go back
+      if (id <= last) {
+        if (idArg != "*" && id.ms < last.ms) {
+          return {ErrorCodes::ERR_PARSEOPT,
+                  "The ID specified in XADD is equal or smaller than the "
+                  "target stream top item"};
+        }
+        id = last;
+        if (!streamIncrId(&id)) {
+          return {ErrorCodes::ERR_PARSEOPT,
+                  "The stream has exhausted the last possible ID, unable "
+                  "to add more items"};
+        }
+      }
+    } else {
+      auto eid = parseStreamId(idArg, 0);
+      RET_IF_ERR_EXPECTED(eid);
+      id = eid.value();
+    }
+    if (id == kStreamMinId) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "The ID specified in XADD must be greater than 0-0"};
+    }
+    if (id <= last) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "The ID specified in XADD is equal or smaller than the target "
+              "stream top item"};
+    }
+
+    PStore kvstore = expdb.value().store;
+    RecordKey metaRk(expdb.value().chunkId,
+                     pCtx->getDbId(),
+                     RecordType::RT_STREAM_META,
+                     key,
+                     "");
+    auto ptxn = kvstore->createTransaction(sess);
+    RET_IF_ERR_EXPECTED(ptxn);
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+
+    auto s = kvstore->setKV(
+      streamEleKey(metaRk, id),
+      RecordValue(
+        encodeStreamFields(args, i + 1), RecordType::RT_STREAM_ELE, -1),
+      txn.get());
+    RET_IF_ERR(s);
+    meta.setCount(meta.getCount() + 1);
+    meta.setLastId(id);
+    auto trimmed = streamTrim(kvstore, txn.get(), metaRk, trim, &meta);
+    RET_IF_ERR_EXPECTED(trimmed);
+    s = setStreamMeta(sess, kvstore, txn.get(), metaRk, rv, meta);
+    RET_IF_ERR(s);
+    auto eCommit = txn->commit();
+    RET_IF_ERR_EXPECTED(eCommit);
+
+    // every XREAD waiting on the key may read the new entry
+    server->getBlockMgr()->signalKeyReady(
+      pCtx->getDbId(), key, std::numeric_limits<size_t>::max());
+    return Command::fmtBulk(id.toString());
+  }
+} xaddCmd;
+
+class XLenCommand : public Command {
+ public:
+  XLenCommand() : Command("xlen", "rF") {}
+
+  ssize_t arity() const {
+    return 2;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return 1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::string& key = sess->getArgs()[1];
+    auto rv = getStreamKey(sess, key);
+    if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return Command::fmtZero();
+    }
+    RET_IF_ERR_EXPECTED(rv);
+    auto meta = StreamMetaValue::decode(rv.value().getValue());
+    RET_IF_ERR_EXPECTED(meta);
+    return Command::fmtLongLong(meta.value().getCount());
+  }
+} xlenCmd;
+
+// XRANGE key start end [COUNT count]
+// XREVRANGE key end start [COUNT count]
+class XRangeGenericCommand : public Command {
+ public:
+  explicit XRangeGenericCommand(const std::string& name)
+    : Command(name, "r"), _rev(name == "xrevrange") {}
+
+  ssize_t arity() const {
+    return -4;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return 1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    const std::string& key = args[1];
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+
+    auto start = parseStreamRangeId(_rev ? args[3] : args[2], true);
+    RET_IF_ERR_EXPECTED(start);
+    auto end = parseStreamRangeId(_rev ? args[2] : args[3], false);
+    RET_IF_ERR_EXPECTED(end);
+    uint64_t count = UINT64_MAX;
+    if (args.size() == 6 && toLower(args[4]) == "count") {
+      auto ecount = tendisplus::stoll(args[5]);
+      if (!ecount.ok()) {
+        return {ErrorCodes::ERR_INTERGER, ""};
+      }
+      count = std::max(ecount.value(), static_cast<int64_t>(0));
+    } else if (args.size() != 4) {
+      return {ErrorCodes::ERR_PARSEOPT, ""};
+    }
+
+    auto server = sess->getServerEntry();
+    auto expdb = server->getSegmentMgr()->getDbWithKeyLock(
+      sess, key, Command::RdLock());
+    RET_IF_ERR_EXPECTED(expdb);
+    auto rv = getStreamKey(sess, key);
+    if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return Command::fmtZeroBulkLen();
+    }
+    RET_IF_ERR_EXPECTED(rv);
+    if (count == 0 || end.value() < start.value()) {
+      return Command::fmtZeroBulkLen();
+    }
+
+    PStore kvstore = expdb.value().store;
+    RecordKey metaRk(expdb.value().chunkId,
+                     pCtx->getDbId(),
+                     RecordType::RT_STREAM_META,
+                     key,
+                     "");
+    auto ptxn = kvstore->createTransaction(sess);
+    RET_IF_ERR_EXPECTED(ptxn);
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    auto entries = _rev
+      ? streamRevRange(txn.get(), metaRk, start.value(), end.value(), count)
+      : streamRange(txn.get(), metaRk, start.value(), end.value(), count);
+    RET_IF_ERR_EXPECTED(entries);
+
+    std::stringstream ss;
+    auto s = fmtStreamEntries(ss, entries.value());
+    RET_IF_ERR(s);
+    return ss.str();
+  }
+
+ private:
+  bool _rev;
+};
+
+XRangeGenericCommand xrangeCmd("xrange");
+XRangeGenericCommand xrevrangeCmd("xrevrange");
+
+class XDelCommand : public Command {
+ public:
+  XDelCommand() : Command("xdel", "wF") {}
+
+  ssize_t arity() const {
+    return -3;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return 1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    const std::string& key = args[1];
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+
+    std::vector<StreamId> ids;
+    for (size_t i = 2; i < args.size(); i++) {
+      auto id = parseStreamId(args[i], 0);
+      RET_IF_ERR_EXPECTED(id);
+      ids.push_back(id.value());
+    }
+
+    auto server = sess->getServerEntry();
+    auto expdb = server->getSegmentMgr()->getDbWithKeyLock(
+      sess, key, mgl::LockMode::LOCK_X);
+    RET_IF_ERR_EXPECTED(expdb);
+    auto rv = getStreamKey(sess, key);
+    if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return Command::fmtZero();
+    }
+    RET_IF_ERR_EXPECTED(rv);
+    auto meta = StreamMetaValue::decode(rv.value().getValue());
+    RET_IF_ERR_EXPECTED(meta);
+
+    PStore kvstore = expdb.value().store;
+    RecordKey metaRk(expdb.value().chunkId,
+                     pCtx->getDbId(),
+                     RecordType::RT_STREAM_META,
+                     key,
+                     "");
+    auto ptxn = kvstore->createTransaction(sess);
+    RET_IF_ERR_EXPECTED(ptxn);
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    uint64_t deleted = 0;
+    for (const auto& id : ids) {
+      RecordKey eleRk = streamEleKey(metaRk, id);
+      auto ele = kvstore->getKV(eleRk, txn.get());
+      if (ele.status().code() == ErrorCodes::ERR_NOTFOUND) {
+        continue;
+      }
+      RET_IF_ERR_EXPECTED(ele);
+      auto s = kvstore->delKV(eleRk, txn.get());
+      RET_IF_ERR(s);
+      deleted++;
+    }
+    if (deleted == 0) {
+      return Command::fmtZero();
+    }
+    // an empty stream is kept, like redis, with its last id
+    meta.value().setCount(meta.value().getCount() - deleted);
+    auto s = setStreamMeta(sess, kvstore, txn.get(), metaRk, rv, meta.value());
+    RET_IF_ERR(s);
+    auto eCommit = txn->commit();
+    RET_IF_ERR_EXPECTED(eCommit);
+    return Command::fmtLongLong(deleted);
+  }
+} xdelCmd;
+
+// XTRIM key MAXLEN|MINID [=|~] threshold [LIMIT count]
+class XTrimCommand : public Command {
+ public:
+  XTrimCommand() : Command("xtrim", "wFR") {}
+
+  ssize_t arity() const {
+    return -2;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return 1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    const std::string& key = args[1];
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+
+    StreamTrimArgs trim;
+    size_t i = 2;
+    if (i >= args.size()) {
+      return {ErrorCodes::ERR_PARSEOPT, ""};
+    }
+    auto opt = toLower(args[i]);
+    if (opt != "maxlen" && opt != "minid") {
+      return {ErrorCodes::ERR_PARSEOPT, ""};
+    }
+    auto s = parseStreamTrimArgs(args, &i, &trim);
+    RET_IF_ERR(s);
+    if (i != args.size()) {
+      return {ErrorCodes::ERR_PARSEOPT, ""};
+    }
+
+    auto server = sess->getServerEntry();
+    auto expdb = server->getSegmentMgr()->getDbWithKeyLock(
+      sess, key, mgl::LockMode::LOCK_X);
+    RET_IF_ERR_EXPECTED(expdb);
+    auto rv = getStreamKey(sess, key);
+    if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return Command::fmtZero();
+    }
+    RET_IF_ERR_EXPECTED(rv);
+    auto meta = StreamMetaValue::decode(rv.value().getValue());
+    RET_IF_ERR_EXPECTED(meta);
+
+    PStore kvstore = expdb.value().store;
+    RecordKey metaRk(expdb.value().chunkId,
+                     pCtx->getDbId(),
+                     RecordType::RT_STREAM_META,
+                     key,
+                     "");
+    auto ptxn = kvstore->createTransaction(sess);
+    RET_IF_ERR_EXPECTED(ptxn);
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    auto trimmed =
+      streamTrim(kvstore, txn.get(), metaRk, trim, &meta.value());
+    RET_IF_ERR_EXPECTED(trimmed);
+    if (trimmed.value() == 0) {
+      return Command::fmtZero();
+    }
+    s = setStreamMeta(sess, kvstore, txn.get(), metaRk, rv, meta.value());
+    RET_IF_ERR(s);
+    auto eCommit = txn->commit();
+    RET_IF_ERR_EXPECTED(eCommit);
+    return Command::fmtLongLong(trimmed.value());
+  }
+} xtrimCmd;
+
+struct StreamReadArgs {
+  uint64_t count = UINT64_MAX;
+  bool block = false;
+  uint64_t blockMs = 0;
+  bool noack = false;
+  std::string group;
+  std::string consumer;
+  // the keys are args[streamsPos, streamsPos + numKeys), followed by
+  // their ids
+  size_t streamsPos = 0;
+  size_t numKeys = 0;
+};
+
+// [GROUP group consumer] [COUNT count] [BLOCK ms] [NOACK]
+//   STREAMS key [key ...] id [id ...]
+Expected<StreamReadArgs> parseStreamReadArgs(
+  const std::vector<std::string>& args, bool isGroup) {
+  StreamReadArgs ra;
+  for (size_t i = 1; i < args.size(); i++) {
+    auto opt = toLower(args[i]);
+    size_t moreArgs = args.size() - i - 1;
+    if (opt == "count" && moreArgs) {
+      auto count = tendisplus::stoll(args[++i]);
+      if (!count.ok()) {
+        return {ErrorCodes::ERR_INTERGER, ""};
+      }
+      if (count.value() > 0) {
+        ra.count = count.value();
+      }
+    } else if (opt == "block" && moreArgs) {
+      auto ms = tendisplus::stoll(args[++i]);
+      if (!ms.ok()) {
+        return {ErrorCodes::ERR_PARSEOPT,
+                "timeout is not an integer or out of range"};
+      } else if (ms.value() < 0) {
+        return {ErrorCodes::ERR_PARSEOPT, "timeout is negative"};
+      }
+      ra.block = true;
+      ra.blockMs = ms.value();
+    } else if (opt == "streams" && moreArgs) {
+      if (moreArgs % 2 != 0) {
+        return {ErrorCodes::ERR_PARSEOPT,
+                "Unbalanced '" + toLower(args[0]) +
+                  "' list of streams: for each stream key an ID or '" +
+                  (isGroup ? ">" : "$") + "' must be specified."};
+      }
+      ra.streamsPos = i + 1;
+      ra.numKeys = moreArgs / 2;
+      break;
+    } else if (opt == "group" && moreArgs >= 2) {
+      if (!isGroup) {
+        return {ErrorCodes::ERR_PARSEOPT,
+                "The GROUP option is only supported by XREADGROUP. You "
+                "called XREAD instead."};
+      }
+      ra.group = args[i + 1];
+      ra.consumer = args[i + 2];
+      i += 2;
+    } else if (opt == "noack" && isGroup) {
+      ra.noack = true;
+    } else {
+      return {ErrorCodes::ERR_PARSEOPT, ""};
+    }
+  }
+  if (ra.streamsPos == 0) {
+    return {ErrorCodes::ERR_PARSEOPT, ""};
+  }
+  if (isGroup && ra.group.empty()) {
+    return {ErrorCodes::ERR_PARSEOPT,
+            "Missing GROUP option for XREADGROUP"};
+  }
+  return ra;
+}
+
+// the deadline(ms) of a blocking read, kept in SessionCtx across wakeups
+uint64_t getStreamBlockDeadline(Session* sess, const StreamReadArgs& ra) {
+  uint64_t deadline = sess->getCtx()->getBlockDeadline();
+  if (deadline) {
+    return deadline;
+  }
+  return ra.blockMs ? msSinceEpoch() + ra.blockMs : BlockManager::NO_DEADLINE;
+}
+
+class XReadGenericCommand : public Command {
+ public:
+  XReadGenericCommand(const std::string& name, const char* sflags)
+    : Command(name, sflags), _isGroup(name == "xreadgroup") {}
+
+  ssize_t arity() const {
+    return _isGroup ? -7 : -4;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return 1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  std::vector<int> getKeysFromCommand(
+    const std::vector<std::string>& argv) final {
+    std::vector<int> keyindex;
+    auto ra = parseStreamReadArgs(argv, _isGroup);
+    if (!ra.ok()) {
+      return keyindex;
+    }
+    for (size_t i = 0; i < ra.value().numKeys; i++) {
+      keyindex.push_back(ra.value().streamsPos + i);
+    }
+    return keyindex;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    // a copy, the ids may be rewritten before blocking
+    std::vector<std::string> args = sess->getArgs();
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+
+    auto era = parseStreamReadArgs(args, _isGroup);
+    RET_IF_ERR_EXPECTED(era);
+    const StreamReadArgs& ra = era.value();
+
+    auto server = sess->getServerEntry();
+    auto index = getKeysFromCommand(args);
+    auto locklist = server->getSegmentMgr()->getAllKeysLocked(
+      sess,
+      args,
+      index,
+      _isGroup ? mgl::LockMode::LOCK_X : Command::RdLock());
+    RET_IF_ERR_EXPECTED(locklist);
+
+    ReadState st;
+    st.canBlock = ra.block;
+    auto body = readStreams(sess, &args, ra, &st);
+    if (_isGroup) {
+      // the group changes of all the keys, in their kvstores
+      if (!body.ok()) {
+        pCtx->rollbackAll();
+        return body.status();
+      }
+      auto s = pCtx->commitAll(getName());
+      RET_IF_ERR(s);
+    }
+    RET_IF_ERR_EXPECTED(body);
+
+    if (st.replied) {
+      std::stringstream ss;
+      Command::fmtMultiBulkLen(ss, st.replied);
+      ss << body.value();
+      return ss.str();
+    }
+    if (!st.canBlock) {
+      return Command::fmtNullArray();
+    }
+    std::vector<std::string> keys(args.begin() + ra.streamsPos,
+                                  args.begin() + ra.streamsPos + ra.numKeys);
+    auto reply = blockForKeys(sess, keys, getStreamBlockDeadline(sess, ra));
+    if (pCtx->isBlocked() && st.rewritten) {
+      // "$" means the entries after the ones when the command arrives,
+      // not the ones when it runs again
+      sess->swapArgs(&args);
+    }
+    return reply;
+  }
+
+ private:
+  struct ReadState {
+    uint64_t replied = 0;
+    bool canBlock = false;
+    bool rewritten = false;
+  };
+
+  // the replies of the keys with entries, "$" in args are replaced by
+  // the last ids
+  Expected<std::string> readStreams(Session* sess,
+                                    std::vector<std::string>* args,
+                                    const StreamReadArgs& ra,
+                                    ReadState* st) {
+    auto server = sess->getServerEntry();
+    SessionCtx* pCtx = sess->getCtx();
+    std::stringstream ss;
+    for (size_t i = 0; i < ra.numKeys; i++) {
+      const std::string& key = (*args)[ra.streamsPos + i];
+      std::string& idArg = (*args)[ra.streamsPos + ra.numKeys + i];
+
+      auto rv = getStreamKey(sess, key);
+      if (!rv.ok() && rv.status().code() != ErrorCodes::ERR_NOTFOUND) {
+        return rv.status();
+      }
+      if (!rv.ok() && _isGroup) {
+        return noGroupErr(key, ra.group);
+      }
+      auto meta = getStreamMeta(rv);
+      RET_IF_ERR_EXPECTED(meta);
+
+      auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, key);
+      RET_IF_ERR_EXPECTED(expdb);
+      PStore kvstore = expdb.value().store;
+      RecordKey metaRk(expdb.value().chunkId,
+                       pCtx->getDbId(),
+                       RecordType::RT_STREAM_META,
+                       key,
+                       "");
+      Expected<std::vector<Record>> entries = std::vector<Record>();
+      bool history = false;
+      if (_isGroup) {
+        auto ptxn = pCtx->createTransaction(kvstore);
+        RET_IF_ERR_EXPECTED(ptxn);
+        if (idArg == ">") {
+          entries = readGroupNew(
+            kvstore, ptxn.value(), metaRk, ra, meta.value());
+        } else {
+          auto id = parseStreamId(idArg, 0);
+          RET_IF_ERR_EXPECTED(id);
+          entries = readGroupHistory(
+            kvstore, ptxn.value(), metaRk, ra, id.value());
+          // the history is replied even if empty, never blocks
+          history = true;
+          st->canBlock = false;
+        }
+      } else {
+        StreamId id;
+        if (idArg == "$") {
+          id = meta.value().getLastId();
+          idArg = id.toString();
+          st->rewritten = true;
+        } else {
+          auto eid = parseStreamId(idArg, 0);
+          RET_IF_ERR_EXPECTED(eid);
+          id = eid.value();
+        }
+        if (meta.value().getCount() && id < meta.value().getLastId()) {
+          streamIncrId(&id);
+          auto ptxn = kvstore->createTransaction(sess);
+          RET_IF_ERR_EXPECTED(ptxn);
+          entries = streamRange(
+            ptxn.value().get(), metaRk, id, kStreamMaxId, ra.count);
+        }
+      }
+      RET_IF_ERR_EXPECTED(entries);
+      if (entries.value().empty() && !history) {
+        continue;
+      }
+      Command::fmtMultiBulkLen(ss, 2);
+      Command::fmtBulk(ss, key);
+      auto s = fmtStreamEntries(ss, entries.value());
+      RET_IF_ERR(s);
+      st->replied++;
+    }
+    return ss.str();
+  }
+
+  // the entries never delivered to the group, they are pending on the
+  // consumer unless NOACK
+  Expected<std::vector<Record>> readGroupNew(PStore kvstore,
+                                             Transaction* txn,
+                                             const RecordKey& metaRk,
+                                             const StreamReadArgs& ra,
+                                             const StreamMetaValue& meta) {
+    auto cg = getStreamGroup(kvstore, txn, metaRk, ra.group);
+    if (cg.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return noGroupErr(metaRk.getPrimaryKey(), ra.group);
+    }
+    RET_IF_ERR_EXPECTED(cg);
+    auto created =
+      touchStreamConsumer(kvstore, txn, metaRk, ra.group, ra.consumer);
+    RET_IF_ERR_EXPECTED(created);
+
+    StreamId start = cg.value().lastId;
+    if (!(start < meta.getLastId()) || !streamIncrId(&start)) {
+      return std::vector<Record>();
+    }
+    auto entries = streamRange(txn, metaRk, start, kStreamMaxId, ra.count);
+    RET_IF_ERR_EXPECTED(entries);
+    if (entries.value().empty()) {
+      return entries;
+    }
+
+    uint64_t now = msSinceEpoch();
+    for (const auto& rcd : entries.value()) {
+      auto id = StreamId::decode(rcd.getRecordKey().getSecondaryKey());
+      RET_IF_ERR_EXPECTED(id);
+      cg.value().lastId = id.value();
+      if (ra.noack) {
+        continue;
+      }
+      StreamPending pe{ra.consumer, now, 1};
+      auto s = kvstore->setKV(
+        streamCgKey(metaRk, streamPendingSk(ra.group, id.value())),
+        RecordValue(pe.encode(), RecordType::RT_STREAM_CG, -1),
+        txn);
+      RET_IF_ERR(s);
+      cg.value().pending++;
+    }
+    auto s = setStreamGroup(kvstore, txn, metaRk, ra.group, cg.value());
+    RET_IF_ERR(s);
+    return entries;
+  }
+
+  // the entries pending on the consumer after id, those deleted from
+  // the stream are replied with a nil body
+  Expected<std::vector<Record>> readGroupHistory(PStore kvstore,
+                                                 Transaction* txn,
+                                                 const RecordKey& metaRk,
+                                                 const StreamReadArgs& ra,
+                                                 const StreamId& after) {
+    auto cg = getStreamGroup(kvstore, txn, metaRk, ra.group);
+    if (cg.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return noGroupErr(metaRk.getPrimaryKey(), ra.group);
+    }
+    RET_IF_ERR_EXPECTED(cg);
+    auto created =
+      touchStreamConsumer(kvstore, txn, metaRk, ra.group, ra.consumer);
+    RET_IF_ERR_EXPECTED(created);
+
+    std::vector<Record> entries;
+    StreamId start = after;
+    if (!streamIncrId(&start)) {
+      return entries;
+    }
+    Status err = {ErrorCodes::ERR_OK, ""};
+    auto s = scanStreamGroup(
+      txn,
+      metaRk,
+      'P',
+      ra.group,
+      start.encode(),
+      [&](const Record& rcd, const std::string& idStr) {
+        auto pe = StreamPending::decode(rcd.getRecordValue().getValue());
+        if (!pe.ok()) {
+          err = pe.status();
+          return false;
+        }
+        if (pe.value().consumer != ra.consumer) {
+          return true;
+        }
+        auto id = StreamId::decode(idStr);
+        if (!id.ok()) {
+          err = id.status();
+          return false;
+        }
+        RecordKey eleRk = streamEleKey(metaRk, id.value());
+        auto ele = kvstore->getKV(eleRk, txn);
+        if (ele.ok()) {
+          entries.emplace_back(eleRk, ele.value());
+        } else if (ele.status().code() == ErrorCodes::ERR_NOTFOUND) {
+          // deleted from the stream
+          entries.emplace_back(
+            eleRk, RecordValue("", RecordType::RT_STREAM_ELE, -1));
+        } else {
+          err = ele.status();
+          return false;
+        }
+        return entries.size() < ra.count;
+      });
+    RET_IF_ERR(s);
+    RET_IF_ERR(err);
+    return entries;
+  }
+
+  bool _isGroup;
+};
+
+// XREAD [COUNT count] [BLOCK ms] STREAMS key [key ...] id [id ...]
+// XREADGROUP GROUP group consumer [COUNT count] [BLOCK ms] [NOACK]
+//   STREAMS key [key ...] id [id ...]
+// A blocked XREAD is woken up by XADD through BlockManager, and runs
+// again like BLPOP.
+XReadGenericCommand xreadCmd("xread", "rs");
+XReadGenericCommand xreadgroupCmd("xreadgroup", "ws");
+
+// XGROUP CREATE key group id|$ [MKSTREAM]
+// XGROUP SETID key group id|$
+// XGROUP DESTROY key group
+// XGROUP CREATECONSUMER key group consumer
+// XGROUP DELCONSUMER key group consumer
+class XGroupCommand : public Command {
+ public:
+  XGroupCommand() : Command("xgroup", "wm") {}
+
+  ssize_t arity() const {
+    return -2;
+  }
+
+  int32_t firstkey() const {
+    return 2;
+  }
+
+  int32_t lastkey() const {
+    return 2;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+
+    auto subCmd = toLower(args[1]);
+    bool mkStream = false;
+    if (subCmd == "create" && (args.size() == 5 || args.size() == 6)) {
+      if (args.size() == 6) {
+        if (toLower(args[5]) != "mkstream") {
+          return {ErrorCodes::ERR_PARSEOPT, ""};
+        }
+        mkStream = true;
+      }
+    } else if (!((subCmd == "setid" && args.size() == 5) ||
+                 (subCmd == "destroy" && args.size() == 4) ||
+                 (subCmd == "createconsumer" && args.size() == 5) ||
+                 (subCmd == "delconsumer" && args.size() == 5))) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "Unknown subcommand or wrong number of arguments for '" +
+                args[1] + "'. Try XGROUP HELP."};
+    }
+    const std::string& key = args[2];
+    const std::string& group = args[3];
+
+    auto server = sess->getServerEntry();
+    auto expdb = server->getSegmentMgr()->getDbWithKeyLock(
+      sess, key, mgl::LockMode::LOCK_X);
+    RET_IF_ERR_EXPECTED(expdb);
+    auto rv = getStreamKey(sess, key);
+    if (!rv.ok() && rv.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return rv.status();
+    }
+    if (!rv.ok() && !mkStream) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "The XGROUP subcommand requires the key to exist. Note that "
+              "for CREATE you may want to use the MKSTREAM option to create "
+              "an empty stream automatically."};
+    }
+    auto meta = getStreamMeta(rv);
+    RET_IF_ERR_EXPECTED(meta);
+
+    PStore kvstore = expdb.value().store;
+    RecordKey metaRk(expdb.value().chunkId,
+                     pCtx->getDbId(),
+                     RecordType::RT_STREAM_META,
+                     key,
+                     "");
+    auto ptxn = kvstore->createTransaction(sess);
+    RET_IF_ERR_EXPECTED(ptxn);
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+
+    auto cg = getStreamGroup(kvstore, txn.get(), metaRk, group);
+    if (!cg.ok() && cg.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return cg.status();
+    }
+    if (subCmd != "create" && !cg.ok()) {
+      if (subCmd == "destroy") {
+        return Command::fmtZero();
+      }
+      return {ErrorCodes::ERR_PARSEOPT,
+              "-NOGROUP No such consumer group '" + group + "' for key name '" +
+                key + "'\r\n"};
+    }
+
+    std::string reply;
+    if (subCmd == "create" || subCmd == "setid") {
+      if (subCmd == "create" && cg.ok()) {
+        return {ErrorCodes::ERR_PARSEOPT,
+                "-BUSYGROUP Consumer Group name already exists\r\n"};
+      }
+      StreamId id = meta.value().getLastId();
+      if (args[4] != "$") {
+        auto eid = parseStreamId(args[4], 0);
+        RET_IF_ERR_EXPECTED(eid);
+        id = eid.value();
+      }
+      StreamGroup newCg{id, cg.ok() ? cg.value().pending : 0};
+      auto s = setStreamGroup(kvstore, txn.get(), metaRk, group, newCg);
+      RET_IF_ERR(s);
+      if (subCmd == "create") {
+        meta.value().setGroups(meta.value().getGroups() + 1);
+        s = setStreamMeta(
+          sess, kvstore, txn.get(), metaRk, rv, meta.value());
+        RET_IF_ERR(s);
+      }
+      reply = Command::fmtOK();
+    } else if (subCmd == "destroy") {
+      auto s = destroyGroup(kvstore, txn.get(), metaRk, group);
+      RET_IF_ERR(s);
+      meta.value().setGroups(meta.value().getGroups() - 1);
+      s = setStreamMeta(sess, kvstore, txn.get(), metaRk, rv, meta.value());
+      RET_IF_ERR(s);
+      reply = Command::fmtOne();
+    } else if (subCmd == "createconsumer") {
+      RecordKey rk = streamCgKey(metaRk, streamConsumerSk(group, args[4]));
+      auto exists = kvstore->getKV(rk, txn.get());
+      if (exists.ok()) {
+        return Command::fmtZero();
+      }
+      auto created =
+        touchStreamConsumer(kvstore, txn.get(), metaRk, group, args[4]);
+      RET_IF_ERR_EXPECTED(created);
+      reply = Command::fmtOne();
+    } else {
+      auto deleted =
+        delConsumer(kvstore, txn.get(), metaRk, group, args[4], &cg.value());
+      RET_IF_ERR_EXPECTED(deleted);
+      reply = Command::fmtLongLong(deleted.value());
+    }
+
+    auto eCommit = txn->commit();
+    RET_IF_ERR_EXPECTED(eCommit);
+    return reply;
+  }
+
+ private:
+  Status destroyGroup(PStore kvstore,
+                      Transaction* txn,
+                      const RecordKey& metaRk,
+                      const std::string& group) {
+    std::vector<RecordKey> toDel;
+    for (char tag : {'C', 'P'}) {
+      auto s = scanStreamGroup(
+        txn, metaRk, tag, group, "", [&](const Record& rcd,
+                                         const std::string&) {
+          toDel.push_back(rcd.getRecordKey());
+          return true;
+        });
+      RET_IF_ERR(s);
+    }
+    toDel.push_back(streamCgKey(metaRk, streamGroupSk(group)));
+    for (const auto& rk : toDel) {
+      auto s = kvstore->delKV(rk, txn);
+      RET_IF_ERR(s);
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  // the pending entries of the consumer are dropped with it
+  Expected<uint64_t> delConsumer(PStore kvstore,
+                                 Transaction* txn,
+                                 const RecordKey& metaRk,
+                                 const std::string& group,
+                                 const std::string& consumer,
+                                 StreamGroup* cg) {
+    RecordKey rk = streamCgKey(metaRk, streamConsumerSk(group, consumer));
+    auto exists = kvstore->getKV(rk, txn);
+    if (exists.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return 0;
+    }
+    RET_IF_ERR_EXPECTED(exists);
+
+    std::vector<RecordKey> toDel;
+    Status err = {ErrorCodes::ERR_OK, ""};
+    auto s = scanStreamGroup(
+      txn, metaRk, 'P', group, "", [&](const Record& rcd,
+                                       const std::string&) {
+        auto pe = StreamPending::decode(rcd.getRecordValue().getValue());
+        if (!pe.ok()) {
+          err = pe.status();
+          return false;
+        }
+        if (pe.value().consumer == consumer) {
+          toDel.push_back(rcd.getRecordKey());
+        }
+        return true;
+      });
+    RET_IF_ERR(s);
+    RET_IF_ERR(err);
+    for (const auto& pk : toDel) {
+      s = kvstore->delKV(pk, txn);
+      RET_IF_ERR(s);
+    }
+    s = kvstore->delKV(rk, txn);
+    RET_IF_ERR(s);
+    cg->pending -= toDel.size();
+    s = setStreamGroup(kvstore, txn, metaRk, group, *cg);
+    RET_IF_ERR(s);
+    return toDel.size();
+  }
+} xgroupCmd;
+
+// XACK key group id [id ...]
+class XAckCommand : public Command {
+ public:
+  XAckCommand() : Command("xack", "wF") {}
+
+  ssize_t arity() const {
+    return -4;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return 1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    const std::string& key = args[1];
+    const std::string& group = args[2];
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+
+    std::vector<StreamId> ids;
+    for (size_t i = 3; i < args.size(); i++) {
+      auto id = parseStreamId(args[i], 0);
+      RET_IF_ERR_EXPECTED(id);
+      ids.push_back(id.value());
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    auto server = sess->getServerEntry();
+    auto expdb = server->getSegmentMgr()->getDbWithKeyLock(
+      sess, key, mgl::LockMode::LOCK_X);
+    RET_IF_ERR_EXPECTED(expdb);
+    auto rv = getStreamKey(sess, key);
+    if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return Command::fmtZero();
+    }
+    RET_IF_ERR_EXPECTED(rv);
+
+    PStore kvstore = expdb.value().store;
+    RecordKey metaRk(expdb.value().chunkId,
+                     pCtx->getDbId(),
+                     RecordType::RT_STREAM_META,
+                     key,
+                     "");
+    auto ptxn = kvstore->createTransaction(sess);
+    RET_IF_ERR_EXPECTED(ptxn);
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    auto cg = getStreamGroup(kvstore, txn.get(), metaRk, group);
+    if (cg.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return Command::fmtZero();
+    }
+    RET_IF_ERR_EXPECTED(cg);
+
+    uint64_t acked = 0;
+    for (const auto& id : ids) {
+      RecordKey rk = streamCgKey(metaRk, streamPendingSk(group, id));
+      auto pe = kvstore->getKV(rk, txn.get());
+      if (pe.status().code() == ErrorCodes::ERR_NOTFOUND) {
+        continue;
+      }
+      RET_IF_ERR_EXPECTED(pe);
+      auto s = kvstore->delKV(rk, txn.get());
+      RET_IF_ERR(s);
+      acked++;
+    }
+    if (acked == 0) {
+      return Command::fmtZero();
+    }
+    cg.value().pending -= acked;
+    auto s = setStreamGroup(kvstore, txn.get(), metaRk, group, cg.value());
+    RET_IF_ERR(s);
+    auto eCommit = txn->commit();
+    RET_IF_ERR_EXPECTED(eCommit);
+    return Command::fmtLongLong(acked);
+  }
+} xackCmd;
+
+// XPENDING key group [[IDLE min-idle-time] start end count [consumer]]
+class XPendingCommand : public Command {
+ public:
+  XPendingCommand() : Command("xpending", "rR") {}
+
+  ssize_t arity() const {
+    return -3;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return 1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    const std::string& key = args[1];
+    const std::string& group = args[2];
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+
+    bool extended = args.size() > 3;
+    uint64_t minIdle = 0;
+    StreamId start = kStreamMinId;
+    StreamId end = kStreamMaxId;
+    uint64_t count = 0;
+    std::string consumer;
+    if (extended) {
+      size_t i = 3;
+      if (toLower(args[i]) == "idle" && args.size() > i + 1) {
+        auto idle = tendisplus::stoll(args[i + 1]);
+        if (!idle.ok()) {
+          return {ErrorCodes::ERR_INTERGER, ""};
+        }
+        minIdle = std::max(idle.value(), static_cast<int64_t>(0));
+        i += 2;
+      }
+      if (args.size() != i + 3 && args.size() != i + 4) {
+        return {ErrorCodes::ERR_PARSEOPT, ""};
+      }
+      auto estart = parseStreamRangeId(args[i], true);
+      RET_IF_ERR_EXPECTED(estart);
+      auto eend = parseStreamRangeId(args[i + 1], false);
+      RET_IF_ERR_EXPECTED(eend);
+      auto ecount = tendisplus::stoll(args[i + 2]);
+      if (!ecount.ok()) {
+        return {ErrorCodes::ERR_INTERGER, ""};
+      }
+      start = estart.value();
+      end = eend.value();
+      count = std::max(ecount.value(), static_cast<int64_t>(0));
+      if (args.size() == i + 4) {
+        consumer = args[i + 3];
+      }
+    }
+
+    auto server = sess->getServerEntry();
+    auto expdb = server->getSegmentMgr()->getDbWithKeyLock(
+      sess, key, Command::RdLock());
+    RET_IF_ERR_EXPECTED(expdb);
+    auto rv = getStreamKey(sess, key);
+    if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return noGroupErr(key, group);
+    }
+    RET_IF_ERR_EXPECTED(rv);
+
+    PStore kvstore = expdb.value().store;
+    RecordKey metaRk(expdb.value().chunkId,
+                     pCtx->getDbId(),
+                     RecordType::RT_STREAM_META,
+                     key,
+                     "");
+    auto ptxn = kvstore->createTransaction(sess);
+    RET_IF_ERR_EXPECTED(ptxn);
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    auto cg = getStreamGroup(kvstore, txn.get(), metaRk, group);
+    if (cg.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return noGroupErr(key, group);
+    }
+    RET_IF_ERR_EXPECTED(cg);
+
+    uint64_t now = msSinceEpoch();
+    uint64_t total = 0;
+    std::string minId, maxId;
+    std::map<std::string, uint64_t> consumers;
+    std::stringstream entries;
+    uint64_t replied = 0;
+    Status err = {ErrorCodes::ERR_OK, ""};
+    if (extended && (count == 0 || end < start)) {
+      return Command::fmtZeroBulkLen();
+    }
+    auto s = scanStreamGroup(
+      txn.get(),
+      metaRk,
+      'P',
+      group,
+      start.encode(),
+      [&](const Record& rcd, const std::string& idStr) {
+        auto id = StreamId::decode(idStr);
+        auto pe = StreamPending::decode(rcd.getRecordValue().getValue());
+        if (!id.ok() || !pe.ok()) {
+          err = id.ok() ? pe.status() : id.status();
+          return false;
+        }
+        if (!extended) {
+          if (total == 0) {
+            minId = id.value().toString();
+          }
+          maxId = id.value().toString();
+          total++;
+          consumers[pe.value().consumer]++;
+          return true;
+        }
+        if (end < id.value()) {
+          return false;
+        }
+        uint64_t idle = now > pe.value().deliveryTime
+          ? now - pe.value().deliveryTime
+          : 0;
+        if ((!consumer.empty() && pe.value().consumer != consumer) ||
+            idle < minIdle) {
+          return true;
+        }
+        Command::fmtMultiBulkLen(entries, 4);
+        Command::fmtBulk(entries, id.value().toString());
+        Command::fmtBulk(entries, pe.value().consumer);
+        Command::fmtLongLong(entries, idle);
+        Command::fmtLongLong(entries, pe.value().deliveryCount);
+        return ++replied < count;
+      });
+    RET_IF_ERR(s);
+    RET_IF_ERR(err);
+
+    std::stringstream ss;
+    if (extended) {
+      Command::fmtMultiBulkLen(ss, replied);
+      ss << entries.str();
+      return ss.str();
+    }
+    Command::fmtMultiBulkLen(ss, 4);
+    Command::fmtLongLong(ss, total);
+    if (total == 0) {
+      Command::fmtNull(ss);
+      Command::fmtNull(ss);
+      ss << Command::fmtNullArray();
+      return ss.str();
+    }
+    Command::fmtBulk(ss, minId);
+    Command::fmtBulk(ss, maxId);
+    Command::fmtMultiBulkLen(ss, consumers.size());
+    for (const auto& v : consumers) {
+      Command::fmtMultiBulkLen(ss, 2);
+      Command::fmtBulk(ss, v.first);
+      Command::fmtBulk(ss, std::to_string(v.second));
+    }
+    return ss.str();
+  }
+} xpendingCmd;
+
+}  // namespace tendisplus
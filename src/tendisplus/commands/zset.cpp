@@ -156,6 +156,7 @@ Expected<std::string> genericZadd(Session* sess,
                 eMeta.status().code() == ErrorCodes::ERR_EXPIRED);
     // head node also included into the count
     ZSlMetaValue tmp(1 /*lvl*/, 1 /*count*/, 0 /*tail*/);
+    tmp.setScoreIndex(true);
     RecordValue rv(
       tmp.encode(), RecordType::RT_ZSET_META, pCtx->getVersionEP());
     Status s = kvstore->setKV(mk, rv, txn.get());
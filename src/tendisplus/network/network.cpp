@@ -72,11 +72,20 @@ RequestMatrix RequestMatrix::operator-(const RequestMatrix& right) {
   return result;
 }
 
+void NetworkMatrix::setIoThreadNum(size_t num) {
+  ioThreadAccepted.resize(num);
+  ioThreadConns.resize(num);
+}
+
 std::string NetworkMatrix::toString() const {
   std::stringstream ss;
   ss << "\nstickyPackets\t" << stickyPackets << "\nconnCreated\t" << connCreated
      << "\nconnReleased\t" << connReleased << "\ninvalidPackets\t"
-     << invalidPackets;
+     << invalidPackets << "\nacceptCost\t" << acceptCost << "ns";
+  for (size_t i = 0; i < ioThreadAccepted.size(); i++) {
+    ss << "\nioThread" << i << "\taccepted:" << ioThreadAccepted[i]
+       << " conns:" << ioThreadConns[i];
+  }
   return ss.str();
 }
 
@@ -85,6 +94,11 @@ void NetworkMatrix::reset() {
   connCreated = 0;
   connReleased = 0;
   invalidPackets = 0;
+  acceptCost = 0;
+  // the alive connections are a gauge, not reset
+  for (auto& v : ioThreadAccepted) {
+    v = 0;
+  }
 }
 
 NetworkMatrix NetworkMatrix::operator-(const NetworkMatrix& right) {
@@ -93,6 +107,15 @@ NetworkMatrix NetworkMatrix::operator-(const NetworkMatrix& right) {
   result.connCreated = connCreated - right.connCreated;
   result.connReleased = connReleased - right.connReleased;
   result.invalidPackets = invalidPackets - right.invalidPackets;
+  result.acceptCost = acceptCost - right.acceptCost;
+  result.ioThreadAccepted = ioThreadAccepted;
+  result.ioThreadConns = ioThreadConns;
+  for (size_t i = 0;
+       i < ioThreadAccepted.size() && i < right.ioThreadAccepted.size();
+       i++) {
+    result.ioThreadAccepted[i] =
+      ioThreadAccepted[i] - right.ioThreadAccepted[i];
+  }
   return result;
 }
 
@@ -189,12 +212,23 @@ Status NetworkAsio::prepare(const std::string& ip,
       asio::ip::address address = asio::ip::make_address(ip);
       ep = tcp::endpoint(address, port);
     }
-    std::error_code ec;
-    _acceptor = std::make_unique<tcp::acceptor>(*_acceptCtx, ep);
-    _acceptor->set_option(tcp::acceptor::reuse_address(true));
-    _acceptor->non_blocking(true, ec);
-    if (ec.value()) {
-      return {ErrorCodes::ERR_NETWORK, ec.message()};
+    for (size_t i = 0; i < _netIoThreadNum; ++i) {
+      _rwCtxList.push_back(std::make_shared<asio::io_context>());
+    }
+    _netMatrix->setIoThreadNum(_netIoThreadNum);
+    if (_cfg->netReusePortAccept) {
+      auto s = prepareReusePort(ep);
+      if (!s.ok()) {
+        return s;
+      }
+    } else {
+      std::error_code ec;
+      _acceptor = std::make_unique<tcp::acceptor>(*_acceptCtx, ep);
+      _acceptor->set_option(tcp::acceptor::reuse_address(true));
+      _acceptor->non_blocking(true, ec);
+      if (ec.value()) {
+        return {ErrorCodes::ERR_NETWORK, ec.message()};
+      }
     }
   } catch (std::exception& e) {
 #ifdef TENDIS_DEBUG
@@ -206,6 +240,46 @@ Status NetworkAsio::prepare(const std::string& ip,
   return {ErrorCodes::ERR_OK, ""};
 }
 
+Status NetworkAsio::prepareReusePort(const asio::ip::tcp::endpoint& ep) {
+#ifdef SO_REUSEPORT
+  using reuse_port =
+    asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+  // with SO_REUSEPORT the port would be shared with another server of the
+  // same user listening on it, so it's bound without it first, and the
+  // server fails to start like the one without net-reuseport-accept
+  {
+    std::error_code ec;
+    tcp::acceptor probe(*_acceptCtx);
+    probe.open(ep.protocol());
+    probe.set_option(tcp::acceptor::reuse_address(true));
+    probe.bind(ep, ec);
+    if (ec.value()) {
+      return {ErrorCodes::ERR_NETWORK, "bind failed: " + ec.message()};
+    }
+  }
+  // the kernel spreads the new connections over the listeners
+  for (auto& rwCtx : _rwCtxList) {
+    std::error_code ec;
+    auto acceptor = std::make_unique<tcp::acceptor>(*rwCtx);
+    acceptor->open(ep.protocol());
+    acceptor->set_option(tcp::acceptor::reuse_address(true));
+    acceptor->set_option(reuse_port(true));
+    acceptor->bind(ep);
+    acceptor->listen();
+    acceptor->non_blocking(true, ec);
+    if (ec.value()) {
+      return {ErrorCodes::ERR_NETWORK, ec.message()};
+    }
+    _rwAcceptors.emplace_back(std::move(acceptor));
+  }
+  LOG(INFO) << "NetworkAsio::prepare " << _rwAcceptors.size()
+            << " acceptors with SO_REUSEPORT";
+  return {ErrorCodes::ERR_OK, ""};
+#else
+  return {ErrorCodes::ERR_NETWORK, "SO_REUSEPORT is not supported"};
+#endif
+}
+
 Expected<uint64_t> NetworkAsio::client2Session(
   std::shared_ptr<BlockingTcpClient> c, bool migrateOnly) {
   if (c->getReadBufSize() > 0) {
@@ -241,38 +315,63 @@ Expected<std::shared_ptr<ClusterSession>> NetworkAsio::client2ClusterSession(
   return sess;
 }
 
+template <typename T>
+bool NetworkAsio::onAccept(const std::error_code& ec,
+                           tcp::socket socket,
+                           uint32_t index) {
+  if (!_isRunning.load(std::memory_order_relaxed)) {
+    LOG(INFO) << "acceptCb, server is shuting down";
+    return false;
+  }
+  if (ec.value()) {
+    LOG(WARNING) << "acceptCb errorcode:" << ec.message();
+    // we log this error, but dont return
+  }
+
+  auto start = nsSinceEpoch();
+  uint64_t newConnId = _connCreated.fetch_add(1, std::memory_order_relaxed);
+  auto sess = std::make_shared<T>(
+    _server, std::move(socket), newConnId, true, _netMatrix, _reqMatrix);
+  sess->setIoCtxId(index);
+  DLOG(INFO) << "new net session, id:" << sess->id()
+             << ",connId:" << newConnId << ",from:" << sess->getRemoteRepr()
+             << " created";
+  ++_netMatrix->ioThreadAccepted[index];
+  // before the session starts, it may end at once on the io thread
+  ++_netMatrix->ioThreadConns[index];
+  // TODO(wayenchen): check whether clusterSession should add to
+  // ServerEntry::_sessions.
+  if (_server->addSession(std::move(sess))) {
+    ++_netMatrix->connCreated;
+  } else {
+    --_netMatrix->ioThreadConns[index];
+  }
+  _netMatrix->acceptCost += nsSinceEpoch() - start;
+  return true;
+}
+
 template <typename T>
 void NetworkAsio::doAccept() {
   int index = _connCreated % _rwCtxList.size();
   auto cb = [this, index](const std::error_code& ec, tcp::socket socket) {
-    if (!_isRunning.load(std::memory_order_relaxed)) {
-      LOG(INFO) << "acceptCb, server is shuting down";
-      return;
-    }
-    if (ec.value()) {
-      LOG(WARNING) << "acceptCb errorcode:" << ec.message();
-      // we log this error, but dont return
+    if (onAccept<T>(ec, std::move(socket), index)) {
+      doAccept<T>();
     }
-
-    uint64_t newConnId = _connCreated.fetch_add(1, std::memory_order_relaxed);
-    auto sess = std::make_shared<T>(
-      _server, std::move(socket), newConnId, true, _netMatrix, _reqMatrix);
-    sess->setIoCtxId(index);
-    DLOG(INFO) << "new net session, id:" << sess->id()
-               << ",connId:" << newConnId << ",from:" << sess->getRemoteRepr()
-               << " created";
-    // TODO(wayenchen): check whether clusterSession should add to
-    // ServerEntry::_sessions.
-    if (_server->addSession(std::move(sess))) {
-      ++_netMatrix->connCreated;
-    }
-
-    doAccept<T>();
   };
   auto rwCtx = _rwCtxList[index];
   _acceptor->async_accept(*rwCtx, std::move(cb));
 }
 
+template <typename T>
+void NetworkAsio::doAccept(uint32_t index) {
+  auto cb = [this, index](const std::error_code& ec, tcp::socket socket) {
+    if (onAccept<T>(ec, std::move(socket), index)) {
+      doAccept<T>(index);
+    }
+  };
+  _rwAcceptors[index]->async_accept(std::move(cb));
+}
+
 void NetworkAsio::stop() {
   LOG(INFO) << "network-asio begin stops...";
   _isRunning.store(false, std::memory_order_relaxed);
@@ -280,7 +379,9 @@ void NetworkAsio::stop() {
   for (auto rwCtx : _rwCtxList) {
     rwCtx->stop();
   }
-  _acceptThd->join();
+  if (_acceptThd) {
+    _acceptThd->join();
+  }
   for (auto& v : _rwThreads) {
     v.join();
   }
@@ -290,27 +391,27 @@ void NetworkAsio::stop() {
 
 Status NetworkAsio::startThread() {
   _isRunning.store(true, std::memory_order_relaxed);
-  _acceptThd = std::make_unique<std::thread>([this] {
-    std::string threadName = _name + "-accept";
-    threadName.resize(15);
-    INVARIANT(!pthread_setname_np(pthread_self(), threadName.c_str()));
-    while (_isRunning.load(std::memory_order_relaxed)) {
-      // if no work-gurad, the run() returns immediately if no other tasks
-      asio::io_context::work work(*_acceptCtx);
-      try {
-        _acceptCtx->run();
-      } catch (const std::exception& ex) {
-        LOG(FATAL) << "accept failed:" << ex.what();
-      } catch (...) {
-        LOG(FATAL) << "unknown exception";
+  // the io threads accept by themselves with SO_REUSEPORT
+  if (_rwAcceptors.empty()) {
+    _acceptThd = std::make_unique<std::thread>([this] {
+      std::string threadName = _name + "-accept";
+      threadName.resize(15);
+      INVARIANT(!pthread_setname_np(pthread_self(), threadName.c_str()));
+      while (_isRunning.load(std::memory_order_relaxed)) {
+        // if no work-gurad, the run() returns immediately if no other tasks
+        asio::io_context::work work(*_acceptCtx);
+        try {
+          _acceptCtx->run();
+        } catch (const std::exception& ex) {
+          LOG(FATAL) << "accept failed:" << ex.what();
+        } catch (...) {
+          LOG(FATAL) << "unknown exception";
+        }
       }
-    }
-  });
+    });
+  }
 
   LOG(INFO) << "NetworkAsio::run netIO _netIoThreadNum:" << _netIoThreadNum;
-  for (size_t i = 0; i < _netIoThreadNum; ++i) {
-    _rwCtxList.push_back(std::make_shared<asio::io_context>());
-  }
   for (size_t i = 0; i < _netIoThreadNum; ++i) {
     std::thread thd([this, i] {
       std::string threadName = _name + "-rw-" + std::to_string(i);
@@ -338,6 +439,16 @@ Status NetworkAsio::run(bool forGossip) {
   // TODO(deyukong): acceptor needs no explicitly listen.
   // but only through listen can we configure backlog.
   // _acceptor->listen(BACKLOG);
+  for (uint32_t i = 0; i < _rwAcceptors.size(); ++i) {
+    if (!forGossip) {
+      doAccept<NetSession>(i);
+    } else {
+      doAccept<ClusterSession>(i);
+    }
+  }
+  if (!_acceptor) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
   if (!forGossip) {
     doAccept<NetSession>();
   } else {
@@ -365,6 +476,8 @@ NetSession::NetSession(std::shared_ptr<ServerEntry> server,
     _bulkLen(-1),
     _isSendRunning(false),
     _isEnded(false),
+    _blockState(BlockState::None),
+    _sendBufferBytes(0),
     _netMatrix(netMatrix),
     _reqMatrix(reqMatrix) {
   if (initSock) {
@@ -490,6 +603,7 @@ Status NetSession::setResponse(const std::string& s) {
   auto v = std::make_shared<SendBuffer>();
   std::copy(s.begin(), s.end(), std::back_inserter(v->buffer));
   v->closeAfterThis = _closeAfterRsp;
+  _sendBufferBytes += v->buffer.size();
   if (_isSendRunning) {
     _sendBuffer.push_back(v);
   } else {
@@ -500,6 +614,37 @@ Status NetSession::setResponse(const std::string& s) {
   return {ErrorCodes::ERR_OK, ""};
 }
 
+Status NetSession::setSharedResponse(const std::shared_ptr<SendBuffer>& buf,
+                                     uint64_t limit) {
+  INVARIANT_D(!buf->closeAfterThis);
+  uint64_t pending = 0;
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    if (_isEnded || _closeAfterRsp) {
+      return {ErrorCodes::ERR_NETWORK, "connection is ended"};
+    }
+    pending = _sendBufferBytes + buf->buffer.size();
+    if (limit == 0 || pending <= limit) {
+      _sendBufferBytes = pending;
+      if (_isSendRunning) {
+        _sendBuffer.push_back(buf);
+      } else {
+        _isSendRunning = true;
+        drainRsp(buf);
+      }
+      return {ErrorCodes::ERR_OK, ""};
+    }
+  }
+
+  // a slow consumer, drop it rather than buffering without bound
+  LOG(WARNING) << "close session, id:" << id() << ",connId:" << _connId
+               << ",remote:" << getRemote() << " for pending output "
+               << pending << " exceeding limit " << limit;
+  cancel();
+  endSession();
+  return {ErrorCodes::ERR_NETWORK, "output buffer limit exceeded"};
+}
+
 void NetSession::start() {
   stepState();
 }
@@ -858,9 +1003,15 @@ void NetSession::processReq() {
     _reqMatrix->processed += 1;
     _reqMatrix->processCost += nsSinceEpoch() - _ctx->getProcessPacketStart();
     _ctx->setProcessPacketStart(0);
+    if (!_ctx->isBlocked()) {
+      _ctx->clearBlockDeadline();
+    }
   }
   if (!continueSched) {
     endSession();
+  } else if (_ctx->isBlocked()) {
+    // the reply is sent when the command runs again after unblock()
+    parkBlocked();
   } else if (!_closeAfterRsp) {
     resetMultiBulkCtx();
     if (_queryBufPos == 0) {
@@ -876,6 +1027,72 @@ void NetSession::processReq() {
   }
 }
 
+void NetSession::parkBlocked() {
+  bool woken = false;
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    if (_blockState == BlockState::Woken) {
+      woken = true;
+      _blockState = BlockState::None;
+    } else {
+      INVARIANT_D(_blockState == BlockState::None);
+      _blockState = BlockState::Parked;
+    }
+  }
+  if (woken) {
+    // the keys were pushed before we got here, run the command again
+    _ctx->resetBlocked();
+    schedule();
+    return;
+  }
+  watchBlocked();
+}
+
+void NetSession::unblock() {
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    if (_isEnded) {
+      return;
+    }
+    if (_blockState != BlockState::Parked) {
+      // processReq() is still on the way to parkBlocked()
+      _blockState = BlockState::Woken;
+      return;
+    }
+    _blockState = BlockState::None;
+  }
+  _ctx->resetBlocked();
+  // state is still Process with the same args, so the blocking command
+  // runs again and either pops, replies nil on timeout or blocks again
+  schedule();
+}
+
+void NetSession::watchBlocked() {
+  auto self(shared_from_this());
+  _sock.async_wait(
+    asio::ip::tcp::socket::wait_read, [this, self](const std::error_code& ec) {
+      if (ec) {
+        return;
+      }
+      char c;
+      std::error_code rec;
+      size_t n = _sock.receive(
+        asio::buffer(&c, 1), asio::socket_base::message_peek, rec);
+      if (rec == asio::error::would_block) {
+        std::lock_guard<std::mutex> lk(_mutex);
+        if (_blockState == BlockState::Parked) {
+          watchBlocked();
+        }
+        return;
+      }
+      if (rec || n == 0) {
+        // peer closed, drop the waiter by ServerEntry::endSession()
+        endSession();
+      }
+      // else: pipelined requests, they are read after unblock()
+    });
+}
+
 void NetSession::drainRsp(std::shared_ptr<SendBuffer> buf) {
   auto self(shared_from_this());
   uint64_t now = nsSinceEpoch();
@@ -914,6 +1131,7 @@ void NetSession::drainRspCallback(const std::error_code& ec,
 
   std::lock_guard<std::mutex> lk(_mutex);
   INVARIANT(_isSendRunning);
+  _sendBufferBytes -= buf->buffer.size();
   if (_sendBuffer.size() > 0) {
     auto it = _sendBuffer.front();
     _sendBuffer.pop_front();
@@ -931,6 +1149,9 @@ void NetSession::endSession() {
     }
     _isEnded = true;
     ++_netMatrix->connReleased;
+    if (_ioThreadId < _netMatrix->ioThreadConns.size()) {
+      --_netMatrix->ioThreadConns[_ioThreadId];
+    }
     DLOG(INFO) << "net session, id:" << id() << ",connId:" << _connId
                << " destroyed";
   }
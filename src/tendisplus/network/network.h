@@ -43,6 +43,14 @@ class NetworkMatrix {
   Atom<uint64_t> connCreated{0};
   Atom<uint64_t> connReleased{0};
   Atom<uint64_t> invalidPackets{0};
+  // time cost of setting the accepted connections up (ns), which a single
+  // acceptor does one by one
+  Atom<uint64_t> acceptCost{0};
+  // the connections accepted onto each io thread, and those still alive,
+  // sized by NetworkAsio::prepare() before any connection
+  std::vector<Atom<uint64_t>> ioThreadAccepted;
+  std::vector<Atom<uint64_t>> ioThreadConns;
+  void setIoThreadNum(size_t num);
   NetworkMatrix operator-(const NetworkMatrix& right);
   std::string toString() const;
   void reset();
@@ -98,9 +106,19 @@ class NetworkAsio {
 
  private:
   Status startThread();
+  // the acceptors of the io threads, on the same port with SO_REUSEPORT
+  Status prepareReusePort(const asio::ip::tcp::endpoint& ep);
   // we envolve a single-thread accept, mutex is not needed.
   template <typename T>
   void doAccept();
+  // accept on the acceptor of an io thread, the sessions stay on it
+  template <typename T>
+  void doAccept(uint32_t index);
+  // false if the server is shutting down
+  template <typename T>
+  bool onAccept(const std::error_code& ec,
+                asio::ip::tcp::socket socket,
+                uint32_t index);
   std::shared_ptr<asio::io_context> getRwCtx();
   std::shared_ptr<asio::io_context> getRwCtx(asio::ip::tcp::socket& socket);
 
@@ -109,6 +127,8 @@ class NetworkAsio {
   std::unique_ptr<asio::io_context> _acceptCtx;
   std::vector<std::shared_ptr<asio::io_context>> _rwCtxList;
   std::unique_ptr<asio::ip::tcp::acceptor> _acceptor;
+  // one for each of _rwCtxList if net-reuseport-accept, else empty
+  std::vector<std::unique_ptr<asio::ip::tcp::acceptor>> _rwAcceptors;
   std::unique_ptr<std::thread> _acceptThd;
   std::vector<std::thread> _rwThreads;
   std::atomic<bool> _isRunning;
@@ -143,11 +163,17 @@ class NetSession : public Session {
   virtual std::string getLocalRepr() const;
   asio::ip::tcp::socket borrowConn();
   virtual Status setResponse(const std::string& s);
+  // queue a buffer shared by many sessions, e.g. a pubsub message.
+  // if limit > 0 and the pending output would exceed it, the session is
+  // closed instead.
+  Status setSharedResponse(const std::shared_ptr<SendBuffer>& buf,
+                           uint64_t limit);
   void setCloseAfterRsp();
   virtual void start();
   virtual Status cancel();
   virtual std::string getRemote() const;
   virtual int getFd();
+  virtual void unblock();
 
   virtual Expected<std::string> getRemoteIp() const;
   virtual Expected<uint32_t> getRemotePort() const;
@@ -162,6 +188,7 @@ class NetSession : public Session {
   void setArgs(const std::vector<std::string>&);
   void setIoCtxId(uint32_t id) {
     _ioCtxId = id;
+    _ioThreadId = id;
   }
   enum class State {
     Created,
@@ -191,6 +218,10 @@ class NetSession : public Session {
   virtual void processReq();
   // cleanup state for next request
   virtual void resetMultiBulkCtx();
+  // leave the session in Process state until unblock() is called
+  virtual void parkBlocked();
+  // close the session if the peer goes away while it is parked
+  void watchBlocked();
 
  private:
   FRIEND_TEST(NetSession, drainReqInvalid);
@@ -219,17 +250,32 @@ class NetSession : public Session {
   int64_t _multibulklen;
   int64_t _bulkLen;
 
-  // _mutex protects _isSendRunning, _isEnded, _sendBuffer
-  // other variables will never be visited in send-threads.
+  enum class BlockState {
+    None,
+    // parked by a blocking command, waiting for unblock()
+    Parked,
+    // unblock() came before the session parked itself
+    Woken,
+  };
+
+  // _mutex protects _isSendRunning, _isEnded, _sendBuffer, _blockState
+  // and _sendBufferBytes, other variables will never be visited in
+  // send-threads.
   std::mutex _mutex;
   bool _isSendRunning;
   bool _isEnded;
+  BlockState _blockState;
   bool _first;
   std::list<std::shared_ptr<SendBuffer>> _sendBuffer;
+  // bytes queued but not written yet, including the one being sent
+  uint64_t _sendBufferBytes;
 
   std::shared_ptr<NetworkMatrix> _netMatrix;
   std::shared_ptr<RequestMatrix> _reqMatrix;
   uint32_t _ioCtxId = UINT32_MAX;
+  // the io thread which accepted it, for NetworkMatrix::ioThreadConns,
+  // while _ioCtxId may be moved to another executor by schedule()
+  uint32_t _ioThreadId = UINT32_MAX;
 };
 
 }  // namespace tendisplus
@@ -210,6 +210,34 @@ class server {
   asio::ip::tcp::acceptor* _acceptor;
 };
 
+TEST(NetworkMatrix, IoThreads) {
+  NetworkMatrix m;
+  m.setIoThreadNum(2);
+  ++m.connCreated;
+  ++m.ioThreadAccepted[1];
+  ++m.ioThreadConns[1];
+  m.acceptCost += 100;
+  NetworkMatrix old = m;
+
+  ++m.ioThreadAccepted[1];
+  ++m.ioThreadConns[1];
+  ++m.ioThreadAccepted[0];
+  m.acceptCost += 50;
+  auto diff = m - old;
+  EXPECT_EQ(diff.acceptCost.get(), 50);
+  EXPECT_EQ(diff.ioThreadAccepted[0].get(), 1);
+  EXPECT_EQ(diff.ioThreadAccepted[1].get(), 1);
+  // the alive connections are not a counter
+  EXPECT_EQ(diff.ioThreadConns[1].get(), 2);
+
+  m.reset();
+  EXPECT_EQ(m.acceptCost.get(), 0);
+  EXPECT_EQ(m.ioThreadAccepted[1].get(), 0);
+  EXPECT_EQ(m.ioThreadConns[1].get(), 2);
+  EXPECT_NE(m.toString().find("ioThread1\taccepted:0 conns:2"),
+            std::string::npos);
+}
+
 TEST(BlockingTcpClient, Common) {
   auto ioCtx = std::make_shared<asio::io_context>();
   auto ioCtx1 = std::make_shared<asio::io_context>();
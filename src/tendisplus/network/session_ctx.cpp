@@ -31,7 +31,9 @@ SessionCtx::SessionCtx(Session* sess)
     _replOnly(false),
     _session(sess),
     _isMonitor(false),
-    _flags(0) {
+    _flags(0),
+    _blockDeadline(0),
+    _keyTracking(KeyTracking::NONE) {
   _perfContext.Reset();
   _ioContext.Reset();
 }
@@ -106,6 +108,49 @@ void SessionCtx::clearRequestCtx() {
   _perfLevelFlag = false;
 }
 
+void SessionCtx::reset() {
+  clearRequestCtx();
+  _authed = false;
+  _dbId = 0;
+  _waitlockStore = 0;
+  _waitlockChunk = 0;
+  _waitlockMode = mgl::LockMode::LOCK_NONE;
+  _waitlockKey.clear();
+  _processPacketStart = 0;
+  _perfLevel = PerfLevel::kDisable;
+  _txnVersion = -1;
+  _extendProtocol = false;
+  _replOnly = false;
+  _keylockmap.clear();
+  _isMonitor = false;
+  _flags = 0;
+  _blockDeadline = 0;
+  _keyTracking = KeyTracking::NONE;
+  _writtenKeys.clear();
+  _multiCmds.clear();
+  _nestedTxns.clear();
+
+  std::lock_guard<std::mutex> lk(_mutex);
+  _perfContext.Reset();
+  _ioContext.Reset();
+}
+
+Transaction* SessionCtx::getNestedTxn(const std::string& storeId) const {
+  if (_nestedTxns.empty()) {
+    return nullptr;
+  }
+  auto it = _nestedTxns.find(storeId);
+  return it == _nestedTxns.end() ? nullptr : it->second;
+}
+
+void SessionCtx::setNestedTxn(const std::string& storeId, Transaction* txn) {
+  if (txn) {
+    _nestedTxns[storeId] = txn;
+  } else {
+    _nestedTxns.erase(storeId);
+  }
+}
+
 Expected<Transaction*> SessionCtx::createTransaction(const PStore& kvstore) {
   Transaction* txn = nullptr;
   if (_txnMap.count(kvstore->dbId()) > 0) {
@@ -28,6 +28,17 @@ namespace tendisplus {
 
 #define InMulti (1 << 0)
 #define CLIENT_READONLY (1 << 1)
+#define CLIENT_BLOCKED (1 << 2)
+// subscribes to some channels or patterns
+#define CLIENT_PUBSUB (1 << 3)
+// CLIENT TRACKING ON, not in BCAST mode
+#define CLIENT_TRACKING (1 << 4)
+// running the commands of EVAL/EVALSHA
+#define CLIENT_SCRIPT (1 << 5)
+// a command queued by MULTI failed its check, EXEC will be aborted
+#define CLIENT_DIRTY_EXEC (1 << 6)
+// running the queued commands of EXEC
+#define CLIENT_EXEC (1 << 7)
 
 // storeLock state pair
 using SLSP = std::tuple<uint32_t, uint32_t, std::string, mgl::LockMode>;
@@ -73,6 +84,8 @@ class SessionCtx {
   std::vector<std::string> getArgsBrief() const;
   void setArgsBrief(const std::vector<std::string>& v);
   void clearRequestCtx();
+  // back to the state of a new session, for a pooled LocalSession
+  void reset();
   Status commitAll(const std::string& cmd);
   Status rollbackAll();
   Expected<Transaction*> createTransaction(const PStore& kvstore);
@@ -117,8 +130,19 @@ class SessionCtx {
     _txnVersion = _version;
   }
   inline void resetMulti() {
-    _flags &= ~InMulti;
+    _flags &= ~(InMulti | CLIENT_DIRTY_EXEC);
     _txnVersion = -1;
+    _multiCmds.clear();
+  }
+  // the commands between MULTI and EXEC, not used by the extended
+  // protocol, whose commands are run at once
+  inline void queueMultiCmd(const std::vector<std::string>& args) {
+    _multiCmds.push_back(args);
+  }
+  inline std::vector<std::vector<std::string>> popMultiCmds() {
+    std::vector<std::vector<std::string>> cmds;
+    cmds.swap(_multiCmds);
+    return cmds;
   }
   uint32_t getFlags() {
     return _flags;
@@ -131,6 +155,51 @@ class SessionCtx {
   }
   bool verifyVersion(uint64_t keyVersion);
 
+  // set by blocking commands when the session is parked on some keys,
+  // the deadline is kept until the command finally replies, so that
+  // the command can be run again after wakeup with the same deadline.
+  inline bool isBlocked() const {
+    return (_flags & CLIENT_BLOCKED);
+  }
+  inline void setBlocked(uint64_t deadlineMs) {
+    _flags |= CLIENT_BLOCKED;
+    _blockDeadline = deadlineMs;
+  }
+  inline void resetBlocked() {
+    _flags &= ~CLIENT_BLOCKED;
+  }
+  inline uint64_t getBlockDeadline() const {
+    return _blockDeadline;
+  }
+  inline void clearBlockDeadline() {
+    _blockDeadline = 0;
+  }
+
+  // set by Command::runSessionCmd() when client side caching is used,
+  // tells the key lock path whether the keys of the running command
+  // should be remembered for the session, or invalidated after the write.
+  enum class KeyTracking : unsigned char { NONE, READ, WRITE };
+  inline KeyTracking getKeyTracking() const {
+    return _keyTracking;
+  }
+  inline void setKeyTracking(KeyTracking mode) {
+    _keyTracking = mode;
+  }
+  inline void addWrittenKey(const std::string& key) {
+    _writtenKeys.push_back(key);
+  }
+  inline std::vector<std::string> popWrittenKeys() {
+    std::vector<std::string> keys;
+    keys.swap(_writtenKeys);
+    return keys;
+  }
+
+  // set by EVAL and EXEC while they run, the transactions created for the
+  // session on a kvstore are nested in the one set for it, nullptr if none.
+  Transaction* getNestedTxn(const std::string& storeId) const;
+  // txn is not owned, nullptr to unset
+  void setNestedTxn(const std::string& storeId, Transaction* txn);
+
   static constexpr uint64_t VERSIONEP_UNINITED = -1;
   static constexpr uint64_t TSEP_UNINITED = -1;
 
@@ -154,6 +223,13 @@ class SessionCtx {
   std::unordered_map<std::string, mgl::LockMode> _keylockmap;
   bool _isMonitor;
   uint32_t _flags;
+  // 0 if the session is not running a blocking command
+  uint64_t _blockDeadline;
+  KeyTracking _keyTracking;
+  std::vector<std::string> _writtenKeys;
+  std::vector<std::vector<std::string>> _multiCmds;
+  // NOTE: not owned by me
+  std::unordered_map<std::string, Transaction*> _nestedTxns;
 
   mutable std::mutex _mutex;
 
@@ -2,12 +2,18 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include "rapidjson/document.h"
+
 #include "tendisplus/utils/param_manager.h"
 #include "tendisplus/utils/base64.h"
+#include "tendisplus/utils/string.h"
 #include "tendisplus/storage/kvstore.h"
 #include "tendisplus/storage/varint.h"
 #include "tendisplus/storage/record.h"
@@ -17,10 +23,17 @@ namespace tendisplus {
 // TODO(takenliu) print error to stderr or logfile?
 class BinlogScanner {
  public:
-  enum TOOL_MODE { TEXT_SHOW = 0, BASE64_SHOW, TEXT_SHOW_SCOPE };
-
-  void init(const tendisplus::ParamManager& pm) {
-    _logfile = pm.getString("logfile");
+  // RESTORE is BASE64_SHOW for point in time recovery, it stops at the
+  // first binlog after end-datetime, as the binlogs of a store are in
+  // order. With --backup, the binlogs already in the backup are skipped.
+  enum TOOL_MODE { TEXT_SHOW = 0, BASE64_SHOW, TEXT_SHOW_SCOPE, RESTORE };
+
+  Status init(const tendisplus::ParamManager& pm) {
+    // the dumped binlog files of one store, in order
+    _logfiles = stringSplit(pm.getString("logfile"), ",");
+    if (_logfiles.empty()) {
+      return {ErrorCodes::ERR_PARSEOPT, "logfile is required"};
+    }
     _startDatetime = pm.getUint64("start-datetime", _startDatetime);
     _endDatetime = pm.getUint64("end-datetime", _endDatetime);
     _startPosition = pm.getUint64("start-position", _startPosition);
@@ -30,7 +43,38 @@ class BinlogScanner {
       _mode = TOOL_MODE::BASE64_SHOW;
     } else if (pm.getString("mode") == "scope") {
       _mode = TOOL_MODE::TEXT_SHOW_SCOPE;
+    } else if (pm.getString("mode") == "restore") {
+      _mode = TOOL_MODE::RESTORE;
     }
+
+    auto backup = pm.getString("backup");
+    if (!backup.empty()) {
+      auto pos = getBackupBinlogPos(backup);
+      if (!pos.ok()) {
+        return pos.status();
+      }
+      _startPosition = std::max(_startPosition, pos.value() + 1);
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  // the binlogpos of the backup_meta in a store dir of a backup
+  static Expected<uint64_t> getBackupBinlogPos(const std::string& dir) {
+    std::string filename = dir + "/backup_meta";
+    std::ifstream metafile(filename);
+    if (!metafile.is_open()) {
+      return {ErrorCodes::ERR_INTERNAL, "open file failed:" + filename};
+    }
+    std::stringstream ss;
+    ss << metafile.rdbuf();
+
+    rapidjson::Document doc;
+    doc.Parse(ss.str());
+    if (doc.HasParseError() || !doc.IsObject() ||
+        !doc.HasMember("binlogpos") || !doc["binlogpos"].IsUint64()) {
+      return {ErrorCodes::ERR_INTERNAL, "invalid backup meta:" + filename};
+    }
+    return doc["binlogpos"].GetUint64();
   }
 
   bool isFiltered(const ReplLogKeyV2& logkey, const ReplLogValueV2& logValue) {
@@ -58,6 +102,11 @@ class BinlogScanner {
       return "decode logvalue failed";
     }
 
+    if (_mode == TOOL_MODE::RESTORE &&
+        logValue.value().getTimestamp() > _endDatetime) {
+      _done = true;
+      return "";
+    }
     if (isFiltered(logkey.value(), logValue.value())) {
       return "";
     }
@@ -104,7 +153,8 @@ class BinlogScanner {
                   << " skey:" << opkey.value().getSecondaryKey()
                   << " opvalue:" << opvalue.value().getValue() << std::endl;
       }
-    } else if (_mode == TOOL_MODE::BASE64_SHOW) {
+    } else if (_mode == TOOL_MODE::BASE64_SHOW ||
+               _mode == TOOL_MODE::RESTORE) {
       std::string baseKey =
         Base64::Encode((unsigned char*)key.c_str(), key.size());
       std::string baseValue =
@@ -123,8 +173,8 @@ class BinlogScanner {
     return "";
   }
 
-  Expected<std::string> scan() {
-    FILE* pf = fopen(_logfile.c_str(), "r");
+  Expected<std::string> scan(const std::string& logfile) {
+    FILE* pf = fopen(logfile.c_str(), "r");
     if (pf == NULL) {
       return {ErrorCodes::ERR_INTERNAL, "fopen failed"};
     }
@@ -140,7 +190,7 @@ class BinlogScanner {
     uint32_t storeId =
       be32toh(*reinterpret_cast<uint32_t*>(buff + strlen(BINLOG_HEADER_V2)));
 
-    while (!feof(pf)) {
+    while (!feof(pf) && !_done) {
       // keylen
       uint32_t keylen = 0;
       ret = fread(buff, sizeof(uint32_t), 1, pf);
@@ -194,7 +244,18 @@ class BinlogScanner {
   }
 
   Expected<std::string> run() {
-    auto e = scan();
+    Expected<std::string> e{ErrorCodes::ERR_OK, ""};
+    std::string logfile;
+    for (const auto& f : _logfiles) {
+      if (_done) {
+        break;
+      }
+      logfile = f;
+      e = scan(logfile);
+      if (!e.ok()) {
+        break;
+      }
+    }
     if (_mode == TOOL_MODE::TEXT_SHOW_SCOPE) {
       std::cout << "firstbinlogid:" << _firstbinlogid << std::endl;
       std::cout << "lastbinlogid:" << _lastbinlogid << std::endl;
@@ -204,15 +265,16 @@ class BinlogScanner {
 
     if (!e.ok()) {
       return {e.status().code(),
-              e.status().getErrmsg() + ". file name: " + _logfile};
+              e.status().getErrmsg() + ". file name: " + logfile};
     }
 
     return e;
   }
 
  private:
-  std::string _logfile;
+  std::vector<std::string> _logfiles;
   TOOL_MODE _mode;
+  bool _done = false;
   uint64_t _startDatetime = 0;
   uint64_t _endDatetime = UINT64_MAX;
   uint64_t _startPosition = 0;
@@ -227,10 +289,15 @@ class BinlogScanner {
 }  // namespace tendisplus
 
 void usage() {
-  std::cerr << "binlog_tool --logfile=binlog.log --mode=text|base64|scope"
+  std::cerr << "binlog_tool --logfile=binlog.log[,binlog2.log...]"
+            << " --mode=text|base64|scope|restore"
             << " --start-datetime=1111 --end-datetime=22222"
             << " --start-position=333333 --end-position=55555"
+            << " --backup=backupdir/storeid"
             << /*" --keys=1,2,4,5,6,7,8,9" <<*/ std::endl;
+  std::cerr << "restore to a point in time: restore the backup, then"
+            << " binlog_tool --mode=restore --backup=backupdir/storeid"
+            << " --end-datetime=ts --logfile=... | redis-cli" << std::endl;
 }
 
 int main(int argc, char** argv) {
@@ -242,7 +309,11 @@ int main(int argc, char** argv) {
   pm.init(argc, argv);
 
   tendisplus::BinlogScanner bs;
-  bs.init(pm);
+  auto s = bs.init(pm);
+  if (!s.ok()) {
+    std::cerr << s.toString() << std::endl;
+    return 1;
+  }
   auto e = bs.run();
   if (e.ok()) {
     return 0;
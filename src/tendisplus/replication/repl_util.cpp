@@ -4,11 +4,14 @@
 
 #include "tendisplus/replication/repl_util.h"
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 #include "glog/logging.h"
 #include "tendisplus/commands/command.h"
+#include "tendisplus/storage/skiplist.h"
 
 namespace tendisplus {
 
@@ -227,6 +230,16 @@ Expected<BinlogResult> applySingleTxnV2(Session* sess,
     return value.status();
   }
 
+  // keys changed by the binlog, for the tracking sessions of a slave
+  bool tracking = svr->getTrackingMgr()->isActive();
+  bool trackingAll = false;
+  std::vector<std::string> trackingKeys;
+  // zsets changed by the binlog, whose nodes shared by the transactions
+  // are dropped after the commit
+  SkipListCache* slCache = store->getSkipListCache();
+  bool slCacheAll = false;
+  std::vector<std::string> slCacheKeys;
+
   uint64_t timestamp = 0;
   size_t offset = value.value().getHdrSize();
   auto data = value.value().getData();
@@ -245,6 +258,37 @@ Expected<BinlogResult> applySingleTxnV2(Session* sess,
     if (!s.ok()) {
       return s;
     }
+    if (slCache && !slCacheAll) {
+      if (entry.value().getOp() == ReplOp::REPL_OP_DEL_RANGE) {
+        slCacheAll = true;
+      } else {
+        auto type = RecordKey::decodeType(entry.value().getOpKey());
+        if (type == RecordType::RT_DATA_META ||
+            type == RecordType::RT_ZSET_S_ELE) {
+          auto rk = RecordKey::decode(entry.value().getOpKey());
+          if (rk.ok()) {
+            slCacheKeys.emplace_back(
+              SkipListCache::zsetKey(rk.value().getChunkId(),
+                                     rk.value().getDbId(),
+                                     rk.value().getPrimaryKey()));
+          }
+        }
+      }
+    }
+    if (tracking && !trackingAll) {
+      if (entry.value().getOp() == ReplOp::REPL_OP_DEL_RANGE) {
+        trackingAll = true;
+      } else {
+        auto type = RecordKey::decodeType(entry.value().getOpKey());
+        if (type != RecordType::RT_TTL_INDEX && type != RecordType::RT_BINLOG &&
+            type != RecordType::RT_META) {
+          auto rk = RecordKey::decode(entry.value().getOpKey());
+          if (rk.ok()) {
+            trackingKeys.emplace_back(rk.value().getPrimaryKey());
+          }
+        }
+      }
+    }
   }
 
   if (offset != dataSize) {
@@ -284,6 +328,23 @@ Expected<BinlogResult> applySingleTxnV2(Session* sess,
   // only need to set the last timestamp
   store->setBinlogTime(timestamp);
 
+  if (slCacheAll) {
+    slCache->clear();
+  } else {
+    for (const auto& k : slCacheKeys) {
+      slCache->invalidate(k);
+    }
+  }
+
+  if (trackingAll) {
+    svr->getTrackingMgr()->invalidateAll();
+  } else if (!trackingKeys.empty()) {
+    std::sort(trackingKeys.begin(), trackingKeys.end());
+    trackingKeys.erase(std::unique(trackingKeys.begin(), trackingKeys.end()),
+                       trackingKeys.end());
+    svr->getTrackingMgr()->invalidateKeys(trackingKeys, 0);
+  }
+
   BinlogResult br;
   br.binlogTs = timestamp;
   br.binlogId = binlogId;
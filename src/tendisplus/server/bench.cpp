@@ -0,0 +1,573 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+// tendisplus_bench drives the commands through LocalSession, without the
+// network, against a ServerEntry started on a temporary directory, and
+// prints the throughput and latency percentiles of each workload as JSON.
+// ./tendisplus_bench --threads=8 --ops=100000 --workloads=set,get,mixed
+// ./tendisplus_bench --workloads=replay --replay=capture.bin
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+#include "tendisplus/commands/command.h"
+#include "tendisplus/commands/version.h"
+#include "tendisplus/network/session_ctx.h"
+#include "tendisplus/server/monitor_manager.h"
+#include "tendisplus/server/server_entry.h"
+#include "tendisplus/server/server_params.h"
+#include "tendisplus/storage/varint.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/param_manager.h"
+#include "tendisplus/utils/portable.h"
+#include "tendisplus/utils/string.h"
+
+namespace tendisplus {
+namespace bench {
+
+struct Options {
+  std::string dir = "./tendisplus_bench";
+  // appended to the generated config file
+  std::string config;
+  uint32_t threads = 8;
+  uint64_t ops = 100000;  // per thread
+  uint64_t keys = 100000;
+  uint32_t valueSize = 64;
+  uint32_t fields = 10;  // of hash and zset
+  uint32_t batch = 10;   // keys of MGET
+  uint32_t ttl = 0;      // seconds, 0 means no ttl
+  uint32_t kvStoreCount = 10;
+  std::vector<std::string> workloads = {"set",
+                                        "get",
+                                        "hset",
+                                        "hgetall",
+                                        "zadd",
+                                        "zrange",
+                                        "lpush",
+                                        "lpop",
+                                        "mget",
+                                        "mixed"};
+  std::string replay;  // a file of TRAFFICCAPTURE
+  bool keep = false;
+};
+
+static void usage() {
+  std::cout
+    << "./tendisplus_bench [--option=value] ...\n"
+    << "  --dir=path           data directory, removed at exit\n"
+    << "  --config=path        extra config lines for the server\n"
+    << "  --threads=n          client threads\n"
+    << "  --ops=n              operations of each thread and workload\n"
+    << "  --keys=n             size of the key space\n"
+    << "  --value-size=n       bytes of a value\n"
+    << "  --fields=n           fields of a hash or members of a zset\n"
+    << "  --batch=n            keys of a MGET\n"
+    << "  --ttl=n              expire the written keys in n seconds\n"
+    << "  --kvstorecount=n     kvstores of the server\n"
+    << "  --workloads=a,b,...  set,get,hset,hgetall,zadd,zrange,lpush,lpop,\n"
+    << "                       mget,mixed,replay\n"
+    << "  --replay=path        the file of TRAFFICCAPTURE, for replay\n"
+    << "  --keep               keep the data directory\n";
+}
+
+static Expected<Options> parseOptions(int argc, char* argv[]) {
+  ParamManager pm;
+  pm.init(argc, argv);
+
+  Options opts;
+  opts.dir = pm.getString("dir", opts.dir);
+  opts.config = pm.getString("config");
+  opts.threads = pm.getUint64("threads", opts.threads);
+  opts.ops = pm.getUint64("ops", opts.ops);
+  opts.keys = pm.getUint64("keys", opts.keys);
+  opts.valueSize = pm.getUint64("value-size", opts.valueSize);
+  opts.fields = pm.getUint64("fields", opts.fields);
+  opts.batch = pm.getUint64("batch", opts.batch);
+  opts.ttl = pm.getUint64("ttl", opts.ttl);
+  opts.kvStoreCount = pm.getUint64("kvstorecount", opts.kvStoreCount);
+  auto workloads = pm.getString("workloads");
+  if (!workloads.empty()) {
+    opts.workloads = stringSplit(workloads, ",");
+  }
+  opts.replay = pm.getString("replay");
+  opts.keep = pm.getString("keep", "no") != "no";
+
+  if (opts.dir.empty() || opts.threads == 0 || opts.ops == 0 ||
+      opts.keys == 0 || opts.fields == 0 || opts.batch == 0 ||
+      opts.kvStoreCount == 0) {
+    return {ErrorCodes::ERR_PARSEOPT, "invalid options"};
+  }
+  return opts;
+}
+
+static Expected<std::shared_ptr<ServerEntry>> startServer(
+  const Options& opts) {
+  std::error_code ec;
+  filesystem::remove_all(opts.dir, ec);
+  for (auto sub : {"/db", "/log", "/dump"}) {
+    if (!filesystem::create_directories(opts.dir + sub, ec)) {
+      return {ErrorCodes::ERR_INTERNAL,
+              "create " + opts.dir + sub + " failed:" + ec.message()};
+    }
+  }
+
+  std::string cfgFile = opts.dir + "/bench.cfg";
+  std::ofstream cfg(cfgFile);
+  cfg << "bind 127.0.0.1\n";
+  // the network is started by ServerEntry::startup(), but never used
+  cfg << "port " << 20000 + getpid() % 20000 << "\n";
+  cfg << "logdir " << opts.dir << "/log\n";
+  cfg << "dir " << opts.dir << "/db\n";
+  cfg << "dumpdir " << opts.dir << "/dump\n";
+  cfg << "pidfile " << opts.dir << "/tendisplus.pid\n";
+  cfg << "storage rocks\n";
+  cfg << "kvStoreCount " << opts.kvStoreCount << "\n";
+  if (!opts.config.empty()) {
+    std::ifstream extra(opts.config);
+    if (!extra.is_open()) {
+      return {ErrorCodes::ERR_INTERNAL, "open " + opts.config + " failed"};
+    }
+    cfg << extra.rdbuf() << "\n";
+  }
+  cfg.close();
+
+  auto params = std::make_shared<ServerParams>();
+  auto s = params->parseFile(cfgFile);
+  if (!s.ok()) {
+    return s;
+  }
+  FLAGS_log_dir = params->logDir;
+  ::google::InitGoogleLogging("tendisplus_bench");
+
+  auto server = std::make_shared<ServerEntry>(params);
+  s = server->startup(params);
+  if (!s.ok()) {
+    return s;
+  }
+  return server;
+}
+
+struct Result {
+  std::string workload;
+  uint64_t ops = 0;
+  uint64_t errors = 0;
+  double seconds = 0;
+  // nanoseconds of each operation
+  std::vector<uint64_t> latencies;
+};
+
+using Rnd = std::mt19937_64;
+using Args = std::vector<std::string>;
+// makes the arguments of the next operation of a thread
+using ArgsMaker = std::function<void(Rnd* rnd, Args* args)>;
+
+class Workloads {
+ public:
+  explicit Workloads(const Options& opts)
+    : _opts(opts), _value(opts.valueSize, 'v') {}
+
+  bool exists(const std::string& name) const {
+    return name == "mixed" || getSimple(name) != nullptr;
+  }
+
+  ArgsMaker get(const std::string& name) const {
+    if (name != "mixed") {
+      return getSimple(name);
+    }
+    // read mostly, like a cache
+    return [this](Rnd* rnd, Args* args) {
+      static const std::vector<std::pair<uint32_t, std::string>> kMix = {
+        {50, "get"},
+        {15, "set"},
+        {10, "hgetall"},
+        {5, "hset"},
+        {5, "zrange"},
+        {5, "zadd"},
+        {3, "lpush"},
+        {2, "lpop"},
+        {5, "mget"}};
+      uint32_t r = (*rnd)() % 100;
+      for (const auto& m : kMix) {
+        if (r < m.first) {
+          getSimple(m.second)(rnd, args);
+          return;
+        }
+        r -= m.first;
+      }
+    };
+  }
+
+ private:
+  std::string key(const char* prefix, Rnd* rnd) const {
+    return std::string(prefix) + std::to_string((*rnd)() % _opts.keys);
+  }
+
+  void appendTtl(Args* args) const {
+    if (_opts.ttl != 0) {
+      args->push_back("ex");
+      args->push_back(std::to_string(_opts.ttl));
+    }
+  }
+
+  ArgsMaker getSimple(const std::string& name) const {
+    if (name == "set") {
+      return [this](Rnd* rnd, Args* a) {
+        *a = {"set", key("k:", rnd), _value};
+        appendTtl(a);
+      };
+    } else if (name == "get") {
+      return [this](Rnd* rnd, Args* a) {
+        *a = {"get", key("k:", rnd)};
+      };
+    } else if (name == "hset") {
+      return [this](Rnd* rnd, Args* a) {
+        *a = {"hset",
+              key("h:", rnd),
+              "f" + std::to_string((*rnd)() % _opts.fields),
+              _value};
+      };
+    } else if (name == "hgetall") {
+      return [this](Rnd* rnd, Args* a) {
+        *a = {"hgetall", key("h:", rnd)};
+      };
+    } else if (name == "zadd") {
+      return [this](Rnd* rnd, Args* a) {
+        *a = {"zadd",
+              key("z:", rnd),
+              std::to_string((*rnd)() % 1000000),
+              "m" + std::to_string((*rnd)() % _opts.fields)};
+      };
+    } else if (name == "zrange") {
+      return [this](Rnd* rnd, Args* a) {
+        *a = {"zrange", key("z:", rnd), "0", "-1", "withscores"};
+      };
+    } else if (name == "lpush") {
+      return [this](Rnd* rnd, Args* a) {
+        *a = {"lpush", key("l:", rnd), _value};
+      };
+    } else if (name == "lpop") {
+      return [this](Rnd* rnd, Args* a) {
+        *a = {"lpop", key("l:", rnd)};
+      };
+    } else if (name == "mget") {
+      return [this](Rnd* rnd, Args* a) {
+        a->clear();
+        a->push_back("mget");
+        for (uint32_t j = 0; j < _opts.batch; j++) {
+          a->push_back(key("k:", rnd));
+        }
+      };
+    }
+    return nullptr;
+  }
+
+  const Options& _opts;
+  const std::string _value;
+};
+
+static bool runOne(LocalSession* sess,
+                   const Args& args,
+                   std::vector<uint64_t>* latencies) {
+  sess->setArgs(args);
+  auto start = std::chrono::steady_clock::now();
+  auto ret = Command::runSessionCmd(sess);
+  auto end = std::chrono::steady_clock::now();
+  latencies->push_back(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+  return ret.ok();
+}
+
+// every thread runs opts.ops operations, in its own LocalSession
+static Result runWorkload(const std::shared_ptr<ServerEntry>& server,
+                          const Options& opts,
+                          const std::string& name,
+                          const ArgsMaker& maker) {
+  std::vector<Result> results(opts.threads);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t t = 0; t < opts.threads; t++) {
+    threads.emplace_back([&, t] {
+      LocalSessionGuard sg(server.get());
+      auto sess = sg.getSession();
+      Rnd rnd(t * 7919 + 1);
+      Args args;
+      auto& result = results[t];
+      result.latencies.reserve(opts.ops);
+      for (uint64_t i = 0; i < opts.ops; i++) {
+        maker(&rnd, &args);
+        if (!runOne(sess, args, &result.latencies)) {
+          result.errors++;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  Result total;
+  total.workload = name;
+  total.seconds = std::chrono::duration<double>(end - start).count();
+  for (auto& result : results) {
+    total.errors += result.errors;
+    total.latencies.insert(total.latencies.end(),
+                           result.latencies.begin(),
+                           result.latencies.end());
+  }
+  total.ops = total.latencies.size();
+  return total;
+}
+
+struct CaptureRecord {
+  uint32_t dbId;
+  Args args;
+};
+
+// see MonitorManager for the format
+static Expected<std::map<uint64_t, std::vector<CaptureRecord>>> loadCapture(
+  const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open()) {
+    return {ErrorCodes::ERR_INTERNAL, "open " + path + " failed"};
+  }
+  std::string content((std::istreambuf_iterator<char>(in)),
+                      std::istreambuf_iterator<char>());
+  std::string magic(MonitorManager::CAPTURE_FILE_MAGIC);
+  if (content.compare(0, magic.size(), magic) != 0) {
+    return {ErrorCodes::ERR_DECODE, path + " is not a capture file"};
+  }
+
+  // session id -> records, in the order of capturing
+  std::map<uint64_t, std::vector<CaptureRecord>> sessions;
+  const char* p = content.data() + magic.size();
+  const char* end = content.data() + content.size();
+  auto corrupted = [&path]() -> Status {
+    return {ErrorCodes::ERR_DECODE, path + " is corrupted"};
+  };
+  while (p < end) {
+    if (end - p < 4 || end - p - 4 < int32Decode(p)) {
+      return corrupted();
+    }
+    const char* recEnd = p + 4 + int32Decode(p);
+    p += 4;
+    // timestamp, dbid, session id, argc
+    if (recEnd - p < 24) {
+      return corrupted();
+    }
+    CaptureRecord rec;
+    p += 8;
+    rec.dbId = int32Decode(p);
+    p += 4;
+    uint64_t sessId = int64Decode(p);
+    p += 8;
+    uint32_t argc = int32Decode(p);
+    p += 4;
+    for (uint32_t i = 0; i < argc; i++) {
+      if (recEnd - p < 4 || recEnd - p - 4 < int32Decode(p)) {
+        return corrupted();
+      }
+      uint32_t len = int32Decode(p);
+      rec.args.emplace_back(p + 4, len);
+      p += 4 + len;
+    }
+    if (p != recEnd || argc == 0) {
+      return corrupted();
+    }
+    sessions[sessId].emplace_back(std::move(rec));
+  }
+  return sessions;
+}
+
+// the sessions of the capture are spread over the threads, the commands
+// of a session are replayed in order, by one thread.
+static Expected<Result> runReplay(const std::shared_ptr<ServerEntry>& server,
+                                  const Options& opts) {
+  auto eSessions = loadCapture(opts.replay);
+  if (!eSessions.ok()) {
+    return eSessions.status();
+  }
+  std::vector<std::vector<const std::vector<CaptureRecord>*>> parts(
+    opts.threads);
+  size_t idx = 0;
+  for (const auto& kv : eSessions.value()) {
+    parts[idx++ % opts.threads].push_back(&kv.second);
+  }
+
+  std::vector<Result> results(opts.threads);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t t = 0; t < opts.threads; t++) {
+    threads.emplace_back([&, t] {
+      LocalSessionGuard sg(server.get());
+      auto sess = sg.getSession();
+      auto& result = results[t];
+      for (auto records : parts[t]) {
+        for (const auto& rec : *records) {
+          sess->getCtx()->setDbId(rec.dbId);
+          if (!runOne(sess, rec.args, &result.latencies)) {
+            result.errors++;
+          }
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  Result total;
+  total.workload = "replay";
+  total.seconds = std::chrono::duration<double>(end - start).count();
+  for (auto& result : results) {
+    total.errors += result.errors;
+    total.latencies.insert(total.latencies.end(),
+                           result.latencies.begin(),
+                           result.latencies.end());
+  }
+  total.ops = total.latencies.size();
+  return total;
+}
+
+static void writeResult(rapidjson::PrettyWriter<rapidjson::StringBuffer>* w,
+                        Result* result) {
+  auto& lats = result->latencies;
+  std::sort(lats.begin(), lats.end());
+  auto percentile = [&lats](double p) -> double {
+    if (lats.empty()) {
+      return 0;
+    }
+    size_t i = std::min(lats.size() - 1, static_cast<size_t>(lats.size() * p));
+    return lats[i] / 1000.0;
+  };
+  double sum = 0;
+  for (auto lat : lats) {
+    sum += lat;
+  }
+
+  w->StartObject();
+  w->Key("workload");
+  w->String(result->workload);
+  w->Key("ops");
+  w->Uint64(result->ops);
+  w->Key("errors");
+  w->Uint64(result->errors);
+  w->Key("seconds");
+  w->Double(result->seconds);
+  w->Key("qps");
+  w->Double(result->seconds > 0 ? result->ops / result->seconds : 0);
+  w->Key("latency_us");
+  w->StartObject();
+  w->Key("avg");
+  w->Double(lats.empty() ? 0 : sum / lats.size() / 1000.0);
+  w->Key("p50");
+  w->Double(percentile(0.5));
+  w->Key("p90");
+  w->Double(percentile(0.9));
+  w->Key("p99");
+  w->Double(percentile(0.99));
+  w->Key("p999");
+  w->Double(percentile(0.999));
+  w->Key("max");
+  w->Double(lats.empty() ? 0 : lats.back() / 1000.0);
+  w->EndObject();
+  w->EndObject();
+}
+
+static int run(int argc, char* argv[]) {
+  auto eopts = parseOptions(argc, argv);
+  if (!eopts.ok()) {
+    std::cerr << eopts.status().toString() << std::endl;
+    usage();
+    return -1;
+  }
+  const auto& opts = eopts.value();
+  Workloads workloads(opts);
+  for (const auto& name : opts.workloads) {
+    if (name == "replay" ? opts.replay.empty() : !workloads.exists(name)) {
+      std::cerr << "invalid workload:" << name << std::endl;
+      usage();
+      return -1;
+    }
+  }
+
+  auto eserver = startServer(opts);
+  if (!eserver.ok()) {
+    std::cerr << "start server failed:" << eserver.status().toString()
+              << std::endl;
+    return -1;
+  }
+  auto server = eserver.value();
+
+  rapidjson::StringBuffer sb;
+  rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(sb);
+  writer.StartObject();
+  writer.Key("version");
+  writer.String(TENDISPLUS_VERSION);
+  writer.Key("threads");
+  writer.Uint(opts.threads);
+  writer.Key("ops_per_thread");
+  writer.Uint64(opts.ops);
+  writer.Key("keys");
+  writer.Uint64(opts.keys);
+  writer.Key("value_size");
+  writer.Uint(opts.valueSize);
+  writer.Key("ttl");
+  writer.Uint(opts.ttl);
+  writer.Key("kvstorecount");
+  writer.Uint(opts.kvStoreCount);
+  writer.Key("results");
+  writer.StartArray();
+  int ret = 0;
+  for (const auto& name : opts.workloads) {
+    if (name == "replay") {
+      auto eresult = runReplay(server, opts);
+      if (!eresult.ok()) {
+        std::cerr << "replay failed:" << eresult.status().toString()
+                  << std::endl;
+        ret = -1;
+        break;
+      }
+      writeResult(&writer, &eresult.value());
+      continue;
+    }
+    auto result = runWorkload(server, opts, name, workloads.get(name));
+    writeResult(&writer, &result);
+  }
+  writer.EndArray();
+  writer.EndObject();
+
+  server->stop();
+  server.reset();
+  if (!opts.keep) {
+    std::error_code ec;
+    filesystem::remove_all(opts.dir, ec);
+  }
+  std::cout << sb.GetString() << std::endl;
+  return ret;
+}
+
+}  // namespace bench
+}  // namespace tendisplus
+
+int main(int argc, char* argv[]) {
+  return tendisplus::bench::run(argc, argv);
+}
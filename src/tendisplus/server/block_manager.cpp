@@ -0,0 +1,177 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "tendisplus/server/block_manager.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/redis_port.h"
+
+namespace tendisplus {
+
+BlockManager::BlockManager() : _blockedCnt(0) {}
+
+std::string BlockManager::encodeKey(uint32_t dbId, const std::string& key) {
+  std::string encoded(sizeof(dbId), '\0');
+  memcpy(&encoded[0], &dbId, sizeof(dbId));
+  encoded.append(key);
+  return encoded;
+}
+
+void BlockManager::addWaiter(Session* sess,
+                             uint32_t dbId,
+                             const std::vector<std::string>& keys,
+                             uint64_t deadlineMs,
+                             bool retry) {
+  Waiter waiter;
+  waiter.sess = sess->shared_from_this();
+  for (const auto& key : keys) {
+    auto encoded = encodeKey(dbId, key);
+    // BLPOP a a should wait on a once
+    if (std::find(waiter.encodedKeys.begin(),
+                  waiter.encodedKeys.end(),
+                  encoded) == waiter.encodedKeys.end()) {
+      waiter.encodedKeys.emplace_back(std::move(encoded));
+    }
+  }
+
+  std::lock_guard<std::mutex> lk(_mutex);
+  // a session runs one command at a time, a stale entry means the
+  // previous wakeup has not been consumed yet, replace it.
+  removeWaiterInLock(sess->id());
+
+  for (const auto& encoded : waiter.encodedKeys) {
+    auto& queue = _keyWaiters[encoded];
+    if (retry) {
+      queue.push_front(sess->id());
+    } else {
+      queue.push_back(sess->id());
+    }
+  }
+  waiter.deadlineIt = _deadlines.emplace(deadlineMs, sess->id());
+  _waiters.emplace(sess->id(), std::move(waiter));
+  _blockedCnt.store(_waiters.size(), std::memory_order_relaxed);
+}
+
+std::shared_ptr<Session> BlockManager::removeWaiterInLock(uint64_t sessId) {
+  auto it = _waiters.find(sessId);
+  if (it == _waiters.end()) {
+    return nullptr;
+  }
+  for (const auto& encoded : it->second.encodedKeys) {
+    auto qit = _keyWaiters.find(encoded);
+    INVARIANT_D(qit != _keyWaiters.end());
+    if (qit == _keyWaiters.end()) {
+      continue;
+    }
+    qit->second.remove(sessId);
+    if (qit->second.empty()) {
+      _keyWaiters.erase(qit);
+    }
+  }
+  _deadlines.erase(it->second.deadlineIt);
+  auto sess = it->second.sess.lock();
+  _waiters.erase(it);
+  _blockedCnt.store(_waiters.size(), std::memory_order_relaxed);
+  return sess;
+}
+
+bool BlockManager::removeWaiter(uint64_t sessId) {
+  if (_blockedCnt.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lk(_mutex);
+  if (_waiters.find(sessId) == _waiters.end()) {
+    return false;
+  }
+  removeWaiterInLock(sessId);
+  return true;
+}
+
+void BlockManager::wakeup(const std::vector<std::shared_ptr<Session>>& sesses) {
+  // NOTE: called without _mutex, Session::unblock() may take the
+  // session's own mutex and schedule it on the executors.
+  for (const auto& sess : sesses) {
+    if (sess) {
+      sess->unblock();
+    }
+  }
+}
+
+void BlockManager::signalKeyReady(uint32_t dbId,
+                                  const std::string& key,
+                                  size_t count) {
+  if (_blockedCnt.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+
+  std::vector<std::shared_ptr<Session>> sesses;
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    auto qit = _keyWaiters.find(encodeKey(dbId, key));
+    while (qit != _keyWaiters.end() && sesses.size() < count) {
+      uint64_t sessId = qit->second.front();
+      // removeWaiterInLock() may erase the queue when it is drained
+      bool last = qit->second.size() == 1;
+      auto sess = removeWaiterInLock(sessId);
+      if (sess) {
+        sesses.emplace_back(std::move(sess));
+      }
+      if (last) {
+        break;
+      }
+    }
+  }
+  wakeup(sesses);
+}
+
+void BlockManager::wakeupBySlots(const std::bitset<CLUSTER_SLOTS>& slots) {
+  if (_blockedCnt.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+
+  std::vector<std::shared_ptr<Session>> sesses;
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    std::vector<uint64_t> ids;
+    for (const auto& kv : _waiters) {
+      for (const auto& encoded : kv.second.encodedKeys) {
+        auto slot =
+          redis_port::keyHashSlot(encoded.c_str() + sizeof(uint32_t),
+                                  encoded.size() - sizeof(uint32_t));
+        if (slots.test(slot)) {
+          ids.push_back(kv.first);
+          break;
+        }
+      }
+    }
+    for (auto id : ids) {
+      sesses.emplace_back(removeWaiterInLock(id));
+    }
+  }
+  wakeup(sesses);
+}
+
+void BlockManager::handleTimeout(uint64_t nowMs) {
+  if (_blockedCnt.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+
+  std::vector<std::shared_ptr<Session>> sesses;
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    while (!_deadlines.empty() && _deadlines.begin()->first <= nowMs) {
+      sesses.emplace_back(removeWaiterInLock(_deadlines.begin()->second));
+    }
+  }
+  wakeup(sesses);
+}
+
+uint64_t BlockManager::getBlockedCount() const {
+  return _blockedCnt.load(std::memory_order_relaxed);
+}
+
+}  // namespace tendisplus
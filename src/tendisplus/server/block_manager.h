@@ -0,0 +1,81 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_SERVER_BLOCK_MANAGER_H_
+#define SRC_TENDISPLUS_SERVER_BLOCK_MANAGER_H_
+
+#include <atomic>
+#include <bitset>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tendisplus/server/session.h"
+
+namespace tendisplus {
+
+#define CLUSTER_SLOTS 16384
+
+// BlockManager keeps the sessions parked by BLPOP/BRPOP/BRPOPLPUSH.
+// A parked session holds no lock and no worker thread, it is only an
+// entry in the per-key FIFO queues below. When a key is pushed, or the
+// deadline passes, or the slot of a key leaves this node, the session is
+// woken up and runs its command again, which then pops, replies nil on
+// timeout, or gets MOVED when locking the keys.
+class BlockManager {
+ public:
+  BlockManager();
+  BlockManager(const BlockManager&) = delete;
+  BlockManager(BlockManager&&) = delete;
+
+  static constexpr uint64_t NO_DEADLINE = UINT64_MAX;
+
+  // should be called with the keys locked, so that a push can't commit
+  // between the emptiness check of the command and the registration.
+  // if retry is true, the session was woken up but lost the element to
+  // another client, it is put back at the head of the queues.
+  void addWaiter(Session* sess,
+                 uint32_t dbId,
+                 const std::vector<std::string>& keys,
+                 uint64_t deadlineMs,
+                 bool retry);
+  // returns false if the session is not blocked
+  bool removeWaiter(uint64_t sessId);
+  // wake up at most count sessions waiting on key, in FIFO order
+  void signalKeyReady(uint32_t dbId, const std::string& key, size_t count);
+  // wake up sessions waiting on keys belonging to slots
+  void wakeupBySlots(const std::bitset<CLUSTER_SLOTS>& slots);
+  // wake up sessions whose deadline <= nowMs, called by serverCron
+  void handleTimeout(uint64_t nowMs);
+  uint64_t getBlockedCount() const;
+
+ private:
+  struct Waiter {
+    std::weak_ptr<Session> sess;
+    std::vector<std::string> encodedKeys;
+    std::multimap<uint64_t, uint64_t>::iterator deadlineIt;
+  };
+  static std::string encodeKey(uint32_t dbId, const std::string& key);
+  // should be called with _mutex held
+  std::shared_ptr<Session> removeWaiterInLock(uint64_t sessId);
+  void wakeup(const std::vector<std::shared_ptr<Session>>& sesses);
+
+  mutable std::mutex _mutex;
+  // sessId -> waiter
+  std::unordered_map<uint64_t, Waiter> _waiters;
+  // dbId + key -> sessIds in blocking order
+  std::unordered_map<std::string, std::list<uint64_t>> _keyWaiters;
+  // deadline -> sessId
+  std::multimap<uint64_t, uint64_t> _deadlines;
+  // lets the push path skip _mutex when nobody is blocked
+  std::atomic<uint64_t> _blockedCnt;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_SERVER_BLOCK_MANAGER_H_
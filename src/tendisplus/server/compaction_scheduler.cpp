@@ -0,0 +1,313 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+#include "glog/logging.h"
+#include "tendisplus/server/compaction_scheduler.h"
+#include "tendisplus/server/server_entry.h"
+#include "tendisplus/storage/record.h"
+#include "tendisplus/utils/string.h"
+#include "tendisplus/utils/time.h"
+
+namespace tendisplus {
+
+CompactionScheduler::CompactionScheduler(ServerEntry* svr)
+  : _svr(svr),
+    _isRunning(false),
+    _rebalances(0),
+    _jobsChanged(0),
+    _idleCompactions(0),
+    _idleCompactedDeletes(0) {}
+
+Status CompactionScheduler::startup() {
+  _stores.resize(_svr->getKVStoreCount());
+  _lastRebalance = std::chrono::steady_clock::now();
+  _isRunning.store(true, std::memory_order_relaxed);
+  _controller =
+    std::make_unique<std::thread>(std::move([this]() { controlRoutine(); }));
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+void CompactionScheduler::stop() {
+  LOG(INFO) << "CompactionScheduler begins stops...";
+  {
+    std::lock_guard<std::mutex> lk(_cvMutex);
+    _isRunning.store(false, std::memory_order_relaxed);
+  }
+  _cv.notify_all();
+  if (_controller) {
+    _controller->join();
+  }
+  LOG(INFO) << "CompactionScheduler stops succ";
+}
+
+void CompactionScheduler::controlRoutine() {
+  using namespace std::chrono_literals;  // NOLINT(build/namespaces)
+  while (_isRunning.load(std::memory_order_relaxed)) {
+    {
+      std::unique_lock<std::mutex> lk(_cvMutex);
+      _cv.wait_for(
+        lk, 1s, [this] { return !_isRunning.load(std::memory_order_relaxed); });
+    }
+    if (!_isRunning.load(std::memory_order_relaxed)) {
+      break;
+    }
+
+    const auto& params = _svr->getParams();
+    if (params->compactSchedInterval == 0) {
+      continue;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now >=
+        _lastRebalance + std::chrono::seconds(params->compactSchedInterval)) {
+      _lastRebalance = now;
+      rebalance();
+    }
+    idleCompact();
+  }
+  DLOG(INFO) << "compaction scheduler exits";
+}
+
+std::vector<uint32_t> CompactionScheduler::shareJobs(
+  const std::vector<double>& scores, uint32_t jobs) {
+  std::vector<uint32_t> result(scores.size(), 1);
+  if (scores.empty() || jobs <= scores.size()) {
+    return result;
+  }
+  uint32_t rest = jobs - scores.size();
+  double sum = std::accumulate(scores.begin(), scores.end(), 0.0);
+  std::vector<std::pair<double, size_t>> remainders;
+  uint32_t given = 0;
+  for (size_t i = 0; i < scores.size(); i++) {
+    // without any debt, the stores have the same share
+    double share = sum > 0 ? rest * scores[i] / sum
+                           : static_cast<double>(rest) / scores.size();
+    auto n = static_cast<uint32_t>(share);
+    result[i] += n;
+    given += n;
+    remainders.emplace_back(share - n, i);
+  }
+  // the largest remainders take what is left
+  std::sort(remainders.begin(),
+            remainders.end(),
+            [](const std::pair<double, size_t>& a,
+               const std::pair<double, size_t>& b) {
+              return a.first > b.first ||
+                (a.first == b.first && a.second < b.second);
+            });
+  for (size_t i = 0; given < rest && i < remainders.size(); i++, given++) {
+    result[remainders[i].second]++;
+  }
+  return result;
+}
+
+void CompactionScheduler::rebalance() {
+  uint32_t storeCount = _svr->getKVStoreCount();
+  std::vector<StoreState> states;
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    states = _stores;
+  }
+  states.resize(storeCount);
+
+  std::vector<bool> running(storeCount, false);
+  uint64_t totalReads = 0, totalWrites = 0;
+  for (uint32_t i = 0; i < storeCount; i++) {
+    auto expdb =
+      _svr->getSegmentMgr()->getDb(NULL, i, mgl::LockMode::LOCK_IS, false, 0);
+    if (!expdb.ok() || !expdb.value().store->isRunning()) {
+      continue;
+    }
+    auto store = expdb.value().store;
+    auto& st = states[i];
+    running[i] = true;
+
+    uint64_t nonEmptyLevels = 0;
+    for (int level = 0; level < ROCKSDB_NUM_LEVELS; level++) {
+      std::string files;
+      if (!store->getProperty(
+            "rocksdb.num-files-at-level" + std::to_string(level), &files)) {
+        continue;
+      }
+      auto n = ::tendisplus::stoul(files);
+      if (!n.ok()) {
+        continue;
+      }
+      if (level == 0) {
+        st.l0Files = n.value();
+      } else if (n.value() > 0) {
+        nonEmptyLevels++;
+      }
+    }
+    // a point read may look at every L0 file and one file of each level
+    st.readAmp = st.l0Files + nonEmptyLevels;
+    store->getIntProperty("rocksdb.estimate-pending-compaction-bytes",
+                          &st.pendingBytes);
+
+    // the tickers go back to 0 if the statistics are reset
+    uint64_t reads = store->getNumKeysRead();
+    uint64_t writes = store->getNumKeysWritten();
+    st.reads = reads >= st.lastReads ? reads - st.lastReads : reads;
+    st.writes = writes >= st.lastWrites ? writes - st.lastWrites : writes;
+    st.lastReads = reads;
+    st.lastWrites = writes;
+    totalReads += st.reads;
+    totalWrites += st.writes;
+  }
+
+  uint32_t runningCount = std::count(running.begin(), running.end(), true);
+  if (runningCount == 0) {
+    return;
+  }
+  std::vector<double> scores;
+  for (uint32_t i = 0; i < storeCount; i++) {
+    if (!running[i]) {
+      continue;
+    }
+    auto& st = states[i];
+    // the share of the traffic against an average store, L0 files stall
+    // the writes, and the read amplification slows the reads down
+    double writeShare =
+      totalWrites ? static_cast<double>(st.writes) * runningCount / totalWrites
+                  : 0;
+    double readShare =
+      totalReads ? static_cast<double>(st.reads) * runningCount / totalReads
+                 : 0;
+    st.score = st.l0Files * (1 + writeShare) +
+      static_cast<double>(st.pendingBytes) / (1024 * 1024 * 1024) +
+      st.readAmp * readShare;
+    scores.push_back(st.score);
+  }
+
+  auto jobs = shareJobs(scores, _svr->getParams()->compactSchedJobs);
+  uint64_t changed = 0;
+  size_t idx = 0;
+  for (uint32_t i = 0; i < storeCount; i++) {
+    if (!running[i]) {
+      continue;
+    }
+    auto& st = states[i];
+    st.jobs = jobs[idx++];
+    auto expdb =
+      _svr->getSegmentMgr()->getDb(NULL, i, mgl::LockMode::LOCK_IS, false, 0);
+    if (!expdb.ok()) {
+      continue;
+    }
+    auto store = expdb.value().store;
+    if (store->getBackgroundCompactions() == st.jobs) {
+      continue;
+    }
+    LOG(INFO) << "CompactionScheduler store:" << i << " compactions from "
+              << store->getBackgroundCompactions() << " to " << st.jobs
+              << ", l0:" << st.l0Files << " pending:" << st.pendingBytes
+              << " read-amp:" << st.readAmp << " reads:" << st.reads
+              << " writes:" << st.writes << " score:" << st.score;
+    auto s = store->setBackgroundCompactions(st.jobs);
+    if (!s.ok()) {
+      LOG(WARNING) << "CompactionScheduler store:" << i
+                   << " setBackgroundCompactions failed:" << s.toString();
+      continue;
+    }
+    changed++;
+  }
+
+  std::lock_guard<std::mutex> lk(_mutex);
+  _stores = std::move(states);
+  _rebalances++;
+  _jobsChanged += changed;
+}
+
+bool CompactionScheduler::idleCompact() {
+  const auto& params = _svr->getParams();
+  if (params->compactSchedIdleOps == 0 ||
+      params->compactSchedDeleteThreshold == 0) {
+    return false;
+  }
+  auto ops = _svr->getServerStat().getInstantaneousMetric(STATS_METRIC_COMMAND);
+  if (ops >= params->compactSchedIdleOps) {
+    return false;
+  }
+
+  // the range with the most deletes over all the stores
+  uint32_t storeId = 0, range = 0;
+  uint64_t deletes = 0;
+  for (uint32_t i = 0; i < _svr->getKVStoreCount(); i++) {
+    auto expdb =
+      _svr->getSegmentMgr()->getDb(NULL, i, mgl::LockMode::LOCK_IS, false, 0);
+    if (!expdb.ok() || !expdb.value().store->isRunning()) {
+      continue;
+    }
+    const auto& counts = expdb.value().store->stat.rangeDeleteCount;
+    for (uint32_t r = 0; r < counts.size(); r++) {
+      auto n = counts[r].load(std::memory_order_relaxed);
+      if (n > deletes) {
+        storeId = i;
+        range = r;
+        deletes = n;
+      }
+    }
+  }
+  if (deletes < params->compactSchedDeleteThreshold) {
+    return false;
+  }
+
+  auto expdb = _svr->getSegmentMgr()->getDb(
+    NULL, storeId, mgl::LockMode::LOCK_IS, false, 0);
+  if (!expdb.ok() || !expdb.value().store->isRunning()) {
+    return false;
+  }
+  auto store = expdb.value().store;
+  deletes = store->stat.rangeDeleteCount[range].exchange(0);
+
+  uint32_t beginChunk = range * KVStoreStat::DELETE_RANGE_CHUNKS;
+  uint32_t endChunk = beginChunk + KVStoreStat::DELETE_RANGE_CHUNKS;
+  std::string begin =
+    RecordKey(beginChunk, 0, RecordType::RT_INVALID, "", "").prefixChunkid();
+  std::string end =
+    RecordKey(endChunk, 0, RecordType::RT_INVALID, "", "").prefixChunkid();
+  // the last range holds all the chunks after it
+  bool last = range == KVStoreStat::DELETE_RANGES - 1;
+  auto start = msSinceEpoch();
+  auto s = store->compactRange(
+    ColumnFamilyNumber::ColumnFamily_Default, &begin, last ? nullptr : &end);
+  std::stringstream ss;
+  ss << "store " << storeId << " chunks [" << beginChunk << ","
+     << (last ? "-" : std::to_string(endChunk)) << ") deletes " << deletes
+     << " in " << msSinceEpoch() - start << "ms";
+  if (!s.ok()) {
+    LOG(WARNING) << "CompactionScheduler idle compaction of " << ss.str()
+                 << " failed:" << s.toString();
+    return false;
+  }
+  LOG(INFO) << "CompactionScheduler idle compaction of " << ss.str();
+
+  std::lock_guard<std::mutex> lk(_mutex);
+  _idleCompactions++;
+  _idleCompactedDeletes += deletes;
+  _lastIdleCompaction = ss.str();
+  return true;
+}
+
+void CompactionScheduler::getInfo(std::stringstream& ss) const {
+  std::lock_guard<std::mutex> lk(_mutex);
+  ss << "compact_sched_rebalances:" << _rebalances << "\r\n";
+  ss << "compact_sched_jobs_changed:" << _jobsChanged << "\r\n";
+  ss << "compact_sched_idle_compactions:" << _idleCompactions << "\r\n";
+  ss << "compact_sched_idle_compacted_deletes:" << _idleCompactedDeletes
+     << "\r\n";
+  ss << "compact_sched_last_idle_compaction:" << _lastIdleCompaction
+     << "\r\n";
+  for (size_t i = 0; i < _stores.size(); i++) {
+    const auto& st = _stores[i];
+    ss << "compact_sched_store" << i << ":jobs=" << st.jobs
+       << ",l0=" << st.l0Files << ",pending=" << st.pendingBytes
+       << ",read_amp=" << st.readAmp << ",reads=" << st.reads
+       << ",writes=" << st.writes << ",score=" << st.score << "\r\n";
+  }
+}
+
+}  // namespace tendisplus
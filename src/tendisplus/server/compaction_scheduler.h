@@ -0,0 +1,85 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_SERVER_COMPACTION_SCHEDULER_H_
+#define SRC_TENDISPLUS_SERVER_COMPACTION_SCHEDULER_H_
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tendisplus/utils/status.h"
+
+namespace tendisplus {
+
+class ServerEntry;
+
+// CompactionScheduler moves the background compactions between the
+// stores, instead of every store running as many as it likes on the
+// shared threads. Every compact-sched-interval seconds it scores the
+// stores by their L0 files, weighted by the keys written, their pending
+// compaction bytes, and their read amplification, weighted by the keys
+// read, then shares compact-sched-jobs among them, one at least each.
+// While the server is idle, it also compacts the range of chunks with
+// the most deletes since its last compaction, to drop the tombstones
+// the reads would step over.
+class CompactionScheduler {
+ public:
+  explicit CompactionScheduler(ServerEntry* svr);
+  CompactionScheduler(const CompactionScheduler&) = delete;
+  CompactionScheduler(CompactionScheduler&&) = delete;
+
+  Status startup();
+  void stop();
+  // the compact_sched_* fields of INFO compaction
+  void getInfo(std::stringstream& ss) const;
+
+  // the compactions of each store, for the given scores
+  static std::vector<uint32_t> shareJobs(const std::vector<double>& scores,
+                                         uint32_t jobs);
+
+ private:
+  struct StoreState {
+    uint64_t l0Files = 0;
+    uint64_t readAmp = 0;
+    uint64_t pendingBytes = 0;
+    // the tickers of the last round, and the keys since then
+    uint64_t lastReads = 0;
+    uint64_t lastWrites = 0;
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    double score = 0;
+    uint32_t jobs = 0;
+  };
+
+  void controlRoutine();
+  void rebalance();
+  // true if a range is compacted
+  bool idleCompact();
+
+  ServerEntry* _svr;
+  std::atomic<bool> _isRunning;
+  std::mutex _cvMutex;
+  std::condition_variable _cv;
+  std::unique_ptr<std::thread> _controller;
+  std::chrono::steady_clock::time_point _lastRebalance;
+
+  mutable std::mutex _mutex;
+  std::vector<StoreState> _stores;
+  uint64_t _rebalances;
+  uint64_t _jobsChanged;
+  uint64_t _idleCompactions;
+  uint64_t _idleCompactedDeletes;
+  std::string _lastIdleCompaction;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_SERVER_COMPACTION_SCHEDULER_H_
@@ -0,0 +1,46 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <numeric>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tendisplus/server/compaction_scheduler.h"
+
+namespace tendisplus {
+
+uint32_t sumJobs(const std::vector<uint32_t>& jobs) {
+  return std::accumulate(jobs.begin(), jobs.end(), 0U);
+}
+
+TEST(CompactionScheduler, ShareJobs) {
+  // by the scores, one at least each
+  auto jobs = CompactionScheduler::shareJobs({6, 3, 1, 0}, 14);
+  EXPECT_EQ(jobs, std::vector<uint32_t>({7, 4, 2, 1}));
+
+  // the largest remainders take what is left, the first ones if equal
+  jobs = CompactionScheduler::shareJobs({1, 1, 1}, 5);
+  EXPECT_EQ(jobs, std::vector<uint32_t>({2, 2, 1}));
+  jobs = CompactionScheduler::shareJobs({2, 3, 5}, 6);
+  EXPECT_EQ(sumJobs(jobs), 6U);
+  EXPECT_EQ(jobs, std::vector<uint32_t>({2, 2, 2}));
+  jobs = CompactionScheduler::shareJobs({1, 2, 4}, 10);
+  EXPECT_EQ(sumJobs(jobs), 10U);
+  EXPECT_EQ(jobs, std::vector<uint32_t>({2, 3, 5}));
+
+  // no more jobs than the stores
+  jobs = CompactionScheduler::shareJobs({5, 1, 0}, 3);
+  EXPECT_EQ(jobs, std::vector<uint32_t>({1, 1, 1}));
+  jobs = CompactionScheduler::shareJobs({5, 1, 0}, 1);
+  EXPECT_EQ(jobs, std::vector<uint32_t>({1, 1, 1}));
+  EXPECT_TRUE(CompactionScheduler::shareJobs({}, 4).empty());
+
+  // the same share without any score
+  jobs = CompactionScheduler::shareJobs({0, 0, 0, 0}, 10);
+  EXPECT_EQ(jobs, std::vector<uint32_t>({3, 3, 2, 2}));
+  jobs = CompactionScheduler::shareJobs({0, 0}, 8);
+  EXPECT_EQ(jobs, std::vector<uint32_t>({4, 4}));
+}
+
+}  // namespace tendisplus
@@ -4,7 +4,9 @@
 
 #include "tendisplus/server/index_manager.h"
 
+#include <algorithm>
 #include <chrono>  // NOLINT
+#include <map>
 #include <memory>
 #include <vector>
 #include <utility>
@@ -18,10 +20,25 @@
 #include "tendisplus/utils/portable.h"
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/scopeguard.h"
+#include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/time.h"
 
 
 namespace tendisplus {
 
+namespace {
+uint32_t autoPoolSize(uint32_t cfgSize, uint32_t storeCnt) {
+  if (cfgSize != 0) {
+    return cfgSize;
+  }
+  uint32_t cpuNum = std::max(std::thread::hardware_concurrency() / 4, 1u);
+  return std::max(std::min(storeCnt, cpuNum), 1u);
+}
+
+// GenericRateLimiter can't work with a tiny rate
+constexpr uint64_t kMinExpireKeysPerSec = 100;
+}  // namespace
+
 IndexManager::IndexManager(std::shared_ptr<ServerEntry> svr,
                            std::shared_ptr<ServerParams> cfg)
   : _isRunning(false),
@@ -30,13 +47,16 @@ IndexManager::IndexManager(std::shared_ptr<ServerEntry> svr,
     _deleterMatrix(std::make_shared<PoolMatrix>()),
     _totalDequeue(0),
     _totalEnqueue(0),
+    _totalDeleted(0),
+    _rateLimiter(std::max(cfg->expireKeysPerSec, kMinExpireKeysPerSec)),
+    _rateLimit(0),
     _scanBatch(cfg->scanCntIndexMgr),
-    _scanPoolSize(cfg->scanJobCntIndexMgr),
+    _scanPoolSize(autoPoolSize(cfg->scanJobCntIndexMgr, cfg->kvStoreCount)),
     _delBatch(cfg->delCntIndexMgr),
-    _delPoolSize(cfg->delJobCntIndexMgr),
+    _delPoolSize(autoPoolSize(cfg->delJobCntIndexMgr, cfg->kvStoreCount)),
     _pauseTime(cfg->pauseTimeIndexMgr) {
   for (size_t storeId = 0; storeId < svr->getKVStoreCount(); ++storeId) {
-    _scanPoints[storeId] = std::move(std::string());
+    _queues.emplace_back(std::make_unique<ExpireQueue>());
     _scanJobStatus[storeId] = {false};
     _delJobStatus[storeId] = {false};
     _disableStatus[storeId] = {false};
@@ -77,6 +97,7 @@ Status IndexManager::scanExpiredKeysJob(uint32_t storeId) {
   }
 
   if (_disableStatus[storeId].load(std::memory_order_relaxed)) {
+    _scanJobStatus[storeId].store(false, std::memory_order_release);
     return {ErrorCodes::ERR_OK, ""};
   }
 
@@ -85,12 +106,22 @@ Status IndexManager::scanExpiredKeysJob(uint32_t storeId) {
     _scanJobStatus[storeId].store(false, std::memory_order_release);
   });
 
+  _scanJobCnt[storeId]++;
   bool clusterEnabled = _svr->getParams()->clusterEnabled;
   if (clusterEnabled && _svr->getMigrateManager()->existMigrateTask()) {
     return {ErrorCodes::ERR_OK, ""};
   }
 
-  _scanJobCnt[storeId]++;
+  auto& queue = *_queues[storeId];
+  {
+    // the deleters are behind, don't take more
+    std::lock_guard<std::mutex> lk(queue.mutex);
+    if (queue.keys.size() >= _scanBatch) {
+      queue.more = true;
+      return {ErrorCodes::ERR_OK, ""};
+    }
+  }
+
   LocalSessionGuard sg(_svr.get());
   auto expd = _svr->getSegmentMgr()->getDb(
     sg.getSession(), storeId, mgl::LockMode::LOCK_IS, true);
@@ -115,19 +146,20 @@ Status IndexManager::scanExpiredKeysJob(uint32_t storeId) {
   // slave here. In fact, it maybe more safe to use
   // store->getCurrentTime()
   auto cursor = txn->createTTLIndexCursor(store->getCurrentTime());
-  INVARIANT(_scanPoints.find(storeId) != _scanPoints.end());
   // seek to the place where we left NOTE: skip the entry
   // already push into list
   std::string prefix;
   {
-    std::lock_guard<std::mutex> lk(_mutex);
-    prefix = _scanPoints[storeId];
+    std::lock_guard<std::mutex> lk(queue.mutex);
+    prefix = queue.scanPoint;
   }
 
   if (prefix.size() > 0) {
     cursor->seek(prefix);
     auto key = cursor->key();
     if (!key.ok()) {
+      std::lock_guard<std::mutex> lk(queue.mutex);
+      queue.more = false;
       return {ErrorCodes::ERR_OK, ""};
     }
     if (!prefix.compare(key.value())) {
@@ -152,20 +184,24 @@ Status IndexManager::scanExpiredKeysJob(uint32_t storeId) {
       // key is expired), any attempt to inserting an ttl
       // index before T will result in a deletion of the
       // key.
+      std::lock_guard<std::mutex> lk(queue.mutex);
+      queue.more = false;
       break;
     }
 
+    _totalEnqueue++;
     {
-      std::lock_guard<std::mutex> lk(_mutex);
-      _scanPoints[storeId].assign(record.value().encode());
-      _expiredKeys[storeId].push_back(std::move(record.value()));
-      _totalEnqueue++;
-      if (_expiredKeys[storeId].size() == _scanBatch) {
+      std::lock_guard<std::mutex> lk(queue.mutex);
+      queue.scanPoint.assign(record.value().encode());
+      queue.keys.push_back(std::move(record.value()));
+      if (queue.keys.size() >= _scanBatch) {
+        queue.more = true;
         break;
       }
     }
 
-    TEST_SYNC_POINT_CALLBACK("InspectTotalEnqueue", &_totalEnqueue);
+    uint64_t totalEnqueue = _totalEnqueue.load();
+    TEST_SYNC_POINT_CALLBACK("InspectTotalEnqueue", &totalEnqueue);
     TEST_SYNC_POINT_CALLBACK("InspectScanJobCnt", &_scanJobCnt[storeId]);
   }
 
@@ -173,11 +209,13 @@ Status IndexManager::scanExpiredKeysJob(uint32_t storeId) {
 }
 
 Status IndexManager::stopStore(uint32_t storeId) {
-  std::lock_guard<std::mutex> lk(_mutex);
+  auto& queue = *_queues[storeId];
+  std::lock_guard<std::mutex> lk(queue.mutex);
 
-  _expiredKeys[storeId].clear();
+  queue.keys.clear();
+  queue.scanPoint.clear();
+  queue.more = false;
 
-  _scanPoints[storeId] = std::move(std::string());
   _scanJobCnt[storeId] = {0u};
   _delJobCnt[storeId] = {0u};
   _disableStatus[storeId].store(true, std::memory_order_relaxed);
@@ -185,6 +223,45 @@ Status IndexManager::stopStore(uint32_t storeId) {
   return {ErrorCodes::ERR_OK, ""};
 }
 
+void IndexManager::delExpiredWindow(uint32_t storeId,
+                                    std::vector<TTLIndex>* window) {
+  auto segMgr = _svr->getSegmentMgr();
+  // chunk id -> ttl indexes, one transaction for each chunk
+  std::map<uint32_t, std::vector<TTLIndex>> chunks;
+  for (auto& index : *window) {
+    auto key = index.getPriKey();
+    uint32_t chunkId =
+      redis_port::keyHashSlot(key.c_str(), key.size()) % segMgr->getChunkSize();
+    chunks[chunkId].emplace_back(std::move(index));
+  }
+
+  LocalSessionGuard sg(_svr.get());
+  auto sess = sg.getSession();
+  sess->getCtx()->setAuthed();
+  std::vector<TTLIndex> rest;
+  for (const auto& kv : chunks) {
+    std::vector<TTLIndex> bigKeys;
+    auto deleted =
+      Command::expireChunkKeys(sess, kv.first, kv.second, &bigKeys);
+    if (!deleted.ok()) {
+      // delete them one by one, as before
+      rest.insert(rest.end(), kv.second.begin(), kv.second.end());
+      continue;
+    }
+    _totalDeleted += deleted.value();
+    rest.insert(rest.end(), bigKeys.begin(), bigKeys.end());
+  }
+
+  for (const auto& index : rest) {
+    sess->getCtx()->setDbId(index.getDbId());
+    auto s =
+      Command::expireKeyIfNeeded(sess, index.getPriKey(), index.getType());
+    if (s.status().code() == ErrorCodes::ERR_EXPIRED) {
+      ++_totalDeleted;
+    }
+  }
+}
+
 int IndexManager::tryDelExpiredKeysJob(uint32_t storeId) {
   bool expect = false;
   if (!_delJobStatus[storeId].compare_exchange_strong(
@@ -193,43 +270,37 @@ int IndexManager::tryDelExpiredKeysJob(uint32_t storeId) {
   }
 
   if (_disableStatus[storeId].load(std::memory_order_relaxed)) {
+    _delJobStatus[storeId].store(false, std::memory_order_release);
     return 0;
   }
 
   _delJobCnt[storeId]++;
   uint32_t deletes = 0;
+  auto& queue = *_queues[storeId];
 
-  while (true) {
-    TTLIndex index;
-
+  while (deletes < _delBatch && _isRunning.load(std::memory_order_relaxed)) {
+    std::vector<TTLIndex> window;
     {
-      std::lock_guard<std::mutex> lk(_mutex);
-      if (_expiredKeys[storeId].empty()) {
-        break;
+      std::lock_guard<std::mutex> lk(queue.mutex);
+      uint32_t cnt = std::min<uint32_t>(DEL_WINDOW, _delBatch - deletes);
+      while (window.size() < cnt && !queue.keys.empty()) {
+        window.emplace_back(std::move(queue.keys.front()));
+        queue.keys.pop_front();
       }
-      index = _expiredKeys[storeId].front();
     }
-    LocalSessionGuard sg(_svr.get());
-    auto sess = sg.getSession();
-    sess->getCtx()->setAuthed();
-    sess->getCtx()->setDbId(index.getDbId());
-    Command::expireKeyIfNeeded(
-      sg.getSession(), index.getPriKey(), index.getType());
-
-    {
-      std::lock_guard<std::mutex> lk(_mutex);
-      INVARIANT(!_expiredKeys[storeId].empty());
-      _expiredKeys[storeId].pop_front();
-      _totalDequeue++;
-      deletes++;
-    }
-
-    // break if delete a number of keys in the current store
-    if (deletes == _delBatch) {
+    if (window.empty()) {
       break;
     }
+    uint32_t cnt = window.size();
+    if (_rateLimit.load(std::memory_order_relaxed) != 0) {
+      _rateLimiter.Request(cnt);
+    }
+    delExpiredWindow(storeId, &window);
 
-    TEST_SYNC_POINT_CALLBACK("InspectTotalDequeue", &_totalDequeue);
+    deletes += cnt;
+    _totalDequeue += cnt;
+    uint64_t totalDequeue = _totalDequeue.load();
+    TEST_SYNC_POINT_CALLBACK("InspectTotalDequeue", &totalDequeue);
     TEST_SYNC_POINT_CALLBACK("InspectDelJobCnt", &_delJobCnt[storeId]);
   }
 
@@ -238,6 +309,37 @@ int IndexManager::tryDelExpiredKeysJob(uint32_t storeId) {
   return deletes;
 }
 
+std::pair<uint64_t, uint64_t> IndexManager::getBacklog() {
+  uint64_t backlog = 0;
+  uint64_t oldestTtl = 0;
+  for (auto& queue : _queues) {
+    std::lock_guard<std::mutex> lk(queue->mutex);
+    backlog += queue->keys.size();
+    // the queue is in the order of ttl
+    if (!queue->keys.empty() &&
+        (oldestTtl == 0 || queue->keys.front().getTTL() < oldestTtl)) {
+      oldestTtl = queue->keys.front().getTTL();
+    }
+  }
+  uint64_t now = msSinceEpoch();
+  return {backlog, oldestTtl != 0 && now > oldestTtl ? now - oldestTtl : 0};
+}
+
+void IndexManager::adjustRate(uint64_t lagMs) {
+  const auto& cfg = _svr->getParams();
+  uint64_t ops = _svr->getServerStat().getInstantaneousMetric(
+    STATS_METRIC_COMMAND);
+  bool busy =
+    cfg->expireBusyOpsPerSec != 0 && ops >= cfg->expireBusyOpsPerSec;
+  bool lagging = lagMs >= (uint64_t)cfg->expireMaxLagSec * 1000;
+  uint64_t rate = 0;
+  if (cfg->expireKeysPerSec != 0 && busy && !lagging) {
+    rate = std::max(cfg->expireKeysPerSec, kMinExpireKeysPerSec);
+    _rateLimiter.SetBytesPerSecond(rate);
+  }
+  _rateLimit.store(rate, std::memory_order_relaxed);
+}
+
 // call this in a forever loop
 Status IndexManager::run() {
   auto scheScanExpired = [this]() {
@@ -249,12 +351,10 @@ Status IndexManager::run() {
   auto schedDelExpired = [this]() {
     std::vector<uint32_t> stored_with_expires;
 
-    {
-      std::lock_guard<std::mutex> lk(_mutex);
-      for (uint32_t i = 0; i < _svr->getKVStoreCount(); ++i) {
-        if (_expiredKeys[i].size() > 0) {
-          stored_with_expires.push_back(i);
-        }
+    for (uint32_t i = 0; i < _svr->getKVStoreCount(); ++i) {
+      std::lock_guard<std::mutex> lk(_queues[i]->mutex);
+      if (_queues[i]->keys.size() > 0) {
+        stored_with_expires.push_back(i);
       }
     }
 
@@ -265,13 +365,32 @@ Status IndexManager::run() {
 
     return stored_with_expires.size() > 0;
   };
+
+  auto hasMore = [this]() {
+    for (auto& queue : _queues) {
+      std::lock_guard<std::mutex> lk(queue->mutex);
+      if (queue->more) {
+        return true;
+      }
+    }
+    return false;
+  };
   LOG(WARNING) << "index manager running...";
 
   TEST_SYNC_POINT_CALLBACK("BeforeIndexManagerLoop", &_isRunning);
   while (_isRunning.load(std::memory_order_relaxed)) {
+    adjustRate(getBacklog().second);
+
     scheScanExpired();
-    schedDelExpired();
-    std::this_thread::sleep_for(std::chrono::seconds(_pauseTime));
+    bool busy = schedDelExpired();
+    busy = hasMore() || busy;
+
+    auto pause = busy ? std::chrono::milliseconds(BUSY_PAUSE_MS)
+                      : std::chrono::milliseconds(_pauseTime * 1000);
+    std::unique_lock<std::mutex> lk(_mutex);
+    _cv.wait_for(lk, pause, [this] {
+      return !_isRunning.load(std::memory_order_relaxed);
+    });
   }
 
   LOG(WARNING) << "index manager exiting...";
@@ -281,7 +400,11 @@ Status IndexManager::run() {
 
 void IndexManager::stop() {
   LOG(WARNING) << "index manager begins to stop...";
-  _isRunning.store(false, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    _isRunning.store(false, std::memory_order_relaxed);
+  }
+  _cv.notify_all();
   _runner.join();
   _indexScanner->stop();
   _keyDeleter->stop();
@@ -291,4 +414,13 @@ void IndexManager::stop() {
 bool IndexManager::isRunning() {
   return _isRunning.load(std::memory_order_relaxed);
 }
+
+void IndexManager::getStatInfo(std::stringstream& ss) {
+  auto backlog = getBacklog();
+  ss << "expire_backlog_keys:" << backlog.first << "\r\n";
+  ss << "expire_lag_ms:" << backlog.second << "\r\n";
+  ss << "expire_scanned_keys:" << _totalEnqueue.load() << "\r\n";
+  ss << "expire_deleted_keys:" << _totalDeleted.load() << "\r\n";
+  ss << "expire_rate_limit:" << _rateLimit.load() << "\r\n";
+}
 }  // namespace tendisplus
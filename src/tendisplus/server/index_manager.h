@@ -10,14 +10,26 @@
 #include <list>
 #include <string>
 #include <memory>
+#include <condition_variable>
+#include <sstream>
+#include <vector>
 #include "tendisplus/server/server_entry.h"
 #include "tendisplus/network/worker_pool.h"
+#include "tendisplus/utils/rate_limiter.h"
 
 namespace tendisplus {
 
 using JobStatus = std::unordered_map<std::size_t, std::atomic<bool>>;
 using JobCnt = std::unordered_map<std::size_t, std::atomic<uint32_t>>;
 
+// IndexManager deletes the expired keys in the background. The stores
+// are scanned and cleaned in parallel, each store has its own queue of
+// expired ttl indexes. The keys of a queue are deleted in windows, the
+// keys of the same chunk in one transaction.
+// The next round starts at once while there is a backlog, otherwise
+// after pauseTimeIndexMgr seconds. When the server is busy, the delete
+// rate is limited to expireKeysPerSec, unless the oldest expired key has
+// waited for more than expireMaxLagSec.
 class IndexManager {
  public:
   IndexManager(std::shared_ptr<ServerEntry> svr,
@@ -29,12 +41,32 @@ class IndexManager {
   int tryDelExpiredKeysJob(uint32_t storeId);
   bool isRunning();
   Status stopStore(uint32_t storeId);
+  // the expire_* fields of INFO stats
+  void getStatInfo(std::stringstream& ss);
+
+  // the ttl indexes a delete job takes from its queue at a time
+  static constexpr uint32_t DEL_WINDOW = 256;
+  // the pause between two rounds while there is a backlog
+  static constexpr uint32_t BUSY_PAUSE_MS = 100;
 
  private:
+  struct ExpireQueue {
+    std::mutex mutex;
+    std::list<TTLIndex> keys;
+    // the last ttl index scanned
+    std::string scanPoint;
+    // the last scan stopped with the queue full
+    bool more = false;
+  };
+
+  void delExpiredWindow(uint32_t storeId, std::vector<TTLIndex>* window);
+  // the backlog of all the stores, and the wait of the oldest one in ms
+  std::pair<uint64_t, uint64_t> getBacklog();
+  void adjustRate(uint64_t lagMs);
+
   std::unique_ptr<WorkerPool> _indexScanner;
   std::unique_ptr<WorkerPool> _keyDeleter;
-  std::unordered_map<std::size_t, std::list<TTLIndex>> _expiredKeys;
-  std::unordered_map<std::size_t, std::string> _scanPoints;
+  std::vector<std::unique_ptr<ExpireQueue>> _queues;
   JobStatus _scanJobStatus;
   JobStatus _delJobStatus;
   // when destroystore, _disableStatus[storeId] = true
@@ -45,13 +77,20 @@ class IndexManager {
   std::atomic<bool> _isRunning;
   std::shared_ptr<ServerEntry> _svr;
   std::thread _runner;
+  // wakes up _runner when stopping
   std::mutex _mutex;
+  std::condition_variable _cv;
 
   std::shared_ptr<PoolMatrix> _scannerMatrix;
   std::shared_ptr<PoolMatrix> _deleterMatrix;
 
-  uint64_t _totalDequeue;
-  uint64_t _totalEnqueue;
+  std::atomic<uint64_t> _totalDequeue;
+  std::atomic<uint64_t> _totalEnqueue;
+  std::atomic<uint64_t> _totalDeleted;
+
+  RateLimiter _rateLimiter;
+  // keys per second, 0 if the deletes are not limited now
+  std::atomic<uint64_t> _rateLimit;
 
   uint32_t _scanBatch;
   uint32_t _scanPoolSize;
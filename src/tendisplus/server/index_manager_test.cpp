@@ -262,6 +262,51 @@ TEST(IndexManager, scanIndexWhileExpire) {
   SyncPoint::GetInstance()->ClearAllCallBacks();
 }
 
+TEST(IndexManager, expireInChunkBatches) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+
+  auto cfg = makeServerParam();
+  cfg->pauseTimeIndexMgr = 1;
+  auto server = std::make_shared<ServerEntry>(cfg);
+  auto s = server->startup(cfg);
+  ASSERT_TRUE(s.ok());
+
+  {
+    auto ctx = std::make_shared<asio::io_context>();
+    auto session = makeSession(server, ctx);
+
+    WorkLoad work(server, session);
+    work.init();
+
+    AllKeys all_keys;
+    auto hash_keys = work.writeWork(RecordType::RT_HASH_META, 1000, 8);
+    all_keys.emplace_back(hash_keys);
+    work.expireKeys(all_keys, 1);
+
+    for (int i = 0; i < 60; i++) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      if (countTTLIndex(server, session, 1) == 0) {
+        break;
+      }
+    }
+    EXPECT_EQ(countTTLIndex(server, session, 1), 0u);
+    EXPECT_EQ(server->getServerStat().expiredkeys.get(), hash_keys.size());
+
+    std::stringstream ss;
+    server->getStatInfo(ss);
+    std::string info = ss.str();
+    EXPECT_NE(info.find("expire_backlog_keys:0\r\n"), std::string::npos);
+    EXPECT_NE(info.find("expire_deleted_keys:" +
+                        std::to_string(hash_keys.size()) + "\r\n"),
+              std::string::npos);
+  }
+
+  server->stop();
+  ASSERT_EQ(server.use_count(), 1);
+}
+
 TEST(IndexManager, singleJobRunning) {
   uint64_t totalDequeue = 0;
   uint64_t totalEnqueue = 0;
@@ -0,0 +1,412 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cstring>
+#include <map>
+#include <utility>
+
+#include "glog/logging.h"
+#include "tendisplus/server/monitor_manager.h"
+#include "tendisplus/server/server_entry.h"
+#include "tendisplus/commands/command.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/string.h"
+
+namespace tendisplus {
+
+static std::atomic<uint64_t> gMonitorMgrId(1);
+
+Expected<CaptureFilter> CaptureFilter::parse(
+  const std::vector<std::string>& args, size_t pos) {
+  CaptureFilter filter;
+  for (size_t i = pos; i < args.size(); i++) {
+    auto opt = toLower(args[i]);
+    bool moreargs = args.size() > i + 1;
+    if (opt == "sample" && moreargs) {
+      Expected<uint64_t> erate = ::tendisplus::stoul(args[++i]);
+      if (!erate.ok()) {
+        return erate.status();
+      }
+      if (erate.value() == 0 || erate.value() > UINT32_MAX) {
+        return {ErrorCodes::ERR_PARSEOPT, "invalid SAMPLE rate"};
+      }
+      filter.sampleRate = erate.value();
+    } else if (opt == "command" && moreargs) {
+      filter.commands.insert(toLower(args[++i]));
+    } else if (opt == "keyprefix" && moreargs) {
+      filter.keyPrefix = args[++i];
+    } else {
+      return {ErrorCodes::ERR_PARSEOPT, ""};
+    }
+  }
+  return filter;
+}
+
+bool MonitorManager::Consumer::match(const Record& rec) {
+  if (!filter.commands.empty() &&
+      filter.commands.find(rec.cmd->getName()) == filter.commands.end()) {
+    return false;
+  }
+  if (!filter.keyPrefix.empty()) {
+    const auto& prefix = filter.keyPrefix;
+    bool found = false;
+    for (auto i : rec.cmd->getKeysFromCommand(rec.args)) {
+      if (rec.args[i].compare(0, prefix.size(), prefix) == 0) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+  }
+  return (matched++ % filter.sampleRate) == 0;
+}
+
+MonitorManager::MonitorManager(ServerEntry* svr)
+  : _svr(svr),
+    _instanceId(gMonitorMgrId.fetch_add(1, std::memory_order_relaxed)),
+    _consumerCnt(0),
+    _dumped(0),
+    _closedCaptured(0),
+    _closedDropped(0),
+    _isRunning(false) {}
+
+MonitorManager::~MonitorManager() {
+  stop();
+}
+
+void MonitorManager::stop() {
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    if (!_isRunning) {
+      return;
+    }
+    _isRunning = false;
+  }
+  _cv.notify_all();
+  _thread->join();
+  LOG(INFO) << "MonitorManager stopped";
+
+  std::lock_guard<std::mutex> lk(_mutex);
+  if (_dumpFile) {
+    _dumpFile->close();
+    _dumpFile.reset();
+  }
+  _monitors.clear();
+  _consumerCnt.store(0, std::memory_order_relaxed);
+}
+
+MonitorManager::Ring* MonitorManager::getRing() {
+  struct RingCache {
+    uint64_t instanceId = 0;
+    std::shared_ptr<Ring> ring;
+    void close() {
+      if (ring) {
+        ring->closed.store(true, std::memory_order_release);
+      }
+    }
+    // the manager may be gone, it finds the ring closed if not
+    ~RingCache() {
+      close();
+    }
+  };
+  static thread_local RingCache cache;
+  if (cache.instanceId != _instanceId) {
+    cache.close();
+    auto ring = std::make_shared<Ring>();
+    {
+      std::lock_guard<std::mutex> lk(_ringMutex);
+      _rings.push_back(ring);
+    }
+    cache.instanceId = _instanceId;
+    cache.ring = std::move(ring);
+  }
+  return cache.ring.get();
+}
+
+void MonitorManager::captureSlow(Session* sess, Command* cmd) {
+  if (cmd->getFlags() & CMD_SKIP_MONITOR) {
+    return;
+  }
+  Ring* ring = getRing();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) >= RING_SIZE) {
+    // never wait for the consumer
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  auto& rec = ring->slots[head % RING_SIZE];
+  rec.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+  rec.dbId = sess->getCtx()->getDbId();
+  rec.sessId = sess->id();
+  rec.cmd = cmd;
+  rec.remote = sess->getRemote();
+  // copy assignment reuses the buffers of the slot
+  rec.args = sess->getArgs();
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+Status MonitorManager::addMonitor(Session* sess, const CaptureFilter& filter) {
+  auto ns = std::dynamic_pointer_cast<NetSession>(sess->shared_from_this());
+  if (!ns || sess->getType() != Session::Type::NET) {
+    return {ErrorCodes::ERR_INTERNAL, "monitor not supported in this session"};
+  }
+
+  std::lock_guard<std::mutex> lk(_mutex);
+  for (auto& monitor : _monitors) {
+    if (monitor.sessId == sess->id()) {
+      monitor.consumer.filter = filter;
+      return {ErrorCodes::ERR_OK, ""};
+    }
+  }
+  Monitor monitor;
+  monitor.sess = ns;
+  monitor.sessId = sess->id();
+  monitor.consumer.filter = filter;
+  _monitors.emplace_back(std::move(monitor));
+  _consumerCnt.fetch_add(1, std::memory_order_relaxed);
+  ensureThread();
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+void MonitorManager::removeMonitor(uint64_t sessId) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  for (auto it = _monitors.begin(); it != _monitors.end(); ++it) {
+    if (it->sessId == sessId) {
+      _monitors.erase(it);
+      _consumerCnt.fetch_sub(1, std::memory_order_relaxed);
+      break;
+    }
+  }
+}
+
+Status MonitorManager::startDump(const std::string& path,
+                                 const CaptureFilter& filter) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  if (_dumpFile) {
+    return {ErrorCodes::ERR_INTERNAL,
+            "traffic capture is already running to " + _dumpPath};
+  }
+  auto file = std::make_unique<std::ofstream>(
+    path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file->is_open()) {
+    return {ErrorCodes::ERR_INTERNAL, "open " + path + " failed"};
+  }
+  file->write(CAPTURE_FILE_MAGIC, strlen(CAPTURE_FILE_MAGIC));
+
+  _dumpFile = std::move(file);
+  _dumpPath = path;
+  _dumpConsumer = std::make_unique<Consumer>();
+  _dumpConsumer->filter = filter;
+  _dumped.store(0, std::memory_order_relaxed);
+  _consumerCnt.fetch_add(1, std::memory_order_relaxed);
+  ensureThread();
+  LOG(INFO) << "traffic capture starts, file:" << path;
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status MonitorManager::stopDump() {
+  // the commands captured before stop are still written
+  drain();
+  std::lock_guard<std::mutex> lk(_mutex);
+  if (!_dumpFile) {
+    return {ErrorCodes::ERR_NOTFOUND, "traffic capture is not running"};
+  }
+  _dumpFile->close();
+  _dumpFile.reset();
+  _dumpConsumer.reset();
+  _consumerCnt.fetch_sub(1, std::memory_order_relaxed);
+  LOG(INFO) << "traffic capture stops, file:" << _dumpPath
+            << " records:" << _dumped.load(std::memory_order_relaxed);
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+MonitorManager::Stats MonitorManager::getStats() const {
+  Stats stats{0, 0, 0, 0, 0, false, ""};
+  {
+    std::lock_guard<std::mutex> lk(_ringMutex);
+    stats.captured = _closedCaptured;
+    stats.dropped = _closedDropped;
+    stats.rings = _rings.size();
+    for (const auto& ring : _rings) {
+      stats.captured += ring->head.load(std::memory_order_relaxed);
+      stats.dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+  }
+  stats.dumped = _dumped.load(std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lk(_mutex);
+  stats.monitors = _monitors.size();
+  stats.dumping = _dumpFile != nullptr;
+  stats.dumpPath = _dumpPath;
+  return stats;
+}
+
+// should be called with _mutex held
+void MonitorManager::ensureThread() {
+  if (_thread) {
+    // NOTE: not restarted after stop()
+    return;
+  }
+  _isRunning = true;
+  _thread = std::make_unique<std::thread>([this] {
+    pthread_setname_np(pthread_self(), "tx-monitor");
+    consumerLoop();
+  });
+}
+
+void MonitorManager::consumerLoop() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lk(_mutex);
+      if (!_isRunning) {
+        break;
+      }
+      _cv.wait_for(lk, std::chrono::milliseconds(10));
+      if (!_isRunning) {
+        break;
+      }
+    }
+    // the rings are drained even without consumers, so that the
+    // commands captured before the last consumer left are dropped.
+    while (drain() >= RING_SIZE) {
+    }
+  }
+}
+
+size_t MonitorManager::drain() {
+  std::lock_guard<std::mutex> dlk(_drainMutex);
+  std::vector<std::shared_ptr<Ring>> rings;
+  {
+    std::lock_guard<std::mutex> lk(_ringMutex);
+    rings = _rings;
+  }
+
+  size_t drained = 0;
+  std::vector<std::shared_ptr<Ring>> closed;
+  // monitor -> the lines to send
+  std::map<uint64_t, std::pair<std::shared_ptr<NetSession>, std::string>>
+    outputs;
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    std::string dumpBuf;
+    for (const auto& ring : rings) {
+      // the producer closes the ring after its last record
+      bool isClosed = ring->closed.load(std::memory_order_acquire);
+      uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+      uint64_t head = ring->head.load(std::memory_order_acquire);
+      for (; tail != head; ++tail) {
+        auto& rec = ring->slots[tail % RING_SIZE];
+        std::string line;
+        for (auto it = _monitors.begin(); it != _monitors.end();) {
+          auto sess = it->sess.lock();
+          if (!sess) {
+            it = _monitors.erase(it);
+            _consumerCnt.fetch_sub(1, std::memory_order_relaxed);
+            continue;
+          }
+          if (it->consumer.match(rec)) {
+            if (line.empty()) {
+              line = formatMonitor(rec);
+            }
+            auto& output = outputs[it->sessId];
+            output.first = std::move(sess);
+            output.second.append(line);
+          }
+          ++it;
+        }
+        if (_dumpConsumer && _dumpConsumer->match(rec)) {
+          appendDump(rec, &dumpBuf);
+          _dumped.fetch_add(1, std::memory_order_relaxed);
+        }
+        // the producer doesn't touch the slot before the tail moves
+        std::vector<std::string>().swap(rec.args);
+        std::string().swap(rec.remote);
+      }
+      drained += head - ring->tail.load(std::memory_order_relaxed);
+      ring->tail.store(head, std::memory_order_release);
+      if (isClosed) {
+        closed.push_back(ring);
+      }
+    }
+    if (_dumpFile && !dumpBuf.empty()) {
+      _dumpFile->write(dumpBuf.data(), dumpBuf.size());
+      _dumpFile->flush();
+    }
+  }
+
+  if (!closed.empty()) {
+    std::lock_guard<std::mutex> lk(_ringMutex);
+    for (const auto& ring : closed) {
+      _closedCaptured += ring->head.load(std::memory_order_relaxed);
+      _closedDropped += ring->dropped.load(std::memory_order_relaxed);
+      _rings.erase(std::remove(_rings.begin(), _rings.end(), ring),
+                   _rings.end());
+    }
+  }
+
+  // NOTE: without _mutex, a slow monitor may be closed by
+  // setSharedResponse(), and then removeMonitor() is called.
+  auto limit = _svr->getParams()->pubsubOutputBufferLimit;
+  for (auto& kv : outputs) {
+    auto buf = std::make_shared<SendBuffer>();
+    buf->closeAfterThis = false;
+    buf->buffer.assign(kv.second.second.begin(), kv.second.second.end());
+    kv.second.first->setSharedResponse(buf, limit);
+  }
+  return drained;
+}
+
+std::string MonitorManager::formatMonitor(const Record& rec) const {
+  std::string remote = rec.remote;
+  size_t size = remote.size() + 48;
+  for (const auto& arg : rec.args) {
+    size += arg.size() + 3;
+  }
+  std::string info;
+  info.reserve(size);
+  info += "+";
+  info += std::to_string(rec.timestamp / 1000000);
+  info += ".";
+  info += std::to_string(rec.timestamp % 1000000);
+  info += " [";
+  info += std::to_string(rec.dbId);
+  info += " ";
+  info += rec.remote;
+  info += "] ";
+  for (size_t i = 0; i < rec.args.size(); ++i) {
+    info += "\"";
+    info += rec.args[i];
+    info += "\"";
+    if (i != rec.args.size() - 1) {
+      info += " ";
+    }
+  }
+  info += "\r\n";
+  return info;
+}
+
+void MonitorManager::appendDump(const Record& rec, std::string* buf) const {
+  std::vector<uint8_t> data;
+  CopyUint(&data, rec.timestamp);
+  CopyUint(&data, rec.dbId);
+  CopyUint(&data, rec.sessId);
+  CopyUint(&data, static_cast<uint32_t>(rec.args.size()));
+  for (const auto& arg : rec.args) {
+    CopyUint(&data, static_cast<uint32_t>(arg.size()));
+    data.insert(data.end(), arg.begin(), arg.end());
+  }
+  std::vector<uint8_t> len;
+  CopyUint(&len, static_cast<uint32_t>(data.size()));
+  buf->append(reinterpret_cast<const char*>(len.data()), len.size());
+  buf->append(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,161 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_SERVER_MONITOR_MANAGER_H_
+#define SRC_TENDISPLUS_SERVER_MONITOR_MANAGER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "tendisplus/network/network.h"
+#include "tendisplus/utils/status.h"
+
+namespace tendisplus {
+
+class ServerEntry;
+class Command;
+
+// which of the captured commands a consumer wants
+struct CaptureFilter {
+  // 1 of every sampleRate matched commands, 1 means all of them
+  uint32_t sampleRate = 1;
+  // lower case command names, empty means all commands
+  std::unordered_set<std::string> commands;
+  // at least one key of the command should have the prefix
+  std::string keyPrefix;
+
+  // parse [SAMPLE n] [COMMAND name] ... [KEYPREFIX prefix] from args[pos]
+  static Expected<CaptureFilter> parse(const std::vector<std::string>& args,
+                                       size_t pos);
+};
+
+// MonitorManager feeds MONITOR sessions and the traffic capture file.
+// The worker threads only copy the arguments of the request into a
+// ring buffer of their own, without any lock, and drop the request if
+// the ring is full. A background thread drains the rings, filters and
+// formats the commands, and writes them to the consumers.
+//
+// The capture file is a sequence of records, all integers big endian:
+//   uint32 length of the record after this field
+//   uint64 timestamp in microseconds
+//   uint32 dbid
+//   uint64 session id
+//   uint32 argc, then argc times (uint32 length, bytes)
+// after the file header CAPTURE_FILE_MAGIC.
+class MonitorManager {
+ public:
+  explicit MonitorManager(ServerEntry* svr);
+  MonitorManager(const MonitorManager&) = delete;
+  MonitorManager(MonitorManager&&) = delete;
+  ~MonitorManager();
+
+  void stop();
+
+  // called by ServerEntry::processRequest() for every request
+  void capture(Session* sess, Command* cmd) {
+    if (_consumerCnt.load(std::memory_order_relaxed) != 0) {
+      captureSlow(sess, cmd);
+    }
+  }
+
+  Status addMonitor(Session* sess, const CaptureFilter& filter);
+  void removeMonitor(uint64_t sessId);
+  Status startDump(const std::string& path, const CaptureFilter& filter);
+  Status stopDump();
+
+  struct Stats {
+    uint64_t captured;
+    uint64_t dropped;
+    uint64_t dumped;
+    uint64_t monitors;
+    // the rings of the worker threads alive
+    uint64_t rings;
+    bool dumping;
+    std::string dumpPath;
+  };
+  Stats getStats() const;
+
+  static constexpr size_t RING_SIZE = 4096;
+  static constexpr const char* CAPTURE_FILE_MAGIC = "TENDISCAPTURE1\n";
+
+ private:
+  struct Record {
+    uint64_t timestamp;
+    uint32_t dbId;
+    uint64_t sessId;
+    Command* cmd;
+    std::string remote;
+    std::vector<std::string> args;
+  };
+
+  // single producer (the worker thread), single consumer. the consumer
+  // releases the arguments of a slot once it is drained, so an idle ring
+  // holds no request. when the worker thread exits, the ring is closed
+  // and then removed by the consumer after its last records.
+  struct Ring {
+    std::vector<Record> slots;
+    std::atomic<uint64_t> head;  // written by the producer
+    std::atomic<uint64_t> tail;  // written by the consumer
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> closed;  // no more records after head
+    Ring() : slots(RING_SIZE), head(0), tail(0), dropped(0), closed(false) {}
+  };
+
+  struct Consumer {
+    CaptureFilter filter;
+    uint64_t matched = 0;
+    bool match(const Record& rec);
+  };
+
+  struct Monitor {
+    std::weak_ptr<NetSession> sess;
+    uint64_t sessId;
+    Consumer consumer;
+  };
+
+  void captureSlow(Session* sess, Command* cmd);
+  Ring* getRing();
+  void ensureThread();
+  void consumerLoop();
+  // returns the number of records drained, the rings have one consumer
+  // at a time by _drainMutex
+  size_t drain();
+  std::string formatMonitor(const Record& rec) const;
+  void appendDump(const Record& rec, std::string* buf) const;
+
+  ServerEntry* _svr;
+  // tells the thread_local ring cache which manager it belongs to
+  const uint64_t _instanceId;
+  std::atomic<uint64_t> _consumerCnt;
+  std::atomic<uint64_t> _dumped;
+
+  std::mutex _drainMutex;
+  mutable std::mutex _ringMutex;
+  std::vector<std::shared_ptr<Ring>> _rings;
+  // the counters of the removed rings, protected by _ringMutex
+  uint64_t _closedCaptured;
+  uint64_t _closedDropped;
+
+  // protects the consumers below and the thread state
+  mutable std::mutex _mutex;
+  std::condition_variable _cv;
+  std::list<Monitor> _monitors;
+  std::unique_ptr<Consumer> _dumpConsumer;
+  std::unique_ptr<std::ofstream> _dumpFile;
+  std::string _dumpPath;
+  bool _isRunning;
+  std::unique_ptr<std::thread> _thread;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_SERVER_MONITOR_MANAGER_H_
@@ -0,0 +1,337 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <functional>
+#include <utility>
+
+#include "glog/logging.h"
+#include "tendisplus/server/pubsub_manager.h"
+#include "tendisplus/server/server_entry.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/redis_port.h"
+
+namespace tendisplus {
+
+PubSubManager::PubSubManager(ServerEntry* svr) : _svr(svr), _patternCnt(0) {}
+
+PubSubManager::ChannelShard& PubSubManager::getShard(
+  const std::string& channel) {
+  return _shards[std::hash<std::string>()(channel) % CHANNEL_SHARDS];
+}
+
+const PubSubManager::ChannelShard& PubSubManager::getShard(
+  const std::string& channel) const {
+  return _shards[std::hash<std::string>()(channel) % CHANNEL_SHARDS];
+}
+
+std::string PubSubManager::literalPrefix(const std::string& pattern) {
+  size_t i = 0;
+  for (; i < pattern.size(); ++i) {
+    char c = pattern[i];
+    if (c == '*' || c == '?' || c == '[' || c == '\\') {
+      break;
+    }
+  }
+  return pattern.substr(0, i);
+}
+
+size_t PubSubManager::subCountInLock(uint64_t sessId) const {
+  auto it = _sessSubs.find(sessId);
+  if (it == _sessSubs.end()) {
+    return 0;
+  }
+  return it->second.channels.size() + it->second.patterns.size();
+}
+
+size_t PubSubManager::subscribe(NetSession* sess, const std::string& channel) {
+  auto ns = std::dynamic_pointer_cast<NetSession>(sess->shared_from_this());
+  INVARIANT(ns != nullptr);
+
+  std::lock_guard<std::mutex> lk(_sessMutex);
+  auto& subs = _sessSubs[sess->id()];
+  if (subs.channels.insert(channel).second) {
+    auto& shard = getShard(channel);
+    std::lock_guard<std::mutex> slk(shard.mutex);
+    shard.channels[channel].emplace(sess->id(), ns);
+  }
+  return subCountInLock(sess->id());
+}
+
+void PubSubManager::removeChannelInLock(uint64_t sessId,
+                                        const std::string& channel) {
+  auto& shard = getShard(channel);
+  std::lock_guard<std::mutex> slk(shard.mutex);
+  auto it = shard.channels.find(channel);
+  if (it == shard.channels.end()) {
+    return;
+  }
+  it->second.erase(sessId);
+  if (it->second.empty()) {
+    shard.channels.erase(it);
+  }
+}
+
+size_t PubSubManager::unsubscribe(Session* sess, const std::string& channel) {
+  std::lock_guard<std::mutex> lk(_sessMutex);
+  auto it = _sessSubs.find(sess->id());
+  if (it == _sessSubs.end()) {
+    return 0;
+  }
+  if (it->second.channels.erase(channel)) {
+    removeChannelInLock(sess->id(), channel);
+  }
+  size_t cnt = subCountInLock(sess->id());
+  if (cnt == 0) {
+    _sessSubs.erase(it);
+  }
+  return cnt;
+}
+
+size_t PubSubManager::psubscribe(NetSession* sess, const std::string& pattern) {
+  auto ns = std::dynamic_pointer_cast<NetSession>(sess->shared_from_this());
+  INVARIANT(ns != nullptr);
+
+  std::lock_guard<std::mutex> lk(_sessMutex);
+  auto& subs = _sessSubs[sess->id()];
+  if (subs.patterns.insert(pattern).second) {
+    std::unique_lock<std::shared_timed_mutex> plk(_patternMutex);
+    TrieNode* node = &_patternRoot;
+    for (char c : literalPrefix(pattern)) {
+      auto& child = node->children[c];
+      if (!child) {
+        child = std::make_unique<TrieNode>();
+      }
+      node = child.get();
+    }
+    node->patterns[pattern].emplace(sess->id(), ns);
+    ++_patternCnt;
+  }
+  return subCountInLock(sess->id());
+}
+
+void PubSubManager::removePatternInLock(uint64_t sessId,
+                                        const std::string& pattern) {
+  std::unique_lock<std::shared_timed_mutex> plk(_patternMutex);
+  // remember the path to prune the empty nodes
+  std::vector<std::pair<TrieNode*, char>> path;
+  TrieNode* node = &_patternRoot;
+  for (char c : literalPrefix(pattern)) {
+    auto it = node->children.find(c);
+    if (it == node->children.end()) {
+      INVARIANT_D(0);
+      return;
+    }
+    path.emplace_back(node, c);
+    node = it->second.get();
+  }
+  auto it = node->patterns.find(pattern);
+  if (it == node->patterns.end()) {
+    INVARIANT_D(0);
+    return;
+  }
+  if (it->second.erase(sessId)) {
+    --_patternCnt;
+  }
+  if (!it->second.empty()) {
+    return;
+  }
+  node->patterns.erase(it);
+  while (!path.empty() && node->patterns.empty() && node->children.empty()) {
+    auto parent = path.back();
+    path.pop_back();
+    parent.first->children.erase(parent.second);
+    node = parent.first;
+  }
+}
+
+size_t PubSubManager::punsubscribe(Session* sess, const std::string& pattern) {
+  std::lock_guard<std::mutex> lk(_sessMutex);
+  auto it = _sessSubs.find(sess->id());
+  if (it == _sessSubs.end()) {
+    return 0;
+  }
+  if (it->second.patterns.erase(pattern)) {
+    removePatternInLock(sess->id(), pattern);
+  }
+  size_t cnt = subCountInLock(sess->id());
+  if (cnt == 0) {
+    _sessSubs.erase(it);
+  }
+  return cnt;
+}
+
+std::vector<std::string> PubSubManager::getChannels(uint64_t sessId) const {
+  std::lock_guard<std::mutex> lk(_sessMutex);
+  auto it = _sessSubs.find(sessId);
+  if (it == _sessSubs.end()) {
+    return {};
+  }
+  return {it->second.channels.begin(), it->second.channels.end()};
+}
+
+std::vector<std::string> PubSubManager::getPatterns(uint64_t sessId) const {
+  std::lock_guard<std::mutex> lk(_sessMutex);
+  auto it = _sessSubs.find(sessId);
+  if (it == _sessSubs.end()) {
+    return {};
+  }
+  return {it->second.patterns.begin(), it->second.patterns.end()};
+}
+
+void PubSubManager::unsubscribeAll(uint64_t sessId) {
+  std::lock_guard<std::mutex> lk(_sessMutex);
+  auto it = _sessSubs.find(sessId);
+  if (it == _sessSubs.end()) {
+    return;
+  }
+  for (const auto& channel : it->second.channels) {
+    removeChannelInLock(sessId, channel);
+  }
+  for (const auto& pattern : it->second.patterns) {
+    removePatternInLock(sessId, pattern);
+  }
+  _sessSubs.erase(it);
+}
+
+std::shared_ptr<SendBuffer> PubSubManager::makeMessage(
+  const std::vector<const std::string*>& parts) const {
+  auto buf = std::make_shared<SendBuffer>();
+  buf->closeAfterThis = false;
+  size_t size = 16;
+  for (auto part : parts) {
+    size += part->size() + 16;
+  }
+  buf->buffer.reserve(size);
+
+  auto append = [&buf](const std::string& s) {
+    buf->buffer.insert(buf->buffer.end(), s.begin(), s.end());
+  };
+  append("*" + std::to_string(parts.size()) + "\r\n");
+  for (auto part : parts) {
+    append("$" + std::to_string(part->size()) + "\r\n");
+    append(*part);
+    append("\r\n");
+  }
+  return buf;
+}
+
+uint64_t PubSubManager::outputLimit() const {
+  auto& params = _svr->getParams();
+  return params ? params->pubsubOutputBufferLimit : 0;
+}
+
+uint64_t PubSubManager::deliver(
+  const std::vector<std::shared_ptr<NetSession>>& sesses,
+  const std::shared_ptr<SendBuffer>& buf) const {
+  uint64_t limit = outputLimit();
+  uint64_t receivers = 0;
+  for (const auto& sess : sesses) {
+    if (sess->setSharedResponse(buf, limit).ok()) {
+      receivers++;
+    }
+  }
+  return receivers;
+}
+
+uint64_t PubSubManager::publish(const std::string& channel,
+                                const std::string& message) {
+  static const std::string kMessage = "message";
+  static const std::string kPMessage = "pmessage";
+
+  uint64_t receivers = 0;
+  std::vector<std::shared_ptr<NetSession>> sesses;
+  {
+    auto& shard = getShard(channel);
+    std::lock_guard<std::mutex> slk(shard.mutex);
+    auto it = shard.channels.find(channel);
+    if (it != shard.channels.end()) {
+      sesses.reserve(it->second.size());
+      for (const auto& sub : it->second) {
+        auto sess = sub.second.lock();
+        if (sess) {
+          sesses.emplace_back(std::move(sess));
+        }
+      }
+    }
+  }
+  // NOTE: sessions are written outside of the shard lock, a slow
+  // subscriber may be closed by setSharedResponse()
+  if (!sesses.empty()) {
+    receivers += deliver(sesses, makeMessage({&kMessage, &channel, &message}));
+  }
+
+  if (_patternCnt.load(std::memory_order_relaxed) == 0) {
+    return receivers;
+  }
+
+  std::vector<std::pair<std::string, std::vector<std::shared_ptr<NetSession>>>>
+    matched;
+  {
+    std::shared_lock<std::shared_timed_mutex> plk(_patternMutex);
+    const TrieNode* node = &_patternRoot;
+    size_t depth = 0;
+    while (node) {
+      for (const auto& kv : node->patterns) {
+        const auto& pattern = kv.first;
+        if (!redis_port::stringmatchlen(pattern.c_str(),
+                                        pattern.size(),
+                                        channel.c_str(),
+                                        channel.size(),
+                                        0)) {
+          continue;
+        }
+        std::vector<std::shared_ptr<NetSession>> psesses;
+        for (const auto& sub : kv.second) {
+          auto sess = sub.second.lock();
+          if (sess) {
+            psesses.emplace_back(std::move(sess));
+          }
+        }
+        matched.emplace_back(pattern, std::move(psesses));
+      }
+      if (depth == channel.size()) {
+        break;
+      }
+      auto it = node->children.find(channel[depth++]);
+      node = it == node->children.end() ? nullptr : it->second.get();
+    }
+  }
+  for (const auto& m : matched) {
+    auto buf = makeMessage({&kPMessage, &m.first, &channel, &message});
+    receivers += deliver(m.second, buf);
+  }
+  return receivers;
+}
+
+std::vector<std::string> PubSubManager::activeChannels(
+  const std::string& pattern) const {
+  std::vector<std::string> result;
+  for (const auto& shard : _shards) {
+    std::lock_guard<std::mutex> slk(shard.mutex);
+    for (const auto& kv : shard.channels) {
+      if (pattern.empty() ||
+          redis_port::stringmatchlen(pattern.c_str(),
+                                     pattern.size(),
+                                     kv.first.c_str(),
+                                     kv.first.size(),
+                                     0)) {
+        result.push_back(kv.first);
+      }
+    }
+  }
+  return result;
+}
+
+size_t PubSubManager::numSub(const std::string& channel) const {
+  auto& shard = getShard(channel);
+  std::lock_guard<std::mutex> slk(shard.mutex);
+  auto it = shard.channels.find(channel);
+  return it == shard.channels.end() ? 0 : it->second.size();
+}
+
+size_t PubSubManager::numPat() const {
+  return _patternCnt.load(std::memory_order_relaxed);
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,108 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_SERVER_PUBSUB_MANAGER_H_
+#define SRC_TENDISPLUS_SERVER_PUBSUB_MANAGER_H_
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "tendisplus/network/network.h"
+
+namespace tendisplus {
+
+class ServerEntry;
+
+// PubSubManager keeps the channel and pattern subscriptions of sessions.
+// Channels are spread over CHANNEL_SHARDS independently locked maps, so
+// publishers of different channels don't contend. Patterns are indexed by
+// their literal prefix in a trie, a publish only tries the patterns whose
+// prefix matches the channel. A message is serialized once and the same
+// SendBuffer is queued to every subscriber.
+class PubSubManager {
+ public:
+  explicit PubSubManager(ServerEntry* svr);
+  PubSubManager(const PubSubManager&) = delete;
+  PubSubManager(PubSubManager&&) = delete;
+
+  // the functions below return the number of channels and patterns the
+  // session subscribes after the call, which is part of the reply.
+  size_t subscribe(NetSession* sess, const std::string& channel);
+  size_t unsubscribe(Session* sess, const std::string& channel);
+  size_t psubscribe(NetSession* sess, const std::string& pattern);
+  size_t punsubscribe(Session* sess, const std::string& pattern);
+
+  std::vector<std::string> getChannels(uint64_t sessId) const;
+  std::vector<std::string> getPatterns(uint64_t sessId) const;
+  // called when the session is closed
+  void unsubscribeAll(uint64_t sessId);
+
+  // deliver message to the local subscribers, returns the number of
+  // sessions that received it.
+  uint64_t publish(const std::string& channel, const std::string& message);
+
+  // for PUBSUB CHANNELS/NUMSUB/NUMPAT
+  std::vector<std::string> activeChannels(const std::string& pattern) const;
+  size_t numSub(const std::string& channel) const;
+  size_t numPat() const;
+
+  static constexpr size_t CHANNEL_SHARDS = 16;
+
+ private:
+  using Subscribers =
+    std::unordered_map<uint64_t, std::weak_ptr<NetSession>>;
+
+  struct ChannelShard {
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Subscribers> channels;
+  };
+
+  struct TrieNode {
+    std::map<char, std::unique_ptr<TrieNode>> children;
+    // patterns whose literal prefix ends at this node
+    std::unordered_map<std::string, Subscribers> patterns;
+  };
+
+  struct SessionSubs {
+    std::unordered_set<std::string> channels;
+    std::unordered_set<std::string> patterns;
+  };
+
+  ChannelShard& getShard(const std::string& channel);
+  const ChannelShard& getShard(const std::string& channel) const;
+  static std::string literalPrefix(const std::string& pattern);
+  // should be called with _sessMutex held
+  size_t subCountInLock(uint64_t sessId) const;
+  void removeChannelInLock(uint64_t sessId, const std::string& channel);
+  void removePatternInLock(uint64_t sessId, const std::string& pattern);
+  std::shared_ptr<SendBuffer> makeMessage(
+    const std::vector<const std::string*>& parts) const;
+  uint64_t deliver(const std::vector<std::shared_ptr<NetSession>>& sesses,
+                   const std::shared_ptr<SendBuffer>& buf) const;
+  uint64_t outputLimit() const;
+
+  ServerEntry* _svr;
+  std::array<ChannelShard, CHANNEL_SHARDS> _shards;
+
+  mutable std::shared_timed_mutex _patternMutex;
+  TrieNode _patternRoot;
+  // number of (session, pattern) subscriptions
+  std::atomic<size_t> _patternCnt;
+
+  // lock order: _sessMutex -> ChannelShard::mutex or _patternMutex
+  mutable std::mutex _sessMutex;
+  std::unordered_map<uint64_t, SessionSubs> _sessSubs;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_SERVER_PUBSUB_MANAGER_H_
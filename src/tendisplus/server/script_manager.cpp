@@ -0,0 +1,510 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <utility>
+
+#ifdef WITH_LUA
+extern "C" {
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+}
+#endif
+
+#include "glog/logging.h"
+#include "tendisplus/server/script_manager.h"
+#include "tendisplus/server/server_entry.h"
+#include "tendisplus/commands/command.h"
+#include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/scopeguard.h"
+#include "tendisplus/utils/sha1.h"
+#include "tendisplus/utils/time.h"
+
+namespace tendisplus {
+
+static std::atomic<uint64_t> gScriptMgrId(1);
+
+namespace {
+
+// an error message in a RESP error line
+std::string oneLine(std::string s) {
+  std::replace(s.begin(), s.end(), '\r', ' ');
+  std::replace(s.begin(), s.end(), '\n', ' ');
+  return s;
+}
+
+const char* kNoScriptErr = "-NOSCRIPT No matching script. Please use EVAL.\r\n";
+
+}  // namespace
+
+#ifdef WITH_LUA
+namespace {
+
+// NOTE: lua_error() longjmps over the C++ frames, the functions called
+// by lua raise errors only when there is no C++ object alive in them.
+
+struct LuaEnv {
+  lua_State* lua = nullptr;
+  uint64_t instanceId = 0;
+  uint64_t generation = 0;
+  // the running script
+  ScriptManager* mgr = nullptr;
+  Session* sess = nullptr;
+  Transaction* txn = nullptr;
+  // in ms, 0 means no limit
+  uint64_t deadline = 0;
+
+  ~LuaEnv() {
+    if (lua) {
+      lua_close(lua);
+    }
+  }
+};
+
+thread_local LuaEnv tlsLuaEnv;
+
+// check the time limit every so many instructions
+constexpr int HOOK_INSTRUCTIONS = 100000;
+
+// push the lua value of the RESP reply at pos, returns the position
+// after the reply
+size_t respToLua(lua_State* lua, const std::string& reply, size_t pos) {
+  auto end = reply.find("\r\n", pos);
+  if (pos >= reply.size() || end == std::string::npos) {
+    lua_pushboolean(lua, 0);
+    return reply.size();
+  }
+  std::string line = reply.substr(pos + 1, end - pos - 1);
+  size_t next = end + 2;
+  switch (reply[pos]) {
+    case ':':
+      lua_pushnumber(
+        lua, static_cast<lua_Number>(std::strtoll(line.c_str(), nullptr, 10)));
+      return next;
+    case '$': {
+      int64_t len = std::strtoll(line.c_str(), nullptr, 10);
+      if (len < 0 || next + len > reply.size()) {
+        lua_pushboolean(lua, 0);
+        return next;
+      }
+      lua_pushlstring(lua, reply.data() + next, len);
+      return next + len + 2;
+    }
+    case '+':
+    case '-':
+      lua_newtable(lua);
+      lua_pushlstring(lua, line.data(), line.size());
+      lua_setfield(lua, -2, reply[pos] == '+' ? "ok" : "err");
+      return next;
+    case '*': {
+      int64_t n = std::strtoll(line.c_str(), nullptr, 10);
+      if (n < 0) {
+        lua_pushboolean(lua, 0);
+        return next;
+      }
+      lua_checkstack(lua, 4);
+      lua_newtable(lua);
+      for (int64_t i = 0; i < n; i++) {
+        next = respToLua(lua, reply, next);
+        lua_rawseti(lua, -2, i + 1);
+      }
+      return next;
+    }
+    default:
+      lua_pushboolean(lua, 0);
+      return reply.size();
+  }
+}
+
+// the RESP reply of the lua value on the top, like redis
+std::string luaToResp(lua_State* lua) {
+  switch (lua_type(lua, -1)) {
+    case LUA_TSTRING: {
+      size_t len = 0;
+      const char* s = lua_tolstring(lua, -1, &len);
+      return Command::fmtBulk(std::string(s, len));
+    }
+    case LUA_TBOOLEAN:
+      return lua_toboolean(lua, -1) ? Command::fmtOne() : Command::fmtNull();
+    case LUA_TNUMBER:
+      return Command::fmtLongLong(static_cast<int64_t>(lua_tonumber(lua, -1)));
+    case LUA_TTABLE: {
+      lua_getfield(lua, -1, "err");
+      if (lua_type(lua, -1) == LUA_TSTRING) {
+        std::string err = lua_tostring(lua, -1);
+        lua_pop(lua, 1);
+        return "-" + oneLine(err) + "\r\n";
+      }
+      lua_pop(lua, 1);
+      lua_getfield(lua, -1, "ok");
+      if (lua_type(lua, -1) == LUA_TSTRING) {
+        std::string ok = lua_tostring(lua, -1);
+        lua_pop(lua, 1);
+        return Command::fmtStatus(oneLine(ok));
+      }
+      lua_pop(lua, 1);
+
+      // an array, up to the first nil
+      std::string items;
+      uint64_t count = 0;
+      for (int j = 1;; j++) {
+        lua_rawgeti(lua, -1, j);
+        if (lua_type(lua, -1) == LUA_TNIL) {
+          lua_pop(lua, 1);
+          break;
+        }
+        items += luaToResp(lua);
+        lua_pop(lua, 1);
+        count++;
+      }
+      return "*" + std::to_string(count) + "\r\n" + items;
+    }
+    default:
+      return Command::fmtNull();
+  }
+}
+
+int luaRedisGenericCommand(lua_State* lua, bool raiseError) {
+  bool failed = false;
+  {
+    LuaEnv* env = &tlsLuaEnv;
+    int argc = lua_gettop(lua);
+    std::string err;
+    std::vector<std::string> args;
+    if (argc == 0) {
+      err = "Please specify at least one argument for redis.call()";
+    }
+    for (int i = 1; i <= argc; i++) {
+      int type = lua_type(lua, i);
+      if (type != LUA_TSTRING && type != LUA_TNUMBER) {
+        err = "Lua redis() command arguments must be strings or integers";
+        break;
+      }
+      size_t len = 0;
+      const char* s = lua_tolstring(lua, i, &len);
+      args.emplace_back(s, len);
+    }
+
+    std::string reply = err.empty()
+      ? env->mgr->callCommand(env->sess, env->txn, args)
+      : Command::fmtErr(err);
+    if (raiseError && reply[0] == '-') {
+      // without the leading '-' and "\r\n"
+      lua_pushlstring(lua, reply.data() + 1, reply.size() - 3);
+      failed = true;
+    } else {
+      respToLua(lua, reply, 0);
+    }
+  }
+  if (failed) {
+    return lua_error(lua);
+  }
+  return 1;
+}
+
+int luaRedisCallCommand(lua_State* lua) {
+  return luaRedisGenericCommand(lua, true);
+}
+
+int luaRedisPCallCommand(lua_State* lua) {
+  return luaRedisGenericCommand(lua, false);
+}
+
+int luaRedisSha1hexCommand(lua_State* lua) {
+  if (lua_gettop(lua) != 1) {
+    lua_pushstring(lua, "wrong number of arguments");
+    return lua_error(lua);
+  }
+  size_t len = 0;
+  const char* s = lua_tolstring(lua, 1, &len);
+  if (!s) {
+    lua_pushstring(lua, "wrong type of argument");
+    return lua_error(lua);
+  }
+  char digest[41];
+  {
+    auto hex = sha1hex(std::string(s, len));
+    std::copy(hex.begin(), hex.end(), digest);
+  }
+  lua_pushlstring(lua, digest, 40);
+  return 1;
+}
+
+// redis.error_reply() and redis.status_reply()
+int luaReturnSingleFieldTable(lua_State* lua, const char* field) {
+  if (lua_gettop(lua) != 1 || lua_type(lua, -1) != LUA_TSTRING) {
+    lua_pushstring(lua, "wrong number or type of arguments");
+    return lua_error(lua);
+  }
+  lua_newtable(lua);
+  lua_pushvalue(lua, 1);
+  lua_setfield(lua, -2, field);
+  return 1;
+}
+
+int luaRedisErrorReplyCommand(lua_State* lua) {
+  return luaReturnSingleFieldTable(lua, "err");
+}
+
+int luaRedisStatusReplyCommand(lua_State* lua) {
+  return luaReturnSingleFieldTable(lua, "ok");
+}
+
+void luaMaskCountHook(lua_State* lua, lua_Debug* ar) {
+  auto deadline = tlsLuaEnv.deadline;
+  if (deadline != 0 && msSinceEpoch() > deadline) {
+    lua_pushstring(lua, "Script killed by timeout, lua-time-limit exceeded");
+    lua_error(lua);
+  }
+}
+
+void loadLib(lua_State* lua, const char* name, lua_CFunction f) {
+  lua_pushcfunction(lua, f);
+  lua_pushstring(lua, name);
+  lua_call(lua, 1, 0);
+}
+
+lua_State* createLuaState() {
+  lua_State* lua = luaL_newstate();
+  // no io, os or package, a script can't touch the files
+  loadLib(lua, "", luaopen_base);
+  loadLib(lua, LUA_TABLIBNAME, luaopen_table);
+  loadLib(lua, LUA_STRLIBNAME, luaopen_string);
+  loadLib(lua, LUA_MATHLIBNAME, luaopen_math);
+  lua_pushnil(lua);
+  lua_setglobal(lua, "loadfile");
+  lua_pushnil(lua);
+  lua_setglobal(lua, "dofile");
+
+  lua_newtable(lua);
+  lua_pushcfunction(lua, luaRedisCallCommand);
+  lua_setfield(lua, -2, "call");
+  lua_pushcfunction(lua, luaRedisPCallCommand);
+  lua_setfield(lua, -2, "pcall");
+  lua_pushcfunction(lua, luaRedisSha1hexCommand);
+  lua_setfield(lua, -2, "sha1hex");
+  lua_pushcfunction(lua, luaRedisErrorReplyCommand);
+  lua_setfield(lua, -2, "error_reply");
+  lua_pushcfunction(lua, luaRedisStatusReplyCommand);
+  lua_setfield(lua, -2, "status_reply");
+  lua_setglobal(lua, "redis");
+
+  lua_sethook(lua, luaMaskCountHook, LUA_MASKCOUNT, HOOK_INSTRUCTIONS);
+  return lua;
+}
+
+// the lua state of the thread, rebuilt after SCRIPT FLUSH
+LuaEnv* getLuaEnv(const ScriptManager* mgr) {
+  LuaEnv* env = &tlsLuaEnv;
+  if (env->lua && env->instanceId == mgr->getInstanceId() &&
+      env->generation == mgr->getGeneration()) {
+    return env;
+  }
+  if (env->lua) {
+    lua_close(env->lua);
+  }
+  env->generation = mgr->getGeneration();
+  env->instanceId = mgr->getInstanceId();
+  env->lua = createLuaState();
+  return env;
+}
+
+std::string popLuaError(lua_State* lua) {
+  const char* s = lua_tostring(lua, -1);
+  std::string err = s ? s : "unknown error";
+  lua_pop(lua, 1);
+  return oneLine(err);
+}
+
+// define the global function fname of the script body
+Status compileScript(lua_State* lua,
+                     const std::string& fname,
+                     const std::string& body) {
+  std::string code = "function " + fname + "() " + body + "\nend";
+  if (luaL_loadbuffer(lua, code.data(), code.size(), "@user_script") ||
+      lua_pcall(lua, 0, 0, 0)) {
+    return {ErrorCodes::ERR_PARSEPKT,
+            "Error compiling script (new function): " + popLuaError(lua)};
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+void setGlobalArray(lua_State* lua,
+                    const char* name,
+                    const std::vector<std::string>& elems) {
+  lua_newtable(lua);
+  for (size_t i = 0; i < elems.size(); i++) {
+    lua_pushlstring(lua, elems[i].data(), elems[i].size());
+    lua_rawseti(lua, -2, i + 1);
+  }
+  lua_setglobal(lua, name);
+}
+
+}  // namespace
+#endif  // WITH_LUA
+
+ScriptManager::ScriptManager(ServerEntry* svr)
+  : _svr(svr),
+    _instanceId(gScriptMgrId.fetch_add(1, std::memory_order_relaxed)),
+    _generation(0) {}
+
+Expected<std::string> ScriptManager::loadScript(const std::string& body) {
+#ifdef WITH_LUA
+  auto sha = sha1hex(body);
+  auto env = getLuaEnv(this);
+  auto fname = "f_" + sha;
+  lua_getglobal(env->lua, fname.c_str());
+  bool compiled = !lua_isnil(env->lua, -1);
+  lua_pop(env->lua, 1);
+  if (!compiled) {
+    RET_IF_ERR(compileScript(env->lua, fname, body));
+  }
+  cacheScript(sha, body);
+  return sha;
+#else
+  return {ErrorCodes::ERR_PARSEPKT, "scripting is not enabled in this build"};
+#endif
+}
+
+void ScriptManager::cacheScript(const std::string& sha,
+                                const std::string& body) {
+  {
+    std::shared_lock<std::shared_timed_mutex> lk(_mutex);
+    if (_scripts.count(sha)) {
+      return;
+    }
+  }
+  std::unique_lock<std::shared_timed_mutex> lk(_mutex);
+  _scripts.emplace(sha, body);
+}
+
+Expected<std::string> ScriptManager::getScript(const std::string& sha) const {
+  std::shared_lock<std::shared_timed_mutex> lk(_mutex);
+  auto it = _scripts.find(sha);
+  if (it == _scripts.end()) {
+    return {ErrorCodes::ERR_PARSEPKT, kNoScriptErr};
+  }
+  return it->second;
+}
+
+bool ScriptManager::existsScript(const std::string& sha) const {
+  std::shared_lock<std::shared_timed_mutex> lk(_mutex);
+  return _scripts.count(sha) > 0;
+}
+
+void ScriptManager::flushScripts() {
+  std::unique_lock<std::shared_timed_mutex> lk(_mutex);
+  _scripts.clear();
+  ++_generation;
+}
+
+uint64_t ScriptManager::getScriptCount() const {
+  std::shared_lock<std::shared_timed_mutex> lk(_mutex);
+  return _scripts.size();
+}
+
+std::string ScriptManager::callCommand(Session* sess,
+                                       Transaction* txn,
+                                       const std::vector<std::string>& args) {
+  // swapped back when the command is done
+  std::vector<std::string> swapped = args;
+  sess->swapArgs(&swapped);
+  const auto guard = MakeGuard([sess, &swapped] { sess->swapArgs(&swapped); });
+
+  auto expCmd = Command::precheck(sess);
+  if (!expCmd.ok()) {
+    return Command::fmtErr(expCmd.status().toString());
+  }
+  auto cmd = expCmd.value();
+  if (cmd->getFlags() & CMD_NOSCRIPT) {
+    return Command::fmtErr("This Redis command is not allowed from scripts");
+  }
+  // the keys were locked by EVAL, an undeclared key may be in another
+  // store or deadlock with other sessions
+  const auto& cmdArgs = sess->getArgs();
+  auto index = cmd->getKeysFromCommand(cmdArgs);
+  bool isWrite = cmd->getFlags() & CMD_WRITE;
+  if (isWrite && index.empty()) {
+    return Command::fmtErr(
+      "Write commands without keys are not allowed from scripts");
+  }
+  for (auto i : index) {
+    if (!sess->getCtx()->isLockedByMe(cmdArgs[i], mgl::LockMode::LOCK_NONE)) {
+      return Command::fmtErr(
+        "Script attempted to access a key not declared in KEYS: " +
+        oneLine(cmdArgs[i]));
+    }
+  }
+
+  cmd->incrCallTimes();
+  // a failed command leaves nothing in the script transaction, like it
+  // does in its own transaction
+  if (isWrite && txn) {
+    txn->setSavePoint();
+  }
+  auto v = cmd->run(sess);
+  if (isWrite && txn) {
+    auto s = v.ok() ? txn->popSavePoint() : txn->rollbackToSavePoint();
+    if (!s.ok()) {
+      LOG(ERROR) << "release save point failed:" << s.toString();
+    }
+  }
+  if (!v.ok()) {
+    return Command::fmtErr(v.status().toString());
+  }
+  return v.value();
+}
+
+Expected<std::string> ScriptManager::runScript(
+  Session* sess,
+  const std::string& sha,
+  const std::string& body,
+  const std::vector<std::string>& keys,
+  const std::vector<std::string>& argv,
+  Transaction* txn) {
+#ifdef WITH_LUA
+  auto env = getLuaEnv(this);
+  lua_State* lua = env->lua;
+  auto fname = "f_" + sha;
+  lua_getglobal(lua, fname.c_str());
+  if (lua_isnil(lua, -1)) {
+    lua_pop(lua, 1);
+    RET_IF_ERR(compileScript(lua, fname, body));
+    // EVAL keeps the script for EVALSHA
+    cacheScript(sha, body);
+    lua_getglobal(lua, fname.c_str());
+  }
+  setGlobalArray(lua, "KEYS", keys);
+  setGlobalArray(lua, "ARGV", argv);
+
+  auto limit = _svr->getParams()->luaTimeLimit;
+  env->mgr = this;
+  env->sess = sess;
+  env->txn = txn;
+  env->deadline = limit ? msSinceEpoch() + limit : 0;
+  sess->getCtx()->setFlags(CLIENT_SCRIPT);
+  int err = lua_pcall(lua, 0, 1, 0);
+  sess->getCtx()->resetFlags(CLIENT_SCRIPT);
+  env->sess = nullptr;
+  env->txn = nullptr;
+  env->deadline = 0;
+
+  if (err) {
+    return {ErrorCodes::ERR_PARSEPKT,
+            "Error running script (call to " + fname +
+              "): " + popLuaError(lua)};
+  }
+  auto reply = luaToResp(lua);
+  lua_pop(lua, 1);
+  lua_gc(lua, LUA_GCSTEP, 1);
+  return reply;
+#else
+  return {ErrorCodes::ERR_PARSEPKT, "scripting is not enabled in this build"};
+#endif
+}
+
+}  // namespace tendisplus
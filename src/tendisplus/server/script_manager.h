@@ -0,0 +1,82 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_SERVER_SCRIPT_MANAGER_H_
+#define SRC_TENDISPLUS_SERVER_SCRIPT_MANAGER_H_
+
+#include <atomic>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tendisplus/server/session.h"
+#include "tendisplus/storage/kvstore.h"
+#include "tendisplus/utils/status.h"
+
+namespace tendisplus {
+
+class ServerEntry;
+
+// ScriptManager keeps the scripts of EVAL and SCRIPT LOAD by their sha1,
+// and runs them in the lua state of the worker thread. Each worker thread
+// has a state of its own, a script is compiled into it on the first run
+// there. SCRIPT FLUSH bumps the generation, and the states are rebuilt on
+// their next use.
+// The commands called by a script (redis.call/redis.pcall) run in the
+// session of EVAL, so the keys locked by EVAL are not locked again, and
+// their transactions are nested in the one of the script, see
+// NestedTransaction.
+class ScriptManager {
+ public:
+  explicit ScriptManager(ServerEntry* svr);
+  ScriptManager(const ScriptManager&) = delete;
+  ScriptManager(ScriptManager&&) = delete;
+
+  // returns the sha1 of the script, or the compile error
+  Expected<std::string> loadScript(const std::string& body);
+  // EVAL keeps the script for EVALSHA
+  void cacheScript(const std::string& sha, const std::string& body);
+  // a NOSCRIPT error if the script is not loaded
+  Expected<std::string> getScript(const std::string& sha) const;
+  bool existsScript(const std::string& sha) const;
+  void flushScripts();
+  uint64_t getScriptCount() const;
+
+  // run the script with the declared keys locked by the caller, txn is
+  // the script transaction, nullptr if there is no key. returns the reply
+  // of the script in RESP, an error if the script fails, and then the
+  // caller should roll back txn.
+  Expected<std::string> runScript(Session* sess,
+                                  const std::string& sha,
+                                  const std::string& body,
+                                  const std::vector<std::string>& keys,
+                                  const std::vector<std::string>& argv,
+                                  Transaction* txn);
+
+  // run one command of the script, the reply is in RESP, errors included
+  std::string callCommand(Session* sess,
+                          Transaction* txn,
+                          const std::vector<std::string>& args);
+
+  uint64_t getInstanceId() const {
+    return _instanceId;
+  }
+  uint64_t getGeneration() const {
+    return _generation.load(std::memory_order_relaxed);
+  }
+
+ private:
+  ServerEntry* _svr;
+  // tells the thread_local lua state which manager it belongs to
+  const uint64_t _instanceId;
+  std::atomic<uint64_t> _generation;
+
+  mutable std::shared_timed_mutex _mutex;
+  std::unordered_map<std::string, std::string> _scripts;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_SERVER_SCRIPT_MANAGER_H_
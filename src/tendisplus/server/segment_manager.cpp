@@ -92,6 +92,10 @@ Expected<DbWithLock> SegmentMgrFnvHash64::getDbWithKeyLock(
         return node.status();
       }
     }
+    if (sess && sess->getCtx() &&
+        sess->getCtx()->getKeyTracking() != SessionCtx::KeyTracking::NONE) {
+      sess->getServerEntry()->getTrackingMgr()->onKeyLocked(sess, key);
+    }
     return DbWithLock{
       segId, chunkId, _instances[segId], nullptr, std::move(elk.value())};
   } else {
@@ -228,6 +232,14 @@ SegmentMgrFnvHash64::getAllKeysLocked(Session* sess,
     }
   }
 
+  if (sess && sess->getCtx() &&
+      sess->getCtx()->getKeyTracking() != SessionCtx::KeyTracking::NONE) {
+    auto trackingMgr = sess->getServerEntry()->getTrackingMgr();
+    for (auto i : index) {
+      trackingMgr->onKeyLocked(sess, args[i]);
+    }
+  }
+
   return locklist;
 }
 
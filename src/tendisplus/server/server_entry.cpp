@@ -17,6 +17,8 @@
 #include "tendisplus/utils/time.h"
 #include "tendisplus/commands/command.h"
 #include "tendisplus/storage/rocks/rocks_kvstore.h"
+#include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/counter_cache.h"
 #include "tendisplus/utils/string.h"
 #include "tendisplus/lock/lock.h"
 
@@ -210,6 +212,7 @@ ServerEntry::ServerEntry()
     _isShutdowned(false),
     _startupTime(nsSinceEpoch()),
     _network(nullptr),
+    _sessionCnt(0),
     _segmentMgr(nullptr),
     _replMgr(nullptr),
     _migrateMgr(nullptr),
@@ -218,6 +221,12 @@ ServerEntry::ServerEntry()
     _mgLockMgr(nullptr),
     _clusterMgr(nullptr),
     _gcMgr(nullptr),
+    _blockMgr(std::make_unique<BlockManager>()),
+    _pubsubMgr(std::make_unique<PubSubManager>(this)),
+    _trackingMgr(std::make_unique<TrackingManager>(this)),
+    _monitorMgr(std::make_unique<MonitorManager>(this)),
+    _scriptMgr(std::make_unique<ScriptManager>(this)),
+    _compactionScheduler(nullptr),
     _catalog(nullptr),
     _netMatrix(std::make_shared<NetworkMatrix>()),
     _poolMatrix(std::make_shared<PoolMatrix>()),
@@ -510,8 +519,23 @@ Status ServerEntry::startup(const std::shared_ptr<ServerParams>& cfg) {
   }
 
   // kvstore init
-  auto blockCache = rocksdb::NewLRUCache(
-    cfg->rocksBlockcacheMB * 1024 * 1024LL, 6, cfg->rocksStrictCapacityLimit);
+  // the index and filter blocks are the only ones of high priority
+  _blockCache = rocksdb::NewLRUCache(
+    cfg->rocksBlockcacheMB * 1024 * 1024LL,
+    6,
+    cfg->rocksStrictCapacityLimit,
+    cfg->rocksCacheIndexAndFilterBlocks ? cfg->rocksBlockcacheHighPriPoolRatio
+                                        : 0.0);
+  if (cfg->rocksWriteBufferManagerMB > 0) {
+    if (cfg->rocksWriteBufferManagerMB >= cfg->rocksBlockcacheMB) {
+      LOG(WARNING) << "rocks.write_buffer_manager_mb is not less than "
+                   << "rocks.blockcachemb, no block would be cached";
+    }
+    // the memtables take the room of the blocks, rather than adding to
+    // the memory the cache takes
+    _writeBufferManager = std::make_shared<rocksdb::WriteBufferManager>(
+      cfg->rocksWriteBufferManagerMB * 1024 * 1024LL, _blockCache);
+  }
   std::vector<PStore> tmpStores;
   tmpStores.reserve(kvStoreCount);
   for (size_t i = 0; i < kvStoreCount; ++i) {
@@ -537,11 +561,12 @@ Status ServerEntry::startup(const std::shared_ptr<ServerParams>& cfg) {
     tmpStores.emplace_back(
       std::unique_ptr<KVStore>(new RocksKVStore(std::to_string(i),
                                                 cfg,
-                                                blockCache,
+                                                _blockCache,
                                                 true,
                                                 mode,
                                                 RocksKVStore::TxnMode::TXN_PES,
-                                                flag)));
+                                                flag,
+                                                _writeBufferManager)));
   }
 
   // if binlogUsingDefaultCF is flase and binlog version is 1, we end up
@@ -661,6 +686,14 @@ Status ServerEntry::startup(const std::shared_ptr<ServerParams>& cfg) {
     }
   }
 
+  _compactionScheduler = std::make_unique<CompactionScheduler>(this);
+  s = _compactionScheduler->startup();
+  if (!s.ok()) {
+    LOG(ERROR) << "ServerEntry::startup failed, _compactionScheduler->startup:"
+               << s.toString();
+    return s;
+  }
+
   // listener should be the lastone to run.
   s = _network->run();
   if (!s.ok()) {
@@ -726,6 +759,30 @@ GCManager* ServerEntry::getGcMgr() {
   return _gcMgr.get();
 }
 
+BlockManager* ServerEntry::getBlockMgr() {
+  return _blockMgr.get();
+}
+
+PubSubManager* ServerEntry::getPubSubMgr() {
+  return _pubsubMgr.get();
+}
+
+TrackingManager* ServerEntry::getTrackingMgr() {
+  return _trackingMgr.get();
+}
+
+MonitorManager* ServerEntry::getMonitorMgr() {
+  return _monitorMgr.get();
+}
+
+ScriptManager* ServerEntry::getScriptMgr() {
+  return _scriptMgr.get();
+}
+
+CompactionScheduler* ServerEntry::getCompactionScheduler() {
+  return _compactionScheduler.get();
+}
+
 std::string ServerEntry::requirepass() const {
   std::lock_guard<std::mutex> lk(_mutex);
   return _requirepass;
@@ -750,8 +807,19 @@ bool ServerEntry::versionIncrease() const {
   return _versionIncrease;
 }
 
+ServerEntry::SessionShard& ServerEntry::getSessionShard(uint64_t id) {
+  return _sessionShards[id % SESSION_SHARDS];
+}
+
+const ServerEntry::SessionShard& ServerEntry::getSessionShard(
+  uint64_t id) const {
+  return _sessionShards[id % SESSION_SHARDS];
+}
+
 bool ServerEntry::addSession(std::shared_ptr<Session> sess) {
-  std::lock_guard<std::mutex> lk(_mutex);
+  uint64_t id = sess->id();
+  auto& shard = getSessionShard(id);
+  std::lock_guard<std::mutex> lk(shard.mutex);
   if (!_isRunning.load(std::memory_order_relaxed)) {
     LOG(WARNING) << "session:" << sess->id()
                  << " comes when stopping, ignore it";
@@ -760,8 +828,7 @@ bool ServerEntry::addSession(std::shared_ptr<Session> sess) {
 
   // NOTE(deyukong): first driving force
   sess->start();
-  uint64_t id = sess->id();
-  if (_sessions.find(id) != _sessions.end()) {
+  if (shard.sessions.find(id) != shard.sessions.end()) {
     INVARIANT_D(0);
     LOG(ERROR) << "add session:" << id << ",session id already exists";
   }
@@ -772,14 +839,17 @@ bool ServerEntry::addSession(std::shared_ptr<Session> sess) {
                << " type:" << sess->getTypeStr();
   }
 #endif
-  _sessions[id] = std::move(sess);
+  if (shard.sessions.emplace(id, std::move(sess)).second) {
+    _sessionCnt.fetch_add(1, std::memory_order_relaxed);
+  }
   return true;
 }
 
 std::shared_ptr<Session> ServerEntry::getSession(uint64_t id) const {
-  std::lock_guard<std::mutex> lk(_mutex);
-  auto it = _sessions.find(id);
-  if (it == _sessions.end()) {
+  auto& shard = getSessionShard(id);
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  auto it = shard.sessions.find(id);
+  if (it == shard.sessions.end()) {
     return nullptr;
   }
 
@@ -787,17 +857,17 @@ std::shared_ptr<Session> ServerEntry::getSession(uint64_t id) const {
 }
 
 size_t ServerEntry::getSessionCount() {
-  std::lock_guard<std::mutex> lk(_mutex);
-  return _sessions.size();
+  return _sessionCnt.load(std::memory_order_relaxed);
 }
 
 Status ServerEntry::cancelSession(uint64_t connId) {
-  std::lock_guard<std::mutex> lk(_mutex);
+  auto& shard = getSessionShard(connId);
+  std::lock_guard<std::mutex> lk(shard.mutex);
   if (!_isRunning.load(std::memory_order_relaxed)) {
     return {ErrorCodes::ERR_BUSY, "server is shutting down"};
   }
-  auto it = _sessions.find(connId);
-  if (it == _sessions.end()) {
+  auto it = shard.sessions.find(connId);
+  if (it == shard.sessions.end()) {
     return {ErrorCodes::ERR_NOTFOUND,
             "session not found:" + std::to_string(connId)};
   }
@@ -807,40 +877,87 @@ Status ServerEntry::cancelSession(uint64_t connId) {
 }
 //
 void ServerEntry::endSession(uint64_t connId) {
-  std::lock_guard<std::mutex> lk(_mutex);
-  if (!_isRunning.load(std::memory_order_relaxed)) {
-    return;
+  std::shared_ptr<Session> sess;
+  {
+    auto& shard = getSessionShard(connId);
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    if (!_isRunning.load(std::memory_order_relaxed)) {
+      return;
+    }
+    auto it = shard.sessions.find(connId);
+    if (it == shard.sessions.end()) {
+      // NOTE(vinchen): ServerEntry::endSession() is called by
+      // NetSession::endSession(), but it is not holding NetSession::_mutex
+      // So here is possible now.
+      LOG(ERROR) << "destroy conn:" << connId << ",not exists";
+      return;
+    }
+    SessionCtx* pCtx = it->second->getCtx();
+    INVARIANT(pCtx != nullptr);
+    if (pCtx->getIsMonitor()) {
+      _monitorMgr->removeMonitor(connId);
+    }
+    _blockMgr->removeWaiter(connId);
+    _pubsubMgr->unsubscribeAll(connId);
+    _trackingMgr->disableTracking(connId);
+#ifdef TENDIS_DEBUG
+    if (it->second->getType() != Session::Type::LOCAL) {
+      DLOG(INFO) << "ServerEntry endSession id:" << connId
+                 << " addr:" << it->second->getRemote()
+                 << " type:" << it->second->getTypeStr();
+    }
+#endif
+    sess = std::move(it->second);
+    shard.sessions.erase(it);
+    _sessionCnt.fetch_sub(1, std::memory_order_relaxed);
   }
-  auto it = _sessions.find(connId);
-  if (it == _sessions.end()) {
-    // NOTE(vinchen): ServerEntry::endSession() is called by
-    // NetSession::endSession(), but it is not holding NetSession::_mutex
-    // So here is possible now.
-    LOG(ERROR) << "destroy conn:" << connId << ",not exists";
-    return;
+  // the session may be destroyed here, out of the shard lock
+}
+
+std::shared_ptr<LocalSession> ServerEntry::acquireLocalSession() {
+  std::shared_ptr<LocalSession> sess;
+  {
+    std::lock_guard<std::mutex> lk(_localPoolMutex);
+    if (!_localSessionPool.empty()) {
+      sess = std::move(_localSessionPool.back());
+      _localSessionPool.pop_back();
+    }
   }
-  SessionCtx* pCtx = it->second->getCtx();
-  INVARIANT(pCtx != nullptr);
-  if (pCtx->getIsMonitor()) {
-    DelMonitorNoLock(connId);
+  if (!sess) {
+    sess = std::make_shared<LocalSession>(this);
   }
-#ifdef TENDIS_DEBUG
-  if (it->second->getType() != Session::Type::LOCAL) {
-    DLOG(INFO) << "ServerEntry endSession id:" << connId
-               << " addr:" << it->second->getRemote()
-               << " type:" << it->second->getTypeStr();
+  addSession(sess);
+  return sess;
+}
+
+void ServerEntry::releaseLocalSession(std::shared_ptr<LocalSession> sess) {
+  endSession(sess->id());
+  // the session may still be referred by others, e.g. getAllSessions()
+  if (sess.use_count() != 1 || !_isRunning.load(std::memory_order_relaxed)) {
+    return;
+  }
+  uint32_t poolSize = _cfg ? _cfg->localSessionPoolSize : 0;
+  std::lock_guard<std::mutex> lk(_localPoolMutex);
+  if (_localSessionPool.size() < poolSize) {
+    sess->reset();
+    _localSessionPool.emplace_back(std::move(sess));
   }
-#endif
-  _sessions.erase(it);
 }
 
 std::list<std::shared_ptr<Session>> ServerEntry::getAllSessions() const {
-  std::lock_guard<std::mutex> lk(_mutex);
   uint64_t start = nsSinceEpoch();
   std::list<std::shared_ptr<Session>> sesses;
-  for (const auto& kv : _sessions) {
-    sesses.push_back(kv.second);
+  for (const auto& shard : _sessionShards) {
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    for (const auto& kv : shard.sessions) {
+      sesses.push_back(kv.second);
+    }
   }
+  // in the order of connecting, like the single map before
+  sesses.sort([](const std::shared_ptr<Session>& a,
+                 const std::shared_ptr<Session>& b) {
+    return a->id() < b->id();
+  });
   uint64_t delta = (nsSinceEpoch() - start) / 1000000;
   if (delta >= 5) {
     LOG(WARNING) << "get sessions cost:" << delta << "ms"
@@ -849,31 +966,6 @@ std::list<std::shared_ptr<Session>> ServerEntry::getAllSessions() const {
   return sesses;
 }
 
-void ServerEntry::AddMonitor(uint64_t sessId) {
-  std::lock_guard<std::mutex> lk(_mutex);
-  for (const auto& monSess : _monitors) {
-    if (monSess->id() == sessId) {
-      return;
-    }
-  }
-  auto it = _sessions.find(sessId);
-  if (it == _sessions.end()) {
-    LOG(ERROR) << "AddMonitor session not found:" << sessId;
-    return;
-  }
-
-  _monitors.push_back(it->second);
-}
-
-void ServerEntry::DelMonitorNoLock(uint64_t connId) {
-  for (auto it = _monitors.begin(); it != _monitors.end(); ++it) {
-    if (it->get()->id() == connId) {
-      _monitors.erase(it);
-      break;
-    }
-  }
-}
-
 /**
  * @brief update func to resize workpool thread num
  * @note like WorkerPool::resize(), three cases
@@ -939,44 +1031,6 @@ void ServerEntry::resizeIncrExecutorThreadNum(uint64_t newThreadNum) {
   }
 }
 
-void ServerEntry::replyMonitors(Session* sess) {
-  if (_monitors.size() <= 0) {
-    return;
-  }
-
-  std::string info = "+";
-
-  auto timeNow = std::chrono::duration_cast<std::chrono::microseconds>(
-    std::chrono::system_clock::now().time_since_epoch());
-  uint64_t timestamp = timeNow.count();
-
-  SessionCtx* pCtx = sess->getCtx();
-  INVARIANT(pCtx != nullptr);
-  uint32_t dbId = pCtx->getDbId();
-
-  info += std::to_string(timestamp / 1000000) + "." +
-    std::to_string(timestamp % 1000000);
-  info += " [" + std::to_string(dbId) + " " + sess->getRemote() + "] ";
-  const auto& args = sess->getArgs();
-  for (uint32_t i = 0; i < args.size(); ++i) {
-    info += "\"" + args[i] + "\"";
-    if (i != (args.size() - 1)) {
-      info += " ";
-    }
-  }
-  info += "\r\n";
-
-  std::lock_guard<std::mutex> lk(_mutex);
-  for (auto iter = _monitors.begin(); iter != _monitors.end();) {
-    auto s = (*iter)->setResponse(info);
-    if (!s.ok()) {
-      iter = _monitors.erase(iter);
-    } else {
-      ++iter;
-    }
-  }
-}
-
 bool ServerEntry::processRequest(Session* sess) {
   if (!_isRunning.load(std::memory_order_relaxed)) {
     return false;
@@ -986,6 +1040,10 @@ bool ServerEntry::processRequest(Session* sess) {
 
   auto expCmd = Command::precheck(sess);
   if (!expCmd.ok()) {
+    if (sess->getCtx()->isInMulti() && !sess->getCtx()->isEp()) {
+      // like redis, EXEC fails if a command can't be queued
+      sess->getCtx()->setFlags(CLIENT_DIRTY_EXEC);
+    }
     auto s =
       sess->setResponse(redis_port::errorReply(expCmd.status().toString()));
     if (!s.ok()) {
@@ -994,7 +1052,7 @@ bool ServerEntry::processRequest(Session* sess) {
     return true;
   }
 
-  replyMonitors(sess);
+  _monitorMgr->capture(sess, expCmd.value());
 
   if (expCmd.value()->isBgCmd()) {
     auto expCmdName = expCmd.value()->getName();
@@ -1071,6 +1129,10 @@ bool ServerEntry::processRequest(Session* sess) {
                 << " err:" << expect.status().toString();
     return true;
   }
+  if (sess->getCtx()->isBlocked()) {
+    // parked by a blocking command, no reply until it is woken up
+    return true;
+  }
   auto s = sess->setResponse(expect.value());
   if (!s.ok()) {
     return false;
@@ -1083,6 +1145,16 @@ void ServerEntry::getStatInfo(std::stringstream& ss) const {
      << "\r\n";
   ss << "total_connections_released:" << _netMatrix->connReleased.get()
      << "\r\n";
+  auto connCreated = _netMatrix->connCreated.get();
+  ss << "total_accept_cost(ns):" << _netMatrix->acceptCost.get() << "\r\n";
+  ss << "avg_accept_cost(ns):"
+     << _netMatrix->acceptCost.get() / (connCreated ? connCreated : 1)
+     << "\r\n";
+  for (size_t i = 0; i < _netMatrix->ioThreadAccepted.size(); i++) {
+    ss << "net_io_thread" << i
+       << ":accepted=" << _netMatrix->ioThreadAccepted[i].get()
+       << ",conns=" << _netMatrix->ioThreadConns[i].get() << "\r\n";
+  }
   auto executed = _reqMatrix->processed.get();
   ss << "total_commands_processed:" << executed << "\r\n";
   ss << "instantaneous_ops_per_sec:"
@@ -1135,10 +1207,38 @@ void ServerEntry::getStatInfo(std::stringstream& ss) const {
   ss << "sync_full:" << _serverStat.syncFull.get() << "\r\n";
   ss << "sync_partial_ok:" << _serverStat.syncPartialOk.get() << "\r\n";
   ss << "sync_partial_err:" << _serverStat.syncPartialErr.get() << "\r\n";
+  ss << "expired_keys:" << _serverStat.expiredkeys.get() << "\r\n";
+  if (_indexMgr) {
+    _indexMgr->getStatInfo(ss);
+  }
   ss << "keyspace_hits:" << _serverStat.keyspaceHits.get() << "\r\n";
   ss << "keyspace_misses:" << _serverStat.keyspaceMisses.get() << "\r\n";
   ss << "keyspace_wrong_versionep:" << _serverStat.keyspaceIncorrectEp.get()
      << "\r\n";
+  uint64_t slHits = 0, slMisses = 0, slNodes = 0;
+  for (const auto& store : _kvstores) {
+    auto slCache = store->getSkipListCache();
+    if (slCache) {
+      slHits += slCache->getHits();
+      slMisses += slCache->getMisses();
+      slNodes += slCache->size();
+    }
+  }
+  ss << "zset_node_cache_hits:" << slHits << "\r\n";
+  ss << "zset_node_cache_misses:" << slMisses << "\r\n";
+  ss << "zset_node_cache_nodes:" << slNodes << "\r\n";
+  uint64_t ccHits = 0, ccMisses = 0, ccKeys = 0;
+  for (const auto& store : _kvstores) {
+    auto counters = store->getCounterCache();
+    if (counters) {
+      ccHits += counters->getHits();
+      ccMisses += counters->getMisses();
+      ccKeys += counters->size();
+    }
+  }
+  ss << "incr_merge_cache_hits:" << ccHits << "\r\n";
+  ss << "incr_merge_cache_misses:" << ccMisses << "\r\n";
+  ss << "incr_merge_cache_keys:" << ccKeys << "\r\n";
   ss << "scheduleNum:" << _scheduleNum << "\r\n";
 }
 
@@ -1156,6 +1256,17 @@ void ServerEntry::appendJSONStat(
     w.Uint64(_netMatrix->connReleased.get());
     w.Key("invalid_packets");
     w.Uint64(_netMatrix->invalidPackets.get());
+    w.Key("accept_cost");
+    w.Uint64(_netMatrix->acceptCost.get());
+    for (size_t i = 0; i < _netMatrix->ioThreadAccepted.size(); i++) {
+      w.Key(("io_thread" + std::to_string(i)).c_str());
+      w.StartObject();
+      w.Key("accepted");
+      w.Uint64(_netMatrix->ioThreadAccepted[i].get());
+      w.Key("conns");
+      w.Uint64(_netMatrix->ioThreadConns[i].get());
+      w.EndObject();
+    }
     w.EndObject();
   }
   if (sections.find("request") != sections.end()) {
@@ -1381,6 +1492,7 @@ void ServerEntry::serverCron() {
                                            _serverStat.netInputBytes.get());
       _serverStat.trackInstantaneousMetric(STATS_METRIC_NET_OUTPUT,
                                            _serverStat.netOutputBytes.get());
+      _blockMgr->handleTimeout(msSinceEpoch());
     }
 
     run_with_period(1000) {
@@ -1462,14 +1574,23 @@ void ServerEntry::stop() {
   for (auto& executor : _executorRecycleSet) {
     executor->stop();
   }
+  _monitorMgr->stop();
   _replMgr->stop();
   if (_migrateMgr)
     _migrateMgr->stop();
   if (_indexMgr)
     _indexMgr->stop();
+  for (auto& shard : _sessionShards) {
+    std::unordered_map<uint64_t, std::shared_ptr<Session>> sessions;
+    {
+      std::lock_guard<std::mutex> lk(shard.mutex);
+      sessions.swap(shard.sessions);
+      _sessionCnt.fetch_sub(sessions.size(), std::memory_order_relaxed);
+    }
+  }
   {
-    std::lock_guard<std::mutex> lk(_mutex);
-    _sessions.clear();
+    std::lock_guard<std::mutex> lk(_localPoolMutex);
+    _localSessionPool.clear();
   }
   if (_clusterMgr) {
     _clusterMgr->stop();
@@ -1477,6 +1598,9 @@ void ServerEntry::stop() {
   if (_gcMgr) {
     _gcMgr->stop();
   }
+  if (_compactionScheduler) {
+    _compactionScheduler->stop();
+  }
   if (!_isShutdowned.load(std::memory_order_relaxed)) {
     // NOTE(vinchen): if it's not the shutdown command, it should reset the
     // workerpool to decr the referent count of share_ptr<server>
@@ -1493,6 +1617,7 @@ void ServerEntry::stop() {
     _segmentMgr.reset();
     _clusterMgr.reset();
     _gcMgr.reset();
+    _compactionScheduler.reset();
   }
 
   // stop the rocksdb
@@ -5,7 +5,9 @@
 #ifndef SRC_TENDISPLUS_SERVER_SERVER_ENTRY_H_
 #define SRC_TENDISPLUS_SERVER_SERVER_ENTRY_H_
 
+#include <array>
 #include <vector>
+#include <unordered_map>
 #include <utility>
 #include <memory>
 #include <map>
@@ -23,6 +25,12 @@
 #include "tendisplus/replication/repl_manager.h"
 #include "tendisplus/cluster/migrate_manager.h"
 #include "tendisplus/server/index_manager.h"
+#include "tendisplus/server/block_manager.h"
+#include "tendisplus/server/pubsub_manager.h"
+#include "tendisplus/server/tracking_manager.h"
+#include "tendisplus/server/monitor_manager.h"
+#include "tendisplus/server/script_manager.h"
+#include "tendisplus/server/compaction_scheduler.h"
 #include "tendisplus/storage/kvstore.h"
 #include "tendisplus/storage/catalog.h"
 #include "tendisplus/lock/mgl/mgl_mgr.h"
@@ -167,6 +175,12 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   void endSession(uint64_t connId);
   size_t getSessionCount();
 
+  // LocalSessions of the internal tasks are reused, see LocalSessionGuard.
+  // an acquired session is registered like a new one, a released session
+  // is unregistered and reset before it goes back to the pool.
+  std::shared_ptr<LocalSession> acquireLocalSession();
+  void releaseLocalSession(std::shared_ptr<LocalSession> sess);
+
   Status cancelSession(uint64_t connId);
 
   std::list<std::shared_ptr<Session>> getAllSessions() const;
@@ -191,6 +205,12 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   IndexManager* getIndexMgr();
   ClusterManager* getClusterMgr();
   GCManager* getGcMgr();
+  BlockManager* getBlockMgr();
+  PubSubManager* getPubSubMgr();
+  TrackingManager* getTrackingMgr();
+  MonitorManager* getMonitorMgr();
+  ScriptManager* getScriptMgr();
+  CompactionScheduler* getCompactionScheduler();
 
   // TODO(takenliu) : args exist at two places, has better way?
   std::string requirepass() const;
@@ -212,6 +232,15 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   const std::vector<PStore>& getStores() const {
     return _kvstores;
   }
+  // shared by the stores, except the catalog
+  const std::shared_ptr<rocksdb::Cache>& getBlockCache() const {
+    return _blockCache;
+  }
+  // nullptr if rocks.write_buffer_manager_mb is 0
+  const std::shared_ptr<rocksdb::WriteBufferManager>& getWriteBufferManager()
+    const {
+    return _writeBufferManager;
+  }
 
   void toggleFtmc(bool enable);
   void appendJSONStat(rapidjson::PrettyWriter<rapidjson::StringBuffer>&,
@@ -235,7 +264,6 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   uint32_t getKVStoreCount() const;
   void setTsEp(uint64_t timestamp);
   uint64_t getTsEp() const;
-  void AddMonitor(uint64_t sessId);
   static void logWarning(const std::string& str, Session* sess = nullptr);
   static void logError(const std::string& str, Session* sess = nullptr);
   void slowlogPushEntryIfNeeded(uint64_t time,
@@ -293,12 +321,20 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   ServerEntry();
   Status adaptSomeThreadNumByCpuNum(const std::shared_ptr<ServerParams>& cfg);
   void serverCron();
-  void replyMonitors(Session* sess);
-  void DelMonitorNoLock(uint64_t connId);
   void resizeExecutorThreadNum(uint64_t newThreadNum);
   void resizeIncrExecutorThreadNum(uint64_t newThreadNum);
   void resizeDecrExecutorThreadNum(uint64_t newThreadNum);
 
+  // the sessions are striped by id, so that connecting and closing don't
+  // serialize on ServerEntry::_mutex
+  static constexpr size_t SESSION_SHARDS = 16;
+  struct SessionShard {
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<Session>> sessions;
+  };
+  SessionShard& getSessionShard(uint64_t id);
+  const SessionShard& getSessionShard(uint64_t id) const;
+
   // NOTE(deyukong): _isRunning = true -> running
   // _isRunning = false && _isStopped = false -> stopping in progress
   // _isRunning = false && _isStopped = true -> stop complete
@@ -311,7 +347,10 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   mutable std::mutex _mutex;
   std::condition_variable _eventCV;
   std::unique_ptr<NetworkAsio> _network;
-  std::map<uint64_t, std::shared_ptr<Session>> _sessions;
+  std::array<SessionShard, SESSION_SHARDS> _sessionShards;
+  std::atomic<uint64_t> _sessionCnt;
+  std::mutex _localPoolMutex;
+  std::vector<std::shared_ptr<LocalSession>> _localSessionPool;
   std::vector<std::unique_ptr<WorkerPool>> _executorList;
   std::set<std::unique_ptr<WorkerPool>> _executorRecycleSet;
   std::unique_ptr<SegmentMgr> _segmentMgr;
@@ -322,9 +361,17 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   std::unique_ptr<mgl::MGLockMgr> _mgLockMgr;
   std::unique_ptr<ClusterManager> _clusterMgr;
   std::unique_ptr<GCManager> _gcMgr;
+  std::unique_ptr<BlockManager> _blockMgr;
+  std::unique_ptr<PubSubManager> _pubsubMgr;
+  std::unique_ptr<TrackingManager> _trackingMgr;
+  std::unique_ptr<MonitorManager> _monitorMgr;
+  std::unique_ptr<ScriptManager> _scriptMgr;
+  std::unique_ptr<CompactionScheduler> _compactionScheduler;
 
   std::vector<PStore> _kvstores;
   std::unique_ptr<Catalog> _catalog;
+  std::shared_ptr<rocksdb::Cache> _blockCache;
+  std::shared_ptr<rocksdb::WriteBufferManager> _writeBufferManager;
 
   std::shared_ptr<NetworkMatrix> _netMatrix;
   std::shared_ptr<PoolMatrix> _poolMatrix;
@@ -344,7 +391,6 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   uint32_t _dbNum;
   std::atomic<uint64_t> _tsFromExtendedProtocol;
 
-  std::list<std::shared_ptr<Session>> _monitors;
   std::atomic<uint64_t> _scheduleNum;
   std::shared_ptr<ServerParams> _cfg;
   std::atomic<uint64_t> _lastBackupTime;
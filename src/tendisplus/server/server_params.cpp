@@ -301,6 +301,10 @@ ServerParams::ServerParams() {
   REGISTER_VARS(delCntIndexMgr);
   REGISTER_VARS(delJobCntIndexMgr);
   REGISTER_VARS(pauseTimeIndexMgr);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("expire-keys-per-sec", expireKeysPerSec);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("expire-busy-ops-per-sec",
+                                  expireBusyOpsPerSec);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("expire-max-lag-sec", expireMaxLagSec);
 
   REGISTER_VARS_DIFF_NAME("proto-max-bulk-len", protoMaxBulkLen);
   REGISTER_VARS_DIFF_NAME("databases", dbNum);
@@ -312,6 +316,16 @@ ServerParams::ServerParams() {
   REGISTER_VARS_ALLOW_DYNAMIC_SET(slaveBinlogKeepNum);
 
   REGISTER_VARS_ALLOW_DYNAMIC_SET(maxClients);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("pubsub-output-buffer-limit",
+                                  pubsubOutputBufferLimit);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("tracking-table-max-keys",
+                                  trackingTableMaxKeys);
+  REGISTER_VARS_DIFF_NAME("zset-node-cache-size", zsetNodeCacheSize);
+  REGISTER_VARS_DIFF_NAME("incr-merge-mode", incrMergeMode);
+  REGISTER_VARS_DIFF_NAME("incr-merge-cache-keys", incrMergeCacheKeys);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("local-session-pool-size",
+                                  localSessionPoolSize);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("lua-time-limit", luaTimeLimit);
   REGISTER_VARS_DIFF_NAME("slowlog", slowlogPath);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("slowlog-log-slower-than",
                                   slowlogLogSlowerThan);
@@ -325,6 +339,7 @@ ServerParams::ServerParams() {
   //              they don't use Workerpool, no need to use
   //              Workerpool::resize()
   REGISTER_VARS(netIoThreadNum);
+  REGISTER_VARS_DIFF_NAME("net-reuseport-accept", netReusePortAccept);
   REGISTER_VARS_SAME_NAME(
     executorThreadNum, executorThreadNumCheck, nullptr, 1, 200, true);
   REGISTER_VARS_SAME_NAME(
@@ -351,6 +366,12 @@ ServerParams::ServerParams() {
   REGISTER_VARS_DIFF_NAME("rocks.blockcachemb", rocksBlockcacheMB);
   REGISTER_VARS_DIFF_NAME("rocks.blockcache_strict_capacity_limit",
                           rocksStrictCapacityLimit);
+  REGISTER_VARS_DIFF_NAME("rocks.write_buffer_manager_mb",
+                          rocksWriteBufferManagerMB);
+  REGISTER_VARS_DIFF_NAME("rocks.cache_index_and_filter_blocks",
+                          rocksCacheIndexAndFilterBlocks);
+  REGISTER_VARS_DIFF_NAME("rocks.blockcache_high_pri_pool_ratio",
+                          rocksBlockcacheHighPriPoolRatio);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("rocks.disable_wal", rocksDisableWAL);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("rocks.flush_log_at_trx_commit",
                                   rocksFlushLogAtTrxCommit);
@@ -388,6 +409,18 @@ ServerParams::ServerParams() {
   REGISTER_VARS_DIFF_NAME_DYNAMIC("cluster-migration-distance",
                                   migrateDistance);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("garbage-delete-size", garbageDeleteSize);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("garbage-delete-files", garbageDeleteFiles);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("garbage-compact-idle-ops",
+                                  garbageCompactIdleOps);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("garbage-compact-max-delay",
+                                  garbageCompactMaxDelay);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("compact-sched-interval",
+                                  compactSchedInterval);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("compact-sched-jobs", compactSchedJobs);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("compact-sched-idle-ops",
+                                  compactSchedIdleOps);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("compact-sched-delete-threshold",
+                                  compactSchedDeleteThreshold);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("cluster-migration-binlog-iters",
                                   migrateBinlogIter);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("cluster-migration-slots-num-per-task",
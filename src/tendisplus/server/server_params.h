@@ -370,10 +370,17 @@ class ServerParams {
   uint32_t kvStoreCount = 10;
 
   uint32_t scanCntIndexMgr = 1000;
-  uint32_t scanJobCntIndexMgr = 1;
+  // 0: one thread per store, at most a quarter of the cpus
+  uint32_t scanJobCntIndexMgr = 0;
   uint32_t delCntIndexMgr = 10000;
-  uint32_t delJobCntIndexMgr = 1;
+  uint32_t delJobCntIndexMgr = 0;
   uint32_t pauseTimeIndexMgr = 10;
+  // the background expiration is limited to expireKeysPerSec when the
+  // instantaneous ops is over expireBusyOpsPerSec, unless an expired key
+  // has waited for expireMaxLagSec. 0 means no limit.
+  uint64_t expireKeysPerSec = 0;
+  uint64_t expireBusyOpsPerSec = 0;
+  uint32_t expireMaxLagSec = 60;
 
   uint32_t protoMaxBulkLen = CONFIG_DEFAULT_PROTO_MAX_BULK_LEN;
   uint32_t dbNum = CONFIG_DEFAULT_DBNUM;
@@ -384,6 +391,21 @@ class ServerParams {
   uint64_t slaveBinlogKeepNum = 1;
 
   uint32_t maxClients = CONFIG_DEFAULT_MAX_CLIENTS;
+  // close a subscriber whose pending output exceeds it, 0 means no limit
+  uint64_t pubsubOutputBufferLimit = 32 * 1024 * 1024;
+  // keys remembered for CLIENT TRACKING, 0 means no limit
+  uint64_t trackingTableMaxKeys = 1000000;
+  // skiplist nodes cached for the zsets on each store, 0 disables it
+  uint64_t zsetNodeCacheSize = 65536;
+  // INCR and HINCRBY write merge operands instead of the sums, replying
+  // from a per-store cache of the counters
+  bool incrMergeMode = false;
+  uint64_t incrMergeCacheKeys = 65536;
+  // idle LocalSessions kept for reuse by the internal tasks
+  uint32_t localSessionPoolSize = 64;
+  // a script running longer than it is aborted and rolled back, in ms,
+  // 0 means no limit
+  uint64_t luaTimeLimit = 5000;
   std::string slowlogPath = "./slowlog";
   uint32_t slowlogLogSlowerThan = CONFIG_DEFAULT_SLOWLOG_LOG_SLOWER_THAN;
   // uint32_t slowlogMaxLen = CONFIG_DEFAULT_SLOWLOG_LOG_MAX_LEN;
@@ -392,6 +414,10 @@ class ServerParams {
   bool slowlogFileEnabled = true;
   bool binlogUsingDefaultCF = false;
   uint32_t netIoThreadNum = 0;
+  // one SO_REUSEPORT listener on each net io thread instead of the single
+  // accept thread, the sessions are served by the thread accepting them.
+  // The server still fails to start if the port is in use.
+  bool netReusePortAccept = false;
   uint32_t executorThreadNum = 0;
   uint32_t executorWorkPoolSize = 0;
 
@@ -415,6 +441,13 @@ class ServerParams {
   // parameter for rocksdb
   uint32_t rocksBlockcacheMB = 4096;
   bool rocksStrictCapacityLimit = false;
+  // the memtables of all the stores share it, and are charged to the
+  // block cache, 0 leaves each memtable sized on its own
+  uint32_t rocksWriteBufferManagerMB = 0;
+  // keep the partitioned index and filter blocks in the block cache,
+  // in its high priority pool, instead of unbounded table readers
+  bool rocksCacheIndexAndFilterBlocks = false;
+  float rocksBlockcacheHighPriPoolRatio = 0.1;
   std::string rocksWALDir = "";
   string rocksCompressType = "snappy";
   // WriteOptions
@@ -430,6 +463,22 @@ class ServerParams {
   uint32_t migrateReceiveThreadnum = 4;
   uint32_t garbageDeleteThreadnum = 1;
   uint16_t garbageDeleteSize = 30;
+  // drop the sst files of the garbage slots before deleteRange
+  bool garbageDeleteFiles = true;
+  // the compaction after a garbage delete waits until the instantaneous
+  // ops is below garbageCompactIdleOps, garbageCompactMaxDelay seconds at
+  // most. 0 compacts at once.
+  uint64_t garbageCompactIdleOps = 0;
+  uint32_t garbageCompactMaxDelay = 3600;
+  // every compactSchedInterval seconds, compactSchedJobs background
+  // compactions are shared by the stores as their L0 files, pending
+  // compaction bytes and read amplification need. 0 disables it.
+  uint32_t compactSchedInterval = 0;
+  uint32_t compactSchedJobs = 16;
+  // a range of chunks with more deletes than it is compacted while the
+  // instantaneous ops is below compactSchedIdleOps, 0 disables it
+  uint64_t compactSchedIdleOps = 1000;
+  uint64_t compactSchedDeleteThreshold = 100000;
 
   bool clusterEnabled = false;
   bool domainEnabled = false;
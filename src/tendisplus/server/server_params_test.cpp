@@ -207,9 +207,9 @@ TEST(ServerParams, DefaultValue) {
   EXPECT_EQ(cfg->kvStoreCount, 10);
 
   EXPECT_EQ(cfg->scanCntIndexMgr, 1000);
-  EXPECT_EQ(cfg->scanJobCntIndexMgr, 1);
+  EXPECT_EQ(cfg->scanJobCntIndexMgr, 0);
   EXPECT_EQ(cfg->delCntIndexMgr, 10000);
-  EXPECT_EQ(cfg->delJobCntIndexMgr, 1);
+  EXPECT_EQ(cfg->delJobCntIndexMgr, 0);
   EXPECT_EQ(cfg->pauseTimeIndexMgr, 10);
 
   EXPECT_EQ(cfg->protoMaxBulkLen, CONFIG_DEFAULT_PROTO_MAX_BULK_LEN);
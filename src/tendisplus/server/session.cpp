@@ -108,6 +108,10 @@ const std::vector<std::string>& Session::getArgs() const {
   return _args;
 }
 
+void Session::swapArgs(std::vector<std::string>* args) {
+  _args.swap(*args);
+}
+
 ServerEntry* Session::getServerEntry() const {
   return _server;
 }
@@ -135,6 +139,14 @@ void LocalSession::setArgs(const std::string& cmd) {
   _ctx->setArgsBrief(_args);
 }
 
+void LocalSession::reset() {
+  _args.clear();
+  _respBuf.clear();
+  _ctx->reset();
+  _timestamp = msSinceEpoch();
+  setName("");
+}
+
 Status LocalSession::cancel() {
   return {ErrorCodes::ERR_INTERNAL,
           "LocalSession::cancel should not be called"};
@@ -155,19 +167,20 @@ Status LocalSession::setResponse(const std::string& s) {
 }
 
 LocalSessionGuard::LocalSessionGuard(ServerEntry* svr, Session* sess) {
-  _sess = std::make_shared<LocalSession>(svr);
+  if (svr) {
+    _sess = svr->acquireLocalSession();
+  } else {
+    _sess = std::make_shared<LocalSession>(svr);
+  }
   if (sess && sess->getCtx()->authed()) {
     _sess->getCtx()->setAuthed();
   }
-  if (svr) {
-    svr->addSession(_sess);
-  }
 }
 
 LocalSessionGuard::~LocalSessionGuard() {
   auto svr = _sess->getServerEntry();
   if (svr) {
-    svr->endSession(_sess->id());
+    svr->releaseLocalSession(std::move(_sess));
   }
 }
 
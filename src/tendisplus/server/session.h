@@ -32,6 +32,9 @@ class Session : public std::enable_shared_from_this<Session> {
   uint64_t id() const;
   virtual Status setResponse(const std::string& s) = 0;
   const std::vector<std::string>& getArgs() const;
+  // the commands called by a script run with the args swapped in the
+  // session of EVAL
+  void swapArgs(std::vector<std::string>* args);
   Status processExtendProtocol();
   SessionCtx* getCtx() const;
   ServerEntry* getServerEntry() const;
@@ -42,7 +45,9 @@ class Session : public std::enable_shared_from_this<Session> {
   virtual Status cancel() = 0;
   virtual int getFd() = 0;
   virtual std::string getRemote() const = 0;
-
+  // wake up a session parked by a blocking command, see BlockManager.
+  // it may be called from any thread.
+  virtual void unblock() {}
 
   virtual Expected<std::string> getRemoteIp() const {
     return {ErrorCodes::ERR_NETWORK, ""};
@@ -93,11 +98,16 @@ class LocalSession : public Session {
   Status setResponse(const std::string& s) final;
   void setArgs(const std::vector<std::string>& args);
   void setArgs(const std::string& cmd);
+  // called by ServerEntry::releaseLocalSession() before the session is
+  // reused, the id is kept.
+  void reset();
 
  private:
   std::vector<char> _respBuf;
 };
 
+// a LocalSession registered in the ServerEntry for the scope of the guard,
+// the session comes from the pool of the ServerEntry and goes back to it.
 class LocalSessionGuard {
  public:
   explicit LocalSessionGuard(ServerEntry* svr, Session* sess = nullptr);
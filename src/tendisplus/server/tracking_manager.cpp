@@ -0,0 +1,324 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+#include "glog/logging.h"
+#include "tendisplus/server/tracking_manager.h"
+#include "tendisplus/server/server_entry.h"
+#include "tendisplus/utils/invariant.h"
+
+namespace tendisplus {
+
+TrackingManager::TrackingManager(ServerEntry* svr)
+  : _svr(svr), _trackedKeys(0), _clientCnt(0), _bcastCnt(0) {}
+
+TrackingManager::TableShard& TrackingManager::getShard(const std::string& key) {
+  return _shards[std::hash<std::string>()(key) % TABLE_SHARDS];
+}
+
+uint64_t TrackingManager::shardLimit() const {
+  auto& params = _svr->getParams();
+  if (!params || params->trackingTableMaxKeys == 0) {
+    return 0;
+  }
+  return std::max<uint64_t>(params->trackingTableMaxKeys / TABLE_SHARDS, 1);
+}
+
+Status TrackingManager::enableTracking(
+  Session* sess,
+  uint64_t redirectId,
+  bool bcast,
+  bool noloop,
+  const std::vector<std::string>& prefixes) {
+  auto target =
+    std::dynamic_pointer_cast<NetSession>(_svr->getSession(redirectId));
+  if (!target || target->getType() != Session::Type::NET) {
+    return {ErrorCodes::ERR_PARSEOPT,
+            "The client ID you want redirect to does not exist"};
+  }
+
+  std::unique_lock<std::shared_timed_mutex> lk(_clientMutex);
+  auto it = _clients.find(sess->id());
+  if (it != _clients.end() && it->second.bcast != bcast) {
+    return {ErrorCodes::ERR_PARSEOPT,
+            "You can't switch BCAST mode on/off before disabling tracking "
+            "for this client, and then re-enabling it with a different mode."};
+  }
+  if (it == _clients.end()) {
+    it = _clients.emplace(sess->id(), Client()).first;
+    _clientCnt.store(_clients.size(), std::memory_order_relaxed);
+    if (bcast) {
+      ++_bcastCnt;
+    }
+  }
+  auto& client = it->second;
+  client.redirectId = redirectId;
+  client.redirect = target;
+  client.bcast = bcast;
+  client.noloop = noloop;
+  client.prefixes = prefixes;
+
+  if (bcast) {
+    sess->getCtx()->resetFlags(CLIENT_TRACKING);
+  } else {
+    sess->getCtx()->setFlags(CLIENT_TRACKING);
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+void TrackingManager::disableTracking(Session* sess) {
+  sess->getCtx()->resetFlags(CLIENT_TRACKING);
+  disableTracking(sess->id());
+}
+
+void TrackingManager::disableTracking(uint64_t sessId) {
+  if (!isActive()) {
+    return;
+  }
+  // NOTE: the keys read by the session are left in the table, they are
+  // skipped when invalidated, and dropped by later writes or eviction.
+  std::unique_lock<std::shared_timed_mutex> lk(_clientMutex);
+  auto it = _clients.find(sessId);
+  if (it == _clients.end()) {
+    return;
+  }
+  if (it->second.bcast) {
+    --_bcastCnt;
+  }
+  _clients.erase(it);
+  _clientCnt.store(_clients.size(), std::memory_order_relaxed);
+}
+
+uint64_t TrackingManager::getRedirectId(uint64_t sessId) const {
+  std::shared_lock<std::shared_timed_mutex> lk(_clientMutex);
+  auto it = _clients.find(sessId);
+  return it == _clients.end() ? 0 : it->second.redirectId;
+}
+
+void TrackingManager::onKeyLocked(Session* sess, const std::string& key) {
+  auto ctx = sess->getCtx();
+  switch (ctx->getKeyTracking()) {
+    case SessionCtx::KeyTracking::READ:
+      rememberKey(sess, key);
+      break;
+    case SessionCtx::KeyTracking::WRITE:
+      // invalidated by Command::runSessionCmd() after the write
+      ctx->addWrittenKey(key);
+      break;
+    default:
+      break;
+  }
+}
+
+void TrackingManager::rememberKey(Session* sess, const std::string& key) {
+  std::vector<std::pair<std::string, std::unordered_set<uint64_t>>> evicted;
+  {
+    auto& shard = getShard(key);
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    auto it = shard.keys.find(key);
+    if (it == shard.keys.end()) {
+      shard.lru.push_front(key);
+      it = shard.keys.emplace(key, TrackedKey{{}, shard.lru.begin()}).first;
+      ++_trackedKeys;
+    } else {
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lruPos);
+    }
+    it->second.ids.insert(sess->id());
+
+    // the key itself is at the front, it's never the one evicted
+    auto limit = shardLimit();
+    while (limit != 0 && shard.keys.size() > limit) {
+      auto victim = shard.keys.find(shard.lru.back());
+      INVARIANT_D(victim != shard.keys.end());
+      evicted.emplace_back(victim->first, std::move(victim->second.ids));
+      shard.keys.erase(victim);
+      shard.lru.pop_back();
+      --_trackedKeys;
+    }
+  }
+  if (evicted.empty()) {
+    return;
+  }
+
+  Invalidations invs;
+  {
+    std::shared_lock<std::shared_timed_mutex> lk(_clientMutex);
+    for (const auto& kv : evicted) {
+      for (auto id : kv.second) {
+        // the session is not the writer, noloop doesn't apply
+        addInvalidationInLock(&invs, id, &kv.first, 0);
+      }
+    }
+  }
+  sendInvalidations(invs);
+}
+
+void TrackingManager::addInvalidationInLock(Invalidations* invs,
+                                            uint64_t sessId,
+                                            const std::string* key,
+                                            uint64_t fromSessId) const {
+  auto it = _clients.find(sessId);
+  if (it == _clients.end()) {
+    return;
+  }
+  const auto& client = it->second;
+  if (client.noloop && sessId == fromSessId) {
+    return;
+  }
+  auto target = client.redirect.lock();
+  if (!target) {
+    return;
+  }
+  auto& inv = (*invs)[client.redirectId];
+  inv.first = std::move(target);
+  inv.second.push_back(key);
+}
+
+void TrackingManager::invalidateKeys(const std::vector<std::string>& keys,
+                                     uint64_t fromSessId) {
+  if (!isActive()) {
+    return;
+  }
+
+  std::vector<std::pair<const std::string*, std::unordered_set<uint64_t>>>
+    hits;
+  for (const auto& key : keys) {
+    auto& shard = getShard(key);
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    auto it = shard.keys.find(key);
+    if (it == shard.keys.end()) {
+      continue;
+    }
+    hits.emplace_back(&key, std::move(it->second.ids));
+    shard.lru.erase(it->second.lruPos);
+    shard.keys.erase(it);
+    --_trackedKeys;
+  }
+  if (hits.empty() && _bcastCnt.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+
+  Invalidations invs;
+  {
+    std::shared_lock<std::shared_timed_mutex> lk(_clientMutex);
+    for (const auto& hit : hits) {
+      for (auto id : hit.second) {
+        addInvalidationInLock(&invs, id, hit.first, fromSessId);
+      }
+    }
+    if (_bcastCnt.load(std::memory_order_relaxed) != 0) {
+      for (const auto& kv : _clients) {
+        if (!kv.second.bcast) {
+          continue;
+        }
+        const auto& prefixes = kv.second.prefixes;
+        for (const auto& key : keys) {
+          bool match = prefixes.empty() ||
+            std::any_of(prefixes.begin(),
+                        prefixes.end(),
+                        [&key](const std::string& prefix) {
+                          return key.compare(0, prefix.size(), prefix) == 0;
+                        });
+          if (match) {
+            addInvalidationInLock(&invs, kv.first, &key, fromSessId);
+          }
+        }
+      }
+    }
+  }
+  sendInvalidations(invs);
+}
+
+void TrackingManager::invalidateAll() {
+  if (!isActive()) {
+    return;
+  }
+  for (auto& shard : _shards) {
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    _trackedKeys -= shard.keys.size();
+    shard.keys.clear();
+    shard.lru.clear();
+  }
+
+  std::unordered_map<uint64_t, std::shared_ptr<NetSession>> targets;
+  {
+    std::shared_lock<std::shared_timed_mutex> lk(_clientMutex);
+    for (const auto& kv : _clients) {
+      auto target = kv.second.redirect.lock();
+      if (target) {
+        targets.emplace(kv.second.redirectId, std::move(target));
+      }
+    }
+  }
+  if (targets.empty()) {
+    return;
+  }
+  auto buf = makeMessage(nullptr);
+  auto limit = _svr->getParams()->pubsubOutputBufferLimit;
+  for (const auto& kv : targets) {
+    kv.second->setSharedResponse(buf, limit);
+  }
+}
+
+std::shared_ptr<SendBuffer> TrackingManager::makeMessage(
+  const std::vector<const std::string*>* keys) const {
+  static const std::string kHeader = std::string("*3\r\n$7\r\nmessage\r\n$") +
+    std::to_string(strlen(INVALIDATE_CHANNEL)) + "\r\n" + INVALIDATE_CHANNEL +
+    "\r\n";
+
+  auto buf = std::make_shared<SendBuffer>();
+  buf->closeAfterThis = false;
+  auto append = [&buf](const std::string& s) {
+    buf->buffer.insert(buf->buffer.end(), s.begin(), s.end());
+  };
+  append(kHeader);
+  if (!keys) {
+    append("$-1\r\n");
+    return buf;
+  }
+  append("*" + std::to_string(keys->size()) + "\r\n");
+  for (auto key : *keys) {
+    append("$" + std::to_string(key->size()) + "\r\n");
+    append(*key);
+    append("\r\n");
+  }
+  return buf;
+}
+
+void TrackingManager::sendInvalidations(const Invalidations& invs) const {
+  if (invs.empty()) {
+    return;
+  }
+  // NOTE: a slow redirect session may be closed by setSharedResponse(),
+  // like a slow subscriber of pub/sub
+  auto limit = _svr->getParams()->pubsubOutputBufferLimit;
+  for (const auto& kv : invs) {
+    // a key may come from several sessions redirected to the same one, or
+    // be written twice by a command, it's sent once
+    auto keys = kv.second.second;
+    auto less = [](const std::string* a, const std::string* b) {
+      return *a < *b;
+    };
+    auto equal = [](const std::string* a, const std::string* b) {
+      return *a == *b;
+    };
+    std::sort(keys.begin(), keys.end(), less);
+    keys.erase(std::unique(keys.begin(), keys.end(), equal), keys.end());
+    kv.second.first->setSharedResponse(makeMessage(&keys), limit);
+  }
+}
+
+uint64_t TrackingManager::getTrackingCount() const {
+  return _clientCnt.load(std::memory_order_relaxed);
+}
+
+uint64_t TrackingManager::getTrackedKeyCount() const {
+  return _trackedKeys.load(std::memory_order_relaxed);
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,131 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_SERVER_TRACKING_MANAGER_H_
+#define SRC_TENDISPLUS_SERVER_TRACKING_MANAGER_H_
+
+#include <array>
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "tendisplus/network/network.h"
+#include "tendisplus/utils/status.h"
+
+namespace tendisplus {
+
+class ServerEntry;
+
+// TrackingManager is the server side of client side caching (CLIENT
+// TRACKING). By default, the keys read by a tracking session are put in a
+// table of key -> session ids while the keys are still locked, a later
+// write of the key sends one invalidation to each of the sessions and
+// removes the key. When the table is full, the least recently read keys
+// are evicted and their sessions are invalidated, the client can't tell
+// it from a write.
+// In BCAST mode nothing is remembered, every write of a key matching one
+// of the prefixes is sent.
+// Tendis speaks RESP2 only, so the invalidations are delivered to the
+// REDIRECT session as pub/sub messages of __redis__:invalidate.
+class TrackingManager {
+ public:
+  explicit TrackingManager(ServerEntry* svr);
+  TrackingManager(const TrackingManager&) = delete;
+  TrackingManager(TrackingManager&&) = delete;
+
+  Status enableTracking(Session* sess,
+                        uint64_t redirectId,
+                        bool bcast,
+                        bool noloop,
+                        const std::vector<std::string>& prefixes);
+  // called by CLIENT TRACKING OFF and when the session is closed
+  void disableTracking(Session* sess);
+  void disableTracking(uint64_t sessId);
+  // returns 0 if the session is not tracking
+  uint64_t getRedirectId(uint64_t sessId) const;
+
+  // false if no session is tracking, checked before any other work
+  bool isActive() const {
+    return _clientCnt.load(std::memory_order_relaxed) != 0;
+  }
+  // called by the key lock path of SegmentMgr, when the running command
+  // is a read of a tracking session or a write while tracking is active
+  void onKeyLocked(Session* sess, const std::string& key);
+  // should be called by a read command with the key locked
+  void rememberKey(Session* sess, const std::string& key);
+  // should be called after the write is committed, noloop sessions are
+  // not told about their own writes.
+  void invalidateKeys(const std::vector<std::string>& keys,
+                      uint64_t fromSessId);
+  // FLUSHDB/FLUSHALL, every tracking session drops its cache
+  void invalidateAll();
+
+  uint64_t getTrackingCount() const;
+  uint64_t getTrackedKeyCount() const;
+
+  static constexpr size_t TABLE_SHARDS = 16;
+  static constexpr const char* INVALIDATE_CHANNEL = "__redis__:invalidate";
+
+ private:
+  struct Client {
+    uint64_t redirectId;
+    std::weak_ptr<NetSession> redirect;
+    bool bcast;
+    bool noloop;
+    std::vector<std::string> prefixes;
+  };
+
+  struct TrackedKey {
+    std::unordered_set<uint64_t> ids;
+    // the position in TableShard::lru
+    std::list<std::string>::iterator lruPos;
+  };
+
+  struct TableShard {
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, TrackedKey> keys;
+    // the most recently read key first, evicted from the back
+    std::list<std::string> lru;
+  };
+
+  // redirect session -> keys to invalidate
+  using Invalidations =
+    std::unordered_map<uint64_t,
+                       std::pair<std::shared_ptr<NetSession>,
+                                 std::vector<const std::string*>>>;
+
+  TableShard& getShard(const std::string& key);
+  // should be called with _clientMutex held
+  void addInvalidationInLock(Invalidations* invs,
+                             uint64_t sessId,
+                             const std::string* key,
+                             uint64_t fromSessId) const;
+  void sendInvalidations(const Invalidations& invs) const;
+  // keys is nullptr for FLUSHDB/FLUSHALL
+  std::shared_ptr<SendBuffer> makeMessage(
+    const std::vector<const std::string*>* keys) const;
+  uint64_t shardLimit() const;
+
+  ServerEntry* _svr;
+  std::array<TableShard, TABLE_SHARDS> _shards;
+  std::atomic<uint64_t> _trackedKeys;
+
+  // never held together with TableShard::mutex
+  mutable std::shared_timed_mutex _clientMutex;
+  std::unordered_map<uint64_t, Client> _clients;
+  std::atomic<uint64_t> _clientCnt;
+  // lets the write path skip the BCAST scan
+  std::atomic<uint64_t> _bcastCnt;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_SERVER_TRACKING_MANAGER_H_
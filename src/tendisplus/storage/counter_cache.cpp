@@ -0,0 +1,77 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include "tendisplus/storage/counter_cache.h"
+
+namespace tendisplus {
+
+CounterCache::CounterCache(uint64_t capacity)
+  : _shardCapacity(std::max<uint64_t>(capacity / SHARDS, 1)),
+    _hits(0),
+    _misses(0) {}
+
+CounterCache::Shard& CounterCache::getShard(const std::string& key) {
+  return _shards[std::hash<std::string>()(key) % SHARDS];
+}
+
+bool CounterCache::get(const std::string& key, int64_t* val) {
+  auto& shard = getShard(key);
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  auto it = shard.counters.find(key);
+  if (it == shard.counters.end()) {
+    _misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  *val = it->second;
+  _hits.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void CounterCache::put(const std::string& key, int64_t val) {
+  auto& shard = getShard(key);
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  auto it = shard.counters.find(key);
+  if (it != shard.counters.end()) {
+    it->second = val;
+    return;
+  }
+  // any one is dropped, a missed counter is read from the store again
+  if (shard.counters.size() >= _shardCapacity) {
+    shard.counters.erase(shard.counters.begin());
+  }
+  shard.counters.emplace(key, val);
+}
+
+void CounterCache::invalidate(const std::string& key) {
+  auto& shard = getShard(key);
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  shard.counters.erase(key);
+}
+
+void CounterCache::clear() {
+  for (auto& shard : _shards) {
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    shard.counters.clear();
+  }
+}
+
+uint64_t CounterCache::size() const {
+  uint64_t size = 0;
+  for (auto& shard : _shards) {
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    size += shard.counters.size();
+  }
+  return size;
+}
+
+uint64_t CounterCache::getHits() const {
+  return _hits.load(std::memory_order_relaxed);
+}
+
+uint64_t CounterCache::getMisses() const {
+  return _misses.load(std::memory_order_relaxed);
+}
+
+}  // namespace tendisplus
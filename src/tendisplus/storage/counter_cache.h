@@ -0,0 +1,54 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_COUNTER_CACHE_H_
+#define SRC_TENDISPLUS_STORAGE_COUNTER_CACHE_H_
+
+#include <array>
+#include <atomic>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+
+namespace tendisplus {
+
+// CounterCache keeps the values of the counters of a store, which are
+// incremented by merge operands instead of being read and written back,
+// see KVIncrMergeOperator. The key is the encoded RecordKey of the string
+// or the hash field. A counter is dropped by any other write of its key,
+// and the writers of a key are serialized by the key lock, so a cached
+// value is the one a read would merge.
+class CounterCache {
+ public:
+  explicit CounterCache(uint64_t capacity);
+  CounterCache(const CounterCache&) = delete;
+  CounterCache& operator=(const CounterCache&) = delete;
+
+  bool get(const std::string& key, int64_t* val);
+  void put(const std::string& key, int64_t val);
+  void invalidate(const std::string& key);
+  void clear();
+
+  uint64_t size() const;
+  uint64_t getHits() const;
+  uint64_t getMisses() const;
+
+ private:
+  struct Shard {
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, int64_t> counters;
+  };
+  static constexpr size_t SHARDS = 16;
+
+  Shard& getShard(const std::string& key);
+
+  const uint64_t _shardCapacity;
+  std::array<Shard, SHARDS> _shards;
+  std::atomic<uint64_t> _hits;
+  std::atomic<uint64_t> _misses;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_COUNTER_CACHE_H_
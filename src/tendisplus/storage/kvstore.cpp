@@ -2,6 +2,7 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <cstring>
 #include <fstream>
 #include "glog/logging.h"
 #include "tendisplus/storage/kvstore.h"
@@ -208,6 +209,174 @@ Expected<ReplLogV2> RepllogCursorV2::nextV2() {
   return {ErrorCodes::ERR_EXHAUST, ""};
 }
 
+Expected<uint64_t> NestedTransaction::commit() {
+  return _parent->getTxnId();
+}
+
+Status NestedTransaction::rollback() {
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+std::unique_ptr<Cursor> NestedTransaction::createCursor(
+  ColumnFamilyNumber cf,
+  const std::string* iterate_upper_bound,
+  size_t readahead_size) {
+  return _parent->createCursor(cf, iterate_upper_bound, readahead_size);
+}
+
+Status NestedTransaction::flushall() {
+  return _parent->flushall();
+}
+
+Status NestedTransaction::migrate(const std::string& logKey,
+                                  const std::string& logValue) {
+  return _parent->migrate(logKey, logValue);
+}
+
+std::unique_ptr<RepllogCursorV2> NestedTransaction::createRepllogCursorV2(
+  uint64_t begin, bool ignoreReadBarrier) {
+  return _parent->createRepllogCursorV2(begin, ignoreReadBarrier);
+}
+
+Status NestedTransaction::applyBinlog(const ReplLogValueEntryV2& logEntry) {
+  return _parent->applyBinlog(logEntry);
+}
+
+Status NestedTransaction::setBinlogKV(uint64_t binlogId,
+                                      const std::string& logKey,
+                                      const std::string& logValue) {
+  return _parent->setBinlogKV(binlogId, logKey, logValue);
+}
+
+Status NestedTransaction::setBinlogKV(const std::string& logKey,
+                                      const std::string& logValue) {
+  return _parent->setBinlogKV(logKey, logValue);
+}
+
+Status NestedTransaction::delBinlog(const ReplLogRawV2& log) {
+  return _parent->delBinlog(log);
+}
+
+uint64_t NestedTransaction::getBinlogId() const {
+  return _parent->getBinlogId();
+}
+
+void NestedTransaction::setBinlogId(uint64_t binlogId) {
+  _parent->setBinlogId(binlogId);
+}
+
+uint32_t NestedTransaction::getChunkId() const {
+  return _parent->getChunkId();
+}
+
+std::string NestedTransaction::getKVStoreId() const {
+  return _parent->getKVStoreId();
+}
+
+void NestedTransaction::setChunkId(uint32_t chunkId) {
+  _parent->setChunkId(chunkId);
+}
+
+void NestedTransaction::SetSnapshot() {
+  _parent->SetSnapshot();
+}
+
+std::unique_ptr<TTLIndexCursor> NestedTransaction::createTTLIndexCursor(
+  std::uint64_t until) {
+  return _parent->createTTLIndexCursor(until);
+}
+
+std::unique_ptr<SlotCursor> NestedTransaction::createSlotCursor(
+  uint32_t slot) {
+  return _parent->createSlotCursor(slot);
+}
+
+std::unique_ptr<SlotsCursor> NestedTransaction::createSlotsCursor(
+  uint32_t start, uint32_t end) {
+  return _parent->createSlotsCursor(start, end);
+}
+
+std::unique_ptr<VersionMetaCursor>
+NestedTransaction::createVersionMetaCursor() {
+  return _parent->createVersionMetaCursor();
+}
+
+std::unique_ptr<BasicDataCursor> NestedTransaction::createDataCursor(
+  size_t readahead_size) {
+  return _parent->createDataCursor(readahead_size);
+}
+
+std::unique_ptr<PrefixCursor> NestedTransaction::createPrefixCursor(
+  const std::string& prefix, size_t readahead_size) {
+  return _parent->createPrefixCursor(prefix, readahead_size);
+}
+
+std::unique_ptr<AllDataCursor> NestedTransaction::createAllDataCursor() {
+  return _parent->createAllDataCursor();
+}
+
+std::unique_ptr<BinlogCursor> NestedTransaction::createBinlogCursor() {
+  return _parent->createBinlogCursor();
+}
+
+Expected<std::string> NestedTransaction::getKV(const std::string& key) {
+  return _parent->getKV(key);
+}
+
+std::vector<Expected<std::string>> NestedTransaction::multiGetKV(
+  const std::vector<std::string>& keys) {
+  return _parent->multiGetKV(keys);
+}
+
+Status NestedTransaction::setKV(const std::string& key,
+                                const std::string& val,
+                                const uint64_t ts) {
+  return _parent->setKV(key, val, ts);
+}
+
+Status NestedTransaction::delKV(const std::string& key, const uint64_t ts) {
+  return _parent->delKV(key, ts);
+}
+
+Status NestedTransaction::mergeKV(const std::string& key,
+                                  const std::string& operand,
+                                  const uint64_t ts) {
+  return _parent->mergeKV(key, operand, ts);
+}
+
+Status NestedTransaction::addDeleteRangeBinlog(const std::string& begin,
+                                               const std::string& end) {
+  return _parent->addDeleteRangeBinlog(begin, end);
+}
+
+uint64_t NestedTransaction::getBinlogTime() {
+  return _parent->getBinlogTime();
+}
+
+void NestedTransaction::setBinlogTime(uint64_t timestamp) {
+  _parent->setBinlogTime(timestamp);
+}
+
+bool NestedTransaction::isReplOnly() const {
+  return _parent->isReplOnly();
+}
+
+uint64_t NestedTransaction::getTxnId() const {
+  return _parent->getTxnId();
+}
+
+void NestedTransaction::setSavePoint() {
+  _parent->setSavePoint();
+}
+
+Status NestedTransaction::rollbackToSavePoint() {
+  return _parent->rollbackToSavePoint();
+}
+
+Status NestedTransaction::popSavePoint() {
+  return _parent->popSavePoint();
+}
+
 BasicDataCursor::BasicDataCursor(std::unique_ptr<Cursor> cursor)
   : _baseCursor(std::move(cursor)) {
   _baseCursor->seek("");
@@ -217,6 +386,10 @@ void BasicDataCursor::seek(const std::string& prefix) {
   _baseCursor->seek(prefix);
 }
 
+void BasicDataCursor::seekForPrev(const std::string& target) {
+  _baseCursor->seekForPrev(target);
+}
+
 // can't be used currently
 /*void BasicDataCursor::seekToLast() {
     _baseCursor->seekToLast();
@@ -225,9 +398,8 @@ void BasicDataCursor::seek(const std::string& prefix) {
 Expected<Record> BasicDataCursor::next() {
   auto expRcd = _baseCursor->next();
   if (expRcd.ok()) {
-    Record dataRecord(expRcd.value());
-    if (dataRecord.getRecordKey().getChunkId() < CLUSTER_SLOTS) {
-      return dataRecord;
+    if (expRcd.value().getRecordKey().getChunkId() < CLUSTER_SLOTS) {
+      return expRcd;
     } else {
       return {ErrorCodes::ERR_EXHAUST, "no more basic data"};
     }
@@ -464,6 +636,51 @@ Expected<Record> SlotsCursor::next() {
   }
 }
 
+PrefixCursor::PrefixCursor(std::unique_ptr<Cursor> cursor,
+                           const std::string& prefix)
+  : _prefix(prefix), _baseCursor(std::move(cursor)) {
+  _baseCursor->seek(prefix);
+}
+
+void PrefixCursor::seek(const std::string& target) {
+  _baseCursor->seek(target < _prefix ? _prefix : target);
+}
+
+Status PrefixCursor::next(RecordKeyView* key, RecordValueView* value) {
+  mystring_view k, v;
+  auto s = _baseCursor->nextRaw(&k, &v);
+  if (!s.ok()) {
+    return s;
+  }
+  // the iterator stops at the upper bound, unless there is none
+  if (k.size() < _prefix.size() ||
+      memcmp(k.data(), _prefix.data(), _prefix.size()) != 0) {
+    return {ErrorCodes::ERR_EXHAUST, "no more data"};
+  }
+  auto ek = RecordKeyView::decode(k);
+  if (!ek.ok()) {
+    return ek.status();
+  }
+  auto ev = RecordValueView::decode(v);
+  if (!ev.ok()) {
+    return ev.status();
+  }
+  *key = ek.value();
+  *value = ev.value();
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+std::string PrefixCursor::upperBound(const std::string& prefix) {
+  std::string bound = prefix;
+  while (!bound.empty()) {
+    if (static_cast<uint8_t>(bound.back()) != 0xff) {
+      bound.back()++;
+      break;
+    }
+    bound.pop_back();
+  }
+  return bound;
+}
 
 KVStore::KVStore(const std::string& id, const std::string& path)
   : _id(id), _dbPath(path), _backupDir(path + "/" + id + "_bak") {
@@ -575,4 +792,29 @@ uint64_t BackupInfo::getStartTimeSec() const {
 uint64_t BackupInfo::getEndTimeSec() const {
   return _endTimeSec;
 }
+
+void BackupInfo::setBaseDir(const std::string& dir) {
+  _baseDir = dir;
+}
+
+const std::string& BackupInfo::getBaseDir() const {
+  return _baseDir;
+}
+
+void BackupInfo::setDbIdentity(const std::string& identity) {
+  _dbIdentity = identity;
+}
+
+const std::string& BackupInfo::getDbIdentity() const {
+  return _dbIdentity;
+}
+
+void BackupInfo::addSstFile(const std::string& file, const SstFile& sst) {
+  _sstFiles[file] = sst;
+}
+
+const std::map<std::string, BackupInfo::SstFile>& BackupInfo::getSstFiles()
+  const {
+  return _sstFiles;
+}
 }  // namespace tendisplus
@@ -5,6 +5,8 @@
 #ifndef SRC_TENDISPLUS_STORAGE_KVSTORE_H_
 #define SRC_TENDISPLUS_STORAGE_KVSTORE_H_
 
+#include <array>
+#include <algorithm>
 #include <limits>
 #include <string>
 #include <utility>
@@ -21,6 +23,7 @@
 #include "rapidjson/stringbuffer.h"
 #include "rocksdb/db.h"
 #include "tendisplus/utils/status.h"
+#include "tendisplus/utils/string.h"
 #include "tendisplus/storage/record.h"
 #include "tendisplus/server/session.h"
 
@@ -37,6 +40,10 @@ class Transaction;
 class TTLIndex;
 class RecordKey;
 class RecordValue;
+class RecordKeyView;
+class RecordValueView;
+class SkipListCache;
+class CounterCache;
 class VersionMeta;
 enum class RecordType;
 
@@ -58,9 +65,16 @@ class Cursor {
   Cursor() = default;
   virtual ~Cursor() = default;
   virtual void seek(const std::string& prefix) = 0;
+  // seek to the last record not greater than target
+  virtual void seekForPrev(const std::string& target) = 0;
   // seek to last of the collection, Not the prefix
   virtual void seekToLast() = 0;
+  // prev() after next() or nextRaw() goes back to the record returned,
+  // even if it's the last one of the collection
   virtual Expected<Record> next() = 0;
+  // the same as next(), but the key and the value aren't decoded or
+  // copied, they are valid until the cursor is used again
+  virtual Status nextRaw(mystring_view* key, mystring_view* value) = 0;
   virtual Status prev() = 0;
   virtual Expected<std::string> key() = 0;
 };
@@ -94,6 +108,7 @@ class BasicDataCursor {
   explicit BasicDataCursor(std::unique_ptr<Cursor>);
   ~BasicDataCursor() = default;
   void seek(const std::string& prefix);
+  void seekForPrev(const std::string& target);
   // void seekToLast();
   Expected<Record> next();
   Status prev();
@@ -194,6 +209,31 @@ class SlotsCursor {
   std::unique_ptr<Cursor> _baseCursor;
 };
 
+// PrefixCursor scans the records with a prefix, like the elements of a
+// key. The iterator is bounded by the end of the prefix, and the records
+// are not decoded or copied, see RecordKeyView, so that a long scan doesn't
+// allocate for every record.
+class PrefixCursor {
+ public:
+  PrefixCursor() = delete;
+  PrefixCursor(std::unique_ptr<Cursor> cursor, const std::string& prefix);
+  ~PrefixCursor() = default;
+  // seek to the first record not less than target and the prefix
+  void seek(const std::string& target);
+  // ERR_EXHAUST after the last record with the prefix, the views are
+  // valid until the cursor is used again
+  Status next(RecordKeyView* key, RecordValueView* value);
+
+  // the upper bound of the keys with the prefix, empty if there is none
+  static std::string upperBound(const std::string& prefix);
+
+ private:
+  const std::string _prefix;
+
+ protected:
+  std::unique_ptr<Cursor> _baseCursor;
+};
+
 class Transaction {
  public:
   Transaction() = default;
@@ -202,8 +242,12 @@ class Transaction {
   virtual ~Transaction() = default;
   virtual Expected<uint64_t> commit() = 0;
   virtual Status rollback() = 0;
+  // readahead_size(bytes) > 0 prefetches the blocks of a long sequential
+  // scan, 0 uses the default of the storage
   virtual std::unique_ptr<Cursor> createCursor(
-    ColumnFamilyNumber cf, const std::string* iterate_upper_bound = NULL) = 0;
+    ColumnFamilyNumber cf,
+    const std::string* iterate_upper_bound = NULL,
+    size_t readahead_size = 0) = 0;
   virtual Status flushall() = 0;
   virtual Status migrate(const std::string& logKey,
                          const std::string& logValue) = 0;
@@ -230,21 +274,38 @@ class Transaction {
   virtual std::unique_ptr<SlotsCursor> createSlotsCursor(uint32_t start,
                                                          uint32_t end) = 0;
   virtual std::unique_ptr<VersionMetaCursor> createVersionMetaCursor() = 0;
-  virtual std::unique_ptr<BasicDataCursor> createDataCursor() = 0;
+  virtual std::unique_ptr<BasicDataCursor> createDataCursor(
+    size_t readahead_size = 0) = 0;
+  virtual std::unique_ptr<PrefixCursor> createPrefixCursor(
+    const std::string& prefix, size_t readahead_size = 0) = 0;
   virtual std::unique_ptr<AllDataCursor> createAllDataCursor() = 0;
   virtual std::unique_ptr<BinlogCursor> createBinlogCursor() = 0;
 
   virtual Expected<std::string> getKV(const std::string& key) = 0;
+  // batched point lookups in the data column family, results are in the
+  // same order of keys, missing keys are reported as ERR_NOTFOUND
+  virtual std::vector<Expected<std::string>> multiGetKV(
+    const std::vector<std::string>& keys) = 0;
   virtual Status setKV(const std::string& key,
                        const std::string& val,
                        const uint64_t ts = 0) = 0;
   virtual Status delKV(const std::string& key, const uint64_t ts = 0) = 0;
+  // write a merge operand of KVIncrMergeOperator, with its binlog
+  virtual Status mergeKV(const std::string& key,
+                         const std::string& operand,
+                         const uint64_t ts = 0) = 0;
   virtual Status addDeleteRangeBinlog(const std::string& begin,
                                       const std::string& end) = 0;
   virtual uint64_t getBinlogTime() = 0;
   virtual void setBinlogTime(uint64_t timestamp) = 0;
   virtual bool isReplOnly() const = 0;
   virtual uint64_t getTxnId() const = 0;
+  // rollbackToSavePoint() undoes the writes after the last setSavePoint()
+  // and removes it, the save points are a stack. popSavePoint() removes
+  // the last one and keeps the writes.
+  virtual void setSavePoint() = 0;
+  virtual Status rollbackToSavePoint() = 0;
+  virtual Status popSavePoint() = 0;
   static constexpr uint64_t MAX_VALID_TXNID =
     std::numeric_limits<uint64_t>::max() / 2;
   static constexpr uint64_t MIN_VALID_TXNID = 1;
@@ -261,8 +322,95 @@ class Transaction {
   static constexpr uint32_t CHUNKID_DEL_RANGE = 0xFFFFFFFB;
 };
 
+// NestedTransaction is handed out by KVStore::createTransaction() to the
+// commands run by a script or EXEC, everything goes to the transaction of
+// the script or EXEC. commit() and rollback() do nothing, the owner of the
+// parent commits or rolls back all of the commands at once.
+class NestedTransaction : public Transaction {
+ public:
+  explicit NestedTransaction(Transaction* parent) : _parent(parent) {}
+  NestedTransaction(const NestedTransaction&) = delete;
+  NestedTransaction(NestedTransaction&&) = delete;
+  virtual ~NestedTransaction() = default;
+
+  Expected<uint64_t> commit() final;
+  Status rollback() final;
+  std::unique_ptr<Cursor> createCursor(
+    ColumnFamilyNumber cf,
+    const std::string* iterate_upper_bound = NULL,
+    size_t readahead_size = 0) final;
+  Status flushall() final;
+  Status migrate(const std::string& logKey,
+                 const std::string& logValue) final;
+  std::unique_ptr<RepllogCursorV2> createRepllogCursorV2(
+    uint64_t begin, bool ignoreReadBarrier = false) final;
+  Status applyBinlog(const ReplLogValueEntryV2& logEntry) final;
+  Status setBinlogKV(uint64_t binlogId,
+                     const std::string& logKey,
+                     const std::string& logValue) final;
+  Status setBinlogKV(const std::string& logKey,
+                     const std::string& logValue) final;
+  Status delBinlog(const ReplLogRawV2& log) final;
+  uint64_t getBinlogId() const final;
+  void setBinlogId(uint64_t binlogId) final;
+  uint32_t getChunkId() const final;
+  std::string getKVStoreId() const final;
+  void setChunkId(uint32_t chunkId) final;
+  void SetSnapshot() final;
+
+  std::unique_ptr<TTLIndexCursor> createTTLIndexCursor(
+    std::uint64_t until) final;
+  std::unique_ptr<SlotCursor> createSlotCursor(uint32_t slot) final;
+  std::unique_ptr<SlotsCursor> createSlotsCursor(uint32_t start,
+                                                 uint32_t end) final;
+  std::unique_ptr<VersionMetaCursor> createVersionMetaCursor() final;
+  std::unique_ptr<BasicDataCursor> createDataCursor(
+    size_t readahead_size = 0) final;
+  std::unique_ptr<PrefixCursor> createPrefixCursor(
+    const std::string& prefix, size_t readahead_size = 0) final;
+  std::unique_ptr<AllDataCursor> createAllDataCursor() final;
+  std::unique_ptr<BinlogCursor> createBinlogCursor() final;
+
+  Expected<std::string> getKV(const std::string& key) final;
+  std::vector<Expected<std::string>> multiGetKV(
+    const std::vector<std::string>& keys) final;
+  Status setKV(const std::string& key,
+               const std::string& val,
+               const uint64_t ts = 0) final;
+  Status delKV(const std::string& key, const uint64_t ts = 0) final;
+  Status mergeKV(const std::string& key,
+                 const std::string& operand,
+                 const uint64_t ts = 0) final;
+  Status addDeleteRangeBinlog(const std::string& begin,
+                              const std::string& end) final;
+  uint64_t getBinlogTime() final;
+  void setBinlogTime(uint64_t timestamp) final;
+  bool isReplOnly() const final;
+  uint64_t getTxnId() const final;
+  void setSavePoint() final;
+  Status rollbackToSavePoint() final;
+  Status popSavePoint() final;
+
+ private:
+  // NOTE: not owned by me
+  Transaction* _parent;
+};
+
 class BackupInfo {
  public:
+  // an sst file of the db when it's backed up, the number of a file is
+  // never reused in a db, together with the db identity it tells whether
+  // the file of another backup is the same one
+  struct SstFile {
+    uint64_t size;
+    uint64_t smallestSeqno;
+    uint64_t largestSeqno;
+    bool operator==(const SstFile& o) const {
+      return size == o.size && smallestSeqno == o.smallestSeqno &&
+        largestSeqno == o.largestSeqno;
+    }
+  };
+
   BackupInfo();
   const std::map<std::string, uint64_t>& getFileList() const;
   void setFileList(const std::map<std::string, uint64_t>&);
@@ -277,6 +425,14 @@ class BackupInfo {
   uint64_t getEndTimeSec() const;
   BinlogVersion getBinlogVersion() const;
   void addFile(const std::string& file, uint64_t size);
+  // the previous backup of an incremental one
+  void setBaseDir(const std::string& dir);
+  const std::string& getBaseDir() const;
+  // the identity of the db backed up, empty if unknown
+  void setDbIdentity(const std::string& identity);
+  const std::string& getDbIdentity() const;
+  void addSstFile(const std::string& file, const SstFile& sst);
+  const std::map<std::string, SstFile>& getSstFiles() const;
 
  private:
   std::map<std::string, uint64_t> _fileList;
@@ -285,6 +441,9 @@ class BackupInfo {
   uint64_t _startTimeSec;
   uint64_t _endTimeSec;
   BinlogVersion _binlogVersion;
+  std::string _baseDir;
+  std::string _dbIdentity;
+  std::map<std::string, SstFile> _sstFiles;
 };
 
 class BinlogObserver {
@@ -295,10 +454,23 @@ class BinlogObserver {
 struct KVStoreStat {
   std::atomic<uint64_t> compactFilterCount;
   std::atomic<uint64_t> compactKvExpiredCount;
+  // the sub keys of the expired collections, and the ttl indexes of the
+  // keys deleted or expiring at another time, dropped by the compaction
+  std::atomic<uint64_t> compactEleExpiredCount{0};
+  std::atomic<uint64_t> compactTtlIndexStaleCount{0};
   // number of request when store is paused
   std::atomic<uint64_t> pausedErrorCount;
   // number of request when store is destroyed
   std::atomic<uint64_t> destroyedErrorCount;
+  // keys deleted in each range of DELETE_RANGE_CHUNKS chunks, reset by
+  // the idle compaction of the range, see CompactionScheduler
+  static constexpr uint32_t DELETE_RANGE_CHUNKS = 256;
+  static constexpr uint32_t DELETE_RANGES = 64;
+  std::array<std::atomic<uint64_t>, DELETE_RANGES> rangeDeleteCount{};
+  void countDelete(uint32_t chunkId) {
+    auto range = std::min(chunkId / DELETE_RANGE_CHUNKS, DELETE_RANGES - 1);
+    rangeDeleteCount[range].fetch_add(1, std::memory_order_relaxed);
+  }
 };
 
 #define BINLOG_HEADER_V2 "BINLOG_V2\r\n"
@@ -320,7 +492,13 @@ class KVStore {
  public:
   enum class StoreMode { READ_WRITE = 0, REPLICATE_ONLY = 1, STORE_NONE = 2 };
 
-  enum class BackupMode { BACKUP_COPY, BACKUP_CKPT, BACKUP_CKPT_INTER };
+  enum class BackupMode {
+    BACKUP_COPY,
+    BACKUP_CKPT,
+    BACKUP_CKPT_INTER,
+    // like BACKUP_CKPT, the unchanged files are hard linked from a base
+    BACKUP_INCR,
+  };
 
 
   explicit KVStore(const std::string& id, const std::string& path);
@@ -341,6 +519,8 @@ class KVStore {
   virtual Expected<RecordValue> getKV(const RecordKey& key,
                                       Transaction* txn,
                                       RecordType valueType) = 0;
+  virtual std::vector<Expected<RecordValue>> multiGetKV(
+    const std::vector<RecordKey>& keys, Transaction* txn) = 0;
   virtual Status setKV(const RecordKey&, const RecordValue&, Transaction*) = 0;
   virtual Status setKV(const Record& kv, Transaction* txn) = 0;
   // TODO(eliotwang) deprecate this member function
@@ -348,9 +528,20 @@ class KVStore {
                        const std::string& val,
                        Transaction* txn) = 0;
   virtual Status delKV(const RecordKey& key, Transaction* txn) = 0;
+  virtual Status mergeKV(const RecordKey& key,
+                         const RecordValue& operand,
+                         Transaction* txn) = 0;
   // [begin, end)
   virtual Status deleteRange(const std::string& begin,
                              const std::string& end) = 0;
+  // drop the sst files whose keys are all in [begin, end), without
+  // binlog. it doesn't respect snapshots, the range should be unreadable,
+  // and be followed by deleteRange() for the keys left.
+  virtual Status deleteFilesInRange(const std::string& begin,
+                                    const std::string& end) = 0;
+  // the approximate size on disk of [begin, end)
+  virtual uint64_t getApproximateSize(const std::string& begin,
+                                      const std::string& end) = 0;
   virtual Status deleteRangeBinlog(uint64_t begin, uint64_t end) = 0;
 
   virtual Status assignBinlogIdIfNeeded(Transaction* txn) = 0;
@@ -373,6 +564,13 @@ class KVStore {
                               const std::string* begin,
                               const std::string* end) = 0;
   virtual Status fullCompact() = 0;
+  // the compactions the store runs at the same time, it's kept over a
+  // restart of the store
+  virtual Status setBackgroundCompactions(uint32_t num) = 0;
+  virtual uint32_t getBackgroundCompactions() const = 0;
+  // the keys read and written since the statistics are reset
+  virtual uint64_t getNumKeysRead() const = 0;
+  virtual uint64_t getNumKeysWritten() const = 0;
 
   // remove all data in db
   virtual Status clear() = 0;
@@ -385,8 +583,10 @@ class KVStore {
   virtual Status pause() = 0;
   virtual Status resume() = 0;
   virtual Status destroy() = 0;
-  virtual bool getIntProperty(const std::string& property,
-                              uint64_t* value) const = 0;
+  virtual bool getIntProperty(
+    const std::string& property,
+    uint64_t* value,
+    ColumnFamilyNumber cf = ColumnFamilyNumber::ColumnFamily_Default) const = 0;
   virtual bool getProperty(const std::string& property,
                            std::string* value) const = 0;
   virtual std::string getAllProperty() const = 0;
@@ -418,6 +618,13 @@ class KVStore {
   virtual Expected<BackupInfo> backup(const std::string&,
                                       BackupMode,
                                       BinlogVersion) = 0;
+  // an incremental backup of BACKUP_INCR mode to dir, sharing the
+  // unchanged sst files with baseDir, a backup of BACKUP_CKPT or
+  // BACKUP_INCR mode of the same db. the other files are linked or copied
+  // from the db. dir doesn't depend on baseDir after it's done.
+  virtual Expected<BackupInfo> backupIncr(const std::string& dir,
+                                          const std::string& baseDir,
+                                          BinlogVersion) = 0;
   virtual Expected<std::string> restoreBackup(const std::string& dir) = 0;
   virtual Expected<BackupInfo> getBackupMeta(const std::string& dir) = 0;
   virtual Status releaseBackup() = 0;
@@ -428,9 +635,21 @@ class KVStore {
   uint64_t getBinlogTime();
   void setBinlogTime(uint64_t timestamp);
   uint64_t getCurrentTime();
+  // the skiplist nodes shared by the transactions, nullptr if disabled
+  SkipListCache* getSkipListCache() const {
+    return _skipListCache.get();
+  }
+  // the counters incremented by merge operands, nullptr if disabled
+  CounterCache* getCounterCache() const {
+    return _counterCache.get();
+  }
 
   KVStoreStat stat;
 
+ protected:
+  std::shared_ptr<SkipListCache> _skipListCache;
+  std::shared_ptr<CounterCache> _counterCache;
+
  private:
   const std::string _id;
   const std::string _dbPath;
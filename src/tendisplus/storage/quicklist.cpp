@@ -0,0 +1,1472 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include "tendisplus/storage/quicklist.h"
+#include "tendisplus/storage/varint.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/string.h"
+
+namespace tendisplus {
+
+// the chunk ids are spaced by LIST_CHUNK_ID_GAP, a chunk split from
+// another one takes the middle of the gap. they are no less than
+// LIST_CHUNK_MIN_ID, so the chunk records sort after the group records.
+constexpr uint64_t LIST_CHUNK_MIN_ID = 1ULL << 62;
+constexpr uint64_t LIST_CHUNK_INIT_ID = 1ULL << 63;
+constexpr uint64_t LIST_CHUNK_ID_GAP = 1ULL << 16;
+// a longer range scan of the elements reads ahead
+constexpr uint64_t LIST_READAHEAD_MINLEN = 128;
+constexpr size_t LIST_READAHEAD_SIZE = 2 * 1024 * 1024;
+// the elements of a list of the older format are scanned and moved in
+// batches
+constexpr uint64_t LIST_ELES_BATCH = 1024;
+
+std::string listChunkIdKey(uint64_t id) {
+  std::string sk(sizeof(uint64_t), '\0');
+  int64Encode(&sk[0], id);
+  return sk;
+}
+
+// a zero byte before the 8 bytes big endian group id
+std::string listGroupIdKey(uint64_t id) {
+  std::string sk(1 + sizeof(uint64_t), '\0');
+  int64Encode(&sk[1], id);
+  return sk;
+}
+
+// the chunk ids ascend, the deltas are shorter
+std::string encodeListGroup(const std::vector<ListChunk>& chunks) {
+  std::vector<uint8_t> value;
+  value.reserve(chunks.size() * 6 + 8);
+  uint64_t prevId = 0;
+  for (const auto& c : chunks) {
+    auto idBytes = varintEncode(c.id - prevId);
+    value.insert(value.end(), idBytes.begin(), idBytes.end());
+    auto countBytes = varintEncode(c.count);
+    value.insert(value.end(), countBytes.begin(), countBytes.end());
+    prevId = c.id;
+  }
+  return std::string(reinterpret_cast<const char*>(value.data()), value.size());
+}
+
+Expected<std::vector<ListChunk>> decodeListGroup(const std::string& val) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(val.c_str());
+  std::vector<ListChunk> chunks;
+  uint64_t prevId = 0;
+  size_t offset = 0;
+  while (offset < val.size()) {
+    auto expId = varintDecodeFwd(p + offset, val.size() - offset);
+    if (!expId.ok()) {
+      return expId.status();
+    }
+    offset += expId.value().second;
+    auto expCount = varintDecodeFwd(p + offset, val.size() - offset);
+    if (!expCount.ok()) {
+      return expCount.status();
+    }
+    offset += expCount.value().second;
+    prevId += expId.value().first;
+    chunks.push_back(
+      ListChunk{prevId, static_cast<uint32_t>(expCount.value().first)});
+  }
+  return chunks;
+}
+
+size_t listElesBytes(const std::vector<std::string>& eles) {
+  size_t bytes = 0;
+  for (auto& e : eles) {
+    bytes += e.size();
+  }
+  return bytes;
+}
+
+bool listChunkHasRoom(size_t count, size_t bytes, size_t add) {
+  return count == 0 ||
+    (count < LIST_CHUNK_MAX_ELES && bytes + add <= LIST_CHUNK_MAX_BYTES);
+}
+
+QuickList::QuickList(uint32_t chunkId,
+                     uint32_t dbId,
+                     const std::string& pk,
+                     const ListMetaValue& meta,
+                     PStore store)
+  : _chunkId(chunkId),
+    _dbId(dbId),
+    _pk(pk),
+    _store(store),
+    _head(meta.getHead()),
+    _tail(meta.getTail()),
+    _fmt(meta.getKeyFormat()),
+    _lhead(meta.getLegacyHead()),
+    _ltail(meta.getLegacyTail()),
+    _groups(meta.getGroups()),
+    _gi(0) {}
+
+uint64_t QuickList::size() const {
+  return _tail - _head;
+}
+
+ListKeyFormat QuickList::getKeyFormat() const {
+  return _fmt;
+}
+
+ListMetaValue QuickList::getMeta() const {
+  ListMetaValue lm(_head, _tail, _fmt);
+  if (_fmt == ListKeyFormat::LKF_CHUNKED) {
+    lm.setGroups(_groups);
+    lm.setLegacyRange(_lhead, _ltail);
+  }
+  return lm;
+}
+
+Expected<std::vector<ListChunk>> QuickList::getChunks(
+  Transaction* txn) const {
+  std::vector<ListChunk> chunks;
+  for (const auto& g : _groups) {
+    auto expChunks = readGroup(g.id, txn);
+    if (!expChunks.ok()) {
+      return expChunks.status();
+    }
+    chunks.insert(
+      chunks.end(), expChunks.value().begin(), expChunks.value().end());
+  }
+  return chunks;
+}
+
+std::string QuickList::encodeChunk(const std::vector<std::string>& eles) {
+  std::string result;
+  result.reserve(listElesBytes(eles) + eles.size());
+  for (auto& e : eles) {
+    result.append(lenStrEncode(e));
+  }
+  return result;
+}
+
+Expected<std::vector<std::string>> QuickList::decodeChunk(
+  const std::string& val) {
+  std::vector<std::string> eles;
+  size_t offset = 0;
+  while (offset < val.size()) {
+    auto eStr = lenStrDecode(val.c_str() + offset, val.size() - offset);
+    if (!eStr.ok()) {
+      return eStr.status();
+    }
+    offset += eStr.value().second;
+    eles.emplace_back(std::move(eStr.value().first));
+  }
+  return eles;
+}
+
+Expected<uint32_t> QuickList::countChunk(const std::string& val) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(val.c_str());
+  uint32_t count = 0;
+  size_t offset = 0;
+  while (offset < val.size()) {
+    auto expLen = varintDecodeFwd(p + offset, val.size() - offset);
+    if (!expLen.ok()) {
+      return expLen.status();
+    }
+    offset += expLen.value().second + expLen.value().first;
+    if (offset > val.size()) {
+      return {ErrorCodes::ERR_DECODE, "invalid list chunk"};
+    }
+    count++;
+  }
+  return count;
+}
+
+Expected<uint64_t> QuickList::decodeChunkId(const std::string& sk) {
+  if (sk.size() != sizeof(uint64_t)) {
+    return {ErrorCodes::ERR_DECODE, "invalid list chunk id"};
+  }
+  return int64Decode(sk.c_str());
+}
+
+bool QuickList::isChunkKey(const std::string& sk) {
+  return sk.size() == sizeof(uint64_t) &&
+    int64Decode(sk.c_str()) >= LIST_CHUNK_MIN_ID;
+}
+
+bool QuickList::isGroupKey(const std::string& sk) {
+  return sk.size() == 1 + sizeof(uint64_t) && sk[0] == '\0';
+}
+
+RecordKey QuickList::eleKey(const std::string& sk) const {
+  return RecordKey(_chunkId, _dbId, RecordType::RT_LIST_ELE, _pk, sk);
+}
+
+RecordKey QuickList::chunkKey(uint64_t id) const {
+  return eleKey(listChunkIdKey(id));
+}
+
+RecordKey QuickList::groupKey(uint64_t id) const {
+  return eleKey(listGroupIdKey(id));
+}
+
+Expected<std::vector<ListChunk>> QuickList::readGroup(
+  uint64_t id, Transaction* txn) const {
+  Expected<RecordValue> rv = _store->getKV(groupKey(id), txn);
+  if (!rv.ok()) {
+    return rv.status();
+  }
+  return decodeListGroup(rv.value().getValue());
+}
+
+// the group record gi is rewritten with chunks, so are its counts
+Status QuickList::writeGroup(size_t gi,
+                             const std::vector<ListChunk>& chunks,
+                             Transaction* txn) {
+  INVARIANT_D(!chunks.empty());
+  uint64_t count = 0;
+  for (const auto& c : chunks) {
+    count += c.count;
+  }
+  _groups[gi].count = count;
+  _groups[gi].chunks = chunks.size();
+  RecordValue rv(encodeListGroup(chunks), RecordType::RT_LIST_ELE, -1);
+  return _store->setKV(groupKey(_groups[gi].id), rv, txn);
+}
+
+Status QuickList::loadGroup(size_t gi, Transaction* txn) {
+  INVARIANT_D(gi < _groups.size());
+  auto chunks = readGroup(_groups[gi].id, txn);
+  if (!chunks.ok()) {
+    return chunks.status();
+  }
+  uint64_t count = 0;
+  for (const auto& c : chunks.value()) {
+    count += c.count;
+  }
+  INVARIANT_D(count == _groups[gi].count);
+  if (count != _groups[gi].count) {
+    return {ErrorCodes::ERR_INTERNAL, "invalid list chunk group"};
+  }
+  _gi = gi;
+  _chunks = std::move(chunks.value());
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// the first or the last group is loaded, a new one is added to an empty
+// list
+Status QuickList::loadEnd(bool first, Transaction* txn) {
+  if (_groups.empty()) {
+    _groups.push_back(ListChunkGroup{allocGroupId(), 0, 0});
+    _gi = 0;
+    _chunks.clear();
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  return loadGroup(first ? 0 : _groups.size() - 1, txn);
+}
+
+// the loaded group is written back, it's deleted if it has no chunk left,
+// and split evenly if it has too many
+Status QuickList::saveGroup(Transaction* txn) {
+  if (_chunks.empty()) {
+    Status s = _store->delKV(groupKey(_groups[_gi].id), txn);
+    if (!s.ok()) {
+      return s;
+    }
+    _groups.erase(_groups.begin() + _gi);
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  size_t n = (_chunks.size() + LIST_GROUP_MAX_CHUNKS - 1) /
+    LIST_GROUP_MAX_CHUNKS;
+  size_t perGroup = (_chunks.size() + n - 1) / n;
+  for (size_t i = 0; i * perGroup < _chunks.size(); i++) {
+    if (i > 0) {
+      _groups.insert(_groups.begin() + _gi + i,
+                     ListChunkGroup{allocGroupId(), 0, 0});
+    }
+    auto begin = _chunks.begin() + i * perGroup;
+    auto end = _chunks.begin() + std::min(_chunks.size(), (i + 1) * perGroup);
+    Status s = writeGroup(_gi + i, std::vector<ListChunk>(begin, end), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+uint64_t QuickList::allocGroupId() const {
+  uint64_t id = 0;
+  for (const auto& g : _groups) {
+    id = std::max(id, g.id + 1);
+  }
+  return id;
+}
+
+// the group gi and its chunks are deleted, the chunks without being read
+Status QuickList::dropGroup(size_t gi, Transaction* txn) {
+  Status s = loadGroup(gi, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  for (const auto& c : _chunks) {
+    s = _store->delKV(chunkKey(c.id), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  _chunks.clear();
+  return saveGroup(txn);
+}
+
+// the neighbouring groups are merged if both of them are less than half
+// full
+Status QuickList::mergeGroups(Transaction* txn) {
+  size_t gi = 0;
+  while (gi + 1 < _groups.size()) {
+    if (_groups[gi].chunks + _groups[gi + 1].chunks >
+        LIST_GROUP_MAX_CHUNKS / 2) {
+      gi++;
+      continue;
+    }
+    auto second = readGroup(_groups[gi + 1].id, txn);
+    if (!second.ok()) {
+      return second.status();
+    }
+    Status s = loadGroup(gi, txn);
+    if (!s.ok()) {
+      return s;
+    }
+    s = _store->delKV(groupKey(_groups[gi + 1].id), txn);
+    if (!s.ok()) {
+      return s;
+    }
+    _groups.erase(_groups.begin() + gi + 1);
+    _chunks.insert(
+      _chunks.end(), second.value().begin(), second.value().end());
+    s = writeGroup(gi, _chunks, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// the group and the chunk holding the idx element are found with the
+// counts, the group is loaded, the position of the chunk in it and the
+// offset of the element in the chunk are returned
+Expected<std::pair<size_t, uint64_t>> QuickList::loadAt(uint64_t idx,
+                                                         Transaction* txn) {
+  INVARIANT_D(idx < size() - legacySize());
+  size_t gi = 0;
+  while (gi < _groups.size() && idx >= _groups[gi].count) {
+    idx -= _groups[gi].count;
+    gi++;
+  }
+  if (gi == _groups.size()) {
+    return {ErrorCodes::ERR_INTERNAL, "invalid list chunk group"};
+  }
+  Status s = loadGroup(gi, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  size_t ci = 0;
+  while (idx >= _chunks[ci].count) {
+    idx -= _chunks[ci].count;
+    ci++;
+  }
+  return std::make_pair(ci, idx);
+}
+
+// the number of the elements of the older format, after the chunks
+uint64_t QuickList::legacySize() const {
+  return _ltail - _lhead;
+}
+
+// a batch of the elements of the older format is moved from the head of
+// them to the tail chunks in txn, the caller saves the meta. all of them
+// are moved if they are few, a longer list is converted by many writes,
+// as the txn rewriting it at once would be too big.
+Status QuickList::convertLegacy(Transaction* txn) {
+  _fmt = ListKeyFormat::LKF_CHUNKED;
+  uint64_t n = legacySize();
+  if (n == 0) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  if (n > LIST_CONVERT_MAX_ELES) {
+    n = LIST_CONVERT_BATCH;
+  }
+  auto eles = rangeOfElements(0, n, txn);
+  if (!eles.ok()) {
+    return eles.status();
+  }
+  for (uint64_t i = _lhead; i < _lhead + n; i++) {
+    Status s = _store->delKV(elementKey(i), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  _lhead += n;
+  if (_lhead == _ltail) {
+    _lhead = _ltail = 0;
+  }
+  Status s = loadEnd(false, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  s = append(std::move(eles.value()), txn);
+  if (!s.ok()) {
+    return s;
+  }
+  return saveGroup(txn);
+}
+
+// the elements in [start, end) of the older format, relative to the first
+// of them, read with one batched lookup
+Expected<std::vector<std::string>> QuickList::rangeOfElements(
+  uint64_t start, uint64_t end, Transaction* txn) {
+  std::vector<std::string> result;
+  if (start >= end) {
+    return result;
+  }
+  result.reserve(end - start);
+  std::vector<RecordKey> keys;
+  keys.reserve(end - start);
+  for (uint64_t i = start; i < end; i++) {
+    keys.emplace_back(elementKey(_lhead + i));
+  }
+  auto values = _store->multiGetKV(keys, txn);
+  for (auto& v : values) {
+    RET_IF_ERR_EXPECTED(v);
+    result.emplace_back(v.value().getValue());
+  }
+  return result;
+}
+
+// the key of the element of the older format on the absolute idx
+RecordKey QuickList::elementKey(uint64_t idx) const {
+  return eleKey(std::to_string(idx));
+}
+
+// the elements on the absolute indexes [from, to) of the older format are
+// moved by delta. the batches are moved beginning with the side they move
+// to, so no element is overwritten before it's read.
+Status QuickList::shiftElements(uint64_t from,
+                                uint64_t to,
+                                int64_t delta,
+                                Transaction* txn) {
+  while (from < to) {
+    uint64_t n = std::min(to - from, LIST_ELES_BATCH);
+    uint64_t start = delta < 0 ? from : to - n;
+    auto eles = rangeOfElements(start - _lhead, start - _lhead + n, txn);
+    if (!eles.ok()) {
+      return eles.status();
+    }
+    for (uint64_t i = 0; i < n; i++) {
+      RecordValue rv(
+        std::move(eles.value()[i]), RecordType::RT_LIST_ELE, -1);
+      Status s = _store->setKV(elementKey(start + i + delta), rv, txn);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    if (delta < 0) {
+      from += n;
+    } else {
+      to -= n;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// the older elements are the tail of the list, the helpers below keep
+// their range only, the callers count the size of the list
+
+Status QuickList::pushElements(const std::vector<std::string>& vals,
+                               Transaction* txn) {
+  for (auto& v : vals) {
+    RecordValue rv(v, RecordType::RT_LIST_ELE, -1);
+    Status s = _store->setKV(elementKey(_ltail++), rv, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<std::string> QuickList::popElement(Transaction* txn) {
+  RecordKey rk = elementKey(_ltail - 1);
+  Expected<RecordValue> rv = _store->getKV(rk, txn);
+  if (!rv.ok()) {
+    return rv.status();
+  }
+  Status s = _store->delKV(rk, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  _ltail--;
+  return rv.value().getValue();
+}
+
+// the elements after the removed ones are moved to fill the holes, from
+// the head or from the tail, whichever moves less
+Expected<uint64_t> QuickList::removeElements(const std::string& val,
+                                             uint64_t count,
+                                             bool fromHead,
+                                             Transaction* txn) {
+  // the absolute indexes of the removed ones
+  std::vector<uint64_t> holes;
+  auto more = [&holes, count]() { return count == 0 || holes.size() < count; };
+  uint64_t len = legacySize();
+  for (uint64_t scanned = 0; scanned < len && more();) {
+    uint64_t n = std::min(len - scanned, LIST_ELES_BATCH);
+    uint64_t start = fromHead ? scanned : len - scanned - n;
+    auto eles = rangeOfElements(start, start + n, txn);
+    if (!eles.ok()) {
+      return eles.status();
+    }
+    for (uint64_t i = 0; i < n && more(); i++) {
+      uint64_t pos = fromHead ? i : n - 1 - i;
+      if (eles.value()[pos] == val) {
+        holes.push_back(_lhead + start + pos);
+      }
+    }
+    scanned += n;
+  }
+  if (holes.empty()) {
+    return 0;
+  }
+  if (!fromHead) {
+    std::reverse(holes.begin(), holes.end());
+  }
+
+  uint64_t k = holes.size();
+  if (_ltail - holes.front() <= holes.back() + 1 - _lhead) {
+    for (uint64_t i = 0; i < k; i++) {
+      uint64_t end = i + 1 < k ? holes[i + 1] : _ltail;
+      Status s = shiftElements(
+        holes[i] + 1, end, -static_cast<int64_t>(i + 1), txn);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    for (uint64_t i = _ltail - k; i < _ltail; i++) {
+      Status s = _store->delKV(elementKey(i), txn);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    _ltail -= k;
+  } else {
+    for (uint64_t i = k; i-- > 0;) {
+      uint64_t begin = i > 0 ? holes[i - 1] + 1 : _lhead;
+      Status s =
+        shiftElements(begin, holes[i], static_cast<int64_t>(k - i), txn);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    for (uint64_t i = _lhead; i < _lhead + k; i++) {
+      Status s = _store->delKV(elementKey(i), txn);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    _lhead += k;
+  }
+  return k;
+}
+
+// the elements after or before the new one are moved, whichever are fewer
+Expected<bool> QuickList::insertElement(const std::string& pivot,
+                                        const std::string& val,
+                                        bool after,
+                                        Transaction* txn) {
+  uint64_t len = legacySize();
+  uint64_t found = len;
+  for (uint64_t start = 0; start < len && found == len;
+       start += LIST_ELES_BATCH) {
+    uint64_t end = std::min(len, start + LIST_ELES_BATCH);
+    auto eles = rangeOfElements(start, end, txn);
+    if (!eles.ok()) {
+      return eles.status();
+    }
+    auto it = std::find(eles.value().begin(), eles.value().end(), pivot);
+    if (it != eles.value().end()) {
+      found = start + (it - eles.value().begin());
+    }
+  }
+  if (found == len) {
+    return false;
+  }
+
+  // the new element goes before the one on pos
+  uint64_t pos = _lhead + found + (after ? 1 : 0);
+  RecordValue rv(val, RecordType::RT_LIST_ELE, -1);
+  Status s;
+  if (_ltail - pos <= pos - _lhead) {
+    s = shiftElements(pos, _ltail, 1, txn);
+    if (!s.ok()) {
+      return s;
+    }
+    s = _store->setKV(elementKey(pos), rv, txn);
+    _ltail++;
+  } else {
+    s = shiftElements(_lhead, pos, -1, txn);
+    if (!s.ok()) {
+      return s;
+    }
+    s = _store->setKV(elementKey(pos - 1), rv, txn);
+    _lhead--;
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  return true;
+}
+
+// the older elements in [start, end), relative to the first of them, are
+// kept only
+Status QuickList::trimElements(uint64_t start,
+                               uint64_t end,
+                               Transaction* txn) {
+  end = std::min(end, legacySize());
+  if (start >= end) {
+    start = end = 0;
+  }
+  for (uint64_t i = _lhead; i < _lhead + start; i++) {
+    Status s = _store->delKV(elementKey(i), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  for (uint64_t i = _lhead + end; i < _ltail; i++) {
+    Status s = _store->delKV(elementKey(i), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  _ltail = _lhead + end;
+  _lhead += start;
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<std::vector<std::string>> QuickList::readChunk(size_t ci,
+                                                        Transaction* txn) {
+  if (ci >= _chunks.size()) {
+    return {ErrorCodes::ERR_INTERNAL, "invalid list chunk"};
+  }
+  Expected<RecordValue> rv = _store->getKV(chunkKey(_chunks[ci].id), txn);
+  if (!rv.ok()) {
+    return rv.status();
+  }
+  auto eles = decodeChunk(rv.value().getValue());
+  if (!eles.ok()) {
+    return eles.status();
+  }
+  INVARIANT_D(eles.value().size() == _chunks[ci].count);
+  if (eles.value().size() != _chunks[ci].count) {
+    return {ErrorCodes::ERR_INTERNAL, "invalid list chunk"};
+  }
+  return eles;
+}
+
+Status QuickList::writeChunk(size_t ci,
+                             const std::vector<std::string>& eles,
+                             Transaction* txn) {
+  INVARIANT_D(!eles.empty());
+  _chunks[ci].count = eles.size();
+  RecordValue rv(encodeChunk(eles), RecordType::RT_LIST_ELE, -1);
+  return _store->setKV(chunkKey(_chunks[ci].id), rv, txn);
+}
+
+Status QuickList::delChunk(size_t ci, Transaction* txn) {
+  Status s = _store->delKV(chunkKey(_chunks[ci].id), txn);
+  if (!s.ok()) {
+    return s;
+  }
+  _chunks.erase(_chunks.begin() + ci);
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// the chunk ci is replaced with eles, which are split into chunks evenly if
+// they are beyond the limits. the number of the chunks taking the place of
+// ci is returned, 0 if eles is empty.
+Expected<size_t> QuickList::rewriteChunk(size_t ci,
+                                         std::vector<std::string>&& eles,
+                                         Transaction* txn) {
+  if (eles.empty()) {
+    Status s = delChunk(ci, txn);
+    if (!s.ok()) {
+      return s;
+    }
+    return 0;
+  }
+  size_t bytes = listElesBytes(eles);
+  size_t n = std::max(
+    (eles.size() + LIST_CHUNK_MAX_ELES - 1) / LIST_CHUNK_MAX_ELES,
+    (bytes + LIST_CHUNK_MAX_BYTES - 1) / LIST_CHUNK_MAX_BYTES);
+  size_t perChunk = (eles.size() + n - 1) / n;
+
+  std::vector<std::vector<std::string>> pieces(1);
+  bytes = 0;
+  for (auto& e : eles) {
+    if (pieces.back().size() >= perChunk ||
+        !listChunkHasRoom(pieces.back().size(), bytes, e.size())) {
+      pieces.emplace_back();
+      bytes = 0;
+    }
+    bytes += e.size();
+    pieces.back().emplace_back(std::move(e));
+  }
+
+  Status s = writeChunk(ci, pieces[0], txn);
+  if (!s.ok()) {
+    return s;
+  }
+  for (size_t i = 1; i < pieces.size(); i++) {
+    auto id = allocId(ci + i, txn);
+    if (!id.ok()) {
+      return id.status();
+    }
+    _chunks.insert(_chunks.begin() + ci + i, ListChunk{id.value(), 0});
+    s = writeChunk(ci + i, pieces[i], txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return pieces.size();
+}
+
+// eles are appended to the tail chunk while it has room, and then to new
+// chunks
+Status QuickList::append(std::vector<std::string>&& eles, Transaction* txn) {
+  size_t i = 0;
+  if (!_chunks.empty() && _chunks.back().count < LIST_CHUNK_MAX_ELES) {
+    size_t ci = _chunks.size() - 1;
+    auto back = readChunk(ci, txn);
+    if (!back.ok()) {
+      return back.status();
+    }
+    auto& chunk = back.value();
+    size_t bytes = listElesBytes(chunk);
+    while (i < eles.size() &&
+           listChunkHasRoom(chunk.size(), bytes, eles[i].size())) {
+      bytes += eles[i].size();
+      chunk.emplace_back(std::move(eles[i++]));
+    }
+    if (i > 0) {
+      Status s = writeChunk(ci, chunk, txn);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+  }
+  while (i < eles.size()) {
+    std::vector<std::string> chunk;
+    size_t bytes = 0;
+    while (i < eles.size() &&
+           listChunkHasRoom(chunk.size(), bytes, eles[i].size())) {
+      bytes += eles[i].size();
+      chunk.emplace_back(std::move(eles[i++]));
+    }
+    auto id = allocId(_chunks.size(), txn);
+    if (!id.ok()) {
+      return id.status();
+    }
+    _chunks.emplace_back(ListChunk{id.value(), 0});
+    Status s = writeChunk(_chunks.size() - 1, chunk, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// eles in the order of the list are put before the head, the head chunk is
+// filled from the last one of eles while it has room
+Status QuickList::prepend(std::vector<std::string>&& eles, Transaction* txn) {
+  size_t j = eles.size();
+  if (!_chunks.empty() && _chunks.front().count < LIST_CHUNK_MAX_ELES) {
+    auto front = readChunk(0, txn);
+    if (!front.ok()) {
+      return front.status();
+    }
+    size_t bytes = listElesBytes(front.value());
+    std::vector<std::string> chunk;
+    while (j > 0 &&
+           listChunkHasRoom(
+             front.value().size() + chunk.size(), bytes, eles[j - 1].size())) {
+      bytes += eles[j - 1].size();
+      chunk.emplace_back(std::move(eles[--j]));
+    }
+    if (!chunk.empty()) {
+      std::reverse(chunk.begin(), chunk.end());
+      chunk.insert(chunk.end(),
+                   std::make_move_iterator(front.value().begin()),
+                   std::make_move_iterator(front.value().end()));
+      Status s = writeChunk(0, chunk, txn);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+  }
+  while (j > 0) {
+    std::vector<std::string> chunk;
+    size_t bytes = 0;
+    while (j > 0 &&
+           listChunkHasRoom(chunk.size(), bytes, eles[j - 1].size())) {
+      bytes += eles[j - 1].size();
+      chunk.emplace_back(std::move(eles[--j]));
+    }
+    std::reverse(chunk.begin(), chunk.end());
+    auto id = allocId(0, txn);
+    if (!id.ok()) {
+      return id.status();
+    }
+    _chunks.insert(_chunks.begin(), ListChunk{id.value(), 0});
+    Status s = writeChunk(0, chunk, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// the id of a new chunk before the loaded chunk pos. the neighbouring
+// group is read if pos is at an end of the loaded one, and the chunks are
+// respaced if there is no room between the neighbours.
+Expected<uint64_t> QuickList::allocId(size_t pos, Transaction* txn) {
+  if (_chunks.empty()) {
+    // the first chunk of an empty list
+    INVARIANT_D(_groups.size() == 1);
+    return LIST_CHUNK_INIT_ID;
+  }
+  bool hasLo = true;
+  bool hasHi = true;
+  uint64_t lo = 0;
+  uint64_t hi = 0;
+  if (pos > 0) {
+    lo = _chunks[pos - 1].id;
+  } else if (_gi > 0) {
+    auto prev = readGroup(_groups[_gi - 1].id, txn);
+    if (!prev.ok() || prev.value().empty()) {
+      return {ErrorCodes::ERR_INTERNAL, "invalid list chunk group"};
+    }
+    lo = prev.value().back().id;
+  } else {
+    hasLo = false;
+  }
+  if (pos < _chunks.size()) {
+    hi = _chunks[pos].id;
+  } else if (_gi + 1 < _groups.size()) {
+    auto next = readGroup(_groups[_gi + 1].id, txn);
+    if (!next.ok() || next.value().empty()) {
+      return {ErrorCodes::ERR_INTERNAL, "invalid list chunk group"};
+    }
+    hi = next.value().front().id;
+  } else {
+    hasHi = false;
+  }
+
+  if (!hasLo) {
+    if (hi >= LIST_CHUNK_MIN_ID + LIST_CHUNK_ID_GAP) {
+      return hi - LIST_CHUNK_ID_GAP;
+    }
+  } else if (!hasHi) {
+    if (lo <= std::numeric_limits<uint64_t>::max() - LIST_CHUNK_ID_GAP) {
+      return lo + LIST_CHUNK_ID_GAP;
+    }
+  } else if (hi - lo > 1) {
+    return lo + (hi - lo) / 2;
+  }
+  Status s = respace(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  return allocId(pos, txn);
+}
+
+// all the chunks are rewritten with ids spaced by LIST_CHUNK_ID_GAP around
+// LIST_CHUNK_INIT_ID, so are the groups, the loaded chunks keep their
+// positions. it's rare, as it takes 16 splits in the same gap.
+Status QuickList::respace(Transaction* txn) {
+  // the loaded group may be ahead of its record
+  std::vector<std::vector<ListChunk>> groups;
+  size_t total = 0;
+  for (size_t gi = 0; gi < _groups.size(); gi++) {
+    if (gi == _gi) {
+      groups.push_back(_chunks);
+    } else {
+      auto chunks = readGroup(_groups[gi].id, txn);
+      if (!chunks.ok()) {
+        return chunks.status();
+      }
+      groups.emplace_back(std::move(chunks.value()));
+    }
+    total += groups.back().size();
+  }
+
+  // the chunk records are in the order of the list
+  std::vector<std::string> values;
+  values.reserve(total);
+  auto cursor = txn->createDataCursor(LIST_READAHEAD_SIZE);
+  std::string prefix = eleKey("").prefixPk();
+  for (auto& chunks : groups) {
+    for (auto& c : chunks) {
+      if (values.empty()) {
+        cursor->seek(chunkKey(c.id).encode());
+      }
+      Expected<Record> exptRcd = cursor->next();
+      if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+        return {ErrorCodes::ERR_NOTFOUND, "list chunk missing"};
+      }
+      RET_IF_ERR_EXPECTED(exptRcd);
+      const RecordKey& rk = exptRcd.value().getRecordKey();
+      if (rk.prefixPk() != prefix ||
+          rk.getSecondaryKey() != listChunkIdKey(c.id)) {
+        return {ErrorCodes::ERR_NOTFOUND, "list chunk missing"};
+      }
+      values.emplace_back(exptRcd.value().getRecordValue().getValue());
+    }
+  }
+  for (auto& chunks : groups) {
+    for (auto& c : chunks) {
+      Status s = _store->delKV(chunkKey(c.id), txn);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+  }
+
+  uint64_t id = LIST_CHUNK_INIT_ID - total / 2 * LIST_CHUNK_ID_GAP;
+  size_t i = 0;
+  for (size_t gi = 0; gi < groups.size(); gi++) {
+    for (auto& c : groups[gi]) {
+      c.id = id;
+      RecordValue rv(std::move(values[i++]), RecordType::RT_LIST_ELE, -1);
+      Status s = _store->setKV(chunkKey(id), rv, txn);
+      if (!s.ok()) {
+        return s;
+      }
+      id += LIST_CHUNK_ID_GAP;
+    }
+    Status s = writeGroup(gi, groups[gi], txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  _chunks = std::move(groups[_gi]);
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// the neighbours are merged if both of them are less than half full
+Status QuickList::mergeSmall(Transaction* txn) {
+  size_t ci = 0;
+  while (ci + 1 < _chunks.size()) {
+    if (_chunks[ci].count + _chunks[ci + 1].count > LIST_CHUNK_MAX_ELES / 2) {
+      ci++;
+      continue;
+    }
+    auto first = readChunk(ci, txn);
+    if (!first.ok()) {
+      return first.status();
+    }
+    auto second = readChunk(ci + 1, txn);
+    if (!second.ok()) {
+      return second.status();
+    }
+    if (listElesBytes(first.value()) + listElesBytes(second.value()) >
+        LIST_CHUNK_MAX_BYTES / 2) {
+      ci++;
+      continue;
+    }
+    auto& chunk = first.value();
+    chunk.insert(chunk.end(),
+                 std::make_move_iterator(second.value().begin()),
+                 std::make_move_iterator(second.value().end()));
+    Status s = writeChunk(ci, chunk, txn);
+    if (!s.ok()) {
+      return s;
+    }
+    s = delChunk(ci + 1, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// n elements are dropped from the head or the tail, the whole groups and
+// chunks are deleted without being read
+Status QuickList::dropEnd(bool first, uint64_t n, Transaction* txn) {
+  while (n > 0) {
+    if (_groups.empty()) {
+      return {ErrorCodes::ERR_INTERNAL, "invalid list chunk group"};
+    }
+    size_t gi = first ? 0 : _groups.size() - 1;
+    if (_groups[gi].count <= n) {
+      n -= _groups[gi].count;
+      Status s = dropGroup(gi, txn);
+      if (!s.ok()) {
+        return s;
+      }
+      continue;
+    }
+    Status s = loadGroup(gi, txn);
+    if (!s.ok()) {
+      return s;
+    }
+    while (n > 0) {
+      size_t ci = first ? 0 : _chunks.size() - 1;
+      if (_chunks[ci].count <= n) {
+        n -= _chunks[ci].count;
+        s = delChunk(ci, txn);
+        if (!s.ok()) {
+          return s;
+        }
+        continue;
+      }
+      auto eles = readChunk(ci, txn);
+      if (!eles.ok()) {
+        return eles.status();
+      }
+      auto& chunk = eles.value();
+      if (first) {
+        chunk.erase(chunk.begin(), chunk.begin() + n);
+      } else {
+        chunk.resize(chunk.size() - n);
+      }
+      s = writeChunk(ci, chunk, txn);
+      if (!s.ok()) {
+        return s;
+      }
+      n = 0;
+    }
+    s = saveGroup(txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status QuickList::push(const std::vector<std::string>& vals,
+                       bool head,
+                       Transaction* txn) {
+  Status s = convertLegacy(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  if (!head && legacySize() > 0) {
+    s = pushElements(vals, txn);
+    if (!s.ok()) {
+      return s;
+    }
+    _tail += vals.size();
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  s = loadEnd(head, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  if (head) {
+    s = prepend(std::vector<std::string>(vals.rbegin(), vals.rend()), txn);
+    if (!s.ok()) {
+      return s;
+    }
+    _head -= vals.size();
+  } else {
+    s = append(std::vector<std::string>(vals), txn);
+    if (!s.ok()) {
+      return s;
+    }
+    _tail += vals.size();
+  }
+  return saveGroup(txn);
+}
+
+Expected<std::string> QuickList::pop(bool head, Transaction* txn) {
+  Status s = convertLegacy(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  INVARIANT_D(size() > 0);
+  if (!head && legacySize() > 0) {
+    auto val = popElement(txn);
+    if (val.ok()) {
+      _tail--;
+    }
+    return val;
+  }
+  if (size() == 0 || _groups.empty()) {
+    return {ErrorCodes::ERR_INTERNAL, "invalid head or tail of list"};
+  }
+  s = loadEnd(head, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  size_t ci = head ? 0 : _chunks.size() - 1;
+  auto eles = readChunk(ci, txn);
+  if (!eles.ok()) {
+    return eles.status();
+  }
+  auto& chunk = eles.value();
+  std::string val;
+  if (head) {
+    val = std::move(chunk.front());
+    chunk.erase(chunk.begin());
+  } else {
+    val = std::move(chunk.back());
+    chunk.pop_back();
+  }
+  if (!chunk.empty()) {
+    s = writeChunk(ci, chunk, txn);
+  } else {
+    s = delChunk(ci, txn);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  s = saveGroup(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  head ? _head++ : _tail--;
+  return val;
+}
+
+Expected<std::string> QuickList::index(uint64_t idx, Transaction* txn) {
+  INVARIANT_D(idx < size());
+  uint64_t chunked = size() - legacySize();
+  if (idx >= chunked) {
+    Expected<RecordValue> rv =
+      _store->getKV(elementKey(_lhead + idx - chunked), txn);
+    if (!rv.ok()) {
+      return rv.status();
+    }
+    return rv.value().getValue();
+  }
+  auto pos = loadAt(idx, txn);
+  if (!pos.ok()) {
+    return pos.status();
+  }
+  auto eles = readChunk(pos.value().first, txn);
+  if (!eles.ok()) {
+    return eles.status();
+  }
+  return std::move(eles.value()[pos.value().second]);
+}
+
+// the chunks are in the order of the list, the range is read with one
+// cursor scan from the chunk holding start, the part of it in the older
+// elements after the chunks with one batched lookup
+Expected<std::vector<std::string>> QuickList::range(uint64_t start,
+                                                    uint64_t end,
+                                                    Transaction* txn) {
+  uint64_t chunked = size() - legacySize();
+  if (end > chunked) {
+    auto eles =
+      rangeOfElements(std::max(start, chunked) - chunked, end - chunked, txn);
+    if (!eles.ok() || start >= chunked) {
+      return eles;
+    }
+    auto head = range(start, chunked, txn);
+    if (!head.ok()) {
+      return head.status();
+    }
+    auto& result = head.value();
+    result.reserve(end - start);
+    std::move(eles.value().begin(), eles.value().end(),
+              std::back_inserter(result));
+    return head;
+  }
+  std::vector<std::string> result;
+  if (start >= end) {
+    return result;
+  }
+  result.reserve(end - start);
+  auto pos = loadAt(start, txn);
+  if (!pos.ok()) {
+    return pos.status();
+  }
+  auto cursor = txn->createDataCursor(
+    end - start >= LIST_READAHEAD_MINLEN ? LIST_READAHEAD_SIZE : 0);
+  std::string prefix = eleKey("").prefixPk();
+  cursor->seek(chunkKey(_chunks[pos.value().first].id).encode());
+  uint64_t offset = pos.value().second;
+  while (result.size() < end - start) {
+    Expected<Record> exptRcd = cursor->next();
+    if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+      return {ErrorCodes::ERR_NOTFOUND, "list chunk missing"};
+    }
+    RET_IF_ERR_EXPECTED(exptRcd);
+    if (exptRcd.value().getRecordKey().prefixPk() != prefix) {
+      return {ErrorCodes::ERR_NOTFOUND, "list chunk missing"};
+    }
+    auto eles = decodeChunk(exptRcd.value().getRecordValue().getValue());
+    if (!eles.ok()) {
+      return eles.status();
+    }
+    for (uint64_t i = offset;
+         i < eles.value().size() && result.size() < end - start;
+         i++) {
+      result.emplace_back(std::move(eles.value()[i]));
+    }
+    offset = 0;
+  }
+  return result;
+}
+
+Status QuickList::set(uint64_t idx, const std::string& val, Transaction* txn) {
+  INVARIANT_D(idx < size());
+  Status s = convertLegacy(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  uint64_t chunked = size() - legacySize();
+  if (idx >= chunked) {
+    RecordValue rv(val, RecordType::RT_LIST_ELE, -1);
+    return _store->setKV(elementKey(_lhead + idx - chunked), rv, txn);
+  }
+  auto pos = loadAt(idx, txn);
+  if (!pos.ok()) {
+    return pos.status();
+  }
+  auto eles = readChunk(pos.value().first, txn);
+  if (!eles.ok()) {
+    return eles.status();
+  }
+  eles.value()[pos.value().second] = val;
+  auto n = rewriteChunk(pos.value().first, std::move(eles.value()), txn);
+  if (!n.ok()) {
+    return n.status();
+  }
+  return saveGroup(txn);
+}
+
+// the groups are rewritten one by one, the chunks in each of them as the
+// chunks of a list. the older elements after the chunks are the last ones
+// searched from the head and the first ones from the tail.
+Expected<uint64_t> QuickList::remove(const std::string& val,
+                                     uint64_t count,
+                                     bool fromHead,
+                                     Transaction* txn) {
+  Status s = convertLegacy(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  uint64_t removed = 0;
+  auto more = [&removed, count]() { return count == 0 || removed < count; };
+  auto removeLegacy = [&]() -> Status {
+    if (legacySize() == 0 || !more()) {
+      return {ErrorCodes::ERR_OK, ""};
+    }
+    auto n = removeElements(val, count == 0 ? 0 : count - removed, fromHead,
+                            txn);
+    if (!n.ok()) {
+      return n.status();
+    }
+    removed += n.value();
+    return {ErrorCodes::ERR_OK, ""};
+  };
+  if (!fromHead) {
+    s = removeLegacy();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  size_t gi = fromHead ? 0 : _groups.size();
+  while (more() && (fromHead ? gi < _groups.size() : gi > 0)) {
+    if (!fromHead) {
+      gi--;
+    }
+    s = loadGroup(gi, txn);
+    if (!s.ok()) {
+      return s;
+    }
+    uint64_t before = removed;
+    size_t ci = fromHead ? 0 : _chunks.size();
+    while (more() && (fromHead ? ci < _chunks.size() : ci > 0)) {
+      if (!fromHead) {
+        ci--;
+      }
+      auto eles = readChunk(ci, txn);
+      if (!eles.ok()) {
+        return eles.status();
+      }
+      auto& chunk = eles.value();
+      std::vector<std::string> kept;
+      kept.reserve(chunk.size());
+      if (fromHead) {
+        for (auto& e : chunk) {
+          if (e == val && more()) {
+            removed++;
+          } else {
+            kept.emplace_back(std::move(e));
+          }
+        }
+      } else {
+        for (auto it = chunk.rbegin(); it != chunk.rend(); ++it) {
+          if (*it == val && more()) {
+            removed++;
+          } else {
+            kept.emplace_back(std::move(*it));
+          }
+        }
+        std::reverse(kept.begin(), kept.end());
+      }
+      if (kept.size() == chunk.size()) {
+        if (fromHead) {
+          ci++;
+        }
+        continue;
+      }
+      // the chunks before ci are not moved
+      auto n = rewriteChunk(ci, std::move(kept), txn);
+      if (!n.ok()) {
+        return n.status();
+      }
+      if (fromHead) {
+        ci += n.value();
+      }
+    }
+    if (removed == before) {
+      if (fromHead) {
+        gi++;
+      }
+      continue;
+    }
+    s = mergeSmall(txn);
+    if (!s.ok()) {
+      return s;
+    }
+    size_t groups = _groups.size();
+    s = saveGroup(txn);
+    if (!s.ok()) {
+      return s;
+    }
+    if (fromHead && _groups.size() == groups) {
+      gi++;
+    }
+  }
+  if (fromHead) {
+    s = removeLegacy();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (removed == 0) {
+    return removed;
+  }
+  _tail -= removed;
+  s = mergeGroups(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  return removed;
+}
+
+Expected<bool> QuickList::insert(const std::string& pivot,
+                                 const std::string& val,
+                                 bool after,
+                                 Transaction* txn) {
+  Status s = convertLegacy(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  for (size_t gi = 0; gi < _groups.size(); gi++) {
+    s = loadGroup(gi, txn);
+    if (!s.ok()) {
+      return s;
+    }
+    for (size_t ci = 0; ci < _chunks.size(); ci++) {
+      auto eles = readChunk(ci, txn);
+      if (!eles.ok()) {
+        return eles.status();
+      }
+      auto& chunk = eles.value();
+      auto it = std::find(chunk.begin(), chunk.end(), pivot);
+      if (it == chunk.end()) {
+        continue;
+      }
+      chunk.insert(after ? it + 1 : it, val);
+      auto n = rewriteChunk(ci, std::move(chunk), txn);
+      if (!n.ok()) {
+        return n.status();
+      }
+      s = saveGroup(txn);
+      if (!s.ok()) {
+        return s;
+      }
+      _tail++;
+      return true;
+    }
+  }
+  auto inserted = insertElement(pivot, val, after, txn);
+  if (inserted.ok() && inserted.value()) {
+    _tail++;
+  }
+  return inserted;
+}
+
+Status QuickList::trim(uint64_t start, uint64_t end, Transaction* txn) {
+  Status s = convertLegacy(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  uint64_t len = size();
+  end = std::min(end, len);
+  if (start >= end) {
+    start = end = len;
+  }
+  uint64_t chunked = len - legacySize();
+  s = trimElements(std::max(start, chunked) - chunked,
+                   std::max(end, chunked) - chunked, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  s = dropEnd(true, std::min(start, chunked), txn);
+  if (!s.ok()) {
+    return s;
+  }
+  s = dropEnd(false, chunked - std::min(end, chunked), txn);
+  if (!s.ok()) {
+    return s;
+  }
+  _head += start;
+  _tail -= len - end;
+
+  // the end chunks are merged with their neighbours if they are small
+  for (bool first : {true, false}) {
+    if (_groups.empty()) {
+      break;
+    }
+    s = loadEnd(first, txn);
+    if (!s.ok()) {
+      return s;
+    }
+    size_t chunks = _chunks.size();
+    s = mergeSmall(txn);
+    if (!s.ok()) {
+      return s;
+    }
+    if (_chunks.size() != chunks) {
+      s = saveGroup(txn);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+  }
+  return mergeGroups(txn);
+}
+
+Status QuickList::save(Transaction* txn,
+                       const Expected<RecordValue>& oldValue,
+                       uint64_t versionEP) {
+  RecordKey rk(_chunkId, _dbId, RecordType::RT_LIST_META, _pk, "");
+  ListMetaValue lm = getMeta();
+  uint64_t ttl = oldValue.ok() ? oldValue.value().getTtl() : 0;
+  RecordValue rv(
+    lm.encode(), RecordType::RT_LIST_META, versionEP, ttl, oldValue);
+  return _store->setKV(rk, rv, txn);
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,177 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_QUICKLIST_H_
+#define SRC_TENDISPLUS_STORAGE_QUICKLIST_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "tendisplus/storage/record.h"
+#include "tendisplus/storage/kvstore.h"
+
+namespace tendisplus {
+
+// a chunk holds up to LIST_CHUNK_MAX_ELES elements, and no more than
+// LIST_CHUNK_MAX_BYTES bytes unless it has only one element
+constexpr uint32_t LIST_CHUNK_MAX_ELES = 128;
+constexpr size_t LIST_CHUNK_MAX_BYTES = 8192;
+// a group record counts up to LIST_GROUP_MAX_CHUNKS chunks
+constexpr uint32_t LIST_GROUP_MAX_CHUNKS = 128;
+// a write converts the elements of the older format all at once if there
+// are no more than LIST_CONVERT_MAX_ELES of them, or LIST_CONVERT_BATCH
+// of them otherwise
+constexpr uint64_t LIST_CONVERT_MAX_ELES = 8192;
+constexpr uint64_t LIST_CONVERT_BATCH = 1024;
+
+struct ListChunk {
+  uint64_t id;
+  uint32_t count;
+};
+
+// QuickList is the LKF_CHUNKED layout of a list, like the quicklist of
+// redis. The elements are packed into chunk records, the chunk ids ascend
+// in the order of the list, so a range of the elements is one cursor scan.
+// The ids and the element counts of the chunks are kept in group records,
+// each of them counting up to LIST_GROUP_MAX_CHUNKS chunks in a row, and
+// the meta keeps the element counts of the groups. An element is found by
+// walking the groups of the meta, and then the chunks of one group record,
+// it takes two reads wherever it is. A write rewrites only the chunks and
+// the groups it touches, a chunk or a group is split when it grows beyond
+// the limits, and merged with its neighbour when they shrink.
+// The lists of the older format are read as they are, and converted by
+// the writes. A write moves a batch of the elements from the head of the
+// older records to the tail chunks before it's done, so a long list is
+// converted in many transactions rather than a big one. Until then the
+// list is the chunks followed by the older records, and a write to the
+// older part is done in the older format.
+class QuickList {
+ public:
+  QuickList(uint32_t chunkId,
+            uint32_t dbId,
+            const std::string& pk,
+            const ListMetaValue& meta,
+            PStore store);
+
+  // vals are pushed one by one, LPUSH a b c makes c b a
+  Status push(const std::vector<std::string>& vals,
+              bool head,
+              Transaction* txn);
+  Expected<std::string> pop(bool head, Transaction* txn);
+  // the 0-based idx should be in [0, size())
+  Expected<std::string> index(uint64_t idx, Transaction* txn);
+  // the elements in [start, end)
+  Expected<std::vector<std::string>> range(uint64_t start,
+                                           uint64_t end,
+                                           Transaction* txn);
+  Status set(uint64_t idx, const std::string& val, Transaction* txn);
+  // remove count(0 for all) elements equal to val, from the head or the
+  // tail, the number of the removed ones is returned
+  Expected<uint64_t> remove(const std::string& val,
+                            uint64_t count,
+                            bool fromHead,
+                            Transaction* txn);
+  // false if there is no pivot
+  Expected<bool> insert(const std::string& pivot,
+                        const std::string& val,
+                        bool after,
+                        Transaction* txn);
+  // keep the elements in [start, end) only
+  Status trim(uint64_t start, uint64_t end, Transaction* txn);
+
+  // an empty list should be deleted instead
+  Status save(Transaction* txn,
+              const Expected<RecordValue>& oldValue,
+              uint64_t versionEP);
+
+  uint64_t size() const;
+  ListKeyFormat getKeyFormat() const;
+  ListMetaValue getMeta() const;
+  // all the chunks in the order of the list, read from the group records
+  Expected<std::vector<ListChunk>> getChunks(Transaction* txn) const;
+
+  static std::string encodeChunk(const std::vector<std::string>& eles);
+  static Expected<std::vector<std::string>> decodeChunk(
+    const std::string& val);
+  // the number of the elements, without copying them
+  static Expected<uint32_t> countChunk(const std::string& val);
+  // if the secondary key is of a chunk record, or of a group record
+  static bool isChunkKey(const std::string& sk);
+  static bool isGroupKey(const std::string& sk);
+  // the chunk id of the secondary key of a chunk record
+  static Expected<uint64_t> decodeChunkId(const std::string& sk);
+
+ private:
+  RecordKey eleKey(const std::string& sk) const;
+  RecordKey chunkKey(uint64_t id) const;
+  RecordKey groupKey(uint64_t id) const;
+  Expected<std::vector<ListChunk>> readGroup(uint64_t id,
+                                             Transaction* txn) const;
+  Status writeGroup(size_t gi,
+                    const std::vector<ListChunk>& chunks,
+                    Transaction* txn);
+  Status loadGroup(size_t gi, Transaction* txn);
+  Status loadEnd(bool first, Transaction* txn);
+  Status saveGroup(Transaction* txn);
+  uint64_t allocGroupId() const;
+  Status dropGroup(size_t gi, Transaction* txn);
+  Status mergeGroups(Transaction* txn);
+  Expected<std::pair<size_t, uint64_t>> loadAt(uint64_t idx,
+                                               Transaction* txn);
+  uint64_t legacySize() const;
+  Status convertLegacy(Transaction* txn);
+  RecordKey elementKey(uint64_t idx) const;
+  Expected<std::vector<std::string>> rangeOfElements(uint64_t start,
+                                                     uint64_t end,
+                                                     Transaction* txn);
+  Status shiftElements(uint64_t from,
+                       uint64_t to,
+                       int64_t delta,
+                       Transaction* txn);
+  Status pushElements(const std::vector<std::string>& vals,
+                      Transaction* txn);
+  Expected<std::string> popElement(Transaction* txn);
+  Expected<uint64_t> removeElements(const std::string& val,
+                                    uint64_t count,
+                                    bool fromHead,
+                                    Transaction* txn);
+  Expected<bool> insertElement(const std::string& pivot,
+                               const std::string& val,
+                               bool after,
+                               Transaction* txn);
+  Status trimElements(uint64_t start, uint64_t end, Transaction* txn);
+  Expected<std::vector<std::string>> readChunk(size_t ci, Transaction* txn);
+  Status writeChunk(size_t ci,
+                    const std::vector<std::string>& eles,
+                    Transaction* txn);
+  Status delChunk(size_t ci, Transaction* txn);
+  Expected<size_t> rewriteChunk(size_t ci,
+                                std::vector<std::string>&& eles,
+                                Transaction* txn);
+  Status append(std::vector<std::string>&& eles, Transaction* txn);
+  Status prepend(std::vector<std::string>&& eles, Transaction* txn);
+  Expected<uint64_t> allocId(size_t pos, Transaction* txn);
+  Status respace(Transaction* txn);
+  Status mergeSmall(Transaction* txn);
+  Status dropEnd(bool first, uint64_t n, Transaction* txn);
+
+  uint32_t _chunkId;
+  uint32_t _dbId;
+  std::string _pk;
+  PStore _store;
+  uint64_t _head;
+  uint64_t _tail;
+  ListKeyFormat _fmt;
+  // the decimal keys of the elements of the older format, after the chunks
+  uint64_t _lhead;
+  uint64_t _ltail;
+  std::vector<ListChunkGroup> _groups;
+  // the chunks of the group _gi being read or written
+  size_t _gi;
+  std::vector<ListChunk> _chunks;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_QUICKLIST_H_
@@ -0,0 +1,488 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <fstream>
+#include <deque>
+#include <utility>
+#include <algorithm>
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+#include "tendisplus/utils/status.h"
+#include "tendisplus/utils/scopeguard.h"
+#include "tendisplus/utils/portable.h"
+#include "tendisplus/storage/quicklist.h"
+#include "tendisplus/storage/kvstore.h"
+#include "tendisplus/storage/rocks/rocks_kvstore.h"
+#include "tendisplus/server/server_params.h"
+
+namespace tendisplus {
+
+std::shared_ptr<ServerParams> genParams() {
+  srand(time(0));
+  const auto guard = MakeGuard([] { remove("a.cfg"); });
+  std::ofstream myfile;
+  myfile.open("a.cfg");
+  myfile << "bind 127.0.0.1\n";
+  myfile << "port 8903\n";
+  myfile << "loglevel debug\n";
+  myfile << "logdir ./log\n";
+  myfile << "storage rocks\n";
+  myfile << "dir ./db\n";
+  myfile << "rocks.blockcachemb 64\n";
+  myfile.close();
+  auto cfg = std::make_shared<ServerParams>();
+  auto s = cfg->parseFile("a.cfg");
+  EXPECT_EQ(s.ok(), true) << s.toString();
+  return cfg;
+}
+
+void checkList(QuickList* ql,
+               const std::deque<std::string>& expect,
+               Transaction* txn,
+               const std::string& pk = "test") {
+  EXPECT_EQ(ql->size(), expect.size());
+  // the chunks hold the elements but the older ones after them
+  auto meta = ql->getMeta();
+  uint64_t legacy = meta.getLegacyTail() - meta.getLegacyHead();
+  EXPECT_LE(legacy, expect.size());
+  auto chunks = ql->getChunks(txn);
+  EXPECT_TRUE(chunks.ok());
+  uint64_t total = 0;
+  for (auto& c : chunks.value()) {
+    EXPECT_GT(c.count, 0U);
+    EXPECT_LE(c.count, LIST_CHUNK_MAX_ELES);
+    total += c.count;
+  }
+  if (ql->getKeyFormat() == ListKeyFormat::LKF_CHUNKED) {
+    EXPECT_EQ(total, expect.size() - legacy);
+  } else {
+    EXPECT_EQ(total, 0U);
+  }
+  for (size_t i = 1; i < chunks.value().size(); i++) {
+    EXPECT_LT(chunks.value()[i - 1].id, chunks.value()[i].id);
+  }
+  // the groups of the meta count all the chunks
+  uint64_t grouped = 0;
+  size_t groupedChunks = 0;
+  for (auto& g : meta.getGroups()) {
+    EXPECT_GT(g.chunks, 0U);
+    EXPECT_LE(g.chunks, LIST_GROUP_MAX_CHUNKS);
+    grouped += g.count;
+    groupedChunks += g.chunks;
+  }
+  EXPECT_EQ(grouped, total);
+  EXPECT_EQ(groupedChunks, chunks.value().size());
+  // and no record is left behind
+  size_t chunkRcds = 0;
+  size_t groupRcds = 0;
+  size_t legacyRcds = 0;
+  auto cursor = txn->createDataCursor();
+  std::string prefix =
+    RecordKey(0, 0, RecordType::RT_LIST_ELE, pk, "").prefixPk();
+  cursor->seek(prefix);
+  while (true) {
+    auto exptRcd = cursor->next();
+    if (!exptRcd.ok() ||
+        exptRcd.value().getRecordKey().prefixPk() != prefix) {
+      break;
+    }
+    const std::string& sk = exptRcd.value().getRecordKey().getSecondaryKey();
+    if (QuickList::isChunkKey(sk)) {
+      chunkRcds++;
+    } else if (QuickList::isGroupKey(sk)) {
+      groupRcds++;
+    } else {
+      legacyRcds++;
+    }
+  }
+  EXPECT_EQ(chunkRcds, chunks.value().size());
+  EXPECT_EQ(groupRcds, meta.getGroups().size());
+  EXPECT_EQ(legacyRcds, legacy);
+  auto eles = ql->range(0, ql->size(), txn);
+  EXPECT_TRUE(eles.ok());
+  EXPECT_TRUE(std::equal(
+    eles.value().begin(), eles.value().end(), expect.begin(), expect.end()));
+  if (!expect.empty()) {
+    uint64_t idx = rand() % expect.size();
+    auto v = ql->index(idx, txn);
+    EXPECT_TRUE(v.ok());
+    EXPECT_EQ(v.value(), expect[idx]);
+  }
+}
+
+TEST(QuickList, Common) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+
+  ListMetaValue meta(1ULL << 40, 1ULL << 40);
+  QuickList ql(0, 0, "test", meta, store);
+  std::deque<std::string> expect;
+
+  for (uint32_t i = 0; i < 1000; i++) {
+    std::string val = std::to_string(rand() % 50);
+    if (i % 3 == 0) {
+      EXPECT_TRUE(ql.push({val}, true, txn).ok());
+      expect.push_front(val);
+    } else {
+      EXPECT_TRUE(ql.push({val}, false, txn).ok());
+      expect.push_back(val);
+    }
+  }
+  checkList(&ql, expect, txn);
+  EXPECT_GT(ql.getChunks(txn).value().size(), 1000 / LIST_CHUNK_MAX_ELES);
+
+  // a list loaded from the meta finds the middle chunks by the counts
+  {
+    auto lm = ListMetaValue::decode(ql.getMeta().encode());
+    EXPECT_TRUE(lm.ok());
+    QuickList loaded(0, 0, "test", lm.value(), store);
+    checkList(&loaded, expect, txn);
+    for (uint64_t i = 0; i < expect.size(); i += 97) {
+      auto v = loaded.index(i, txn);
+      EXPECT_TRUE(v.ok());
+      EXPECT_EQ(v.value(), expect[i]);
+    }
+    auto eles = loaded.range(300, 700, txn);
+    EXPECT_TRUE(eles.ok());
+    EXPECT_TRUE(std::equal(eles.value().begin(),
+                           eles.value().end(),
+                           expect.begin() + 300,
+                           expect.begin() + 700));
+  }
+
+  // inserted in the middle of a full chunk, which is split
+  auto found = ql.insert(expect[500], "pivot", true, txn);
+  EXPECT_TRUE(found.ok() && found.value());
+  auto it = std::find(expect.begin(), expect.end(), expect[500]);
+  expect.insert(it + 1, "pivot");
+  checkList(&ql, expect, txn);
+  found = ql.insert("nosuchpivot", "x", false, txn);
+  EXPECT_TRUE(found.ok() && !found.value());
+
+  // remove from the tail, then all from the head, the small chunks left
+  // are merged
+  auto removed = ql.remove("7", 3, false, txn);
+  EXPECT_TRUE(removed.ok());
+  uint64_t cnt = 0;
+  for (auto rit = expect.rbegin(); rit != expect.rend() && cnt < 3;) {
+    if (*rit == "7") {
+      rit = decltype(rit)(expect.erase(std::next(rit).base()));
+      cnt++;
+    } else {
+      ++rit;
+    }
+  }
+  EXPECT_EQ(removed.value(), cnt);
+  checkList(&ql, expect, txn);
+  for (uint32_t i = 0; i < 40; i++) {
+    std::string val = std::to_string(i);
+    removed = ql.remove(val, 0, true, txn);
+    EXPECT_TRUE(removed.ok());
+    expect.erase(std::remove(expect.begin(), expect.end(), val),
+                 expect.end());
+  }
+  checkList(&ql, expect, txn);
+  auto chunks = ql.getChunks(txn);
+  EXPECT_TRUE(chunks.ok());
+  for (size_t i = 1; i < chunks.value().size(); i++) {
+    EXPECT_GT(chunks.value()[i - 1].count + chunks.value()[i].count,
+              LIST_CHUNK_MAX_ELES / 2);
+  }
+
+  EXPECT_TRUE(ql.trim(3, expect.size() - 5, txn).ok());
+  expect.erase(expect.end() - 5, expect.end());
+  expect.erase(expect.begin(), expect.begin() + 3);
+  checkList(&ql, expect, txn);
+
+  // a big element splits the chunk
+  uint64_t idx = expect.size() / 2;
+  EXPECT_TRUE(ql.set(idx, std::string(LIST_CHUNK_MAX_BYTES, 'a'), txn).ok());
+  expect[idx] = std::string(LIST_CHUNK_MAX_BYTES, 'a');
+  checkList(&ql, expect, txn);
+
+  while (!expect.empty()) {
+    bool head = rand() % 2;
+    auto v = ql.pop(head, txn);
+    EXPECT_TRUE(v.ok());
+    EXPECT_EQ(v.value(), head ? expect.front() : expect.back());
+    head ? expect.pop_front() : expect.pop_back();
+  }
+  checkList(&ql, expect, txn);
+  EXPECT_EQ(ql.getChunks(txn).value().size(), 0U);
+}
+
+TEST(QuickList, Respace) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+
+  ListMetaValue meta(1ULL << 40, 1ULL << 40);
+  QuickList ql(0, 0, "test", meta, store);
+  std::deque<std::string> expect;
+  std::vector<std::string> vals;
+  for (uint32_t i = 0; i < 2 * LIST_CHUNK_MAX_ELES; i++) {
+    vals.emplace_back(std::to_string(i));
+  }
+  EXPECT_TRUE(ql.push(vals, false, txn).ok());
+  expect.insert(expect.end(), vals.begin(), vals.end());
+  EXPECT_EQ(ql.getChunks(txn).value().size(), 2U);
+
+  // every split takes the middle of the gap after the first chunk, until
+  // the chunks are respaced
+  std::string big(LIST_CHUNK_MAX_BYTES / 2, 'b');
+  for (uint32_t i = 0; i < 40; i++) {
+    EXPECT_TRUE(ql.set(0, big + std::to_string(i), txn).ok());
+    expect[0] = big + std::to_string(i);
+    EXPECT_TRUE(ql.insert(expect[0], big, true, txn).ok());
+    expect.insert(expect.begin() + 1, big);
+    checkList(&ql, expect, txn);
+  }
+}
+
+// the groups are split as the list grows, and dropped or merged as it
+// shrinks
+TEST(QuickList, Groups) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+
+  ListMetaValue meta(1ULL << 40, 1ULL << 40);
+  QuickList ql(0, 0, "test", meta, store);
+  std::deque<std::string> expect;
+  uint64_t groupEles = LIST_GROUP_MAX_CHUNKS * LIST_CHUNK_MAX_ELES;
+  std::vector<std::string> vals;
+  for (uint64_t i = 0; i < 3 * groupEles + 1000; i++) {
+    vals.emplace_back(std::to_string(i % 10));
+  }
+  EXPECT_TRUE(ql.push(vals, false, txn).ok());
+  expect.insert(expect.end(), vals.begin(), vals.end());
+  for (uint32_t i = 0; i < 2000; i++) {
+    EXPECT_TRUE(ql.push({std::to_string(i % 10)}, true, txn).ok());
+    expect.push_front(std::to_string(i % 10));
+  }
+  checkList(&ql, expect, txn);
+  EXPECT_GE(ql.getMeta().getGroups().size(), 4U);
+
+  // a list loaded from the meta reads a group and a chunk for an element
+  {
+    auto lm = ListMetaValue::decode(ql.getMeta().encode());
+    EXPECT_TRUE(lm.ok());
+    QuickList loaded(0, 0, "test", lm.value(), store);
+    for (uint64_t i = 0; i < expect.size(); i += 4999) {
+      auto v = loaded.index(i, txn);
+      EXPECT_TRUE(v.ok());
+      EXPECT_EQ(v.value(), expect[i]);
+    }
+    uint64_t mid = expect.size() / 2;
+    auto eles = loaded.range(mid, mid + 300, txn);
+    EXPECT_TRUE(eles.ok());
+    EXPECT_TRUE(std::equal(eles.value().begin(),
+                           eles.value().end(),
+                           expect.begin() + mid,
+                           expect.begin() + mid + 300));
+  }
+  uint64_t idx = expect.size() / 2;
+  EXPECT_TRUE(ql.set(idx, "x", txn).ok());
+  expect[idx] = "x";
+  checkList(&ql, expect, txn);
+
+  // the groups out of the range are dropped as a whole
+  EXPECT_TRUE(ql.trim(groupEles + 10, expect.size() - 5000, txn).ok());
+  expect.erase(expect.end() - 5000, expect.end());
+  expect.erase(expect.begin(), expect.begin() + groupEles + 10);
+  checkList(&ql, expect, txn);
+
+  // the chunks shrink, and so do the groups
+  size_t groups = ql.getMeta().getGroups().size();
+  for (uint32_t i = 0; i < 9; i++) {
+    std::string val = std::to_string(i);
+    auto removed = ql.remove(val, 0, i % 2, txn);
+    EXPECT_TRUE(removed.ok());
+    expect.erase(std::remove(expect.begin(), expect.end(), val),
+                 expect.end());
+  }
+  checkList(&ql, expect, txn);
+  EXPECT_LT(ql.getMeta().getGroups().size(), groups);
+
+  EXPECT_TRUE(ql.trim(1, 0, txn).ok());
+  expect.clear();
+  checkList(&ql, expect, txn);
+}
+
+// the shorter lists of the older format are converted by the first write,
+// the longer ones a batch per write, the rest of them stays in the older
+// records after the chunks
+TEST(QuickList, OldFormat) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+
+  uint64_t head = 1ULL << 40;
+  auto writeOldList = [&](const std::string& pk, uint64_t len) {
+    std::deque<std::string> eles;
+    for (uint64_t i = 0; i < len; i++) {
+      eles.push_back(std::to_string(i % 100));
+      RecordKey rk(
+        0, 0, RecordType::RT_LIST_ELE, pk, std::to_string(head + i));
+      RecordValue rv(eles.back(), RecordType::RT_LIST_ELE, -1);
+      EXPECT_TRUE(store->setKV(rk, rv, txn).ok());
+    }
+    return eles;
+  };
+
+  std::string pk = "shortlist";
+  std::deque<std::string> expect = writeOldList(pk, 100);
+  {
+    ListMetaValue meta(head, head + expect.size(), ListKeyFormat::LKF_DECIMAL);
+    QuickList ql(0, 0, pk, meta, store);
+    checkList(&ql, expect, txn, pk);
+    EXPECT_TRUE(ql.push({"a"}, false, txn).ok());
+    expect.push_back("a");
+    EXPECT_EQ(ql.getKeyFormat(), ListKeyFormat::LKF_CHUNKED);
+    EXPECT_EQ(ql.getMeta().getLegacyHead(), ql.getMeta().getLegacyTail());
+    checkList(&ql, expect, txn, pk);
+  }
+
+  pk = "oldlist";
+  uint64_t len = LIST_CONVERT_MAX_ELES + 16 * LIST_CONVERT_BATCH;
+  expect = writeOldList(pk, len);
+  ListMetaValue meta(head, head + len, ListKeyFormat::LKF_DECIMAL);
+  QuickList ql(0, 0, pk, meta, store);
+  uint64_t legacy = len;
+  auto check = [&]() {
+    EXPECT_EQ(ql.getKeyFormat(), ListKeyFormat::LKF_CHUNKED);
+    auto lm = ql.getMeta();
+    uint64_t left = lm.getLegacyTail() - lm.getLegacyHead();
+    EXPECT_GT(left, 0U);
+    EXPECT_LT(left, legacy);
+    legacy = left;
+    checkList(&ql, expect, txn, pk);
+
+    // read across the last chunk and the first older element
+    auto expLm = ListMetaValue::decode(lm.encode());
+    EXPECT_TRUE(expLm.ok());
+    QuickList loaded(0, 0, pk, expLm.value(), store);
+    uint64_t chunked = expect.size() - legacy;
+    auto eles = loaded.range(chunked - 5, chunked + 5, txn);
+    EXPECT_TRUE(eles.ok());
+    EXPECT_TRUE(std::equal(eles.value().begin(),
+                           eles.value().end(),
+                           expect.begin() + chunked - 5,
+                           expect.begin() + chunked + 5));
+    for (uint64_t i : {chunked - 1, chunked}) {
+      auto v = loaded.index(i, txn);
+      EXPECT_TRUE(v.ok());
+      EXPECT_EQ(v.value(), expect[i]);
+    }
+  };
+
+  EXPECT_TRUE(ql.push({"a", "b"}, true, txn).ok());
+  expect.push_front("a");
+  expect.push_front("b");
+  EXPECT_TRUE(ql.push({"c"}, false, txn).ok());
+  expect.push_back("c");
+  auto v = ql.pop(true, txn);
+  EXPECT_TRUE(v.ok());
+  EXPECT_EQ(v.value(), "b");
+  expect.pop_front();
+  v = ql.pop(false, txn);
+  EXPECT_TRUE(v.ok());
+  EXPECT_EQ(v.value(), "c");
+  expect.pop_back();
+  check();
+
+  // in the chunks, and in the older records
+  EXPECT_TRUE(ql.set(3, "d", txn).ok());
+  expect[3] = "d";
+  EXPECT_TRUE(ql.set(expect.size() - 2, "e", txn).ok());
+  expect[expect.size() - 2] = "e";
+  check();
+
+  // near the tail, the older elements after it are moved
+  auto found = ql.insert("e", "f", false, txn);
+  EXPECT_TRUE(found.ok() && found.value());
+  expect.insert(expect.end() - 2, "f");
+  // in the chunks
+  found = ql.insert("99", "g", true, txn);
+  EXPECT_TRUE(found.ok() && found.value());
+  expect.insert(std::find(expect.begin(), expect.end(), "99") + 1, "g");
+  found = ql.insert("nosuchpivot", "x", false, txn);
+  EXPECT_TRUE(found.ok() && !found.value());
+  check();
+
+  // the older elements are searched first from the tail, and last from
+  // the head
+  auto removed = ql.remove("7", 3, false, txn);
+  EXPECT_TRUE(removed.ok());
+  EXPECT_EQ(removed.value(), 3U);
+  for (int i = 0; i < 3; i++) {
+    auto rit = std::find(expect.rbegin(), expect.rend(), "7");
+    expect.erase(std::next(rit).base());
+  }
+  removed = ql.remove("8", 0, true, txn);
+  EXPECT_TRUE(removed.ok());
+  auto n = std::count(expect.begin(), expect.end(), "8");
+  EXPECT_EQ(removed.value(), static_cast<uint64_t>(n));
+  expect.erase(std::remove(expect.begin(), expect.end(), "8"),
+               expect.end());
+  check();
+
+  EXPECT_TRUE(ql.trim(2, expect.size() - 3, txn).ok());
+  expect.erase(expect.end() - 3, expect.end());
+  expect.erase(expect.begin(), expect.begin() + 2);
+  check();
+
+  // and converted fully by the later writes
+  for (int i = 0; i < 20 && legacy > 0; i++) {
+    EXPECT_TRUE(ql.push({"h"}, false, txn).ok());
+    expect.push_back("h");
+    auto lm = ql.getMeta();
+    legacy = lm.getLegacyTail() - lm.getLegacyHead();
+  }
+  EXPECT_EQ(legacy, 0U);
+  checkList(&ql, expect, txn, pk);
+}
+
+}  // namespace tendisplus
@@ -2,6 +2,7 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <cstring>
 #include <type_traits>
 #include <utility>
 #include <memory>
@@ -27,6 +28,7 @@ bool isDataMetaType(RecordType t) {
     case RecordType::RT_LIST_META:
     case RecordType::RT_ZSET_META:
     case RecordType::RT_SET_META:
+    case RecordType::RT_STREAM_META:
     case RecordType::RT_KV:
       return true;
     // case RecordType::RT_INVALID:
@@ -60,6 +62,9 @@ bool isRealEleType(RecordType keyType, RecordType valueType) {
         return true;
       }
     case RecordType::RT_ZSET_S_ELE:
+    case RecordType::RT_ZSET_I_ELE:
+    case RecordType::RT_STREAM_ELE:
+    case RecordType::RT_STREAM_CG:
     case RecordType::RT_BINLOG:
     case RecordType::RT_TTL_INDEX:
     case RecordType::RT_META:  // For ts/revision
@@ -97,6 +102,14 @@ uint8_t rt2Char(RecordType t) {
       return 'c';
     case RecordType::RT_ZSET_S_ELE:
       return 'z';
+    case RecordType::RT_ZSET_I_ELE:
+      return 'i';
+    case RecordType::RT_STREAM_META:
+      return 'X';
+    case RecordType::RT_STREAM_ELE:
+      return 'x';
+    case RecordType::RT_STREAM_CG:
+      return 'g';
     case RecordType::RT_TTL_INDEX:
       return std::numeric_limits<uint8_t>::max() - 1;
     // it's convinent (for seek) to have BINLOG to pos
@@ -134,7 +147,13 @@ std::string rt2Str(RecordType t) {
     case RecordType::RT_ZSET_META:
     case RecordType::RT_ZSET_H_ELE:
     case RecordType::RT_ZSET_S_ELE:
+    case RecordType::RT_ZSET_I_ELE:
       return "ZSET";
+
+    case RecordType::RT_STREAM_META:
+    case RecordType::RT_STREAM_ELE:
+    case RecordType::RT_STREAM_CG:
+      return "STREAM";
     default:
       INVARIANT_D(0);
       LOG(ERROR) << "invalid recordtype:" << static_cast<uint32_t>(t);
@@ -168,6 +187,14 @@ RecordType char2Rt(uint8_t t) {
       return RecordType::RT_ZSET_S_ELE;
     case 'c':
       return RecordType::RT_ZSET_H_ELE;
+    case 'i':
+      return RecordType::RT_ZSET_I_ELE;
+    case 'X':
+      return RecordType::RT_STREAM_META;
+    case 'x':
+      return RecordType::RT_STREAM_ELE;
+    case 'g':
+      return RecordType::RT_STREAM_CG;
     case std::numeric_limits<uint8_t>::max() - 1:
       return RecordType::RT_TTL_INDEX;
     case std::numeric_limits<uint8_t>::max():
@@ -1090,6 +1117,116 @@ std::string Record::toString() const {
   return ss.str();
 }
 
+RecordKeyView::RecordKeyView() : _pkLen(0), _skOffset(0), _skLen(0) {}
+
+// the same layout as RecordKey::decode()
+Expected<RecordKeyView> RecordKeyView::decode(mystring_view key) {
+  constexpr size_t rsvd = sizeof(RecordKey::TRSV);
+  const size_t offset = RecordKey::getHdrSize();
+  if (key.size() < RecordKey::minSize()) {
+    return {ErrorCodes::ERR_DECODE, "invalid recordkey"};
+  }
+  const uint8_t* keyCstr = reinterpret_cast<const uint8_t*>(key.data());
+
+  // pklen is stored in the reverse order
+  auto expt = varintDecodeRvs(keyCstr + key.size() - rsvd - 1,
+                              key.size() - rsvd - offset);
+  if (!expt.ok()) {
+    return expt.status();
+  }
+  size_t rvsOffset = expt.value().second;
+  size_t pkLen = expt.value().first;
+  // here -1 for the padding 0 after pk
+  if (key.size() < offset + rsvd + rvsOffset + pkLen + 1) {
+    return {ErrorCodes::ERR_DECODE, "invalid sk len"};
+  }
+
+  size_t left = key.size() - offset - rsvd - rvsOffset - pkLen - 1;
+  auto v = varintDecodeFwd(keyCstr + offset + pkLen + 1, left);
+  if (!v.ok()) {
+    return {ErrorCodes::ERR_DECODE, "invalid version len"};
+  }
+
+  RecordKeyView view;
+  view._key = key;
+  view._pkLen = pkLen;
+  view._skOffset = offset + pkLen + 1 + v.value().second;
+  view._skLen = left - v.value().second;
+  return view;
+}
+
+uint32_t RecordKeyView::getChunkId() const {
+  return int32Decode(_key.data() + RecordKey::CHUNKID_OFFSET);
+}
+
+uint32_t RecordKeyView::getDbId() const {
+  return int32Decode(_key.data() + RecordKey::DBID_OFFSET);
+}
+
+RecordType RecordKeyView::getRecordType() const {
+  return RecordKey::decodeType(_key.data(), _key.size());
+}
+
+mystring_view RecordKeyView::getPrimaryKey() const {
+  return _key.substr(RecordKey::PK_OFFSET, _pkLen);
+}
+
+mystring_view RecordKeyView::getSecondaryKey() const {
+  return _key.substr(_skOffset, _skLen);
+}
+
+mystring_view RecordKeyView::encode() const {
+  return _key;
+}
+
+Expected<RecordKey> RecordKeyView::toRecordKey() const {
+  return RecordKey::decode(std::string(_key.data(), _key.size()));
+}
+
+RecordValueView::RecordValueView() {}
+
+Expected<RecordValueView> RecordValueView::decode(mystring_view value) {
+  if (value.size() < RecordValue::minSize()) {
+    return {ErrorCodes::ERR_DECODE, "too small RecordValue"};
+  }
+  RecordValueView view;
+  view._value = value;
+  return view;
+}
+
+RecordType RecordValueView::getRecordType() const {
+  return RecordValue::decodeType(_value.data(), _value.size());
+}
+
+Expected<mystring_view> RecordValueView::getValue() const {
+  // the header of the other types is the type and 6 zeros
+  size_t offset = RecordValue::minSize();
+  if (isDataMetaType(getRecordType())) {
+    const uint8_t* valueCstr = reinterpret_cast<const uint8_t*>(_value.data());
+    // ttl, version, versionEP, cas, pieceSize and totalSize
+    offset = 1;
+    for (int i = 0; i < 6; i++) {
+      auto expt = varintDecodeFwd(valueCstr + offset, _value.size() - offset);
+      if (!expt.ok()) {
+        return expt.status();
+      }
+      offset += expt.value().second;
+    }
+    if (offset > _value.size()) {
+      return {ErrorCodes::ERR_DECODE, "invalid RecordValue header"};
+    }
+  }
+  return _value.substr(offset);
+}
+
+mystring_view RecordValueView::encode() const {
+  return _value;
+}
+
+Expected<RecordValue> RecordValueView::toRecordValue() const {
+  return RecordValue::decode(std::string(_value.data(), _value.size()));
+}
+
 HashMetaValue::HashMetaValue() : HashMetaValue(0) {}
 
 HashMetaValue::HashMetaValue(uint64_t count) : _count(count) {}
@@ -1137,11 +1274,18 @@ uint64_t HashMetaValue::getCount() const {
   return _count;
 }
 
-ListMetaValue::ListMetaValue(uint64_t head, uint64_t tail)
-  : _head(head), _tail(tail) {}
+ListMetaValue::ListMetaValue(uint64_t head,
+                             uint64_t tail,
+                             ListKeyFormat fmt)
+  : _head(head), _tail(tail), _fmt(fmt), _legacyHead(0), _legacyTail(0) {}
 
 ListMetaValue::ListMetaValue(ListMetaValue&& v)
-  : _head(v._head), _tail(v._tail) {
+  : _head(v._head),
+    _tail(v._tail),
+    _fmt(v._fmt),
+    _legacyHead(v._legacyHead),
+    _legacyTail(v._legacyTail),
+    _groups(std::move(v._groups)) {
   v._head = 0;
   v._tail = 0;
 }
@@ -1153,6 +1297,23 @@ std::string ListMetaValue::encode() const {
   value.insert(value.end(), headBytes.begin(), headBytes.end());
   auto tailBytes = varintEncode(_tail);
   value.insert(value.end(), tailBytes.begin(), tailBytes.end());
+  // the older versions have no format, it means LKF_DECIMAL
+  if (_fmt == ListKeyFormat::LKF_DECIMAL) {
+    return std::string(reinterpret_cast<const char*>(value.data()),
+                       value.size());
+  }
+  for (uint64_t v : {static_cast<uint64_t>(_fmt), _legacyHead, _legacyTail}) {
+    auto bytes = varintEncode(v);
+    value.insert(value.end(), bytes.begin(), bytes.end());
+  }
+  auto cntBytes = varintEncode(_groups.size());
+  value.insert(value.end(), cntBytes.begin(), cntBytes.end());
+  for (const auto& g : _groups) {
+    for (uint64_t v : {g.id, g.count, static_cast<uint64_t>(g.chunks)}) {
+      auto bytes = varintEncode(v);
+      value.insert(value.end(), bytes.begin(), bytes.end());
+    }
+  }
   return std::string(reinterpret_cast<const char*>(value.data()), value.size());
 }
 
@@ -1174,7 +1335,57 @@ Expected<ListMetaValue> ListMetaValue::decode(const std::string& val) {
   }
   offset += expt.value().second;
   tail = expt.value().first;
-  return ListMetaValue(head, tail);
+
+  if (offset == val.size()) {
+    return ListMetaValue(head, tail, ListKeyFormat::LKF_DECIMAL);
+  }
+  expt = varintDecodeFwd(valCstr + offset, val.size() - offset);
+  if (!expt.ok()) {
+    return expt.status();
+  }
+  offset += expt.value().second;
+  if (expt.value().first !=
+      static_cast<uint64_t>(ListKeyFormat::LKF_CHUNKED)) {
+    return {ErrorCodes::ERR_DECODE, "invalid list key format"};
+  }
+  ListMetaValue lm(head, tail, ListKeyFormat::LKF_CHUNKED);
+
+  uint64_t legacy[2];
+  for (auto& l : legacy) {
+    expt = varintDecodeFwd(valCstr + offset, val.size() - offset);
+    if (!expt.ok()) {
+      return expt.status();
+    }
+    offset += expt.value().second;
+    l = expt.value().first;
+  }
+  if (legacy[0] > legacy[1]) {
+    return {ErrorCodes::ERR_DECODE, "invalid list legacy range"};
+  }
+  lm.setLegacyRange(legacy[0], legacy[1]);
+
+  expt = varintDecodeFwd(valCstr + offset, val.size() - offset);
+  if (!expt.ok()) {
+    return expt.status();
+  }
+  offset += expt.value().second;
+  uint64_t n = expt.value().first;
+  std::vector<ListChunkGroup> groups;
+  for (uint64_t i = 0; i < n; i++) {
+    uint64_t fields[3];
+    for (auto& f : fields) {
+      expt = varintDecodeFwd(valCstr + offset, val.size() - offset);
+      if (!expt.ok()) {
+        return expt.status();
+      }
+      offset += expt.value().second;
+      f = expt.value().first;
+    }
+    groups.push_back(
+      ListChunkGroup{fields[0], fields[1], static_cast<uint32_t>(fields[2])});
+  }
+  lm.setGroups(std::move(groups));
+  return std::move(lm);
 }
 
 ListMetaValue& ListMetaValue::operator=(ListMetaValue&& o) {
@@ -1183,6 +1394,10 @@ ListMetaValue& ListMetaValue::operator=(ListMetaValue&& o) {
   }
   _head = o._head;
   _tail = o._tail;
+  _fmt = o._fmt;
+  _legacyHead = o._legacyHead;
+  _legacyTail = o._legacyTail;
+  _groups = std::move(o._groups);
   o._head = 0;
   o._tail = 0;
   return *this;
@@ -1204,6 +1419,35 @@ uint64_t ListMetaValue::getTail() const {
   return _tail;
 }
 
+void ListMetaValue::setKeyFormat(ListKeyFormat fmt) {
+  _fmt = fmt;
+}
+
+ListKeyFormat ListMetaValue::getKeyFormat() const {
+  return _fmt;
+}
+
+void ListMetaValue::setGroups(std::vector<ListChunkGroup> groups) {
+  _groups = std::move(groups);
+}
+
+const std::vector<ListChunkGroup>& ListMetaValue::getGroups() const {
+  return _groups;
+}
+
+void ListMetaValue::setLegacyRange(uint64_t head, uint64_t tail) {
+  _legacyHead = head;
+  _legacyTail = tail;
+}
+
+uint64_t ListMetaValue::getLegacyHead() const {
+  return _fmt == ListKeyFormat::LKF_DECIMAL ? _head : _legacyHead;
+}
+
+uint64_t ListMetaValue::getLegacyTail() const {
+  return _fmt == ListKeyFormat::LKF_DECIMAL ? _tail : _legacyTail;
+}
+
 SetMetaValue::SetMetaValue() : _count(0) {}
 
 SetMetaValue::SetMetaValue(uint64_t count) : _count(count) {}
@@ -1238,6 +1482,81 @@ uint64_t SetMetaValue::getCount() const {
 
 uint32_t ZSlMetaValue::HEAD_ID = 1;
 
+std::string StreamId::encode() const {
+  std::string result(ENCODED_SIZE, '\0');
+  int64Encode(&result[0], ms);
+  int64Encode(&result[sizeof(uint64_t)], seq);
+  return result;
+}
+
+Expected<StreamId> StreamId::decode(const std::string& val) {
+  if (val.size() != ENCODED_SIZE) {
+    return {ErrorCodes::ERR_DECODE, "invalid stream id"};
+  }
+  return StreamId{int64Decode(val.c_str()),
+                  int64Decode(val.c_str() + sizeof(uint64_t))};
+}
+
+std::string StreamId::toString() const {
+  return std::to_string(ms) + "-" + std::to_string(seq);
+}
+
+StreamMetaValue::StreamMetaValue() : StreamMetaValue(0, StreamId{0, 0}, 0) {}
+
+StreamMetaValue::StreamMetaValue(uint64_t count,
+                                 const StreamId& lastId,
+                                 uint64_t groups)
+  : _count(count), _lastId(lastId), _groups(groups) {}
+
+std::string StreamMetaValue::encode() const {
+  std::string value;
+  value.reserve(32);
+  value.append(varintEncodeStr(_count));
+  value.append(varintEncodeStr(_lastId.ms));
+  value.append(varintEncodeStr(_lastId.seq));
+  value.append(varintEncodeStr(_groups));
+  return value;
+}
+
+Expected<StreamMetaValue> StreamMetaValue::decode(const std::string& val) {
+  const uint8_t* valCstr = reinterpret_cast<const uint8_t*>(val.c_str());
+  size_t offset = 0;
+  uint64_t fields[4];
+  for (auto& field : fields) {
+    auto expt = varintDecodeFwd(valCstr + offset, val.size() - offset);
+    if (!expt.ok()) {
+      return expt.status();
+    }
+    offset += expt.value().second;
+    field = expt.value().first;
+  }
+  return StreamMetaValue(fields[0], StreamId{fields[1], fields[2]}, fields[3]);
+}
+
+void StreamMetaValue::setCount(uint64_t count) {
+  _count = count;
+}
+
+uint64_t StreamMetaValue::getCount() const {
+  return _count;
+}
+
+void StreamMetaValue::setLastId(const StreamId& id) {
+  _lastId = id;
+}
+
+const StreamId& StreamMetaValue::getLastId() const {
+  return _lastId;
+}
+
+void StreamMetaValue::setGroups(uint64_t groups) {
+  _groups = groups;
+}
+
+uint64_t StreamMetaValue::getGroups() const {
+  return _groups;
+}
+
 ZSlMetaValue::ZSlMetaValue() : ZSlMetaValue(0, 0, 0) {}
 
 ZSlMetaValue::ZSlMetaValue(uint8_t lvl, uint32_t count, uint64_t tail)
@@ -1245,7 +1564,10 @@ ZSlMetaValue::ZSlMetaValue(uint8_t lvl, uint32_t count, uint64_t tail)
     _maxLevel(MAX_LAYER),
     _count(count),
     _tail(tail),
-    _posAlloc(ZSlMetaValue::MIN_POS) {
+    _posAlloc(ZSlMetaValue::MIN_POS),
+    _scoreIndex(false),
+    _writeId(0),
+    _scoreIndexBuilding(false) {
   // NOTE(vinchen): _maxLevel can't change. If you want to
   // change it, the constructor of ZSlEleValue should add new
   // parameter of it.
@@ -1279,7 +1601,18 @@ std::string ZSlMetaValue::encode() const {
   bytes = varintEncode(_posAlloc);
   value.insert(value.end(), bytes.begin(), bytes.end());
 
-  return std::string(reinterpret_cast<const char*>(value.data()), value.size());
+  bytes = varintEncode(_scoreIndex ? 1 : 0);
+  value.insert(value.end(), bytes.begin(), bytes.end());
+
+  bytes = varintEncode(_writeId);
+  value.insert(value.end(), bytes.begin(), bytes.end());
+
+  std::string result(reinterpret_cast<const char*>(value.data()), value.size());
+  // the older versions ignore it, and start the building over
+  if (!_scoreIndex && _scoreIndexBuilding) {
+    result.append(lenStrEncode(_scoreIndexNext));
+  }
+  return result;
 }
 
 Expected<ZSlMetaValue> ZSlMetaValue::decode(const std::string& val) {
@@ -1328,6 +1661,37 @@ Expected<ZSlMetaValue> ZSlMetaValue::decode(const std::string& val) {
   offset += expt.value().second;
   result._posAlloc = expt.value().first;
 
+  // _scoreIndex, optional
+  if (offset < val.size()) {
+    expt = varintDecodeFwd(keyCstr + offset, val.size() - offset);
+    if (!expt.ok()) {
+      return expt.status();
+    }
+    offset += expt.value().second;
+    result._scoreIndex = expt.value().first != 0;
+  }
+
+  // _writeId, optional
+  if (offset < val.size()) {
+    expt = varintDecodeFwd(keyCstr + offset, val.size() - offset);
+    if (!expt.ok()) {
+      return expt.status();
+    }
+    offset += expt.value().second;
+    result._writeId = expt.value().first;
+  }
+
+  // _scoreIndexNext, optional
+  if (offset < val.size()) {
+    auto next = lenStrDecode(val.c_str() + offset, val.size() - offset);
+    if (!next.ok()) {
+      return next.status();
+    }
+    offset += next.value().second;
+    result._scoreIndexBuilding = true;
+    result._scoreIndexNext = std::move(next.value().first);
+  }
+
   return result;
 }
 
@@ -1351,6 +1715,118 @@ uint64_t ZSlMetaValue::getPosAlloc() const {
   return _posAlloc;
 }
 
+bool ZSlMetaValue::hasScoreIndex() const {
+  return _scoreIndex;
+}
+
+void ZSlMetaValue::setScoreIndex(bool v) {
+  _scoreIndex = v;
+}
+
+bool ZSlMetaValue::isScoreIndexBuilding() const {
+  return _scoreIndexBuilding;
+}
+
+const std::string& ZSlMetaValue::getScoreIndexNext() const {
+  return _scoreIndexNext;
+}
+
+void ZSlMetaValue::setScoreIndexNext(const std::string& member) {
+  _scoreIndexBuilding = true;
+  _scoreIndexNext = member;
+}
+
+uint64_t ZSlMetaValue::getWriteId() const {
+  return _writeId;
+}
+
+void ZSlMetaValue::setWriteId(uint64_t id) {
+  _writeId = id;
+}
+
+std::string ZSlMetaValue::scoreIndexKey(double score,
+                                        const std::string& member) {
+  std::string sk = scoreIndexPrefix(score, member);
+  sk.push_back('\0');
+  sk.push_back('\1');
+  return sk;
+}
+
+std::string ZSlMetaValue::scoreIndexPrefix(double score, bool after) {
+  // -0.0 equals 0.0
+  if (score == 0) {
+    score = 0;
+  }
+  uint64_t bits = 0;
+  static_assert(sizeof(bits) == sizeof(score), "invalid double size");
+  memcpy(&bits, &score, sizeof(bits));
+  // flip all the bits of the negative ones, and the sign bit of the
+  // others, then the bytes are in the order of the doubles
+  if (bits & (1ULL << 63)) {
+    bits = ~bits;
+  } else {
+    bits |= (1ULL << 63);
+  }
+  if (after) {
+    bits++;
+  }
+  std::string sk(sizeof(bits), '\0');
+  for (size_t i = 0; i < sizeof(bits); ++i) {
+    sk[i] = static_cast<char>((bits >> ((sizeof(bits) - i - 1) * 8)) & 0xff);
+  }
+  return sk;
+}
+
+std::string ZSlMetaValue::scoreIndexPrefix(double score,
+                                           const std::string& member,
+                                           bool after) {
+  std::string sk = scoreIndexPrefix(score);
+  sk.reserve(sk.size() + member.size() + 2);
+  for (auto c : member) {
+    sk.push_back(c);
+    if (c == '\0') {
+      sk.push_back('\xff');
+    }
+  }
+  if (after) {
+    sk.push_back('\0');
+    sk.push_back('\2');
+  }
+  return sk;
+}
+
+Expected<std::pair<double, std::string>> ZSlMetaValue::decodeScoreIndexKey(
+  const std::string& sk) {
+  if (sk.size() < sizeof(uint64_t) + 2 || sk[sk.size() - 2] != '\0' ||
+      sk[sk.size() - 1] != '\1') {
+    return {ErrorCodes::ERR_DECODE, "invalid zset score index key"};
+  }
+  uint64_t bits = 0;
+  for (size_t i = 0; i < sizeof(bits); ++i) {
+    bits = (bits << 8) | static_cast<uint8_t>(sk[i]);
+  }
+  if (bits & (1ULL << 63)) {
+    bits &= ~(1ULL << 63);
+  } else {
+    bits = ~bits;
+  }
+  double score = 0;
+  memcpy(&score, &bits, sizeof(score));
+
+  std::string member;
+  member.reserve(sk.size() - sizeof(bits) - 2);
+  for (size_t i = sizeof(bits); i < sk.size() - 2; ++i) {
+    member.push_back(sk[i]);
+    if (sk[i] == '\0') {
+      if (i + 1 >= sk.size() - 2 || sk[i + 1] != '\xff') {
+        return {ErrorCodes::ERR_DECODE, "invalid zset score index key"};
+      }
+      i++;
+    }
+  }
+  return std::make_pair(score, std::move(member));
+}
+
 /*
 ZslEleSubKey::ZslEleSubKey()
     :ZslEleSubKey(0, "") {
@@ -1697,6 +2173,13 @@ Expected<uint64_t> getSubKeyCount(const RecordKey& key,
       }
       return v.value().getCount();
     }
+    case RecordType::RT_STREAM_META: {
+      auto v = StreamMetaValue::decode(val.getValue());
+      if (!v.ok()) {
+        return v.status();
+      }
+      return v.value().getCount();
+    }
     default: {
       return {ErrorCodes::ERR_INTERNAL, "not support"};
     }
@@ -54,6 +54,10 @@ enum class RecordType {
   RT_BINLOG,     /* For binlog in RecordKey and RecordValue  */
   RT_TTL_INDEX,  /* For ttl index  in RecordKey and RecordValue  */
   RT_DATA_META,  /* For key type in RecordKey */
+  RT_STREAM_META, /* For realtype in RecordValue */
+  RT_STREAM_ELE,  /* For stream entry type in RecordKey and RecordValue */
+  RT_STREAM_CG,   /* For stream group type in RecordKey and RecordValue */
+  RT_ZSET_I_ELE,  /* For zset score index in RecordKey and RecordValue */
 };
 
 uint8_t rt2Char(RecordType t);
@@ -295,6 +299,45 @@ class Record {
   RecordValue _value;
 };
 
+// RecordKeyView is an encoded RecordKey that isn't copied. The lengths of
+// the fields are decoded once, the fields are views into the encoded key,
+// which should live as long as the view.
+class RecordKeyView {
+ public:
+  RecordKeyView();
+  static Expected<RecordKeyView> decode(mystring_view key);
+  uint32_t getChunkId() const;
+  uint32_t getDbId() const;
+  RecordType getRecordType() const;
+  mystring_view getPrimaryKey() const;
+  mystring_view getSecondaryKey() const;
+  mystring_view encode() const;
+  // a copy, for the records kept after the cursor moves
+  Expected<RecordKey> toRecordKey() const;
+
+ private:
+  mystring_view _key;
+  size_t _pkLen;
+  size_t _skOffset;
+  size_t _skLen;
+};
+
+// RecordValueView is an encoded RecordValue that isn't copied, like
+// RecordKeyView. The header of a meta is decoded only if it's asked for.
+class RecordValueView {
+ public:
+  RecordValueView();
+  static Expected<RecordValueView> decode(mystring_view value);
+  RecordType getRecordType() const;
+  // the user value, as RecordValue::getValue()
+  Expected<mystring_view> getValue() const;
+  mystring_view encode() const;
+  Expected<RecordValue> toRecordValue() const;
+
+ private:
+  mystring_view _value;
+};
+
 enum class ReplFlag : std::uint16_t {
   REPL_GROUP_MID = 0,
   REPL_GROUP_START = (1 << 0),
@@ -308,6 +351,9 @@ enum class ReplOp : std::uint8_t {
   REPL_OP_STMT = 3,  // statement
   REPL_OP_SPEC = 4,  // special
   REPL_OP_DEL_RANGE = 5,
+  // a merge operand of KVIncrMergeOperator, an encoded RecordValue of the
+  // delta, applied once with its binlog like the others
+  REPL_OP_MERGE = 6,
 };
 
 class ReplLogKeyV2 {
@@ -579,9 +625,33 @@ class BinlogReader {
   mystring_view _val;
 };
 
+// the secondary key format of the list elements.
+// LKF_DECIMAL is the decimal text of the index, as the lists created by
+// the older versions have. It doesn't sort numerically, so the elements
+// can only be read one by one.
+// LKF_CHUNKED packs the elements into chunk records keyed by the 8 bytes
+// big endian chunk id. The chunks are counted in group records, the meta
+// keeps the element counts of the groups, see QuickList. A list converted
+// from LKF_DECIMAL may still have a range of the decimal keys after the
+// chunks, the meta keeps the range until they are all converted.
+enum class ListKeyFormat : uint8_t {
+  LKF_DECIMAL = 0,
+  LKF_CHUNKED = 1,
+};
+
+// a group record of the chunks of a list, with the number of the elements
+// and the number of the chunks in it
+struct ListChunkGroup {
+  uint64_t id;
+  uint64_t count;
+  uint32_t chunks;
+};
+
 class ListMetaValue {
  public:
-  ListMetaValue(uint64_t head, uint64_t tail);
+  ListMetaValue(uint64_t head,
+                uint64_t tail,
+                ListKeyFormat fmt = ListKeyFormat::LKF_CHUNKED);
   ListMetaValue(ListMetaValue&&);
   static Expected<ListMetaValue> decode(const std::string&);
   ListMetaValue& operator=(ListMetaValue&&);
@@ -590,10 +660,24 @@ class ListMetaValue {
   uint64_t getHead() const;
   void setTail(uint64_t tail);
   uint64_t getTail() const;
+  void setKeyFormat(ListKeyFormat fmt);
+  ListKeyFormat getKeyFormat() const;
+  // the chunk groups in the order of the list if LKF_CHUNKED
+  void setGroups(std::vector<ListChunkGroup> groups);
+  const std::vector<ListChunkGroup>& getGroups() const;
+  // the decimal keys [head, tail) of the elements not converted yet, all
+  // the elements if LKF_DECIMAL
+  void setLegacyRange(uint64_t head, uint64_t tail);
+  uint64_t getLegacyHead() const;
+  uint64_t getLegacyTail() const;
 
  private:
   uint64_t _head;
   uint64_t _tail;
+  ListKeyFormat _fmt;
+  uint64_t _legacyHead;
+  uint64_t _legacyTail;
+  std::vector<ListChunkGroup> _groups;
 };
 
 class HashMetaValue {
@@ -626,6 +710,58 @@ class SetMetaValue {
   uint64_t _count;
 };
 
+// the id of a stream entry, <ms>-<seq>. in RecordKey, it is encoded in 16
+// bytes big-endian, so that the entries are sorted by id.
+struct StreamId {
+  uint64_t ms;
+  uint64_t seq;
+
+  static constexpr size_t ENCODED_SIZE = 16;
+  std::string encode() const;
+  static Expected<StreamId> decode(const std::string&);
+  std::string toString() const;
+  bool operator<(const StreamId& o) const {
+    return ms < o.ms || (ms == o.ms && seq < o.seq);
+  }
+  bool operator==(const StreamId& o) const {
+    return ms == o.ms && seq == o.seq;
+  }
+  bool operator<=(const StreamId& o) const {
+    return !(o < *this);
+  }
+};
+
+/*
+META:
+CHUNK|DBID|STREAM_META|KEY|
+COUNT|LAST_MS|LAST_SEQ|GROUPS|
+
+ELE: *COUNT
+CHUNK|DBID|STREAM_ELE|KEY|ID|
+FIELD_NUM|FIELD|VALUE|...
+
+CG: the consumer groups, see commands/stream.cpp
+CHUNK|DBID|STREAM_CG|KEY|TAG|GROUP|...|
+*/
+class StreamMetaValue {
+ public:
+  StreamMetaValue();
+  StreamMetaValue(uint64_t count, const StreamId& lastId, uint64_t groups);
+  static Expected<StreamMetaValue> decode(const std::string&);
+  std::string encode() const;
+  void setCount(uint64_t count);
+  uint64_t getCount() const;
+  // the largest id ever added, XADD generates ids after it
+  void setLastId(const StreamId& id);
+  const StreamId& getLastId() const;
+  void setGroups(uint64_t groups);
+  uint64_t getGroups() const;
+
+ private:
+  uint64_t _count;
+  StreamId _lastId;
+  uint64_t _groups;
+};
 
 /*
 
@@ -656,6 +792,34 @@ class ZSlMetaValue {
   uint32_t getCount() const;
   uint64_t getTail() const;
   uint64_t getPosAlloc() const;
+  // whether the members are also kept in the score index, see
+  // scoreIndexKey(). It's absent in the metas written before it.
+  bool hasScoreIndex() const;
+  void setScoreIndex(bool v);
+  // whether the score index is being built, the members before
+  // getScoreIndexNext() in the order of RT_ZSET_H_ELE are indexed.
+  // It's absent in the metas written before it.
+  bool isScoreIndexBuilding() const;
+  const std::string& getScoreIndexNext() const;
+  void setScoreIndexNext(const std::string& member);
+  // the id of the transaction wrote it last, which makes every change of
+  // the zset a different meta, 0 for the metas written before it
+  uint64_t getWriteId() const;
+  void setWriteId(uint64_t id);
+  // the subkey of RT_ZSET_I_ELE is the score in 8 order-preserving bytes,
+  // then the member with its '\0's escaped and a "\0\1" terminator, so
+  // the index is ordered by (score, member) like the skiplist.
+  static std::string scoreIndexKey(double score, const std::string& member);
+  // the subkeys of score are all after scoreIndexPrefix(score), and before
+  // scoreIndexPrefix(score, true)
+  static std::string scoreIndexPrefix(double score, bool after = false);
+  // the subkey of (score, member) is the only one between
+  // scoreIndexPrefix(score, member) and scoreIndexPrefix(score, member, true)
+  static std::string scoreIndexPrefix(double score,
+                                      const std::string& member,
+                                      bool after = false);
+  static Expected<std::pair<double, std::string>> decodeScoreIndexKey(
+    const std::string& sk);
   // can not dynamicly change
   static constexpr int8_t MAX_LAYER = ZSKIPLIST_MAXLEVEL;
   static constexpr uint32_t MAX_NUM = (1 << 31);
@@ -671,6 +835,10 @@ class ZSlMetaValue {
   uint32_t _count;
   uint64_t _tail;
   uint64_t _posAlloc;
+  bool _scoreIndex;
+  uint64_t _writeId;
+  bool _scoreIndexBuilding;
+  std::string _scoreIndexNext;
 };
 
 class ZSlEleValue {
@@ -193,6 +193,19 @@ TEST(Record, Common) {
     EXPECT_EQ(ttl_, ttl);
     EXPECT_TRUE(prcd1.ok());
     EXPECT_EQ(prcd1.value(), rcd);
+
+    auto kView = RecordKeyView::decode(kv.first);
+    EXPECT_TRUE(kView.ok());
+    EXPECT_EQ(kView.value().getChunkId(), chunkid);
+    EXPECT_EQ(kView.value().getDbId(), dbid);
+    EXPECT_EQ(kView.value().getRecordType(), rk.getRecordType());
+    EXPECT_EQ(kView.value().getPrimaryKey(), pk);
+    EXPECT_EQ(kView.value().getSecondaryKey(), sk);
+    auto vView = RecordValueView::decode(kv.second);
+    EXPECT_TRUE(vView.ok());
+    EXPECT_EQ(vView.value().getRecordType(), type);
+    EXPECT_EQ(vView.value().getValue().value(), val);
+    EXPECT_EQ(vView.value().toRecordValue().value(), rv);
   }
 }
 
@@ -404,6 +417,160 @@ TEST(ZSl, Common) {
   }
 }
 
+TEST(ZSl, ScoreIndex) {
+  ZSlMetaValue m(1, 1, 0);
+  EXPECT_FALSE(m.hasScoreIndex());
+  m.setScoreIndex(true);
+  auto expm = ZSlMetaValue::decode(m.encode());
+  EXPECT_TRUE(expm.ok());
+  EXPECT_TRUE(expm.value().hasScoreIndex());
+
+  // the metas written before the flag
+  std::string old = ZSlMetaValue(1, 1, 0).encode();
+  old.resize(old.size() - 2);
+  expm = ZSlMetaValue::decode(old);
+  EXPECT_TRUE(expm.ok());
+  EXPECT_FALSE(expm.value().hasScoreIndex());
+  EXPECT_EQ(expm.value().getWriteId(), 0U);
+
+  m.setWriteId(1ULL << 40);
+  expm = ZSlMetaValue::decode(m.encode());
+  EXPECT_TRUE(expm.ok());
+  EXPECT_EQ(expm.value().getWriteId(), 1ULL << 40);
+  EXPECT_FALSE(expm.value().isScoreIndexBuilding());
+
+  // the building goes on from the empty member too
+  ZSlMetaValue building(1, 1, 0);
+  building.setScoreIndexNext("");
+  expm = ZSlMetaValue::decode(building.encode());
+  EXPECT_TRUE(expm.ok());
+  EXPECT_FALSE(expm.value().hasScoreIndex());
+  EXPECT_TRUE(expm.value().isScoreIndexBuilding());
+  EXPECT_EQ(expm.value().getScoreIndexNext(), "");
+  building.setScoreIndexNext(std::string("a\0b", 3));
+  expm = ZSlMetaValue::decode(building.encode());
+  EXPECT_TRUE(expm.ok());
+  EXPECT_EQ(expm.value().getScoreIndexNext(), std::string("a\0b", 3));
+
+  // in the order of (score, member)
+  std::vector<std::pair<double, std::string>> eles = {
+    {-std::numeric_limits<double>::infinity(), "a"},
+    {-1e10, ""},
+    {-1.5, "b"},
+    {-1, "a"},
+    {0, std::string("\0", 1)},
+    {0, std::string("\0\0", 2)},
+    {0, std::string("\0\1", 2)},
+    {0, "a"},
+    {0, std::string("a\0", 2)},
+    {0, "ab"},
+    {0.5, "a"},
+    {1, "\xff"},
+    {1e10, "z"},
+    {std::numeric_limits<double>::infinity(), "a"},
+  };
+  std::vector<std::string> keys;
+  for (const auto& e : eles) {
+    keys.push_back(ZSlMetaValue::scoreIndexKey(e.first, e.second));
+    auto d = ZSlMetaValue::decodeScoreIndexKey(keys.back());
+    EXPECT_TRUE(d.ok());
+    EXPECT_EQ(d.value(), e);
+  }
+  EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+  EXPECT_EQ(ZSlMetaValue::scoreIndexKey(-0.0, "a"),
+            ZSlMetaValue::scoreIndexKey(0, "a"));
+
+  // the bounds of a score, and of a member
+  EXPECT_LT(ZSlMetaValue::scoreIndexPrefix(0), keys[4]);
+  EXPECT_GT(ZSlMetaValue::scoreIndexPrefix(0), keys[3]);
+  EXPECT_GT(ZSlMetaValue::scoreIndexPrefix(0, true), keys[9]);
+  EXPECT_LT(ZSlMetaValue::scoreIndexPrefix(0, true), keys[10]);
+  EXPECT_LT(ZSlMetaValue::scoreIndexPrefix(0, "a"), keys[7]);
+  EXPECT_GT(ZSlMetaValue::scoreIndexPrefix(0, "a"), keys[6]);
+  EXPECT_GT(ZSlMetaValue::scoreIndexPrefix(0, "a", true), keys[7]);
+  EXPECT_LT(ZSlMetaValue::scoreIndexPrefix(0, "a", true), keys[8]);
+
+  EXPECT_FALSE(ZSlMetaValue::decodeScoreIndexKey("abc").ok());
+}
+
+TEST(Stream, Common) {
+  srand(time(NULL));
+  for (size_t i = 0; i < 10000; i++) {
+    StreamId id{static_cast<uint64_t>(genRand()) * genRand(),
+                static_cast<uint64_t>(genRand())};
+    StreamMetaValue m(genRand(), id, genRand() % 16);
+    Expected<StreamMetaValue> expm = StreamMetaValue::decode(m.encode());
+    EXPECT_TRUE(expm.ok());
+    EXPECT_EQ(expm.value().getCount(), m.getCount());
+    EXPECT_EQ(expm.value().getLastId(), id);
+    EXPECT_EQ(expm.value().getGroups(), m.getGroups());
+
+    std::string s = id.encode();
+    EXPECT_EQ(s.size(), StreamId::ENCODED_SIZE);
+    Expected<StreamId> expid = StreamId::decode(s);
+    EXPECT_TRUE(expid.ok());
+    EXPECT_EQ(expid.value(), id);
+  }
+
+  // the encoded ids are in the same order as the ids
+  StreamId a{1, UINT64_MAX}, b{2, 0};
+  EXPECT_TRUE(a < b);
+  EXPECT_LT(a.encode(), b.encode());
+  EXPECT_EQ(b.toString(), "2-0");
+}
+
+TEST(ListMeta, Common) {
+  ListMetaValue m(100, 200);
+  EXPECT_EQ(m.getKeyFormat(), ListKeyFormat::LKF_CHUNKED);
+  Expected<ListMetaValue> expm = ListMetaValue::decode(m.encode());
+  EXPECT_TRUE(expm.ok());
+  EXPECT_EQ(expm.value().getKeyFormat(), ListKeyFormat::LKF_CHUNKED);
+  EXPECT_TRUE(expm.value().getGroups().empty());
+
+  std::vector<ListChunkGroup> groups{{3, 16384, 128}, {0, 7, 1}, {12, 1, 1}};
+  m.setGroups(groups);
+  expm = ListMetaValue::decode(m.encode());
+  EXPECT_TRUE(expm.ok());
+  EXPECT_EQ(expm.value().getHead(), 100U);
+  EXPECT_EQ(expm.value().getTail(), 200U);
+  EXPECT_EQ(expm.value().getKeyFormat(), ListKeyFormat::LKF_CHUNKED);
+  EXPECT_EQ(expm.value().getGroups().size(), groups.size());
+  for (size_t i = 0; i < groups.size(); i++) {
+    EXPECT_EQ(expm.value().getGroups()[i].id, groups[i].id);
+    EXPECT_EQ(expm.value().getGroups()[i].count, groups[i].count);
+    EXPECT_EQ(expm.value().getGroups()[i].chunks, groups[i].chunks);
+  }
+  std::string cut = m.encode();
+  cut.pop_back();
+  EXPECT_FALSE(ListMetaValue::decode(cut).ok());
+
+  // the decimal keys left after the chunks
+  EXPECT_EQ(m.getLegacyHead(), 0U);
+  m.setLegacyRange(150, 170);
+  expm = ListMetaValue::decode(m.encode());
+  EXPECT_TRUE(expm.ok());
+  EXPECT_EQ(expm.value().getLegacyHead(), 150U);
+  EXPECT_EQ(expm.value().getLegacyTail(), 170U);
+  EXPECT_EQ(expm.value().getGroups().size(), groups.size());
+  m.setLegacyRange(170, 150);
+  EXPECT_FALSE(ListMetaValue::decode(m.encode()).ok());
+
+  // the meta of the older versions has no format
+  ListMetaValue old(100, 200, ListKeyFormat::LKF_DECIMAL);
+  EXPECT_EQ(old.encode().size(), 2U);
+  expm = ListMetaValue::decode(old.encode());
+  EXPECT_TRUE(expm.ok());
+  EXPECT_EQ(expm.value().getKeyFormat(), ListKeyFormat::LKF_DECIMAL);
+  EXPECT_EQ(expm.value().getHead(), 100U);
+  EXPECT_EQ(expm.value().getTail(), 200U);
+  EXPECT_EQ(expm.value().getLegacyHead(), 100U);
+  EXPECT_EQ(expm.value().getLegacyTail(), 200U);
+
+  std::string bad = old.encode();
+  bad.push_back(static_cast<char>(ListKeyFormat::LKF_CHUNKED) + 1);
+  EXPECT_FALSE(ListMetaValue::decode(bad).ok());
+}
+
 TEST(VersionMeta, Compare) {
   auto meta1 = VersionMeta(0, 0, "sync_1");
   auto meta2 = VersionMeta(0, -1, "sync_1");
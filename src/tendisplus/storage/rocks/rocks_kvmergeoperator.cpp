@@ -0,0 +1,118 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <climits>
+#include <string>
+#include <utility>
+#include "glog/logging.h"
+#include "tendisplus/storage/rocks/rocks_kvmergeoperator.h"
+#include "tendisplus/storage/record.h"
+#include "tendisplus/utils/string.h"
+
+namespace tendisplus {
+
+namespace {
+
+bool addOverflow(int64_t sum, int64_t delta) {
+  return (delta < 0 && sum < 0 && delta < (LLONG_MIN - sum)) ||
+    (delta > 0 && sum > 0 && delta > (LLONG_MAX - sum));
+}
+
+// the operand and its delta, or an error if it's not a valid one
+Expected<std::pair<RecordValue, int64_t>> decodeOperand(
+  const rocksdb::Slice& operand) {
+  auto rv = RecordValue::decode(operand.ToString());
+  if (!rv.ok()) {
+    return rv.status();
+  }
+  auto delta = ::tendisplus::stoll(rv.value().getValue());
+  if (!delta.ok()) {
+    return delta.status();
+  }
+  return std::make_pair(std::move(rv.value()), delta.value());
+}
+
+}  // namespace
+
+bool KVIncrMergeOperator::FullMergeV2(const MergeOperationInput& merge_in,
+                                      MergeOperationOutput* merge_out) const {
+  int64_t sum = 0;
+  Expected<RecordValue> base = {ErrorCodes::ERR_NOTFOUND, ""};
+  if (merge_in.existing_value) {
+    base = RecordValue::decode(merge_in.existing_value->ToString());
+    if (!base.ok()) {
+      LOG(ERROR) << "merge into an invalid value:" << base.status().toString();
+      return false;
+    }
+    auto val = ::tendisplus::stoll(base.value().getValue());
+    if (!val.ok()) {
+      LOG(WARNING) << "merge into a value not an integer, skipped";
+      merge_out->new_value = merge_in.existing_value->ToString();
+      return true;
+    }
+    sum = val.value();
+  }
+
+  Expected<RecordValue> last = {ErrorCodes::ERR_NOTFOUND, ""};
+  for (const auto& operand : merge_in.operand_list) {
+    auto op = decodeOperand(operand);
+    if (!op.ok() || addOverflow(sum, op.value().second)) {
+      LOG(WARNING) << "invalid merge operand skipped";
+      continue;
+    }
+    sum += op.value().second;
+    last = std::move(op.value().first);
+  }
+  if (!last.ok()) {
+    if (!base.ok()) {
+      LOG(ERROR) << "no valid merge operand";
+      return false;
+    }
+    merge_out->new_value = merge_in.existing_value->ToString();
+    return true;
+  }
+
+  const RecordValue& hdr = base.ok() ? base.value() : last.value();
+  RecordValue result(std::to_string(sum),
+                     last.value().getRecordType(),
+                     last.value().getVersionEP(),
+                     last.value().getTtl(),
+                     hdr.getCas(),
+                     hdr.getVersion(),
+                     hdr.getPieceSize());
+  merge_out->new_value = result.encode();
+  return true;
+}
+
+bool KVIncrMergeOperator::PartialMergeMulti(
+  const rocksdb::Slice& /*key*/,
+  const std::deque<rocksdb::Slice>& operand_list,
+  std::string* new_value,
+  rocksdb::Logger* /*logger*/) const {
+  int64_t sum = 0;
+  Expected<RecordValue> last = {ErrorCodes::ERR_NOTFOUND, ""};
+  for (const auto& operand : operand_list) {
+    auto op = decodeOperand(operand);
+    // leave them to the full merge, which skips the bad one
+    if (!op.ok() || addOverflow(sum, op.value().second)) {
+      return false;
+    }
+    sum += op.value().second;
+    last = std::move(op.value().first);
+  }
+  if (!last.ok()) {
+    return false;
+  }
+  RecordValue result(std::to_string(sum),
+                     last.value().getRecordType(),
+                     last.value().getVersionEP(),
+                     last.value().getTtl(),
+                     last.value().getCas(),
+                     last.value().getVersion(),
+                     last.value().getPieceSize());
+  *new_value = result.encode();
+  return true;
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,39 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_KVMERGEOPERATOR_H_
+#define SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_KVMERGEOPERATOR_H_
+
+#include <deque>
+#include <string>
+#include "rocksdb/merge_operator.h"
+#include "rocksdb/slice.h"
+
+namespace tendisplus {
+
+// KVIncrMergeOperator adds the integer deltas to an integer RecordValue,
+// the value of a string or a hash field. An operand is an encoded
+// RecordValue whose user value is the decimal delta, and whose header is
+// the one the sum has, except that the cas, the version and the piece
+// size of the existing value are kept. The operands are only written
+// after the existing value is known to be an integer which doesn't
+// overflow, a bad operand is skipped rather than failing the reads.
+class KVIncrMergeOperator : public rocksdb::MergeOperator {
+ public:
+  const char* Name() const override {
+    return "KVIncrMergeOperator";
+  }
+
+  bool FullMergeV2(const MergeOperationInput& merge_in,
+                   MergeOperationOutput* merge_out) const override;
+
+  bool PartialMergeMulti(const rocksdb::Slice& key,
+                         const std::deque<rocksdb::Slice>& operand_list,
+                         std::string* new_value,
+                         rocksdb::Logger* logger) const override;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_KVMERGEOPERATOR_H_
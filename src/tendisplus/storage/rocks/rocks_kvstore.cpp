@@ -25,6 +25,7 @@
 #include "rocksdb/filter_policy.h"
 #include "rocksdb/utilities/backupable_db.h"
 #include "rocksdb/utilities/checkpoint.h"
+#include "rocksdb/convenience.h"
 #include "rocksdb/options.h"
 #include "rocksdb/iostats_context.h"
 #include "rocksdb/perf_context.h"
@@ -39,6 +40,9 @@
 #include "tendisplus/server/session.h"
 #include "tendisplus/server/server_entry.h"
 #include "tendisplus/storage/varint.h"
+#include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/counter_cache.h"
+#include "tendisplus/storage/rocks/rocks_kvmergeoperator.h"
 
 namespace tendisplus {
 
@@ -57,19 +61,34 @@ namespace tendisplus {
 #endif
 
 RocksKVCursor::RocksKVCursor(std::unique_ptr<rocksdb::Iterator> it)
-  : Cursor(), _it(std::move(it)) {
+  : Cursor(), _it(std::move(it)), _pending(false) {
   _it->Seek("");
 }
 
+void RocksKVCursor::skipPending() {
+  if (_pending) {
+    _pending = false;
+    _it->Next();
+  }
+}
+
 void RocksKVCursor::seek(const std::string& prefix) {
+  _pending = false;
   _it->Seek(rocksdb::Slice(prefix.c_str(), prefix.size()));
 }
 
+void RocksKVCursor::seekForPrev(const std::string& target) {
+  _pending = false;
+  _it->SeekForPrev(rocksdb::Slice(target.c_str(), target.size()));
+}
+
 void RocksKVCursor::seekToLast() {
+  _pending = false;
   _it->SeekToLast();
 }
 
 Expected<Record> RocksKVCursor::next() {
+  skipPending();
   if (!_it->status().ok()) {
     return {ErrorCodes::ERR_INTERNAL, _it->status().ToString()};
   }
@@ -79,7 +98,7 @@ Expected<Record> RocksKVCursor::next() {
   const std::string& key = _it->key().ToString();
   const std::string& val = _it->value().ToString();
   auto result = Record::decode(key, val);
-  _it->Next();
+  _pending = true;
   if (result.ok()) {
     return std::move(result.value());
   } else {
@@ -88,7 +107,26 @@ Expected<Record> RocksKVCursor::next() {
   return result.status();
 }
 
+Status RocksKVCursor::nextRaw(mystring_view* key, mystring_view* value) {
+  skipPending();
+  if (!_it->status().ok()) {
+    return {ErrorCodes::ERR_INTERNAL, _it->status().ToString()};
+  }
+  if (!_it->Valid()) {
+    return {ErrorCodes::ERR_EXHAUST, "no more data"};
+  }
+  *key = mystring_view(_it->key().data(), _it->key().size());
+  *value = mystring_view(_it->value().data(), _it->value().size());
+  _pending = true;
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Status RocksKVCursor::prev() {
+  if (_pending) {
+    // still on the record returned
+    _pending = false;
+    return {ErrorCodes::ERR_OK, ""};
+  }
   if (!_it->status().ok()) {
     return {ErrorCodes::ERR_INTERNAL, _it->status().ToString()};
   }
@@ -103,6 +141,7 @@ Status RocksKVCursor::prev() {
 }
 
 Expected<std::string> RocksKVCursor::key() {
+  skipPending();
   if (!_it->status().ok()) {
     return {ErrorCodes::ERR_INTERNAL, _it->status().ToString()};
   }
@@ -191,11 +230,22 @@ std::unique_ptr<VersionMetaCursor> RocksTxn::createVersionMetaCursor() {
   return std::make_unique<VersionMetaCursor>(std::move(cursor));
 }
 
-std::unique_ptr<BasicDataCursor> RocksTxn::createDataCursor() {
-  auto cursor = createCursor(ColumnFamilyNumber::ColumnFamily_Default);
+std::unique_ptr<BasicDataCursor> RocksTxn::createDataCursor(
+  size_t readahead_size) {
+  auto cursor = createCursor(
+    ColumnFamilyNumber::ColumnFamily_Default, NULL, readahead_size);
   return std::make_unique<BasicDataCursor>(std::move(cursor));
 }
 
+std::unique_ptr<PrefixCursor> RocksTxn::createPrefixCursor(
+  const std::string& prefix, size_t readahead_size) {
+  auto bound = PrefixCursor::upperBound(prefix);
+  auto cursor = createCursor(ColumnFamilyNumber::ColumnFamily_Default,
+                             bound.empty() ? NULL : &bound,
+                             readahead_size);
+  return std::make_unique<PrefixCursor>(std::move(cursor), prefix);
+}
+
 std::unique_ptr<AllDataCursor> RocksTxn::createAllDataCursor() {
   auto cursor = createCursor(ColumnFamilyNumber::ColumnFamily_Default);
   return std::make_unique<AllDataCursor>(std::move(cursor));
@@ -208,13 +258,15 @@ std::unique_ptr<BinlogCursor> RocksTxn::createBinlogCursor() {
 
 std::unique_ptr<Cursor> RocksTxn::createCursor(
   ColumnFamilyNumber column_family_num,
-  const std::string* iterate_upper_bound) {
+  const std::string* iterate_upper_bound,
+  size_t readahead_size) {
   rocksdb::ReadOptions readOpts;
   RESET_PERFCONTEXT();
+  readOpts.readahead_size = readahead_size;
   if (iterate_upper_bound != NULL) {
-    _strUpperBound = *iterate_upper_bound;
-    _upperBound = rocksdb::Slice(_strUpperBound);
-    readOpts.iterate_upper_bound = &_upperBound;
+    _strUpperBounds.emplace_back(*iterate_upper_bound);
+    _upperBounds.emplace_back(_strUpperBounds.back());
+    readOpts.iterate_upper_bound = &_upperBounds.back();
   }
   readOpts.snapshot = _txn->GetSnapshot();
   // create iterator corresponding to chosen column family
@@ -309,6 +361,9 @@ Expected<uint64_t> RocksTxn::commit() {
   TEST_SYNC_POINT("RocksTxn::commit()::2");
   auto s = _txn->Commit();
   if (s.ok()) {
+    for (auto chunkId : _deletedChunks) {
+      _store->stat.countDelete(chunkId);
+    }
     return _txnId;
   } else {
     binlogTxnId = Transaction::TXNID_UNINITED;
@@ -340,6 +395,69 @@ Status RocksTxn::rollback() {
   }
 }
 
+void RocksTxn::setSavePoint() {
+  INVARIANT_D(!_done && _txn != nullptr);
+  _txn->SetSavePoint();
+#ifdef BINLOG_V1
+  _savePoints.push_back(_binlogs.size());
+#else
+  _savePoints.push_back(_replLogValues.size());
+#endif
+  _deleteSavePoints.push_back(_deletedChunks.size());
+  _staleSavePoints.push_back(0);
+}
+
+Status RocksTxn::rollbackToSavePoint() {
+  INVARIANT_D(!_done && _txn != nullptr);
+  if (_savePoints.empty()) {
+    return {ErrorCodes::ERR_NOTFOUND, "no save point"};
+  }
+  // the stale rocksdb save points are above this one, rolling back all
+  // of them undoes the same writes
+  for (size_t i = 0; i <= _staleSavePoints.back(); i++) {
+    auto s = _txn->RollbackToSavePoint();
+    if (!s.ok()) {
+      return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+    }
+  }
+  size_t size = _savePoints.back();
+  _savePoints.pop_back();
+#ifdef BINLOG_V1
+  _binlogs.erase(_binlogs.begin() + size, _binlogs.end());
+#else
+  _replLogValues.erase(_replLogValues.begin() + size, _replLogValues.end());
+#endif
+  _deletedChunks.resize(_deleteSavePoints.back());
+  _deleteSavePoints.pop_back();
+  _staleSavePoints.pop_back();
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status RocksTxn::popSavePoint() {
+  INVARIANT_D(!_done && _txn != nullptr);
+  if (_savePoints.empty()) {
+    return {ErrorCodes::ERR_NOTFOUND, "no save point"};
+  }
+  size_t stale = _staleSavePoints.back();
+#if ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR > 15)
+  auto s = _txn->PopSavePoint();
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+#else
+  // the rocksdb save point stays until the transaction ends, the save
+  // point below rolls it back together with its own
+  stale++;
+#endif
+  _savePoints.pop_back();
+  _deleteSavePoints.pop_back();
+  _staleSavePoints.pop_back();
+  if (!_staleSavePoints.empty()) {
+    _staleSavePoints.back() += stale;
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 uint64_t RocksTxn::getTxnId() const {
   return _txnId;
 }
@@ -380,6 +498,34 @@ Expected<std::string> RocksTxn::getKV(const std::string& key) {
   return {ErrorCodes::ERR_INTERNAL, s.ToString()};
 }
 
+std::vector<Expected<std::string>> RocksTxn::multiGetKV(
+  const std::vector<std::string>& keys) {
+  rocksdb::ReadOptions readOpts;
+  std::vector<rocksdb::Slice> slices;
+  slices.reserve(keys.size());
+  for (const auto& key : keys) {
+    INVARIANT_D(RecordKey::decodeType(key) != RecordType::RT_BINLOG);
+    slices.emplace_back(key);
+  }
+
+  RESET_PERFCONTEXT();
+  std::vector<std::string> values;
+  auto ss = _txn->MultiGet(readOpts, slices, &values);
+
+  std::vector<Expected<std::string>> result;
+  result.reserve(keys.size());
+  for (size_t i = 0; i < ss.size(); ++i) {
+    if (ss[i].ok()) {
+      result.emplace_back(std::move(values[i]));
+    } else if (ss[i].IsNotFound()) {
+      result.emplace_back(ErrorCodes::ERR_NOTFOUND, ss[i].ToString());
+    } else {
+      result.emplace_back(ErrorCodes::ERR_INTERNAL, ss[i].ToString());
+    }
+  }
+  return result;
+}
+
 Status RocksTxn::setKV(const std::string& key,
                        const std::string& val,
                        const uint64_t ts) {
@@ -393,6 +539,10 @@ Status RocksTxn::setKV(const std::string& key,
   if (!s.ok()) {
     return {ErrorCodes::ERR_INTERNAL, s.ToString()};
   }
+  // the writer holds the key lock, no counter is cached again before commit
+  if (_store->getCounterCache()) {
+    _store->getCounterCache()->invalidate(key);
+  }
 
   if (_store->enableRepllog()) {
     INVARIANT_D(_store->dbId() != CATALOG_NAME);
@@ -432,6 +582,12 @@ Status RocksTxn::delKV(const std::string& key, const uint64_t ts) {
   if (!s.ok()) {
     return {ErrorCodes::ERR_INTERNAL, s.ToString()};
   }
+  if (RecordKey::decodeType(key) != RecordType::RT_BINLOG) {
+    _deletedChunks.push_back(RecordKey::decodeChunkId(key));
+  }
+  if (_store->getCounterCache()) {
+    _store->getCounterCache()->invalidate(key);
+  }
 
   if (_store->enableRepllog()) {
     INVARIANT_D(_store->dbId() != CATALOG_NAME);
@@ -455,6 +611,30 @@ Status RocksTxn::delKV(const std::string& key, const uint64_t ts) {
   return {ErrorCodes::ERR_OK, ""};
 }
 
+Status RocksTxn::mergeKV(const std::string& key,
+                         const std::string& operand,
+                         const uint64_t ts) {
+  if (_replOnly) {
+    return {ErrorCodes::ERR_INTERNAL, "txn is replOnly"};
+  }
+
+  RESET_PERFCONTEXT();
+  auto s = _txn->Merge(key, operand);
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+
+  if (_store->enableRepllog()) {
+    INVARIANT_D(_store->dbId() != CATALOG_NAME);
+    setChunkId(RecordKey::decodeChunkId(key));
+    // the delta is replayed once, as the binlog id is committed with it
+    ReplLogValueEntryV2 logVal(
+      ReplOp::REPL_OP_MERGE, ts ? ts : msSinceEpoch(), key, operand);
+    _replLogValues.emplace_back(std::move(logVal));
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Status RocksTxn::addDeleteRangeBinlog(const std::string& begin,
                                       const std::string& end) {
   if (_replOnly) {
@@ -525,6 +705,7 @@ Status RocksTxn::applyBinlog(const ReplLogValueEntryV2& logEntry) {
     return {ErrorCodes::ERR_INTERNAL, "txn is not replOnly or migrationOnly"};
   }
   RESET_PERFCONTEXT();
+  auto counterCache = _store->getCounterCache();
   switch (logEntry.getOp()) {
     case ReplOp::REPL_OP_SET: {
       // TODO(vinchen): RecordKey::validate()
@@ -532,6 +713,9 @@ Status RocksTxn::applyBinlog(const ReplLogValueEntryV2& logEntry) {
       if (!s.ok()) {
         return {ErrorCodes::ERR_INTERNAL, s.ToString()};
       }
+      if (counterCache) {
+        counterCache->invalidate(logEntry.getOpKey());
+      }
       break;
     }
     case ReplOp::REPL_OP_DEL: {
@@ -539,6 +723,20 @@ Status RocksTxn::applyBinlog(const ReplLogValueEntryV2& logEntry) {
       if (!s.ok()) {
         return {ErrorCodes::ERR_INTERNAL, s.ToString()};
       }
+      _deletedChunks.push_back(RecordKey::decodeChunkId(logEntry.getOpKey()));
+      if (counterCache) {
+        counterCache->invalidate(logEntry.getOpKey());
+      }
+      break;
+    }
+    case ReplOp::REPL_OP_MERGE: {
+      auto s = _txn->Merge(logEntry.getOpKey(), logEntry.getOpValue());
+      if (!s.ok()) {
+        return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+      }
+      if (counterCache) {
+        counterCache->invalidate(logEntry.getOpKey());
+      }
       break;
     }
     case ReplOp::REPL_OP_STMT: {
@@ -1037,15 +1235,30 @@ rocksdb::Options RocksKVStore::options() {
   table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, false));
   table_options.block_size = 16 * 1024;  // 16KB
   table_options.format_version = 2;
-  // let index and filters pining in mem forever
-  table_options.cache_index_and_filter_blocks = false;
+  if (_cfg->rocksCacheIndexAndFilterBlocks && _blockCache) {
+    // the top level index and the partitions are charged to the block
+    // cache, the ones of L0 are pinned as they are read most
+    table_options.cache_index_and_filter_blocks = true;
+    table_options.cache_index_and_filter_blocks_with_high_priority = true;
+    table_options.pin_l0_filter_and_index_blocks_in_cache = true;
+    table_options.index_type =
+      rocksdb::BlockBasedTableOptions::IndexType::kTwoLevelIndexSearch;
+    table_options.partition_filters = true;
+    table_options.metadata_block_size = 4096;
+  } else {
+    // let index and filters pining in mem forever
+    table_options.cache_index_and_filter_blocks = false;
+  }
 
   options.write_buffer_size = 64 * 1024 * 1024;  // 64MB
+  // the memtables are flushed once the stores use up the budget, so a
+  // busy store may take more of it than the idle ones
+  options.write_buffer_manager = _writeBufferManager;
   // level_0 max size: 8*64MB = 512MB
   options.level0_slowdown_writes_trigger = 8;
   options.max_write_buffer_number = 2;
   options.max_write_buffer_number_to_maintain = 1;
-  options.max_background_compactions = 8;
+  options.max_background_compactions = _backgroundCompactions.load();
   options.max_background_flushes = 2;
   options.target_file_size_base = 64 * 1024 * 1024;  // 64MB
   options.level_compaction_dynamic_level_bytes = true;
@@ -1100,6 +1313,9 @@ rocksdb::Options RocksKVStore::options() {
     options.compaction_filter_factory.reset(
       new KVTtlCompactionFilterFactory(this));
   }
+  // set even if incr-merge-mode is off, the operands may be written before
+  // the mode is turned off, or come from the binlog of the master
+  options.merge_operator = std::make_shared<KVIncrMergeOperator>();
 
   // background listener
   auto listener = std::make_shared<BackgroundErrorListener>(_env);
@@ -1181,6 +1397,7 @@ Status RocksKVStore::stop() {
             "it's upperlayer's duty to guarantee no pinning txns alive"};
   }
   _isRunning = false;
+  _baseDB.store(nullptr, std::memory_order_release);
 
   for (auto* h : _cfHandles) {
     delete h;
@@ -1519,6 +1736,32 @@ Status RocksKVStore::fullCompact() {
   return s;
 }
 
+Status RocksKVStore::setBackgroundCompactions(uint32_t num) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  _backgroundCompactions.store(num);
+  if (!_isRunning) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  auto s = getBaseDB()->SetDBOptions(
+    {{"max_background_compactions", std::to_string(num)}});
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+uint32_t RocksKVStore::getBackgroundCompactions() const {
+  return _backgroundCompactions.load();
+}
+
+uint64_t RocksKVStore::getNumKeysRead() const {
+  return _stats->getTickerCount(rocksdb::Tickers::NUMBER_KEYS_READ);
+}
+
+uint64_t RocksKVStore::getNumKeysWritten() const {
+  return _stats->getTickerCount(rocksdb::Tickers::NUMBER_KEYS_WRITTEN);
+}
+
 Status RocksKVStore::clear() {
   std::lock_guard<std::mutex> lk(_mutex);
   if (_isRunning) {
@@ -1592,6 +1835,13 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
               << " nextBinlogSeq:" << nextBinlogSeq
               << " highestVisible:" << highestVisible;
     INVARIANT_D(nextBinlogSeq != Transaction::TXNID_UNINITED);
+    // the data may be replaced, and the txn ids are reused
+    if (_skipListCache) {
+      _skipListCache->clear();
+    }
+    if (_counterCache) {
+      _counterCache->clear();
+    }
 
     // NOTE(vinchen): if stateMode is STORE_NONE, the store no need
     // to open in rocksdb layer.
@@ -1662,6 +1912,7 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
       binlog_iter.reset(tmpDb->GetBaseDB()->NewIterator(
         readOpts, getBinlogColumnFamilyHandle()));
       _optdb.reset(tmpDb);
+      _baseDB.store(tmpDb->GetBaseDB(), std::memory_order_release);
     } else {
       rocksdb::TransactionDB* tmpDb = nullptr;
       rocksdb::TransactionDBOptions txnDbOptions;
@@ -1690,6 +1941,7 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
       binlog_iter.reset(tmpDb->GetBaseDB()->NewIterator(
         readOpts, getBinlogColumnFamilyHandle()));
       _pesdb.reset(tmpDb);
+      _baseDB.store(tmpDb->GetBaseDB(), std::memory_order_release);
     }
     // NOTE(deyukong): during starttime, mutex is held and
     // no need to consider visibility
@@ -1800,7 +2052,8 @@ RocksKVStore::RocksKVStore(const std::string& id,
                            bool enableRepllog,
                            KVStore::StoreMode mode,
                            TxnMode txnMode,
-                           uint32_t flag)
+                           uint32_t flag,
+                           std::shared_ptr<rocksdb::WriteBufferManager> wbm)
   : KVStore(id, cfg->dbPath),
     _cfg(cfg),
     _isRunning(false),
@@ -1812,8 +2065,11 @@ RocksKVStore::RocksKVStore(const std::string& id,
     _txnMode(txnMode),
     _optdb(nullptr),
     _pesdb(nullptr),
+    _baseDB(nullptr),
     _stats(rocksdb::CreateDBStatistics()),
     _blockCache(blockCache),
+    _writeBufferManager(wbm),
+    _backgroundCompactions(8),
     _nextTxnSeq(0),
     _highestVisible(Transaction::TXNID_UNINITED),
     _logOb(nullptr),
@@ -1821,6 +2077,12 @@ RocksKVStore::RocksKVStore(const std::string& id,
   if (_cfg->noexpire) {
     _enableFilter = false;
   }
+  if (_cfg->zsetNodeCacheSize > 0) {
+    _skipListCache = std::make_shared<SkipListCache>(_cfg->zsetNodeCacheSize);
+  }
+  if (_cfg->incrMergeMode) {
+    _counterCache = std::make_shared<CounterCache>(_cfg->incrMergeCacheKeys);
+  }
 
   Expected<uint64_t> s =
     restart(false, Transaction::MIN_VALID_TXNID, UINT64_MAX, flag);
@@ -1850,6 +2112,73 @@ Status RocksKVStore::releaseBackup() {
   }
 }
 
+namespace {
+Expected<std::map<std::string, uint64_t>> listBackupFiles(
+  const std::string& dir) {
+  std::map<std::string, uint64_t> flist;
+  try {
+    for (auto& p : filesystem::recursive_directory_iterator(dir)) {
+      const filesystem::path& path = p.path();
+      if (!filesystem::is_regular_file(p)) {
+        LOG(INFO) << "backup ignore:" << p.path();
+        continue;
+      }
+      size_t filesize = filesystem::file_size(path);
+#ifndef _WIN32
+      // assert path with bkupdir prefix
+      // for win32, the dir should change to "\\"
+      INVARIANT(path.string().find(dir) == 0);
+#endif
+      std::string relative = path.string().erase(0, dir.size());
+      flist[relative] = filesize;
+    }
+  } catch (const std::exception& ex) {
+    return {ErrorCodes::ERR_INTERNAL, ex.what()};
+  }
+  return flist;
+}
+
+bool isSstFile(const std::string& name) {
+  const std::string suffix = ".sst";
+  return name.size() > suffix.size() &&
+    name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// the first size bytes of src, the file may be still appended
+Status copyFilePrefix(const std::string& src,
+                      const std::string& dst,
+                      uint64_t size) {
+  std::ifstream in(src, std::ios::binary);
+  if (!in.is_open()) {
+    return {ErrorCodes::ERR_INTERNAL, "open file failed:" + src};
+  }
+  std::ofstream out(dst, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    return {ErrorCodes::ERR_INTERNAL, "open file failed:" + dst};
+  }
+  std::vector<char> buf(1024 * 1024);
+  while (size > 0) {
+    auto n = std::min<uint64_t>(size, buf.size());
+    if (!in.read(buf.data(), n)) {
+      return {ErrorCodes::ERR_INTERNAL, "read file failed:" + src};
+    }
+    out.write(buf.data(), n);
+    size -= n;
+  }
+  out.close();
+  if (!out) {
+    return {ErrorCodes::ERR_INTERNAL, "write file failed:" + dst};
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+bool linkFile(const std::string& src, const std::string& dst) {
+  std::error_code ec;
+  filesystem::create_hard_link(src, dst, ec);
+  return !ec;
+}
+}  // namespace
+
 // this function guarantees that:
 // If backup failed, there should be no remaining dirs left to clean,
 // and the _hasBackup flag set to false
@@ -1913,6 +2242,10 @@ Expected<BackupInfo> RocksKVStore::backup(const std::string& dir,
     if (!s.ok()) {
       return {ErrorCodes::ERR_INTERNAL, s.ToString()};
     }
+    auto recorded = recordSstFiles(dir, &result);
+    if (!recorded.ok()) {
+      return recorded;
+    }
   } else {
     rocksdb::BackupEngine* bkEngine = nullptr;
     auto s = rocksdb::BackupEngine::Open(
@@ -1928,34 +2261,223 @@ Expected<BackupInfo> RocksKVStore::backup(const std::string& dir,
       return {ErrorCodes::ERR_INTERNAL, s.ToString()};
     }
   }
-  std::map<std::string, uint64_t> flist;
-  try {
-    for (auto& p : filesystem::recursive_directory_iterator(dir)) {
-      const filesystem::path& path = p.path();
-      if (!filesystem::is_regular_file(p)) {
-        LOG(INFO) << "backup ignore:" << p.path();
+  auto flist = listBackupFiles(dir);
+  if (!flist.ok()) {
+    return flist.status();
+  }
+  result.setFileList(flist.value());
+  result.setEndTimeSec(sinceEpoch());
+  result.setBackupMode((uint32_t)mode);
+  result.setBinlogVersion(binlogVersion);
+  auto saveret = saveBackupMeta(dir, &result);
+  if (!saveret.ok()) {
+    return saveret.status();
+  }
+  succ = true;
+  return result;
+}
+
+Status RocksKVStore::recordSstFiles(const std::string& dir,
+                                    BackupInfo* result) {
+  std::string identity;
+  auto s = getBaseDB()->GetDbIdentity(identity);
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  result->setDbIdentity(identity);
+  std::vector<rocksdb::LiveFileMetaData> metadata;
+  getBaseDB()->GetLiveFilesMetaData(&metadata);
+  for (const auto& m : metadata) {
+    // the files compacted after the checkpoint are not in dir
+    std::error_code ec;
+    auto size = filesystem::file_size(dir + m.name, ec);
+    if (ec || size != m.size) {
+      continue;
+    }
+    result->addSstFile(m.name, {m.size, m.smallest_seqno, m.largest_seqno});
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// the incremental backup is a db dir like a checkpoint, made of the live
+// files of the db, with the file deletions disabled meanwhile. an sst file
+// is linked from the base backup only if the base is a backup of this db,
+// by the db identity, and has the file of the same number, size and
+// sequence numbers, as the number of a file is never reused in a db. the
+// other sst files are linked from the db if possible, or copied. the
+// backup is a complete db dir, restoring it or removing the base later
+// doesn't need the other one.
+Expected<BackupInfo> RocksKVStore::backupIncr(const std::string& dir,
+                                              const std::string& baseDir,
+                                              BinlogVersion binlogVersion) {
+  if (dir == dftBackupDir() || baseDir == dftBackupDir()) {
+    return {ErrorCodes::ERR_INTERNAL,
+            "BACKUP_INCR cant use dftBackupDir:" + dftBackupDir()};
+  }
+  auto baseMeta = getBackupMeta(baseDir);
+  if (!baseMeta.ok()) {
+    return baseMeta.status();
+  }
+  auto baseMode = baseMeta.value().getBackupMode();
+  if (baseMode != (uint32_t)KVStore::BackupMode::BACKUP_CKPT &&
+      baseMode != (uint32_t)KVStore::BackupMode::BACKUP_INCR) {
+    return {ErrorCodes::ERR_INTERNAL,
+            "base backup should be ckpt or incr:" + baseDir};
+  }
+  // the guard below removes dir, never touch a dir we don't create
+  if (filesystem::exists(dir)) {
+    return {ErrorCodes::ERR_INTERNAL, "Directory exists:" + dir};
+  }
+
+  bool succ = false;
+  auto guard = MakeGuard([&dir, &succ]() {
+    if (succ) {
+      return;
+    }
+    std::error_code ec;
+    filesystem::remove_all(dir, ec);
+  });
+  std::error_code ec;
+  filesystem::create_directories(dir, ec);
+  if (ec) {
+    return {ErrorCodes::ERR_INTERNAL, "create " + dir + ":" + ec.message()};
+  }
+
+  BackupInfo result;
+  uint64_t highVisible = getHighestBinlogId();
+  if (highVisible == Transaction::TXNID_UNINITED) {
+    LOG(WARNING) << "store:" << dbId() << " highVisible still zero";
+  }
+  result.setBinlogPos(highVisible);
+  result.setStartTimeSec(sinceEpoch());
+
+  auto db = getBaseDB();
+  auto s = db->DisableFileDeletions();
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  // undo this call only, other backups may disable them too
+  auto deletionGuard = MakeGuard([db]() { db->EnableFileDeletions(false); });
+
+  std::vector<std::string> liveFiles;
+  uint64_t manifestSize = 0;
+  s = db->GetLiveFiles(liveFiles, &manifestSize, true);
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  rocksdb::VectorLogPtr walFiles;
+  s = db->GetSortedWalFiles(walFiles);
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  std::string identity;
+  s = db->GetDbIdentity(identity);
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  result.setDbIdentity(identity);
+  std::vector<rocksdb::LiveFileMetaData> metadata;
+  db->GetLiveFilesMetaData(&metadata);
+  std::map<std::string, BackupInfo::SstFile> sstFiles;
+  for (const auto& m : metadata) {
+    sstFiles[m.name] = {m.size, m.smallest_seqno, m.largest_seqno};
+  }
+
+  // the base of another db may have the files of the same names
+  bool sameDb = baseMeta.value().getDbIdentity() == identity;
+  if (!sameDb) {
+    LOG(WARNING) << "store:" << dbId() << " base:" << baseDir
+                 << " is not a backup of this db, nothing is shared";
+  }
+  const auto& baseSstFiles = baseMeta.value().getSstFiles();
+  const std::string& dbDir = db->GetName();
+  std::string manifest;
+  uint32_t linked = 0;
+  for (const auto& f : liveFiles) {
+    std::string src = dbDir + f;
+    std::string dst = dir + f;
+    if (isSstFile(f)) {
+      auto it = sstFiles.find(f);
+      if (it == sstFiles.end()) {
+        return {ErrorCodes::ERR_INTERNAL, "no metadata of " + src};
+      }
+      result.addSstFile(f, it->second);
+      auto baseIt = baseSstFiles.find(f);
+      if (sameDb && baseIt != baseSstFiles.end() &&
+          baseIt->second == it->second && linkFile(baseDir + f, dst)) {
+        linked++;
         continue;
       }
-      size_t filesize = filesystem::file_size(path);
-#ifndef _WIN32
-      // assert path with bkupdir prefix
-      // for win32, the dir should change to "\\"
-      INVARIANT(path.string().find(dir) == 0);
-#endif
-      std::string relative = path.string().erase(0, dir.size());
-      flist[relative] = filesize;
+      if (linkFile(src, dst)) {
+        continue;
+      }
+      auto copied = copyFilePrefix(src, dst, it->second.size);
+      if (!copied.ok()) {
+        return copied;
+      }
+    } else if (f == "/CURRENT") {
+      // written after the manifest is copied
+      continue;
+    } else if (f.compare(0, 10, "/MANIFEST-") == 0) {
+      manifest = f.substr(1);
+      auto copied = copyFilePrefix(src, dst, manifestSize);
+      if (!copied.ok()) {
+        return copied;
+      }
+    } else {
+      auto size = filesystem::file_size(src, ec);
+      if (ec) {
+        return {ErrorCodes::ERR_INTERNAL, src + ":" + ec.message()};
+      }
+      auto copied = copyFilePrefix(src, dst, size);
+      if (!copied.ok()) {
+        return copied;
+      }
     }
-  } catch (const std::exception& ex) {
-    return {ErrorCodes::ERR_INTERNAL, ex.what()};
   }
-  result.setFileList(flist);
+  if (manifest.empty()) {
+    return {ErrorCodes::ERR_INTERNAL, "no manifest in the live files"};
+  }
+  {
+    std::ofstream current(dir + "/CURRENT", std::ios::trunc);
+    current << manifest << "\n";
+    current.close();
+    if (!current) {
+      return {ErrorCodes::ERR_INTERNAL, "write " + dir + "/CURRENT failed"};
+    }
+  }
+  // the writes after the memtables are flushed
+  const auto& walDir =
+    db->GetOptions().wal_dir.empty() ? dbDir : db->GetOptions().wal_dir;
+  for (const auto& wal : walFiles) {
+    if (wal->Type() != rocksdb::WalFileType::kAliveLogFile) {
+      continue;
+    }
+    auto copied = copyFilePrefix(
+      walDir + wal->PathName(), dir + wal->PathName(), wal->SizeFileBytes());
+    if (!copied.ok()) {
+      return copied;
+    }
+  }
+  deletionGuard.Dismiss();
+  db->EnableFileDeletions(false);
+
+  auto flist = listBackupFiles(dir);
+  if (!flist.ok()) {
+    return flist.status();
+  }
+  result.setFileList(flist.value());
   result.setEndTimeSec(sinceEpoch());
-  result.setBackupMode((uint32_t)mode);
+  result.setBackupMode((uint32_t)KVStore::BackupMode::BACKUP_INCR);
   result.setBinlogVersion(binlogVersion);
+  result.setBaseDir(baseDir);
   auto saveret = saveBackupMeta(dir, &result);
   if (!saveret.ok()) {
     return saveret.status();
   }
+  LOG(INFO) << "store:" << dbId() << " incremental backup to " << dir
+            << " base:" << baseDir << " files:" << flist.value().size()
+            << " linked from base:" << linked;
   succ = true;
   return result;
 }
@@ -1977,6 +2499,26 @@ Expected<std::string> RocksKVStore::saveBackupMeta(const std::string& dir,
   writer.Uint64(backup->getEndTimeSec() - backup->getStartTimeSec());
   writer.Key("binlogVersion");
   writer.Uint64((uint64_t)backup->getBinlogVersion());
+  if (!backup->getBaseDir().empty()) {
+    writer.Key("baseDir");
+    writer.String(backup->getBaseDir());
+  }
+  if (!backup->getDbIdentity().empty()) {
+    writer.Key("dbIdentity");
+    writer.String(backup->getDbIdentity());
+    // file -> [size, smallest seqno, largest seqno]
+    writer.Key("sstFiles");
+    writer.StartObject();
+    for (const auto& kv : backup->getSstFiles()) {
+      writer.Key(kv.first);
+      writer.StartArray();
+      writer.Uint64(kv.second.size);
+      writer.Uint64(kv.second.smallestSeqno);
+      writer.Uint64(kv.second.largestSeqno);
+      writer.EndArray();
+    }
+    writer.EndObject();
+  }
   writer.EndObject();
   string data = sb.GetString();
 
@@ -2053,6 +2595,32 @@ Expected<BackupInfo> RocksKVStore::getBackupMeta(const std::string& dir) {
       } else {
         return {ErrorCodes::ERR_PARSEOPT, "Invalid backup meta"};
       }
+    } else if (o.name == "baseDir") {
+      if (o.value.IsString()) {
+        bkInfo.setBaseDir(o.value.GetString());
+      } else {
+        return {ErrorCodes::ERR_PARSEOPT, "Invalid backup meta"};
+      }
+    } else if (o.name == "dbIdentity") {
+      if (o.value.IsString()) {
+        bkInfo.setDbIdentity(o.value.GetString());
+      } else {
+        return {ErrorCodes::ERR_PARSEOPT, "Invalid backup meta"};
+      }
+    } else if (o.name == "sstFiles") {
+      if (!o.value.IsObject()) {
+        return {ErrorCodes::ERR_PARSEOPT, "Invalid backup meta"};
+      }
+      for (auto& f : o.value.GetObject()) {
+        const auto& v = f.value;
+        if (!v.IsArray() || v.Size() != 3 || !v[0u].IsUint64() ||
+            !v[1u].IsUint64() || !v[2u].IsUint64()) {
+          return {ErrorCodes::ERR_PARSEOPT, "Invalid backup meta"};
+        }
+        bkInfo.addSstFile(
+          f.name.GetString(),
+          {v[0u].GetUint64(), v[1u].GetUint64(), v[2u].GetUint64()});
+      }
     }
   }
   return bkInfo;
@@ -2065,7 +2633,8 @@ Expected<std::string> RocksKVStore::restoreBackup(const std::string& dir) {
   }
 
   uint32_t mode = backup_meta.value().getBackupMode();
-  if (mode == (uint32_t)KVStore::BackupMode::BACKUP_CKPT) {
+  if (mode == (uint32_t)KVStore::BackupMode::BACKUP_CKPT ||
+      mode == (uint32_t)KVStore::BackupMode::BACKUP_INCR) {
     return copyCkpt(dir);
   } else if (mode == (uint32_t)KVStore::BackupMode::BACKUP_COPY) {
     return loadCopy(dir);
@@ -2119,6 +2688,12 @@ Expected<std::string> RocksKVStore::copyCkpt(const std::string& dir) {
 
 Expected<std::unique_ptr<Transaction>> RocksKVStore::createTransaction(
   Session* sess) {
+  if (sess) {
+    auto parent = sess->getCtx()->getNestedTxn(dbId());
+    if (parent) {
+      return std::unique_ptr<Transaction>(new NestedTransaction(parent));
+    }
+  }
   std::lock_guard<std::mutex> lk(_mutex);
   if (!_isRunning) {
     return {ErrorCodes::ERR_INTERNAL, "db stopped!"};
@@ -2195,6 +2770,26 @@ uint64_t RocksKVStore::getNextBinlogSeq() const {
   return _nextBinlogSeq;
 }
 
+Expected<std::string> RocksKVStore::getCommittedKV(
+  const std::string& key) const {
+  auto db = _baseDB.load(std::memory_order_acquire);
+  if (db == nullptr) {
+    return {ErrorCodes::ERR_INTERNAL, "store not open"};
+  }
+  rocksdb::ReadOptions readOpts;
+  // the compaction shouldn't evict the blocks of the foreground reads
+  readOpts.fill_cache = false;
+  std::string value;
+  auto s = db->Get(readOpts, key, &value);
+  if (s.IsNotFound()) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  return value;
+}
+
 rocksdb::DB* RocksKVStore::getBaseDB() const {
   return _optdb.get() ? _optdb->GetBaseDB() : _pesdb->GetBaseDB();
 }
@@ -2283,6 +2878,27 @@ Expected<RecordValue> RocksKVStore::getKV(const RecordKey& key,
   return eValue;
 }
 
+std::vector<Expected<RecordValue>> RocksKVStore::multiGetKV(
+  const std::vector<RecordKey>& keys, Transaction* txn) {
+  INVARIANT_D(txn->getKVStoreId() == dbId());
+  std::vector<std::string> encoded;
+  encoded.reserve(keys.size());
+  for (const auto& key : keys) {
+    encoded.emplace_back(key.encode());
+  }
+
+  std::vector<Expected<RecordValue>> result;
+  result.reserve(keys.size());
+  for (auto& v : txn->multiGetKV(encoded)) {
+    if (!v.ok()) {
+      result.emplace_back(v.status());
+    } else {
+      result.emplace_back(RecordValue::decode(v.value()));
+    }
+  }
+  return result;
+}
+
 Status RocksKVStore::setKV(const RecordKey& key,
                            const RecordValue& value,
                            Transaction* txn) {
@@ -2310,6 +2926,13 @@ Status RocksKVStore::delKV(const RecordKey& key, Transaction* txn) {
   return txn->delKV(key.encode());
 }
 
+Status RocksKVStore::mergeKV(const RecordKey& key,
+                             const RecordValue& operand,
+                             Transaction* txn) {
+  INVARIANT_D(txn->getKVStoreId() == dbId());
+  return txn->mergeKV(key.encode(), operand.encode());
+}
+
 Status RocksKVStore::deleteRange(const std::string& begin,
                                  const std::string& end) {
   // NOTE(takenliu) be care of db::DeleteRange and add binlog are not atomic
@@ -2350,9 +2973,37 @@ Status RocksKVStore::deleteRangeWithoutBinlog(
     LOG(ERROR) << "deleteRange failed:" << s.ToString();
     return {ErrorCodes::ERR_INTERNAL, s.ToString()};
   }
+  if (_counterCache && column_family == getDataColumnFamilyHandle()) {
+    _counterCache->clear();
+  }
   return {ErrorCodes::ERR_OK, ""};
 }
 
+Status RocksKVStore::deleteFilesInRange(const std::string& begin,
+                                        const std::string& end) {
+  rocksdb::Slice sBegin(begin);
+  rocksdb::Slice sEnd(end);
+  auto s = rocksdb::DeleteFilesInRange(
+    getBaseDB(), getDataColumnFamilyHandle(), &sBegin, &sEnd, false);
+  if (!s.ok()) {
+    LOG(ERROR) << "deleteFilesInRange failed:" << s.ToString();
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  if (_counterCache) {
+    _counterCache->clear();
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+uint64_t RocksKVStore::getApproximateSize(const std::string& begin,
+                                          const std::string& end) {
+  rocksdb::Range range(begin, end);
+  uint64_t size = 0;
+  getBaseDB()->GetApproximateSizes(
+    getDataColumnFamilyHandle(), &range, 1, &size);
+  return size;
+}
+
 Status RocksKVStore::deleteRangeBinlog(uint64_t begin, uint64_t end) {
   ReplLogKeyV2 beginKey(begin);
   ReplLogKeyV2 endKey(end);
@@ -2422,10 +3073,16 @@ void RocksKVStore::initRocksProperties() {
 }
 
 bool RocksKVStore::getIntProperty(const std::string& property,
-                                  uint64_t* value) const {
+                                  uint64_t* value,
+                                  ColumnFamilyNumber cf) const {
   bool ok = false;
   if (_isRunning) {
-    ok = getBaseDB()->GetIntProperty(property, value);
+    auto handle = _cfHandles[0];
+    if (cf == ColumnFamilyNumber::ColumnFamily_Binlog &&
+        !_cfg->binlogUsingDefaultCF) {
+      handle = _cfHandles[1];
+    }
+    ok = getBaseDB()->GetIntProperty(handle, property, value);
     if (!ok) {
       LOG(WARNING) << "db:" << dbId() << " getProperty:" << property
                    << " failed";
@@ -2618,6 +3275,10 @@ void RocksKVStore::appendJSONStat(
   w.Uint64(stat.compactFilterCount.load(std::memory_order_relaxed));
   w.Key("compact_kvexpired_count");
   w.Uint64(stat.compactKvExpiredCount.load(std::memory_order_relaxed));
+  w.Key("compact_eleexpired_count");
+  w.Uint64(stat.compactEleExpiredCount.load(std::memory_order_relaxed));
+  w.Key("compact_ttlindex_stale_count");
+  w.Uint64(stat.compactTtlIndexStaleCount.load(std::memory_order_relaxed));
   w.Key("paused_error_count");
   w.Uint64(stat.pausedErrorCount.load(std::memory_order_relaxed));
   w.Key("destroyed_error_count");
@@ -17,6 +17,7 @@
 #include <list>
 
 #include "rocksdb/db.h"
+#include "rocksdb/write_buffer_manager.h"
 #include "rocksdb/utilities/transaction.h"
 #include "rocksdb/utilities/optimistic_transaction_db.h"
 #include "rocksdb/utilities/transaction_db.h"
@@ -43,7 +44,9 @@ class RocksTxn : public Transaction {
   RocksTxn(RocksTxn&&) = delete;
   virtual ~RocksTxn();
   std::unique_ptr<Cursor> createCursor(
-    ColumnFamilyNumber cf, const std::string* iterate_upper_bound = NULL) final;
+    ColumnFamilyNumber cf,
+    const std::string* iterate_upper_bound = NULL,
+    size_t readahead_size = 0) final;
 #ifdef BINLOG_V1
   std::unique_ptr<BinlogCursor> createBinlogCursor(
     uint64_t begin, bool ignoreReadBarrier) final;
@@ -56,18 +59,29 @@ class RocksTxn : public Transaction {
   std::unique_ptr<SlotsCursor> createSlotsCursor(uint32_t start,
                                                  uint32_t end) final;
   std::unique_ptr<VersionMetaCursor> createVersionMetaCursor() final;
-  std::unique_ptr<BasicDataCursor> createDataCursor() final;
+  std::unique_ptr<BasicDataCursor> createDataCursor(
+    size_t readahead_size = 0) final;
+  std::unique_ptr<PrefixCursor> createPrefixCursor(
+    const std::string& prefix, size_t readahead_size = 0) final;
   std::unique_ptr<AllDataCursor> createAllDataCursor() final;
   std::unique_ptr<BinlogCursor> createBinlogCursor() final;
 
   Expected<uint64_t> commit() final;
   Status rollback() final;
+  void setSavePoint() final;
+  Status rollbackToSavePoint() final;
+  Status popSavePoint() final;
   // getKV: get data from chosen column family
   Expected<std::string> getKV(const std::string& key) final;
+  std::vector<Expected<std::string>> multiGetKV(
+    const std::vector<std::string>& keys) final;
   Status setKV(const std::string& key,
                const std::string& val,
                const uint64_t ts = 0) final;
   Status delKV(const std::string& key, const uint64_t ts = 0) final;
+  Status mergeKV(const std::string& key,
+                 const std::string& operand,
+                 const uint64_t ts = 0) final;
   Status addDeleteRangeBinlog(const std::string& begin,
                               const std::string& end) final;
 #ifdef BINLOG_V1
@@ -112,8 +126,9 @@ class RocksTxn : public Transaction {
   uint32_t _chunkId;
   // NOTE(deyukong): I believe rocksdb does clean job in txn's destructor
   std::unique_ptr<rocksdb::Transaction> _txn;
-  string _strUpperBound;
-  rocksdb::Slice _upperBound;
+  // the upper bounds of the cursors, the iterators keep pointers to them
+  std::list<string> _strUpperBounds;
+  std::list<rocksdb::Slice> _upperBounds;
 
   // NOTE(deyukong): not owned by me
   RocksKVStore* _store;
@@ -124,6 +139,16 @@ class RocksTxn : public Transaction {
 #else
   std::vector<ReplLogValueEntryV2> _replLogValues;
 #endif
+  // the size of _replLogValues at each save point
+  std::vector<size_t> _savePoints;
+  // the chunks of the deleted keys, counted in the stat of the store when
+  // they are committed
+  std::vector<uint32_t> _deletedChunks;
+  // the size of _deletedChunks at each save point
+  std::vector<size_t> _deleteSavePoints;
+  // the rocksdb save points above each save point which are popped but
+  // still kept by a rocksdb without Transaction::PopSavePoint()
+  std::vector<size_t> _staleSavePoints;
 
   // if rollback/commit has been explicitly called
   bool _done;
@@ -180,13 +205,21 @@ class RocksKVCursor : public Cursor {
   explicit RocksKVCursor(std::unique_ptr<rocksdb::Iterator>);
   virtual ~RocksKVCursor() = default;
   void seek(const std::string& prefix) final;
+  void seekForPrev(const std::string& target) final;
   void seekToLast() final;
   Expected<Record> next() final;
+  Status nextRaw(mystring_view* key, mystring_view* value) final;
   Status prev() final;
   Expected<std::string> key() final;
 
  private:
+  // the iterator moves past the record next() or nextRaw() returned when
+  // the cursor is used again, the key and the value of it are valid until
+  // then
+  void skipPending();
+
   std::unique_ptr<rocksdb::Iterator> _it;
+  bool _pending;
 };
 
 typedef struct sstMetaData {
@@ -211,7 +244,9 @@ class RocksKVStore : public KVStore {
                bool enableRepllog = true,
                KVStore::StoreMode mode = KVStore::StoreMode::READ_WRITE,
                TxnMode txnMode = TxnMode::TXN_PES,
-               uint32_t flag = 0);
+               uint32_t flag = 0,
+               std::shared_ptr<rocksdb::WriteBufferManager> writeBufferManager =
+                 nullptr);
   virtual ~RocksKVStore() {
     stop();
   }
@@ -220,6 +255,8 @@ class RocksKVStore : public KVStore {
   Expected<RecordValue> getKV(const RecordKey& key,
                               Transaction* txn,
                               RecordType valueType) final;
+  std::vector<Expected<RecordValue>> multiGetKV(
+    const std::vector<RecordKey>& keys, Transaction* txn) final;
   Status setKV(const Record& kv, Transaction* txn) final;
   Status setKV(const RecordKey& key,
                const RecordValue& val,
@@ -228,8 +265,15 @@ class RocksKVStore : public KVStore {
                const std::string& val,
                Transaction* txn) final;
   Status delKV(const RecordKey& key, Transaction* txn) final;
+  Status mergeKV(const RecordKey& key,
+                 const RecordValue& operand,
+                 Transaction* txn) final;
   // [begin, end)
   Status deleteRange(const std::string& begin, const std::string& end) final;
+  Status deleteFilesInRange(const std::string& begin,
+                            const std::string& end) final;
+  uint64_t getApproximateSize(const std::string& begin,
+                              const std::string& end) final;
   Status deleteRangeWithoutBinlog(rocksdb::ColumnFamilyHandle* column_family,
                                   const std::string& begin,
                                   const std::string& end);
@@ -260,6 +304,10 @@ class RocksKVStore : public KVStore {
                       const std::string* begin,
                       const std::string* end) final;
   Status fullCompact() final;
+  Status setBackgroundCompactions(uint32_t num) final;
+  uint32_t getBackgroundCompactions() const final;
+  uint64_t getNumKeysRead() const final;
+  uint64_t getNumKeysWritten() const final;
   Status clear() final;
   bool isRunning() const final;
   Status stop() final;
@@ -297,6 +345,9 @@ class RocksKVStore : public KVStore {
   Expected<BackupInfo> backup(const std::string&,
                               KVStore::BackupMode,
                               BinlogVersion binlogVersion) final;
+  Expected<BackupInfo> backupIncr(const std::string& dir,
+                                  const std::string& baseDir,
+                                  BinlogVersion binlogVersion) final;
   Expected<std::string> restoreBackup(const std::string& dir) final;
   Expected<BackupInfo> getBackupMeta(const std::string& dir) final;
 
@@ -319,7 +370,10 @@ class RocksKVStore : public KVStore {
     return _cfg;
   }
 
-  bool getIntProperty(const std::string& property, uint64_t* value) const;
+  bool getIntProperty(
+    const std::string& property,
+    uint64_t* value,
+    ColumnFamilyNumber cf = ColumnFamilyNumber::ColumnFamily_Default) const;
   bool getProperty(const std::string& property, std::string* value) const;
   std::string getAllProperty() const override;
   std::string getStatistics() const override;
@@ -332,6 +386,10 @@ class RocksKVStore : public KVStore {
   Status setVersionMeta(const std::string& name,
                         uint64_t ts,
                         uint64_t version) override;
+  // the latest committed value of a key in the data column family, read
+  // out of any transaction for the compaction filter. It's ERR_INTERNAL
+  // if the store isn't open yet, or is being stopped.
+  Expected<std::string> getCommittedKV(const std::string& key) const;
   rocksdb::ColumnFamilyHandle* getDataColumnFamilyHandle() {
     return _cfHandles[0];
   }
@@ -352,6 +410,9 @@ class RocksKVStore : public KVStore {
   void initRocksProperties();
   Expected<std::string> saveBackupMeta(const std::string& dir,
                                        BackupInfo* result);
+  // the db identity and the sst files of the checkpoint in dir, for the
+  // incremental backups based on it
+  Status recordSstFiles(const std::string& dir, BackupInfo* result);
   Expected<std::string> loadCopy(const std::string& dir);
   Expected<std::string> copyCkpt(const std::string& dir);
 
@@ -374,9 +435,16 @@ class RocksKVStore : public KVStore {
 
   std::unique_ptr<rocksdb::OptimisticTransactionDB> _optdb;
   std::unique_ptr<rocksdb::TransactionDB> _pesdb;
+  // the base db of _optdb or _pesdb, for the compaction threads which
+  // can't take _mutex
+  std::atomic<rocksdb::DB*> _baseDB;
 
   std::shared_ptr<rocksdb::Statistics> _stats;
   std::shared_ptr<rocksdb::Cache> _blockCache;
+  // shared by the stores, nullptr if the memtables have no budget
+  std::shared_ptr<rocksdb::WriteBufferManager> _writeBufferManager;
+  // max_background_compactions, assigned by the CompactionScheduler
+  std::atomic<uint32_t> _backgroundCompactions;
 
   uint64_t _nextTxnSeq;
 #ifdef BINLOG_V1
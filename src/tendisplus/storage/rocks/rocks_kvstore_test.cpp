@@ -20,8 +20,10 @@
 #include "tendisplus/utils/scopeguard.h"
 #include "tendisplus/utils/portable.h"
 #include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/redis_port.h"
 #include "tendisplus/storage/rocks/rocks_kvstore.h"
 #include "tendisplus/storage/kvstore.h"
+#include "tendisplus/storage/counter_cache.h"
 #include "tendisplus/server/server_params.h"
 #include "tendisplus/utils/sync_point.h"
 #include "tendisplus/utils/time.h"
@@ -640,6 +642,303 @@ TEST(RocksKVStore, CursorUpperBound) {
   EXPECT_EQ(cnt, 20000);
 }
 
+TEST(RocksKVStore, CursorBackward) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+
+  std::vector<RecordKey> keys;
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+  for (auto pk : {"k1", "k2", "k3"}) {
+    keys.emplace_back(0, 0, RecordType::RT_KV, pk, "");
+    RecordValue rv("v", RecordType::RT_KV, -1);
+    EXPECT_TRUE(kvstore->setKV(keys.back(), rv, txn.get()).ok());
+  }
+  EXPECT_TRUE(txn->commit().ok());
+
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  txn = std::move(eTxn.value());
+  auto cursor = txn->createDataCursor();
+  auto nextKey = [&cursor]() {
+    auto v = cursor->next();
+    return v.ok() ? v.value().getRecordKey().getPrimaryKey() : "";
+  };
+  // on the last record not greater than the target
+  cursor->seekForPrev(keys[1].encode() + "z");
+  EXPECT_EQ(nextKey(), "k2");
+  // prev() goes back to the last record of the store returned by next()
+  EXPECT_EQ(nextKey(), "k3");
+  EXPECT_TRUE(cursor->prev().ok());
+  EXPECT_EQ(nextKey(), "k3");
+  EXPECT_TRUE(cursor->prev().ok());
+  EXPECT_TRUE(cursor->prev().ok());
+  EXPECT_EQ(nextKey(), "k2");
+  cursor->seekForPrev(keys[0].encode());
+  EXPECT_EQ(nextKey(), "k1");
+  EXPECT_TRUE(cursor->prev().ok());
+  EXPECT_TRUE(cursor->prev().ok());
+  EXPECT_EQ(cursor->next().status().code(), ErrorCodes::ERR_EXHAUST);
+}
+
+TEST(RocksKVStore, PrefixCursor) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+  // h10 follows h1 and h2 follows both
+  for (const auto& pk : {"h1", "h10", "h2"}) {
+    for (uint32_t i = 0; i < 100; i++) {
+      RecordKey rk(0, 0, RecordType::RT_HASH_ELE, pk, to_string(i + 1000));
+      RecordValue rv(string(pk) + to_string(i), RecordType::RT_HASH_ELE, -1);
+      EXPECT_TRUE(kvstore->setKV(rk, rv, txn.get()).ok());
+    }
+  }
+  EXPECT_TRUE(txn->commit().ok());
+
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  txn = std::move(eTxn.value());
+  RecordKey h1(0, 0, RecordType::RT_HASH_ELE, "h1", "");
+  RecordKey h2(0, 0, RecordType::RT_HASH_ELE, "h2", "");
+  auto c1 = txn->createPrefixCursor(h1.prefixPk());
+  auto c2 = txn->createPrefixCursor(h2.prefixPk());
+  RecordKeyView rk1, rk2;
+  RecordValueView rv1, rv2;
+  uint32_t cnt = 0;
+  // the cursors are bounded by their own prefixes
+  while (true) {
+    auto s1 = c1->next(&rk1, &rv1);
+    auto s2 = c2->next(&rk2, &rv2);
+    if (s1.code() == ErrorCodes::ERR_EXHAUST) {
+      EXPECT_EQ(s2.code(), ErrorCodes::ERR_EXHAUST);
+      break;
+    }
+    EXPECT_TRUE(s1.ok() && s2.ok());
+    EXPECT_EQ(rk1.getPrimaryKey(), "h1");
+    EXPECT_EQ(rk2.getPrimaryKey(), "h2");
+    EXPECT_EQ(rk1.getSecondaryKey(), to_string(cnt + 1000));
+    EXPECT_EQ(rk1.getRecordType(), RecordType::RT_HASH_ELE);
+    EXPECT_EQ(rv1.getValue().value(), "h1" + to_string(cnt));
+    EXPECT_EQ(rv2.getValue().value(), "h2" + to_string(cnt));
+    auto rcdKey = rk2.toRecordKey();
+    EXPECT_TRUE(rcdKey.ok());
+    EXPECT_EQ(rcdKey.value().prefixPk(), h2.prefixPk());
+    cnt++;
+  }
+  EXPECT_EQ(cnt, 100U);
+
+  RecordKey from(0, 0, RecordType::RT_HASH_ELE, "h1", "1090");
+  c1->seek(from.encode());
+  cnt = 0;
+  while (c1->next(&rk1, &rv1).ok()) {
+    cnt++;
+  }
+  EXPECT_EQ(cnt, 10U);
+  // the target before the prefix starts at the prefix
+  c2->seek(h1.prefixPk());
+  EXPECT_TRUE(c2->next(&rk2, &rv2).ok());
+  EXPECT_EQ(rk2.getPrimaryKey(), "h2");
+
+  EXPECT_EQ(PrefixCursor::upperBound("ab"), "ac");
+  EXPECT_EQ(PrefixCursor::upperBound(string("a\xff", 2)), "b");
+  EXPECT_EQ(PrefixCursor::upperBound(string("\xff\xff", 2)), "");
+}
+
+TEST(RocksKVStore, MergeCounter) {
+  auto cfg = genParams();
+  cfg->incrMergeMode = true;
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+  auto counters = kvstore->getCounterCache();
+  EXPECT_NE(counters, nullptr);
+
+  RecordKey rk(0, 0, RecordType::RT_KV, "c", "");
+  RecordKey rkStr(0, 0, RecordType::RT_KV, "s", "");
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+  EXPECT_TRUE(kvstore
+                ->setKV(rkStr, RecordValue("abc", RecordType::RT_KV, -1),
+                        txn.get())
+                .ok());
+  for (int64_t delta : {1, 2, 3, -10}) {
+    RecordValue operand(to_string(delta), RecordType::RT_KV, -1);
+    EXPECT_TRUE(kvstore->mergeKV(rk, operand, txn.get()).ok());
+    EXPECT_TRUE(kvstore->mergeKV(rkStr, operand, txn.get()).ok());
+  }
+  EXPECT_TRUE(txn->commit().ok());
+
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  txn = std::move(eTxn.value());
+  auto rv = kvstore->getKV(rk, txn.get());
+  EXPECT_TRUE(rv.ok());
+  EXPECT_EQ(rv.value().getValue(), "-4");
+  EXPECT_EQ(rv.value().getRecordType(), RecordType::RT_KV);
+  // a value not an integer is kept
+  rv = kvstore->getKV(rkStr, txn.get());
+  EXPECT_TRUE(rv.ok());
+  EXPECT_EQ(rv.value().getValue(), "abc");
+
+  // the delta is in the binlog
+  auto bcursor = txn->createRepllogCursorV2(Transaction::MIN_VALID_TXNID);
+  EXPECT_TRUE(bcursor->seekToLast().ok());
+  auto v = bcursor->nextV2();
+  EXPECT_TRUE(v.ok());
+  const auto& entrys = v.value().getReplLogValueEntrys();
+  EXPECT_EQ(entrys.size(), 9U);
+  EXPECT_EQ(entrys.back().getOp(), ReplOp::REPL_OP_MERGE);
+  EXPECT_EQ(entrys.back().getOpKey(), rkStr.encode());
+
+  // any other write drops the cached counter
+  int64_t cached = 0;
+  counters->put(rk.encode(), -4);
+  EXPECT_TRUE(counters->get(rk.encode(), &cached));
+  EXPECT_EQ(cached, -4);
+  EXPECT_TRUE(kvstore->delKV(rk, txn.get()).ok());
+  EXPECT_FALSE(counters->get(rk.encode(), &cached));
+  EXPECT_TRUE(txn->commit().ok());
+}
+
+TEST(RocksKVStore, SavePoint) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+  auto set = [&](const std::string& key) {
+    RecordKey rk(0, 0, RecordType::RT_KV, key, "");
+    RecordValue rv("v", RecordType::RT_KV, -1);
+    EXPECT_TRUE(kvstore->setKV(rk, rv, txn.get()).ok());
+  };
+  auto exists = [&](const std::string& key) {
+    RecordKey rk(0, 0, RecordType::RT_KV, key, "");
+    return kvstore->getKV(rk, txn.get()).ok();
+  };
+
+  EXPECT_EQ(txn->popSavePoint().code(), ErrorCodes::ERR_NOTFOUND);
+  set("a");
+  txn->setSavePoint();
+  set("b");
+  txn->setSavePoint();
+  set("c");
+  // a popped save point keeps its writes
+  EXPECT_TRUE(txn->popSavePoint().ok());
+  EXPECT_TRUE(exists("c"));
+  txn->setSavePoint();
+  set("d");
+  EXPECT_TRUE(txn->popSavePoint().ok());
+  // the outer save point undoes the writes of the popped ones
+  EXPECT_TRUE(txn->rollbackToSavePoint().ok());
+  EXPECT_TRUE(exists("a"));
+  EXPECT_FALSE(exists("b"));
+  EXPECT_FALSE(exists("c"));
+  EXPECT_FALSE(exists("d"));
+  EXPECT_EQ(txn->rollbackToSavePoint().code(), ErrorCodes::ERR_NOTFOUND);
+
+  txn->setSavePoint();
+  set("e");
+  EXPECT_TRUE(txn->popSavePoint().ok());
+  txn->setSavePoint();
+  set("f");
+  EXPECT_TRUE(txn->rollbackToSavePoint().ok());
+  EXPECT_TRUE(txn->commit().ok());
+
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  txn = std::move(eTxn.value());
+  EXPECT_TRUE(exists("a"));
+  EXPECT_TRUE(exists("e"));
+  EXPECT_FALSE(exists("b"));
+  EXPECT_FALSE(exists("f"));
+}
+
+TEST(RocksKVStore, WriteBufferManager) {
+  auto cfg = genParams();
+  cfg->rocksCacheIndexAndFilterBlocks = true;
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache = rocksdb::NewLRUCache(64 * 1024 * 1024LL, 4, false, 0.1);
+  auto wbm =
+    std::make_shared<rocksdb::WriteBufferManager>(16 * 1024 * 1024, blockCache);
+  std::vector<std::unique_ptr<RocksKVStore>> stores;
+  for (auto id : {"0", "1"}) {
+    stores.emplace_back(
+      std::make_unique<RocksKVStore>(id,
+                                     cfg,
+                                     blockCache,
+                                     true,
+                                     KVStore::StoreMode::READ_WRITE,
+                                     RocksKVStore::TxnMode::TXN_PES,
+                                     0,
+                                     wbm));
+  }
+
+  auto eTxn = stores[0]->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+  for (uint32_t i = 0; i < 1000; i++) {
+    RecordKey rk(0, 0, RecordType::RT_KV, to_string(i), "");
+    RecordValue rv(string(1024, 'v'), RecordType::RT_KV, -1);
+    EXPECT_TRUE(stores[0]->setKV(rk, rv, txn.get()).ok());
+  }
+  EXPECT_TRUE(txn->commit().ok());
+
+  // the memtables of both stores are charged to the shared cache
+  EXPECT_GT(wbm->memory_usage(), 1000U * 1024);
+  EXPECT_GE(blockCache->GetUsage(), wbm->memory_usage());
+  const std::string property = "rocksdb.cur-size-all-mem-tables";
+  uint64_t data = 0, binlog = 0, idle = 0;
+  EXPECT_TRUE(stores[0]->getIntProperty(
+    property, &data, ColumnFamilyNumber::ColumnFamily_Default));
+  EXPECT_TRUE(stores[0]->getIntProperty(
+    property, &binlog, ColumnFamilyNumber::ColumnFamily_Binlog));
+  EXPECT_TRUE(stores[1]->getIntProperty(property, &idle));
+  EXPECT_GT(data, 1000U * 1024);
+  EXPECT_GT(binlog, 0U);
+  EXPECT_LT(idle, data);
+}
+
 TEST(RocksKVStore, BackupCkptInter) {
   auto cfg = genParams();
   EXPECT_TRUE(filesystem::create_directory("db"));
@@ -782,6 +1081,135 @@ TEST(RocksKVStore, BackupCkpt) {
   testMaxBinlogId(kvstore);
 }
 
+TEST(RocksKVStore, BackupIncr) {
+  auto cfg = genParams();
+  string backup_dir = "backup";
+  string incr_dir = "backup_incr";
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+
+  string other_dir = "backup_other";
+  string other_incr_dir = "backup_other_incr";
+  const auto guard =
+    MakeGuard([backup_dir, incr_dir, other_dir, other_incr_dir] {
+      filesystem::remove_all("./log");
+      filesystem::remove_all("./db");
+      filesystem::remove_all(backup_dir);
+      filesystem::remove_all(incr_dir);
+      filesystem::remove_all(other_dir);
+      filesystem::remove_all(other_incr_dir);
+    });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+  auto binlogversion = cfg->binlogUsingDefaultCF
+    ? BinlogVersion::BINLOG_VERSION_1
+    : BinlogVersion::BINLOG_VERSION_2;
+
+  auto setStoreKV = [](RocksKVStore* store, const std::string& key) {
+    auto eTxn = store->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    Status s =
+      store->setKV(Record(RecordKey(0, 0, RecordType::RT_KV, key, ""),
+                          RecordValue(key, RecordType::RT_KV, -1)),
+                   eTxn.value().get());
+    EXPECT_TRUE(s.ok());
+    auto eCommit = eTxn.value()->commit();
+    EXPECT_TRUE(eCommit.ok());
+    return eCommit.value();
+  };
+  auto setKV = [&](const std::string& key) {
+    return setStoreKV(kvstore.get(), key);
+  };
+  auto sharedFiles = [](const std::string& dir1, const std::string& dir2) {
+    uint32_t shared = 0;
+    for (auto& p : filesystem::directory_iterator(dir1)) {
+      auto path2 = filesystem::path(dir2) / p.path().filename();
+      if (p.path().extension() == ".sst" && filesystem::exists(path2) &&
+          filesystem::equivalent(p.path(), path2)) {
+        shared++;
+      }
+    }
+    return shared;
+  };
+
+  // the base has no backup_meta yet
+  Expected<BackupInfo> expBk0 =
+    kvstore->backupIncr(incr_dir, backup_dir, binlogversion);
+  EXPECT_FALSE(expBk0.ok());
+  EXPECT_FALSE(filesystem::exists(incr_dir));
+
+  setKV("a");
+  EXPECT_TRUE(kvstore->fullCompact().ok());
+  Expected<BackupInfo> expBk1 = kvstore->backup(
+    backup_dir, KVStore::BackupMode::BACKUP_CKPT, binlogversion);
+  EXPECT_TRUE(expBk1.ok()) << expBk1.status().toString();
+
+  uint64_t lastCommitId = setKV("b");
+  Expected<BackupInfo> expBk2 =
+    kvstore->backupIncr(incr_dir, backup_dir, binlogversion);
+  EXPECT_TRUE(expBk2.ok()) << expBk2.status().toString();
+  EXPECT_GT(expBk2.value().getBinlogPos(), expBk1.value().getBinlogPos());
+
+  auto meta = kvstore->getBackupMeta(incr_dir);
+  EXPECT_TRUE(meta.ok());
+  EXPECT_EQ(meta.value().getBackupMode(),
+            (uint32_t)KVStore::BackupMode::BACKUP_INCR);
+  EXPECT_EQ(meta.value().getBaseDir(), backup_dir);
+
+  // the sst files of the base are shared, not copied
+  EXPECT_GT(sharedFiles(backup_dir, incr_dir), 0u);
+  EXPECT_FALSE(meta.value().getDbIdentity().empty());
+  EXPECT_EQ(meta.value().getDbIdentity(),
+            kvstore->getBackupMeta(backup_dir).value().getDbIdentity());
+  EXPECT_FALSE(meta.value().getSstFiles().empty());
+
+  // a backup of another db, whose files have the same names and sizes,
+  // is never shared
+  {
+    auto other = std::make_unique<RocksKVStore>("1", cfg, blockCache);
+    setStoreKV(other.get(), "a");
+    EXPECT_TRUE(other->fullCompact().ok());
+    auto expOther = other->backup(
+      other_dir, KVStore::BackupMode::BACKUP_CKPT, binlogversion);
+    EXPECT_TRUE(expOther.ok()) << expOther.status().toString();
+    EXPECT_NE(other->getBackupMeta(other_dir).value().getDbIdentity(),
+              meta.value().getDbIdentity());
+    EXPECT_TRUE(other->stop().ok());
+  }
+  auto expOtherIncr =
+    kvstore->backupIncr(other_incr_dir, other_dir, binlogversion);
+  EXPECT_TRUE(expOtherIncr.ok()) << expOtherIncr.status().toString();
+  EXPECT_EQ(sharedFiles(other_dir, other_incr_dir), 0u);
+
+  Expected<BackupInfo> expBk3 =
+    kvstore->backupIncr(incr_dir, backup_dir, binlogversion);
+  EXPECT_FALSE(expBk3.ok());
+
+  Status s = kvstore->stop();
+  EXPECT_TRUE(s.ok());
+  s = kvstore->clear();
+  EXPECT_TRUE(s.ok());
+
+  // the incremental backup doesn't need the base to restore
+  filesystem::remove_all(backup_dir);
+  Expected<std::string> ret = kvstore->restoreBackup(incr_dir);
+  EXPECT_TRUE(ret.ok()) << ret.status().toString();
+
+  Expected<uint64_t> exptCommitId = kvstore->restart(false);
+  EXPECT_TRUE(exptCommitId.ok()) << exptCommitId.status().toString();
+  EXPECT_EQ(exptCommitId.value(), lastCommitId);
+
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  for (auto key : {"a", "b"}) {
+    Expected<RecordValue> e = kvstore->getKV(
+      RecordKey(0, 0, RecordType::RT_KV, key, ""), eTxn.value().get());
+    EXPECT_TRUE(e.ok());
+  }
+  testMaxBinlogId(kvstore);
+}
+
 TEST(RocksKVStore, BackupCopy) {
   auto cfg = genParams();
   string backup_dir = "backup";
@@ -1212,6 +1640,144 @@ TEST(RocksKVStore, PesTruncateBinlog) {
   testMaxBinlogId(kvstore);
 }
 
+TEST(RocksKVStore, DeleteFilesInRange) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+
+  auto setKV = [&kvstore](uint32_t chunkId, const std::string& key) {
+    auto eTxn = kvstore->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    Status s = kvstore->setKV(
+      Record(RecordKey(chunkId, 0, RecordType::RT_KV, key, ""),
+             RecordValue(std::string(100, 'v'), RecordType::RT_KV, -1)),
+      eTxn.value().get());
+    EXPECT_TRUE(s.ok());
+    EXPECT_TRUE(eTxn.value()->commit().ok());
+  };
+  auto getKV = [&kvstore](uint32_t chunkId, const std::string& key) {
+    auto eTxn = kvstore->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    return kvstore
+      ->getKV(RecordKey(chunkId, 0, RecordType::RT_KV, key, ""),
+              eTxn.value().get())
+      .status();
+  };
+
+  // the chunks [100, 200) are in the sst files only
+  for (uint32_t i = 0; i < 1000; i++) {
+    setKV(100 + i % 100, "key" + std::to_string(i));
+  }
+  EXPECT_TRUE(kvstore->compactRange(
+                ColumnFamilyNumber::ColumnFamily_Default, nullptr, nullptr)
+                .ok());
+  setKV(300, "other");
+  std::string begin =
+    RecordKey(100, 0, RecordType::RT_INVALID, "", "").prefixChunkid();
+  std::string end =
+    RecordKey(200, 0, RecordType::RT_INVALID, "", "").prefixChunkid();
+  EXPECT_GT(kvstore->getApproximateSize(begin, end), 0u);
+
+  EXPECT_TRUE(kvstore->deleteFilesInRange(begin, end).ok());
+  if (!cfg->binlogUsingDefaultCF) {
+    // the files hold nothing else, they are dropped at once
+    EXPECT_EQ(kvstore->getApproximateSize(begin, end), 0u);
+    EXPECT_EQ(getKV(150, "key50").code(), ErrorCodes::ERR_NOTFOUND);
+  }
+
+  // the keys left are deleted by deleteRange
+  EXPECT_TRUE(kvstore->deleteRange(begin, end).ok());
+  EXPECT_TRUE(kvstore->compactRange(
+                ColumnFamilyNumber::ColumnFamily_Default, &begin, &end)
+                .ok());
+  EXPECT_EQ(kvstore->getApproximateSize(begin, end), 0u);
+  for (uint32_t i = 0; i < 100; i++) {
+    EXPECT_EQ(getKV(100 + i, "key" + std::to_string(i)).code(),
+              ErrorCodes::ERR_NOTFOUND);
+  }
+  EXPECT_TRUE(getKV(300, "other").ok());
+}
+
+TEST(RocksKVStore, CompactionStats) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+  auto maxCompactions = [&kvstore]() {
+    rocksdb::DB* db = kvstore->getUnderlayerPesDB();
+    if (db == nullptr) {
+      db = kvstore->getUnderlayerOptDB()->GetBaseDB();
+    }
+    return db->GetDBOptions().max_background_compactions;
+  };
+
+  // the jobs are set on the running db, and kept by the restart
+  EXPECT_TRUE(kvstore->setBackgroundCompactions(3).ok());
+  EXPECT_EQ(kvstore->getBackgroundCompactions(), 3U);
+  EXPECT_EQ(maxCompactions(), 3);
+  EXPECT_TRUE(kvstore->stop().ok());
+  EXPECT_TRUE(kvstore->setBackgroundCompactions(5).ok());
+  EXPECT_TRUE(kvstore->restart(false).ok());
+  EXPECT_EQ(maxCompactions(), 5);
+
+  // the deletes are counted by the range of their chunks, once committed
+  auto rk = [](uint32_t chunkId, uint32_t i) {
+    return RecordKey(chunkId, 0, RecordType::RT_KV, std::to_string(i), "");
+  };
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  for (uint32_t i = 0; i < 10; i++) {
+    RecordValue rv("v", RecordType::RT_KV, -1);
+    EXPECT_TRUE(kvstore->setKV(rk(1, i), rv, eTxn.value().get()).ok());
+    EXPECT_TRUE(kvstore->setKV(rk(300, i), rv, eTxn.value().get()).ok());
+  }
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+  const auto& counts = kvstore->stat.rangeDeleteCount;
+  uint32_t r0 = 1 / KVStoreStat::DELETE_RANGE_CHUNKS;
+  uint32_t r1 = 300 / KVStoreStat::DELETE_RANGE_CHUNKS;
+  EXPECT_NE(r0, r1);
+  EXPECT_EQ(counts[r0].load(), 0U);
+
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  for (uint32_t i = 0; i < 4; i++) {
+    EXPECT_TRUE(kvstore->delKV(rk(1, i), eTxn.value().get()).ok());
+  }
+  EXPECT_TRUE(kvstore->delKV(rk(300, 0), eTxn.value().get()).ok());
+  EXPECT_EQ(counts[r0].load(), 0U);
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+  EXPECT_EQ(counts[r0].load(), 4U);
+  EXPECT_EQ(counts[r1].load(), 1U);
+
+  // nor the ones rolled back
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  EXPECT_TRUE(kvstore->delKV(rk(1, 5), eTxn.value().get()).ok());
+  EXPECT_TRUE(eTxn.value()->rollback().ok());
+  EXPECT_EQ(counts[r0].load(), 4U);
+
+  // the chunks beyond the ranges are counted in the last one
+  uint32_t far = KVStoreStat::DELETE_RANGE_CHUNKS * KVStoreStat::DELETE_RANGES;
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  EXPECT_TRUE(kvstore->delKV(rk(far + 10, 0), eTxn.value().get()).ok());
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+  EXPECT_EQ(counts[KVStoreStat::DELETE_RANGES - 1].load(), 1U);
+}
+
 TEST(RocksKVStore, Compaction) {
   auto cfg = genParams();
   EXPECT_TRUE(filesystem::create_directory("db"));
@@ -1289,4 +1855,82 @@ TEST(RocksKVStore, Compaction) {
   testMaxBinlogId(kvstore);
 }
 
+TEST(RocksKVStore, CompactionSubKeys) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+
+  uint64_t past = msSinceEpoch() - 1000;
+  uint64_t future = msSinceEpoch() + 3600 * 1000;
+  auto chunkOf = [&cfg](const std::string& key) {
+    return redis_port::keyHashSlot(key.c_str(), key.size()) % cfg->chunkSize;
+  };
+  auto eleKey = [&chunkOf](const std::string& key, uint32_t i) {
+    return RecordKey(
+      chunkOf(key), 0, RecordType::RT_HASH_ELE, key, std::to_string(i));
+  };
+
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+  // "expired" is expired, "live" isn't, "deleted" has an index only
+  for (const auto& kv : std::vector<std::pair<std::string, uint64_t>>{
+         {"expired", past}, {"live", future}}) {
+    RecordKey mk(chunkOf(kv.first), 0, RecordType::RT_DATA_META, kv.first, "");
+    RecordValue mv(
+      HashMetaValue(10).encode(), RecordType::RT_HASH_META, -1, kv.second);
+    EXPECT_TRUE(kvstore->setKV(mk, mv, txn.get()).ok());
+    for (uint32_t i = 0; i < 10; i++) {
+      RecordValue ev("v", RecordType::RT_HASH_ELE, -1);
+      EXPECT_TRUE(kvstore->setKV(eleKey(kv.first, i), ev, txn.get()).ok());
+    }
+  }
+  std::vector<std::string> liveIdxs = {
+    TTLIndex("expired", RecordType::RT_HASH_META, 0, past).encode(),
+    TTLIndex("live", RecordType::RT_HASH_META, 0, future).encode()};
+  std::vector<std::string> staleIdxs = {
+    TTLIndex("live", RecordType::RT_HASH_META, 0, past).encode(),
+    TTLIndex("deleted", RecordType::RT_HASH_META, 0, past).encode()};
+  for (const auto& idx : liveIdxs) {
+    auto v = RecordValue(RecordType::RT_TTL_INDEX).encode();
+    EXPECT_TRUE(txn->setKV(idx, v).ok());
+  }
+  for (const auto& idx : staleIdxs) {
+    auto v = RecordValue(RecordType::RT_TTL_INDEX).encode();
+    EXPECT_TRUE(txn->setKV(idx, v).ok());
+  }
+  EXPECT_TRUE(txn->commit().ok());
+
+  auto status = kvstore->compactRange(
+    ColumnFamilyNumber::ColumnFamily_Default, nullptr, nullptr);
+  EXPECT_TRUE(status.ok());
+  EXPECT_EQ(kvstore->stat.compactEleExpiredCount.load(), 10U);
+  EXPECT_EQ(kvstore->stat.compactTtlIndexStaleCount.load(), 2U);
+
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  txn = std::move(eTxn.value());
+  // the meta and the index of the expired key are left to IndexManager
+  RecordKey mk(chunkOf("expired"), 0, RecordType::RT_DATA_META, "expired", "");
+  EXPECT_TRUE(kvstore->getKV(mk, txn.get()).ok());
+  for (uint32_t i = 0; i < 10; i++) {
+    auto ev = kvstore->getKV(eleKey("expired", i), txn.get());
+    EXPECT_EQ(ev.status().code(), ErrorCodes::ERR_NOTFOUND);
+    EXPECT_TRUE(kvstore->getKV(eleKey("live", i), txn.get()).ok());
+  }
+  for (const auto& idx : liveIdxs) {
+    EXPECT_TRUE(txn->getKV(idx).ok());
+  }
+  for (const auto& idx : staleIdxs) {
+    EXPECT_EQ(txn->getKV(idx).status().code(), ErrorCodes::ERR_NOTFOUND);
+  }
+}
+
 }  // namespace tendisplus
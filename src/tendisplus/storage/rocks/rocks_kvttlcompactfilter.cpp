@@ -4,30 +4,61 @@
 
 #include <string>
 #include <memory>
-#include <limits>
 #include "rocksdb/compaction_filter.h"
 #include "tendisplus/storage/rocks/rocks_kvttlcompactfilter.h"
 #include "tendisplus/storage/record.h"
 #include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/redis_port.h"
 #include "tendisplus/utils/time.h"
 #include "tendisplus/utils/sync_point.h"
 #include "glog/logging.h"
 
 namespace tendisplus {
+
+namespace {
+// the value type of the meta a sub key belongs to, RT_INVALID if the
+// record isn't a sub key
+RecordType getMetaType(RecordType keyType) {
+  switch (keyType) {
+    case RecordType::RT_HASH_ELE:
+      return RecordType::RT_HASH_META;
+    case RecordType::RT_SET_ELE:
+      return RecordType::RT_SET_META;
+    case RecordType::RT_LIST_ELE:
+      return RecordType::RT_LIST_META;
+    case RecordType::RT_ZSET_S_ELE:
+    case RecordType::RT_ZSET_H_ELE:
+    case RecordType::RT_ZSET_I_ELE:
+      return RecordType::RT_ZSET_META;
+    case RecordType::RT_STREAM_ELE:
+    case RecordType::RT_STREAM_CG:
+      return RecordType::RT_STREAM_META;
+    default:
+      return RecordType::RT_INVALID;
+  }
+}
+}  // namespace
+
 class KVTtlCompactionFilter : public CompactionFilter {
  public:
-  explicit KVTtlCompactionFilter(KVStore* store, uint64_t current_time)
+  explicit KVTtlCompactionFilter(RocksKVStore* store, uint64_t current_time)
     : _store(store), _currentTime(current_time) {}
 
   ~KVTtlCompactionFilter() override {
     TEST_SYNC_POINT_CALLBACK("InspectKvTtlExpiredCount", &_expiredCount);
     TEST_SYNC_POINT_CALLBACK("InspectKvTtlFilterCount", &_filterCount);
+    TEST_SYNC_POINT_CALLBACK("InspectEleTtlExpiredCount", &_eleExpiredCount);
+    TEST_SYNC_POINT_CALLBACK("InspectTtlIndexStaleCount", &_staleIndexCount);
 
     // do something statistics here
     _store->stat.compactFilterCount.fetch_add(_filterCount,
                                               std::memory_order_relaxed);
     _store->stat.compactKvExpiredCount.fetch_add(_expiredCount,
                                                  std::memory_order_relaxed);
+    _store->stat.compactEleExpiredCount.fetch_add(_eleExpiredCount,
+                                                  std::memory_order_relaxed);
+    _store->stat.compactTtlIndexStaleCount.fetch_add(
+      _staleIndexCount, std::memory_order_relaxed);
   }
 
   const char* Name() const override {
@@ -50,7 +81,7 @@ class KVTtlCompactionFilter : public CompactionFilter {
         if (vt == RecordType::RT_KV) {
           ttl = RecordValue::decodeTtl(existing_value.data(),
                                        existing_value.size());
-          if (ttl > 0 && ttl < _currentTime) {
+          if (isExpired(ttl)) {
             // Expired
             _expiredCount++;
             _expiredSize += key.size() + existing_value.size();
@@ -59,18 +90,114 @@ class KVTtlCompactionFilter : public CompactionFilter {
           }
         }
         break;
+      case RecordType::RT_TTL_INDEX:
+        if (isStaleIndex(key)) {
+          _staleIndexCount++;
+          return true;
+        }
+        break;
       case RecordType::RT_INVALID:
         // TODO(vinchen): make sure
         INVARIANT_D(0);
         break;
       default:
+        if (isExpiredEle(type, key)) {
+          _eleExpiredCount++;
+          _expiredSize += key.size() + existing_value.size();
+          return true;
+        }
         break;
     }
     return false;
   }
 
  private:
-  KVStore* _store;
+  struct MetaInfo {
+    // ERR_OK, ERR_NOTFOUND if there is no meta, or the lookup failed
+    ErrorCodes code = ErrorCodes::ERR_INTERNAL;
+    RecordType type = RecordType::RT_INVALID;
+    uint64_t ttl = 0;
+  };
+
+  bool isExpired(uint64_t ttl) const {
+    return ttl > 0 && ttl < _currentTime;
+  }
+
+  // the sub keys of a key are next to each other in the compaction, so
+  // the meta looked up last is kept for them
+  const MetaInfo& getMeta(uint32_t chunkId,
+                          uint32_t dbId,
+                          mystring_view pk) const {
+    if (_hasLastMeta && chunkId == _lastChunkId && dbId == _lastDbId &&
+        pk.compare(_lastPk) == 0) {
+      return _lastMeta;
+    }
+    _hasLastMeta = true;
+    _lastChunkId = chunkId;
+    _lastDbId = dbId;
+    _lastPk.assign(pk.data(), pk.size());
+    _lastMeta = MetaInfo();
+
+    RecordKey mk(chunkId, dbId, RecordType::RT_DATA_META, _lastPk, "");
+    auto ev = _store->getCommittedKV(mk.encode());
+    if (!ev.ok()) {
+      _lastMeta.code = ev.status().code();
+      return _lastMeta;
+    }
+    const auto& v = ev.value();
+    if (v.size() < RecordValue::minSize()) {
+      return _lastMeta;
+    }
+    _lastMeta.code = ErrorCodes::ERR_OK;
+    _lastMeta.type = RecordValue::decodeType(v.data(), v.size());
+    _lastMeta.ttl = RecordValue::decodeTtl(v.data(), v.size());
+    return _lastMeta;
+  }
+
+  // a sub key is written with its meta in a transaction, and the meta is
+  // deleted after all of them. A sub key without a meta may come from a
+  // migrating chunk, so it's kept.
+  bool isExpiredEle(RecordType type, const rocksdb::Slice& key) const {
+    RecordType metaType = getMetaType(type);
+    if (metaType == RecordType::RT_INVALID) {
+      return false;
+    }
+    auto erk = RecordKeyView::decode(mystring_view(key.data(), key.size()));
+    if (!erk.ok()) {
+      return false;
+    }
+    const auto& rk = erk.value();
+    const auto& meta =
+      getMeta(rk.getChunkId(), rk.getDbId(), rk.getPrimaryKey());
+    return meta.code == ErrorCodes::ERR_OK &&
+      (meta.type != metaType || isExpired(meta.ttl));
+  }
+
+  // a ttl index is written and deleted with the ttl of its meta, an index
+  // is stale if the key is deleted or expires at another time now
+  bool isStaleIndex(const rocksdb::Slice& key) const {
+    auto erk = RecordKey::decode(key.ToString());
+    if (!erk.ok()) {
+      return false;
+    }
+    auto eidx = TTLIndex::decode(erk.value());
+    if (!eidx.ok()) {
+      return false;
+    }
+    const auto& idx = eidx.value();
+    const auto& pk = idx.getPriKey();
+    // the same chunk as IndexManager takes for the key
+    uint32_t chunkId = redis_port::keyHashSlot(pk.c_str(), pk.size()) %
+      _store->getCfg()->chunkSize;
+    const auto& meta = getMeta(chunkId, idx.getDbId(), pk);
+    if (meta.code == ErrorCodes::ERR_NOTFOUND) {
+      return true;
+    }
+    return meta.code == ErrorCodes::ERR_OK &&
+      (meta.type != idx.getType() || meta.ttl != idx.getTTL());
+  }
+
+  RocksKVStore* _store;
   // millisecond, same as ttl in the record
   const uint64_t _currentTime;
   // It is safe to not using std::atomic since the compaction filter,
@@ -79,6 +206,13 @@ class KVTtlCompactionFilter : public CompactionFilter {
   mutable uint64_t _expiredCount = 0;
   mutable uint64_t _expiredSize = 0;
   mutable uint64_t _filterCount = 0;
+  mutable uint64_t _eleExpiredCount = 0;
+  mutable uint64_t _staleIndexCount = 0;
+  mutable bool _hasLastMeta = false;
+  mutable uint32_t _lastChunkId = 0;
+  mutable uint32_t _lastDbId = 0;
+  mutable std::string _lastPk;
+  mutable MetaInfo _lastMeta;
 };
 
 std::unique_ptr<CompactionFilter>
@@ -86,13 +220,17 @@ KVTtlCompactionFilterFactory::CreateCompactionFilter(
   const CompactionFilter::Context& context) {
   uint64_t currentTs = 0;
   INVARIANT(_store != nullptr);
+  // the data is in the default column family, whose id is always 0
+  if (context.column_family_id != 0) {
+    return nullptr;
+  }
   // NOTE(vinchen): It can't get time = sinceEpoch () here, because it
   // should get the binlog time in slave point.
   currentTs = _store->getCurrentTime();
 
+  // nothing is expired with a zero time, a ttl is never below it
   if (currentTs == 0) {
     LOG(WARNING) << "The currentTs is 0, the kvttlcompaction would do nothing";
-    currentTs = std::numeric_limits<uint64_t>::max();
   }
 
   return std::unique_ptr<CompactionFilter>(
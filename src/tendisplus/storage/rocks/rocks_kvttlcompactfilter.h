@@ -19,19 +19,25 @@ struct KVTTLCompactionContext {
   bool is_manual_compaction;
 };
 
+// KVTtlCompactionFilterFactory filters the data column family only, the
+// binlogs are truncated by the binlog manager. Besides the expired kvs,
+// the filter drops the sub keys of an expired collection, and the ttl
+// indexes which don't match the meta any more, looking the meta up in
+// the store.
 class KVTtlCompactionFilterFactory : public CompactionFilterFactory {
  public:
-  explicit KVTtlCompactionFilterFactory(KVStore* store) : _store(store) {}
+  explicit KVTtlCompactionFilterFactory(RocksKVStore* store)
+    : _store(store) {}
 
   const char* Name() const override {
     return "KVTTLCompactionFilterFactory";
   }
 
   std::unique_ptr<CompactionFilter> CreateCompactionFilter(
-    const CompactionFilter::Context& /*context*/) override;
+    const CompactionFilter::Context& context) override;
 
  private:
-  KVStore* _store;
+  RocksKVStore* _store;
 };
 
 }  // namespace tendisplus
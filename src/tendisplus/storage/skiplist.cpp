@@ -2,11 +2,13 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <algorithm>
 #include <chrono>  // NOLINT
 #include <random>
 #include <map>
 #include <utility>
 #include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/varint.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/server/session.h"
 
@@ -61,12 +63,205 @@ int slCmp(double score0,
   INVARIANT(0);
 }
 
+SkipListCache::SkipListCache(uint64_t capacity)
+  : _shardCapacity(std::max<uint64_t>(capacity / SHARDS, 1)),
+    _hits(0),
+    _misses(0) {
+  for (auto& shard : _shards) {
+    shard.lru.resize(ZSlMetaValue::MAX_LAYER + 1);
+  }
+}
+
+std::string SkipListCache::zsetKey(uint32_t chunkId,
+                                   uint32_t dbId,
+                                   const std::string& pk) {
+  return RecordKey(chunkId, dbId, RecordType::RT_ZSET_S_ELE, pk, "")
+    .prefixPk();
+}
+
+SkipListCache::Shard& SkipListCache::getShard(const std::string& zset) {
+  return _shards[std::hash<std::string>()(zset) % SHARDS];
+}
+
+bool SkipListCache::get(const std::string& zset,
+                        const std::string& version,
+                        uint64_t pos,
+                        ZSlEleValue* node) {
+  auto& shard = getShard(zset);
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  auto it = shard.zsets.find(zset);
+  if (it == shard.zsets.end() || it->second.version != version) {
+    ++_misses;
+    return false;
+  }
+  auto nit = it->second.nodes.find(pos);
+  if (nit == it->second.nodes.end()) {
+    ++_misses;
+    return false;
+  }
+  auto& lru = shard.lru[nit->second.level];
+  lru.splice(lru.begin(), lru, nit->second.lru);
+  *node = nit->second.val;
+  ++_hits;
+  return true;
+}
+
+void SkipListCache::put(const std::string& zset,
+                        const std::string& version,
+                        uint64_t pos,
+                        const ZSlEleValue& node) {
+  auto& shard = getShard(zset);
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  auto it = shard.zsets.find(zset);
+  if (it == shard.zsets.end()) {
+    it = shard.zsets.emplace(zset, Zset{version, {}}).first;
+  } else if (it->second.version != version) {
+    // a reader of another version, the newer one wins in most cases
+    dropZset(&shard, it);
+    it = shard.zsets.emplace(zset, Zset{version, {}}).first;
+  }
+  setNode(&shard, it, pos, node);
+  evict(&shard);
+}
+
+void SkipListCache::update(
+  const std::string& zset,
+  const std::string& oldVersion,
+  const std::string& version,
+  const std::vector<std::pair<uint64_t, const ZSlEleValue*>>& changed,
+  const std::vector<uint64_t>& deleted) {
+  auto& shard = getShard(zset);
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  auto it = shard.zsets.find(zset);
+  if (it != shard.zsets.end() && it->second.version != oldVersion) {
+    dropZset(&shard, it);
+    it = shard.zsets.end();
+  }
+  if (it == shard.zsets.end()) {
+    it = shard.zsets.emplace(zset, Zset{version, {}}).first;
+  }
+  it->second.version = version;
+  for (auto pos : deleted) {
+    dropNode(&shard, &it->second, pos);
+  }
+  for (const auto& v : changed) {
+    setNode(&shard, it, v.first, *v.second);
+  }
+  if (it->second.nodes.empty()) {
+    shard.zsets.erase(it);
+  }
+  evict(&shard);
+}
+
+void SkipListCache::invalidate(const std::string& zset) {
+  auto& shard = getShard(zset);
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  auto it = shard.zsets.find(zset);
+  if (it != shard.zsets.end()) {
+    dropZset(&shard, it);
+  }
+}
+
+void SkipListCache::clear() {
+  for (auto& shard : _shards) {
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    shard.zsets.clear();
+    for (auto& lru : shard.lru) {
+      lru.clear();
+    }
+    shard.size = 0;
+  }
+}
+
+uint64_t SkipListCache::size() const {
+  uint64_t size = 0;
+  for (auto& shard : _shards) {
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    size += shard.size;
+  }
+  return size;
+}
+
+uint64_t SkipListCache::getHits() const {
+  return _hits.load(std::memory_order_relaxed);
+}
+
+uint64_t SkipListCache::getMisses() const {
+  return _misses.load(std::memory_order_relaxed);
+}
+
+void SkipListCache::setNode(Shard* shard,
+                            std::unordered_map<std::string, Zset>::iterator it,
+                            uint64_t pos,
+                            const ZSlEleValue& val) {
+  // the highest level the node is linked in
+  uint8_t level = ZSlMetaValue::MAX_LAYER;
+  if (pos != ZSlMetaValue::HEAD_ID) {
+    level = 1;
+    for (uint8_t i = ZSlMetaValue::MAX_LAYER; i > 1; --i) {
+      if (val.getForward(i) != 0 || val.getSpan(i) != 0) {
+        level = i;
+        break;
+      }
+    }
+  }
+  auto nit = it->second.nodes.find(pos);
+  if (nit == it->second.nodes.end()) {
+    auto& lru = shard->lru[level];
+    lru.emplace_front(&it->first, pos);
+    it->second.nodes.emplace(pos, Node{val, level, lru.begin()});
+    shard->size++;
+    return;
+  }
+  auto& node = nit->second;
+  shard->lru[level].splice(
+    shard->lru[level].begin(), shard->lru[node.level], node.lru);
+  node.val = val;
+  node.level = level;
+}
+
+void SkipListCache::dropNode(Shard* shard, Zset* zs, uint64_t pos) {
+  auto nit = zs->nodes.find(pos);
+  if (nit == zs->nodes.end()) {
+    return;
+  }
+  shard->lru[nit->second.level].erase(nit->second.lru);
+  zs->nodes.erase(nit);
+  shard->size--;
+}
+
+void SkipListCache::dropZset(
+  Shard* shard, std::unordered_map<std::string, Zset>::iterator it) {
+  for (auto& v : it->second.nodes) {
+    shard->lru[v.second.level].erase(v.second.lru);
+  }
+  shard->size -= it->second.nodes.size();
+  shard->zsets.erase(it);
+}
+
+void SkipListCache::evict(Shard* shard) {
+  size_t level = 1;
+  while (shard->size > _shardCapacity) {
+    while (shard->lru[level].empty()) {
+      level++;
+    }
+    auto victim = shard->lru[level].back();
+    auto it = shard->zsets.find(*victim.first);
+    INVARIANT_D(it != shard->zsets.end());
+    dropNode(shard, &it->second, victim.second);
+    if (it->second.nodes.empty()) {
+      shard->zsets.erase(it);
+    }
+  }
+}
+
 SkipList::SkipList(uint32_t chunkId,
                    uint32_t dbId,
                    const std::string& pk,
                    const ZSlMetaValue& meta,
                    PStore store)
   : nGetFromCache(0),
+    nGetFromShared(0),
     nGetFromStore(0),
     nInserted(0),
     nUpdated(0),
@@ -76,10 +271,20 @@ SkipList::SkipList(uint32_t chunkId,
     _count(meta.getCount()),
     _tail(meta.getTail()),
     _posAlloc(meta.getPosAlloc()),
+    _scoreIndex(meta.hasScoreIndex()),
+    _scoreIndexBuilding(meta.isScoreIndexBuilding()),
+    _scoreIndexNext(meta.getScoreIndexNext()),
+    _scoreIndexBuilt(false),
     _chunkId(chunkId),
     _dbId(dbId),
     _pk(pk),
-    _store(store) {}
+    _store(store),
+    _sharedCache(store ? store->getSkipListCache() : nullptr),
+    _version(meta.encode()) {
+  if (_sharedCache) {
+    _cacheKey = SkipListCache::zsetKey(chunkId, dbId, pk);
+  }
+}
 
 uint8_t SkipList::randomLevel() {
   static thread_local std::mt19937 generator(
@@ -150,6 +355,15 @@ Expected<ZSlEleValue*> SkipList::getNode(uint64_t pointer, Transaction* txn) {
     ++nGetFromCache;
     return it->second.get();
   }
+  if (_sharedCache) {
+    auto ptr = std::make_unique<ZSlEleValue>();
+    if (_sharedCache->get(_cacheKey, _version, pointer, ptr.get())) {
+      ZSlEleValue* toReturn = ptr.get();
+      cache[pointer] = std::move(ptr);
+      ++nGetFromShared;
+      return toReturn;
+    }
+  }
   std::string pointerStr = std::to_string(pointer);
   RecordKey rk(_chunkId, _dbId, RecordType::RT_ZSET_S_ELE, _pk, pointerStr);
   Expected<RecordValue> rv = _store->getKV(rk, txn);
@@ -161,6 +375,9 @@ Expected<ZSlEleValue*> SkipList::getNode(uint64_t pointer, Transaction* txn) {
   if (!result.ok()) {
     return result.status();
   }
+  if (_sharedCache) {
+    _sharedCache->put(_cacheKey, _version, pointer, result.value());
+  }
   auto ptr = std::make_unique<ZSlEleValue>(std::move(result.value()));
   ZSlEleValue* toReturn = ptr.get();
   cache[pointer] = std::move(ptr);
@@ -171,6 +388,9 @@ Expected<ZSlEleValue*> SkipList::getNode(uint64_t pointer, Transaction* txn) {
 Status SkipList::delNode(uint64_t pointer, Transaction* txn) {
   // TODO(vinchen)
   cache.erase(pointer);
+  if (_sharedCache) {
+    _deleted.push_back(pointer);
+  }
   ++nDeleted;
   RecordKey rk(
     _chunkId, _dbId, RecordType::RT_ZSET_S_ELE, _pk, std::to_string(pointer));
@@ -192,9 +412,73 @@ Status SkipList::saveNode(uint64_t pointer,
   return _store->setKV(rk, rv, txn);
 }
 
+RecordKey SkipList::indexKey(const std::string& sk) const {
+  return RecordKey(_chunkId, _dbId, RecordType::RT_ZSET_I_ELE, _pk, sk);
+}
+
+RecordKey SkipList::hashKey(const std::string& member) const {
+  return RecordKey(_chunkId, _dbId, RecordType::RT_ZSET_H_ELE, _pk, member);
+}
+
+bool SkipList::isIndexed(const std::string& member) const {
+  return _scoreIndex ||
+    (_scoreIndexBuilding &&
+     hashKey(member).encode() < hashKey(_scoreIndexNext).encode());
+}
+
+// a batch of the members is indexed from the hash elements, before the
+// first change of the zset by this one, so that the hash elements agree
+// with the skiplist. the reads use the skiplist until the index is
+// complete.
+Status SkipList::ensureScoreIndex(Transaction* txn) {
+  if (_scoreIndex || _scoreIndexBuilt) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  _scoreIndexBuilt = true;
+  std::string prefix = hashKey("").prefixPk();
+  RecordValue iv("", RecordType::RT_ZSET_I_ELE, -1);
+  auto cursor = txn->createDataCursor();
+  cursor->seek(_scoreIndexBuilding ? hashKey(_scoreIndexNext).encode()
+                                   : prefix);
+  uint32_t n = 0;
+  while (true) {
+    Expected<Record> exptRcd = cursor->next();
+    if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    if (!exptRcd.ok()) {
+      return exptRcd.status();
+    }
+    const RecordKey& rcdKey = exptRcd.value().getRecordKey();
+    if (rcdKey.prefixPk() != prefix) {
+      break;
+    }
+    if (n++ == SCORE_INDEX_BATCH) {
+      _scoreIndexBuilding = true;
+      _scoreIndexNext = rcdKey.getSecondaryKey();
+      return {ErrorCodes::ERR_OK, ""};
+    }
+    auto score = doubleDecode(exptRcd.value().getRecordValue().getValue());
+    if (!score.ok()) {
+      return score.status();
+    }
+    auto sk =
+      ZSlMetaValue::scoreIndexKey(score.value(), rcdKey.getSecondaryKey());
+    auto s = _store->setKV(indexKey(sk), iv, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  _scoreIndex = true;
+  _scoreIndexBuilding = false;
+  _scoreIndexNext.clear();
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Status SkipList::save(Transaction* txn,
                       const Expected<RecordValue>& oldValue,
                       uint64_t versionEP) {
+  std::vector<std::pair<uint64_t, const ZSlEleValue*>> changed;
   // saveNode one time
   for (auto& v : cache) {
     if (v.second->isChanged()) {
@@ -202,15 +486,33 @@ Status SkipList::save(Transaction* txn,
       if (!s.ok()) {
         return s;
       }
+      if (_sharedCache) {
+        changed.emplace_back(v.first, v.second.get());
+      }
     }
   }
 
   RecordKey rk(_chunkId, _dbId, RecordType::RT_ZSET_META, _pk, "");
   ZSlMetaValue mv(_level, _count, _tail, _posAlloc);
+  mv.setScoreIndex(_scoreIndex);
+  if (_scoreIndexBuilding) {
+    mv.setScoreIndexNext(_scoreIndexNext);
+  }
+  mv.setWriteId(txn->getTxnId());
+  std::string version = mv.encode();
   uint64_t ttl = oldValue.ok() ? oldValue.value().getTtl() : 0;
-  RecordValue rv(
-    mv.encode(), RecordType::RT_ZSET_META, versionEP, ttl, oldValue);
-  return _store->setKV(rk, rv, txn);
+  RecordValue rv(version, RecordType::RT_ZSET_META, versionEP, ttl, oldValue);
+  auto s = _store->setKV(rk, rv, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  // the nodes are those after the commit, or never read if it fails
+  if (_sharedCache) {
+    _sharedCache->update(_cacheKey, _version, version, changed, _deleted);
+    _deleted.clear();
+  }
+  _version = std::move(version);
+  return s;
 }
 
 Status SkipList::removeInternal(uint64_t pos,
@@ -238,6 +540,15 @@ Status SkipList::removeInternal(uint64_t pos,
     _tail = cache[pos]->getBackward();
   }
 
+  if (isIndexed(cache[pos]->getSubKey())) {
+    auto sk = ZSlMetaValue::scoreIndexKey(cache[pos]->getScore(),
+                                          cache[pos]->getSubKey());
+    auto s = _store->delKV(indexKey(sk), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+
   --_count;
   while (_level > 1 && cache[ZSlMetaValue::HEAD_ID]->getForward(_level) == 0) {
     --_level;
@@ -247,6 +558,10 @@ Status SkipList::removeInternal(uint64_t pos,
 
 Expected<std::list<std::pair<double, std::string>>> SkipList::removeRangeByRank(
   uint32_t start, uint32_t end, Transaction* txn) {
+  Status s = ensureScoreIndex(txn);
+  if (!s.ok()) {
+    return s;
+  }
   std::vector<uint64_t> update(_maxLevel + 1);
   Expected<ZSlEleValue*> expHead = getNode(ZSlMetaValue::HEAD_ID, txn);
   if (!expHead.ok()) {
@@ -300,6 +615,10 @@ Expected<std::list<std::pair<double, std::string>>> SkipList::removeRangeByRank(
 
 Expected<std::list<std::pair<double, std::string>>> SkipList::removeRangeByLex(
   const Zlexrangespec& range, Transaction* txn) {
+  Status s = ensureScoreIndex(txn);
+  if (!s.ok()) {
+    return s;
+  }
   std::vector<uint64_t> update(_maxLevel + 1);
   Expected<ZSlEleValue*> expHead = getNode(ZSlMetaValue::HEAD_ID, txn);
   if (!expHead.ok()) {
@@ -350,6 +669,10 @@ Expected<std::list<std::pair<double, std::string>>> SkipList::removeRangeByLex(
 
 Expected<std::list<std::pair<double, std::string>>>
 SkipList::removeRangeByScore(const Zrangespec& range, Transaction* txn) {
+  Status s = ensureScoreIndex(txn);
+  if (!s.ok()) {
+    return s;
+  }
   std::vector<uint64_t> update(_maxLevel + 1);
   Expected<ZSlEleValue*> expHead = getNode(ZSlMetaValue::HEAD_ID, txn);
   if (!expHead.ok()) {
@@ -404,6 +727,10 @@ SkipList::removeRangeByScore(const Zrangespec& range, Transaction* txn) {
 Status SkipList::remove(double score,
                         const std::string& subkey,
                         Transaction* txn) {
+  Status s = ensureScoreIndex(txn);
+  if (!s.ok()) {
+    return s;
+  }
   std::vector<uint64_t> update(_maxLevel + 1);
   Expected<ZSlEleValue*> expHead = getNode(ZSlMetaValue::HEAD_ID, txn);
   if (!expHead.ok()) {
@@ -716,12 +1043,104 @@ Expected<uint64_t> SkipList::lastInLexRange(const Zlexrangespec& range,
   return pos;
 }
 
+Expected<std::list<std::pair<double, std::string>>> SkipList::scanIndex(
+  const std::string& sk,
+  uint64_t offset,
+  uint64_t limit,
+  bool rev,
+  const std::function<int(double, const std::string&)>& cmp,
+  Transaction* txn) {
+  std::string prefix = indexKey("").prefixPk();
+  std::list<std::pair<double, std::string>> result;
+  auto cursor = txn->createDataCursor();
+  // backward, sk is after the range, the scan begins with the key before
+  // the first key >= sk
+  cursor->seek(prefix + sk);
+  bool moved = false;
+  while (limit > 0) {
+    std::string subKey;
+    if (rev) {
+      auto s = cursor->prev();
+      if (s.code() == ErrorCodes::ERR_EXHAUST && !moved) {
+        // nothing after the zset in the store, the cursor can't go back
+        // from there
+        return s;
+      } else if (s.code() == ErrorCodes::ERR_EXHAUST) {
+        break;
+      } else if (!s.ok()) {
+        return s;
+      }
+      moved = true;
+      auto key = cursor->key();
+      if (key.status().code() == ErrorCodes::ERR_EXHAUST) {
+        break;
+      } else if (!key.ok()) {
+        return key.status();
+      }
+      auto rk = RecordKey::decode(key.value());
+      if (!rk.ok()) {
+        return rk.status();
+      }
+      if (rk.value().prefixPk() != prefix) {
+        break;
+      }
+      subKey = rk.value().getSecondaryKey();
+    } else {
+      Expected<Record> exptRcd = cursor->next();
+      if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+        break;
+      } else if (!exptRcd.ok()) {
+        return exptRcd.status();
+      }
+      const RecordKey& rcdKey = exptRcd.value().getRecordKey();
+      if (rcdKey.prefixPk() != prefix) {
+        break;
+      }
+      subKey = rcdKey.getSecondaryKey();
+    }
+    auto ele = ZSlMetaValue::decodeScoreIndexKey(subKey);
+    if (!ele.ok()) {
+      return ele.status();
+    }
+    int c = cmp(ele.value().first, ele.value().second);
+    if (c < 0 && !rev) {
+      continue;
+    } else if (c > 0 && rev) {
+      continue;
+    } else if (c != 0) {
+      break;
+    }
+    if (offset > 0) {
+      offset--;
+      continue;
+    }
+    result.emplace_back(std::move(ele.value()));
+    limit--;
+  }
+  return std::move(result);
+}
+
 Expected<std::list<std::pair<double, std::string>>> SkipList::scanByScore(
   const Zrangespec& range,
   uint64_t offset,
   uint64_t limit,
   bool rev,
   Transaction* txn) {
+  if (_scoreIndex) {
+    auto cmp = [&range](double score, const std::string&) {
+      if (!zslValueGteMin(score, range)) {
+        return -1;
+      }
+      return zslValueLteMax(score, range) ? 0 : 1;
+    };
+    auto sk = rev ? ZSlMetaValue::scoreIndexPrefix(range.max, true)
+                  : ZSlMetaValue::scoreIndexPrefix(range.min);
+    auto result = scanIndex(sk, offset, limit, rev, cmp, txn);
+    if (result.status().code() != ErrorCodes::ERR_EXHAUST) {
+      return result;
+    }
+  }
+
   uint64_t pos = SKIPLIST_INVALID_POS;
   if (rev) {
     auto tmp = lastInRange(range, txn);
@@ -747,6 +1166,8 @@ Expected<std::list<std::pair<double, std::string>>> SkipList::scanByScore(
     if (rev) {
       auto nxt = ln->getBackward();
       if (nxt == 0) {
+        // the offset is beyond the range
+        ln = nullptr;
         break;
       }
       auto tmp = getNode(nxt, txn);
@@ -757,6 +1178,7 @@ Expected<std::list<std::pair<double, std::string>>> SkipList::scanByScore(
     } else {
       auto nxt = ln->getForward(1);
       if (nxt == 0) {
+        ln = nullptr;
         break;
       }
       auto tmp = getNode(nxt, txn);
@@ -808,6 +1230,46 @@ Expected<std::list<std::pair<double, std::string>>> SkipList::scanByLex(
   uint64_t limit,
   bool rev,
   Transaction* txn) {
+  // the lex ranges are only meaningful when all the scores are the same,
+  // the index is scanned then, like the skiplist is walked
+  if (_scoreIndex && _count > 1) {
+    auto head = getNode(ZSlMetaValue::HEAD_ID, txn);
+    if (!head.ok()) {
+      return head.status();
+    }
+    auto first = getNode(head.value()->getForward(1), txn);
+    if (!first.ok()) {
+      return first.status();
+    }
+    double score = first.value()->getScore();
+    auto last = getNode(_tail, txn);
+    if (!last.ok()) {
+      return last.status();
+    }
+    if (last.value()->getScore() == score) {
+      auto cmp = [&range](double, const std::string& member) {
+        if (!zslLexValueGteMin(member, range)) {
+          return -1;
+        }
+        return zslLexValueLteMax(member, range) ? 0 : 1;
+      };
+      std::string sk;
+      if (rev) {
+        sk = range.max == ZLEXMAX
+          ? ZSlMetaValue::scoreIndexPrefix(score, true)
+          : ZSlMetaValue::scoreIndexPrefix(score, range.max, true);
+      } else {
+        sk = range.min == ZLEXMIN
+          ? ZSlMetaValue::scoreIndexPrefix(score)
+          : ZSlMetaValue::scoreIndexPrefix(score, range.min);
+      }
+      auto result = scanIndex(sk, offset, limit, rev, cmp, txn);
+      if (result.status().code() != ErrorCodes::ERR_EXHAUST) {
+        return result;
+      }
+    }
+  }
+
   uint64_t pos = SKIPLIST_INVALID_POS;
   if (rev) {
     auto tmp = lastInLexRange(range, txn);
@@ -832,6 +1294,8 @@ Expected<std::list<std::pair<double, std::string>>> SkipList::scanByLex(
     if (rev) {
       auto nxt = ln->getBackward();
       if (nxt == 0) {
+        // the offset is beyond the range
+        ln = nullptr;
         break;
       }
       auto tmp = getNode(nxt, txn);
@@ -842,6 +1306,7 @@ Expected<std::list<std::pair<double, std::string>>> SkipList::scanByLex(
     } else {
       auto nxt = ln->getForward(1);
       if (nxt == 0) {
+        ln = nullptr;
         break;
       }
       auto tmp = getNode(nxt, txn);
@@ -953,6 +1418,18 @@ Status SkipList::insert(double score,
   if (_count >= std::numeric_limits<int32_t>::max() / 2) {
     return {ErrorCodes::ERR_INTERNAL, "zset count reach limit"};
   }
+  Status s = ensureScoreIndex(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  if (isIndexed(subkey)) {
+    RecordValue iv("", RecordType::RT_ZSET_I_ELE, -1);
+    s = _store->setKV(
+      indexKey(ZSlMetaValue::scoreIndexKey(score, subkey)), iv, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
   // the previous position of the inserted node in level i
   std::vector<uint64_t> update(_maxLevel + 1, 0);
   // rank[1] means the index of the inserted node
@@ -1068,6 +1545,10 @@ uint8_t SkipList::getLevel() const {
   return _level;
 }
 
+bool SkipList::hasScoreIndex() const {
+  return _scoreIndex;
+}
+
 uint64_t SkipList::getAlloc() const {
   return _posAlloc;
 }
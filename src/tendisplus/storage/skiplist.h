@@ -5,13 +5,17 @@
 #ifndef SRC_TENDISPLUS_STORAGE_SKIPLIST_H_
 #define SRC_TENDISPLUS_STORAGE_SKIPLIST_H_
 
+#include <array>
 #include <map>
+#include <mutex>
+#include <unordered_map>
 #include <limits>
 #include <memory>
 #include <string>
 #include <list>
 #include <vector>
 #include <atomic>
+#include <functional>
 #include <utility>
 #include "tendisplus/storage/record.h"
 #include "tendisplus/storage/kvstore.h"
@@ -22,8 +26,88 @@ namespace tendisplus {
 using Zrangespec = redis_port::Zrangespec;
 using Zlexrangespec = redis_port::Zlexrangespec;
 const uint64_t SKIPLIST_INVALID_POS = (uint64_t)-1;
+
+// SkipListCache keeps the skiplist nodes of the zsets recently used on a
+// store, shared by the transactions. The nodes of a zset are valid for
+// one version of its meta only, the encoded ZSlMetaValue, which differs
+// after every write. A write moves the nodes of the version it read to
+// the version it writes, the readers of the other versions miss. The
+// nodes of the upper levels are evicted last, every access walks through
+// them.
+class SkipListCache {
+ public:
+  explicit SkipListCache(uint64_t capacity);
+  SkipListCache(const SkipListCache&) = delete;
+  SkipListCache& operator=(const SkipListCache&) = delete;
+
+  static std::string zsetKey(uint32_t chunkId,
+                             uint32_t dbId,
+                             const std::string& pk);
+  bool get(const std::string& zset,
+           const std::string& version,
+           uint64_t pos,
+           ZSlEleValue* node);
+  void put(const std::string& zset,
+           const std::string& version,
+           uint64_t pos,
+           const ZSlEleValue& node);
+  // the zset of oldVersion is changed to version, by the changed and the
+  // deleted nodes
+  void update(const std::string& zset,
+              const std::string& oldVersion,
+              const std::string& version,
+              const std::vector<std::pair<uint64_t, const ZSlEleValue*>>&
+                changed,
+              const std::vector<uint64_t>& deleted);
+  void invalidate(const std::string& zset);
+  void clear();
+
+  uint64_t size() const;
+  uint64_t getHits() const;
+  uint64_t getMisses() const;
+
+ private:
+  using LruList = std::list<std::pair<const std::string*, uint64_t>>;
+  struct Node {
+    ZSlEleValue val;
+    uint8_t level;
+    LruList::iterator lru;
+  };
+  struct Zset {
+    std::string version;
+    std::unordered_map<uint64_t, Node> nodes;
+  };
+  struct Shard {
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Zset> zsets;
+    // a list of each level, the most recently used first
+    std::vector<LruList> lru;
+    uint64_t size = 0;
+  };
+  static constexpr size_t SHARDS = 16;
+
+  Shard& getShard(const std::string& zset);
+  void setNode(Shard* shard,
+               std::unordered_map<std::string, Zset>::iterator it,
+               uint64_t pos,
+               const ZSlEleValue& val);
+  void dropNode(Shard* shard, Zset* zs, uint64_t pos);
+  void dropZset(Shard* shard,
+                std::unordered_map<std::string, Zset>::iterator it);
+  void evict(Shard* shard);
+
+  const uint64_t _shardCapacity;
+  std::array<Shard, SHARDS> _shards;
+  std::atomic<uint64_t> _hits;
+  std::atomic<uint64_t> _misses;
+};
+
+// the zsets written before the score index are indexed by their writes,
+// every SkipList indexes at most SCORE_INDEX_BATCH members of them, from
+// where the last one stopped
 class SkipList {
  public:
+  static constexpr uint32_t SCORE_INDEX_BATCH = 1024;
   using PSE = std::unique_ptr<ZSlEleValue>;
   using PSE_MAP = std::map<uint64_t, SkipList::PSE>;
   SkipList(uint32_t chunkId,
@@ -83,9 +167,11 @@ class SkipList {
   uint64_t getAlloc() const;
   uint64_t getTail() const;
   uint8_t getLevel() const;
+  bool hasScoreIndex() const;
   ZSlEleValue* getCacheNode(uint64_t pos);
 
   uint32_t nGetFromCache;
+  uint32_t nGetFromShared;
   uint32_t nGetFromStore;
   uint32_t nInserted;
   uint32_t nUpdated;
@@ -101,16 +187,42 @@ class SkipList {
   Expected<ZSlEleValue*> getEleByRank(uint32_t rank, Transaction* txn);
   Expected<ZSlEleValue*> getNode(uint64_t pointer, Transaction* txn);
   std::pair<uint64_t, PSE> makeNode(double score, const std::string& subkey);
+  RecordKey indexKey(const std::string& sk) const;
+  RecordKey hashKey(const std::string& member) const;
+  Status ensureScoreIndex(Transaction* txn);
+  // whether the member is kept in the score index, it's complete or has
+  // been built beyond the member
+  bool isIndexed(const std::string& member) const;
+  // scan the score index from sk, backward if rev. cmp returns < 0 for
+  // the elements before the range, and > 0 for the ones after it.
+  Expected<std::list<std::pair<double, std::string>>> scanIndex(
+    const std::string& sk,
+    uint64_t offset,
+    uint64_t limit,
+    bool rev,
+    const std::function<int(double, const std::string&)>& cmp,
+    Transaction* txn);
   const uint8_t _maxLevel;
   uint8_t _level;
   uint32_t _count;
   uint64_t _tail;
   uint64_t _posAlloc;
+  bool _scoreIndex;
+  bool _scoreIndexBuilding;
+  std::string _scoreIndexNext;
+  // a batch of the score index has been built by this one
+  bool _scoreIndexBuilt;
   uint32_t _chunkId;
   uint32_t _dbId;
   std::string _pk;
   PStore _store;
   PSE_MAP cache;
+  SkipListCache* _sharedCache;
+  std::string _cacheKey;
+  // the encoded meta the nodes read belong to
+  std::string _version;
+  // the nodes deleted since the last save()
+  std::vector<uint64_t> _deleted;
 };
 
 }  // namespace tendisplus
@@ -5,6 +5,10 @@
 #include <fstream>
 #include <utility>
 #include <algorithm>
+#include <functional>
+#include <list>
+#include <map>
+#include <set>
 #include "glog/logging.h"
 #include "gtest/gtest.h"
 #include "tendisplus/utils/status.h"
@@ -449,4 +453,434 @@ TEST(SkipList, Common) {
   LOG(INFO) << "skiplist level:" << static_cast<uint32_t>(sl.getLevel());
 }
 
+std::list<std::pair<double, std::string>> modelRange(
+  const std::set<std::pair<double, std::string>>& model,
+  const std::function<bool(const std::pair<double, std::string>&)>& inRange,
+  uint64_t offset,
+  uint64_t limit,
+  bool rev) {
+  std::list<std::pair<double, std::string>> result;
+  for (const auto& v : model) {
+    if (inRange(v)) {
+      result.push_back(v);
+    }
+  }
+  if (rev) {
+    result.reverse();
+  }
+  while (offset-- > 0 && !result.empty()) {
+    result.pop_front();
+  }
+  while (result.size() > limit) {
+    result.pop_back();
+  }
+  return result;
+}
+
+void checkScoreIndex(SkipList* sl,
+                     const std::set<std::pair<double, std::string>>& model,
+                     Transaction* txn) {
+  for (uint32_t i = 0; i < 100; i++) {
+    Zrangespec range;
+    range.min = rand() % 40 - 20;
+    range.max = range.min + rand() % 20;
+    range.minex = rand() % 2;
+    range.maxex = rand() % 2;
+    uint64_t offset = rand() % 3;
+    uint64_t limit = rand() % 2 ? (uint64_t)-1 : rand() % 10;
+    bool rev = rand() % 2;
+    auto inRange = [&range](const std::pair<double, std::string>& v) {
+      return (range.minex ? v.first > range.min : v.first >= range.min) &&
+        (range.maxex ? v.first < range.max : v.first <= range.max);
+    };
+    auto eles = sl->scanByScore(range, offset, limit, rev, txn);
+    EXPECT_TRUE(eles.ok());
+    EXPECT_EQ(eles.value(), modelRange(model, inRange, offset, limit, rev));
+  }
+}
+
+TEST(SkipList, ScoreIndex) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+
+  // a zset written before the score index, with its hash elements
+  ZSlMetaValue meta(1, 1, 0);
+  RecordKey head(0,
+                 0,
+                 RecordType::RT_ZSET_S_ELE,
+                 "test",
+                 std::to_string(ZSlMetaValue::HEAD_ID));
+  ZSlEleValue headVal;
+  RecordValue subRv(headVal.encode(), RecordType::RT_ZSET_S_ELE, -1);
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  EXPECT_TRUE(store->setKV(head, subRv, eTxn.value().get()).ok());
+  SkipList sl(0, 0, "test", meta, store);
+  std::set<std::pair<double, std::string>> model;
+  for (uint32_t i = 0; i < 500; i++) {
+    double score = rand() % 40 - 20;
+    std::string member = std::to_string(i);
+    if (i % 7 == 0) {
+      member.push_back('\0');
+    }
+    EXPECT_TRUE(sl.insert(score, member, eTxn.value().get()).ok());
+    RecordKey hk(0, 0, RecordType::RT_ZSET_H_ELE, "test", member);
+    RecordValue hv(score, RecordType::RT_ZSET_H_ELE);
+    EXPECT_TRUE(store->setKV(hk, hv, eTxn.value().get()).ok());
+    model.insert({score, member});
+  }
+  // the index of the empty zset is built by the first insert
+  EXPECT_TRUE(sl.hasScoreIndex());
+  EXPECT_TRUE(
+    sl.save(eTxn.value().get(), {ErrorCodes::ERR_NOTFOUND, ""}, -1).ok());
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+
+  eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  checkScoreIndex(&sl, model, eTxn.value().get());
+
+  // drop the index, it's rebuilt by the next write
+  RecordKey mk(0, 0, RecordType::RT_ZSET_META, "test", "");
+  auto eMeta = store->getKV(mk, eTxn.value().get());
+  EXPECT_TRUE(eMeta.ok());
+  auto eMetaContent = ZSlMetaValue::decode(eMeta.value().getValue());
+  EXPECT_TRUE(eMetaContent.ok());
+  meta = eMetaContent.value();
+  EXPECT_TRUE(meta.hasScoreIndex());
+  meta.setScoreIndex(false);
+  for (const auto& v : model) {
+    RecordKey ik(0,
+                 0,
+                 RecordType::RT_ZSET_I_ELE,
+                 "test",
+                 ZSlMetaValue::scoreIndexKey(v.first, v.second));
+    EXPECT_TRUE(store->delKV(ik, eTxn.value().get()).ok());
+  }
+  SkipList sl2(0, 0, "test", meta, store);
+  EXPECT_FALSE(sl2.hasScoreIndex());
+  checkScoreIndex(&sl2, model, eTxn.value().get());
+
+  auto v = *model.begin();
+  EXPECT_TRUE(sl2.remove(v.first, v.second, eTxn.value().get()).ok());
+  RecordKey hk(0, 0, RecordType::RT_ZSET_H_ELE, "test", v.second);
+  EXPECT_TRUE(store->delKV(hk, eTxn.value().get()).ok());
+  model.erase(v);
+  EXPECT_TRUE(sl2.hasScoreIndex());
+  auto removed = sl2.removeRangeByScore({-5, 5, 0, 1}, eTxn.value().get());
+  EXPECT_TRUE(removed.ok());
+  for (const auto& r : removed.value()) {
+    EXPECT_TRUE(r.first >= -5 && r.first < 5);
+    model.erase(r);
+  }
+  EXPECT_TRUE(
+    sl2.save(eTxn.value().get(), {ErrorCodes::ERR_NOTFOUND, ""}, -1).ok());
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+
+  eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  checkScoreIndex(&sl2, model, eTxn.value().get());
+}
+
+TEST(SkipList, ScoreIndexBatches) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+
+  // a zset written before the score index
+  ZSlMetaValue meta(1, 1, 0);
+  meta.setScoreIndex(true);
+  RecordKey head(0,
+                 0,
+                 RecordType::RT_ZSET_S_ELE,
+                 "test",
+                 std::to_string(ZSlMetaValue::HEAD_ID));
+  ZSlEleValue headVal;
+  RecordValue subRv(headVal.encode(), RecordType::RT_ZSET_S_ELE, -1);
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  EXPECT_TRUE(store->setKV(head, subRv, eTxn.value().get()).ok());
+  SkipList sl(0, 0, "test", meta, store);
+  std::set<std::pair<double, std::string>> model;
+  std::map<std::string, double> scores;
+  for (uint32_t i = 0; i < 2 * SkipList::SCORE_INDEX_BATCH + 100; i++) {
+    double score = rand() % 40 - 20;
+    std::string member = std::to_string(i);
+    EXPECT_TRUE(sl.insert(score, member, eTxn.value().get()).ok());
+    RecordKey hk(0, 0, RecordType::RT_ZSET_H_ELE, "test", member);
+    RecordValue hv(score, RecordType::RT_ZSET_H_ELE);
+    EXPECT_TRUE(store->setKV(hk, hv, eTxn.value().get()).ok());
+    model.insert({score, member});
+    scores[member] = score;
+  }
+  for (const auto& v : model) {
+    RecordKey ik(0,
+                 0,
+                 RecordType::RT_ZSET_I_ELE,
+                 "test",
+                 ZSlMetaValue::scoreIndexKey(v.first, v.second));
+    EXPECT_TRUE(store->delKV(ik, eTxn.value().get()).ok());
+  }
+  EXPECT_TRUE(
+    sl.save(eTxn.value().get(), {ErrorCodes::ERR_NOTFOUND, ""}, -1).ok());
+  RecordKey mk(0, 0, RecordType::RT_ZSET_META, "test", "");
+  auto eMeta = store->getKV(mk, eTxn.value().get());
+  EXPECT_TRUE(eMeta.ok());
+  meta = ZSlMetaValue::decode(eMeta.value().getValue()).value();
+  meta.setScoreIndex(false);
+  RecordValue mv(meta.encode(), RecordType::RT_ZSET_META, -1);
+  EXPECT_TRUE(store->setKV(mk, mv, eTxn.value().get()).ok());
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+
+  // every write indexes a batch, and changes the score of a member, which
+  // is indexed already or not yet
+  for (uint32_t i = 0; i < 3; i++) {
+    eTxn = store->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    Transaction* txn = eTxn.value().get();
+    eMeta = store->getKV(mk, txn);
+    EXPECT_TRUE(eMeta.ok());
+    meta = ZSlMetaValue::decode(eMeta.value().getValue()).value();
+    EXPECT_FALSE(meta.hasScoreIndex());
+    EXPECT_EQ(meta.isScoreIndexBuilding(), i > 0);
+    SkipList sl2(0, 0, "test", meta, store);
+    checkScoreIndex(&sl2, model, txn);
+
+    for (auto member : {std::to_string(i), std::to_string(2000 + i)}) {
+      double score = scores[member];
+      EXPECT_TRUE(sl2.remove(score, member, txn).ok());
+      model.erase({score, member});
+      score += 100;
+      EXPECT_TRUE(sl2.insert(score, member, txn).ok());
+      RecordKey hk(0, 0, RecordType::RT_ZSET_H_ELE, "test", member);
+      RecordValue hv(score, RecordType::RT_ZSET_H_ELE);
+      EXPECT_TRUE(store->setKV(hk, hv, txn).ok());
+      model.insert({score, member});
+      scores[member] = score;
+    }
+    EXPECT_EQ(sl2.hasScoreIndex(), i == 2);
+    EXPECT_TRUE(sl2.save(txn, eMeta, -1).ok());
+    EXPECT_TRUE(eTxn.value()->commit().ok());
+  }
+
+  // the index has all the members with their scores, and nothing else
+  eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+  meta = ZSlMetaValue::decode(store->getKV(mk, txn).value().getValue())
+           .value();
+  EXPECT_TRUE(meta.hasScoreIndex());
+  SkipList sl3(0, 0, "test", meta, store);
+  checkScoreIndex(&sl3, model, txn);
+  RecordKey ik(0, 0, RecordType::RT_ZSET_I_ELE, "test", "");
+  auto cursor = txn->createDataCursor();
+  cursor->seek(ik.prefixPk());
+  std::set<std::pair<double, std::string>> indexed;
+  while (true) {
+    auto rcd = cursor->next();
+    if (!rcd.ok() || rcd.value().getRecordKey().prefixPk() != ik.prefixPk()) {
+      break;
+    }
+    auto ele = ZSlMetaValue::decodeScoreIndexKey(
+      rcd.value().getRecordKey().getSecondaryKey());
+    EXPECT_TRUE(ele.ok());
+    indexed.insert(ele.value());
+  }
+  EXPECT_EQ(indexed, model);
+}
+
+TEST(SkipList, LexIndex) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+
+  ZSlMetaValue meta(1, 1, 0);
+  meta.setScoreIndex(true);
+  RecordKey head(0,
+                 0,
+                 RecordType::RT_ZSET_S_ELE,
+                 "test",
+                 std::to_string(ZSlMetaValue::HEAD_ID));
+  ZSlEleValue headVal;
+  RecordValue subRv(headVal.encode(), RecordType::RT_ZSET_S_ELE, -1);
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  EXPECT_TRUE(store->setKV(head, subRv, eTxn.value().get()).ok());
+  SkipList sl(0, 0, "test", meta, store);
+  std::set<std::pair<double, std::string>> model;
+  for (uint32_t i = 0; i < 300; i++) {
+    std::string member = std::to_string(rand() % 1000);
+    if (model.count({1, member})) {
+      continue;
+    }
+    EXPECT_TRUE(sl.insert(1, member, eTxn.value().get()).ok());
+    model.insert({1, member});
+  }
+  EXPECT_TRUE(
+    sl.save(eTxn.value().get(), {ErrorCodes::ERR_NOTFOUND, ""}, -1).ok());
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+
+  eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  for (uint32_t i = 0; i < 100; i++) {
+    Zlexrangespec range;
+    range.min = i % 10 == 0 ? ZLEXMIN : std::to_string(rand() % 1000);
+    range.max = i % 10 == 1 ? ZLEXMAX : std::to_string(rand() % 1000);
+    range.minex = rand() % 2;
+    range.maxex = rand() % 2;
+    uint64_t offset = rand() % 3;
+    uint64_t limit = rand() % 2 ? (uint64_t)-1 : rand() % 10;
+    bool rev = rand() % 2;
+    auto inRange = [&range](const std::pair<double, std::string>& v) {
+      bool gteMin = range.min == ZLEXMIN ||
+        (range.minex ? v.second > range.min : v.second >= range.min);
+      bool lteMax = range.max == ZLEXMAX ||
+        (range.maxex ? v.second < range.max : v.second <= range.max);
+      return gteMin && lteMax;
+    };
+    auto eles = sl.scanByLex(range, offset, limit, rev, eTxn.value().get());
+    EXPECT_TRUE(eles.ok());
+    EXPECT_EQ(eles.value(), modelRange(model, inRange, offset, limit, rev));
+  }
+}
+
+TEST(SkipList, SharedCache) {
+  // 16 shards of 3 nodes
+  SkipListCache cache(48);
+  std::string zset = SkipListCache::zsetKey(0, 0, "test");
+  ZSlEleValue head, v1(1, "a"), v2(2, "b"), v3(3, "c"), out;
+  v2.setForward(2, 4);
+  cache.put(zset, "v1", ZSlMetaValue::HEAD_ID, head);
+  cache.put(zset, "v1", 2, v1);
+  cache.put(zset, "v1", 3, v2);
+  EXPECT_EQ(cache.size(), 3U);
+  EXPECT_TRUE(cache.get(zset, "v1", 2, &out));
+  EXPECT_EQ(out.getSubKey(), "a");
+  EXPECT_FALSE(cache.get(zset, "v0", 2, &out));
+  EXPECT_FALSE(cache.get(zset, "v1", 4, &out));
+  EXPECT_EQ(cache.getHits(), 1U);
+  EXPECT_EQ(cache.getMisses(), 2U);
+
+  // the nodes of level 1 are evicted first
+  cache.put(zset, "v1", 4, v3);
+  EXPECT_EQ(cache.size(), 3U);
+  EXPECT_FALSE(cache.get(zset, "v1", 2, &out));
+  EXPECT_TRUE(cache.get(zset, "v1", ZSlMetaValue::HEAD_ID, &out));
+  EXPECT_TRUE(cache.get(zset, "v1", 3, &out));
+
+  // a write moves the nodes to its version
+  cache.update(zset, "v1", "v2", {{2, &v1}}, {4});
+  EXPECT_FALSE(cache.get(zset, "v1", 3, &out));
+  EXPECT_TRUE(cache.get(zset, "v2", 3, &out));
+  EXPECT_TRUE(cache.get(zset, "v2", 2, &out));
+  EXPECT_FALSE(cache.get(zset, "v2", 4, &out));
+  // the write of another version drops them
+  cache.update(zset, "v1", "v3", {{4, &v3}}, {});
+  EXPECT_FALSE(cache.get(zset, "v3", 3, &out));
+  EXPECT_TRUE(cache.get(zset, "v3", 4, &out));
+  EXPECT_EQ(cache.size(), 1U);
+  cache.invalidate(zset);
+  EXPECT_EQ(cache.size(), 0U);
+
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  EXPECT_NE(store->getSkipListCache(), nullptr);
+
+  ZSlMetaValue meta(1, 1, 0);
+  RecordKey hk(0,
+               0,
+               RecordType::RT_ZSET_S_ELE,
+               "test",
+               std::to_string(ZSlMetaValue::HEAD_ID));
+  RecordValue subRv(head.encode(), RecordType::RT_ZSET_S_ELE, -1);
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  EXPECT_TRUE(store->setKV(hk, subRv, eTxn.value().get()).ok());
+  SkipList sl(0, 0, "test", meta, store);
+  for (uint32_t i = 0; i < 200; i++) {
+    EXPECT_TRUE(sl.insert(i, std::to_string(i), eTxn.value().get()).ok());
+  }
+  EXPECT_TRUE(
+    sl.save(eTxn.value().get(), {ErrorCodes::ERR_NOTFOUND, ""}, -1).ok());
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+
+  auto readMeta = [&store](Transaction* txn) {
+    RecordKey mk(0, 0, RecordType::RT_ZSET_META, "test", "");
+    auto eMeta = store->getKV(mk, txn);
+    EXPECT_TRUE(eMeta.ok());
+    auto eMetaContent = ZSlMetaValue::decode(eMeta.value().getValue());
+    EXPECT_TRUE(eMetaContent.ok());
+    return eMetaContent.value();
+  };
+
+  // the nodes written by the last transaction are shared
+  eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  SkipList sl2(0, 0, "test", readMeta(eTxn.value().get()), store);
+  auto r = sl2.rank(150, "150", eTxn.value().get());
+  EXPECT_TRUE(r.ok());
+  EXPECT_EQ(r.value(), 151U);
+  EXPECT_GT(sl2.nGetFromShared, 0U);
+  EXPECT_EQ(sl2.nGetFromStore, 0U);
+
+  // a new zset of the same key isn't confused with the old one
+  RecordKey mk(0, 0, RecordType::RT_ZSET_META, "test", "");
+  EXPECT_TRUE(store->delKV(mk, eTxn.value().get()).ok());
+  EXPECT_TRUE(store->setKV(hk, subRv, eTxn.value().get()).ok());
+  SkipList sl3(0, 0, "test", meta, store);
+  for (uint32_t i = 0; i < 200; i++) {
+    EXPECT_TRUE(sl3.insert(i, "n" + std::to_string(i),
+                           eTxn.value().get()).ok());
+  }
+  EXPECT_TRUE(
+    sl3.save(eTxn.value().get(), {ErrorCodes::ERR_NOTFOUND, ""}, -1).ok());
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+
+  eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  SkipList sl4(0, 0, "test", readMeta(eTxn.value().get()), store);
+  auto l = sl4.scanByRank(0, 200, false, eTxn.value().get());
+  EXPECT_TRUE(l.ok());
+  EXPECT_EQ(l.value().size(), 200U);
+  EXPECT_EQ(l.value().back().second, "n199");
+
+  // dropped, the nodes are read from the store
+  store->getSkipListCache()->invalidate(zset);
+  SkipList sl5(0, 0, "test", readMeta(eTxn.value().get()), store);
+  r = sl5.rank(150, "n150", eTxn.value().get());
+  EXPECT_TRUE(r.ok());
+  EXPECT_EQ(r.value(), 151U);
+  EXPECT_EQ(sl5.nGetFromShared, 0U);
+  EXPECT_GT(sl5.nGetFromStore, 0U);
+}
+
 }  // namespace tendisplus
@@ -8,6 +8,12 @@
 #include <stdarg.h>
 #include <sstream>
 #include <utility>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TENDIS_BITOPS_X86
+#include <immintrin.h>
+#endif
 
 #include "glog/logging.h"
 #include "tendisplus/utils/invariant.h"
@@ -142,7 +148,7 @@ int stringmatchlen(const char* pattern,
   return 0;
 }
 
-int64_t bitPos(const void* s, size_t count, uint32_t bit) {
+int64_t bitPosScalar(const void* s, size_t count, uint32_t bit) {
   unsigned long* l;  // NOLINT:runtime/int
   unsigned char* c;
   unsigned long skipval, word = 0, one;  // NOLINT:runtime/int
@@ -227,7 +233,7 @@ int64_t bitPos(const void* s, size_t count, uint32_t bit) {
   return 0; /* Just to avoid warnings. */
 }
 
-size_t popCount(const void* s, long count) {  // (NOLINT)
+size_t popCountScalar(const void* s, long count) {  // (NOLINT)
   size_t bits = 0;
   const unsigned char* p = static_cast<const unsigned char*>(s);
   uint32_t* p4;
@@ -281,6 +287,274 @@ size_t popCount(const void* s, long count) {  // (NOLINT)
   return bits;
 }
 
+void bitOpScalar(BitOp op,
+                 unsigned char* dst,
+                 size_t len,
+                 const std::vector<const std::string*>& srcs) {
+  INVARIANT_D(!srcs.empty());
+  const std::string& first = *srcs[0];
+  size_t n = std::min(len, first.size());
+  memcpy(dst, first.data(), n);
+  memset(dst + n, 0, len - n);
+  if (op == BitOp::BITOP_NOT) {
+    for (size_t i = 0; i < len; ++i) {
+      dst[i] = ~dst[i];
+    }
+    return;
+  }
+
+  for (size_t j = 1; j < srcs.size(); ++j) {
+    const unsigned char* src =
+      reinterpret_cast<const unsigned char*>(srcs[j]->data());
+    n = std::min(len, srcs[j]->size());
+    size_t i = 0;
+    /* Combine a word at a time, memcpy() keeps unaligned access legal. */
+    for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+      uint64_t a, b;
+      memcpy(&a, dst + i, sizeof(a));
+      memcpy(&b, src + i, sizeof(b));
+      switch (op) {
+        case BitOp::BITOP_AND:
+          a &= b;
+          break;
+        case BitOp::BITOP_OR:
+          a |= b;
+          break;
+        case BitOp::BITOP_XOR:
+          a ^= b;
+          break;
+        default:
+          INVARIANT_D(0);
+      }
+      memcpy(dst + i, &a, sizeof(a));
+    }
+    for (; i < n; ++i) {
+      switch (op) {
+        case BitOp::BITOP_AND:
+          dst[i] &= src[i];
+          break;
+        case BitOp::BITOP_OR:
+          dst[i] |= src[i];
+          break;
+        case BitOp::BITOP_XOR:
+          dst[i] ^= src[i];
+          break;
+        default:
+          INVARIANT_D(0);
+      }
+    }
+    /* The source is zero padded: AND clears the tail, OR/XOR keep it. */
+    if (op == BitOp::BITOP_AND) {
+      memset(dst + n, 0, len - n);
+    }
+  }
+}
+
+namespace {
+
+struct BitKernels {
+  const char* name;
+  size_t (*popCount)(const void* s, long count);  // (NOLINT)
+  int64_t (*bitPos)(const void* s, size_t count, uint32_t bit);
+  void (*bitOp)(BitOp op,
+                unsigned char* dst,
+                size_t len,
+                const std::vector<const std::string*>& srcs);
+};
+
+#ifdef TENDIS_BITOPS_X86
+__attribute__((target("popcnt"))) size_t popCountPopcnt(
+  const void* s,
+  long count) {  // (NOLINT)
+  const unsigned char* p = static_cast<const unsigned char*>(s);
+  size_t bits = 0;
+  while (count >= 32) {
+    uint64_t w[4];
+    memcpy(w, p, sizeof(w));
+    bits += __builtin_popcountll(w[0]) + __builtin_popcountll(w[1]) +
+      __builtin_popcountll(w[2]) + __builtin_popcountll(w[3]);
+    p += 32;
+    count -= 32;
+  }
+  while (count >= 8) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    bits += __builtin_popcountll(w);
+    p += 8;
+    count -= 8;
+  }
+  while (count-- > 0) {
+    bits += __builtin_popcount(*p++);
+  }
+  return bits;
+}
+
+/* Nibble lookup popcount (vpshufb), bytes are summed into 64 bit lanes
+ * by vpsadbw, so there is no overflow whatever the length is. */
+__attribute__((target("avx2,popcnt"))) size_t popCountAvx2(
+  const void* s,
+  long count) {  // (NOLINT)
+  const unsigned char* p = static_cast<const unsigned char*>(s);
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4,
+                                          0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i lowMask = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc = _mm256_setzero_si256();
+  while (count >= 64) {
+    __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+    __m256i c1 = _mm256_add_epi8(
+      _mm256_shuffle_epi8(lookup, _mm256_and_si256(v1, lowMask)),
+      _mm256_shuffle_epi8(lookup,
+                          _mm256_and_si256(_mm256_srli_epi16(v1, 4), lowMask)));
+    __m256i c2 = _mm256_add_epi8(
+      _mm256_shuffle_epi8(lookup, _mm256_and_si256(v2, lowMask)),
+      _mm256_shuffle_epi8(lookup,
+                          _mm256_and_si256(_mm256_srli_epi16(v2, 4), lowMask)));
+    acc = _mm256_add_epi64(acc,
+                           _mm256_sad_epu8(_mm256_add_epi8(c1, c2), zero));
+    p += 64;
+    count -= 64;
+  }
+  size_t bits = _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +
+    _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+  return bits + popCountPopcnt(p, count);
+}
+
+/* Skip 32 byte blocks which are all zeros (looking for 1) or all ones
+ * (looking for 0), then let the scalar code find the exact bit. */
+__attribute__((target("avx2"))) int64_t bitPosAvx2(const void* s,
+                                                   size_t count,
+                                                   uint32_t bit) {
+  const unsigned char* p = static_cast<const unsigned char*>(s);
+  const __m256i ones = _mm256_set1_epi8(-1);
+  size_t skipped = 0;
+  while (count - skipped >= 32) {
+    __m256i v =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + skipped));
+    int skip = bit ? _mm256_testz_si256(v, v) : _mm256_testc_si256(v, ones);
+    if (!skip) {
+      break;
+    }
+    skipped += 32;
+  }
+  int64_t pos = bitPosScalar(p + skipped, count - skipped, bit);
+  if (pos == -1) {
+    return -1;
+  }
+  return pos + static_cast<int64_t>(skipped) * 8;
+}
+
+__attribute__((target("avx2"))) void bitOpAvx2(
+  BitOp op,
+  unsigned char* dst,
+  size_t len,
+  const std::vector<const std::string*>& srcs) {
+  INVARIANT_D(!srcs.empty());
+  const std::string& first = *srcs[0];
+  size_t n = std::min(len, first.size());
+  memcpy(dst, first.data(), n);
+  memset(dst + n, 0, len - n);
+  if (op == BitOp::BITOP_NOT) {
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+      __m256i* d = reinterpret_cast<__m256i*>(dst + i);
+      _mm256_storeu_si256(d, _mm256_xor_si256(_mm256_loadu_si256(d), ones));
+    }
+    for (; i < len; ++i) {
+      dst[i] = ~dst[i];
+    }
+    return;
+  }
+
+  for (size_t j = 1; j < srcs.size(); ++j) {
+    const unsigned char* src =
+      reinterpret_cast<const unsigned char*>(srcs[j]->data());
+    n = std::min(len, srcs[j]->size());
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+      __m256i* d = reinterpret_cast<__m256i*>(dst + i);
+      __m256i a = _mm256_loadu_si256(d);
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      switch (op) {
+        case BitOp::BITOP_AND:
+          a = _mm256_and_si256(a, b);
+          break;
+        case BitOp::BITOP_OR:
+          a = _mm256_or_si256(a, b);
+          break;
+        case BitOp::BITOP_XOR:
+          a = _mm256_xor_si256(a, b);
+          break;
+        default:
+          INVARIANT_D(0);
+      }
+      _mm256_storeu_si256(d, a);
+    }
+    for (; i < n; ++i) {
+      switch (op) {
+        case BitOp::BITOP_AND:
+          dst[i] &= src[i];
+          break;
+        case BitOp::BITOP_OR:
+          dst[i] |= src[i];
+          break;
+        case BitOp::BITOP_XOR:
+          dst[i] ^= src[i];
+          break;
+        default:
+          INVARIANT_D(0);
+      }
+    }
+    if (op == BitOp::BITOP_AND) {
+      memset(dst + n, 0, len - n);
+    }
+  }
+}
+#endif  // TENDIS_BITOPS_X86
+
+BitKernels selectBitKernels() {
+#ifdef TENDIS_BITOPS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+    return {"avx2", popCountAvx2, bitPosAvx2, bitOpAvx2};
+  }
+  if (__builtin_cpu_supports("popcnt")) {
+    return {"popcnt", popCountPopcnt, bitPosScalar, bitOpScalar};
+  }
+#endif
+  return {"generic", popCountScalar, bitPosScalar, bitOpScalar};
+}
+
+const BitKernels& bitKernels() {
+  static const BitKernels kernels = selectBitKernels();
+  return kernels;
+}
+
+}  // namespace
+
+size_t popCount(const void* s, long count) {  // (NOLINT)
+  return bitKernels().popCount(s, count);
+}
+
+int64_t bitPos(const void* s, size_t count, uint32_t bit) {
+  return bitKernels().bitPos(s, count, bit);
+}
+
+void bitOp(BitOp op,
+           unsigned char* dst,
+           size_t len,
+           const std::vector<const std::string*>& srcs) {
+  bitKernels().bitOp(op, dst, len, srcs);
+}
+
+const char* bitopsKernelName() {
+  return bitKernels().name;
+}
+
 /* Convert a long double into a string. If humanfriendly is non-zero
  * it does not use exponential format and trims trailing zeroes at the end,
  * however this results in loss of precision. Otherwise exp format is used
@@ -1158,6 +1432,8 @@ int getCommandFlags(const char* sflags) {
 #define geohashCommand NULL
 #define geoposCommand NULL
 #define geodistCommand NULL
+#define geosearchCommand NULL
+#define geosearchstoreCommand NULL
 #define pfselftestCommand NULL
 #define pfaddCommand NULL
 #define pfcountCommand NULL
@@ -1166,6 +1442,16 @@ int getCommandFlags(const char* sflags) {
 #define securityWarningCommand NULL
 #define securityWarningCommand NULL
 #define latencyCommand NULL
+#define xaddCommand NULL
+#define xrangeCommand NULL
+#define xrevrangeCommand NULL
+#define xlenCommand NULL
+#define xreadCommand NULL
+#define xgroupCommand NULL
+#define xackCommand NULL
+#define xpendingCommand NULL
+#define xdelCommand NULL
+#define xtrimCommand NULL
 
 // take care of it!
 #define zunionInterGetKeys NULL
@@ -1178,6 +1464,7 @@ int getCommandFlags(const char* sflags) {
 #define georadiusGetKeys NULL
 #define georadiusGetKeys NULL
 #define georadiusGetKeys NULL
+#define xreadGetKeys NULL
 
 struct redisCommand redisCommandTable[] = {
   {"module", moduleCommand, -2, "as", 0, NULL, 0, 0, 0, 0, 0},
@@ -1356,11 +1643,24 @@ struct redisCommand redisCommandTable[] = {
   {"geohash", geohashCommand, -2, "r", 0, NULL, 1, 1, 1, 0, 0},
   {"geopos", geoposCommand, -2, "r", 0, NULL, 1, 1, 1, 0, 0},
   {"geodist", geodistCommand, -4, "r", 0, NULL, 1, 1, 1, 0, 0},
+  {"geosearch", geosearchCommand, -7, "r", 0, NULL, 1, 1, 1, 0, 0},
+  {"geosearchstore", geosearchstoreCommand, -8, "wm", 0, NULL, 1, 2, 1, 0, 0},  // NOLINT
   {"pfselftest", pfselftestCommand, 1, "a", 0, NULL, 0, 0, 0, 0, 0},
   {"pfadd", pfaddCommand, -2, "wmF", 0, NULL, 1, 1, 1, 0, 0},
   {"pfcount", pfcountCommand, -2, "r", 0, NULL, 1, -1, 1, 0, 0},
   {"pfmerge", pfmergeCommand, -2, "wm", 0, NULL, 1, -1, 1, 0, 0},
   {"pfdebug", pfdebugCommand, -3, "w", 0, NULL, 2, 2, 1, 0, 0},
+  {"xadd", xaddCommand, -5, "wmFR", 0, NULL, 1, 1, 1, 0, 0},
+  {"xrange", xrangeCommand, -4, "r", 0, NULL, 1, 1, 1, 0, 0},
+  {"xrevrange", xrevrangeCommand, -4, "r", 0, NULL, 1, 1, 1, 0, 0},
+  {"xlen", xlenCommand, 2, "rF", 0, NULL, 1, 1, 1, 0, 0},
+  {"xread", xreadCommand, -4, "rs", 0, xreadGetKeys, 1, 1, 1, 0, 0},
+  {"xreadgroup", xreadCommand, -7, "ws", 0, xreadGetKeys, 1, 1, 1, 0, 0},
+  {"xgroup", xgroupCommand, -2, "wm", 0, NULL, 2, 2, 1, 0, 0},
+  {"xack", xackCommand, -4, "wF", 0, NULL, 1, 1, 1, 0, 0},
+  {"xpending", xpendingCommand, -3, "rR", 0, NULL, 1, 1, 1, 0, 0},
+  {"xdel", xdelCommand, -3, "wF", 0, NULL, 1, 1, 1, 0, 0},
+  {"xtrim", xtrimCommand, -2, "wFR", 0, NULL, 1, 1, 1, 0, 0},
   {"post", securityWarningCommand, -1, "lt", 0, NULL, 0, 0, 0, 0, 0},
   {"host:", securityWarningCommand, -1, "lt", 0, NULL, 0, 0, 0, 0, 0},
   {"latency", latencyCommand, -2, "aslt", 0, NULL, 0, 0, 0, 0, 0}};
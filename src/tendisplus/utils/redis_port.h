@@ -48,6 +48,33 @@ int ld2string(char* buf, size_t len, long double value, int humanfriendly);
 size_t popCount(const void* s, long count);  // (NOLINT)
 
 int64_t bitPos(const void* s, size_t count, uint32_t bit);
+
+enum class BitOp {
+  BITOP_AND,
+  BITOP_OR,
+  BITOP_XOR,
+  BITOP_NOT,
+};
+
+/* Combine srcs into dst (len bytes) the way BITOP does. Sources shorter
+ * than len are treated as zero padded on the right. */
+void bitOp(BitOp op,
+           unsigned char* dst,
+           size_t len,
+           const std::vector<const std::string*>& srcs);
+
+/* The byte/word-at-a-time ports of redis code, popCount()/bitPos() pick
+ * a SIMD implementation at runtime when the cpu supports it. */
+size_t popCountScalar(const void* s, long count);  // (NOLINT)
+int64_t bitPosScalar(const void* s, size_t count, uint32_t bit);
+void bitOpScalar(BitOp op,
+                 unsigned char* dst,
+                 size_t len,
+                 const std::vector<const std::string*>& srcs);
+
+/* Name of the kernel set selected by the runtime cpu dispatch,
+ * "avx2", "popcnt" or "generic". */
+const char* bitopsKernelName();
 int random();
 
 /* Command flags. Please check the command table defined in the redis.c file
@@ -333,6 +360,114 @@ int hllUpdateByRawHpll(struct hllhdr* hdr,
                        size_t hdrMaxSize,
                        struct hllhdr* hdrRaw);
 
+/* ========================= Geohash begin ========================= */
+
+#define GEO_STEP_MAX 26 /* 26*2 = 52 bits. */
+
+/* Limits from EPSG:900913 / EPSG:3785 / OSGEO:41001 */
+#define GEO_LAT_MIN -85.05112878
+#define GEO_LAT_MAX 85.05112878
+#define GEO_LONG_MIN -180
+#define GEO_LONG_MAX 180
+
+#define HASHISZERO(r) (!(r).bits && !(r).step)
+#define RANGEISZERO(r) (!(r).max && !(r).min)
+#define RANGEPISZERO(r) (r == NULL || RANGEISZERO(*r))
+#define GZERO(s) s.bits = s.step = 0;
+
+typedef uint64_t GeoHashFix52Bits;
+
+struct GeoHashBits {
+  uint64_t bits;
+  uint8_t step;
+};
+
+struct GeoHashRange {
+  double min;
+  double max;
+};
+
+struct GeoHashArea {
+  GeoHashBits hash;
+  GeoHashRange longitude;
+  GeoHashRange latitude;
+};
+
+struct GeoHashNeighbors {
+  GeoHashBits north;
+  GeoHashBits east;
+  GeoHashBits west;
+  GeoHashBits south;
+  GeoHashBits north_east;
+  GeoHashBits south_east;
+  GeoHashBits north_west;
+  GeoHashBits south_west;
+};
+
+struct GeoHashRadius {
+  GeoHashBits hash;
+  GeoHashArea area;
+  GeoHashNeighbors neighbors;
+};
+
+#define CIRCULAR_TYPE 1
+#define RECTANGLE_TYPE 2
+
+/* the area of GEORADIUS/GEOSEARCH, sizes are in the unit of conversion */
+struct GeoShape {
+  int type;
+  double xy[2];
+  double conversion; /* the unit to meters */
+  double bounds[4];  /* the bounding box, min lon/lat and max lon/lat */
+  union {
+    double radius;
+    struct {
+      double height;
+      double width;
+    } r;
+  } t;
+};
+
+void geohashGetCoordRange(GeoHashRange* long_range, GeoHashRange* lat_range);
+int geohashEncode(const GeoHashRange* long_range,
+                  const GeoHashRange* lat_range,
+                  double longitude,
+                  double latitude,
+                  uint8_t step,
+                  GeoHashBits* hash);
+int geohashEncodeWGS84(double longitude,
+                       double latitude,
+                       uint8_t step,
+                       GeoHashBits* hash);
+int geohashDecode(const GeoHashRange long_range,
+                  const GeoHashRange lat_range,
+                  const GeoHashBits hash,
+                  GeoHashArea* area);
+int geohashDecodeToLongLatWGS84(const GeoHashBits hash, double* xy);
+void geohashNeighbors(const GeoHashBits* hash, GeoHashNeighbors* neighbors);
+
+GeoHashRadius geohashCalculateAreasByShapeWGS84(GeoShape* shape);
+GeoHashFix52Bits geohashAlign52Bits(const GeoHashBits hash);
+double geohashGetDistance(double lon1d,
+                          double lat1d,
+                          double lon2d,
+                          double lat2d);
+int geohashGetDistanceIfInRadiusWGS84(double x1,
+                                      double y1,
+                                      double x2,
+                                      double y2,
+                                      double radius,
+                                      double* distance);
+int geohashGetDistanceIfInRectangle(double width_m,
+                                    double height_m,
+                                    double x1,
+                                    double y1,
+                                    double x2,
+                                    double y2,
+                                    double* distance);
+
+/* ========================= Geohash end ========================= */
+
 unsigned int lzf_decompress(const void* const in_data,
                             unsigned int in_len,
                             void* out_data,
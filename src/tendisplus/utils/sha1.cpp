@@ -0,0 +1,107 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <cstdint>
+#include <string>
+
+#include "tendisplus/utils/sha1.h"
+
+namespace tendisplus {
+
+namespace {
+
+inline uint32_t rol(uint32_t v, int bits) {
+  return (v << bits) | (v >> (32 - bits));
+}
+
+void sha1Block(uint32_t state[5], const unsigned char* block) {
+  uint32_t w[80];
+  for (int i = 0; i < 16; i++) {
+    w[i] = (static_cast<uint32_t>(block[i * 4]) << 24) |
+      (static_cast<uint32_t>(block[i * 4 + 1]) << 16) |
+      (static_cast<uint32_t>(block[i * 4 + 2]) << 8) |
+      static_cast<uint32_t>(block[i * 4 + 3]);
+  }
+  for (int i = 16; i < 80; i++) {
+    w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+           e = state[4];
+  for (int i = 0; i < 80; i++) {
+    uint32_t f, k;
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDC;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6;
+    }
+    uint32_t t = rol(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = rol(b, 30);
+    b = a;
+    a = t;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+}  // namespace
+
+std::string sha1(const std::string& data) {
+  uint32_t state[5] = {
+    0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+  auto p = reinterpret_cast<const unsigned char*>(data.data());
+  size_t full = data.size() / 64 * 64;
+  for (size_t i = 0; i < full; i += 64) {
+    sha1Block(state, p + i);
+  }
+
+  // the tail, 0x80, zero padding and the bit length in big endian
+  unsigned char tail[128] = {0};
+  size_t rest = data.size() - full;
+  for (size_t i = 0; i < rest; i++) {
+    tail[i] = p[full + i];
+  }
+  tail[rest] = 0x80;
+  size_t tailLen = rest + 1 + 8 <= 64 ? 64 : 128;
+  uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+  for (int i = 0; i < 8; i++) {
+    tail[tailLen - 1 - i] = static_cast<unsigned char>(bits >> (i * 8));
+  }
+  for (size_t i = 0; i < tailLen; i += 64) {
+    sha1Block(state, tail + i);
+  }
+
+  std::string digest(20, '\0');
+  for (int i = 0; i < 20; i++) {
+    digest[i] = static_cast<char>(state[i / 4] >> ((3 - i % 4) * 8));
+  }
+  return digest;
+}
+
+std::string sha1hex(const std::string& data) {
+  static const char* lookup = "0123456789abcdef";
+  auto digest = sha1(data);
+  std::string result(digest.size() * 2, '\0');
+  for (size_t i = 0; i < digest.size(); ++i) {
+    result[2 * i] = lookup[(digest[i] >> 4) & 0xf];
+    result[2 * i + 1] = lookup[digest[i] & 0x0f];
+  }
+  return result;
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,19 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_UTILS_SHA1_H_
+#define SRC_TENDISPLUS_UTILS_SHA1_H_
+
+#include <string>
+
+namespace tendisplus {
+
+// the 20 bytes SHA-1 digest of data
+std::string sha1(const std::string& data);
+// the 40 chars lower case hex SHA-1 digest, like redis' sha1hex()
+std::string sha1hex(const std::string& data);
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_UTILS_SHA1_H_
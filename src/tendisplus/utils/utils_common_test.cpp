@@ -13,12 +13,15 @@
 #include <algorithm>
 #include <bitset>
 #include <random>
+#include <functional>
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/time.h"
 #include "tendisplus/utils/param_manager.h"
 #include "tendisplus/utils/test_util.h"
 #include "tendisplus/cluster/cluster_manager.h"
 #include "tendisplus/utils/base64.h"
+#include "tendisplus/utils/sha1.h"
+#include "tendisplus/utils/redis_port.h"
 #include "gtest/gtest.h"
 #include "glog/logging.h"
 
@@ -153,6 +156,38 @@ TEST(Base64, common) {
   EXPECT_EQ(data, decode);
 }
 
+TEST(SHA1, common) {
+  EXPECT_EQ(sha1hex(""), "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+  EXPECT_EQ(sha1hex("abc"), "a9993e364706816aba3e25717850c26c9cd0d89d");
+  EXPECT_EQ(
+    sha1hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+    "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+  EXPECT_EQ(sha1hex(std::string(1000, 'a')).size(), 40U);
+  EXPECT_EQ(sha1("abc").size(), 20U);
+}
+
+TEST(Geohash, common) {
+  using redis_port::GeoHashBits;
+  double xy[2];
+  GeoHashBits hash;
+  EXPECT_TRUE(
+    redis_port::geohashEncodeWGS84(13.361389, 38.115556, GEO_STEP_MAX, &hash));
+  EXPECT_EQ(hash.step, GEO_STEP_MAX);
+  EXPECT_EQ(redis_port::geohashAlign52Bits(hash), 3479099956230698ULL);
+  EXPECT_TRUE(redis_port::geohashDecodeToLongLatWGS84(hash, xy));
+  EXPECT_NEAR(xy[0], 13.361389, 0.00001);
+  EXPECT_NEAR(xy[1], 38.115556, 0.00001);
+
+  // Palermo to Catania
+  double dist =
+    redis_port::geohashGetDistance(13.361389, 38.115556, 15.087269, 37.502669);
+  EXPECT_NEAR(dist, 166274.15, 1);
+  EXPECT_TRUE(redis_port::geohashGetDistanceIfInRadiusWGS84(
+    13.361389, 38.115556, 15.087269, 37.502669, 200000, &dist));
+  EXPECT_FALSE(redis_port::geohashGetDistanceIfInRadiusWGS84(
+    13.361389, 38.115556, 15.087269, 37.502669, 100000, &dist));
+}
+
 TEST(bitsetEncode, common) {
   std::bitset<CLUSTER_SLOTS> bitmap;
   for (size_t j = 0; j < bitmap.size(); j++) {
@@ -198,6 +233,112 @@ TEST(bitsetEncode, common) {
   }
 }
 
+TEST(RedisPort, bitops) {
+  std::mt19937 gen(genRand());
+  for (int i = 0; i < 2000; i++) {
+    // mostly 0x00/0xff bytes so that bitPos has long runs to skip
+    size_t len = gen() % 300;
+    std::string s(len + 8, 0);
+    for (auto& c : s) {
+      c = (gen() % 4 == 0) ? gen() : ((gen() % 2) ? 0 : 0xff);
+    }
+    size_t off = gen() % 8;
+    EXPECT_EQ(redis_port::popCount(s.data() + off, len),
+              redis_port::popCountScalar(s.data() + off, len));
+    for (uint32_t bit = 0; bit < 2; bit++) {
+      EXPECT_EQ(redis_port::bitPos(s.data() + off, len, bit),
+                redis_port::bitPosScalar(s.data() + off, len, bit));
+    }
+
+    auto op = static_cast<redis_port::BitOp>(gen() % 4);
+    size_t numKeys = op == redis_port::BitOp::BITOP_NOT ? 1 : 1 + gen() % 4;
+    std::vector<std::string> vals;
+    std::vector<const std::string*> srcs;
+    size_t maxLen = 0;
+    for (size_t j = 0; j < numKeys; j++) {
+      vals.emplace_back(randomStr(gen() % 200, true));
+      maxLen = std::max(maxLen, vals.back().size());
+    }
+    for (const auto& v : vals) {
+      srcs.push_back(&v);
+    }
+    std::string expect(maxLen, 0);
+    for (size_t k = 0; k < maxLen; k++) {
+      unsigned char output = vals[0].size() <= k ? 0 : vals[0][k];
+      if (op == redis_port::BitOp::BITOP_NOT) {
+        output = ~output;
+      }
+      for (size_t j = 1; j < numKeys; j++) {
+        unsigned char byte = vals[j].size() <= k ? 0 : vals[j][k];
+        if (op == redis_port::BitOp::BITOP_AND) {
+          output &= byte;
+        } else if (op == redis_port::BitOp::BITOP_OR) {
+          output |= byte;
+        } else {
+          output ^= byte;
+        }
+      }
+      expect[k] = output;
+    }
+    std::string result(maxLen, 0);
+    redis_port::bitOp(
+      op, reinterpret_cast<unsigned char*>(&result[0]), maxLen, srcs);
+    EXPECT_EQ(result, expect);
+    std::string result2(maxLen, 0);
+    redis_port::bitOpScalar(
+      op, reinterpret_cast<unsigned char*>(&result2[0]), maxLen, srcs);
+    EXPECT_EQ(result2, expect);
+  }
+}
+
+TEST(RedisPort, bitopsBench) {
+  const size_t len = 16 * 1024 * 1024;
+  std::string a = randomStr(len, false);
+  std::string b = randomStr(len, false);
+  // a sparse bitmap, with the only set bit near the end
+  std::string sparse(len, 0);
+  sparse[len - 3] = 1;
+  std::vector<const std::string*> srcs = {&a, &b};
+  std::string dst(len, 0);
+  auto dstPtr = reinterpret_cast<unsigned char*>(&dst[0]);
+
+  auto bench = [](const char* name, const std::function<void()>& scalar,
+                  const std::function<void()>& simd) {
+    uint64_t t1 = nsSinceEpoch();
+    scalar();
+    uint64_t t2 = nsSinceEpoch();
+    simd();
+    uint64_t t3 = nsSinceEpoch();
+    LOG(INFO) << name << " 16MB scalar:" << (t2 - t1) / 1000
+              << "us " << redis_port::bitopsKernelName() << ":"
+              << (t3 - t2) / 1000 << "us";
+  };
+
+  size_t cnt1 = 0, cnt2 = 0;
+  bench("bitcount",
+        [&]() { cnt1 = redis_port::popCountScalar(a.data(), len); },
+        [&]() { cnt2 = redis_port::popCount(a.data(), len); });
+  EXPECT_EQ(cnt1, cnt2);
+
+  int64_t pos1 = 0, pos2 = 0;
+  bench("bitpos",
+        [&]() { pos1 = redis_port::bitPosScalar(sparse.data(), len, 1); },
+        [&]() { pos2 = redis_port::bitPos(sparse.data(), len, 1); });
+  EXPECT_EQ(pos1, pos2);
+  EXPECT_EQ(pos1, static_cast<int64_t>((len - 3) * 8 + 7));
+
+  std::string dst2(len, 0);
+  bench("bitop and",
+        [&]() {
+          redis_port::bitOpScalar(redis_port::BitOp::BITOP_AND,
+            reinterpret_cast<unsigned char*>(&dst2[0]), len, srcs);
+        },
+        [&]() {
+          redis_port::bitOp(redis_port::BitOp::BITOP_AND, dstPtr, len, srcs);
+        });
+  EXPECT_EQ(dst, dst2);
+}
+
 TEST(ParamManager, common) {
   ParamManager pm;
   const char* argv[] = {"--skey1=value", "--ikey1=123"};
@@ -30,6 +30,7 @@ runOne "./$dir/signalhandler_unittest"
 runOne "./$dir/symbolize_unittest"
 runOne "./$dir/atomic_utility_test"
 runOne "./$dir/index_mgr_test"
+runOne "./$dir/compaction_sched_test"
 runOne "./$dir/stacktrace_unittest"
 runOne "./$dir/status_test"
 runOne "./$dir/skiplist_test"